@@ -8,7 +8,8 @@
 #include "serialization/virtual_ibuf.hpp"
 bool Animation::serialize(std::vector<unsigned char>& buf) const {
     const uint32_t tag = *(uint32_t*)"SANM";
-    const uint32_t version = 0;
+    // 1: compressed clip after the root motion
+    const uint32_t version = 1;
 
     vofbuf vof;
 
@@ -50,6 +51,11 @@ bool Animation::serialize(std::vector<unsigned char>& buf) const {
         vof.write_vector(r_keyframes, true);
     }
 
+    vof.write<uint8_t>(is_compressed);
+    if (is_compressed) {
+        compressed.serialize(vof);
+    }
+
     buf.insert(buf.end(), vof.getData(), vof.getData() + vof.getSize());
     return true;
 }
@@ -64,6 +70,7 @@ bool Animation::deserialize(const void* data, size_t sz) {
 
     uint32_t node_count = vif.read<uint32_t>();
     nodes.resize(node_count);
+    packed_dirty = true;
     for (int i = 0; i < node_count; ++i) {
         auto& node = nodes[i];
         auto& t_curve = node.t;
@@ -106,6 +113,19 @@ bool Animation::deserialize(const void* data, size_t sz) {
         }
     }
 
+    is_compressed = false;
+    if (version >= 1) {
+        is_compressed = vif.read<uint8_t>() != 0;
+        if (is_compressed && !compressed.deserialize(vif)) {
+            return false;
+        }
+        if (is_compressed && compressed.nodeCount() != nodes.size()) {
+            LOG_ERR("Animation: compressed clip has " << compressed.nodeCount() << " nodes, expected " << nodes.size());
+            is_compressed = false;
+            return false;
+        }
+    }
+
     return true;
 }
 void Animation::serializeJson(nlohmann::json& json) const {
@@ -127,7 +147,7 @@ bool Animation::deserializeJson(const nlohmann::json& json) {
     return deserialize(buf.data(), buf.size());
 }
 
-bool Animation::load(byte_reader& in) {
+bool Animation::decode(byte_reader& in, ResourceLoadContext& ctx) {
     auto view = in.try_slurp();
     if (!view) {
         return false;
@@ -7,6 +7,8 @@
 #include "resource/resource.hpp"
 #include "math/gfxm.hpp"
 #include "curve.hpp"
+#include "animation_packed.hpp"
+#include "animation_compressed.hpp"
 #include "log/log.hpp"
 #include "animation/hitbox_sequence/hitbox_sequence.hpp"
 #include "animation/audio_sequence/audio_sequence.hpp"
@@ -25,11 +27,17 @@ struct AnimSample {
     gfxm::vec3 s;
 };
 
-class Animation : public ILoadable, public IWritable {
+class Animation : public IAsyncLoadable, public IWritable {
     std::vector<AnimNode> nodes;
     std::map<std::string, int> node_name_to_index;
     AnimNode root_motion_node;
     bool has_root_motion = false;
+    // Built from nodes on first use, any access that can change a node drops it
+    animPackedClip packed;
+    bool packed_dirty = true;
+    // Set by compress(), the node curves are emptied and everything samples from here instead
+    animCompressedClip compressed;
+    bool is_compressed = false;
 
     RHSHARED<hitboxCmdSequence> hitbox_sequence;
     RHSHARED<audioSequence>     audio_sequence;
@@ -41,16 +49,17 @@ public:
 
     void                                setHitboxSequence(const RHSHARED<hitboxCmdSequence>& hitbox_sequence) { this->hitbox_sequence = hitbox_sequence; }
     const RHSHARED<hitboxCmdSequence>&  getHitboxSequence() const { return hitbox_sequence; }
-    RHSHARED<hitboxCmdSequence>         getHitboxSequence() { return hitbox_sequence; }
+    RHSHARED<hitboxCmdSequence>&        getHitboxSequence() { return hitbox_sequence; }
 
     void                                setAudioSequence(const RHSHARED<audioSequence>& audio_seq) { this->audio_sequence = audio_seq; }
     const RHSHARED<audioSequence>&      getAudioSequence() const { return audio_sequence; }
-    RHSHARED<audioSequence>             getAudioSequence() { return audio_sequence; }
+    RHSHARED<audioSequence>&            getAudioSequence() { return audio_sequence; }
 
     AnimNode& createNode(const std::string& name) {
         assert(node_name_to_index.find(name) == node_name_to_index.end());
         node_name_to_index[name] = nodes.size();
         nodes.emplace_back(AnimNode());
+        packed_dirty = true;
         return nodes.back();
     }
 
@@ -64,13 +73,41 @@ public:
         if (idx < 0) {
             return 0;
         }
+        packed_dirty = true;
         return &nodes[idx];
     }
 
     AnimNode* getNode(int index) {
+        packed_dirty = true;
         return &nodes[index];
     }
 
+    // Not thread safe when the animation was changed since the last call,
+    // animSampler calls it when created so sampling from jobs only reads it
+    const animPackedClip& getPacked() {
+        if (packed_dirty) {
+            packed.pack(nodes.data(), (int)nodes.size());
+            packed_dirty = false;
+        }
+        return packed;
+    }
+
+    // Meant as the last step after import, the node curves are dropped afterwards
+    // Root motion is not touched
+    bool compress(const animCompressSettings& settings = animCompressSettings(), animCompressStats* stats = nullptr) {
+        if (!compressed.compress(nodes.data(), (int)nodes.size(), settings, stats)) {
+            return false;
+        }
+        for (auto& n : nodes) {
+            n = AnimNode();
+        }
+        is_compressed = true;
+        packed_dirty = true;
+        return true;
+    }
+    bool isCompressed() const { return is_compressed; }
+    const animCompressedClip& getCompressed() const { return compressed; }
+
     int getNodeIndex(const std::string& name) const {
         auto it = node_name_to_index.find(name);
         if(it == node_name_to_index.end()) {
@@ -138,6 +175,10 @@ public:
             }
             assert(out_index >= 0 && out_index < sample_count);
             AnimSample& result = samples[out_index];
+            if (is_compressed) {
+                compressed.sampleNode(i, cursor, result);
+                continue;
+            }
             result.t = n.t.at(cursor);
             result.r = n.r.at(cursor);
             result.s = n.s.at(cursor);
@@ -153,6 +194,10 @@ public:
             int32_t out_index = i;
             assert(out_index >= 0 && out_index < sample_count);
             AnimSample& result = samples[out_index];
+            if (is_compressed) {
+                compressed.sampleNode(i, cursor, result);
+                continue;
+            }
             result.t = n.t.at(cursor);
             result.r = n.r.at(cursor);
             result.s = n.s.at(cursor);
@@ -165,7 +210,7 @@ public:
     bool deserializeJson(const nlohmann::json& json);
 
     DEFINE_EXTENSIONS(e_anim, e_animation);
-    bool load(byte_reader& in) override;
+    bool decode(byte_reader& in, ResourceLoadContext& ctx) override;
     void write(byte_writer& out) const override;
 };
 
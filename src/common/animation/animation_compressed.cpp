@@ -0,0 +1,451 @@
+#include "animation_compressed.hpp"
+
+#include <cfloat>
+#include <cmath>
+#include "animation.hpp"
+#include "log/log.hpp"
+#include "serialization/virtual_obuf.hpp"
+#include "serialization/virtual_ibuf.hpp"
+
+
+constexpr uint32_t ANIM_COMPRESSED_MAX_FRAMES = 1 << 16;
+constexpr float ANIM_QUAT48_SCALE = 32767.f;
+constexpr float ANIM_SQRT2 = 1.41421356f;
+
+// Angle between two rotations, from the chord instead of acos(dot) which has no precision left near zero
+static float animQuatAngle(const gfxm::quat& a, const gfxm::quat& b) {
+    const gfxm::quat d = gfxm::dot(a, b) < .0f ? a + b : a - b;
+    const float chord = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z + d.w * d.w);
+    return 4.f * asinf(std::min(1.f, chord * .5f));
+}
+static float animVec3Error(const gfxm::vec3& a, const gfxm::vec3& b) {
+    return std::max(fabsf(a.x - b.x), std::max(fabsf(a.y - b.y), fabsf(a.z - b.z)));
+}
+
+static void animEncodeQuat48(const gfxm::quat& q_, uint8_t* out) {
+    gfxm::quat q = gfxm::normalize(q_);
+    float c[4] = { q.x, q.y, q.z, q.w };
+    int largest = 0;
+    for (int i = 1; i < 4; ++i) {
+        if (fabsf(c[i]) > fabsf(c[largest])) {
+            largest = i;
+        }
+    }
+    // q and -q are the same rotation, keep the dropped one positive so it can be rebuilt with a sqrt
+    const float sign = c[largest] < .0f ? -1.f : 1.f;
+    uint64_t bits = (uint64_t)largest << 45;
+    int shift = 30;
+    for (int i = 0; i < 4; ++i) {
+        if (i == largest) {
+            continue;
+        }
+        // The other three are within +-1/sqrt(2)
+        const float v = c[i] * sign * ANIM_SQRT2 * .5f + .5f;
+        const uint64_t u = (uint64_t)std::max(.0f, std::min(ANIM_QUAT48_SCALE, roundf(v * ANIM_QUAT48_SCALE)));
+        bits |= u << shift;
+        shift -= 15;
+    }
+    memcpy(out, &bits, 6);
+}
+static gfxm::quat animDecodeQuat48(const uint8_t* in) {
+    uint64_t bits = 0;
+    memcpy(&bits, in, 6);
+    const int largest = (int)((bits >> 45) & 3);
+    float c[4];
+    float sum = .0f;
+    int shift = 30;
+    for (int i = 0; i < 4; ++i) {
+        if (i == largest) {
+            continue;
+        }
+        const float v = ((bits >> shift) & 0x7FFF) / ANIM_QUAT48_SCALE;
+        c[i] = (v - .5f) * 2.f / ANIM_SQRT2;
+        sum += c[i] * c[i];
+        shift -= 15;
+    }
+    c[largest] = sqrtf(std::max(.0f, 1.f - sum));
+    return gfxm::quat(c[0], c[1], c[2], c[3]);
+}
+
+static gfxm::vec3 animDecodeVec3(const animCompressedTrack& track, const animTrackRange* ranges, const uint8_t* frame) {
+    const uint8_t* p = frame + track.offset;
+    if (track.format == ANIM_TRACK_FLOAT) {
+        gfxm::vec3 v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    const animTrackRange& r = ranges[track.param];
+    if (track.format == ANIM_TRACK_RANGE8) {
+        return gfxm::vec3(
+            r.min.x + p[0] * (r.extent.x / 255.f),
+            r.min.y + p[1] * (r.extent.y / 255.f),
+            r.min.z + p[2] * (r.extent.z / 255.f)
+        );
+    }
+    uint16_t u[3];
+    memcpy(u, p, sizeof(u));
+    return gfxm::vec3(
+        r.min.x + u[0] * (r.extent.x / 65535.f),
+        r.min.y + u[1] * (r.extent.y / 65535.f),
+        r.min.z + u[2] * (r.extent.z / 65535.f)
+    );
+}
+
+
+bool animCompressedClip::compress(const AnimNode* nodes, int node_count, const animCompressSettings& settings, animCompressStats* stats) {
+    tracks.clear();
+    constants.clear();
+    ranges.clear();
+    frames.clear();
+    frame_size = 0;
+    frame_count = 0;
+
+    animCompressStats st;
+    // Frame rate and length come from the source keys
+    float min_gap = FLT_MAX;
+    float end_time = .0f;
+    auto scanKeys = [&](const auto& keyframes) {
+        for (int i = 0; i < keyframes.size(); ++i) {
+            end_time = std::max(end_time, keyframes[i].time);
+            if (i > 0 && keyframes[i].time - keyframes[i - 1].time > 1e-5f) {
+                min_gap = std::min(min_gap, keyframes[i].time - keyframes[i - 1].time);
+            }
+        }
+        st.raw_bytes += keyframes.size() * sizeof(keyframes[0]);
+    };
+    for (int i = 0; i < node_count; ++i) {
+        scanKeys(nodes[i].t.get_keyframes());
+        scanKeys(nodes[i].r.get_keyframes());
+        scanKeys(nodes[i].s.get_keyframes());
+    }
+    if (settings.sample_interval > .0f) {
+        sample_interval = settings.sample_interval;
+    } else if (min_gap == FLT_MAX) {
+        sample_interval = 1.f;
+    } else {
+        // Fit a whole number of gaps into the clip, so keys baked at a fixed rate land exactly on frames
+        sample_interval = end_time / std::max(1.f, roundf(end_time / min_gap));
+    }
+    frame_count = (uint32_t)ceilf(end_time / sample_interval - 1e-3f) + 1;
+    if (frame_count > ANIM_COMPRESSED_MAX_FRAMES) {
+        LOG_WARN("animCompressedClip: " << frame_count << " frames is too many, sampling at a lower rate");
+        frame_count = ANIM_COMPRESSED_MAX_FRAMES;
+        sample_interval = end_time / (frame_count - 1);
+    }
+
+    // Pick a format for every track, the animated ones get a slot in the frame
+    std::vector<gfxm::vec3> vec_samples(frame_count);
+    std::vector<gfxm::quat> quat_samples(frame_count);
+    auto classifyVec3 = [&](const curve<gfxm::vec3>& c, const gfxm::vec3& identity, float max_error) {
+        animCompressedTrack track;
+        gfxm::vec3 vmin = c.at(.0f);
+        gfxm::vec3 vmax = vmin;
+        for (uint32_t f = 0; f < frame_count; ++f) {
+            vec_samples[f] = c.at(f * sample_interval);
+            vmin = gfxm::vec3(std::min(vmin.x, vec_samples[f].x), std::min(vmin.y, vec_samples[f].y), std::min(vmin.z, vec_samples[f].z));
+            vmax = gfxm::vec3(std::max(vmax.x, vec_samples[f].x), std::max(vmax.y, vec_samples[f].y), std::max(vmax.z, vec_samples[f].z));
+        }
+        const gfxm::vec3 extent = vmax - vmin;
+        const float max_extent = std::max(extent.x, std::max(extent.y, extent.z));
+        if (max_extent <= max_error) {
+            const gfxm::vec3 mid = vmin + extent * .5f;
+            if (animVec3Error(mid, identity) <= max_error) {
+                track.format = ANIM_TRACK_IDENTITY;
+                ++st.identity_tracks;
+            } else {
+                track.format = ANIM_TRACK_CONSTANT;
+                track.param = (uint16_t)constants.size();
+                constants.push_back(gfxm::vec4(mid, .0f));
+                ++st.constant_tracks;
+            }
+            return track;
+        }
+        ++st.animated_tracks;
+        track.offset = frame_size;
+        // Rounding to the nearest step is off by half a step at most
+        if (max_extent / 255.f * .5f <= max_error) {
+            track.format = ANIM_TRACK_RANGE8;
+            frame_size += 3;
+        } else if (max_extent / 65535.f * .5f <= max_error) {
+            track.format = ANIM_TRACK_RANGE16;
+            frame_size += 6;
+        } else {
+            track.format = ANIM_TRACK_FLOAT;
+            frame_size += sizeof(gfxm::vec3);
+            return track;
+        }
+        track.param = (uint16_t)ranges.size();
+        animTrackRange range;
+        range.min = vmin;
+        range.extent = extent;
+        ranges.push_back(range);
+        return track;
+    };
+    auto classifyQuat = [&](const curve<gfxm::quat>& c) {
+        animCompressedTrack track;
+        const gfxm::quat first = c.at(.0f);
+        bool is_constant = true;
+        for (uint32_t f = 0; f < frame_count && is_constant; ++f) {
+            is_constant = animQuatAngle(first, c.at(f * sample_interval)) <= settings.rotation_error;
+        }
+        if (is_constant) {
+            if (animQuatAngle(first, gfxm::quat(0, 0, 0, 1)) <= settings.rotation_error) {
+                track.format = ANIM_TRACK_IDENTITY;
+                ++st.identity_tracks;
+            } else {
+                track.format = ANIM_TRACK_CONSTANT;
+                track.param = (uint16_t)constants.size();
+                const gfxm::quat q = gfxm::normalize(first);
+                constants.push_back(gfxm::vec4(q.x, q.y, q.z, q.w));
+                ++st.constant_tracks;
+            }
+            return track;
+        }
+        ++st.animated_tracks;
+        track.format = ANIM_TRACK_QUAT48;
+        track.offset = frame_size;
+        frame_size += 6;
+        return track;
+    };
+    for (int i = 0; i < node_count; ++i) {
+        tracks.push_back(classifyVec3(nodes[i].t, gfxm::vec3(0, 0, 0), settings.translation_error));
+        tracks.push_back(classifyQuat(nodes[i].r));
+        tracks.push_back(classifyVec3(nodes[i].s, gfxm::vec3(1, 1, 1), settings.scale_error));
+    }
+    if (constants.size() > UINT16_MAX || ranges.size() > UINT16_MAX) {
+        LOG_ERR("animCompressedClip: too many tracks");
+        tracks.clear();
+        return false;
+    }
+
+    // Fill the frames
+    frames.resize(frame_size * frame_count);
+    for (int i = 0; i < node_count; ++i) {
+        for (int ch = 0; ch < 3; ++ch) {
+            const animCompressedTrack& track = tracks[i * 3 + ch];
+            if (track.format == ANIM_TRACK_IDENTITY || track.format == ANIM_TRACK_CONSTANT) {
+                continue;
+            }
+            const curve<gfxm::vec3>& cv = ch == 0 ? nodes[i].t : nodes[i].s;
+            for (uint32_t f = 0; f < frame_count; ++f) {
+                uint8_t* p = &frames[f * frame_size + track.offset];
+                const float time = f * sample_interval;
+                if (track.format == ANIM_TRACK_QUAT48) {
+                    animEncodeQuat48(nodes[i].r.at(time), p);
+                    continue;
+                }
+                const gfxm::vec3 v = cv.at(time);
+                if (track.format == ANIM_TRACK_FLOAT) {
+                    memcpy(p, &v, sizeof(v));
+                    continue;
+                }
+                const animTrackRange& r = ranges[track.param];
+                const float vals[3] = { v.x - r.min.x, v.y - r.min.y, v.z - r.min.z };
+                const float exts[3] = { r.extent.x, r.extent.y, r.extent.z };
+                for (int j = 0; j < 3; ++j) {
+                    const float n = exts[j] > .0f ? std::max(.0f, std::min(1.f, vals[j] / exts[j])) : .0f;
+                    if (track.format == ANIM_TRACK_RANGE8) {
+                        p[j] = (uint8_t)roundf(n * 255.f);
+                    } else {
+                        const uint16_t u = (uint16_t)roundf(n * 65535.f);
+                        memcpy(p + j * 2, &u, sizeof(u));
+                    }
+                }
+            }
+        }
+    }
+
+    // Measure against the source at every key and halfway between frames
+    if (stats) {
+        AnimSample s;
+        auto check = [&](int node, float time) {
+            sampleNode(node, time, s);
+            st.max_translation_error = std::max(st.max_translation_error, animVec3Error(s.t, nodes[node].t.at(time)));
+            st.max_rotation_error = std::max(st.max_rotation_error, animQuatAngle(s.r, nodes[node].r.at(time)));
+            st.max_scale_error = std::max(st.max_scale_error, animVec3Error(s.s, nodes[node].s.at(time)));
+        };
+        for (int i = 0; i < node_count; ++i) {
+            for (auto& k : nodes[i].t.get_keyframes()) {
+                check(i, k.time);
+            }
+            for (auto& k : nodes[i].r.get_keyframes()) {
+                check(i, k.time);
+            }
+            for (auto& k : nodes[i].s.get_keyframes()) {
+                check(i, k.time);
+            }
+            for (uint32_t f = 0; f + 1 < frame_count; ++f) {
+                check(i, (f + .5f) * sample_interval);
+            }
+        }
+        st.compressed_bytes = byteSize();
+        *stats = st;
+    }
+    return true;
+}
+
+size_t animCompressedClip::byteSize() const {
+    return tracks.size() * sizeof(tracks[0])
+        + constants.size() * sizeof(constants[0])
+        + ranges.size() * sizeof(ranges[0])
+        + frames.size();
+}
+
+void animCompressedClip::decodeNode(int node, const uint8_t* f0, const uint8_t* f1, float w, ANIM_ROTATION_INTERP rotation_interp, AnimSample& out) const {
+    const animCompressedTrack* tr = &tracks[node * 3];
+    const gfxm::vec3 identity[3] = { gfxm::vec3(0, 0, 0), gfxm::vec3(0, 0, 0), gfxm::vec3(1, 1, 1) };
+    gfxm::vec3* vec_out[3] = { &out.t, nullptr, &out.s };
+    for (int ch = 0; ch < 3; ch += 2) {
+        const animCompressedTrack& track = tr[ch];
+        if (track.format == ANIM_TRACK_IDENTITY) {
+            *vec_out[ch] = identity[ch];
+        } else if (track.format == ANIM_TRACK_CONSTANT) {
+            *vec_out[ch] = gfxm::vec3(constants[track.param]);
+        } else {
+            const gfxm::vec3 a = animDecodeVec3(track, ranges.data(), f0);
+            if (w > .0f) {
+                const gfxm::vec3 b = animDecodeVec3(track, ranges.data(), f1);
+                *vec_out[ch] = a + (b - a) * w;
+            } else {
+                *vec_out[ch] = a;
+            }
+        }
+    }
+    const animCompressedTrack& track = tr[1];
+    if (track.format == ANIM_TRACK_IDENTITY) {
+        out.r = gfxm::quat(0, 0, 0, 1);
+    } else if (track.format == ANIM_TRACK_CONSTANT) {
+        out.r = gfxm::quat(constants[track.param]);
+    } else {
+        const gfxm::quat a = animDecodeQuat48(f0 + track.offset);
+        if (w <= .0f) {
+            out.r = a;
+        } else if (rotation_interp == ANIM_ROTATION_SLERP) {
+            out.r = gfxm::slerp(a, animDecodeQuat48(f1 + track.offset), w);
+        } else {
+            gfxm::quat b = animDecodeQuat48(f1 + track.offset);
+            if (gfxm::dot(a, b) < .0f) {
+                b = -b;
+            }
+            out.r = gfxm::normalize(a * (1.f - w) + b * w);
+        }
+    }
+}
+
+void animCompressedClip::sample(
+    float time,
+    const int32_t* nodes,
+    const int32_t* out_indices,
+    int count,
+    ANIM_ROTATION_INTERP rotation_interp,
+    AnimSample* out
+) const {
+    if (frame_count == 0) {
+        return;
+    }
+    // Before the first frame holds it, like curve<>::at() does before zero
+    const float ft = time > .0f ? time / sample_interval : .0f;
+    uint32_t i0 = (uint32_t)std::min(ft, (float)(frame_count - 1));
+    float w = ft - i0;
+    if (i0 >= frame_count - 1) {
+        i0 = frame_count - 1;
+        w = .0f;
+    }
+    const uint8_t* f0 = frames.data() + i0 * frame_size;
+    const uint8_t* f1 = w > .0f ? f0 + frame_size : f0;
+    for (int i = 0; i < count; ++i) {
+        decodeNode(nodes[i], f0, f1, w, rotation_interp, out[out_indices[i]]);
+    }
+}
+
+void animCompressedClip::sampleNode(int node, float time, AnimSample& out) const {
+    const int32_t zero = 0;
+    sample(time, &node, &zero, 1, ANIM_ROTATION_SLERP, &out);
+}
+
+void animCompressedClip::serialize(vofbuf& out) const {
+    out.write<uint32_t>(frame_size);
+    out.write<uint32_t>(frame_count);
+    out.write<float>(sample_interval);
+    out.write_vector(tracks, true);
+    out.write_vector(constants, true);
+    out.write_vector(ranges, true);
+    out.write_vector(frames, true);
+}
+
+bool animCompressedClip::validate() const {
+    if (frames.size() != (uint64_t)frame_size * frame_count || tracks.size() % 3 != 0) {
+        LOG_ERR("animCompressedClip: frame data does not match the header");
+        return false;
+    }
+    if (frame_count > ANIM_COMPRESSED_MAX_FRAMES || !(sample_interval > .0f) || !std::isfinite(sample_interval)) {
+        LOG_ERR("animCompressedClip: bad frame count or sample interval");
+        return false;
+    }
+    // Sampling indexes constants, ranges and frames with whatever the tracks say
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        const animCompressedTrack& track = tracks[i];
+        const bool is_rotation = i % 3 == 1;
+        uint32_t bytes = 0;
+        bool uses_range = false;
+        switch (track.format) {
+        case ANIM_TRACK_IDENTITY:
+            continue;
+        case ANIM_TRACK_CONSTANT:
+            if (track.param >= constants.size()) {
+                LOG_ERR("animCompressedClip: track " << i << " constant index out of range");
+                return false;
+            }
+            continue;
+        case ANIM_TRACK_QUAT48:
+            bytes = is_rotation ? 6 : 0;
+            break;
+        case ANIM_TRACK_RANGE8:
+            bytes = is_rotation ? 0 : 3;
+            uses_range = true;
+            break;
+        case ANIM_TRACK_RANGE16:
+            bytes = is_rotation ? 0 : 6;
+            uses_range = true;
+            break;
+        case ANIM_TRACK_FLOAT:
+            bytes = is_rotation ? 0 : sizeof(gfxm::vec3);
+            break;
+        }
+        if (bytes == 0) {
+            LOG_ERR("animCompressedClip: track " << i << " has an unknown format " << (int)track.format);
+            return false;
+        }
+        if (uses_range && track.param >= ranges.size()) {
+            LOG_ERR("animCompressedClip: track " << i << " range index out of range");
+            return false;
+        }
+        if ((uint64_t)track.offset + bytes > frame_size) {
+            LOG_ERR("animCompressedClip: track " << i << " reads past the end of a frame");
+            return false;
+        }
+    }
+    return true;
+}
+
+bool animCompressedClip::deserialize(vifbuf& in) {
+    // read_vector() leaves the vector alone when the count is 0
+    tracks.clear();
+    constants.clear();
+    ranges.clear();
+    frames.clear();
+    frame_size = in.read<uint32_t>();
+    frame_count = in.read<uint32_t>();
+    sample_interval = in.read<float>();
+    in.read_vector(tracks);
+    in.read_vector(constants);
+    in.read_vector(ranges);
+    in.read_vector(frames);
+    if (!validate()) {
+        tracks.clear();
+        frames.clear();
+        frame_count = 0;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "math/gfxm.hpp"
+#include "animation_packed.hpp"
+
+
+struct AnimNode;
+struct AnimSample;
+class vofbuf;
+class vifbuf;
+
+// Animation tracks resampled at a uniform rate and quantized
+//  - tracks that never move are stored as one value, tracks that stay at identity are not stored at all
+//  - rotations are smallest three, 2 bits for the dropped component and 15 for each of the other three
+//  - translations and scales are quantized to 8 or 16 bits over the track's own range,
+//    whichever keeps within the error budget, or kept as floats when neither does
+// Frames are laid out one after another, every animated track of a frame next to each other,
+// so sampling reads two short runs of bytes and needs no key search
+
+struct animCompressSettings {
+    // Largest allowed quantization error, in clip units
+    float translation_error = .0001f;
+    float scale_error = .0001f;
+    // Radians, used to tell a constant rotation track from a moving one
+    float rotation_error = .0001f;
+    // Time between frames, 0 takes the smallest gap between two keys in the source
+    float sample_interval = .0f;
+};
+
+struct animCompressStats {
+    size_t raw_bytes = 0;
+    size_t compressed_bytes = 0;
+    int identity_tracks = 0;
+    int constant_tracks = 0;
+    int animated_tracks = 0;
+    // Largest difference from the source curves, checked at every source key and between frames
+    float max_translation_error = .0f;
+    float max_rotation_error = .0f; // Radians
+    float max_scale_error = .0f;
+};
+
+enum ANIM_TRACK_FORMAT : uint8_t {
+    ANIM_TRACK_IDENTITY,
+    ANIM_TRACK_CONSTANT,
+    ANIM_TRACK_QUAT48,
+    ANIM_TRACK_RANGE8,
+    ANIM_TRACK_RANGE16,
+    ANIM_TRACK_FLOAT
+};
+
+struct animCompressedTrack {
+    uint8_t format = ANIM_TRACK_IDENTITY;
+    uint8_t unused = 0;
+    uint16_t param = 0;  // Index into constants or ranges
+    uint32_t offset = 0; // Byte offset inside a frame
+};
+
+struct animTrackRange {
+    gfxm::vec3 min;
+    gfxm::vec3 extent;
+};
+
+class animCompressedClip {
+    // Three per node: translation, rotation, scale
+    std::vector<animCompressedTrack> tracks;
+    std::vector<gfxm::vec4> constants;
+    std::vector<animTrackRange> ranges;
+    std::vector<uint8_t> frames;
+    uint32_t frame_size = 0;
+    uint32_t frame_count = 0;
+    float sample_interval = 1.f;
+
+    void decodeNode(int node, const uint8_t* f0, const uint8_t* f1, float w, ANIM_ROTATION_INTERP rotation_interp, AnimSample& out) const;
+    // Checks every index sampling relies on, for data that came from a file
+    bool validate() const;
+public:
+    bool compress(const AnimNode* nodes, int node_count, const animCompressSettings& settings, animCompressStats* stats = nullptr);
+
+    int nodeCount() const { return (int)tracks.size() / 3; }
+    int frameCount() const { return (int)frame_count; }
+    size_t byteSize() const;
+
+    // Same arguments as animSamplePacked(), no cursor needed
+    void sample(
+        float time,
+        const int32_t* nodes,
+        const int32_t* out_indices,
+        int count,
+        ANIM_ROTATION_INTERP rotation_interp,
+        AnimSample* out
+    ) const;
+    void sampleNode(int node, float time, AnimSample& out) const;
+
+    void serialize(vofbuf& out) const;
+    bool deserialize(vifbuf& in);
+};
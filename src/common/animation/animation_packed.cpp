@@ -0,0 +1,229 @@
+#include "animation_packed.hpp"
+
+#include "animation.hpp"
+
+// SSE2 is always there on x64
+#if defined(_M_X64) || defined(__x86_64__)
+#define ANIM_PACKED_SSE 1
+#include <emmintrin.h>
+#else
+#define ANIM_PACKED_SSE 0
+#endif
+
+
+template<typename T>
+static void animPackTrack(animPackedClip& clip, const curve<T>& c, const gfxm::vec4& def) {
+    const auto& keyframes = c.get_keyframes();
+    animPackedTrack track;
+    track.first = (uint32_t)clip.times.size();
+    track.count = (uint32_t)std::max<size_t>(keyframes.size(), 1);
+    if (keyframes.empty()) {
+        clip.times.push_back(.0f);
+        clip.values.push_back(def);
+    }
+    for (auto& k : keyframes) {
+        clip.times.push_back(k.time);
+        clip.values.push_back(gfxm::vec4(k.value.x, k.value.y, k.value.z, .0f));
+    }
+    clip.tracks.push_back(track);
+}
+template<>
+void animPackTrack(animPackedClip& clip, const curve<gfxm::quat>& c, const gfxm::vec4& def) {
+    const auto& keyframes = c.get_keyframes();
+    animPackedTrack track;
+    track.first = (uint32_t)clip.times.size();
+    track.count = (uint32_t)std::max<size_t>(keyframes.size(), 1);
+    if (keyframes.empty()) {
+        clip.times.push_back(.0f);
+        clip.values.push_back(def);
+    }
+    for (auto& k : keyframes) {
+        clip.times.push_back(k.time);
+        clip.values.push_back(gfxm::vec4(k.value.x, k.value.y, k.value.z, k.value.w));
+    }
+    clip.tracks.push_back(track);
+}
+
+void animPackedClip::pack(const AnimNode* nodes, int node_count) {
+    tracks.clear();
+    times.clear();
+    values.clear();
+    // Defaults are what curve<>::at() returns for an empty curve
+    for (int i = 0; i < node_count; ++i) {
+        animPackTrack(*this, nodes[i].t, gfxm::vec4(0, 0, 0, 0));
+        animPackTrack(*this, nodes[i].r, gfxm::vec4(0, 0, 0, 1));
+        animPackTrack(*this, nodes[i].s, gfxm::vec4(0, 0, 0, 0));
+    }
+}
+
+// Index of the key at or before time, clamped to [0, count - 2], and the weight of the next one
+// Same rules as curve<>::at(): past the last key holds it, before zero holds the first
+static int animFindKey(const float* times, int count, float time, uint32_t& cursor, float& weight) {
+    if (count == 1) {
+        weight = .0f;
+        return 0;
+    }
+    if (time > times[count - 1]) {
+        cursor = count - 2;
+        weight = 1.f;
+        return count - 2;
+    }
+    if (time < .0f) {
+        cursor = 0;
+        weight = .0f;
+        return 0;
+    }
+    int k = (int)cursor;
+    if (k > count - 2 || time < times[k]) {
+        k = 0;
+    }
+    // A few steps forward cover normal playback, anything further is a seek
+    int steps = 0;
+    while (k < count - 2 && times[k + 1] <= time && steps < 4) {
+        ++k;
+        ++steps;
+    }
+    if (k < count - 2 && times[k + 1] <= time) {
+        int left = k + 1;
+        int right = count - 1;
+        while (right - left > 1) {
+            const int center = left + (right - left) / 2;
+            if (time < times[center]) {
+                right = center;
+            } else {
+                left = center;
+            }
+        }
+        k = left;
+    }
+    cursor = k;
+    weight = (time - times[k]) / (times[k + 1] - times[k]);
+    return k;
+}
+
+static void animLerpVec3(const gfxm::vec4& a, const gfxm::vec4& b, float w, gfxm::vec3& out) {
+    out.x = a.x + w * (b.x - a.x);
+    out.y = a.y + w * (b.y - a.y);
+    out.z = a.z + w * (b.z - a.z);
+}
+
+void animSamplePacked(
+    const animPackedClip& clip,
+    animSampleCursor& cursor,
+    const int32_t* nodes,
+    const int32_t* out_indices,
+    int count,
+    float time,
+    ANIM_ROTATION_INTERP rotation_interp,
+    AnimSample* out
+) {
+    if (cursor.keys.size() != clip.tracks.size()) {
+        cursor.reset(clip);
+    }
+    const float* times = clip.times.data();
+    const gfxm::vec4* values = clip.values.data();
+    uint32_t* keys = cursor.keys.data();
+
+    // Rotations are blended four nodes at a time, the key lookups fill these first
+    const gfxm::vec4* rot_a[4];
+    const gfxm::vec4* rot_b[4];
+    float rot_w[4];
+    AnimSample* rot_out[4];
+    int rot_count = 0;
+    auto flushRotations = [&]() {
+#if ANIM_PACKED_SSE
+        // Pad the group with copies of the first lane
+        for (int k = rot_count; k < 4; ++k) {
+            rot_a[k] = rot_a[0];
+            rot_b[k] = rot_b[0];
+            rot_w[k] = rot_w[0];
+        }
+        __m128 x0 = _mm_loadu_ps(&rot_a[0]->x);
+        __m128 y0 = _mm_loadu_ps(&rot_a[1]->x);
+        __m128 z0 = _mm_loadu_ps(&rot_a[2]->x);
+        __m128 w0 = _mm_loadu_ps(&rot_a[3]->x);
+        _MM_TRANSPOSE4_PS(x0, y0, z0, w0);
+        __m128 x1 = _mm_loadu_ps(&rot_b[0]->x);
+        __m128 y1 = _mm_loadu_ps(&rot_b[1]->x);
+        __m128 z1 = _mm_loadu_ps(&rot_b[2]->x);
+        __m128 w1 = _mm_loadu_ps(&rot_b[3]->x);
+        _MM_TRANSPOSE4_PS(x1, y1, z1, w1);
+        // Shortest way around, then lerp and normalize
+        const __m128 d = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(x0, x1), _mm_mul_ps(y0, y1)),
+            _mm_add_ps(_mm_mul_ps(z0, z1), _mm_mul_ps(w0, w1))
+        );
+        const __m128 t = _mm_loadu_ps(rot_w);
+        const __m128 t1 = _mm_xor_ps(t, _mm_and_ps(_mm_cmplt_ps(d, _mm_setzero_ps()), _mm_set1_ps(-.0f)));
+        const __m128 t0 = _mm_sub_ps(_mm_set1_ps(1.f), t);
+        __m128 x = _mm_add_ps(_mm_mul_ps(x0, t0), _mm_mul_ps(x1, t1));
+        __m128 y = _mm_add_ps(_mm_mul_ps(y0, t0), _mm_mul_ps(y1, t1));
+        __m128 z = _mm_add_ps(_mm_mul_ps(z0, t0), _mm_mul_ps(z1, t1));
+        __m128 w = _mm_add_ps(_mm_mul_ps(w0, t0), _mm_mul_ps(w1, t1));
+        const __m128 len2 = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)),
+            _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w))
+        );
+        // rsqrt plus one newton step, good to about 1e-7
+        __m128 inv = _mm_rsqrt_ps(len2);
+        inv = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(.5f), inv), _mm_sub_ps(_mm_set1_ps(3.f), _mm_mul_ps(_mm_mul_ps(len2, inv), inv)));
+        x = _mm_mul_ps(x, inv);
+        y = _mm_mul_ps(y, inv);
+        z = _mm_mul_ps(z, inv);
+        w = _mm_mul_ps(w, inv);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        const __m128 q[4] = { x, y, z, w };
+        for (int k = 0; k < rot_count; ++k) {
+            _mm_storeu_ps(&rot_out[k]->r.x, q[k]);
+        }
+#else
+        for (int k = 0; k < rot_count; ++k) {
+            const gfxm::quat a(rot_a[k]->x, rot_a[k]->y, rot_a[k]->z, rot_a[k]->w);
+            gfxm::quat b(rot_b[k]->x, rot_b[k]->y, rot_b[k]->z, rot_b[k]->w);
+            if (gfxm::dot(a, b) < .0f) {
+                b = -b;
+            }
+            rot_out[k]->r = gfxm::normalize(a * (1.f - rot_w[k]) + b * rot_w[k]);
+        }
+#endif
+        rot_count = 0;
+    };
+
+    for (int i = 0; i < count; ++i) {
+        const int node = nodes[i];
+        AnimSample& result = out[out_indices[i]];
+        const animPackedTrack* tr = &clip.tracks[node * 3];
+        float w = .0f;
+        int k = 0;
+
+        k = animFindKey(times + tr[0].first, tr[0].count, time, keys[node * 3], w);
+        const gfxm::vec4* v = values + tr[0].first + k;
+        animLerpVec3(v[0], v[tr[0].count > 1 ? 1 : 0], w, result.t);
+
+        k = animFindKey(times + tr[2].first, tr[2].count, time, keys[node * 3 + 2], w);
+        v = values + tr[2].first + k;
+        animLerpVec3(v[0], v[tr[2].count > 1 ? 1 : 0], w, result.s);
+
+        k = animFindKey(times + tr[1].first, tr[1].count, time, keys[node * 3 + 1], w);
+        v = values + tr[1].first + k;
+        const gfxm::vec4* v1 = v + (tr[1].count > 1 ? 1 : 0);
+        if (rotation_interp == ANIM_ROTATION_SLERP) {
+            result.r = gfxm::slerp(
+                gfxm::quat(v->x, v->y, v->z, v->w),
+                gfxm::quat(v1->x, v1->y, v1->z, v1->w),
+                w
+            );
+            continue;
+        }
+        rot_a[rot_count] = v;
+        rot_b[rot_count] = v1;
+        rot_w[rot_count] = w;
+        rot_out[rot_count] = &result;
+        if (++rot_count == 4) {
+            flushRotations();
+        }
+    }
+    if (rot_count) {
+        flushRotations();
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "math/gfxm.hpp"
+
+
+struct AnimNode;
+struct AnimSample;
+
+// Animation tracks repacked for sampling
+// Key times and key values of every track live in two flat arrays instead of a vector of keyframes per curve,
+// so a sampler can keep its own key cursors and several bones can be blended at once
+
+enum ANIM_ROTATION_INTERP {
+    ANIM_ROTATION_SLERP,
+    // Normalized lerp, close enough to slerp between neighbouring keys and a lot cheaper
+    ANIM_ROTATION_NLERP
+};
+
+struct animPackedTrack {
+    uint32_t first = 0; // Into times and values
+    uint32_t count = 0; // Never 0, an empty curve is packed as a single default key
+};
+
+class animPackedClip {
+public:
+    // Three per node: translation, rotation, scale
+    std::vector<animPackedTrack> tracks;
+    std::vector<float> times;
+    // vec3 keys are padded with w = 0, quat keys are x y z w
+    std::vector<gfxm::vec4> values;
+
+    void pack(const AnimNode* nodes, int node_count);
+    int nodeCount() const { return (int)tracks.size() / 3; }
+};
+
+// Last key found for each track, forward playback only ever steps to the next key or two
+// Starts over with a binary search when time goes backwards, on a seek or a loop
+struct animSampleCursor {
+    std::vector<uint32_t> keys;
+
+    void reset(const animPackedClip& clip) {
+        keys.assign(clip.tracks.size(), 0);
+    }
+};
+
+// Samples nodes[i] of the clip into out[out_indices[i]]
+// With ANIM_ROTATION_SLERP the results are the same as curve<>::at() gives
+void animSamplePacked(
+    const animPackedClip& clip,
+    animSampleCursor& cursor,
+    const int32_t* nodes,
+    const int32_t* out_indices,
+    int count,
+    float time,
+    ANIM_ROTATION_INTERP rotation_interp,
+    AnimSample* out
+);
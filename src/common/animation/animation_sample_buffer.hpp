@@ -2,6 +2,7 @@
 
 #include "animation.hpp"
 #include "skeleton/skeleton_editable.hpp"
+#include "transform_node/transform_system.hpp"
 
 class animSampleBuffer {
     std::vector<AnimSample> samples;
@@ -33,6 +34,15 @@ public:
     const AnimSample& getRootMotionSample() const { return root_motion_sample; }
 
     void applySamples(SkeletonInstance* skl_inst) {
+        // Straight into the hierarchy's arrays when the bones are bound to it, bone order is the block's input order
+        const int block = skl_inst->getHierarchyBlock();
+        if (block != -1 && samples.size() > 1) {
+            TransformSystem::getHierarchy()->setLocalTransforms(
+                block, 1, (int)samples.size() - 1,
+                &samples[1].t, &samples[1].r, &samples[1].s, sizeof(AnimSample)
+            );
+            return;
+        }
         for (int i = 1; i < samples.size(); ++i) {
             auto& s = samples[i];
             skl_inst->getBoneNode(i)->setTranslation(s.t);
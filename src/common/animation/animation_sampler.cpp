@@ -1,5 +1,7 @@
 #include "animation_sampler.hpp"
 
+#include <algorithm>
+
 
 animSampler::animSampler(Skeleton* skeleton, Animation* anim) {
     assert(anim);
@@ -14,24 +16,52 @@ animSampler::animSampler(Skeleton* skeleton, Animation* anim) {
         if (anim_node_index < 0) continue;
         mapping[anim_node_index] = transform_index;
     }
+    for (int i = 0; i < mapping.size(); ++i) {
+        if (mapping[i] == -1) {
+            continue;
+        }
+        mapped_nodes.push_back(i);
+        mapped_out.push_back(mapping[i]);
+    }
+    key_cursor.reset(anim->getPacked());
+}
+
+void animSampler::sampleBones(AnimSample* out_samples, int sample_count, float cursor) {
+    // Same bounds as Animation::sample_remapped(), nodes past sample_count are skipped
+    const int count = (int)(std::lower_bound(mapped_nodes.begin(), mapped_nodes.end(), sample_count) - mapped_nodes.begin());
+    for (int i = 0; i < count; ++i) {
+        assert(mapped_out[i] >= 0 && mapped_out[i] < sample_count);
+    }
+    if (animation->isCompressed()) {
+        animation->getCompressed().sample(
+            cursor, mapped_nodes.data(), mapped_out.data(), count,
+            rotation_interp, out_samples
+        );
+        return;
+    }
+    const animPackedClip& clip = animation->getPacked();
+    animSamplePacked(
+        clip, key_cursor, mapped_nodes.data(), mapped_out.data(), count,
+        cursor, rotation_interp, out_samples
+    );
 }
 
 void animSampler::sample(AnimSample* out_samples, int sample_count, float cursor) {
     assert(animation);
-    animation->sample_remapped(out_samples, sample_count, cursor, mapping);
+    sampleBones(out_samples, sample_count, cursor);
 }
 void animSampler::sample_normalized(AnimSample* out_samples, int sample_count, float cursor_normal) {
     assert(animation);
-    animation->sample_remapped(out_samples, sample_count, cursor_normal * animation->length, mapping);
+    sampleBones(out_samples, sample_count, cursor_normal * animation->length);
 }
 void animSampler::sampleWithRootMotion(AnimSample* out_samples, int sample_count, float from, float to, AnimSample* rm_sample) {
     assert(animation);
-    animation->sample_remapped(out_samples, sample_count, to, mapping);
+    sampleBones(out_samples, sample_count, to);
     animation->sample_root_motion(rm_sample, from, to);
 }
 void animSampler::sampleWithRootMotion_normalized(AnimSample* out_samples, int sample_count, float from, float to, AnimSample* rm_sample) {
     assert(animation);
-    animation->sample_remapped(out_samples, sample_count, to * animation->length, mapping);
+    sampleBones(out_samples, sample_count, to * animation->length);
     animation->sample_root_motion(rm_sample, from * animation->length, to * animation->length);
 }
 
@@ -6,10 +6,19 @@
 class animSampler {
     Animation* animation = 0;
     std::vector<int32_t> mapping;
+    // Mapped nodes only, ascending, and where each one goes
+    std::vector<int32_t> mapped_nodes;
+    std::vector<int32_t> mapped_out;
+    animSampleCursor key_cursor;
+    ANIM_ROTATION_INTERP rotation_interp = ANIM_ROTATION_SLERP;
+
+    void sampleBones(AnimSample* out_samples, int sample_count, float cursor);
 public:
     animSampler() {}
     animSampler(Skeleton* skeleton, Animation* anim);
 
+    void setRotationInterp(ANIM_ROTATION_INTERP interp) { rotation_interp = interp; }
+
     void sample(AnimSample* out_samples, int sample_count, float cursor);
     void sample_normalized(AnimSample* out_samples, int sample_count, float cursor_normal);
     void sampleWithRootMotion(AnimSample* out_samples, int sample_count, float from, float to, AnimSample* rm_sample);
@@ -9,6 +9,7 @@
 struct animGraphCompileContext {
     int fsm_count = 0;
     int blend_tree_count = 0;
+    int blend_node_count = 0;
 };
 
 
@@ -31,7 +31,6 @@ bool animBtNodeBlend2::compile(AnimMachine* animator, std::set<animBtNode*>& exe
     expr_weight_addr = animator->compileExpr(expr_weight);
 
     updatePriority(order);
-    samples.init(animator->getSkeleton());
     in_a->compile(animator, exec_set, order + 1);
     in_b->compile(animator, exec_set, order + 1);
     exec_set.insert(this);
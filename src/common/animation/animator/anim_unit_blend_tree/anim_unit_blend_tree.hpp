@@ -19,12 +19,12 @@ protected:
         }
     }
 public:
-    // TODO: Move instance specific data
     int exec_priority = 0;
-    float total_influence = .0f;
+    int data_idx = -1; // Into animGraphInstanceData::blend_node_data, nodes in the exec chain only
 
     virtual ~animBtNode() {}
     virtual bool compile(AnimMachine* animator, std::set<animBtNode*>& exec_set, int order) = 0;
+    virtual void prepareInstance(AnimMachineInstance* anim_inst) {}
     virtual void propagateInfluence(AnimMachineInstance* anim_inst, float influence) = 0;
     virtual void update(AnimMachineInstance* anim_inst, float dt) = 0;
     virtual animSampleBuffer* getOutputSamples(AnimMachineInstance* anim_inst) = 0;
@@ -70,10 +70,6 @@ class animBtNodeBlend2 : public animBtNode {
     std::string expr_weight;
     int expr_weight_addr = -1;
 
-    // TODO: Move instance specific data
-    float weight = .0f;
-    animSampleBuffer samples;
-
 public:
     void setInputs(animBtNode* a, animBtNode* b) {
         in_a = a;
@@ -84,18 +80,23 @@ public:
     }
 
     bool compile(AnimMachine* animator, std::set<animBtNode*>& exec_set, int order) override;
+    void prepareInstance(AnimMachineInstance* anim_inst) override {
+        anim_inst->getData()->blend_node_data[data_idx].samples.init(anim_inst->getSkeletonMaster());
+    }
     void propagateInfluence(AnimMachineInstance* anim_inst, float influence) override {
-        total_influence += influence;
+        auto& data = anim_inst->getData()->blend_node_data[data_idx];
+        data.total_influence += influence;
         int ret = anim_inst->runExpr(expr_weight_addr);
-        weight = *(float*)&ret;
-        in_a->propagateInfluence(anim_inst, total_influence * (1.0f - weight));
-        in_b->propagateInfluence(anim_inst, total_influence * weight);
+        data.weight = *(float*)&ret;
+        in_a->propagateInfluence(anim_inst, data.total_influence * (1.0f - data.weight));
+        in_b->propagateInfluence(anim_inst, data.total_influence * data.weight);
     }
     void update(AnimMachineInstance* anim_inst, float dt) override {
-        animBlendSamples(*in_a->getOutputSamples(anim_inst), *in_b->getOutputSamples(anim_inst), samples, weight);
+        auto& data = anim_inst->getData()->blend_node_data[data_idx];
+        animBlendSamples(*in_a->getOutputSamples(anim_inst), *in_b->getOutputSamples(anim_inst), data.samples, data.weight);
     }
     animSampleBuffer* getOutputSamples(AnimMachineInstance* anim_inst) override {
-        return &samples;
+        return &anim_inst->getData()->blend_node_data[data_idx].samples;
     }
 };
 class animUnitBlendTree : public animUnit {
@@ -142,6 +143,10 @@ public:
         std::sort(exec_chain.begin(), exec_chain.end(), [](const animBtNode* a, const animBtNode* b)->bool {
             return a->exec_priority > b->exec_priority;
         });
+        // State that changes during update lives in the instance
+        for (auto node : exec_chain) {
+            node->data_idx = ctx->blend_node_count++;
+        }
         for (int i = 0; i < exec_chain.size(); ++i) {
             LOG_DBG(exec_chain[i]->exec_priority);
         }
@@ -150,7 +155,9 @@ public:
     }
 
     void prepareInstance(AnimMachineInstance* inst) {
-        // TODO:
+        for (auto node : exec_chain) {
+            node->prepareInstance(inst);
+        }
     }
 
     void updateInfluence(AnimMachine* master, AnimMachineInstance* anim_inst, float infl) override {
@@ -17,8 +17,9 @@ HSHARED<AnimMachineInstance> AnimMachine::createInstance() {
 
     inst->instance_data.fsm_data.resize(compile_context.fsm_count);
 
-    inst->vm_program = vm_program;
-    inst->vm.load_program(&inst->vm_program);
+    vm_program.init_frame(inst->vm_frame);
+    inst->vm.load_program(&vm_program);
+    inst->vm.load_frame(&inst->vm_frame);
     inst->vm.set_host_event_cb(std::bind(&AnimMachineInstance::onHostEventCb, inst, std::placeholders::_1));
     
     inst->samples.init(skeleton.get());
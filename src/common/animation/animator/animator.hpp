@@ -34,7 +34,9 @@ class AnimMachine : public ILoadable {
 
     std::unique_ptr<animUnit> rootUnit;
 
+    // Shared by every instance, each only keeps its own frame of variables
     animvm::vm_program vm_program;
+    int state_complete_addr = -1;
     std::vector<int> signals; // Keeping a list of those to clear them to 0 each update
 
     animGraphCompileContext compile_context; // Data left after compiling necessary for instantiation
@@ -125,10 +127,15 @@ public:
         }
 
         vm_program.decl_variable(animvm::type_bool, "state_complete");
+        state_complete_addr = vm_program.find_variable("state_complete").addr;
 
         // Init animator tree
         compile_context = animGraphCompileContext();
         rootUnit->compile(&compile_context, this, skeleton.get());
+        if (!vm_program.link()) {
+            LOG_ERR("AnimMachine failed to link expressions");
+            return false;
+        }
         return true;
     }
 
@@ -11,9 +11,11 @@ bool AnimMachineInstance::init(ResourceRef<AnimMachine>& anim_machine) {
     animator = anim_machine;
 
     instance_data.fsm_data.resize(anim_machine->compile_context.fsm_count);
+    instance_data.blend_node_data.resize(anim_machine->compile_context.blend_node_count);
 
-    vm_program = anim_machine->vm_program;
-    vm.load_program(&vm_program);
+    anim_machine->vm_program.init_frame(vm_frame);
+    vm.load_program(&anim_machine->vm_program);
+    vm.load_frame(&vm_frame);
     vm.set_host_event_cb(std::bind(&AnimMachineInstance::onHostEventCb, this, std::placeholders::_1));
     
     auto skel = anim_machine->getSkeleton();
@@ -74,8 +76,10 @@ bool AnimMachineInstance::update(float dt) {
     for (auto& kv : feedback_events) {
         kv.second = false;
     }
+    host_events.clear();
+    unknown_host_events.clear();
     // Clear state_complete
-    vm_program.set_variable_bool(vm_program.find_variable("state_complete").addr, 0);
+    vm_frame.set_variable_bool(animator->state_complete_addr, 0);
 
     // Clear sampler influence weights
     for (auto& sg : sync_groups) {
@@ -103,7 +107,8 @@ bool AnimMachineInstance::update(float dt) {
         if (sampler->total_influence == .0f) {
             continue;
         }
-        auto hitbox_seq = sampler->getSequence()->getHitboxSequence();
+        // By reference, handle ref counts are not atomic and the sequences are shared between instances
+        auto& hitbox_seq = sampler->getSequence()->getHitboxSequence();
         float cur_n_prev = sampler->cursor_prev / sampler->length_scaled;
         float cur_n = sampler->cursor / sampler->length_scaled;
         int sample_count = hitbox_seq->sample(
@@ -121,7 +126,7 @@ bool AnimMachineInstance::update(float dt) {
         if (sampler->total_influence == .0f) {
             continue;
         }
-        auto audio_seq = sampler->getSequence()->getAudioSequence();
+        auto& audio_seq = sampler->getSequence()->getAudioSequence();
         if (!audio_seq) {
             continue;
         }
@@ -132,7 +137,7 @@ bool AnimMachineInstance::update(float dt) {
 
     // Clear signals
     for (auto addr : animator->signals) {
-        vm_program.set_variable_float(addr, .0f);
+        vm_frame.set_variable_float(addr, .0f);
     }
 
     return true;
@@ -22,8 +22,15 @@ struct animUnitFsmInstanceData {
     float transition_factor = .0f;
 };
 
+struct animBlendNodeInstanceData {
+    animSampleBuffer samples;
+    float weight = .0f;
+    float total_influence = .0f;
+};
+
 struct animGraphInstanceData {
     std::vector<animUnitFsmInstanceData> fsm_data;
+    std::vector<animBlendNodeInstanceData> blend_node_data;
 };
 
 class AnimMachine;
@@ -33,12 +40,17 @@ class AnimMachineInstance {
     ResourceRef<AnimMachine> animator;
 
     // Virtual machine for running transition conditions
-    // and triggering host events
+    // and triggering host events, runs the AnimMachine's program
     animvm::VM vm;
-    // and a copy of the program from AnimMachine (Why do I need a copy here?)
-    animvm::vm_program vm_program;
+    // Params, signals and expression temporaries of this instance
+    animvm::vm_frame vm_frame;
 
     std::unordered_map<int, bool> feedback_events;
+    // Fired during the last update(), in order. Left for the caller to dispatch
+    // so update() can run on any thread
+    std::vector<int> host_events;
+    // Fired ids that have no feedback event, reported along with host_events
+    std::vector<int> unknown_host_events;
     
     std::vector<animAnimatorSampler> samplers;
     std::unordered_map<std::string, std::unique_ptr<animAnimatorSyncGroup>> sync_groups;
@@ -52,12 +64,11 @@ class AnimMachineInstance {
     animGraphInstanceData instance_data;
 
     void onHostEventCb(int id) {
-        LOG("Host event " << id);
         //Beep(300, 50);
+        host_events.push_back(id);
         const auto& it = feedback_events.find(id);
         if (it == feedback_events.end()) {
-            //assert(false);
-            LOG_ERR("Host event " << id << " does not exist");
+            unknown_host_events.push_back(id);
             return;
         }
         it->second = true;
@@ -73,9 +84,7 @@ public:
             assert(false);
             return 0;
         }
-        int ret = vm.run_at(addr);
-        vm.clear_stack();
-        return ret;
+        return vm.run_at(addr);
     }
 
     animAnimatorSampler* getSampler(int id) {
@@ -84,10 +93,10 @@ public:
     }
 
     void triggerSignal(int id) {
-        vm_program.set_variable_bool(id, true);
+        vm_frame.set_variable_bool(id, true);
     }
     bool isSignalTriggered(int id) {
-        return vm_program.get_variable_bool(id);
+        return vm_frame.get_variable_bool(id);
     }
     void triggerFeedbackEvent(int id) {
         auto it = feedback_events.find(id);
@@ -108,13 +117,17 @@ public:
         return it->second;
     }
     void setParamValue(int id, float val) {
-        vm_program.set_variable_float(/*addr*/id, val);
+        vm_frame.set_variable_float(/*addr*/id, val);
     }
     float getParamValue(int id) const {
-        return vm_program.get_variable_float(id);
+        return vm_frame.get_variable_float(id);
     }
 
+    // Only touches this instance's own data, instances can be updated in parallel
+    // as long as their animations are not being edited at the same time
     bool update(float dt);
+    const std::vector<int>& getHostEvents() const { return host_events; }
+    const std::vector<int>& getUnknownHostEvents() const { return unknown_host_events; }
 
     animGraphInstanceData* getData() { return &instance_data; }
 
@@ -57,6 +57,8 @@ namespace animvm {
                 LOG(read);
             }
             
+            node.free();
+
             vm_program prog;
             
             prog.decl_host_event("anim_end", 1);
@@ -64,17 +66,20 @@ namespace animvm {
             prog.decl_host_event("footstep", 3);
             prog.decl_host_event("fevt_door_open_end", 4);
             
-            node.make_program(prog);
-            node.free();
-
-            prog.instructions.push_back(HALT);
+            int addr = compile(prog, expr);
+            if (addr == -1 || !prog.link()) {
+                return false;
+            }
             prog.log_instructions();
             
+            vm_frame frame;
+            prog.init_frame(frame);
             VM vm;
             vm.set_host_event_cb(&host_event_cb);
             vm.load_program(&prog);
-            i32 ret = vm.run();
-            LOG("Anim VM returned(float): " << *(float*)&ret);
+            vm.load_frame(&frame);
+            i32 ret = vm.run_at(addr);
+            LOG("Anim VM returned(float): " << vm_to_float(ret));
             LOG("Anim VM returned(int): " << ret);
 
         } catch(const parse_exception& ex) {
@@ -83,34 +88,5 @@ namespace animvm {
         }
         return true;
     }
-    
-    inline void vm_test() {
-        float fa = 2.0f;
-        float fb = 0.1f;
-        
-        vm_program program;
-        program.instructions = {
-            PUSH, *(i32*)&fa,
-            PUSH, *(i32*)&fb,
-            SUBF,
-            PUSH, 0,
-            JMPLT, 13,
-            POP,
-            PRINTF,
-            //SLEEP, 500,
-            JMP, 2,
-            POP,
-            PRINTF,
-            PUSH, 0,
-            PRINTH,
-            HALT
-        };
-
-        VM vm;
-        vm.set_heap_string(0, "Hello, World!");
-        vm.load_program(&program);
-        i32 ret = vm.run();
-        LOG("Anim VM finished with: " << ret);
-    }
 
 }
\ No newline at end of file
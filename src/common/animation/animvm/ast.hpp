@@ -65,8 +65,10 @@ namespace animvm {
         ast_node()
             : _ptr_base(0) {}
 
-        float eval();
-        void make_program(vm_program& prog, bool lvalue = false);
+        // Only literals and operators on literals, folds to a single value
+        bool is_constant() const;
+        // Assigns to a variable somewhere inside, can't be dropped even if the value is unused
+        bool has_side_effects() const;
     };
     struct ast_translation_unit : public ast_node_base {
         std::vector<ast_node> statements;
@@ -114,179 +116,34 @@ namespace animvm {
         std::string name;
     };
 
-    inline float ast_node::eval() {
+    inline bool ast_node::is_constant() const {
         switch (type) {
-        case ast_type::ast_binary_op: {
-            if (binary_op->op == "+") {
-                return binary_op->left.eval() + binary_op->right.eval();
-            } else if(binary_op->op == "-") {
-                return binary_op->left.eval() - binary_op->right.eval();
-            } else if(binary_op->op == "*") {
-                return binary_op->left.eval() * binary_op->right.eval();
-            } else if(binary_op->op == "/") {
-                return binary_op->left.eval() / binary_op->right.eval();
-            }
-        }
-        case ast_type::ast_lit_numeric: {
-            if (lit_numeric->type == num_int) {
-                return lit_numeric->_int;
-            } else if(lit_numeric->type == num_float) {
-                return lit_numeric->_float;
-            }
-        }
+        case ast_type::ast_lit_numeric:
+            return true;
+        case ast_type::ast_unary_op:
+            return unary_op->operand.is_constant();
+        case ast_type::ast_binary_op:
+            return binary_op->op != "="
+                && binary_op->left.is_constant()
+                && binary_op->right.is_constant();
+        default:
+            return false;
         }
-        return .0f;
     }
 
-    inline void ast_node::make_program(vm_program& prog, bool lvalue) {
+    inline bool ast_node::has_side_effects() const {
         switch (type) {
-        case ast_type::ast_translation_unit: {
-            for (int i = 0; i < translation_unit->statements.size(); ++i) {
-                translation_unit->statements[i].make_program(prog);
-            }
-            return;
-        }
-        case ast_type::ast_expr_stmt: {
-            expr_stmt->expr.make_program(prog);
-            prog.instructions.push_back(POP);
-            return;
-        }
-        case ast_type::ast_return_stmt: {
-            return_stmt->expr.make_program(prog);
-            prog.instructions.push_back(HALT); // Just halt for now since we don't have functions
-            return;
-        }
-        case ast_type::ast_host_event_stmt: {
-            vm_host_event e = prog.find_host_event(host_event_stmt->name);
-            if (e.id == -1) {
-                throw parse_exception(token{}, "Host event '%s' does not exist", host_event_stmt->name.c_str());
-            }
-            prog.instructions.push_back(HEVT);
-            prog.instructions.push_back(e.id);
-            return;
-        }
-        case ast_type::ast_declaration: {
-            value_type t = declaration->type_specifier_seq.type_specifier_seq->type;
-            std::string name = declaration->declarator.declarator->name;
-            prog.decl_variable(t, name);
-            return;
-        }
-        case ast_type::ast_binary_op: {
-            if (binary_op->op == "=") {
-                binary_op->left.make_program(prog, true);
-                binary_op->right.make_program(prog);
-                prog.instructions.push_back(DSTORE);
-                if (!lvalue) {
-                    prog.instructions.push_back(DLOAD);
-                }
-                return;
-            }
-            
-            if (lvalue) {
-                throw parse_exception(token{}, "left operand must be an assignable lvalue");
-            }
-
-            if (binary_op->op == "+") {
-                binary_op->left.make_program(prog);
-                binary_op->right.make_program(prog);
-                prog.instructions.push_back(ADDF);
-                return;
-            } else if(binary_op->op == "-") {
-                binary_op->left.make_program(prog);
-                binary_op->right.make_program(prog);
-                prog.instructions.push_back(SUBF);
-                return;
-            } else if(binary_op->op == "*") {
-                binary_op->left.make_program(prog);
-                binary_op->right.make_program(prog);
-                prog.instructions.push_back(MULF);
-                return;
-            } else if(binary_op->op == "/") {
-                binary_op->left.make_program(prog);
-                binary_op->right.make_program(prog);
-                prog.instructions.push_back(DIVF);
-                return;
-            } else if(binary_op->op == "==") {
-                binary_op->left.make_program(prog);
-                binary_op->right.make_program(prog);
-                prog.instructions.push_back(EQ);
-                return;
-            } else if(binary_op->op == ">") {
-                binary_op->right.make_program(prog);
-                binary_op->left.make_program(prog);
-                prog.instructions.push_back(LT);
-                return;
-            } else if(binary_op->op == "<") {
-                binary_op->left.make_program(prog);
-                binary_op->right.make_program(prog);
-                prog.instructions.push_back(LT);
-                return;
-            } else if(binary_op->op == ">=") {
-                binary_op->right.make_program(prog);
-                binary_op->left.make_program(prog);
-                prog.instructions.push_back(LTE);
-                return;
-            } else if(binary_op->op == "<=") {
-                binary_op->left.make_program(prog);
-                binary_op->right.make_program(prog);
-                prog.instructions.push_back(LTE);
-                return;
-            } else if(binary_op->op == "&&") {
-                binary_op->left.make_program(prog);
-                binary_op->right.make_program(prog);
-                prog.instructions.push_back(LAND);
-                return;
-            } else if(binary_op->op == "||") {
-                binary_op->left.make_program(prog);
-                binary_op->right.make_program(prog);
-                prog.instructions.push_back(LOR);
-                return;
-            }
-            throw parse_exception(token{}, "unknown binary operator found");
-            return;
-        }
-        case ast_type::ast_unary_op: {
-            if (unary_op->op == "!") {
-                unary_op->operand.make_program(prog);
-                prog.instructions.push_back(NOT);
-                return;
-            }
-            throw parse_exception(token{}, "unknown unary operator found");
-            return;
-        }
-        case ast_type::ast_lit_numeric: {
-            if (lvalue) {
-                throw parse_exception(token{}, "left operand must be an assignable lvalue");
-            }
-
-            if (lit_numeric->type == num_int) {
-                prog.instructions.push_back(PUSH);
-                float flt = (float)lit_numeric->_int;
-                prog.instructions.push_back(*(i32*)&flt);
-                return;
-            } else if(lit_numeric->type == num_float) {
-                prog.instructions.push_back(PUSH);
-                prog.instructions.push_back(*(i32*)&lit_numeric->_float);
-                return;
-            }
-            return;
-        }
-        case ast_type::ast_identifier: {
-            auto var = prog.find_variable(identifier->name);
-            if (var.addr == -1) {
-                throw parse_exception(token{}, "Variable '%s' does not exist", identifier->name.c_str());
-            }
-            if (lvalue) {
-                prog.instructions.push_back(PUSH);
-                prog.instructions.push_back(var.addr);
-            } else {
-                prog.instructions.push_back(DPUSH);
-                prog.instructions.push_back(var.addr);
-            }
-            return;
-        }
+        case ast_type::ast_lit_numeric:
+        case ast_type::ast_identifier:
+            return false;
+        case ast_type::ast_unary_op:
+            return unary_op->operand.has_side_effects();
+        case ast_type::ast_binary_op:
+            return binary_op->op == "="
+                || binary_op->left.has_side_effects()
+                || binary_op->right.has_side_effects();
         default:
-            throw parse_exception(token{}, "Unknown ast node");
+            return true;
         }
     }
 
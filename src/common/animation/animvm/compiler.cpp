@@ -1,10 +1,264 @@
 #include "compiler.hpp"
 
+#include <algorithm>
 #include "parser.hpp"
 
 
 namespace animvm {
 
+    // Result of an expression, either known at compile time or sitting in a slot
+    struct vm_operand {
+        bool is_const;
+        i32 value;
+        uint16_t slot;
+    };
+
+    struct codegen_state {
+        vm_program& prog;
+        int temp_top = 0;
+
+        codegen_state(vm_program& prog)
+            : prog(prog) {}
+
+        uint16_t alloc_temp() {
+            int t = temp_top++;
+            prog.temp_count = std::max(prog.temp_count, temp_top);
+            if (t >= VM_SLOT_CAP) {
+                throw parse_exception(token{}, "expression is too complex");
+            }
+            return VM_TEMP_SLOT | t;
+        }
+
+        void emit(uint8_t op, uint16_t a, uint16_t b, uint16_t c) {
+            prog.instructions.push_back(vm_instr{ op, 0, a, b, c });
+        }
+        uint16_t constant(i32 value) {
+            int idx = prog.add_constant(value);
+            if (idx > 0xFFFF) {
+                throw parse_exception(token{}, "too many constants");
+            }
+            return idx;
+        }
+
+        // Puts the operand into dst, or into a fresh temporary when dst is -1
+        uint16_t materialize(const vm_operand& v, int dst) {
+            if (!v.is_const && (dst == -1 || v.slot == dst)) {
+                return v.slot;
+            }
+            uint16_t to = dst == -1 ? alloc_temp() : dst;
+            if (v.is_const) {
+                emit(MOVK, to, 0, constant(v.value));
+            } else {
+                emit(MOV, to, v.slot, 0);
+            }
+            return to;
+        }
+
+        static vm_operand make_const(i32 value) {
+            return vm_operand{ true, value, 0 };
+        }
+        static vm_operand make_slot(uint16_t slot) {
+            return vm_operand{ false, 0, slot };
+        }
+
+        static bool is_commutative(uint8_t op) {
+            return op == ADDF || op == MULF || op == EQ || op == NE || op == LAND || op == LOR;
+        }
+        // op with its operands swapped, -1 if there is no such op
+        static int mirror(uint8_t op) {
+            if (is_commutative(op)) {
+                return op;
+            }
+            switch (op) {
+            case LT: return GT;
+            case LTE: return GTE;
+            case GT: return LT;
+            case GTE: return LTE;
+            default: return -1;
+            }
+        }
+
+        // dst is a slot the result should preferably end up in, -1 for a temporary.
+        // Nothing is emitted for constant results
+        vm_operand expr(ast_node& node, int dst) {
+            switch (node.type) {
+            case ast_type::ast_lit_numeric: {
+                if (node.lit_numeric->type == num_int) {
+                    return make_const(vm_from_float((float)node.lit_numeric->_int));
+                }
+                return make_const(vm_from_float(node.lit_numeric->_float));
+            }
+            case ast_type::ast_identifier: {
+                auto var = prog.find_variable(node.identifier->name);
+                if (var.addr == -1) {
+                    throw parse_exception(token{}, "Variable '%s' does not exist", node.identifier->name.c_str());
+                }
+                return make_slot(var.addr);
+            }
+            case ast_type::ast_unary_op:
+                return unary(*node.unary_op, dst);
+            case ast_type::ast_binary_op:
+                return binary(*node.binary_op, dst);
+            default:
+                throw parse_exception(token{}, "Unknown ast node");
+            }
+        }
+
+        vm_operand unary(ast_unary_op& op, int dst) {
+            int instr = -1;
+            if (op.op == "!") {
+                instr = NOT;
+            } else if (op.op == "-") {
+                instr = NEGF;
+            } else if (op.op != "+") {
+                throw parse_exception(token{}, "unknown unary operator found");
+            }
+            const int temp_mark = temp_top;
+            vm_operand v = expr(op.operand, -1);
+            if (instr == -1) {
+                return v;
+            }
+            if (v.is_const) {
+                return make_const(instr == NOT ? vm_not(v.value) : vm_negf(v.value));
+            }
+            temp_top = temp_mark;
+            uint16_t to = dst == -1 ? alloc_temp() : dst;
+            emit(instr, to, v.slot, 0);
+            return make_slot(to);
+        }
+
+        vm_operand binary(ast_binary_op& op, int dst) {
+            if (op.op == "=") {
+                if (op.left.type != ast_type::ast_identifier) {
+                    throw parse_exception(token{}, "left operand must be an assignable lvalue");
+                }
+                vm_operand target = expr(op.left, -1);
+                vm_operand v = expr(op.right, target.slot);
+                materialize(v, target.slot);
+                return target;
+            }
+
+            int instr = -1;
+            const char* ops[] = { "+", "-", "*", "/", "<", "<=", ">", ">=", "==", "!=", "&&", "||" };
+            const INSTRUCTION instrs[] = { ADDF, SUBF, MULF, DIVF, LT, LTE, GT, GTE, EQ, NE, LAND, LOR };
+            for (int i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+                if (op.op == ops[i]) {
+                    instr = instrs[i];
+                    break;
+                }
+            }
+            if (instr == -1) {
+                throw parse_exception(token{}, "unknown binary operator found");
+            }
+
+            // A constant that decides && or || drops the other side if dropping it changes nothing
+            if (instr == LAND || instr == LOR) {
+                const i32 decides = instr == LAND ? 0 : 1;
+                if (op.left.is_constant() && !op.right.has_side_effects()
+                    && (expr(op.left, -1).value != 0) == (decides != 0)) {
+                    return make_const(decides);
+                }
+                if (op.right.is_constant() && !op.left.has_side_effects()
+                    && (expr(op.right, -1).value != 0) == (decides != 0)) {
+                    return make_const(decides);
+                }
+            }
+
+            const int temp_mark = temp_top;
+            vm_operand l = expr(op.left, -1);
+            vm_operand r = expr(op.right, -1);
+            if (l.is_const && r.is_const) {
+                return make_const(vm_eval_binary(instr, l.value, r.value));
+            }
+            // x * 1 and x / 1 are exact
+            const i32 one = vm_from_float(1.f);
+            if ((instr == MULF || instr == DIVF) && r.is_const && r.value == one) {
+                return l;
+            }
+            if (instr == MULF && l.is_const && l.value == one) {
+                return r;
+            }
+
+            if (l.is_const) {
+                int mirrored = mirror(instr);
+                if (mirrored == -1) {
+                    // No form takes a constant on the left
+                    uint16_t lslot = materialize(l, -1);
+                    temp_top = temp_mark;
+                    uint16_t to = dst == -1 ? alloc_temp() : dst;
+                    emit(instr, to, lslot, r.slot);
+                    return make_slot(to);
+                }
+                std::swap(l, r);
+                instr = mirrored;
+            }
+
+            // Operands are read before the result is written, the result can reuse their temporaries
+            temp_top = temp_mark;
+            uint16_t to = dst == -1 ? alloc_temp() : dst;
+            if (r.is_const) {
+                emit(instr + INSTRUCTION_K_OFFSET, to, l.slot, constant(r.value));
+            } else {
+                emit(instr, to, l.slot, r.slot);
+            }
+            return make_slot(to);
+        }
+
+        // Returns true once the code returns, everything after that is dead
+        bool statement(ast_node& node) {
+            temp_top = 0;
+            switch (node.type) {
+            case ast_type::ast_declaration: {
+                value_type t = node.declaration->type_specifier_seq.type_specifier_seq->type;
+                std::string name = node.declaration->declarator.declarator->name;
+                prog.decl_variable(t, name);
+                return false;
+            }
+            case ast_type::ast_expr_stmt: {
+                // The value is thrown away, only assignments leave anything behind
+                if (node.expr_stmt->expr.has_side_effects()) {
+                    expr(node.expr_stmt->expr, -1);
+                }
+                return false;
+            }
+            case ast_type::ast_return_stmt: {
+                vm_operand v = expr(node.return_stmt->expr, -1);
+                if (v.is_const) {
+                    emit(RETK, 0, 0, constant(v.value));
+                } else {
+                    emit(RET, 0, v.slot, 0);
+                }
+                return true;
+            }
+            case ast_type::ast_host_event_stmt: {
+                vm_host_event e = prog.find_host_event(node.host_event_stmt->name);
+                if (e.id < 0 || e.id > 0xFFFF) {
+                    throw parse_exception(token{}, "Host event '%s' does not exist", node.host_event_stmt->name.c_str());
+                }
+                emit(HEVT, 0, 0, e.id);
+                return false;
+            }
+            default:
+                throw parse_exception(token{}, "Unknown ast node");
+            }
+        }
+
+        void translation_unit(ast_translation_unit& tu) {
+            bool returned = false;
+            for (int i = 0; i < tu.statements.size(); ++i) {
+                ast_node& stmt = tu.statements[i];
+                // Declarations still count after a return, code does not
+                if (returned && stmt.type != ast_type::ast_declaration) {
+                    continue;
+                }
+                returned = statement(stmt) || returned;
+            }
+            if (!returned) {
+                emit(RETK, 0, 0, constant(0));
+            }
+        }
+    };
+
 
     int compile(vm_program& prog, const char* source) {
         ast_node node;
@@ -12,13 +266,20 @@ namespace animvm {
             return -1;
         }
 
-        int first_instruction = prog.instructions.size();
+        const int first_instruction = prog.instructions.size();
+        const size_t first_constant = prog.constants.size();
+        const int temp_count = prog.temp_count;
         try {
-            node.make_program(prog);
+            codegen_state state(prog);
+            state.translation_unit(*node.translation_unit);
         } catch(const parse_exception& ex) {
             LOG_ERR("animvm compile error: " << ex.what());
+            prog.instructions.resize(first_instruction);
+            prog.constants.resize(first_constant);
+            prog.temp_count = temp_count;
             return -1;
         }
+        prog.linked = false;
 
         return first_instruction;
     }
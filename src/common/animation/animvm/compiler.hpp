@@ -6,6 +6,9 @@
 namespace animvm {
 
 
+    // Appends the code for source to prog and returns its address, -1 on failure.
+    // Constants are folded and code that can't affect the result is dropped.
+    // prog has to be link()ed again before it runs
     int compile(vm_program& prog, const char* source);
 
 
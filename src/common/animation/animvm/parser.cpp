@@ -236,6 +236,7 @@ namespace animvm {
         node.type = ast_type::ast_host_event_stmt;
         node.host_event_stmt = new ast_host_event_stmt;
         node.host_event_stmt->name = tok.str;
+        return true;
     }
 
     bool parse_statement(parse_state& ps, ast_node& node) {
@@ -30,61 +30,176 @@ namespace animvm {
         i32 id;
     };
 
-    struct vm_program {
-        std::vector<i32> data;
-        std::vector<i32> instructions;
+    // Temporaries are emitted with this bit set and moved past the variables by link(),
+    // so declaring a variable after an expression was compiled does not shift them
+    constexpr uint16_t VM_TEMP_SLOT = 0x8000;
+    constexpr int VM_SLOT_CAP = VM_TEMP_SLOT;
 
-        std::map<std::string, vm_variable> variables;
-        std::map<std::string, vm_host_event> host_events;
-
-        void clear() {
-            data.clear();
-            instructions.clear();
-            variables.clear();
-            host_events.clear();
-        }
+    // Per instance slots: variables followed by the temporaries expressions need
+    struct vm_frame {
+        std::vector<i32> slots;
 
         void set_variable_float(i32 addr, float value) {
-            if (addr < 0 || addr >= data.size()) {
+            if (addr < 0 || addr >= slots.size()) {
                 assert(false);
                 return;
             }
-            data[addr] = *(i32*)&value;
+            slots[addr] = vm_from_float(value);
         }
         void set_variable_int(i32 addr, i32 value) {
-            if (addr < 0 || addr >= data.size()) {
+            if (addr < 0 || addr >= slots.size()) {
                 assert(false);
                 return;
             }
-            data[addr] = value;
+            slots[addr] = value;
         }
         void set_variable_bool(i32 addr, bool value) {
-            if (addr < 0 || addr >= data.size()) {
+            if (addr < 0 || addr >= slots.size()) {
                 assert(false);
                 return;
             }
-            data[addr] = value;
+            slots[addr] = value;
         }
         float get_variable_float(i32 addr) const {
-            if (addr < 0 || addr >= data.size()) {
+            if (addr < 0 || addr >= slots.size()) {
                 assert(false);
                 return .0f;
             }
-            return *(float*)&data[addr];
+            return vm_to_float(slots[addr]);
         }
         int get_variable_int(i32 addr) const {
-            if (addr < 0 || addr >= data.size()) {
+            if (addr < 0 || addr >= slots.size()) {
                 assert(false);
                 return 0;
             }
-            return data[addr];
+            return slots[addr];
         }
         bool get_variable_bool(i32 addr) const {
-            if (addr < 0 || addr >= data.size()) {
+            if (addr < 0 || addr >= slots.size()) {
                 assert(false);
                 return false;
             }
-            return data[addr];
+            return slots[addr];
+        }
+    };
+
+    // Code and constants are read only once linked and shared by every vm running the program,
+    // variables live in each vm's own frame
+    struct vm_program {
+        std::vector<i32> data; // Initial variable values
+        std::vector<i32> constants;
+        std::vector<vm_instr> instructions; // As compiled, temporaries not yet placed
+        std::vector<vm_instr> code;         // Linked, what the vm runs
+        int temp_count = 0;
+        bool linked = false;
+
+        std::map<std::string, vm_variable> variables;
+        std::map<std::string, vm_host_event> host_events;
+
+        void clear() {
+            data.clear();
+            constants.clear();
+            instructions.clear();
+            code.clear();
+            temp_count = 0;
+            linked = false;
+            variables.clear();
+            host_events.clear();
+        }
+
+        int frame_size() const {
+            return (int)data.size() + temp_count;
+        }
+        void init_frame(vm_frame& frame) const {
+            frame.slots = data;
+            frame.slots.resize(frame_size());
+        }
+
+        int add_constant(i32 value) {
+            for (int i = 0; i < constants.size(); ++i) {
+                if (constants[i] == value) {
+                    return i;
+                }
+            }
+            constants.push_back(value);
+            return (int)constants.size() - 1;
+        }
+
+        // Places temporaries after the variables and checks every operand once,
+        // so the vm does not have to while running
+        bool link() {
+            if (frame_size() > VM_SLOT_CAP) {
+                LOG_ERR("animvm link: frame of " << frame_size() << " slots is too large");
+                return false;
+            }
+            auto slot = [this](uint16_t s) -> uint16_t {
+                if (s & VM_TEMP_SLOT) {
+                    return (uint16_t)(data.size() + (s & ~VM_TEMP_SLOT));
+                }
+                return s;
+            };
+            code.resize(instructions.size());
+            for (int i = 0; i < instructions.size(); ++i) {
+                vm_instr in = instructions[i];
+                bool reads_b = false;
+                bool reads_c = false;
+                bool reads_k = false;
+                bool writes_a = false;
+                if (in.op == RET) {
+                    reads_b = true;
+                } else if (in.op == RETK) {
+                    reads_k = true;
+                } else if (in.op == HEVT) {
+                } else if (in.op == MOV || in.op == NOT || in.op == NEGF) {
+                    writes_a = true;
+                    reads_b = true;
+                } else if (in.op == MOVK) {
+                    writes_a = true;
+                    reads_k = true;
+                } else if (in.op >= ADDF && in.op <= LOR) {
+                    writes_a = true;
+                    reads_b = true;
+                    reads_c = true;
+                } else if (in.op >= ADDFK && in.op <= LORK) {
+                    writes_a = true;
+                    reads_b = true;
+                    reads_k = true;
+                } else {
+                    LOG_ERR("animvm link: invalid instruction " << (int)in.op << " at " << i);
+                    return false;
+                }
+                if (writes_a) {
+                    in.a = slot(in.a);
+                }
+                if (reads_b) {
+                    in.b = slot(in.b);
+                }
+                if (reads_c) {
+                    in.c = slot(in.c);
+                }
+                if ((writes_a && in.a >= frame_size())
+                    || (reads_b && in.b >= frame_size())
+                    || (reads_c && in.c >= frame_size())
+                    || (reads_k && in.c >= constants.size())
+                ) {
+                    LOG_ERR("animvm link: operand out of range at " << i << ", " << instruction_to_str(in.op));
+                    return false;
+                }
+                code[i] = in;
+            }
+            linked = true;
+            return true;
+        }
+
+        // Expressions have no branches, so this is how many instructions
+        // a run starting at addr executes
+        int instruction_count_at(i32 addr) const {
+            for (int i = addr; i < code.size(); ++i) {
+                if (code[i].op == RET || code[i].op == RETK) {
+                    return i - addr + 1;
+                }
+            }
+            return 0;
         }
 
         vm_variable find_variable(const std::string& name) {
@@ -115,6 +230,7 @@ namespace animvm {
             var.type = t;
             var.addr = data.size();
             data.resize(data.size() + words_to_alloc);
+            linked = false;
             variables.insert(std::make_pair(name, var));
             return var.addr;
         }
@@ -131,8 +247,10 @@ namespace animvm {
         }
 
         void log_instructions() const {
-            for (int i = 0; i < instructions.size(); ++i) {
-                LOG(instruction_to_str(instructions[i]));
+            const std::vector<vm_instr>& list = linked ? code : instructions;
+            for (int i = 0; i < list.size(); ++i) {
+                const vm_instr& in = list[i];
+                LOG(i << ": " << instruction_to_str(in.op) << " " << in.a << " " << in.b << " " << in.c);
             }
         }
     };
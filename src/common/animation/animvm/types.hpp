@@ -1,75 +1,146 @@
 #pragma once
 
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
 
 namespace animvm {
-    
+
     typedef int32_t i32;
-    
-    enum INSTRUCTION {
-        HALT = 0xC0000000,
-        PUSH,               // Push a value, next instruction is the value
-        POP,
-        DPUSH,              // Push a value from the program's data, next instruction is a pointer to that value
-        DSTORE,             // put value at sp-1 to an address stored in sp-2
-        DLOAD,              // put a value on the stack from address at sp-1
-        ADD,
-        SUB,
-        MUL,
-        DIV,
+
+    // Three address instructions over a frame of slots, variables first, then temporaries.
+    // a is the destination, b and c the operands. The K forms take c as an index
+    // into the program's constants instead of a slot
+    enum INSTRUCTION : uint8_t {
+        RET,        // Return slot b
+        RETK,       // Return constant c
+        HEVT,       // Trigger a host event with c as id
+        MOV,        // a = b
+        MOVK,       // a = k[c]
         ADDF,
         SUBF,
         MULF,
         DIVF,
         LT,
         LTE,
+        GT,
+        GTE,
+        EQ,
+        NE,
         LAND,
         LOR,
-        NOT,
-        EQ,
-        JMP,
-        JMPT,
-        JMPF,
-        JMPLT,
-        PRINT,
-        PRINTF,
-        PRINTH,
-        SLEEP,
-        HEVT                // Trigger a host event with next instruction as id
+        ADDFK,
+        SUBFK,
+        MULFK,
+        DIVFK,
+        LTK,
+        LTEK,
+        GTK,
+        GTEK,
+        EQK,
+        NEK,
+        LANDK,
+        LORK,
+        NOT,        // a = !b
+        NEGF,       // a = -b
+        INSTRUCTION_COUNT
     };
-    inline std::string instruction_to_str(i32 instr) {
+    // Distance from a register-register op to its constant form
+    constexpr int INSTRUCTION_K_OFFSET = ADDFK - ADDF;
+
+    struct vm_instr {
+        uint8_t op;
+        uint8_t unused;
+        uint16_t a;
+        uint16_t b;
+        uint16_t c;
+    };
+
+    inline std::string instruction_to_str(uint8_t instr) {
         switch (instr) {
-        case HALT: return "HALT";
-        case PUSH: return "PUSH";
-        case POP: return "POP";
-        case DPUSH: return "DPUSH";
-        case DSTORE: return "DSTORE";
-        case DLOAD: return "DLOAD";
-        case ADD: return "ADD";
-        case SUB: return "SUB";
-        case MUL: return "MUL";
-        case DIV: return "DIV";
+        case RET: return "RET";
+        case RETK: return "RETK";
+        case HEVT: return "HEVT";
+        case MOV: return "MOV";
+        case MOVK: return "MOVK";
         case ADDF: return "ADDF";
         case SUBF: return "SUBF";
         case MULF: return "MULF";
         case DIVF: return "DIVF";
         case LT: return "LT";
         case LTE: return "LTE";
+        case GT: return "GT";
+        case GTE: return "GTE";
+        case EQ: return "EQ";
+        case NE: return "NE";
         case LAND: return "LAND";
         case LOR: return "LOR";
+        case ADDFK: return "ADDFK";
+        case SUBFK: return "SUBFK";
+        case MULFK: return "MULFK";
+        case DIVFK: return "DIVFK";
+        case LTK: return "LTK";
+        case LTEK: return "LTEK";
+        case GTK: return "GTK";
+        case GTEK: return "GTEK";
+        case EQK: return "EQK";
+        case NEK: return "NEK";
+        case LANDK: return "LANDK";
+        case LORK: return "LORK";
         case NOT: return "NOT";
-        case EQ: return "EQ";
-        case JMP: return "JMP";
-        case JMPT: return "JMPT";
-        case JMPF: return "JMPF";
-        case JMPLT: return "JMPLT";
-        case PRINT: return "PRINT";
-        case PRINTF: return "PRINTF";
-        case PRINTH: return "PRINTH";
-        case SLEEP: return "SLEEP";
-        case HEVT: return "HEVT";
+        case NEGF: return "NEGF";
         default: return std::to_string(instr);
         }
     }
 
+    // Values are stored as raw 32 bit words, floats bit cast in
+    inline float vm_to_float(i32 v) {
+        float f;
+        memcpy(&f, &v, sizeof(f));
+        return f;
+    }
+    inline i32 vm_from_float(float f) {
+        i32 v;
+        memcpy(&v, &f, sizeof(v));
+        return v;
+    }
+
+    // Instruction semantics, shared by the vm and the constant folder
+    // so folded results match what would have run
+    inline i32 vm_addf(i32 a, i32 b) { return vm_from_float(vm_to_float(a) + vm_to_float(b)); }
+    inline i32 vm_subf(i32 a, i32 b) { return vm_from_float(vm_to_float(a) - vm_to_float(b)); }
+    inline i32 vm_mulf(i32 a, i32 b) { return vm_from_float(vm_to_float(a) * vm_to_float(b)); }
+    inline i32 vm_divf(i32 a, i32 b) { return vm_from_float(vm_to_float(a) / vm_to_float(b)); }
+    inline i32 vm_lt(i32 a, i32 b) { return vm_to_float(a) < vm_to_float(b); }
+    inline i32 vm_lte(i32 a, i32 b) { return vm_to_float(a) <= vm_to_float(b); }
+    inline i32 vm_gt(i32 a, i32 b) { return vm_to_float(a) > vm_to_float(b); }
+    inline i32 vm_gte(i32 a, i32 b) { return vm_to_float(a) >= vm_to_float(b); }
+    inline i32 vm_eq(i32 a, i32 b) { return vm_to_float(a) == vm_to_float(b); }
+    inline i32 vm_ne(i32 a, i32 b) { return vm_to_float(a) != vm_to_float(b); }
+    inline i32 vm_land(i32 a, i32 b) { return a && b; }
+    inline i32 vm_lor(i32 a, i32 b) { return a || b; }
+    inline i32 vm_not(i32 a) { return !a; }
+    inline i32 vm_negf(i32 a) { return vm_from_float(-vm_to_float(a)); }
+
+    // op is a register-register binary instruction
+    inline i32 vm_eval_binary(uint8_t op, i32 a, i32 b) {
+        switch (op) {
+        case ADDF: return vm_addf(a, b);
+        case SUBF: return vm_subf(a, b);
+        case MULF: return vm_mulf(a, b);
+        case DIVF: return vm_divf(a, b);
+        case LT: return vm_lt(a, b);
+        case LTE: return vm_lte(a, b);
+        case GT: return vm_gt(a, b);
+        case GTE: return vm_gte(a, b);
+        case EQ: return vm_eq(a, b);
+        case NE: return vm_ne(a, b);
+        case LAND: return vm_land(a, b);
+        case LOR: return vm_lor(a, b);
+        default: return 0;
+        }
+    }
+
 
 }
\ No newline at end of file
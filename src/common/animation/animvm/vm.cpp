@@ -3,218 +3,71 @@
 
 namespace animvm {
 
-    VM_ERR VM::exec() {
-        switch (prog[pc]) {
-        case HALT:
-            running = false;
-            break;
-        case PUSH:
-            fetch();
-            if (sp >= VM_STACK_CAP) {
-                return VM_STACK_OVERFLOW;
-            }
-            mem_stack[sp] = prog[pc];
-            ++sp;
-            break;
-        case POP:
-            if (sp == 0) {
-                return VM_STACK_UNDERFLOW;
-            }
-            --sp;
-            break;
-        case DPUSH:
-            fetch();
-            if (sp >= VM_STACK_CAP) {
-                return VM_STACK_OVERFLOW;
-            }
-            mem_stack[sp] = prog_data[prog[pc]];
-            ++sp;
-            break;
-        case DSTORE:
-            if (sp < 2) {
-                return VM_STACK_UNDERFLOW;
-            }
-            prog_data[mem_stack[sp - 2]] = mem_stack[sp - 1];
-            --sp;
-            break;
-        case DLOAD:
-            if (sp == 0) {
-                return VM_STACK_UNDERFLOW;
-            }
-            mem_stack[sp - 1] = prog_data[mem_stack[sp - 1]];
-            break;
-        case ADD: {
-            if (sp < 2) {
-                return VM_STACK_UNDERFLOW;
-            }
-            mem_stack[sp - 2] = mem_stack[sp - 2] + mem_stack[sp - 1];
-            --sp;
-            break;
-        }
-        case SUB: {
-            if (sp < 2) {
-                return VM_STACK_UNDERFLOW;
-            }
-            mem_stack[sp - 2] = mem_stack[sp - 2] - mem_stack[sp - 1];
-            --sp;
-            break;
-        }
-        case MUL: {
-            if (sp < 2) {
-                return VM_STACK_UNDERFLOW;
-            }
-            mem_stack[sp - 2] = mem_stack[sp - 2] * mem_stack[sp - 1];
-            --sp;
-            break;
-        }
-        case DIV: {
-            if (sp < 2) {
-                return VM_STACK_UNDERFLOW;
-            }
-            mem_stack[sp - 2] = mem_stack[sp - 2] / mem_stack[sp - 1];
-            --sp;
-            break;
-        }
-        case ADDF: {
-            if (sp < 2) {
-                return VM_STACK_UNDERFLOW;
-            }
-            *(float*)&mem_stack[sp - 2] = *(float*)&mem_stack[sp - 2] + *(float*)&mem_stack[sp - 1];
-            --sp;
-            break;
-        }
-        case SUBF: {
-            if (sp < 2) {
-                return VM_STACK_UNDERFLOW;
-            }
-            *(float*)&mem_stack[sp - 2] = *(float*)&mem_stack[sp - 2] - *(float*)&mem_stack[sp - 1];
-            --sp;
-            break;
-        }
-        case MULF: {
-            if (sp < 2) {
-                return VM_STACK_UNDERFLOW;
-            }
-            *(float*)&mem_stack[sp - 2] = *(float*)&mem_stack[sp - 2] * *(float*)&mem_stack[sp - 1];
-            --sp;
-            break;
-        }
-        case DIVF: {
-            if (sp < 2) {
-                return VM_STACK_UNDERFLOW;
-            }
-            *(float*)&mem_stack[sp - 2] = *(float*)&mem_stack[sp - 2] / *(float*)&mem_stack[sp - 1];
-            --sp;
-            break;
-        }
-        case LT:
-            if (sp < 2) {
-                return VM_STACK_UNDERFLOW;
-            }
-            mem_stack[sp - 2] = mem_stack[sp - 2] < mem_stack[sp - 1];
-            --sp;
-            break;
-        case LTE:
-            if (sp < 2) {
-                return VM_STACK_UNDERFLOW;
-            }
-            mem_stack[sp - 2] = mem_stack[sp - 2] <= mem_stack[sp - 1];
-            --sp;
-            break;
-        case LAND:
-            if (sp < 2) {
-                return VM_STACK_UNDERFLOW;
-            }
-            mem_stack[sp - 2] = mem_stack[sp - 2] && mem_stack[sp - 1];
-            --sp;
-            break;
-        case LOR:
-            if (sp < 2) {
-                return VM_STACK_UNDERFLOW;
-            }
-            mem_stack[sp - 2] = mem_stack[sp - 2] || mem_stack[sp - 1];
-            --sp;
-            break;
-        case NOT:
-            if (sp < 1) {
-                return VM_STACK_UNDERFLOW;
-            }
-            mem_stack[sp - 1] = !mem_stack[sp - 1];
-            break;
-        case EQ:
-            if (sp < 2) {
-                return VM_STACK_UNDERFLOW;
-            }
-            mem_stack[sp - 2] = !(mem_stack[sp - 2] - mem_stack[sp - 1]);
-            --sp;
-            break;
-        case JMP:
-            fetch();
-            pc = prog[pc] - 1;
-            break;
-        case JMPT:
-            if (sp == 0) {
-                return VM_STACK_UNDERFLOW;
-            }
-            fetch();
-            if (mem_stack[sp - 1] != 0) {
-                pc = prog[pc] - 1;
-            }
-            break;
-        case JMPF:
-            if (sp == 0) {
-                return VM_STACK_UNDERFLOW;
-            }
-            fetch();
-            if (mem_stack[sp - 1] == 0) {
-                pc = prog[pc] - 1;
-            }
-            break;
-        case JMPLT: {
-            if (sp < 2) {
-                return VM_STACK_UNDERFLOW;
-            }
-            fetch();
-            if (mem_stack[sp - 2] < mem_stack[sp - 1]) {
-                pc = prog[pc] - 1;
-            }
-            break;
-        }
-        case PRINT:
-            if (sp == 0) {
-                return VM_STACK_UNDERFLOW;
-            }
-            LOG("ANIMVM: " << mem_stack[sp - 1]);
-            break;
-        case PRINTF:
-            if (sp == 0) {
-                return VM_STACK_UNDERFLOW;
-            }
-            LOG("ANIMVM: " << *(float*)&mem_stack[sp - 1]);
-            break;
-        case PRINTH: {
-            if (sp == 0) {
-                return VM_STACK_UNDERFLOW;
-            }
-            i32 p = mem_stack[sp - 1];
-            LOG("ANIMVM: " << &((uint8_t*)mem_heap)[p]);
-            --sp;
-            break;
-        }
-        case SLEEP: {
-            fetch();
-            std::this_thread::sleep_for(std::chrono::milliseconds(prog[pc]));
-            break;
-        }
-        case HEVT: {
-            fetch();
-            do_host_event(prog[pc]);
-            break;
+    i32 VM::run_at(i32 addr) {
+        if (!code || addr < 0 || addr >= code_len) {
+            assert(false);
+            return 0;
         }
+
+        const vm_instr* ip = code + addr;
+        i32* s = slots;
+        const i32* k = constants;
+
+#if ANIMVM_THREADED_DISPATCH
+        // Same order as INSTRUCTION
+        static void* const dispatch_table[INSTRUCTION_COUNT] = {
+            &&op_RET, &&op_RETK, &&op_HEVT, &&op_MOV, &&op_MOVK,
+            &&op_ADDF, &&op_SUBF, &&op_MULF, &&op_DIVF,
+            &&op_LT, &&op_LTE, &&op_GT, &&op_GTE, &&op_EQ, &&op_NE, &&op_LAND, &&op_LOR,
+            &&op_ADDFK, &&op_SUBFK, &&op_MULFK, &&op_DIVFK,
+            &&op_LTK, &&op_LTEK, &&op_GTK, &&op_GTEK, &&op_EQK, &&op_NEK, &&op_LANDK, &&op_LORK,
+            &&op_NOT, &&op_NEGF
+        };
+#define VM_OP(NAME) op_##NAME:
+#define VM_NEXT() ++ip; goto *dispatch_table[ip->op]
+        goto *dispatch_table[ip->op];
+#else
+#define VM_OP(NAME) case NAME:
+#define VM_NEXT() ++ip; continue
+        while (true) {
+        switch (ip->op) {
+#endif
+#define VM_BINARY(NAME, FN) \
+        VM_OP(NAME) s[ip->a] = FN(s[ip->b], s[ip->c]); VM_NEXT(); \
+        VM_OP(NAME##K) s[ip->a] = FN(s[ip->b], k[ip->c]); VM_NEXT();
+
+        VM_OP(RET) return s[ip->b];
+        VM_OP(RETK) return k[ip->c];
+        VM_OP(HEVT) do_host_event(ip->c); VM_NEXT();
+        VM_OP(MOV) s[ip->a] = s[ip->b]; VM_NEXT();
+        VM_OP(MOVK) s[ip->a] = k[ip->c]; VM_NEXT();
+        VM_BINARY(ADDF, vm_addf)
+        VM_BINARY(SUBF, vm_subf)
+        VM_BINARY(MULF, vm_mulf)
+        VM_BINARY(DIVF, vm_divf)
+        VM_BINARY(LT, vm_lt)
+        VM_BINARY(LTE, vm_lte)
+        VM_BINARY(GT, vm_gt)
+        VM_BINARY(GTE, vm_gte)
+        VM_BINARY(EQ, vm_eq)
+        VM_BINARY(NE, vm_ne)
+        VM_BINARY(LAND, vm_land)
+        VM_BINARY(LOR, vm_lor)
+        VM_OP(NOT) s[ip->a] = vm_not(s[ip->b]); VM_NEXT();
+        VM_OP(NEGF) s[ip->a] = vm_negf(s[ip->b]); VM_NEXT();
+
+#if !ANIMVM_THREADED_DISPATCH
         default:
-            return VM_INVALID_INSTRUCTION;
+            // link() rejects unknown instructions, only reachable with an unlinked program
+            LOG_ERR("anim VM error: invalid instruction " << instruction_to_str(ip->op) << " at " << (ip - code));
+            assert(false);
+            return 0;
+        }
         }
-        return VM_OK;
+#endif
+#undef VM_BINARY
+#undef VM_NEXT
+#undef VM_OP
     }
 
 }
\ No newline at end of file
@@ -1,41 +1,32 @@
 #pragma once
 
 #include <assert.h>
-#include <conio.h>
 #include <functional>
 #include "program.hpp"
 #include "log/log.hpp"
 
 
-namespace animvm {
+// Threaded dispatch, each instruction jumps straight to the next one's handler
+// through a table of label addresses. Compilers without computed goto get a switch
+#if defined(__GNUC__) || defined(__clang__)
+#define ANIMVM_THREADED_DISPATCH 1
+#else
+#define ANIMVM_THREADED_DISPATCH 0
+#endif
 
-    enum VM_ERR {
-        VM_OK,
-        VM_INVALID_INSTRUCTION,
-        VM_STACK_OVERFLOW,
-        VM_STACK_UNDERFLOW
-    };
 
-    constexpr int VM_STACK_CAP = 512;
-    constexpr int VM_HEAP_CAP = 512;
+namespace animvm {
+
+    // Holds no code of its own, runs a linked vm_program over a frame of slots.
+    // Many vms can share one program, each with its own frame
     class VM {
-        i32 mem_stack[VM_STACK_CAP];
-        int sp = 0;
-        i32 mem_heap[VM_HEAP_CAP];
-        vm_program* program = 0;
-        i32* prog_data = 0;
-        i32* prog = 0;
-        int prog_len = 0;
-        int pc = -1;
-        bool running = false;
+        const vm_instr* code = 0;
+        const i32* constants = 0;
+        int code_len = 0;
+        i32* slots = 0;
 
         std::function<void(i32)> fn_host_event_cb;
 
-        void fetch() {
-            ++pc;
-        }
-        VM_ERR exec();
-
         void do_host_event(i32 id) {
             if (fn_host_event_cb) {
                 fn_host_event_cb(id);
@@ -46,73 +37,18 @@ namespace animvm {
             fn_host_event_cb = fn;
         }
 
-        void set_heap_string(i32 addr, const char* str) {
-            size_t len = strlen(str) + 1;
-            i32 byte_addr = addr * sizeof(mem_heap[0]);
-            uint8_t* begin = ((uint8_t*)mem_heap) + byte_addr;
-            i32 bytes_available = VM_HEAP_CAP * sizeof(mem_heap[0]) - byte_addr;
-            for (int i = 0; i < len && i < bytes_available; ++i) {
-                begin[i] = str[i];
-            }
+        void load_program(const vm_program* p) {
+            assert(p->linked);
+            code = p->code.data();
+            constants = p->constants.data();
+            code_len = p->code.size();
         }
-
-        void clear_stack() {
-            sp = 0;
+        // The frame must be at least program's frame_size() and not be resized while loaded
+        void load_frame(vm_frame* frame) {
+            slots = frame->slots.data();
         }
 
-        void load_program(vm_program* p) {
-            program = p;
-            prog_data = p->data.data();
-            prog = p->instructions.data();
-            prog_len = p->instructions.size();
-        }
-
-        i32 run() {
-            return run_at(0);
-        }
-
-        i32 run_at(i32 addr) {
-            if (!prog || !prog_len) {
-                assert(false);
-                return -1;
-            }
-
-            pc = addr - 1;
-
-            running = true;
-            while (running) {
-                fetch();
-
-                // NOTE: Kept for debugging
-                //int begin_pc = pc;
-
-                VM_ERR err = exec();
-                if (err != VM_OK) {
-                    LOG_ERR("anim VM error: " << err);
-                    LOG_ERR("instruction: " << instruction_to_str(prog[pc]));
-                    LOG_ERR("stack pointer: " << sp);
-                    LOG_ERR("program cursor: " << pc);
-                    assert(false);
-                    break;
-                }
-
-
-                // NOTE: Kept for debugging
-                /*
-                int end_pc = pc;
-
-                LOG("exec: ");
-                for (int i = begin_pc; i <= end_pc; ++i) {
-                    LOG(instruction_to_str(prog[i]));
-                }
-                LOG("stack: ");
-                for (int i = 0; i < sp; ++i) {
-                    LOG(mem_stack[i]);
-                }
-                getch();*/
-            }
-            return mem_stack[sp - 1];
-        }        
+        i32 run_at(i32 addr);
     };
 
-}
+}
\ No newline at end of file
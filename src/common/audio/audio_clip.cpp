@@ -58,7 +58,7 @@ AudioClip::AudioClip() {
 
 }
 
-bool AudioClip::load(byte_reader& reader) {
+bool AudioClip::decode(byte_reader& reader, ResourceLoadContext& ctx) {
     //assert(reader.hint() == e_ogg);
 
     auto view = reader.try_slurp();
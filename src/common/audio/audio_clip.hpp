@@ -5,13 +5,13 @@
 #include "audio_mixer.hpp"
 #include "serialization/virtual_ibuf.hpp"
 
-class AudioClip : public ILoadable {
+class AudioClip : public IAsyncLoadable {
     std::unique_ptr<AudioBuffer> buf;
 public:
     AudioClip();
     AudioBuffer* getBuffer() { return buf.get(); }
 
     DEFINE_EXTENSIONS(e_ogg);
-    bool load(byte_reader&) override;
+    bool decode(byte_reader&, ResourceLoadContext&) override;
 };
 
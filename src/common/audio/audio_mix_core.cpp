@@ -0,0 +1,304 @@
+#include "audio_mix_core.hpp"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+// SSE2 is always there on x64
+#if defined(_M_X64) || defined(__x86_64__)
+#define AUDIO_MIX_SSE 1
+#include <emmintrin.h>
+#else
+#define AUDIO_MIX_SSE 0
+#endif
+
+
+constexpr int AUDIO_MIX_BLOCK_FRAMES = 256;
+constexpr float AUDIO_MIX_SHORT_TO_FLOAT = 1.0f / 32767.0f;
+// Frames before the read position the filter looks at, the rest of the taps are at or after it
+constexpr int AUDIO_MIX_TAPS_BEFORE = AUDIO_MIX_TAP_COUNT / 2 - 1;
+
+static void audioBuildKernel(AudioResampleKernel& k) {
+    const double PI = 3.14159265358979323846;
+    const double half_width = AUDIO_MIX_TAP_COUNT / 2;
+    // Relative to the source nyquist. Downsampling has to cut below the destination nyquist,
+    // and with this few taps the transition band is wide, so stay a bit under it either way
+    const double cutoff = 0.9 * std::min(1.0, k.dst_rate / (double)k.src_rate);
+    for (int p = 0; p <= AUDIO_MIX_PHASE_COUNT; ++p) {
+        const double frac = p / (double)AUDIO_MIX_PHASE_COUNT;
+        float* c = &k.coefs[p * AUDIO_MIX_TAP_COUNT];
+        double sum = .0;
+        for (int j = 0; j < AUDIO_MIX_TAP_COUNT; ++j) {
+            const double x = (j - AUDIO_MIX_TAPS_BEFORE) - frac;
+            const double sinc = x == .0 ? 1.0 : sin(PI * cutoff * x) / (PI * cutoff * x);
+            const double window = fabs(x) >= half_width ? .0
+                : .42 + .5 * cos(PI * x / half_width) + .08 * cos(2.0 * PI * x / half_width);
+            c[j] = (float)(sinc * window);
+            sum += c[j];
+        }
+        // Unity gain at dc for every phase
+        for (int j = 0; j < AUDIO_MIX_TAP_COUNT; ++j) {
+            c[j] = (float)(c[j] / sum);
+        }
+    }
+}
+
+static void audioConvertMono(const short* src, int count, float* out) {
+    int i = 0;
+#if AUDIO_MIX_SSE
+    const __m128 scale = _mm_set1_ps(AUDIO_MIX_SHORT_TO_FLOAT);
+    for (; i + 8 <= count; i += 8) {
+        const __m128i x = _mm_loadu_si128((const __m128i*)(src + i));
+        // Sign extend by putting each short in the high half, then shifting it back down
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = src[i] * AUDIO_MIX_SHORT_TO_FLOAT;
+    }
+}
+
+// Interleaved stereo to planar, or to mono when right is null
+static void audioConvertStereo(const short* src, int count, float* left, float* right) {
+    int i = 0;
+#if AUDIO_MIX_SSE
+    const __m128 scale = _mm_set1_ps(AUDIO_MIX_SHORT_TO_FLOAT);
+    for (; i + 4 <= count; i += 4) {
+        const __m128i x = _mm_loadu_si128((const __m128i*)(src + i * 2));
+        const __m128 a = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16)), scale);
+        const __m128 b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16)), scale);
+        const __m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        if (right) {
+            _mm_storeu_ps(left + i, l);
+            _mm_storeu_ps(right + i, r);
+        } else {
+            _mm_storeu_ps(left + i, _mm_add_ps(l, r));
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        const float l = src[i * 2] * AUDIO_MIX_SHORT_TO_FLOAT;
+        const float r = src[i * 2 + 1] * AUDIO_MIX_SHORT_TO_FLOAT;
+        if (right) {
+            left[i] = l;
+            right[i] = r;
+        } else {
+            left[i] = l + r;
+        }
+    }
+}
+
+
+AudioMixCore::AudioMixCore(int sample_rate)
+: sample_rate(sample_rate) {}
+
+const AudioResampleKernel* AudioMixCore::getKernel(int src_rate) {
+    for (auto& k : kernels) {
+        if (k->src_rate == src_rate && k->dst_rate == sample_rate) {
+            return k.get();
+        }
+    }
+    auto k = std::make_unique<AudioResampleKernel>();
+    k->src_rate = src_rate;
+    k->dst_rate = sample_rate;
+    audioBuildKernel(*k);
+    kernels.push_back(std::move(k));
+    return kernels.back().get();
+}
+
+// Source frames [first, first + count) to planar floats
+// Wraps around for looping voices, reads silence outside the clip otherwise,
+// so the loop boundary costs a split into spans instead of a modulo per sample
+void AudioMixCore::gather(const AudioMixSource& src, int64_t first, int count, bool looping, bool downmix) {
+    const bool planar = src.channel_count == 2 && !downmix;
+    // Padding so the resampler can read a full tap group past the last frame
+    if (src_left.size() < count + AUDIO_MIX_TAP_COUNT) {
+        src_left.resize(count + AUDIO_MIX_TAP_COUNT);
+        src_right.resize(count + AUDIO_MIX_TAP_COUNT);
+    }
+    const int64_t len = (int64_t)src.frame_count;
+    int done = 0;
+    while (done < count) {
+        int64_t i = first + done;
+        if (looping) {
+            i %= len;
+            if (i < 0) {
+                i += len;
+            }
+        }
+        int n = 0;
+        if (i < 0 || i >= len) {
+            n = i < 0 ? (int)std::min<int64_t>(count - done, -i) : count - done;
+            memset(&src_left[done], 0, n * sizeof(float));
+            if (planar) {
+                memset(&src_right[done], 0, n * sizeof(float));
+            }
+        } else {
+            n = (int)std::min<int64_t>(count - done, len - i);
+            if (src.channel_count == 1) {
+                audioConvertMono(src.samples + i, n, &src_left[done]);
+            } else {
+                audioConvertStereo(src.samples + i * 2, n, &src_left[done], planar ? &src_right[done] : nullptr);
+            }
+        }
+        done += n;
+    }
+}
+
+// Output frame i reads around source position frac + i * step, counted from
+// src_left[AUDIO_MIX_TAPS_BEFORE]. Both are 32.32 fixed point
+void AudioMixCore::resample(const AudioResampleKernel* kernel, uint64_t frac, uint64_t step, int frame_count, int channel_count) {
+    if (out_left.size() < frame_count) {
+        out_left.resize(frame_count);
+        out_right.resize(frame_count);
+    }
+    // The top bits of the fraction pick the phase, the rest interpolate to the next one
+    const int PHASE_SHIFT = 32 - AUDIO_MIX_PHASE_BITS;
+    const uint32_t PHASE_MASK = (1u << PHASE_SHIFT) - 1;
+    const float T_SCALE = 1.0f / (1 << PHASE_SHIFT);
+    uint64_t pos = frac;
+    int i = 0;
+#if AUDIO_MIX_SSE
+    static_assert(AUDIO_MIX_TAP_COUNT == 8, "the sse path does two groups of four taps");
+    // Four output frames at a time, so the horizontal sums become one transpose
+    const uint32_t step32 = (uint32_t)step;
+    const __m128i step4 = _mm_setr_epi32(0, (int)step32, (int)(step32 * 2), (int)(step32 * 3));
+    for (; i + 4 <= frame_count; i += 4) {
+        __m128 ca[4];
+        __m128 cb[4];
+        int base[4];
+        const __m128i frac4 = _mm_add_epi32(_mm_set1_epi32((int)(uint32_t)pos), step4);
+        alignas(16) int phase[4];
+        alignas(16) float t[4];
+        _mm_store_si128((__m128i*)phase, _mm_srli_epi32(frac4, PHASE_SHIFT));
+        _mm_store_ps(t, _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(frac4, _mm_set1_epi32(PHASE_MASK))), _mm_set1_ps(T_SCALE)));
+        for (int k = 0; k < 4; ++k, pos += step) {
+            base[k] = (int)(pos >> 32);
+            const __m128 tk = _mm_set1_ps(t[k]);
+            const float* c0 = &kernel->coefs[phase[k] * AUDIO_MIX_TAP_COUNT];
+            const __m128 a = _mm_loadu_ps(c0);
+            const __m128 b = _mm_loadu_ps(c0 + 4);
+            ca[k] = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(c0 + 8), a), tk));
+            cb[k] = _mm_add_ps(b, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(c0 + 12), b), tk));
+        }
+        auto dot4 = [&ca, &cb, &base](const float* x) -> __m128 {
+            __m128 s[4];
+            for (int k = 0; k < 4; ++k) {
+                const float* xk = x + base[k];
+                s[k] = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(xk), ca[k]), _mm_mul_ps(_mm_loadu_ps(xk + 4), cb[k]));
+            }
+            _MM_TRANSPOSE4_PS(s[0], s[1], s[2], s[3]);
+            return _mm_add_ps(_mm_add_ps(s[0], s[1]), _mm_add_ps(s[2], s[3]));
+        };
+        _mm_storeu_ps(&out_left[i], dot4(src_left.data()));
+        if (channel_count == 2) {
+            _mm_storeu_ps(&out_right[i], dot4(src_right.data()));
+        }
+    }
+#endif
+    for (; i < frame_count; ++i, pos += step) {
+        const int base = (int)(pos >> 32);
+        const float t = ((uint32_t)pos & PHASE_MASK) * T_SCALE;
+        const float* c0 = &kernel->coefs[((uint32_t)pos >> PHASE_SHIFT) * AUDIO_MIX_TAP_COUNT];
+        const float* c1 = c0 + AUDIO_MIX_TAP_COUNT;
+        float l = .0f;
+        float r = .0f;
+        for (int j = 0; j < AUDIO_MIX_TAP_COUNT; ++j) {
+            const float c = c0[j] + (c1[j] - c0[j]) * t;
+            l += src_left[base + j] * c;
+            r += channel_count == 2 ? src_right[base + j] * c : .0f;
+        }
+        out_left[i] = l;
+        out_right[i] = r;
+    }
+}
+
+bool AudioMixCore::mixVoice(
+    float* dst, int frame_count,
+    const AudioMixSource& src, AudioMixVoice& voice,
+    float gain_left, float gain_right,
+    bool looping, bool downmix
+) {
+    assert(src.channel_count == 1 || src.channel_count == 2);
+    if (!src.samples || src.frame_count == 0) {
+        return false;
+    }
+    const uint64_t end = (uint64_t)src.frame_count << 32;
+    const uint64_t step = ((uint64_t)src.sample_rate << 32) / sample_rate;
+    const int channel_count = (src.channel_count == 2 && !downmix) ? 2 : 1;
+
+    const float g0[2] = {
+        voice.has_gain ? voice.gain[0] : gain_left,
+        voice.has_gain ? voice.gain[1] : gain_right
+    };
+    const float dg[2] = {
+        (gain_left - g0[0]) / frame_count,
+        (gain_right - g0[1]) / frame_count
+    };
+    voice.gain[0] = gain_left;
+    voice.gain[1] = gain_right;
+    voice.has_gain = true;
+
+    for (int done = 0; done < frame_count;) {
+        if (!looping && voice.position >= end) {
+            return false;
+        }
+        const int n = std::min(AUDIO_MIX_BLOCK_FRAMES, frame_count - done);
+        const float* left = nullptr;
+        const float* right = nullptr;
+        // Same rate on a whole frame needs no filter
+        if (step == (1ull << 32) && (voice.position & 0xFFFFFFFF) == 0) {
+            gather(src, (int64_t)(voice.position >> 32), n, looping, downmix);
+            left = src_left.data();
+            right = src_right.data();
+        } else {
+            const uint64_t frac = voice.position & 0xFFFFFFFF;
+            const int src_count = (int)((frac + (n - 1) * step) >> 32) + AUDIO_MIX_TAP_COUNT;
+            gather(src, (int64_t)(voice.position >> 32) - AUDIO_MIX_TAPS_BEFORE, src_count, looping, downmix);
+            resample(getKernel(src.sample_rate), frac, step, n, channel_count);
+            left = out_left.data();
+            right = out_right.data();
+        }
+        if (channel_count == 1) {
+            right = left;
+        }
+
+        // Gain ramps linearly over the whole call, reaching the target on its last frame
+        float* d = dst + done * 2;
+        int i = 0;
+#if AUDIO_MIX_SSE
+        const __m128 g0v = _mm_setr_ps(g0[0], g0[1], g0[0], g0[1]);
+        const __m128 dgv = _mm_setr_ps(dg[0], dg[1], dg[0], dg[1]);
+        const __m128 four = _mm_set1_ps(4.f);
+        __m128 idx_lo = _mm_setr_ps((float)(done + 1), (float)(done + 1), (float)(done + 2), (float)(done + 2));
+        __m128 idx_hi = _mm_add_ps(idx_lo, _mm_set1_ps(2.f));
+        for (; i + 4 <= n; i += 4) {
+            const __m128 l = _mm_loadu_ps(left + i);
+            const __m128 r = _mm_loadu_ps(right + i);
+            const __m128 gain_lo = _mm_add_ps(g0v, _mm_mul_ps(dgv, idx_lo));
+            const __m128 gain_hi = _mm_add_ps(g0v, _mm_mul_ps(dgv, idx_hi));
+            _mm_storeu_ps(d + i * 2, _mm_add_ps(_mm_loadu_ps(d + i * 2), _mm_mul_ps(_mm_unpacklo_ps(l, r), gain_lo)));
+            _mm_storeu_ps(d + i * 2 + 4, _mm_add_ps(_mm_loadu_ps(d + i * 2 + 4), _mm_mul_ps(_mm_unpackhi_ps(l, r), gain_hi)));
+            idx_lo = _mm_add_ps(idx_lo, four);
+            idx_hi = _mm_add_ps(idx_hi, four);
+        }
+#endif
+        for (; i < n; ++i) {
+            const float k = (float)(done + i + 1);
+            d[i * 2] += left[i] * (g0[0] + dg[0] * k);
+            d[i * 2 + 1] += right[i] * (g0[1] + dg[1] * k);
+        }
+
+        voice.position += n * step;
+        if (looping) {
+            voice.position %= end;
+        }
+        done += n;
+    }
+    return looping || voice.position < end;
+}
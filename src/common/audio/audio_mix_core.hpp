@@ -0,0 +1,74 @@
+#ifndef AUDIO_MIX_CORE_HPP
+#define AUDIO_MIX_CORE_HPP
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+
+// Platform independent mixing, no XAudio2 in here
+// Mixes int16 clips of any sample rate and channel count (1 or 2) into an interleaved stereo float buffer
+// AudioMixer feeds XAudio2 from it, but it can render offline just as well
+
+#define AUDIO_MIX_TAP_COUNT 8
+#define AUDIO_MIX_PHASE_BITS 7
+#define AUDIO_MIX_PHASE_COUNT (1 << AUDIO_MIX_PHASE_BITS)
+
+struct AudioMixSource {
+    const short* samples = nullptr;
+    size_t frame_count = 0; // samples / channel_count
+    int channel_count = 2;
+    int sample_rate = 44100;
+};
+
+// Per voice playback state, owned by whoever owns the voice
+struct AudioMixVoice {
+    // Read position in source frames, 32.32 fixed point
+    uint64_t position = 0;
+    // Gain reached at the end of the previous block, changes ramp from it
+    float gain[2] = { .0f, .0f };
+    bool has_gain = false;
+
+    void reset() {
+        *this = AudioMixVoice();
+    }
+};
+
+// Windowed sinc coefficients for one source to destination rate ratio
+// Phases are interpolated, so the table has one extra phase at the end
+struct AudioResampleKernel {
+    int src_rate = 0;
+    int dst_rate = 0;
+    float coefs[(AUDIO_MIX_PHASE_COUNT + 1) * AUDIO_MIX_TAP_COUNT];
+};
+
+class AudioMixCore {
+    int sample_rate = 44100;
+    std::vector<std::unique_ptr<AudioResampleKernel>> kernels;
+    // Planar source frames for the current block, then resampled frames
+    std::vector<float> src_left;
+    std::vector<float> src_right;
+    std::vector<float> out_left;
+    std::vector<float> out_right;
+
+    const AudioResampleKernel* getKernel(int src_rate);
+    void gather(const AudioMixSource& src, int64_t first, int count, bool looping, bool downmix);
+    void resample(const AudioResampleKernel* kernel, uint64_t frac, uint64_t step, int frame_count, int channel_count);
+public:
+    AudioMixCore(int sample_rate = 44100);
+
+    int getSampleRate() const { return sample_rate; }
+
+    // Adds frame_count stereo frames of a voice to dst
+    // Gain is per output channel and ramps over the block from where the voice left off
+    // downmix sums a stereo source to mono before applying the gain, like the 3d path does
+    // Returns false once a non looping voice has played to the end
+    bool mixVoice(
+        float* dst, int frame_count,
+        const AudioMixSource& src, AudioMixVoice& voice,
+        float gain_left, float gain_right,
+        bool looping, bool downmix = false
+    );
+};
+
+#endif
@@ -5,6 +5,7 @@ bool AudioMixer::init(int sampleRate, int bps) {
     this->sampleRate = sampleRate;
     this->bitPerSample = 32;
     this->nChannels = 2;
+    core = AudioMixCore(sampleRate);
     //memset(buffer, 0, sizeof(buffer));
     int blockAlign = (bitPerSample * nChannels) / 8;
 
@@ -61,6 +62,28 @@ void AudioMixer::cleanup() {
     pXAudio2->Release();
 }
 
+static AudioMixSource mixSource(AudioBuffer* buf) {
+    AudioMixSource src;
+    src.samples = buf->getPtr();
+    src.channel_count = buf->channelCount();
+    src.frame_count = buf->sampleCount() / buf->channelCount();
+    src.sample_rate = buf->sampleRate();
+    return src;
+}
+
+static void mixFalloff(const gfxm::vec3& pos, float atten_radius, const gfxm::mat4& listener_transform, float* falloff) {
+    gfxm::vec3 ears[2] = {
+        gfxm::vec3(-0.1075f, .0f, .0f),
+        gfxm::vec3(0.1075f, .0f, .0f)
+    };
+    ears[0] = listener_transform * gfxm::vec4(ears[0], 1.0f);
+    ears[1] = listener_transform * gfxm::vec4(ears[1], 1.0f);
+    float att = 1.0f / atten_radius;
+    for (int i = 0; i < 2; ++i) {
+        float d = gfxm::length(ears[i] - pos) * att;
+        falloff[i] = std::min(1.0f / (d * d), 1.0f);
+    }
+}
 
 void __stdcall AudioMixer::OnBufferEnd(void * pBufferContext) {
     AudioVoiceData* pVoiceData = (AudioVoiceData*)pBufferContext;
@@ -82,7 +105,7 @@ void __stdcall AudioMixer::OnBufferEnd(void * pBufferContext) {
 
     memset(pVoiceData->buffer_f, 0, sizeof(pVoiceData->buffer_f));
     memset(pVoiceData->back, 0, sizeof(pVoiceData->buffer));
-    size_t buf_len = sizeof(pVoiceData->buffer_f) / sizeof(pVoiceData->buffer_f[0]);
+    const int frame_count = AUDIO_BUFFER_SZ / nChannels;
     for(auto it = pVoiceData->emitters.begin(); it != pVoiceData->emitters.end();) {
         Handle<AudioChannel> ei = (*it);
         AudioChannel* em = HANDLE_MGR<AudioChannel>::deref(ei);
@@ -94,39 +117,19 @@ void __stdcall AudioMixer::OnBufferEnd(void * pBufferContext) {
             continue;
         }
 
-        size_t src_cur = em->cursor;
-        short* data = em->buf->getPtr();
-        size_t src_len = em->buf->sampleCount();
-        int sample_rate = em->buf->sampleRate();
-        int channel_count = em->buf->channelCount();
-        bool looping = em->looping;
-            
-        size_t advance = 0;
-        if (channel_count == 2) {
-            advance = mix(
-                pVoiceData->buffer_f, buf_len, data, src_len,
-                src_cur, em->volume, em->panning,
-                looping
-            );
-        } else if (channel_count == 1) {
-            advance = mix_mono_(
-                pVoiceData->buffer_f, buf_len,
-                data, src_len, src_cur, sample_rate,
-                em->volume, looping
-            );
-        }
-            
-        em->cursor += advance;
-        if(em->cursor >= em->buf->sampleCount()) {
-            if(!em->looping) {
-                if (ei->is_orphan) {
-                    HANDLE_MGR<AudioChannel>::release(ei);
-                }
-                it = pVoiceData->emitters.erase(it);
-                continue;
+        // Both sides at full gain when centered, the far side fades out as the pan moves away from it
+        const float pan_left = std::min(fabsf(-1.0f + em->panning), 1.0f);
+        const float pan_right = std::min(fabsf(1.0f + em->panning), 1.0f);
+        if (!core.mixVoice(
+            pVoiceData->buffer_f, frame_count, mixSource(em->buf), em->voice,
+            em->volume * pan_left, em->volume * pan_right, em->looping
+        )) {
+            if (ei->is_orphan) {
+                HANDLE_MGR<AudioChannel>::release(ei);
             }
-        } 
-        em->cursor = em->cursor % src_len;
+            it = pVoiceData->emitters.erase(it);
+            continue;
+        }
         ++it;
     }
     for(auto it = pVoiceData->emitters3d.begin(); it != pVoiceData->emitters3d.end();) {
@@ -146,39 +149,19 @@ void __stdcall AudioMixer::OnBufferEnd(void * pBufferContext) {
             p_ = em->pos;
         }
             
-        size_t src_cur = em->cursor;
-        short* data = em->buf->getPtr();
-        size_t src_len = em->buf->sampleCount();
-        int src_sample_rate = em->buf->sampleRate();
-        int src_channel_count = em->buf->channelCount();
-        bool looping = em->looping;
-
-        size_t advance = 0;
-        if (src_channel_count == 2) {
-            advance = mix3d_stereo(
-                pVoiceData->buffer_f, buf_len,
-                data, src_len, src_cur, src_sample_rate,
-                em->volume, em->attenuation_radius, looping, p_, lis_trans_cache
-            );
-        } else if(src_channel_count == 1) {
-            advance = mix3d_mono(
-                pVoiceData->buffer_f, buf_len,
-                data, src_len, src_cur, src_sample_rate,
-                em->volume, em->attenuation_radius, looping, p_, lis_trans_cache
-            );
-        }
-
-        em->cursor += advance;
-        if(em->cursor >= em->buf->sampleCount()) {
-            if(!em->looping) {
-                if (ei->is_orphan) {
-                    HANDLE_MGR<AudioChannel>::release(ei);
-                }
-                it = pVoiceData->emitters3d.erase(it);
-                continue;
+        // Falloff is worked out once per buffer, the mix core ramps between buffers
+        float falloff[2];
+        mixFalloff(p_, em->attenuation_radius, lis_trans_cache, falloff);
+        if (!core.mixVoice(
+            pVoiceData->buffer_f, frame_count, mixSource(em->buf), em->voice,
+            em->volume * falloff[0], em->volume * falloff[1], em->looping, true
+        )) {
+            if (ei->is_orphan) {
+                HANDLE_MGR<AudioChannel>::release(ei);
             }
+            it = pVoiceData->emitters3d.erase(it);
+            continue;
         }
-        em->cursor = em->cursor % em->buf->sampleCount();
         ++it;
     }
 
@@ -199,152 +182,3 @@ void __stdcall AudioMixer::OnBufferEnd(void * pBufferContext) {
 
     audio_stats.buffer_update_time = timer_.stop();
 }
-
-
-
-size_t AudioMixer::mix(
-    float* dest, 
-    size_t dest_len, 
-    short* src, 
-    size_t src_len,
-    size_t cur,
-    float vol,
-    float panning,
-    bool looping
-) {
-    size_t sample_len = src_len < dest_len ? src_len : dest_len;
-    size_t overflow = (cur + sample_len) > src_len ? (cur + sample_len) - src_len : 0;
-
-    size_t tgt0sz = sample_len - overflow;
-    size_t tgt1sz = overflow;
-    short* tgt0 = src + cur;
-    short* tgt1 = src;
-
-    float mul = 1.0f / (float)SHORT_MAX;
-
-    for(size_t i = 0; i < tgt0sz; ++i) {
-        int lr = (i % 2) * 2 - 1;
-        float pan = std::min(fabs(lr + panning), 1.0f);
-            
-        dest[i] += tgt0[i] * mul * vol * pan;
-    }
-
-    if (!looping) {
-        return sample_len;
-    }
-
-    for(size_t i = 0; i < tgt1sz; ++i) {
-        int lr = (i % 2) * 2 - 1;
-        float pan = std::min(fabs(lr + panning), 1.0f);
-        (dest + tgt0sz)[i] += tgt1[i] * mul * vol * pan;
-    }
-
-    return sample_len;
-}
-size_t AudioMixer::mix_mono_(
-    float* dst, size_t dst_len,
-    short* src, size_t src_len,
-    size_t src_cur, int src_sampleRate,
-    float gain, bool looping
-) {
-    constexpr int dst_channelCount = 2;
-    constexpr float flt_convert = 1.0f / (float)SHORT_MAX;
-    float sampleRatio = src_sampleRate / (float)this->sampleRate;
-    int invSampleRatio = 1;
-
-    for (int di = 0; di < dst_len; di += dst_channelCount) {
-        int step = di / dst_channelCount;
-        int si = (int)((src_cur + step / invSampleRatio)) % src_len;
-        float s = src[si] * flt_convert * gain;
-        dst[di    ] += s; // left
-        dst[di + 1] += s; // right
-    }
-    // TODO: Handle non-looping
-
-    return (int)(dst_len / dst_channelCount / invSampleRatio);
-}
-size_t AudioMixer::mix3d_stereo(
-    float* dst, size_t dst_len,
-    short* src, size_t src_len,
-    size_t src_cur, int src_sampleRate,
-    float gain, float atten_radius, bool looping,
-    const gfxm::vec3& pos,
-    const gfxm::mat4& listener_transform
-) {
-    constexpr int dst_channelCount = 2;
-    constexpr float flt_convert = 1.0f / (float)SHORT_MAX;
-    float sampleRatio = src_sampleRate / (float)this->sampleRate;
-    int invSampleRatio = 1;
-
-    gfxm::vec3 ears[2] = {
-        gfxm::vec3(-0.1075f, .0f, .0f),
-        gfxm::vec3(0.1075f, .0f, .0f)
-    };
-    ears[0] = listener_transform * gfxm::vec4(ears[0], 1.0f);
-    ears[1] = listener_transform * gfxm::vec4(ears[1], 1.0f);
-    float att = 1.0f / atten_radius;
-    float falloff[2] = {
-        std::min(1.0f / pow((gfxm::length(ears[0] - pos) * att), 2.0f), 1.0f),
-        std::min(1.0f / pow((gfxm::length(ears[1] - pos) * att), 2.0f), 1.0f)
-    };
-
-    size_t len = dst_len;
-    if (!looping) {
-        len = std::min(dst_len, src_len);
-    }
-
-    for (int di = 0; di < len; di += dst_channelCount) {
-        int step = di;
-        int si = (int)((src_cur + step / invSampleRatio));// % src_len;
-        if(!looping && si >= src_len) {
-            continue;
-        }
-        si %= src_len;
-        float s0 = src[si] * flt_convert * gain;
-        float s1 = src[si + 1] * flt_convert * gain;
-        dst[di] += (s0 + s1) * falloff[0]; // left
-        dst[di + 1] += (s0 + s1) * falloff[1]; // right
-    }
-    // TODO: Handle non-looping
-
-    return (int)(dst_len / invSampleRatio);
-}
-size_t AudioMixer::mix3d_mono(
-    float* dst, size_t dst_len,
-    short* src, size_t src_len,
-    size_t src_cur, int src_sampleRate,
-    float gain, float atten_radius, bool looping,
-    const gfxm::vec3& pos,
-    const gfxm::mat4& listener_transform
-) {
-    constexpr int dst_channelCount = 2;
-    constexpr float flt_convert = 1.0f / (float)SHORT_MAX;
-    float sampleRatio = src_sampleRate / (float)this->sampleRate;
-    int invSampleRatio = 1;
-
-    gfxm::vec3 ears[2] = {
-        gfxm::vec3(-0.1075f, .0f, .0f),
-        gfxm::vec3(0.1075f, .0f, .0f)
-    };
-    ears[0] = listener_transform * gfxm::vec4(ears[0], 1.0f);
-    ears[1] = listener_transform * gfxm::vec4(ears[1], 1.0f);
-    constexpr float EMITTER_RADIUS = 0.5f;
-    float att = 1.0f / atten_radius;
-    float falloff[2] = {
-        std::min(1.0f / pow((gfxm::length(ears[0] - pos) * att), 2.0f), 1.0f),
-        std::min(1.0f / pow((gfxm::length(ears[1] - pos) * att), 2.0f), 1.0f)
-    };        
-
-    int samples_till_end = src_len - src_cur;
-    int len_to_sample = looping ? dst_len : std::min((int)dst_len, samples_till_end);
-    for (int di = 0; di < len_to_sample; di += dst_channelCount) {
-        int step = di / dst_channelCount;
-        int si = (int)((src_cur + step / invSampleRatio)) % src_len;
-        float s = src[si] * flt_convert * gain;
-        dst[di] += s * falloff[0]; // left
-        dst[di + 1] += s * falloff[1]; // right
-    }
-
-    return (int)(dst_len / dst_channelCount / invSampleRatio);
-}
-
@@ -25,6 +25,7 @@ extern "C" {
 #define AUDIO_BUFFER_SZ 256
 
 #include "audio_buffer.hpp"
+#include "audio_mix_core.hpp"
 
 #include "util/timer.hpp"
 
@@ -35,7 +36,7 @@ struct AUDIO_STATS {
 static const int SHORT_MAX = std::numeric_limits<short>().max();
 
 struct AudioChannel {
-    size_t cursor = 0;
+    AudioMixVoice voice;
     AudioBuffer* buf = 0;
     float volume = 1.0f;
     float panning = 0.0f;
@@ -74,7 +75,9 @@ class AudioMixer : public IXAudio2VoiceCallback {
     int nChannels;
 
     // key - sample rate
+    // Clips are resampled by the mix core, so only the mixer's own rate gets a voice
     std::unordered_map<int, std::unique_ptr<AudioVoiceData>> voices;
+    AudioMixCore core;
     /*
     float* front;
     float* back;
@@ -147,6 +150,9 @@ class AudioMixer : public IXAudio2VoiceCallback {
         }
         return voiceData;
     }
+    AudioVoiceData* getVoiceData() {
+        return getVoiceDataBySampleRate(sampleRate);
+    }
 public:
     AudioMixer() {}
     void setListenerTransform(const gfxm::mat4& t) {
@@ -163,28 +169,28 @@ public:
     }
 
     void play(Handle<AudioChannel> ch) {
-        auto vd = getVoiceDataBySampleRate(ch->buf->sampleRate());
+        auto vd = getVoiceData();
         std::lock_guard<std::mutex> lock(vd->sync);
         vd->emitters.insert(ch);
     }
     void play3d(Handle<AudioChannel> ch) {
-        auto vd = getVoiceDataBySampleRate(ch->buf->sampleRate());
+        auto vd = getVoiceData();
         std::lock_guard<std::mutex> lock(vd->sync);
         vd->emitters3d.insert(ch);
     }
     void stop(Handle<AudioChannel> ch) {
-        auto vd = getVoiceDataBySampleRate(ch->buf->sampleRate());
+        auto vd = getVoiceData();
         std::lock_guard<std::mutex> lock(vd->sync);
         vd->emitters.erase(ch);
         vd->emitters3d.erase(ch);
     }
     void resetCursor(Handle<AudioChannel> ch) {
-        HANDLE_MGR<AudioChannel>::deref(ch)->cursor = 0;
+        HANDLE_MGR<AudioChannel>::deref(ch)->voice.reset();
     }
 
     void setBuffer(Handle<AudioChannel> ch, AudioBuffer* buf) {
         HANDLE_MGR<AudioChannel>::deref(ch)->buf = buf;
-        HANDLE_MGR<AudioChannel>::deref(ch)->cursor = 0;
+        HANDLE_MGR<AudioChannel>::deref(ch)->voice.reset();
     }
     void setAttenuationRadius(Handle<AudioChannel> ch, float radius) {
         HANDLE_MGR<AudioChannel>::deref(ch)->attenuation_radius = radius;
@@ -201,7 +207,7 @@ public:
     }
 
     bool isPlaying(Handle<AudioChannel> ch) {
-        auto vd = getVoiceDataBySampleRate(ch->buf->sampleRate());
+        auto vd = getVoiceData();
         std::lock_guard<std::mutex> lock(vd->sync);
         return vd->emitters.count(ch) || vd->emitters3d.count(ch);
     }
@@ -210,7 +216,7 @@ public:
     }
 
     void playOnce(AudioBuffer* buf, float vol = 1.0f, float pan = .0f) {
-        auto vd = getVoiceDataBySampleRate(buf->sampleRate());
+        auto vd = getVoiceData();
         std::lock_guard<std::mutex> lock(vd->sync);
 
         Handle<AudioChannel> em = HANDLE_MGR<AudioChannel>::acquire();
@@ -222,7 +228,7 @@ public:
         vd->emitters.insert(em);
     }
     void playOnce3d(AudioBuffer* buf, const gfxm::vec3& pos, float vol = 1.0f, float attenuation_radius = 10.0f) {
-        auto vd = getVoiceDataBySampleRate(buf->sampleRate());
+        auto vd = getVoiceData();
         std::lock_guard<std::mutex> lock(vd->sync);
 
         Handle<AudioChannel> em = HANDLE_MGR<AudioChannel>::acquire();
@@ -250,39 +256,6 @@ public:
     void __stdcall OnVoiceError(void * pBufferContext, HRESULT Error) {
         LOG_ERR("XAudio2 voice error: " << Error);
      }
-private:
-    size_t mix(
-        float* dest,
-        size_t dest_len,
-        short* src,
-        size_t src_len,
-        size_t cur,
-        float vol,
-        float panning,
-        bool looping
-    );
-    size_t mix_mono_(
-        float* dst, size_t dst_len,
-        short* src, size_t src_len,
-        size_t src_cur, int src_sampleRate,
-        float gain, bool looping
-    );
-    size_t mix3d_stereo(
-        float* dst, size_t dst_len,
-        short* src, size_t src_len,
-        size_t src_cur, int src_sampleRate,
-        float gain, float atten_radius, bool looping,
-        const gfxm::vec3& pos,
-        const gfxm::mat4& listener_transform
-    );
-    size_t mix3d_mono(
-        float* dst, size_t dst_len,
-        short* src, size_t src_len,
-        size_t src_cur, int src_sampleRate,
-        float gain, float atten_radius, bool looping,
-        const gfxm::vec3& pos,
-        const gfxm::mat4& listener_transform
-    );
 };
 
 #endif
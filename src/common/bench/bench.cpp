@@ -0,0 +1,53 @@
+#include "bench.hpp"
+
+#include <string.h>
+#include "con_registry/con_registry.hpp"
+
+
+void benchRegisterCommands() {
+    auto conreg = ConRegistry::get();
+    conreg->registerCmd("bench.phy_broadphase", "flat vs pointer aabb tree broadphase, 1k/5k/20k bodies", &benchPhyBroadphase);
+    conreg->registerCmd("bench.phy_narrowphase", "narrowphase scaling over 1 to 16 threads, checks results match", &benchPhyNarrowphase);
+    conreg->registerCmd("bench.phy_islands", "10k stacked boxes settling into sleeping islands", &benchPhyIslands);
+    conreg->registerCmd("bench.phy_solver", "scalar vs packed simd contact solver on a 4k contact pile", &benchPhySolver);
+    conreg->registerCmd("bench.phy_queries", "single vs batched ray and sphere sweep queries, checks results match", &benchPhyQueries);
+    conreg->registerCmd("bench.phy_trimesh", "triangle mesh tree build, load and queries on a terrain mesh", &benchPhyTrimesh);
+    conreg->registerCmd("bench.phy_convex", "convex hull support queries and gjk/epa on 64 and 256 vertex hulls, old scan vs hill climbing", &benchPhyConvex);
+    conreg->registerCmd("bench.phy_box_stack", "tall box stacks with sat box contacts vs gjk/epa, step time and drift", &benchPhyBoxStack);
+    conreg->registerCmd("bench.phy_heightfield", "capsules walking a 2048x2048 heightfield, simd cell culling and quadtree sweeps vs full scans", &benchPhyHeightfield);
+    conreg->registerCmd("bench.transforms", "recursive transform nodes vs flat hierarchy pass on animated skeletons", &benchTransforms);
+    conreg->registerCmd("bench.scene_visibility", "brute force vs bvh frustum culling, one and several views per pass", &benchSceneVisibility);
+    conreg->registerCmd("bench.skinning", "cpu skinning kernels on 200 characters, checked against a port of the compute shader", &benchSkinning);
+    conreg->registerCmd("bench.audio_mix", "offline mix of 256 voices at mixed sample rates, checks resampled pitch", &benchAudioMix);
+    conreg->registerCmd("bench.anim_sampling", "curve::at vs packed clip with key cursors over bone counts and clip lengths", &benchAnimSampling);
+    conreg->registerCmd("bench.anim_compression", "compressed clip size, error and sampling cost against curves and the packed clip", &benchAnimCompression);
+    conreg->registerCmd("bench.anim_system", "AnimationSystem update over 1 to 16 threads, checks results against one thread", &benchAnimSystem);
+    conreg->registerCmd("bench.animvm", "animvm instructions per second over typical transition and weight expressions", &benchAnimvm);
+    conreg->registerCmd("bench.anim_transitions", "fsm transition evaluation for a crowd sharing one animvm program", &benchAnimTransitions);
+    conreg->registerCmd("bench.particles", "particle update kernels on one large emitter, checked against the old curve::at() loop", &benchParticles);
+    conreg->registerCmd("bench.particle_storm", "particle simulation bookkeeping under hundreds of short lived emitters a frame", &benchParticleStorm);
+    conreg->registerCmd("bench.resource_loading", "synchronous vs background resource loading with dependencies", &benchResourceLoading);
+    conreg->registerCmd("bench.file_io", "loading files of mixed size through file_reader and mmap_reader, cold and warm", &benchFileIo);
+    conreg->registerCmd("bench.pack_startup", "resolving and loading thousands of small resources from loose files and from a pack", &benchPackStartup);
+    conreg->registerCmd("bench.log_contention", "write latency of many threads logging at once, mutex + queue against the lock-free ring", &benchLogContention);
+    conreg->registerCmd("bench.font_atlas", "streaming 5000 new glyphs into a font atlas, full rebuild vs shelf packing with partial uploads", &benchFontAtlas);
+    conreg->registerCmd("bench.text_layout", "10000 labels laid out per frame, uncached vs TextLayoutCache, full vs incremental relayout on edits", &benchTextLayout);
+}
+
+bool benchRunFromCommandLine(int argc, char** argv) {
+    if (argc < 3 || strcmp(argv[1], "-bench") != 0) {
+        return false;
+    }
+
+    std::string line = std::string("bench.") + argv[2];
+    for (int i = 3; i < argc; ++i) {
+        line += " ";
+        line += argv[i];
+    }
+
+    benchRegisterCommands();
+    if (!ConRegistry::get()->dispatch(ConsoleCommand(line))) {
+        LOG_ERR("Unknown benchmark: '" << argv[2] << "'");
+    }
+    return true;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "con_registry/console_command.hpp"
+
+
+// Headless benchmarks
+// Registered as console commands under 'bench.'
+// Can also run without a window or gpu context from the command line:
+//   omega.exe -bench <name> [args...]
+
+void benchRegisterCommands();
+bool benchRunFromCommandLine(int argc, char** argv);
+
+// bench.phy_broadphase [step_count] [moving_percent]
+void benchPhyBroadphase(const ConsoleCommand& cmd);
+
+// bench.phy_narrowphase [body_count] [warmup_steps] [step_count]
+void benchPhyNarrowphase(const ConsoleCommand& cmd);
+
+// bench.phy_islands [body_count] [stack_height] [step_count] [thread_count]
+void benchPhyIslands(const ConsoleCommand& cmd);
+
+// bench.phy_solver [body_count] [warmup_steps] [step_count]
+void benchPhySolver(const ConsoleCommand& cmd);
+
+// bench.phy_queries [body_count] [query_count] [thread_count]
+void benchPhyQueries(const ConsoleCommand& cmd);
+
+// bench.phy_trimesh [grid_side] [query_count]
+void benchPhyTrimesh(const ConsoleCommand& cmd);
+
+// bench.phy_convex [query_count] [pair_count]
+void benchPhyConvex(const ConsoleCommand& cmd);
+
+// bench.phy_box_stack [column_count] [stack_height] [step_count]
+void benchPhyBoxStack(const ConsoleCommand& cmd);
+
+// bench.phy_heightfield [sample_count] [capsule_count] [step_count]
+void benchPhyHeightfield(const ConsoleCommand& cmd);
+
+// bench.transforms [skeleton_count] [bone_count] [frame_count] [thread_count]
+void benchTransforms(const ConsoleCommand& cmd);
+
+// bench.scene_visibility [proxy_count] [view_count] [frame_count]
+void benchSceneVisibility(const ConsoleCommand& cmd);
+
+// bench.skinning [character_count] [vertex_count] [bone_count] [thread_count]
+void benchSkinning(const ConsoleCommand& cmd);
+
+// bench.audio_mix [voice_count] [seconds]
+void benchAudioMix(const ConsoleCommand& cmd);
+
+// bench.anim_sampling [character_count] [frame_count]
+void benchAnimSampling(const ConsoleCommand& cmd);
+// bench.anim_compression [character_count] [frame_count]
+void benchAnimCompression(const ConsoleCommand& cmd);
+// bench.anim_system [instance_count] [bone_count] [frame_count]
+void benchAnimSystem(const ConsoleCommand& cmd);
+// bench.animvm [run_count]
+void benchAnimvm(const ConsoleCommand& cmd);
+// bench.anim_transitions [instance_count] [frame_count]
+void benchAnimTransitions(const ConsoleCommand& cmd);
+
+// bench.particles [particle_count] [frame_count] [thread_count]
+void benchParticles(const ConsoleCommand& cmd);
+// bench.particle_storm [spawn_count] [frame_count] [master_count]
+void benchParticleStorm(const ConsoleCommand& cmd);
+
+// bench.resource_loading [resource_count] [payload_kb] [decode_rounds]
+void benchResourceLoading(const ConsoleCommand& cmd);
+// bench.file_io [file_count] [run_count]
+void benchFileIo(const ConsoleCommand& cmd);
+// bench.pack_startup [file_count] [compress]
+void benchPackStartup(const ConsoleCommand& cmd);
+// bench.log_contention [thread_count] [lines_per_thread]
+void benchLogContention(const ConsoleCommand& cmd);
+// bench.font_atlas [codepoint_count] [new_per_frame]
+void benchFontAtlas(const ConsoleCommand& cmd);
+// bench.text_layout [label_count] [edits_per_frame]
+void benchTextLayout(const ConsoleCommand& cmd);
+// Drops a file from the OS cache so the next read goes to disk, in bench_file_io.cpp
+void benchEvictFileCache(const std::string& path);
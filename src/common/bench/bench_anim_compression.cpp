@@ -0,0 +1,136 @@
+#include "bench.hpp"
+
+#include <random>
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "animation/animation.hpp"
+
+
+// Clips shaped like imported character animation: keys baked at 30 a second on every bone,
+// most bones only rotate, a few also move, scale sits at one. Compresses each clip and reports
+// the size, the track split and the largest error found, then samples it the way
+// bench.anim_sampling does, through curve<>::at(), the packed clip and the compressed clip
+
+static void benchMakeImportedClip(Animation& anim, int bone_count, float seconds, std::mt19937& rng) {
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+    const int key_count = (int)(seconds * 30.f) + 1;
+    for (int b = 0; b < bone_count; ++b) {
+        AnimNode& node = anim.createNode("bone" + std::to_string(b));
+        const gfxm::vec3 axis = gfxm::normalize(gfxm::vec3(dist(rng), dist(rng), dist(rng)));
+        const gfxm::vec3 offset(dist(rng) * .1f, .1f + dist(rng) * .05f, dist(rng) * .1f);
+        const float phase = dist(rng) * 3.f;
+        const float speed = 1.f + dist(rng) * .5f;
+        // Fingers and twist bones that never turn, and the odd bone that also slides
+        const bool rotates = (b % 5) != 4;
+        const bool moves = (b % 10) == 0;
+        std::vector<keyframe<gfxm::vec3>> t_keys;
+        std::vector<keyframe<gfxm::quat>> r_keys;
+        std::vector<keyframe<gfxm::vec3>> s_keys;
+        for (int k = 0; k < key_count; ++k) {
+            const float time = k / 30.f;
+            gfxm::vec3 t = offset;
+            if (moves) {
+                t.y += .3f * sinf(time * speed + phase);
+            }
+            t_keys.push_back(keyframe<gfxm::vec3>(time, t));
+            r_keys.push_back(keyframe<gfxm::quat>(time, gfxm::angle_axis(rotates ? sinf(time * speed * 3.f + phase) * 1.2f : phase, axis)));
+            s_keys.push_back(keyframe<gfxm::vec3>(time, gfxm::vec3(1.f, 1.f, 1.f)));
+        }
+        node.t.set_keyframes(t_keys);
+        node.r.set_keyframes(r_keys);
+        node.s.set_keyframes(s_keys);
+    }
+    anim.length = seconds;
+}
+
+void benchAnimCompression(const ConsoleCommand& cmd) {
+    const int character_count = std::max(1, cmd.arg<int>(0, 200));
+    const int frame_count = std::max(1, cmd.arg<int>(1, 120));
+    LOG("bench.anim_compression: " << character_count << " characters, " << frame_count << " frames");
+
+    const int bone_counts[] = { 30, 60, 100 };
+    const float clip_lengths[] = { 1.f, 4.f, 16.f };
+    timer timer_;
+    for (int bone_count : bone_counts) {
+        for (float clip_length : clip_lengths) {
+            // Same seed for both, one stays as curves to compare against
+            std::mt19937 rng(bone_count * 100 + (int)clip_length);
+            Animation anim;
+            benchMakeImportedClip(anim, bone_count, clip_length, rng);
+            rng.seed(bone_count * 100 + (int)clip_length);
+            Animation anim_compressed;
+            benchMakeImportedClip(anim_compressed, bone_count, clip_length, rng);
+            animCompressStats stats;
+            if (!anim_compressed.compress(animCompressSettings(), &stats)) {
+                LOG_WARN("  " << bone_count << " bones, " << clip_length << " s clip failed to compress");
+                continue;
+            }
+            const animPackedClip& clip = anim.getPacked();
+            const animCompressedClip& compressed = anim_compressed.getCompressed();
+
+            std::vector<int32_t> nodes(bone_count);
+            std::vector<int32_t> mapping(bone_count);
+            for (int b = 0; b < bone_count; ++b) {
+                nodes[b] = b;
+                mapping[b] = b;
+            }
+            std::vector<AnimSample> ref(character_count * bone_count);
+            std::vector<AnimSample> out(character_count * bone_count);
+            std::vector<animSampleCursor> cursors(character_count);
+            auto timeAt = [&](int c, int f) {
+                return fmodf(c * .37f + f / 60.f, clip_length);
+            };
+
+            float ref_ms = .0f;
+            float packed_ms = .0f;
+            float slerp_ms = .0f;
+            float nlerp_ms = .0f;
+            float max_t_error = .0f;
+            float max_r_error = .0f;
+            for (int f = 0; f < frame_count; ++f) {
+                timer_.start();
+                for (int c = 0; c < character_count; ++c) {
+                    anim.sample_remapped(&ref[c * bone_count], bone_count, timeAt(c, f), mapping);
+                }
+                ref_ms += timer_.stop() * 1000.f;
+
+                timer_.start();
+                for (int c = 0; c < character_count; ++c) {
+                    animSamplePacked(clip, cursors[c], nodes.data(), nodes.data(), bone_count, timeAt(c, f), ANIM_ROTATION_SLERP, &out[c * bone_count]);
+                }
+                packed_ms += timer_.stop() * 1000.f;
+
+                timer_.start();
+                for (int c = 0; c < character_count; ++c) {
+                    compressed.sample(timeAt(c, f), nodes.data(), nodes.data(), bone_count, ANIM_ROTATION_NLERP, &out[c * bone_count]);
+                }
+                nlerp_ms += timer_.stop() * 1000.f;
+
+                timer_.start();
+                for (int c = 0; c < character_count; ++c) {
+                    compressed.sample(timeAt(c, f), nodes.data(), nodes.data(), bone_count, ANIM_ROTATION_SLERP, &out[c * bone_count]);
+                }
+                slerp_ms += timer_.stop() * 1000.f;
+                for (int i = 0; i < ref.size(); ++i) {
+                    const gfxm::vec3 d = ref[i].t - out[i].t;
+                    max_t_error = std::max(max_t_error, std::max(fabsf(d.x), std::max(fabsf(d.y), fabsf(d.z))));
+                    const gfxm::quat dr = gfxm::dot(ref[i].r, out[i].r) < .0f ? ref[i].r + out[i].r : ref[i].r - out[i].r;
+                    const float chord = sqrtf(dr.x * dr.x + dr.y * dr.y + dr.z * dr.z + dr.w * dr.w);
+                    max_r_error = std::max(max_r_error, 4.f * asinf(std::min(1.f, chord * .5f)));
+                }
+            }
+            LOG("  " << bone_count << " bones, " << clip_length << " s clip: "
+                << stats.raw_bytes / 1024.f << " KB -> " << stats.compressed_bytes / 1024.f << " KB ("
+                << (float)stats.raw_bytes / std::max<size_t>(stats.compressed_bytes, 1) << "x), tracks "
+                << stats.identity_tracks << " identity, " << stats.constant_tracks << " constant, " << stats.animated_tracks << " animated");
+            LOG("    max error " << stats.max_translation_error << " translation, "
+                << gfxm::degrees(stats.max_rotation_error) << " deg rotation, " << stats.max_scale_error << " scale, playback off by "
+                << max_t_error << " / " << gfxm::degrees(max_r_error) << " deg");
+            LOG("    curve::at " << ref_ms / frame_count
+                << " ms, packed slerp " << packed_ms / frame_count
+                << " ms, compressed slerp " << slerp_ms / frame_count
+                << " ms, compressed nlerp " << nlerp_ms / frame_count << " ms per frame");
+        }
+    }
+}
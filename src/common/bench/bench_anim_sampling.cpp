@@ -0,0 +1,109 @@
+#include "bench.hpp"
+
+#include <random>
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "animation/animation.hpp"
+
+
+// Characters playing the same looping clip from different start times, 60 frames a second
+// over keys baked at 30. Samples every bone through curve<>::at(), the way
+// Animation::sample_remapped() does, then through the packed clip with per character key
+// cursors, with slerp and with nlerp. Slerp has to match curve<>::at() exactly, nlerp is
+// reported as the largest angle it is off by
+
+static void benchMakeClip(Animation& anim, int bone_count, float seconds, std::mt19937& rng) {
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+    const int key_count = (int)(seconds * 30.f) + 1;
+    for (int b = 0; b < bone_count; ++b) {
+        AnimNode& node = anim.createNode("bone" + std::to_string(b));
+        const gfxm::vec3 axis = gfxm::normalize(gfxm::vec3(dist(rng), dist(rng), dist(rng)));
+        const float phase = dist(rng) * 3.f;
+        const float speed = 1.f + dist(rng) * .5f;
+        std::vector<keyframe<gfxm::vec3>> t_keys;
+        std::vector<keyframe<gfxm::quat>> r_keys;
+        for (int k = 0; k < key_count; ++k) {
+            const float time = k / 30.f;
+            t_keys.push_back(keyframe<gfxm::vec3>(time, gfxm::vec3(.0f, .1f * b + .02f * sinf(time * speed + phase), .0f)));
+            r_keys.push_back(keyframe<gfxm::quat>(time, gfxm::angle_axis(sinf(time * speed * 3.f + phase) * 1.2f, axis)));
+        }
+        node.t.set_keyframes(t_keys);
+        node.r.set_keyframes(r_keys);
+        // Scale hardly ever moves
+        node.s[.0f] = gfxm::vec3(1.f, 1.f, 1.f);
+    }
+    anim.length = seconds;
+}
+
+void benchAnimSampling(const ConsoleCommand& cmd) {
+    const int character_count = std::max(1, cmd.arg<int>(0, 200));
+    const int frame_count = std::max(1, cmd.arg<int>(1, 120));
+    LOG("bench.anim_sampling: " << character_count << " characters, " << frame_count << " frames");
+
+    const int bone_counts[] = { 30, 60, 100 };
+    const float clip_lengths[] = { 1.f, 4.f, 16.f };
+    std::mt19937 rng(1337);
+    timer timer_;
+    for (int bone_count : bone_counts) {
+        for (float clip_length : clip_lengths) {
+            Animation anim;
+            benchMakeClip(anim, bone_count, clip_length, rng);
+            const animPackedClip& clip = anim.getPacked();
+
+            std::vector<int32_t> nodes(bone_count);
+            std::vector<int32_t> mapping(bone_count);
+            for (int b = 0; b < bone_count; ++b) {
+                nodes[b] = b;
+                mapping[b] = b;
+            }
+            std::vector<AnimSample> ref(character_count * bone_count);
+            std::vector<AnimSample> out(character_count * bone_count);
+            std::vector<animSampleCursor> cursors(character_count);
+            auto timeAt = [&](int c, int f) {
+                return fmodf(c * .37f + f / 60.f, clip_length);
+            };
+
+            float ref_ms = .0f;
+            float slerp_ms = .0f;
+            float nlerp_ms = .0f;
+            int slerp_mismatches = 0;
+            float nlerp_max_angle = .0f;
+            for (int f = 0; f < frame_count; ++f) {
+                timer_.start();
+                for (int c = 0; c < character_count; ++c) {
+                    anim.sample_remapped(&ref[c * bone_count], bone_count, timeAt(c, f), mapping);
+                }
+                ref_ms += timer_.stop() * 1000.f;
+
+                timer_.start();
+                for (int c = 0; c < character_count; ++c) {
+                    animSamplePacked(clip, cursors[c], nodes.data(), nodes.data(), bone_count, timeAt(c, f), ANIM_ROTATION_SLERP, &out[c * bone_count]);
+                }
+                slerp_ms += timer_.stop() * 1000.f;
+                for (int i = 0; i < ref.size(); ++i) {
+                    if (memcmp(&ref[i], &out[i], sizeof(AnimSample)) != 0) {
+                        ++slerp_mismatches;
+                    }
+                }
+
+                timer_.start();
+                for (int c = 0; c < character_count; ++c) {
+                    animSamplePacked(clip, cursors[c], nodes.data(), nodes.data(), bone_count, timeAt(c, f), ANIM_ROTATION_NLERP, &out[c * bone_count]);
+                }
+                nlerp_ms += timer_.stop() * 1000.f;
+                for (int i = 0; i < ref.size(); ++i) {
+                    const float d = std::min(1.f, fabsf(gfxm::dot(ref[i].r, out[i].r)));
+                    nlerp_max_angle = std::max(nlerp_max_angle, 2.f * acosf(d));
+                }
+            }
+            LOG("  " << bone_count << " bones, " << clip_length << " s clip: curve::at " << ref_ms / frame_count
+                << " ms, packed slerp " << slerp_ms / frame_count
+                << " ms, packed nlerp " << nlerp_ms / frame_count
+                << " ms per frame, nlerp off by " << gfxm::degrees(nlerp_max_angle) << " deg at most");
+            if (slerp_mismatches) {
+                LOG_WARN("    packed slerp differs from curve::at in " << slerp_mismatches << " samples");
+            }
+        }
+    }
+}
@@ -0,0 +1,175 @@
+#include "bench.hpp"
+
+#include <random>
+#include <thread>
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "resource_manager/resource_manager.hpp"
+#include "animation/animator/animator.hpp"
+#include "transform_node/transform_system.hpp"
+#include "world/common_systems/animation_system.hpp"
+
+
+// Animated characters running through AnimationSystem::update(): an fsm switching between a
+// blend of two clips and a single clip, with a host event on every state change. The same
+// frames are played at every thread count, the bone transforms and the order of host events
+// have to come out the same as with one thread
+
+struct BenchAnimSystemScene {
+    std::vector<std::unique_ptr<AnimMachineInstance>> instances;
+    std::vector<HSHARED<SkeletonInstance>> skeletons;
+    std::vector<std::unique_ptr<AnimObject>> objects;
+    AnimationSystem sys;
+};
+
+static ResourceRef<Animation> benchMakeAnimSystemClip(Skeleton* skl, float speed, std::mt19937& rng) {
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+    ResourceRef<Animation> anim = createResource<Animation>("");
+    const float length = 30.f;
+    for (int b = 0; b < skl->boneCount(); ++b) {
+        AnimNode& node = anim->createNode(skl->getBone(b)->getName());
+        const gfxm::vec3 axis = gfxm::normalize(gfxm::vec3(dist(rng), dist(rng), dist(rng)));
+        const float phase = dist(rng) * 3.f;
+        for (int k = 0; k <= (int)length; ++k) {
+            node.t[(float)k] = gfxm::vec3(.0f, .1f, .0f);
+            node.r[(float)k] = gfxm::angle_axis(sinf(k / length * 6.2831853f * speed + phase) * .8f, axis);
+            node.s[(float)k] = gfxm::vec3(1.f, 1.f, 1.f);
+        }
+    }
+    anim->length = length;
+    anim->fps = 30.f;
+    return anim;
+}
+
+static uint64_t benchHashAnimSystemScene(BenchAnimSystemScene& scene) {
+    TransformSystem::update();
+    uint64_t hash = 14695981039346656037ull;
+    for (auto& skl_inst : scene.skeletons) {
+        const int bone_count = (int)skl_inst->getSkeletonMaster()->boneCount();
+        for (int b = 0; b < bone_count; ++b) {
+            const gfxm::mat4& m = skl_inst->getBoneNode(b)->getWorldTransform();
+            const uint8_t* p = (const uint8_t*)&m;
+            for (int i = 0; i < sizeof(m); ++i) {
+                hash = (hash ^ p[i]) * 1099511628211ull;
+            }
+        }
+    }
+    return hash;
+}
+
+void benchAnimSystem(const ConsoleCommand& cmd) {
+    const int instance_count = std::max(1, cmd.arg<int>(0, 1000));
+    const int bone_count = std::max(2, cmd.arg<int>(1, 60));
+    const int frame_count = std::max(1, cmd.arg<int>(2, 120));
+    const float dt = 1.f / 60.f;
+    const int thread_counts[] = { 1, 2, 4, 8, 16 };
+
+    LOG("bench.anim_system: " << instance_count << " instances, " << bone_count << " bones, "
+        << frame_count << " frames, " << std::thread::hardware_concurrency() << " hardware threads");
+
+    // Spine with limbs branching off
+    ResourceRef<Skeleton> skl = createResource<Skeleton>("");
+    std::mt19937 rng(1337);
+    {
+        std::vector<sklBone*> bones = { skl->getRoot() };
+        for (int i = 1; i < bone_count; ++i) {
+            std::uniform_int_distribution<int> parent_dist(std::max(0, i - 6), i - 1);
+            sklBone* bone = bones[parent_dist(rng)]->createChild(("bone" + std::to_string(i)).c_str());
+            bone->setTranslation(gfxm::vec3(.0f, .1f, .0f));
+            bones.push_back(bone);
+        }
+    }
+
+    ResourceRef<AnimMachine> machine = createResource<AnimMachine>("");
+    machine->setSkeleton(skl);
+    machine->addSampler("idle", "loco", benchMakeAnimSystemClip(skl.get(), 1.f, rng));
+    machine->addSampler("run", "loco", benchMakeAnimSystemClip(skl.get(), 3.f, rng));
+    machine->addSampler("wave", "", benchMakeAnimSystemClip(skl.get(), 2.f, rng));
+    machine->addParam("velocity");
+    machine->addParam("wave");
+    machine->addFeedbackEvent("state_changed");
+    {
+        animUnitFsm* fsm = new animUnitFsm;
+        machine->setRoot(fsm);
+        animFsmState* state_loco = fsm->addState("Locomotion");
+        animFsmState* state_wave = fsm->addState("Wave");
+        animUnitBlendTree* bt = new animUnitBlendTree;
+        state_loco->setUnit(bt);
+        auto node_blend2 = bt->addNode<animBtNodeBlend2>();
+        auto node_clip0 = bt->addNode<animBtNodeClip>();
+        auto node_clip1 = bt->addNode<animBtNodeClip>();
+        bt->setOutputNode(node_blend2);
+        node_clip0->setSampler("idle");
+        node_clip1->setSampler("run");
+        node_blend2->setInputs(node_clip0, node_clip1);
+        node_blend2->setWeightExpression("velocity");
+        animUnitSingle* single = new animUnitSingle;
+        single->setSampler("wave");
+        state_wave->setUnit(single);
+        state_loco->onExit("@state_changed");
+        state_wave->onExit("@state_changed");
+        fsm->addTransition("Locomotion", "Wave", "wave > .5", .1f);
+        fsm->addTransition("Wave", "Locomotion", "wave <= .5", .1f);
+    }
+    machine->compile();
+    const int param_velocity = machine->getParamId("velocity");
+    const int param_wave = machine->getParamId("wave");
+
+    uint64_t reference_hash = 0;
+    std::vector<std::pair<int, int>> reference_events;
+    float reference_ms = .0f;
+    for (int thread_count : thread_counts) {
+        BenchAnimSystemScene scene;
+        scene.sys.setThreadCount(thread_count);
+        std::vector<std::pair<int, int>> events;
+        scene.sys.setHostEventCallback([&events](AnimObject* o, int id) {
+            events.push_back(std::make_pair(o->system_index, id));
+        });
+        for (int i = 0; i < instance_count; ++i) {
+            scene.skeletons.push_back(skl->createInstance());
+            scene.instances.push_back(std::unique_ptr<AnimMachineInstance>(new AnimMachineInstance));
+            scene.instances.back()->init(machine);
+            scene.objects.push_back(std::unique_ptr<AnimObject>(new AnimObject));
+            scene.objects.back()->anim_inst = scene.instances.back().get();
+            scene.objects.back()->skl_inst = scene.skeletons.back().get();
+            scene.sys.addAnimObject(scene.objects.back().get());
+        }
+
+        timer timer_;
+        float update_ms = .0f;
+        for (int f = 0; f < frame_count; ++f) {
+            for (int i = 0; i < instance_count; ++i) {
+                scene.instances[i]->setParamValue(param_velocity, .5f + .5f * sinf(f * .05f + i * .1f));
+                scene.instances[i]->setParamValue(param_wave, ((f + i) / 40) % 3 == 0 ? 1.f : .0f);
+            }
+            timer_.start();
+            scene.sys.update(dt);
+            update_ms += timer_.stop() * 1000.f;
+            TransformSystem::update();
+        }
+        update_ms /= frame_count;
+
+        const uint64_t hash = benchHashAnimSystemScene(scene);
+        if (thread_count == 1) {
+            reference_hash = hash;
+            reference_events = events;
+            reference_ms = update_ms;
+        }
+        LOG("  " << thread_count << " threads: update " << update_ms << " ms/frame, "
+            << events.size() << " host events, speedup " << (update_ms > .0f ? reference_ms / update_ms : .0f) << "x");
+        if (hash != reference_hash) {
+            LOG_WARN("    bone transforms differ from the single threaded run");
+        }
+        if (events != reference_events) {
+            LOG_WARN("    host events differ from the single threaded run");
+        }
+
+        for (int i = instance_count - 1; i >= 0; --i) {
+            scene.sys.removeAnimObject(scene.objects[i].get());
+        }
+        for (auto& skl_inst : scene.skeletons) {
+            skl->destroyInstance(skl_inst);
+        }
+    }
+}
@@ -0,0 +1,147 @@
+#include "bench.hpp"
+
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "animation/animvm/animvm.hpp"
+
+
+// A crowd of characters running the door/locomotion fsm from the test game, only the transition
+// part of animUnitFsm::update(): global transitions, then the current state's, on exit
+// expression when one fires, signals cleared at the end of the frame. Every instance runs the
+// same shared program over its own frame, reports the cost of a frame and the memory it takes
+
+struct BenchFsmTransition {
+    int expr_addr;
+    int target;
+    int instruction_count = 0;
+};
+struct BenchFsmState {
+    std::vector<BenchFsmTransition> transitions;
+    int expr_on_exit_addr = -1;
+};
+struct BenchFsmInstance {
+    animvm::vm_frame frame;
+    animvm::VM vm;
+    int current_state = 0;
+};
+
+void benchAnimTransitions(const ConsoleCommand& cmd) {
+    const int instance_count = std::max(1, cmd.arg<int>(0, 10000));
+    const int frame_count = std::max(1, cmd.arg<int>(1, 120));
+    LOG("bench.anim_transitions: " << instance_count << " instances, " << frame_count << " frames, "
+        << (ANIMVM_THREADED_DISPATCH ? "threaded" : "switch") << " dispatch");
+
+    animvm::vm_program prog;
+    const int velocity = prog.decl_variable(animvm::type_float, "velocity");
+    const int is_falling = prog.decl_variable(animvm::type_float, "is_falling");
+    const int sig_door_open = prog.decl_variable(animvm::type_float, "sig_door_open");
+    const int state_complete = prog.decl_variable(animvm::type_bool, "state_complete");
+    prog.decl_host_event("state_changed", -1);
+
+    enum { IDLE, LOCOMOTION, FALLING, DOOR_OPEN, STATE_COUNT };
+    auto expr = [&prog](const char* source) {
+        int addr = animvm::compile(prog, MKSTR("return " << source << ";").c_str());
+        assert(addr != -1);
+        return addr;
+    };
+    std::vector<BenchFsmState> states(STATE_COUNT);
+    states[IDLE].transitions = {
+        { expr("velocity > .00001"), LOCOMOTION },
+        { expr("is_falling"), FALLING }
+    };
+    states[LOCOMOTION].transitions = {
+        { expr("velocity <= .00001"), IDLE },
+        { expr("is_falling"), FALLING }
+    };
+    states[FALLING].transitions = {
+        { expr("is_falling == 0 && velocity <= .00001"), IDLE },
+        { expr("is_falling == 0 && velocity > .00001"), LOCOMOTION }
+    };
+    states[DOOR_OPEN].transitions = {
+        { expr("state_complete"), IDLE }
+    };
+    std::vector<BenchFsmTransition> global_transitions = {
+        { expr("sig_door_open"), DOOR_OPEN }
+    };
+    for (auto& st : states) {
+        st.expr_on_exit_addr = animvm::compile(prog, "@state_changed; return 0;");
+    }
+    if (!prog.link()) {
+        return;
+    }
+    for (auto& st : states) {
+        for (auto& tr : st.transitions) {
+            tr.instruction_count = prog.instruction_count_at(tr.expr_addr);
+        }
+    }
+    for (auto& tr : global_transitions) {
+        tr.instruction_count = prog.instruction_count_at(tr.expr_addr);
+    }
+
+    int host_events = 0;
+    std::vector<BenchFsmInstance> instances(instance_count);
+    for (auto& inst : instances) {
+        prog.init_frame(inst.frame);
+        inst.vm.load_program(&prog);
+        inst.vm.load_frame(&inst.frame);
+        inst.vm.set_host_event_cb([&host_events](animvm::i32) { ++host_events; });
+    }
+
+    timer timer_;
+    float eval_ms = .0f;
+    long long expressions_run = 0;
+    long long instructions_run = 0;
+    for (int f = 0; f < frame_count; ++f) {
+        for (int i = 0; i < instance_count; ++i) {
+            auto& frame = instances[i].frame;
+            const int phase = (f + i * 7) % 240;
+            frame.set_variable_float(velocity, phase < 80 ? .0f : (phase - 80) / 160.f);
+            frame.set_variable_float(is_falling, phase >= 200 && phase < 210 ? 1.f : .0f);
+            frame.set_variable_float(sig_door_open, phase == 100 ? 1.f : .0f);
+            frame.set_variable_bool(state_complete, phase == 130);
+        }
+
+        timer_.start();
+        for (int i = 0; i < instance_count; ++i) {
+            auto& inst = instances[i];
+            bool fired = false;
+            for (auto& tr : global_transitions) {
+                ++expressions_run;
+                instructions_run += tr.instruction_count;
+                if (inst.vm.run_at(tr.expr_addr)) {
+                    inst.vm.run_at(states[inst.current_state].expr_on_exit_addr);
+                    inst.current_state = tr.target;
+                    fired = true;
+                    break;
+                }
+            }
+            if (fired) {
+                continue;
+            }
+            for (auto& tr : states[inst.current_state].transitions) {
+                ++expressions_run;
+                instructions_run += tr.instruction_count;
+                if (inst.vm.run_at(tr.expr_addr)) {
+                    inst.vm.run_at(states[inst.current_state].expr_on_exit_addr);
+                    inst.current_state = tr.target;
+                    break;
+                }
+            }
+        }
+        eval_ms += timer_.stop() * 1000.f;
+
+        for (auto& inst : instances) {
+            inst.frame.set_variable_float(sig_door_open, .0f);
+        }
+    }
+
+    const size_t shared_bytes = prog.code.size() * sizeof(animvm::vm_instr) + prog.constants.size() * sizeof(animvm::i32);
+    const size_t instance_bytes = sizeof(BenchFsmInstance) + prog.frame_size() * sizeof(animvm::i32);
+    LOG("  " << eval_ms / frame_count << " ms per frame, "
+        << eval_ms * 1e6f / ((float)frame_count * instance_count) << " ns per instance, "
+        << (float)expressions_run / frame_count << " expressions and "
+        << (float)instructions_run / frame_count << " instructions per frame, "
+        << host_events << " state changes");
+    LOG("  " << shared_bytes << " bytes of shared code and constants, " << instance_bytes << " bytes per instance");
+}
@@ -0,0 +1,77 @@
+#include "bench.hpp"
+
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "animation/animvm/animvm.hpp"
+
+
+// Runs each expression over and over on one frame, the way runExpr() does, changing a param
+// between runs so nothing gets hoisted. Reports instructions per run and how many million
+// instructions a second go through dispatch. Last expression is the same as the one before
+// written with constants spelled out, folding should bring it to the same length
+
+void benchAnimvm(const ConsoleCommand& cmd) {
+    const int run_count = std::max(1, cmd.arg<int>(0, 2000000));
+    LOG("bench.animvm: " << run_count << " runs per expression, "
+        << (ANIMVM_THREADED_DISPATCH ? "threaded" : "switch") << " dispatch");
+
+    animvm::vm_program prog;
+    const int velocity = prog.decl_variable(animvm::type_float, "velocity");
+    prog.decl_variable(animvm::type_float, "is_falling");
+    prog.decl_variable(animvm::type_float, "sig_door_open");
+    prog.decl_variable(animvm::type_bool, "state_complete");
+    prog.decl_host_event("state_changed", -1);
+
+    const char* sources[] = {
+        "return velocity > .00001;",
+        "return (velocity);",
+        "return is_falling == 0 && velocity <= .00001;",
+        "return sig_door_open || state_complete;",
+        "@state_changed; return 0;",
+        "return (velocity * 2 - 1) / (is_falling + 3) > .25 && !state_complete;",
+        "return (velocity * (4 / 2) - 1 * 1) / (is_falling + (1 + 2)) > 1 / 4 && !state_complete;"
+    };
+    std::vector<int> addrs;
+    for (auto src : sources) {
+        int addr = animvm::compile(prog, src);
+        if (addr == -1) {
+            LOG_ERR("bench.animvm: failed to compile '" << src << "'");
+            return;
+        }
+        addrs.push_back(addr);
+    }
+    if (!prog.link()) {
+        return;
+    }
+
+    animvm::vm_frame frame;
+    prog.init_frame(frame);
+    animvm::VM vm;
+    int host_events = 0;
+    vm.set_host_event_cb([&host_events](animvm::i32) { ++host_events; });
+    vm.load_program(&prog);
+    vm.load_frame(&frame);
+
+    timer timer_;
+    double total_instructions = .0;
+    double total_seconds = .0;
+    for (int e = 0; e < addrs.size(); ++e) {
+        const int addr = addrs[e];
+        timer_.start();
+        for (int i = 0; i < run_count; ++i) {
+            frame.slots[velocity] = animvm::vm_from_float((i & 1023) * (1.f / 1024.f));
+            vm.run_at(addr);
+        }
+        const float seconds = timer_.stop();
+        const int instructions = prog.instruction_count_at(addr);
+        total_instructions += (double)instructions * run_count;
+        total_seconds += seconds;
+        LOG("  '" << sources[e] << "': " << instructions << " instructions, "
+            << seconds * 1e9f / run_count << " ns per run, "
+            << (double)instructions * run_count / seconds / 1e6 << " M instructions/s");
+    }
+    LOG("  " << total_instructions / total_seconds / 1e6 << " M instructions/s overall, "
+        << prog.code.size() << " instructions, " << prog.constants.size() << " constants, "
+        << prog.frame_size() << " slots per frame, " << host_events << " host events");
+}
@@ -0,0 +1,120 @@
+#include "bench.hpp"
+
+#include <random>
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "audio/audio_mix_core.hpp"
+
+
+// Renders voices offline into a 44.1k stereo buffer, 128 frames at a time like the XAudio2
+// callback does. Clips come in at 22.05k, 32k, 44.1k and 48k, mono and stereo, half of the
+// voices go through the 3d path with their gain changing every buffer.
+// The per sample loop that used to be in AudioMixer is timed alongside for comparison, it
+// ignores the clip rate so it is not doing the same work, only the same amount of it.
+// Then a looping 1kHz sine at 22.05k is mixed and compared to the ideal one at 44.1k
+
+struct BenchAudioClip {
+    std::vector<short> samples;
+    AudioMixSource src;
+};
+
+static void benchMakeClip(BenchAudioClip& clip, int sample_rate, int channel_count, float seconds, float freq, std::mt19937& rng) {
+    std::uniform_real_distribution<float> noise(-.1f, .1f);
+    const int frame_count = (int)(sample_rate * seconds);
+    clip.samples.resize(frame_count * channel_count);
+    for (int i = 0; i < frame_count; ++i) {
+        for (int c = 0; c < channel_count; ++c) {
+            const float s = sinf(6.2831853f * freq * (c + 1) * i / sample_rate) * .5f + noise(rng);
+            clip.samples[i * channel_count + c] = (short)(s * 32767.f);
+        }
+    }
+    clip.src.samples = clip.samples.data();
+    clip.src.frame_count = frame_count;
+    clip.src.channel_count = channel_count;
+    clip.src.sample_rate = sample_rate;
+}
+
+void benchAudioMix(const ConsoleCommand& cmd) {
+    const int voice_count = std::max(1, cmd.arg<int>(0, 256));
+    const int seconds = std::max(1, cmd.arg<int>(1, 10));
+    const int SAMPLE_RATE = 44100;
+    const int BUFFER_FRAMES = 128;
+    const int buffer_count = SAMPLE_RATE * seconds / BUFFER_FRAMES;
+    LOG("bench.audio_mix: " << voice_count << " voices, " << seconds << " s of audio");
+
+    std::mt19937 rng(1337);
+    const int rates[] = { 22050, 32000, 44100, 48000 };
+    std::vector<BenchAudioClip> clips(8);
+    for (int i = 0; i < clips.size(); ++i) {
+        benchMakeClip(clips[i], rates[i % 4], 1 + (i / 4), 1.3f + i * .1f, 220.f + 110.f * i, rng);
+    }
+
+    AudioMixCore core(SAMPLE_RATE);
+    std::vector<AudioMixVoice> voices(voice_count);
+    std::vector<float> out(BUFFER_FRAMES * 2);
+
+    timer timer_;
+    timer_.start();
+    for (int b = 0; b < buffer_count; ++b) {
+        memset(out.data(), 0, out.size() * sizeof(float));
+        for (int v = 0; v < voice_count; ++v) {
+            const bool is_3d = v % 2 == 1;
+            const float gain_l = is_3d ? .5f + .5f * sinf(b * .05f + v) : .8f;
+            const float gain_r = is_3d ? .5f + .5f * cosf(b * .05f + v) : .6f;
+            core.mixVoice(out.data(), BUFFER_FRAMES, clips[v % clips.size()].src, voices[v], gain_l, gain_r, true, is_3d);
+        }
+    }
+    const float core_ms = timer_.stop() * 1000.f;
+
+    // What AudioMixer did before, a short at a time with the pan and the wrap worked out per sample
+    std::vector<size_t> cursors(voice_count);
+    timer_.start();
+    for (int b = 0; b < buffer_count; ++b) {
+        memset(out.data(), 0, out.size() * sizeof(float));
+        for (int v = 0; v < voice_count; ++v) {
+            const AudioMixSource& src = clips[v % clips.size()].src;
+            const size_t src_len = src.frame_count * src.channel_count;
+            const float panning = .1f;
+            for (int i = 0; i < BUFFER_FRAMES * 2; ++i) {
+                const int lr = (i % 2) * 2 - 1;
+                const float pan = std::min(fabsf(lr + panning), 1.0f);
+                out[i] += src.samples[(cursors[v] + i) % src_len] * (1.0f / 32767.f) * .7f * pan;
+            }
+            cursors[v] = (cursors[v] + BUFFER_FRAMES * 2) % src_len;
+        }
+    }
+    const float old_ms = timer_.stop() * 1000.f;
+
+    LOG("  mix core " << core_ms << " ms, " << (seconds * 1000.f) / core_ms << "x realtime");
+    LOG("  old per sample loop " << old_ms << " ms, " << (seconds * 1000.f) / old_ms << "x realtime");
+
+    // Half a second of 1kHz is a whole number of periods, so the loop point is seamless
+    BenchAudioClip sine;
+    sine.samples.resize(11025);
+    for (int i = 0; i < sine.samples.size(); ++i) {
+        sine.samples[i] = (short)(sinf(6.2831853f * 1000.f * i / 22050.f) * .5f * 32767.f);
+    }
+    sine.src.samples = sine.samples.data();
+    sine.src.frame_count = sine.samples.size();
+    sine.src.channel_count = 1;
+    sine.src.sample_rate = 22050;
+    AudioMixVoice voice;
+    std::vector<float> rendered(SAMPLE_RATE * 2 * 2);
+    const int frame_total = (int)rendered.size() / 2;
+    for (int f = 0; f < frame_total; f += BUFFER_FRAMES) {
+        core.mixVoice(rendered.data() + f * 2, std::min(BUFFER_FRAMES, frame_total - f), sine.src, voice, 1.f, 1.f, true);
+    }
+    double err = .0;
+    double sig = .0;
+    for (int i = 0; i < frame_total; ++i) {
+        const double ideal = sin(6.283185307179586 * 1000.0 * i / SAMPLE_RATE) * .5;
+        err += (rendered[i * 2] - ideal) * (rendered[i * 2] - ideal);
+        sig += ideal * ideal;
+    }
+    const double snr = 10.0 * log10(sig / std::max(err, 1e-20));
+    LOG("  22.05k sine resampled to 44.1k over 4 loops: " << snr << " dB snr");
+    if (snr < 40.0) {
+        LOG_WARN("    resampled sine is off, wrong pitch or a broken loop point");
+    }
+}
@@ -0,0 +1,150 @@
+#include "bench.hpp"
+
+#include <stdio.h>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "resource_manager/byte_reader/file_reader.hpp"
+#include "resource_manager/byte_reader/mmap_reader.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+// Loads a few thousand files of mixed size the way resource loaders see them: open, try_slurp(), parse.
+// Most files are small (json-like, 1-16 kb), some medium (64-512 kb), a few large (1-4 mb).
+// file_reader + a std::string copy of the view is what the json loaders used to do,
+// open_file_reader() maps the larger files and the view is read in place.
+// "parse" is a byte sum over the whole view. Cold runs drop the files from the OS cache first,
+// warm runs go again right after
+
+void benchEvictFileCache(const std::string& path) {
+#ifdef _WIN32
+    // Opening unbuffered purges the file's pages from the system cache
+    HANDLE h = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+    if (h != INVALID_HANDLE_VALUE) {
+        CloseHandle(h);
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#endif
+}
+
+static uint64_t benchParseView(const uint8_t* data, size_t size) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; ++i) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+static float benchLoadFiles(const std::vector<std::string>& paths, bool cold, bool mapped, uint64_t& checksum) {
+    if (cold) {
+        for (auto& p : paths) {
+            benchEvictFileCache(p);
+        }
+    }
+    checksum = 0;
+    timer timer_;
+    timer_.start();
+    for (auto& p : paths) {
+        if (mapped) {
+            std::unique_ptr<byte_reader> reader(open_file_reader(p));
+            auto view = reader->try_slurp();
+            if (view) {
+                checksum += benchParseView(view.data, view.size);
+            }
+        } else {
+            file_reader reader(p);
+            auto view = reader.try_slurp();
+            if (view) {
+                std::string str(view.data, view.data + view.size);
+                checksum += benchParseView((const uint8_t*)str.data(), str.size());
+            }
+        }
+    }
+    return timer_.stop() * 1000.f;
+}
+
+void benchFileIo(const ConsoleCommand& cmd) {
+    const int file_count = std::max(1, cmd.arg<int>(0, 3000));
+    const int run_count = std::max(1, cmd.arg<int>(1, 3));
+
+    const auto root = std::filesystem::temp_directory_path() / "bench_file_io";
+    std::filesystem::create_directories(root);
+    std::vector<std::string> paths;
+    size_t total_bytes = 0;
+    int mapped_count = 0;
+    {
+        uint32_t rng = 12345;
+        auto next = [&rng]() -> uint32_t {
+            rng = rng * 1664525u + 1013904223u;
+            return rng >> 8;
+        };
+        std::vector<uint8_t> bytes;
+        for (int i = 0; i < file_count; ++i) {
+            const uint32_t kind = next() % 100;
+            size_t sz = 0;
+            if (kind < 70) {
+                sz = 1024 + next() % (15 * 1024);
+            } else if (kind < 95) {
+                sz = 64 * 1024 + next() % (448 * 1024);
+            } else {
+                sz = 1024 * 1024 + next() % (3 * 1024 * 1024);
+            }
+            bytes.resize(sz);
+            for (size_t b = 0; b < sz; ++b) {
+                bytes[b] = (uint8_t)(i + b * 13);
+            }
+            std::string path = (root / ("f" + std::to_string(i) + ".bin")).string();
+            FILE* f = fopen(path.c_str(), "wb");
+            if (!f) {
+                LOG_ERR("bench.file_io: failed to write " << path);
+                return;
+            }
+            fwrite(bytes.data(), 1, sz, f);
+            fclose(f);
+            paths.push_back(path);
+            total_bytes += sz;
+            mapped_count += sz >= MMAP_READER_MIN_SIZE ? 1 : 0;
+        }
+    }
+    const float total_mb = total_bytes / (1024.f * 1024.f);
+    LOG("bench.file_io: " << file_count << " files, " << total_mb << " mb, " << mapped_count << " at or above the "
+        << MMAP_READER_MIN_SIZE / 1024 << " kb mapping threshold, best of " << run_count << " runs");
+
+    const char* names[] = { "file_reader + string copy", "open_file_reader" };
+    float best[2][2] = { { 1e9f, 1e9f }, { 1e9f, 1e9f } };
+    uint64_t checksums[2] = { 0, 0 };
+    for (int r = 0; r < run_count; ++r) {
+        for (int m = 0; m < 2; ++m) {
+            best[m][0] = std::min(best[m][0], benchLoadFiles(paths, true, m == 1, checksums[m]));
+            best[m][1] = std::min(best[m][1], benchLoadFiles(paths, false, m == 1, checksums[m]));
+        }
+    }
+    std::filesystem::remove_all(root);
+
+    if (checksums[0] != checksums[1]) {
+        LOG_ERR("bench.file_io: checksum mismatch");
+    }
+    for (int m = 0; m < 2; ++m) {
+        LOG("  " << names[m] << ": cold " << best[m][0] << " ms (" << total_mb * 1000.f / best[m][0] << " mb/s), warm "
+            << best[m][1] << " ms (" << total_mb * 1000.f / best[m][1] << " mb/s)");
+    }
+    LOG("  " << best[0][0] / best[1][0] << "x cold, " << best[0][1] / best[1][1] << "x warm");
+}
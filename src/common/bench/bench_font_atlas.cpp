@@ -0,0 +1,158 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "image/image.hpp"
+#include "typeface/rect_pack.hpp"
+#include "typeface/glyph_atlas.hpp"
+
+
+// Streams distinct codepoints into a font atlas a few per frame, like chat or localized ui
+// running into new CJK characters. Headless, glyph bitmaps are synthetic squares of CJK-like size
+// with some narrower latin-like ones, nothing is rendered through FreeType or sent to a gpu.
+// The old Font path rebuilt everything on any new glyph: RectPack over all glyphs, blit all of them
+// into a fresh image and upload the whole image (it also rendered every glyph twice, not counted here).
+// GlyphAtlas places only the new glyphs and uploads the rects they touched.
+// Reports the mean and the worst frame, bytes uploaded, and checks no glyph ever moved
+
+struct BenchGlyphBitmap {
+    int w = 0;
+    int h = 0;
+    std::vector<uint8_t> pixels;
+};
+
+static void benchMakeGlyphs(std::vector<BenchGlyphBitmap>& glyphs, int count) {
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> cjk_size(14, 18);
+    std::uniform_int_distribution<int> latin_w(5, 10);
+    std::uniform_int_distribution<int> value(1, 255);
+    glyphs.resize(count);
+    for (int i = 0; i < count; ++i) {
+        auto& g = glyphs[i];
+        if (i % 5 == 0) {
+            g.w = latin_w(rng);
+            g.h = cjk_size(rng) - 2;
+        } else {
+            g.w = cjk_size(rng);
+            g.h = cjk_size(rng);
+        }
+        g.pixels.resize(g.w * g.h);
+        for (auto& p : g.pixels) {
+            p = (uint8_t)value(rng);
+        }
+    }
+}
+
+static void benchFontAtlasRebuild(const std::vector<BenchGlyphBitmap>& glyphs, int per_frame) {
+    constexpr int border = 1;
+    std::vector<RectPack::Rect> rects;
+    timer timer_;
+    float total_ms = .0f;
+    float worst_ms = .0f;
+    uint64_t upload_bytes = 0;
+    int frames = 0;
+    int image_w = 0;
+    int image_h = 0;
+    for (int first = 0; first < glyphs.size(); first += per_frame) {
+        const int end = std::min((int)glyphs.size(), first + per_frame);
+        timer_.start();
+        rects.clear();
+        for (int i = 0; i < end; ++i) {
+            rects.emplace_back(i, (float)glyphs[i].w, (float)glyphs[i].h);
+        }
+        RectPack packer;
+        RectPack::Rect image_rect = packer.pack(
+            rects.data(), rects.size(), border,
+            RectPack::MAXSIDE, RectPack::POWER_OF_TWO
+        );
+        ktImage image;
+        image.reserve(image_rect.w, image_rect.h, 1);
+        for (auto& r : rects) {
+            const auto& g = glyphs[r.id];
+            image.blit((void*)g.pixels.data(), g.w, g.h, 1, r.x, r.y);
+        }
+        const float ms = timer_.stop() * 1000.f;
+        total_ms += ms;
+        worst_ms = std::max(worst_ms, ms);
+        upload_bytes += image.getSizeBytes();
+        image_w = image.getWidth();
+        image_h = image.getHeight();
+        ++frames;
+    }
+    LOG("  full rebuild: " << total_ms / frames << " ms/frame, worst " << worst_ms << " ms, "
+        << upload_bytes / frames / 1024 << " KB uploaded/frame, final " << image_w << "x" << image_h);
+}
+
+static void benchFontAtlasIncremental(const std::vector<BenchGlyphBitmap>& glyphs, int per_frame) {
+    GlyphAtlas atlas;
+    std::vector<GlyphAtlasRect> placed(glyphs.size());
+    timer timer_;
+    float total_ms = .0f;
+    float worst_ms = .0f;
+    uint64_t upload_bytes = 0;
+    int upload_calls = 0;
+    int frames = 0;
+    int failed = 0;
+    int uploaded_generation = atlas.getGeneration();
+    for (int first = 0; first < glyphs.size(); first += per_frame) {
+        const int end = std::min((int)glyphs.size(), first + per_frame);
+        timer_.start();
+        for (int i = first; i < end; ++i) {
+            const auto& g = glyphs[i];
+            if (!atlas.insert(g.pixels.data(), g.w, g.h, g.w, placed[i])) {
+                ++failed;
+            }
+        }
+        // Same decision Font::updateTextures() makes
+        if (uploaded_generation != atlas.getGeneration()) {
+            upload_bytes += atlas.getWidth() * atlas.getHeight();
+            ++upload_calls;
+            uploaded_generation = atlas.getGeneration();
+        } else {
+            for (auto& rc : atlas.getDirtyRects()) {
+                upload_bytes += rc.w * rc.h;
+                ++upload_calls;
+            }
+        }
+        atlas.clearDirtyRects();
+        const float ms = timer_.stop() * 1000.f;
+        total_ms += ms;
+        worst_ms = std::max(worst_ms, ms);
+        ++frames;
+    }
+
+    // Every glyph still has its own pixels where it was first placed
+    int moved = 0;
+    for (int i = 0; i < glyphs.size(); ++i) {
+        const auto& g = glyphs[i];
+        const auto& rc = placed[i];
+        for (int y = 0; y < g.h; ++y) {
+            const uint8_t* row = atlas.getPixels() + (rc.y + GLYPH_ATLAS_BORDER + y) * atlas.getWidth() + rc.x + GLYPH_ATLAS_BORDER;
+            if (memcmp(row, &g.pixels[y * g.w], g.w) != 0) {
+                ++moved;
+                break;
+            }
+        }
+    }
+
+    LOG("  incremental:  " << total_ms / frames << " ms/frame, worst " << worst_ms << " ms, "
+        << upload_bytes / frames / 1024 << " KB uploaded/frame in " << (float)upload_calls / frames << " rects, final "
+        << atlas.getWidth() << "x" << atlas.getHeight());
+    if (moved || failed) {
+        LOG_WARN("  " << moved << " glyphs lost their pixels, " << failed << " did not fit");
+    }
+}
+
+void benchFontAtlas(const ConsoleCommand& cmd) {
+    const int codepoint_count = std::max(1, cmd.arg<int>(0, 5000));
+    const int per_frame = std::max(1, cmd.arg<int>(1, 4));
+
+    LOG("bench.font_atlas: " << codepoint_count << " distinct codepoints, " << per_frame << " new per frame");
+    std::vector<BenchGlyphBitmap> glyphs;
+    benchMakeGlyphs(glyphs, codepoint_count);
+    benchFontAtlasIncremental(glyphs, per_frame);
+    benchFontAtlasRebuild(glyphs, per_frame);
+}
@@ -0,0 +1,189 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log/log.hpp"
+#include "log/log_ring.hpp"
+#include "util/timer.hpp"
+
+
+// N threads log as fast as they can while a writer thread drains and throws the lines away.
+// Measures the latency of a single write, the part the calling thread pays, formatting excluded:
+// the old mutex + std::queue<LogEntry> path with a writer that copies the whole queue and
+// sleeps 100 ms, against LogRing, blocking and dropping when full.
+// Every 50th line is longer than a ring slot to include the heap fallback
+
+struct BenchLogStats {
+    std::vector<uint32_t> latency_ns;
+    float total_ms = 0;
+    uint64_t dropped = 0;
+};
+
+// Log::_write and the writer thread as they were before LogRing
+struct BenchMutexLog {
+    std::atomic<bool> working = true;
+    std::mutex sync;
+    std::queue<LogEntry> lines;
+    std::thread thread_writer;
+    uint64_t consumed = 0;
+
+    BenchMutexLog() {
+        thread_writer = std::thread([this]() {
+            do {
+                std::queue<LogEntry> lines_copy;
+                {
+                    std::lock_guard<std::mutex> lock(sync);
+                    if (!working && lines.empty()) {
+                        break;
+                    }
+                    lines_copy = lines;
+                    while (!lines.empty()) {
+                        lines.pop();
+                    }
+                }
+                while (!lines_copy.empty()) {
+                    consumed += lines_copy.front().line.size();
+                    lines_copy.pop();
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            } while (1);
+        });
+    }
+    ~BenchMutexLog() {
+        working = false;
+        thread_writer.join();
+    }
+    void write(const std::string& str, unsigned long thread_id) {
+        std::lock_guard<std::mutex> lock(sync);
+        lines.push(LogEntry{ LOG_DEBUG_INFO, time(0), thread_id, str });
+    }
+};
+
+struct BenchRingLog {
+    std::atomic<bool> working = true;
+    LogRing ring;
+    std::thread thread_writer;
+    uint64_t consumed = 0;
+
+    BenchRingLog(LOG_FULL_POLICY policy) {
+        ring.setFullPolicy(policy);
+        thread_writer = std::thread([this]() {
+            ring.setConsumerThread(std::this_thread::get_id());
+            std::vector<LogEntry> batch;
+            do {
+                const bool stopping = !working;
+                const int count = ring.drain(batch);
+                for (int i = 0; i < count; ++i) {
+                    consumed += batch[i].line.size();
+                }
+                if (stopping && count == 0) {
+                    break;
+                }
+                if (count == 0) {
+                    ring.waitForLines(LOG_DRAIN_INTERVAL_MS);
+                }
+            } while (1);
+        });
+    }
+    ~BenchRingLog() {
+        working = false;
+        ring.wakeConsumer();
+        thread_writer.join();
+    }
+    void write(const std::string& str, unsigned long thread_id) {
+        ring.push(LOG_DEBUG_INFO, thread_id, str);
+    }
+};
+
+template<typename LOG_T>
+static void benchLogRun(LOG_T& log, int thread_count, int lines_per_thread, BenchLogStats& stats) {
+    std::vector<std::vector<uint32_t>> latencies(thread_count);
+    std::vector<std::thread> threads;
+    std::atomic<int> ready = 0;
+    const std::string long_tail(300, '.');
+
+    timer timer_;
+    timer_.start();
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&, t]() {
+            auto& lat = latencies[t];
+            lat.reserve(lines_per_thread);
+            ready.fetch_add(1);
+            while (ready.load() < thread_count) {
+                std::this_thread::yield();
+            }
+            std::ostringstream strm;
+            for (int i = 0; i < lines_per_thread; ++i) {
+                strm.str("");
+                strm << "thread " << t << " frame " << i << ": entity " << (i * 7919) % 1000
+                    << " moved to [" << i * .5f << ", 0, " << t * .25f << "]";
+                if (i % 50 == 0) {
+                    strm << long_tail;
+                }
+                const std::string line = strm.str();
+
+                const auto t0 = std::chrono::steady_clock::now();
+                log.write(line, (unsigned long)t);
+                const auto t1 = std::chrono::steady_clock::now();
+                lat.push_back((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    stats.total_ms = timer_.stop() * 1000.f;
+
+    stats.latency_ns.clear();
+    for (auto& lat : latencies) {
+        stats.latency_ns.insert(stats.latency_ns.end(), lat.begin(), lat.end());
+    }
+    std::sort(stats.latency_ns.begin(), stats.latency_ns.end());
+}
+
+static void benchLogReport(const char* name, const BenchLogStats& stats) {
+    const auto& lat = stats.latency_ns;
+    if (lat.empty()) {
+        return;
+    }
+    auto pct = [&lat](double p) -> uint32_t {
+        return lat[std::min(lat.size() - 1, (size_t)(lat.size() * p))];
+    };
+    LOG("  " << name << ": p50 " << pct(.5) << " ns, p99 " << pct(.99) << " ns, p99.9 " << pct(.999)
+        << " ns, max " << lat.back() / 1000 << " us, " << stats.total_ms << " ms total, "
+        << stats.dropped << " dropped");
+}
+
+void benchLogContention(const ConsoleCommand& cmd) {
+    const int thread_count = std::max(1, cmd.arg<int>(0, 8));
+    const int lines_per_thread = std::max(1, cmd.arg<int>(1, 20000));
+
+    LOG("bench.log_contention: " << thread_count << " threads, " << lines_per_thread << " lines each");
+
+    BenchLogStats mutex_stats;
+    {
+        BenchMutexLog log;
+        benchLogRun(log, thread_count, lines_per_thread, mutex_stats);
+    }
+    BenchLogStats block_stats;
+    {
+        BenchRingLog log(LOG_FULL_BLOCK);
+        benchLogRun(log, thread_count, lines_per_thread, block_stats);
+    }
+    BenchLogStats drop_stats;
+    {
+        BenchRingLog log(LOG_FULL_DROP);
+        benchLogRun(log, thread_count, lines_per_thread, drop_stats);
+        drop_stats.dropped = log.ring.takeDroppedCount();
+    }
+
+    benchLogReport("mutex + queue", mutex_stats);
+    benchLogReport("ring, block  ", block_stats);
+    benchLogReport("ring, drop   ", drop_stats);
+}
@@ -0,0 +1,165 @@
+#include "bench.hpp"
+
+#include <stdio.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "resource_manager/resource_manager.hpp"
+#include "resource_manager/pack/pack_builder.hpp"
+
+
+// Startup over a few thousand small resources (.mat, .skl, .anim, .pte, 512 b to 16 kb) loaded
+// by extensionless id, once from loose files and once from a pack built from an identical copy.
+// First only resolves every id: std::filesystem::exists per candidate extension against
+// a hash lookup in the mounted pack. Then loads every id through ResourceManager, cold (files
+// dropped from the OS cache) and warm. Every run uses its own resource type so entries start out unresolved
+
+template<int RUN>
+struct BenchPackResource : public ILoadable {
+    uint64_t sum = 0;
+
+    DEFINE_EXTENSIONS(e_mat, e_skl, e_anim, e_pte);
+    bool load(byte_reader& in) override {
+        auto view = in.try_slurp();
+        if (!view) {
+            return false;
+        }
+        for (size_t i = 0; i < view.size; ++i) {
+            sum += view.data[i];
+        }
+        return true;
+    }
+};
+
+template<int RUN>
+static float benchPackLoadAll(const std::vector<std::string>& ids, int& loaded) {
+    std::vector<ResourceRef<BenchPackResource<RUN>>> refs(ids.size());
+    timer timer_;
+    timer_.start();
+    for (int i = 0; i < ids.size(); ++i) {
+        refs[i] = loadResource<BenchPackResource<RUN>>(ids[i]);
+    }
+    const float ms = timer_.stop() * 1000.f;
+    loaded = 0;
+    for (auto& r : refs) {
+        loaded += r.isLoaded() ? 1 : 0;
+    }
+    return ms;
+}
+
+void benchPackStartup(const ConsoleCommand& cmd) {
+    const int file_count = std::max(1, cmd.arg<int>(0, 4000));
+    const bool compress = cmd.arg<int>(1, 1) != 0;
+
+    const auto root = std::filesystem::temp_directory_path() / "bench_pack_startup";
+    const auto loose_dir = root / "loose";
+    const auto packed_dir = root / "packed";
+    const std::string pack_path = (root / "bench.pack").string();
+    std::filesystem::create_directories(loose_dir);
+    std::filesystem::create_directories(packed_dir);
+
+    const char* exts[] = { "mat", "skl", "anim", "pte" };
+    std::vector<std::string> loose_ids;
+    std::vector<std::string> packed_ids;
+    std::vector<std::string> loose_files;
+    std::vector<uint8_t> bytes;
+    uint32_t rng = 777;
+    for (int i = 0; i < file_count; ++i) {
+        rng = rng * 1664525u + 1013904223u;
+        const size_t sz = 512 + (rng >> 8) % (16 * 1024 - 512);
+        bytes.resize(sz);
+        for (size_t b = 0; b < sz; ++b) {
+            // Json-like redundancy so compression has something to work with
+            bytes[b] = (uint8_t)"{\"name\": \"value\", \"n\": 0.125}\n"[(b + i) % 31];
+        }
+        const std::string fname = "r" + std::to_string(i) + "." + exts[i % 4];
+        for (auto& dir : { loose_dir, packed_dir }) {
+            FILE* f = fopen((dir / fname).string().c_str(), "wb");
+            if (!f) {
+                LOG_ERR("bench.pack_startup: failed to write to " << dir.string());
+                return;
+            }
+            fwrite(bytes.data(), 1, sz, f);
+            fclose(f);
+        }
+        loose_ids.push_back((loose_dir / ("r" + std::to_string(i))).string());
+        packed_ids.push_back((packed_dir / ("r" + std::to_string(i))).string());
+        loose_files.push_back((loose_dir / fname).string());
+    }
+
+    PackBuildStats stats;
+    if (!packBuild(packed_dir.string(), pack_path, compress, &stats)) {
+        LOG_ERR("bench.pack_startup: failed to build the pack");
+        return;
+    }
+    // Only the pack can serve these now
+    std::filesystem::remove_all(packed_dir);
+    LOG("bench.pack_startup: " << file_count << " files, " << stats.raw_bytes / 1024 << " kb, pack "
+        << stats.pack_bytes / 1024 << " kb with " << stats.compressed_count << " entries lz4 compressed");
+
+    timer timer_;
+    auto fs = PackFileSystem::get();
+
+    // Resolve only
+    int found = 0;
+    timer_.start();
+    for (auto& id : loose_ids) {
+        for (auto ext : exts) {
+            if (std::filesystem::exists(id + "." + ext)) {
+                ++found;
+                break;
+            }
+        }
+    }
+    const float loose_resolve_ms = timer_.stop() * 1000.f;
+
+    timer_.start();
+    const bool mounted = fs->mount(pack_path);
+    const float mount_ms = timer_.stop() * 1000.f;
+    if (!mounted) {
+        LOG_ERR("bench.pack_startup: failed to mount the pack");
+        std::filesystem::remove_all(root);
+        return;
+    }
+    timer_.start();
+    for (auto& id : packed_ids) {
+        for (auto ext : exts) {
+            if (fs->exists(id + "." + ext)) {
+                ++found;
+                break;
+            }
+        }
+    }
+    const float pack_resolve_ms = timer_.stop() * 1000.f;
+
+    // Resolve and load through ResourceManager
+    int loaded[4] = { 0 };
+    for (auto& f : loose_files) {
+        benchEvictFileCache(f);
+    }
+    const float loose_cold_ms = benchPackLoadAll<0>(loose_ids, loaded[0]);
+    const float loose_warm_ms = benchPackLoadAll<1>(loose_ids, loaded[1]);
+
+    fs->unmount(pack_path);
+    benchEvictFileCache(pack_path);
+    timer_.start();
+    fs->mount(pack_path);
+    const float remount_ms = timer_.stop() * 1000.f;
+    const float pack_cold_ms = benchPackLoadAll<2>(packed_ids, loaded[2]) + remount_ms;
+    const float pack_warm_ms = benchPackLoadAll<3>(packed_ids, loaded[3]);
+
+    ResourceManager::get()->collectGarbage();
+    fs->unmount(pack_path);
+    std::filesystem::remove_all(root);
+
+    LOG("  resolve: loose " << loose_resolve_ms << " ms, pack " << pack_resolve_ms << " ms + "
+        << mount_ms << " ms mount, " << found << "/" << file_count * 2 << " found");
+    LOG("  load cold: loose " << loose_cold_ms << " ms, pack " << pack_cold_ms << " ms incl. mount, "
+        << loaded[0] << " and " << loaded[2] << " loaded");
+    LOG("  load warm: loose " << loose_warm_ms << " ms, pack " << pack_warm_ms << " ms, "
+        << loaded[1] << " and " << loaded[3] << " loaded");
+    LOG("  " << loose_resolve_ms / (pack_resolve_ms + mount_ms) << "x resolve, "
+        << loose_cold_ms / pack_cold_ms << "x cold, " << loose_warm_ms / pack_warm_ms << "x warm");
+}
@@ -0,0 +1,206 @@
+#include "bench.hpp"
+
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "particle_emitter/particle_instance_pool.hpp"
+
+
+// Gunfire and impacts: every frame a burst of emitter instances is acquired across a few
+// masters, each emits for a couple of frames, gets released, and its particles take a while to
+// run out. Only the simulation's bookkeeping is timed, instances are stand-ins without particle
+// data: acquire, release, walking the active and passive instances of every master, retiring.
+// Runs the std::set based bookkeeping ParticleSimulation used to have, then ptclInstancePool.
+// Counts allocations after warm-up: a node per set insert for the old one, new instances for
+// the pool, whose lists stop growing once they reach the peak instance count
+
+struct BenchStormInstance {
+    PTCL_POOL_LIST pool_list = PTCL_POOL_NONE;
+    int pool_index = -1;
+    int master = 0;
+    bool is_alive = true;
+    int frames_left = 0;
+
+    bool isAlive() const { return is_alive || frames_left > 0; }
+};
+
+struct BenchStormSetSim {
+    struct Pool {
+        std::set<int> free_slots;
+        std::vector<BenchStormInstance*> instances;
+    };
+    std::unordered_map<int, Pool> pools;
+    std::set<BenchStormInstance*> active_instances;
+    std::set<BenchStormInstance*> passive_instances;
+    std::vector<std::unique_ptr<BenchStormInstance>> storage;
+    long long allocations = 0;
+
+    BenchStormInstance* acquire(int master) {
+        auto it = pools.find(master);
+        if (it == pools.end()) {
+            it = pools.insert(std::make_pair(master, Pool())).first;
+        }
+        auto& pool = it->second;
+        if (!pool.free_slots.empty()) {
+            int slot = *pool.free_slots.begin();
+            pool.free_slots.erase(pool.free_slots.begin());
+            active_instances.insert(pool.instances[slot]);
+            ++allocations;
+            pool.instances[slot]->is_alive = true;
+            return pool.instances[slot];
+        }
+        storage.emplace_back(new BenchStormInstance);
+        auto instance = storage.back().get();
+        instance->master = master;
+        pool.instances.push_back(instance);
+        active_instances.insert(instance);
+        allocations += 2;
+        return instance;
+    }
+    void release(BenchStormInstance* inst) {
+        auto& pool = pools[inst->master];
+        for (int i = 0; i < pool.instances.size(); ++i) {
+            if (inst == pool.instances[i]) {
+                active_instances.erase(inst);
+                passive_instances.insert(inst);
+                ++allocations;
+                inst->is_alive = false;
+                break;
+            }
+        }
+    }
+    void update(int particle_frames) {
+        for (auto inst : active_instances) {
+            inst->frames_left = particle_frames;
+        }
+        for (auto inst : passive_instances) {
+            --inst->frames_left;
+        }
+        std::set<BenchStormInstance*> to_remove;
+        for (auto inst : passive_instances) {
+            if (!inst->isAlive()) {
+                to_remove.insert(inst);
+                ++allocations;
+            }
+        }
+        for (auto inst : to_remove) {
+            auto& pool = pools[inst->master];
+            for (int i = 0; i < pool.instances.size(); ++i) {
+                if (inst == pool.instances[i]) {
+                    pool.free_slots.insert(i);
+                    ++allocations;
+                    break;
+                }
+            }
+            passive_instances.erase(inst);
+        }
+    }
+};
+
+struct BenchStormPoolSim {
+    std::vector<ptclInstancePool<BenchStormInstance>> pools;
+    std::unordered_map<int, int> pool_lookup;
+    std::vector<std::unique_ptr<BenchStormInstance>> storage;
+    long long allocations = 0;
+
+    BenchStormInstance* acquire(int master) {
+        auto it = pool_lookup.find(master);
+        if (it == pool_lookup.end()) {
+            it = pool_lookup.insert(std::make_pair(master, (int)pools.size())).first;
+            pools.emplace_back();
+        }
+        auto& pool = pools[it->second];
+        auto instance = pool.reuse();
+        if (!instance) {
+            storage.emplace_back(new BenchStormInstance);
+            instance = storage.back().get();
+            instance->master = master;
+            pool.add(instance);
+            ++allocations;
+        }
+        instance->is_alive = true;
+        return instance;
+    }
+    void release(BenchStormInstance* inst) {
+        if (pools[pool_lookup.find(inst->master)->second].release(inst)) {
+            inst->is_alive = false;
+        }
+    }
+    void update(int particle_frames) {
+        for (auto& pool : pools) {
+            const auto& active = pool.getActive();
+            const auto& passive = pool.getPassive();
+            for (int i = 0; i < active.size(); ++i) {
+                active[i]->frames_left = particle_frames;
+            }
+            for (int i = 0; i < passive.size(); ++i) {
+                --passive[i]->frames_left;
+            }
+            pool.retire([](BenchStormInstance*) {});
+        }
+    }
+};
+
+template<typename SIM_T>
+static float benchRunStorm(SIM_T& sim, int master_count, int spawn_count, int emit_frames, int particle_frames, int warmup_frames, int frame_count, long long& allocations, int& instance_count) {
+    // Bursts still emitting, released emit_frames after they were acquired
+    std::vector<std::vector<BenchStormInstance*>> bursts(emit_frames);
+    for (auto& b : bursts) {
+        b.reserve(spawn_count);
+    }
+    timer timer_;
+    float ms = .0f;
+    for (int f = 0; f < warmup_frames + frame_count; ++f) {
+        if (f == warmup_frames) {
+            allocations = sim.allocations;
+        }
+        auto& burst = bursts[f % emit_frames];
+        timer_.start();
+        for (auto inst : burst) {
+            sim.release(inst);
+        }
+        burst.clear();
+        for (int i = 0; i < spawn_count; ++i) {
+            burst.push_back(sim.acquire((f + i) % master_count));
+        }
+        sim.update(particle_frames);
+        const float frame_ms = timer_.stop() * 1000.f;
+        if (f >= warmup_frames) {
+            ms += frame_ms;
+        }
+    }
+    allocations = sim.allocations - allocations;
+    instance_count = (int)sim.storage.size();
+    return ms / frame_count;
+}
+
+void benchParticleStorm(const ConsoleCommand& cmd) {
+    const int spawn_count = std::max(1, cmd.arg<int>(0, 300));
+    const int frame_count = std::max(1, cmd.arg<int>(1, 600));
+    const int master_count = std::max(1, cmd.arg<int>(2, 8));
+    const int emit_frames = 3;
+    const int particle_frames = 40;
+    const int warmup_frames = emit_frames + particle_frames + 8;
+    LOG("bench.particle_storm: " << spawn_count << " instances spawned per frame over " << master_count << " masters, "
+        << frame_count << " frames, " << emit_frames << " frames emitting, " << particle_frames << " frames of particles after release");
+
+    long long set_allocations = 0;
+    int set_instances = 0;
+    BenchStormSetSim set_sim;
+    const float set_ms = benchRunStorm(set_sim, master_count, spawn_count, emit_frames, particle_frames, warmup_frames, frame_count, set_allocations, set_instances);
+
+    long long pool_allocations = 0;
+    int pool_instances = 0;
+    BenchStormPoolSim pool_sim;
+    const float pool_ms = benchRunStorm(pool_sim, master_count, spawn_count, emit_frames, particle_frames, warmup_frames, frame_count, pool_allocations, pool_instances);
+
+    const float ops = (float)spawn_count * 2.f;
+    LOG("  std::set: " << set_ms << " ms per frame, " << set_ms * 1e6f / ops << " ns per acquire/release incl. update, "
+        << set_allocations / frame_count << " allocations per frame after warm-up, " << set_instances << " instances");
+    LOG("  ptclInstancePool: " << pool_ms << " ms per frame, " << pool_ms * 1e6f / ops << " ns per acquire/release incl. update, "
+        << pool_allocations / frame_count << " allocations per frame after warm-up, " << pool_instances << " instances");
+    LOG("  " << set_ms / pool_ms << "x");
+}
@@ -0,0 +1,198 @@
+#include "bench.hpp"
+
+#include <random>
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "util/thread_pool.hpp"
+#include "particle_emitter/particle_kernels.hpp"
+#include "particle_emitter/particle_impl.hpp"
+
+
+// One big world space emitter, the size and color curves of the test game's emitters.
+// Runs the per particle part of ptclUpdate() the way it was before the kernels (curve::at()
+// per particle, euler_to_quat(), velocity from positions in a second loop), then the kernels
+// on one thread and split over the pool in PTCL_PARALLEL_JOB_SIZE jobs like ptclUpdate() does.
+// Lifetimes wrap around instead of recycling so every run keeps the same particles in the same
+// slots and the end results can be compared. A quarter of the particles spin around all three axes
+
+struct BenchParticles {
+    std::vector<ptclParticleData::Particle> states;
+    std::vector<gfxm::vec4> positions;
+    std::vector<gfxm::vec4> prev_positions;
+    std::vector<gfxm::vec4> scale;
+    std::vector<gfxm::vec4> colors;
+    std::vector<gfxm::quat> rotation;
+
+    ptclKernelStreams streams() {
+        ptclKernelStreams s;
+        s.states = states.data();
+        s.positions = positions.data();
+        s.prev_positions = prev_positions.data();
+        s.scale = scale.data();
+        s.colors = colors.data();
+        s.rotation = rotation.data();
+        return s;
+    }
+    // Not timed, same for every run
+    void endFrame(float dt, float max_lifetime) {
+        for (int i = 0; i < scale.size(); ++i) {
+            float& lifetime = scale[i].w;
+            lifetime += dt;
+            if (lifetime > max_lifetime) {
+                lifetime -= max_lifetime;
+            }
+        }
+        prev_positions = positions;
+    }
+};
+
+static void benchParticlesReference(BenchParticles& pt, const ParticleEmitterParams& params, float dt) {
+    const auto& scale_curve = params.scale_curve;
+    const auto& rgba_curve = params.rgba_curve;
+    const float max_lifetime = params.max_lifetime;
+    for (int i = 0; i < pt.positions.size(); ++i) {
+        float& lifetime = pt.scale[i].w;
+        float size = scale_curve.at(lifetime / max_lifetime);
+
+        gfxm::vec3 pos = pt.positions[i];
+        gfxm::vec3& velocity = pt.states[i].velocity;
+        pos += velocity * dt;
+        velocity += params.gravity * dt;
+        gfxm::vec3 velo_N = gfxm::normalize(velocity);
+        float d = gfxm::dot(velocity, velo_N);
+        if (d > params.terminal_velocity) {
+            velocity *= params.terminal_velocity / d;
+        }
+        pt.positions[i] = gfxm::vec4(pos, size);
+        pt.rotation[i] = gfxm::euler_to_quat(pt.states[i].ang_velocity * dt) * pt.rotation[i];
+        pt.colors[i] = rgba_curve.at(lifetime / max_lifetime);
+    }
+    for (int i = 0; i < pt.positions.size(); ++i) {
+        pt.states[i].velocity = gfxm::vec3(pt.positions[i]) - gfxm::vec3(pt.prev_positions[i]);
+    }
+}
+
+void benchParticles(const ConsoleCommand& cmd) {
+    const int particle_count = std::max(1, cmd.arg<int>(0, 100000));
+    const int frame_count = std::max(1, cmd.arg<int>(1, 120));
+    const int thread_count = std::max(1, cmd.arg<int>(2, 4));
+    const float dt = 1.f / 60.f;
+    LOG("bench.particles: " << particle_count << " particles, " << frame_count << " frames, " << thread_count << " threads");
+
+    ParticleEmitterParams params;
+    params.max_lifetime = 2.f;
+    params.gravity = gfxm::vec3(0, -9.8f, 0);
+    params.rgba_curve[.0f] = gfxm::vec4(1, .1f, 1, 0);
+    params.rgba_curve[.30f] = gfxm::vec4(1, .1f, 1, 1);
+    params.rgba_curve[.85f] = gfxm::vec4(1, 1, .0f, 1);
+    params.rgba_curve[1.f] = gfxm::vec4(1, 1, 0, 0);
+    params.scale_curve[.0f] = .0f;
+    params.scale_curve[.1f] = .25f;
+    params.scale_curve[.7f] = .2f;
+    params.scale_curve[1.f] = .0f;
+    ptclEmitterCurveLuts luts;
+    luts.update(params);
+
+    BenchParticles initial;
+    {
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> unit_dist(-1.f, 1.f);
+        std::uniform_real_distribution<float> u01(.0f, 1.f);
+        initial.states.resize(particle_count);
+        initial.positions.resize(particle_count);
+        initial.scale.resize(particle_count);
+        initial.colors.resize(particle_count);
+        initial.rotation.resize(particle_count);
+        for (int i = 0; i < particle_count; ++i) {
+            auto& st = initial.states[i];
+            st.identifier = i + 1;
+            st.velocity = gfxm::vec3(unit_dist(rng), u01(rng) * 4.f, unit_dist(rng));
+            st.ang_velocity = gfxm::vec3(0, 0, unit_dist(rng) * 5.f);
+            if (i % 4 == 0) {
+                st.ang_velocity = gfxm::vec3(unit_dist(rng), unit_dist(rng), unit_dist(rng)) * 5.f;
+            }
+            initial.positions[i] = gfxm::vec4(unit_dist(rng) * 10.f, u01(rng) * 10.f, unit_dist(rng) * 10.f, .0f);
+            initial.scale[i] = gfxm::vec4(1.f, 1.f, 1.f, u01(rng) * params.max_lifetime);
+            initial.rotation[i] = gfxm::angle_axis(gfxm::pi * u01(rng) * 2.f, gfxm::vec3(0, 0, 1));
+        }
+        initial.prev_positions = initial.positions;
+    }
+
+    ptclKernelParams kernel_params;
+    kernel_params.dt = dt;
+    kernel_params.inv_max_lifetime = 1.f / params.max_lifetime;
+    kernel_params.gravity = params.gravity;
+    kernel_params.terminal_velocity = params.terminal_velocity;
+    kernel_params.scale_lut = &luts.scale;
+    kernel_params.rgba_lut = &luts.rgba;
+
+    timer timer_;
+    BenchParticles reference = initial;
+    float reference_ms = .0f;
+    for (int f = 0; f < frame_count; ++f) {
+        timer_.start();
+        benchParticlesReference(reference, params, dt);
+        reference_ms += timer_.stop() * 1000.f;
+        reference.endFrame(dt, params.max_lifetime);
+    }
+
+    BenchParticles single = initial;
+    const ptclKernelStreams single_streams = single.streams();
+    float single_ms = .0f;
+    for (int f = 0; f < frame_count; ++f) {
+        timer_.start();
+        ptclKernelUpdate(kernel_params, single_streams, 0, particle_count);
+        single_ms += timer_.stop() * 1000.f;
+        single.endFrame(dt, params.max_lifetime);
+    }
+
+    ThreadPool pool(thread_count);
+    BenchParticles pooled = initial;
+    const ptclKernelStreams pooled_streams = pooled.streams();
+    const int job_count = (particle_count + PTCL_PARALLEL_JOB_SIZE - 1) / PTCL_PARALLEL_JOB_SIZE;
+    float pooled_ms = .0f;
+    for (int f = 0; f < frame_count; ++f) {
+        timer_.start();
+        pool.run(job_count, [&](int job) {
+            const int first = job * PTCL_PARALLEL_JOB_SIZE;
+            ptclKernelUpdate(kernel_params, pooled_streams, first, std::min(PTCL_PARALLEL_JOB_SIZE, particle_count - first));
+        });
+        pooled_ms += timer_.stop() * 1000.f;
+        pooled.endFrame(dt, params.max_lifetime);
+    }
+
+    auto compare = [&reference](const char* name, const BenchParticles& pt) {
+        float max_pos = .0f;
+        float max_size = .0f;
+        float max_color = .0f;
+        float max_velocity = .0f;
+        float max_rotation = .0f;
+        for (int i = 0; i < pt.positions.size(); ++i) {
+            const gfxm::vec4 dp = pt.positions[i] - reference.positions[i];
+            max_pos = std::max(max_pos, gfxm::length(gfxm::vec3(dp)));
+            max_size = std::max(max_size, fabsf(dp.w));
+            max_color = std::max(max_color, gfxm::length(pt.colors[i] - reference.colors[i]));
+            max_velocity = std::max(max_velocity, gfxm::length(pt.states[i].velocity - reference.states[i].velocity));
+            const gfxm::quat& a = pt.rotation[i];
+            const gfxm::quat& b = reference.rotation[i];
+            // q and -q are the same rotation
+            const float sign = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w < .0f ? -1.f : 1.f;
+            max_rotation = std::max(max_rotation, fabsf(a.x - b.x * sign));
+            max_rotation = std::max(max_rotation, fabsf(a.y - b.y * sign));
+            max_rotation = std::max(max_rotation, fabsf(a.z - b.z * sign));
+            max_rotation = std::max(max_rotation, fabsf(a.w - b.w * sign));
+        }
+        LOG("  " << name << " max difference: position " << max_pos << ", size " << max_size
+            << ", color " << max_color << ", velocity " << max_velocity
+            << ", rotation quat component " << max_rotation);
+    };
+
+    LOG("  curve::at() loop: " << reference_ms / frame_count << " ms per frame");
+    LOG("  kernels, 1 thread: " << single_ms / frame_count << " ms per frame, "
+        << reference_ms / single_ms << "x");
+    LOG("  kernels, " << thread_count << " threads: " << pooled_ms / frame_count << " ms per frame, "
+        << reference_ms / pooled_ms << "x");
+    compare("1 thread", single);
+    compare("pool", pooled);
+}
@@ -0,0 +1,128 @@
+#include "bench.hpp"
+
+#include <vector>
+#include <memory>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "collision/collision_world.hpp"
+#include "collision/shape/box.hpp"
+#include "collision/shape/capsule.hpp"
+
+
+// Tall columns of boxes on a static box floor with a capsule lying across the top of each column,
+// run once with SAT box contacts and once through GJK/EPA.
+// Throughput is step and narrowphase time, stability is how far the top boxes drifted
+// from where they started and how many bodies managed to fall asleep
+
+struct BenchBoxStackScene {
+    std::unique_ptr<phyWorld> world;
+    phyBoxShape floor_shape;
+    phyRigidBody floor;
+    phyBoxShape box_shape;
+    phyCapsuleShape capsule_shape;
+    std::vector<phyRigidBody> bodies;
+    std::vector<int> top_boxes;
+    std::vector<gfxm::vec3> top_start;
+};
+
+static void benchMakeBoxStackScene(BenchBoxStackScene& scene, int column_count, int stack_height, bool sat) {
+    scene.world.reset(new phyWorld);
+    scene.world->enableSatBoxContacts(sat);
+    scene.box_shape.half_extents = gfxm::vec3(.5f, .5f, .5f);
+    scene.capsule_shape.radius = .2f;
+    scene.capsule_shape.height = .6f;
+
+    const int side = std::max(1, (int)ceilf(sqrtf((float)column_count)));
+    const float spacing = 2.f;
+    const float extent = side * spacing;
+
+    scene.floor_shape.half_extents = gfxm::vec3(extent * .5f, .5f, extent * .5f);
+    scene.floor.setShape(&scene.floor_shape);
+    scene.floor.setPosition(gfxm::vec3(extent * .5f, -.5f, extent * .5f));
+    scene.floor.mass = .0f;
+    scene.world->addCollider(&scene.floor);
+
+    // Bodies hold pointers into the vector, must not reallocate after this
+    scene.bodies = std::vector<phyRigidBody>(column_count * (stack_height + 1));
+    scene.top_boxes.clear();
+    scene.top_start.clear();
+    int n = 0;
+    for (int c = 0; c < column_count; ++c) {
+        const float x = (c % side + .5f) * spacing;
+        const float z = (c / side + .5f) * spacing;
+        for (int level = 0; level < stack_height; ++level) {
+            auto& body = scene.bodies[n++];
+            body.setShape(&scene.box_shape);
+            body.setPosition(gfxm::vec3(x, .5f + level * 1.f, z));
+            body.mass = 1.f;
+            body.friction = .6f;
+            scene.world->addCollider(&body);
+            body.wakeUp();
+        }
+        scene.top_boxes.push_back(n - 1);
+        scene.top_start.push_back(scene.bodies[n - 1].getPosition());
+
+        auto& capsule = scene.bodies[n++];
+        capsule.setShape(&scene.capsule_shape);
+        capsule.setPosition(gfxm::vec3(x, stack_height * 1.f + .2f, z));
+        capsule.setRotation(gfxm::angle_axis(gfxm::pi * .5f, gfxm::vec3(0, 0, 1)));
+        capsule.mass = .5f;
+        capsule.friction = .6f;
+        scene.world->addCollider(&capsule);
+        capsule.wakeUp();
+    }
+}
+
+static void benchBoxStackRun(int column_count, int stack_height, int step_count, bool sat) {
+    const float dt = 1.f / 60.f;
+    BenchBoxStackScene scene;
+    benchMakeBoxStackScene(scene, column_count, stack_height, sat);
+
+    timer timer_;
+    float step_time = .0f;
+    float narrowphase_time = .0f;
+    int contact_count = 0;
+    for (int i = 0; i < step_count; ++i) {
+        timer_.start();
+        scene.world->updateInternal(dt);
+        step_time += timer_.stop();
+        narrowphase_time += scene.world->getNarrowphaseTime();
+        contact_count += scene.world->getSolverContactCount();
+    }
+
+    // Sideways drift is the box sliding or the column leaning, sinking is the stack compressing
+    float max_drift = .0f;
+    float mean_drift = .0f;
+    float mean_sink = .0f;
+    int toppled = 0;
+    for (int i = 0; i < scene.top_boxes.size(); ++i) {
+        const gfxm::vec3 d = scene.bodies[scene.top_boxes[i]].getPosition() - scene.top_start[i];
+        const float drift = gfxm::vec2(d.x, d.z).length();
+        max_drift = std::max(max_drift, drift);
+        mean_drift += drift;
+        mean_sink -= d.y;
+        if (drift > .5f || d.y < -.5f) {
+            ++toppled;
+        }
+    }
+    mean_drift /= std::max(1, (int)scene.top_boxes.size());
+    mean_sink /= std::max(1, (int)scene.top_boxes.size());
+
+    const phyIslandStats& stats = scene.world->getIslandStats();
+    LOG("  " << (sat ? "sat    " : "gjk/epa") << ": " << step_time * 1000.f / step_count << " ms/step, narrowphase "
+        << narrowphase_time * 1000.f / step_count << " ms/step, " << contact_count / step_count << " contacts/step");
+    LOG("           top box drift mean " << mean_drift * 1000.f << " mm, max " << max_drift * 1000.f << " mm, sank "
+        << mean_sink * 1000.f << " mm, "
+        << toppled << " columns toppled, " << stats.sleeping_body_count << " of " << scene.bodies.size() << " bodies asleep");
+}
+
+void benchPhyBoxStack(const ConsoleCommand& cmd) {
+    const int column_count = std::max(1, cmd.arg<int>(0, 64));
+    const int stack_height = std::max(1, cmd.arg<int>(1, 10));
+    const int step_count = std::max(1, cmd.arg<int>(2, 600));
+
+    LOG("bench.phy_box_stack: " << column_count << " columns of " << stack_height << " boxes with a capsule on top, "
+        << step_count << " steps");
+    benchBoxStackRun(column_count, stack_height, step_count, true);
+    benchBoxStackRun(column_count, stack_height, step_count, false);
+}
@@ -0,0 +1,186 @@
+#include "bench.hpp"
+
+#include <random>
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "collision/collider.hpp"
+#include "collision/aabb_tree/aabb_tree.hpp"
+#include "collision/aabb_tree/aabb_tree_flat.hpp"
+
+
+// Reproduces the phyWorld broadphase workload outside of the world:
+// moving bodies get their bounds updated in the tree,
+// then every moved body is queried against the tree for overlapping pairs
+
+struct BenchBroadphaseScene {
+    std::vector<phyRigidBody> bodies;
+    std::vector<gfxm::aabb> aabbs;
+    std::vector<gfxm::vec3> velocities;
+    std::vector<phyRigidBody*> dirty;
+    std::vector<uint8_t> is_dirty;
+
+    int indexOf(const phyRigidBody* b) const {
+        return int(b - bodies.data());
+    }
+};
+
+static void benchMakeScene(BenchBroadphaseScene& scene, int body_count, unsigned seed) {
+    std::mt19937 rng(seed);
+    // Keep density constant between body counts
+    const float extent = cbrtf(float(body_count)) * 4.f;
+    std::uniform_real_distribution<float> pos_dist(.0f, extent);
+    std::uniform_real_distribution<float> size_dist(.25f, .75f);
+    std::uniform_real_distribution<float> vel_dist(-2.f, 2.f);
+
+    scene.bodies = std::vector<phyRigidBody>(body_count);
+    scene.aabbs.resize(body_count);
+    scene.velocities.resize(body_count);
+    scene.is_dirty.resize(body_count);
+    for (int i = 0; i < body_count; ++i) {
+        gfxm::vec3 p(pos_dist(rng), pos_dist(rng), pos_dist(rng));
+        float hs = size_dist(rng);
+        scene.aabbs[i] = gfxm::aabb(p - gfxm::vec3(hs, hs, hs), p + gfxm::vec3(hs, hs, hs));
+        scene.velocities[i] = gfxm::vec3(vel_dist(rng), vel_dist(rng), vel_dist(rng));
+    }
+}
+
+static void benchMoveBodies(BenchBroadphaseScene& scene, int step, int moving_percent, float dt) {
+    scene.dirty.clear();
+    for (int i = 0; i < scene.bodies.size(); ++i) {
+        // Deterministic subset of moving bodies, changes every step
+        bool moving = ((i * 7 + step * 13) % 100) < moving_percent;
+        scene.is_dirty[i] = moving;
+        if (!moving) {
+            continue;
+        }
+        gfxm::vec3 d = scene.velocities[i] * dt;
+        scene.aabbs[i].from += d;
+        scene.aabbs[i].to += d;
+        scene.dirty.push_back(&scene.bodies[i]);
+    }
+}
+
+struct BenchBroadphaseResult {
+    float update_time = .0f;
+    float query_time = .0f;
+    size_t pair_count = 0;
+};
+
+static BenchBroadphaseResult benchRunPointerTree(BenchBroadphaseScene& scene, int step_count, int moving_percent, float dt) {
+    BenchBroadphaseResult result;
+    std::vector<AabbTreeElement> elems(scene.bodies.size());
+    AabbTree tree;
+    for (int i = 0; i < scene.bodies.size(); ++i) {
+        elems[i].collider = &scene.bodies[i];
+        elems[i].aabb = scene.aabbs[i];
+        tree.add(&elems[i]);
+    }
+
+    timer timer_;
+    for (int step = 0; step < step_count; ++step) {
+        benchMoveBodies(scene, step, moving_percent, dt);
+
+        timer_.start();
+        for (int i = 0; i < scene.dirty.size(); ++i) {
+            int idx = scene.indexOf(scene.dirty[i]);
+            elems[idx].aabb = scene.aabbs[idx];
+            tree.remove(&elems[idx]);
+            tree.add(&elems[idx]);
+        }
+        tree.update();
+        result.update_time += timer_.stop();
+
+        timer_.start();
+        for (int i = 0; i < scene.dirty.size(); ++i) {
+            phyRigidBody* a = scene.dirty[i];
+            gfxm::aabb box = gfxm::aabb_grow(scene.aabbs[scene.indexOf(a)], .01f);
+            tree.forEachOverlap(box, [&scene, &result, a](phyRigidBody* b) {
+                if (a == b) {
+                    return;
+                }
+                if (scene.is_dirty[scene.indexOf(b)] && a > b) {
+                    return;
+                }
+                ++result.pair_count;
+            });
+        }
+        result.query_time += timer_.stop();
+    }
+
+    for (int i = 0; i < elems.size(); ++i) {
+        tree.remove(&elems[i]);
+    }
+    return result;
+}
+
+static BenchBroadphaseResult benchRunFlatTree(BenchBroadphaseScene& scene, int step_count, int moving_percent, float dt) {
+    BenchBroadphaseResult result;
+    std::vector<uint32_t> proxies(scene.bodies.size());
+    AabbTreeFlat tree((int)scene.bodies.size() * 2);
+    for (int i = 0; i < scene.bodies.size(); ++i) {
+        proxies[i] = tree.createProxy(scene.aabbs[i], &scene.bodies[i]);
+    }
+
+    timer timer_;
+    for (int step = 0; step < step_count; ++step) {
+        benchMoveBodies(scene, step, moving_percent, dt);
+
+        timer_.start();
+        for (int i = 0; i < scene.dirty.size(); ++i) {
+            int idx = scene.indexOf(scene.dirty[i]);
+            tree.moveProxy(proxies[idx], scene.aabbs[idx], scene.velocities[idx] * dt);
+        }
+        result.update_time += timer_.stop();
+
+        timer_.start();
+        tree.findPairs(
+            scene.dirty.data(), (int)scene.dirty.size(), .01f,
+            [&scene](phyRigidBody* c)->const gfxm::aabb& {
+                return scene.aabbs[scene.indexOf(c)];
+            },
+            [&scene, &result](phyRigidBody* a, phyRigidBody* b) {
+                if (scene.is_dirty[scene.indexOf(b)] && a > b) {
+                    return;
+                }
+                ++result.pair_count;
+            }
+        );
+        result.query_time += timer_.stop();
+    }
+
+    LOG("    flat tree: height " << tree.getHeight() << ", area ratio " << tree.getAreaRatio());
+    return result;
+}
+
+void benchPhyBroadphase(const ConsoleCommand& cmd) {
+    const int step_count = cmd.arg<int>(0, 120);
+    const int moving_percent = std::clamp(cmd.arg<int>(1, 100), 1, 100);
+    const float dt = 1.f / 60.f;
+    const int body_counts[] = { 1000, 5000, 20000 };
+
+    LOG("bench.phy_broadphase: " << step_count << " steps, " << moving_percent << "% of bodies moving");
+    for (int body_count : body_counts) {
+        BenchBroadphaseScene scene;
+
+        benchMakeScene(scene, body_count, 1337);
+        BenchBroadphaseResult old_result = benchRunPointerTree(scene, step_count, moving_percent, dt);
+
+        benchMakeScene(scene, body_count, 1337);
+        BenchBroadphaseResult new_result = benchRunFlatTree(scene, step_count, moving_percent, dt);
+
+        float old_ms = (old_result.update_time + old_result.query_time) * 1000.f / step_count;
+        float new_ms = (new_result.update_time + new_result.query_time) * 1000.f / step_count;
+        LOG("  " << body_count << " bodies:");
+        LOG("    AabbTree:     " << old_ms << " ms/step (update "
+            << old_result.update_time * 1000.f / step_count << ", query "
+            << old_result.query_time * 1000.f / step_count << "), pairs " << old_result.pair_count);
+        LOG("    AabbTreeFlat: " << new_ms << " ms/step (update "
+            << new_result.update_time * 1000.f / step_count << ", query "
+            << new_result.query_time * 1000.f / step_count << "), pairs " << new_result.pair_count);
+        LOG("    speedup: " << (new_ms > .0f ? old_ms / new_ms : .0f) << "x");
+        if (old_result.pair_count != new_result.pair_count) {
+            LOG_WARN("    pair count mismatch between trees");
+        }
+    }
+}
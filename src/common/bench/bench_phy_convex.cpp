@@ -0,0 +1,219 @@
+#include "bench.hpp"
+
+#include <float.h>
+#include <random>
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "collision/intersection/gjkepa/gjkepa.hpp"
+#include "collision/intersection/gjkepa/gjk_convex_mesh.hpp"
+#include "collision/shape/convex_mesh.hpp"
+
+
+// Support queries and GJK/EPA between convex hulls of about 64 and 256 vertices (squashed uv spheres).
+// Queries go through the old path, a full inverse of the transform and a scalar scan over every vertex,
+// against the linear simd scan and hill climbing over the hull's vertex adjacency.
+// Coherent directions turn a little between queries like GJK and EPA iterations do, random ones don't.
+// Narrowphase runs GJKEPA_T over overlapping pairs with random rotations through both support getters
+
+struct BENCH_OLD_CONVEX_TAG {};
+
+template<>
+class GJKEPA_SupportGetter<BENCH_OLD_CONVEX_TAG> {
+    gfxm::mat4 transform;
+    const phyConvexMesh* mesh;
+public:
+    GJKEPA_SupportGetter(const gfxm::mat4& transform, const phyConvexMesh* mesh)
+        : transform(transform), mesh(mesh) {}
+
+    gfxm::vec3 getPosition() const { return transform[3]; }
+
+    gfxm::vec3 operator()(const gfxm::vec3& dir) const {
+        gfxm::vec3 lcl_dir = gfxm::inverse(transform) * gfxm::vec4(dir, .0f);
+        float max_d = -FLT_MAX;
+        int vid = 0;
+        for (int i = 0; i < mesh->vertexCount(); ++i) {
+            float d = gfxm::dot(lcl_dir, mesh->getVertexData()[i]);
+            if (d > max_d) {
+                vid = i;
+                max_d = d;
+            }
+        }
+        return transform * gfxm::vec4(mesh->getVertexData()[vid], 1.f);
+    }
+};
+
+static void benchMakeHull(phyConvexMesh& mesh, int rings, int segments) {
+    std::vector<gfxm::vec3> vertices;
+    std::vector<int> indices;
+    const gfxm::vec3 scale(.6f, .4f, .5f);
+    vertices.push_back(gfxm::vec3(0, scale.y, 0));
+    for (int r = 0; r < rings; ++r) {
+        const float phi = gfxm::pi * (r + 1) / (rings + 1);
+        for (int s = 0; s < segments; ++s) {
+            const float theta = 2.f * gfxm::pi * s / segments;
+            vertices.push_back(gfxm::vec3(
+                sinf(phi) * cosf(theta) * scale.x,
+                cosf(phi) * scale.y,
+                sinf(phi) * sinf(theta) * scale.z
+            ));
+        }
+    }
+    vertices.push_back(gfxm::vec3(0, -scale.y, 0));
+    const int bottom = (int)vertices.size() - 1;
+
+    auto ring_vertex = [segments](int r, int s) {
+        return 1 + r * segments + (s % segments);
+    };
+    for (int s = 0; s < segments; ++s) {
+        indices.insert(indices.end(), { 0, ring_vertex(0, s + 1), ring_vertex(0, s) });
+        indices.insert(indices.end(), { bottom, ring_vertex(rings - 1, s), ring_vertex(rings - 1, s + 1) });
+    }
+    for (int r = 0; r < rings - 1; ++r) {
+        for (int s = 0; s < segments; ++s) {
+            const int a = ring_vertex(r, s);
+            const int b = ring_vertex(r, s + 1);
+            const int c = ring_vertex(r + 1, s);
+            const int d = ring_vertex(r + 1, s + 1);
+            indices.insert(indices.end(), { a, b, c });
+            indices.insert(indices.end(), { b, d, c });
+        }
+    }
+    mesh.setData(vertices.data(), (int)vertices.size(), indices.data(), (int)indices.size());
+}
+
+static gfxm::quat benchRandomRotation(std::mt19937& rng) {
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+    gfxm::vec3 axis(dist(rng), dist(rng), dist(rng));
+    if (axis.length2() < 1e-6f) {
+        axis = gfxm::vec3(0, 1, 0);
+    }
+    return gfxm::angle_axis(dist(rng) * gfxm::pi, gfxm::normalize(axis));
+}
+
+static void benchConvexHull(int rings, int segments, int query_count, int pair_count) {
+    phyConvexMesh mesh;
+    benchMakeHull(mesh, rings, segments);
+    phyConvexMeshShape shape;
+    shape.setMesh(&mesh);
+
+    std::mt19937 rng(4242);
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+    const gfxm::mat4 transform = gfxm::translate(gfxm::mat4(1.f), gfxm::vec3(1, 2, 3)) * gfxm::to_mat4(benchRandomRotation(rng));
+
+    std::vector<gfxm::vec3> random_dirs(query_count);
+    std::vector<gfxm::vec3> coherent_dirs(query_count);
+    gfxm::vec3 walk(1, 0, 0);
+    for (int i = 0; i < query_count; ++i) {
+        random_dirs[i] = gfxm::vec3(dist(rng), dist(rng), dist(rng));
+        walk = gfxm::normalize(walk + gfxm::vec3(dist(rng), dist(rng), dist(rng)) * .15f);
+        coherent_dirs[i] = walk;
+    }
+
+    timer timer_;
+    gfxm::vec3 sink;
+    int mismatches = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        const auto& dirs = pass == 0 ? coherent_dirs : random_dirs;
+
+        GJKEPA_SupportGetter<BENCH_OLD_CONVEX_TAG> old_support(transform, &mesh);
+        timer_.start();
+        for (auto& d : dirs) {
+            sink += old_support(d);
+        }
+        const float old_ms = timer_.stop() * 1000.f;
+
+        const gfxm::mat3 inverse_rotation = gfxm::transpose(gfxm::to_mat3(transform));
+        timer_.start();
+        for (auto& d : dirs) {
+            sink += gfxm::vec3(transform * gfxm::vec4(mesh.getVertexData()[mesh.findSupportVertexLinear(inverse_rotation * d)], 1.f));
+        }
+        const float linear_ms = timer_.stop() * 1000.f;
+
+        GJKEPA_SupportGetter<phyConvexMeshShape> new_support(transform, &shape);
+        timer_.start();
+        for (auto& d : dirs) {
+            sink += new_support(d);
+        }
+        const float climb_ms = timer_.stop() * 1000.f;
+
+        for (auto& d : dirs) {
+            const float a = gfxm::dot(old_support(d), d);
+            const float b = gfxm::dot(new_support(d), d);
+            if (fabsf(a - b) > 1e-4f) {
+                ++mismatches;
+            }
+        }
+
+        LOG("    " << (pass == 0 ? "coherent" : "random  ") << " queries, M/s: old "
+            << query_count / old_ms / 1000.f << ", linear simd " << query_count / linear_ms / 1000.f
+            << ", hill climb " << query_count / climb_ms / 1000.f
+            << ", " << old_ms / climb_ms << "x");
+    }
+
+    // Centers up to a hull width apart, most pairs overlap
+    std::vector<gfxm::mat4> transforms_a(pair_count);
+    std::vector<gfxm::mat4> transforms_b(pair_count);
+    for (int i = 0; i < pair_count; ++i) {
+        transforms_a[i] = gfxm::to_mat4(benchRandomRotation(rng));
+        transforms_b[i] = gfxm::translate(gfxm::mat4(1.f), gfxm::vec3(dist(rng), dist(rng), dist(rng)) * .7f)
+            * gfxm::to_mat4(benchRandomRotation(rng));
+    }
+
+    EPA_Context epa_ctx;
+    int old_hits = 0;
+    float old_depth = .0f;
+    timer_.start();
+    for (int i = 0; i < pair_count; ++i) {
+        GJK_Simplex simplex;
+        EPA_Result result;
+        if (GJKEPA_T(
+            GJKEPA_SupportGetter<BENCH_OLD_CONVEX_TAG>(transforms_a[i], &mesh),
+            GJKEPA_SupportGetter<BENCH_OLD_CONVEX_TAG>(transforms_b[i], &mesh),
+            simplex, epa_ctx, result
+        )) {
+            ++old_hits;
+            old_depth += result.depth;
+        }
+    }
+    const float old_ms = timer_.stop() * 1000.f;
+
+    int new_hits = 0;
+    float new_depth = .0f;
+    timer_.start();
+    for (int i = 0; i < pair_count; ++i) {
+        GJK_Simplex simplex;
+        EPA_Result result;
+        if (GJKEPA_T(
+            GJKEPA_SupportGetter<phyConvexMeshShape>(transforms_a[i], &shape),
+            GJKEPA_SupportGetter<phyConvexMeshShape>(transforms_b[i], &shape),
+            simplex, epa_ctx, result
+        )) {
+            ++new_hits;
+            new_depth += result.depth;
+        }
+    }
+    const float new_ms = timer_.stop() * 1000.f;
+
+    LOG("    gjk/epa, pairs/ms: old " << pair_count / old_ms << ", new " << pair_count / new_ms
+        << ", " << old_ms / new_ms << "x, hits " << old_hits << " and " << new_hits
+        << ", mean depth " << old_depth / std::max(1, old_hits) << " and " << new_depth / std::max(1, new_hits));
+    if (mismatches || old_hits != new_hits) {
+        LOG_WARN("    " << mismatches << " support queries differ from the linear scan");
+    }
+    if (sink.x == 12345.f) {
+        LOG("");
+    }
+}
+
+void benchPhyConvex(const ConsoleCommand& cmd) {
+    const int query_count = std::max(1, cmd.arg<int>(0, 1000000));
+    const int pair_count = std::max(1, cmd.arg<int>(1, 20000));
+
+    LOG("bench.phy_convex: " << query_count << " support queries, " << pair_count << " pairs");
+    const int hulls[][2] = { { 6, 10 }, { 14, 18 } };
+    for (auto& h : hulls) {
+        LOG("  " << h[0] * h[1] + 2 << " vertices:");
+        benchConvexHull(h[0], h[1], query_count, pair_count);
+    }
+}
@@ -0,0 +1,288 @@
+#include "bench.hpp"
+
+#include <float.h>
+#include <random>
+#include <vector>
+#include <memory>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "collision/collision_world.hpp"
+#include "collision/shape/capsule.hpp"
+#include "collision/shape/heightfield.hpp"
+#include "collision/intersection/sphere_capsule.hpp"
+
+
+// Capsules walking across a large heightfield with rolling hills and flat valleys.
+// Steps the world with the walkers pushed along every frame, then compares the cell culling
+// against a scalar loop over the same cells, and sphere sweeps through the quadtree against
+// the old sweep that tested every cell under the sweep's bounding box
+
+static void benchMakeTerrain(std::vector<float>& samples, int sample_count) {
+    samples.resize(sample_count * sample_count);
+    for (int z = 0; z < sample_count; ++z) {
+        for (int x = 0; x < sample_count; ++x) {
+            const float hills = 12.f * sinf(x * .011f) * cosf(z * .013f) + 3.f * sinf(x * .07f + z * .05f);
+            // Negative half is clamped off, leaves wide flat valleys the quadtree can skip
+            samples[x + z * sample_count] = gfxm::_max(.0f, hills);
+        }
+    }
+}
+
+static int benchFindCellsScalar(const phyHeightfieldShape& hf, const gfxm::aabb& box, int* out_cells, int max_count) {
+    const int cells_x = hf.getCellCountX();
+    const int cells_z = hf.getCellCountZ();
+    const int sample_count_x = hf.getSampleCountX();
+    const float* samples = hf.getData();
+    const int x0 = std::max(0, (int)floorf(box.from.x / hf.getCellWidth()));
+    const int x1 = std::min(cells_x, (int)floorf(box.to.x / hf.getCellWidth()) + 1);
+    const int z0 = std::max(0, (int)floorf(box.from.z / hf.getCellDepth()));
+    const int z1 = std::min(cells_z, (int)floorf(box.to.z / hf.getCellDepth()) + 1);
+    int count = 0;
+    for (int z = z0; z < z1; ++z) {
+        for (int x = x0; x < x1; ++x) {
+            const float h0 = samples[x + z * sample_count_x];
+            const float h1 = samples[x + (z + 1) * sample_count_x];
+            const float h2 = samples[x + 1 + (z + 1) * sample_count_x];
+            const float h3 = samples[x + 1 + z * sample_count_x];
+            const float hmin = gfxm::_min(gfxm::_min(h0, h1), gfxm::_min(h2, h3));
+            const float hmax = gfxm::_max(gfxm::_max(h0, h1), gfxm::_max(h2, h3));
+            if (hmin > box.to.y || hmax < box.from.y) {
+                continue;
+            }
+            if (count < max_count) {
+                out_cells[count] = x + z * cells_x;
+            }
+            ++count;
+        }
+    }
+    return count;
+}
+
+// The sweep as it was before the quadtree, every cell under the sweep's bounding box
+static bool benchSweepSphereBrute(const phyHeightfieldShape& hf, const gfxm::vec3& from, const gfxm::vec3& to, float radius, SweepContactPoint& scp) {
+    gfxm::aabb box;
+    box.from = gfxm::vec3(
+        gfxm::_min(from.x, to.x) - radius, gfxm::_min(from.y, to.y) - radius, gfxm::_min(from.z, to.z) - radius
+    );
+    box.to = gfxm::vec3(
+        gfxm::_max(from.x, to.x) + radius, gfxm::_max(from.y, to.y) + radius, gfxm::_max(from.z, to.z) + radius
+    );
+    const int cells_x = hf.getCellCountX();
+    const int x0 = std::max(0, (int)floorf(box.from.x / hf.getCellWidth()));
+    const int x1 = std::min(cells_x, (int)floorf(box.to.x / hf.getCellWidth()) + 1);
+    const int z0 = std::max(0, (int)floorf(box.from.z / hf.getCellDepth()));
+    const int z1 = std::min(hf.getCellCountZ(), (int)floorf(box.to.z / hf.getCellDepth()) + 1);
+
+    float min_distance = gfxm::length(to - from);
+    bool has_hit = false;
+    for (int z = z0; z < z1; ++z) {
+        for (int x = x0; x < x1; ++x) {
+            gfxm::vec3 p[4];
+            hf.getCellCorners(x, z, p);
+            const float hmin = gfxm::_min(gfxm::_min(p[0].y, p[1].y), gfxm::_min(p[2].y, p[3].y));
+            const float hmax = gfxm::_max(gfxm::_max(p[0].y, p[1].y), gfxm::_max(p[2].y, p[3].y));
+            if (hmin > box.to.y || hmax < box.from.y) {
+                continue;
+            }
+            SweepContactPoint hit;
+            if (intersectionSweepSphereTriangle(from, to, radius, p[0], p[1], p[2], hit) && hit.distance_traveled < min_distance) {
+                min_distance = hit.distance_traveled;
+                scp = hit;
+                has_hit = true;
+            }
+            if (intersectionSweepSphereTriangle(from, to, radius, p[2], p[3], p[0], hit) && hit.distance_traveled < min_distance) {
+                min_distance = hit.distance_traveled;
+                scp = hit;
+                has_hit = true;
+            }
+        }
+    }
+    return has_hit;
+}
+
+static void benchHeightfieldWalk(phyHeightfieldShape& hf, int capsule_count, int step_count) {
+    const float dt = 1.f / 60.f;
+    std::unique_ptr<phyWorld> world(new phyWorld);
+    phyRigidBody ground;
+    ground.setShape(&hf);
+    ground.mass = .0f;
+    world->addCollider(&ground);
+
+    phyCapsuleShape capsule_shape;
+    capsule_shape.radius = .4f;
+    capsule_shape.height = 1.f;
+
+    std::mt19937 rng(777);
+    std::uniform_real_distribution<float> dist(.0f, 1.f);
+    // Bodies hold pointers into the vector, must not reallocate after this
+    std::vector<phyRigidBody> capsules(capsule_count);
+    std::vector<gfxm::vec3> walk_dirs(capsule_count);
+    const float spread = gfxm::_min(hf.getWidth(), hf.getDepth()) * .8f;
+    for (int i = 0; i < capsule_count; ++i) {
+        auto& body = capsules[i];
+        const float x = hf.getWidth() * .5f + (dist(rng) - .5f) * spread;
+        const float z = hf.getDepth() * .5f + (dist(rng) - .5f) * spread;
+        const int sx = std::min(hf.getSampleCountX() - 1, (int)(x / hf.getCellWidth()));
+        const int sz = std::min(hf.getSampleCountZ() - 1, (int)(z / hf.getCellDepth()));
+        body.setShape(&capsule_shape);
+        body.setPosition(gfxm::vec3(x, hf.getData()[sx + sz * hf.getSampleCountX()] + 1.5f, z));
+        body.mass = 70.f;
+        body.friction = .0f;
+        world->addCollider(&body);
+        body.wakeUp();
+        const float angle = dist(rng) * 2.f * gfxm::pi;
+        walk_dirs[i] = gfxm::vec3(cosf(angle), .0f, sinf(angle)) * 3.f;
+    }
+
+    timer timer_;
+    float step_time = .0f;
+    float narrowphase_time = .0f;
+    int contact_count = 0;
+    for (int i = 0; i < step_count; ++i) {
+        // Character style walking, horizontal velocity is driven, the capsule is kept upright
+        for (int j = 0; j < capsule_count; ++j) {
+            auto& body = capsules[j];
+            body.velocity.x = walk_dirs[j].x;
+            body.velocity.z = walk_dirs[j].z;
+            body.angular_velocity = gfxm::vec3(0, 0, 0);
+            body.setRotation(gfxm::quat(0, 0, 0, 1));
+        }
+        timer_.start();
+        world->updateInternal(dt);
+        step_time += timer_.stop();
+        narrowphase_time += world->getNarrowphaseTime();
+        contact_count += world->getSolverContactCount();
+    }
+
+    // Walkers that fell through have nothing under them anymore
+    int grounded = 0;
+    for (auto& body : capsules) {
+        const gfxm::vec3 pos = body.getPosition();
+        const int sx = gfxm::_max(0, std::min(hf.getSampleCountX() - 1, (int)(pos.x / hf.getCellWidth())));
+        const int sz = gfxm::_max(0, std::min(hf.getSampleCountZ() - 1, (int)(pos.z / hf.getCellDepth())));
+        if (pos.y > hf.getData()[sx + sz * hf.getSampleCountX()] - .5f) {
+            ++grounded;
+        }
+    }
+    LOG("  walk: " << step_time * 1000.f / step_count << " ms/step, narrowphase "
+        << narrowphase_time * 1000.f / step_count << " ms/step, " << contact_count / step_count << " contacts/step, "
+        << grounded << " of " << capsule_count << " still above the surface");
+}
+
+static void benchHeightfieldCells(const phyHeightfieldShape& hf, int query_count) {
+    std::mt19937 rng(4242);
+    std::uniform_real_distribution<float> dist(.0f, 1.f);
+    std::vector<gfxm::aabb> boxes(query_count);
+    for (auto& box : boxes) {
+        const gfxm::vec3 c(dist(rng) * hf.getWidth(), dist(rng) * 14.f, dist(rng) * hf.getDepth());
+        const gfxm::vec3 e(.5f + dist(rng) * 4.f, .5f + dist(rng), .5f + dist(rng) * 4.f);
+        box.from = c - e;
+        box.to = c + e;
+    }
+
+    int cells_a[PHY_HEIGHTFIELD_MAX_CELLS_PER_PAIR];
+    int cells_b[PHY_HEIGHTFIELD_MAX_CELLS_PER_PAIR];
+    timer timer_;
+    int scalar_total = 0;
+    timer_.start();
+    for (auto& box : boxes) {
+        scalar_total += benchFindCellsScalar(hf, box, cells_a, PHY_HEIGHTFIELD_MAX_CELLS_PER_PAIR);
+    }
+    const float scalar_ms = timer_.stop() * 1000.f;
+
+    int simd_total = 0;
+    timer_.start();
+    for (auto& box : boxes) {
+        int resume_cell = 0;
+        while (resume_cell != -1) {
+            simd_total += hf.findPotentialCells(box, cells_a, PHY_HEIGHTFIELD_MAX_CELLS_PER_PAIR, resume_cell);
+        }
+    }
+    const float simd_ms = timer_.stop() * 1000.f;
+
+    int mismatches = 0;
+    for (auto& box : boxes) {
+        // First batch only, the scalar loop counts every cell but keeps as many as fit
+        int resume_cell = 0;
+        const int na = hf.findPotentialCells(box, cells_a, PHY_HEIGHTFIELD_MAX_CELLS_PER_PAIR, resume_cell);
+        const int nb = std::min(benchFindCellsScalar(hf, box, cells_b, PHY_HEIGHTFIELD_MAX_CELLS_PER_PAIR), PHY_HEIGHTFIELD_MAX_CELLS_PER_PAIR);
+        if (na != nb || memcmp(cells_a, cells_b, sizeof(cells_a[0]) * na) != 0) {
+            ++mismatches;
+        }
+    }
+
+    LOG("  cell culling, queries/ms: scalar " << query_count / scalar_ms << ", simd " << query_count / simd_ms
+        << ", " << scalar_ms / simd_ms << "x, " << simd_total / query_count << " cells/query");
+    if (mismatches || scalar_total != simd_total) {
+        LOG_WARN("  " << mismatches << " cell queries differ from the scalar loop");
+    }
+}
+
+static void benchHeightfieldSweeps(const phyHeightfieldShape& hf, int sweep_count) {
+    std::mt19937 rng(99);
+    std::uniform_real_distribution<float> dist(.0f, 1.f);
+    std::vector<gfxm::vec3> from(sweep_count);
+    std::vector<gfxm::vec3> to(sweep_count);
+    for (int i = 0; i < sweep_count; ++i) {
+        from[i] = gfxm::vec3(dist(rng) * hf.getWidth(), 20.f + dist(rng) * 10.f, dist(rng) * hf.getDepth());
+        // Long shallow sweeps, like a projectile or a camera probe
+        const float angle = dist(rng) * 2.f * gfxm::pi;
+        const float length = 20.f + dist(rng) * 100.f;
+        to[i] = from[i] + gfxm::vec3(cosf(angle) * length, -10.f - dist(rng) * 25.f, sinf(angle) * length);
+    }
+    const float radius = .3f;
+
+    timer timer_;
+    int brute_hits = 0;
+    timer_.start();
+    for (int i = 0; i < sweep_count; ++i) {
+        SweepContactPoint scp;
+        brute_hits += benchSweepSphereBrute(hf, from[i], to[i], radius, scp) ? 1 : 0;
+    }
+    const float brute_ms = timer_.stop() * 1000.f;
+
+    int tree_hits = 0;
+    timer_.start();
+    for (int i = 0; i < sweep_count; ++i) {
+        SweepContactPoint scp;
+        tree_hits += hf.sweepSphere(from[i], to[i], radius, scp) ? 1 : 0;
+    }
+    const float tree_ms = timer_.stop() * 1000.f;
+
+    int mismatches = 0;
+    for (int i = 0; i < sweep_count; ++i) {
+        SweepContactPoint a, b;
+        const bool hit_a = benchSweepSphereBrute(hf, from[i], to[i], radius, a);
+        const bool hit_b = hf.sweepSphere(from[i], to[i], radius, b);
+        if (hit_a != hit_b || (hit_a && fabsf(a.distance_traveled - b.distance_traveled) > 1e-3f)) {
+            ++mismatches;
+        }
+    }
+
+    LOG("  sphere sweeps, sweeps/ms: every cell " << sweep_count / brute_ms << ", quadtree " << sweep_count / tree_ms
+        << ", " << brute_ms / tree_ms << "x, hits " << brute_hits << " and " << tree_hits);
+    if (mismatches) {
+        LOG_WARN("  " << mismatches << " sweeps differ from the full scan");
+    }
+}
+
+void benchPhyHeightfield(const ConsoleCommand& cmd) {
+    const int sample_count = std::max(2, cmd.arg<int>(0, 2048));
+    const int capsule_count = std::max(1, cmd.arg<int>(1, 500));
+    const int step_count = std::max(1, cmd.arg<int>(2, 300));
+
+    LOG("bench.phy_heightfield: " << sample_count << "x" << sample_count << " samples, "
+        << capsule_count << " capsules, " << step_count << " steps");
+
+    std::vector<float> samples;
+    benchMakeTerrain(samples, sample_count);
+    phyHeightfieldShape hf;
+    timer timer_;
+    timer_.start();
+    hf.init(samples.data(), sample_count, sample_count, float(sample_count - 1), float(sample_count - 1));
+    LOG("  init with quadtree: " << timer_.stop() * 1000.f << " ms");
+
+    benchHeightfieldWalk(hf, capsule_count, step_count);
+    benchHeightfieldCells(hf, 200000);
+    benchHeightfieldSweeps(hf, 20000);
+}
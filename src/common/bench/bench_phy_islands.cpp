@@ -0,0 +1,105 @@
+#include "bench.hpp"
+
+#include <vector>
+#include <memory>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "collision/collision_world.hpp"
+#include "collision/shape/box.hpp"
+
+
+// Columns of boxes stacked on a static floor, every column is its own island
+// Step cost should fall off as the columns settle and go to sleep,
+// then one column gets knocked over to show it waking up its neighbors
+
+struct BenchIslandsScene {
+    std::unique_ptr<phyWorld> world;
+    phyBoxShape floor_shape;
+    phyRigidBody floor;
+    phyBoxShape box_shape;
+    std::vector<phyRigidBody> bodies;
+};
+
+static void benchMakeIslandsScene(BenchIslandsScene& scene, int body_count, int stack_height) {
+    scene.world.reset(new phyWorld);
+    scene.box_shape.half_extents = gfxm::vec3(.5f, .5f, .5f);
+
+    const int column_count = (body_count + stack_height - 1) / stack_height;
+    const int side = std::max(1, (int)ceilf(sqrtf((float)column_count)));
+    const float spacing = 1.5f;
+    const float extent = side * spacing;
+
+    scene.floor_shape.half_extents = gfxm::vec3(extent * .5f, .5f, extent * .5f);
+    scene.floor.setShape(&scene.floor_shape);
+    scene.floor.setPosition(gfxm::vec3(extent * .5f, -.5f, extent * .5f));
+    scene.floor.mass = .0f;
+    scene.world->addCollider(&scene.floor);
+
+    // Bodies hold pointers into the vector, must not reallocate after this
+    scene.bodies = std::vector<phyRigidBody>(body_count);
+    for (int i = 0; i < body_count; ++i) {
+        auto& body = scene.bodies[i];
+        body.setShape(&scene.box_shape);
+        int column = i / stack_height;
+        int level = i % stack_height;
+        int x = column % side;
+        int z = column / side;
+        body.setPosition(gfxm::vec3(
+            (x + .5f) * spacing,
+            .505f + level * 1.01f,
+            (z + .5f) * spacing
+        ));
+        body.mass = 1.f;
+        body.friction = .6f;
+        scene.world->addCollider(&body);
+        body.wakeUp();
+    }
+}
+
+void benchPhyIslands(const ConsoleCommand& cmd) {
+    const int body_count = std::max(1, cmd.arg<int>(0, 10000));
+    const int stack_height = std::max(1, cmd.arg<int>(1, 4));
+    const int step_count = std::max(1, cmd.arg<int>(2, 600));
+    const int thread_count = std::max(1, cmd.arg<int>(3, 1));
+    const int report_interval = 30;
+    const float dt = 1.f / 60.f;
+
+    LOG("bench.phy_islands: " << body_count << " boxes in stacks of " << stack_height << ", "
+        << step_count << " steps, " << thread_count << " threads, sleep after " << PHY_SLEEP_THRESHOLD_SEC << " s at rest");
+
+    BenchIslandsScene scene;
+    benchMakeIslandsScene(scene, body_count, stack_height);
+    scene.world->setThreadCount(thread_count);
+
+    auto fn_run = [&scene, dt, report_interval](int first_step, int steps) {
+        timer timer_;
+        float block_time = .0f;
+        int woken_count = 0;
+        for (int i = 0; i < steps; ++i) {
+            timer_.start();
+            scene.world->updateInternal(dt);
+            block_time += timer_.stop();
+            woken_count += scene.world->getIslandStats().woken_body_count;
+
+            int step = first_step + i + 1;
+            if (step % report_interval != 0 && i != steps - 1) {
+                continue;
+            }
+            const phyIslandStats& stats = scene.world->getIslandStats();
+            int block_steps = (step % report_interval) ? (step % report_interval) : report_interval;
+            LOG("  step " << step << ": " << block_time * 1000.f / block_steps << " ms/step, islands " << stats.island_count
+                << ", active " << stats.active_body_count << ", sleeping " << stats.sleeping_body_count
+                << ", woken " << woken_count);
+            block_time = .0f;
+            woken_count = 0;
+        }
+    };
+
+    fn_run(0, step_count);
+
+    // Knock the middle column into its neighbors
+    auto& target = scene.bodies[(body_count / 2 / stack_height) * stack_height + stack_height - 1];
+    LOG("  impulse on a single box");
+    target.impulseAtPoint(gfxm::vec3(8.f, .0f, .0f), target.getCOM() + gfxm::vec3(.0f, .25f, .0f));
+    fn_run(step_count, report_interval * 4);
+}
@@ -0,0 +1,147 @@
+#include "bench.hpp"
+
+#include <random>
+#include <vector>
+#include <memory>
+#include <thread>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "collision/collision_world.hpp"
+#include "collision/shape/sphere.hpp"
+#include "collision/shape/box.hpp"
+#include "collision/shape/capsule.hpp"
+
+
+// A crowded pile of mixed shapes dropped onto a static floor,
+// the same simulation is run once per thread count and the final states are compared
+
+struct BenchNarrowphaseScene {
+    std::unique_ptr<phyWorld> world;
+    phyBoxShape floor_shape;
+    phyRigidBody floor;
+    phyBoxShape box_shape;
+    phySphereShape sphere_shape;
+    phyCapsuleShape capsule_shape;
+    std::vector<phyRigidBody> bodies;
+};
+
+static void benchMakeNarrowphaseScene(BenchNarrowphaseScene& scene, int body_count, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> jitter_dist(-.05f, .05f);
+    std::uniform_real_distribution<float> angle_dist(.0f, gfxm::pi);
+    std::uniform_int_distribution<int> shape_dist(0, 5);
+
+    scene.world.reset(new phyWorld);
+    scene.box_shape.half_extents = gfxm::vec3(.5f, .5f, .5f);
+    scene.sphere_shape.radius = .5f;
+    scene.capsule_shape.radius = .3f;
+    scene.capsule_shape.height = .6f;
+
+    const int side = std::max(1, (int)sqrtf(body_count / 8.f));
+    const float spacing = 1.05f;
+    const float extent = side * spacing;
+
+    scene.floor_shape.half_extents = gfxm::vec3(extent, .5f, extent);
+    scene.floor.setShape(&scene.floor_shape);
+    scene.floor.setPosition(gfxm::vec3(.0f, -.5f, .0f));
+    scene.floor.mass = .0f;
+    scene.world->addCollider(&scene.floor);
+
+    // Bodies hold pointers into the vector, must not reallocate after this
+    scene.bodies = std::vector<phyRigidBody>(body_count);
+    for (int i = 0; i < body_count; ++i) {
+        auto& body = scene.bodies[i];
+        // Half boxes, the rest spheres and capsules
+        int shape_kind = shape_dist(rng);
+        if (shape_kind < 3) {
+            body.setShape(&scene.box_shape);
+        } else if (shape_kind < 5) {
+            body.setShape(&scene.sphere_shape);
+        } else {
+            body.setShape(&scene.capsule_shape);
+        }
+        int x = i % side;
+        int z = (i / side) % side;
+        int y = i / (side * side);
+        body.setPosition(gfxm::vec3(
+            (x - side * .5f) * spacing + jitter_dist(rng),
+            .6f + y * spacing,
+            (z - side * .5f) * spacing + jitter_dist(rng)
+        ));
+        body.setRotation(gfxm::angle_axis(angle_dist(rng), gfxm::normalize(gfxm::vec3(jitter_dist(rng), 1.f, jitter_dist(rng)))));
+        body.mass = 1.f;
+        body.friction = .6f;
+        scene.world->addCollider(&body);
+        // Bodies are added asleep
+        body.velocity = gfxm::vec3(.0f, -1.f, .0f);
+    }
+}
+
+static uint64_t benchHashNarrowphaseScene(BenchNarrowphaseScene& scene) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto fn_hash = [&hash](const void* data, size_t size) {
+        const uint8_t* bytes = (const uint8_t*)data;
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+    };
+    for (auto& body : scene.bodies) {
+        fn_hash(&body.getPosition(), sizeof(gfxm::vec3));
+        fn_hash(&body.getRotation(), sizeof(gfxm::quat));
+        fn_hash(&body.velocity, sizeof(gfxm::vec3));
+        fn_hash(&body.angular_velocity, sizeof(gfxm::vec3));
+    }
+    int manifold_count = scene.world->getManifoldCount();
+    fn_hash(&manifold_count, sizeof(manifold_count));
+    return hash;
+}
+
+void benchPhyNarrowphase(const ConsoleCommand& cmd) {
+    const int body_count = std::max(1, cmd.arg<int>(0, 600));
+    const int warmup_steps = std::max(0, cmd.arg<int>(1, 60));
+    const int step_count = std::max(1, cmd.arg<int>(2, 60));
+    const float dt = 1.f / 60.f;
+    const int thread_counts[] = { 1, 2, 4, 8, 12, 16 };
+
+    LOG("bench.phy_narrowphase: " << body_count << " bodies, "
+        << warmup_steps << " warmup steps, " << step_count << " timed steps, "
+        << std::thread::hardware_concurrency() << " hardware threads");
+
+    uint64_t reference_hash = 0;
+    float reference_ms = .0f;
+    for (int thread_count : thread_counts) {
+        BenchNarrowphaseScene scene;
+        benchMakeNarrowphaseScene(scene, body_count, 1337);
+        scene.world->setThreadCount(thread_count);
+
+        for (int i = 0; i < warmup_steps; ++i) {
+            scene.world->updateInternal(dt);
+        }
+
+        timer timer_;
+        float narrowphase_time = .0f;
+        int64_t pair_count = 0;
+        timer_.start();
+        for (int i = 0; i < step_count; ++i) {
+            scene.world->updateInternal(dt);
+            narrowphase_time += scene.world->getNarrowphaseTime();
+            pair_count += scene.world->getNarrowphasePairCount();
+        }
+        float step_time = timer_.stop();
+
+        uint64_t hash = benchHashNarrowphaseScene(scene);
+        float narrowphase_ms = narrowphase_time * 1000.f / step_count;
+        if (thread_count == 1) {
+            reference_hash = hash;
+            reference_ms = narrowphase_ms;
+        }
+        LOG("  " << thread_count << " threads: narrowphase " << narrowphase_ms << " ms/step, step "
+            << step_time * 1000.f / step_count << " ms/step, pairs/step " << pair_count / step_count
+            << ", manifolds " << scene.world->getManifoldCount()
+            << ", speedup " << (narrowphase_ms > .0f ? reference_ms / narrowphase_ms : .0f) << "x");
+        if (hash != reference_hash) {
+            LOG_WARN("    final state differs from the single threaded run");
+        }
+    }
+}
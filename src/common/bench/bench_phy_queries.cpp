@@ -0,0 +1,215 @@
+#include "bench.hpp"
+
+#include <random>
+#include <vector>
+#include <memory>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "collision/collision_world.hpp"
+#include "collision/shape/sphere.hpp"
+#include "collision/shape/box.hpp"
+#include "collision/shape/capsule.hpp"
+
+
+// Squads of shooters scattered over a field of static props, every shooter casts at every member
+// of another squad. Queries are run one by one through rayTest/sphereSweep, then as batches,
+// batched closest hits are checked against the batched all-hits lists
+
+struct BenchQueriesScene {
+    std::unique_ptr<phyWorld> world;
+    phyBoxShape box_shape;
+    phySphereShape sphere_shape;
+    phyCapsuleShape capsule_shape;
+    std::vector<phyRigidBody> bodies;
+};
+
+static void benchMakeQueriesScene(BenchQueriesScene& scene, int body_count, float extent, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> pos_dist(-extent, extent);
+    std::uniform_real_distribution<float> height_dist(.0f, 4.f);
+    std::uniform_real_distribution<float> angle_dist(.0f, gfxm::pi);
+    std::uniform_int_distribution<int> shape_dist(0, 2);
+
+    scene.world.reset(new phyWorld);
+    scene.box_shape.half_extents = gfxm::vec3(.5f, 1.f, .5f);
+    scene.sphere_shape.radius = .6f;
+    scene.capsule_shape.radius = .3f;
+    scene.capsule_shape.height = 1.2f;
+
+    // Bodies hold pointers into the vector, must not reallocate after this
+    scene.bodies = std::vector<phyRigidBody>(body_count);
+    for (int i = 0; i < body_count; ++i) {
+        auto& body = scene.bodies[i];
+        int shape_kind = shape_dist(rng);
+        if (shape_kind == 0) {
+            body.setShape(&scene.box_shape);
+        } else if (shape_kind == 1) {
+            body.setShape(&scene.sphere_shape);
+        } else {
+            body.setShape(&scene.capsule_shape);
+        }
+        body.setPosition(gfxm::vec3(pos_dist(rng), height_dist(rng), pos_dist(rng)));
+        body.setRotation(gfxm::angle_axis(angle_dist(rng), gfxm::vec3(.0f, 1.f, .0f)));
+        body.mass = .0f;
+        scene.world->addCollider(&body);
+    }
+    // One step to get the bounds into the tree
+    scene.world->updateInternal(1.f / 60.f);
+}
+
+static void benchMakeSquadQueries(std::vector<phyRayQuery>& queries, int query_count, float extent, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> pos_dist(-extent, extent);
+    std::uniform_real_distribution<float> offset_dist(-1.5f, 1.5f);
+    const int squad_size = 8;
+
+    queries.clear();
+    while (queries.size() < query_count) {
+        gfxm::vec3 squad_a(pos_dist(rng), 1.5f, pos_dist(rng));
+        gfxm::vec3 squad_b(pos_dist(rng), 1.5f, pos_dist(rng));
+        gfxm::vec3 shooters[squad_size];
+        gfxm::vec3 targets[squad_size];
+        for (int i = 0; i < squad_size; ++i) {
+            shooters[i] = squad_a + gfxm::vec3(offset_dist(rng), .0f, offset_dist(rng));
+            targets[i] = squad_b + gfxm::vec3(offset_dist(rng), .0f, offset_dist(rng));
+        }
+        // Rays from one shooter go together, they share an origin
+        for (int i = 0; i < squad_size && queries.size() < query_count; ++i) {
+            for (int j = 0; j < squad_size && queries.size() < query_count; ++j) {
+                phyRayQuery q;
+                q.from = shooters[i];
+                q.to = targets[j];
+                queries.push_back(q);
+            }
+        }
+    }
+}
+
+void benchPhyQueries(const ConsoleCommand& cmd) {
+    const int body_count = std::max(1, cmd.arg<int>(0, 5000));
+    const int query_count = std::max(1, cmd.arg<int>(1, 4096));
+    const int thread_count = std::max(1, cmd.arg<int>(2, 1));
+    const int repeat_count = 10;
+    const float extent = sqrtf((float)body_count) * 2.f;
+    const float sweep_radius = .25f;
+
+    LOG("bench.phy_queries: " << body_count << " static bodies, " << query_count << " queries, "
+        << thread_count << " threads, simd " << (PHY_SSE ? "sse" : "off"));
+
+    BenchQueriesScene scene;
+    benchMakeQueriesScene(scene, body_count, extent, 1337);
+    scene.world->setThreadCount(thread_count);
+
+    std::vector<phyRayQuery> ray_queries;
+    benchMakeSquadQueries(ray_queries, query_count, extent, 7331);
+    std::vector<phySphereSweepQuery> sweep_queries(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        sweep_queries[i].from = ray_queries[i].from;
+        sweep_queries[i].to = ray_queries[i].to;
+        sweep_queries[i].radius = sweep_radius;
+    }
+
+    std::vector<phyRayCastResult> single_rays(query_count);
+    std::vector<phyRayCastResult> batch_rays(query_count);
+    std::vector<phySphereSweepResult> single_sweeps(query_count);
+    std::vector<phySphereSweepResult> batch_sweeps(query_count);
+    phyRayHitList ray_hits;
+    phySphereSweepHitList sweep_hits;
+
+    auto fn_time = [repeat_count](const std::function<void()>& fn)->float {
+        timer timer_;
+        timer_.start();
+        for (int i = 0; i < repeat_count; ++i) {
+            fn();
+        }
+        return timer_.stop() * 1000.f / repeat_count;
+    };
+
+    float single_ray_ms = fn_time([&]() {
+        for (int i = 0; i < query_count; ++i) {
+            single_rays[i] = scene.world->rayTest(ray_queries[i].from, ray_queries[i].to, ray_queries[i].mask);
+        }
+    });
+    float batch_ray_ms = fn_time([&]() {
+        scene.world->rayTestBatch(ray_queries.data(), query_count, batch_rays.data());
+    });
+    float any_ray_ms = fn_time([&]() {
+        scene.world->rayTestBatch(ray_queries.data(), query_count, batch_rays.data(), PHY_QUERY_HIT::ANY);
+    });
+    int any_mismatches = 0;
+    for (int i = 0; i < query_count; ++i) {
+        any_mismatches += batch_rays[i].hasHit != single_rays[i].hasHit;
+    }
+    float all_ray_ms = fn_time([&]() {
+        scene.world->rayTestBatch(ray_queries.data(), query_count, ray_hits);
+    });
+    scene.world->rayTestBatch(ray_queries.data(), query_count, batch_rays.data());
+
+    // Batched closest must agree with the nearest entry of the batched all-hits list,
+    // single queries are only compared by whether they hit at all
+    int ray_mismatches = 0;
+    int ray_single_diffs = 0;
+    int ray_hit_count = 0;
+    for (int i = 0; i < query_count; ++i) {
+        const auto& a = single_rays[i];
+        const auto& b = batch_rays[i];
+        ray_hit_count += b.hasHit;
+        bool listed = ray_hits.first[i + 1] > ray_hits.first[i];
+        if (b.hasHit != listed) {
+            ++ray_mismatches;
+        } else if (listed) {
+            const auto& nearest = ray_hits.hits[ray_hits.first[i]];
+            if (nearest.collider != b.collider || fabsf(nearest.distance - b.distance) > 1e-4f) {
+                ++ray_mismatches;
+            }
+        }
+        ray_single_diffs += a.hasHit != b.hasHit || a.collider != b.collider;
+    }
+
+    float single_sweep_ms = fn_time([&]() {
+        for (int i = 0; i < query_count; ++i) {
+            const auto& q = sweep_queries[i];
+            single_sweeps[i] = scene.world->sphereSweep(q.from, q.to, q.radius, q.mask);
+        }
+    });
+    float batch_sweep_ms = fn_time([&]() {
+        scene.world->sphereSweepBatch(sweep_queries.data(), query_count, batch_sweeps.data());
+    });
+    float all_sweep_ms = fn_time([&]() {
+        scene.world->sphereSweepBatch(sweep_queries.data(), query_count, sweep_hits);
+    });
+
+    int sweep_mismatches = 0;
+    int sweep_single_diffs = 0;
+    int sweep_hit_count = 0;
+    for (int i = 0; i < query_count; ++i) {
+        const auto& a = single_sweeps[i];
+        const auto& b = batch_sweeps[i];
+        sweep_hit_count += b.hasHit;
+        bool listed = sweep_hits.first[i + 1] > sweep_hits.first[i];
+        if (b.hasHit != listed) {
+            ++sweep_mismatches;
+        } else if (listed) {
+            const auto& nearest = sweep_hits.hits[sweep_hits.first[i]];
+            if (nearest.collider != b.collider || fabsf(nearest.distance - b.distance) > 1e-4f) {
+                ++sweep_mismatches;
+            }
+        }
+        sweep_single_diffs += a.hasHit != b.hasHit || a.collider != b.collider;
+    }
+
+    LOG("  rays: single " << single_ray_ms << " ms, batch closest " << batch_ray_ms << " ms ("
+        << (batch_ray_ms > .0f ? single_ray_ms / batch_ray_ms : .0f) << "x), any " << any_ray_ms
+        << " ms, all " << all_ray_ms << " ms, " << ray_hit_count << " hit, " << ray_hits.hits.size() << " hits total");
+    LOG("  sweeps: single " << single_sweep_ms << " ms, batch closest " << batch_sweep_ms << " ms ("
+        << (batch_sweep_ms > .0f ? single_sweep_ms / batch_sweep_ms : .0f) << "x), all " << all_sweep_ms
+        << " ms, " << sweep_hit_count << " hit, " << sweep_hits.hits.size() << " hits total");
+    if (ray_mismatches || sweep_mismatches) {
+        LOG_WARN("    batched closest differs from batched all-hits: " << ray_mismatches << " rays, "
+            << sweep_mismatches << " sweeps");
+    }
+    // Single queries report some capsule hits at zero distance and cull spheres
+    // a sweep starts inside of, so a few differences from them are expected
+    LOG("    differences from single queries: " << ray_single_diffs << " rays, " << any_mismatches
+        << " any-hit rays, " << sweep_single_diffs << " sweeps");
+}
@@ -0,0 +1,119 @@
+#include "bench.hpp"
+
+#include <vector>
+#include <memory>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "collision/collision_world.hpp"
+#include "collision/shape/box.hpp"
+
+
+// Boxes stacked side by side on a static floor, the whole pile is one island
+// Two copies of the scene are settled with the scalar solver, then one switches to the packed solver
+// and both are stepped on, comparing solver time and how far the results drift apart
+
+struct BenchSolverScene {
+    std::unique_ptr<phyWorld> world;
+    phyBoxShape floor_shape;
+    phyRigidBody floor;
+    phyBoxShape box_shape;
+    std::vector<phyRigidBody> bodies;
+};
+
+static void benchMakeSolverScene(BenchSolverScene& scene, int body_count, int stack_height) {
+    scene.world.reset(new phyWorld);
+    scene.box_shape.half_extents = gfxm::vec3(.5f, .5f, .5f);
+
+    const int column_count = (body_count + stack_height - 1) / stack_height;
+    const int side = std::max(1, (int)ceilf(sqrtf((float)column_count)));
+    const float spacing = 1.f;
+    const float extent = side * spacing;
+
+    scene.floor_shape.half_extents = gfxm::vec3(extent * .5f + 1.f, .5f, extent * .5f + 1.f);
+    scene.floor.setShape(&scene.floor_shape);
+    scene.floor.setPosition(gfxm::vec3(extent * .5f, -.5f, extent * .5f));
+    scene.floor.mass = .0f;
+    scene.world->addCollider(&scene.floor);
+
+    // Bodies hold pointers into the vector, must not reallocate after this
+    scene.bodies = std::vector<phyRigidBody>(body_count);
+    for (int i = 0; i < body_count; ++i) {
+        auto& body = scene.bodies[i];
+        body.setShape(&scene.box_shape);
+        int column = i / stack_height;
+        int level = i % stack_height;
+        int x = column % side;
+        int z = column / side;
+        body.setPosition(gfxm::vec3(
+            (x + .5f) * spacing,
+            .505f + level * 1.01f,
+            (z + .5f) * spacing
+        ));
+        body.mass = 1.f;
+        body.friction = .6f;
+        scene.world->addCollider(&body);
+        body.wakeUp();
+    }
+}
+
+void benchPhySolver(const ConsoleCommand& cmd) {
+    const int body_count = std::max(1, cmd.arg<int>(0, 1000));
+    const int warmup_steps = std::max(0, cmd.arg<int>(1, 60));
+    const int step_count = std::max(1, cmd.arg<int>(2, 60));
+    const int stack_height = 4;
+    const float dt = 1.f / 60.f;
+
+    LOG("bench.phy_solver: " << body_count << " boxes in stacks of " << stack_height << ", "
+        << warmup_steps << " warmup steps, " << step_count << " timed steps, simd "
+        << (PHY_SOLVER_SSE ? "sse" : "off"));
+
+    BenchSolverScene scalar_scene;
+    BenchSolverScene packed_scene;
+    benchMakeSolverScene(scalar_scene, body_count, stack_height);
+    benchMakeSolverScene(packed_scene, body_count, stack_height);
+    scalar_scene.world->enablePackedSolver(false);
+    packed_scene.world->enablePackedSolver(false);
+    for (int i = 0; i < warmup_steps; ++i) {
+        scalar_scene.world->updateInternal(dt);
+        packed_scene.world->updateInternal(dt);
+    }
+    packed_scene.world->enablePackedSolver(true);
+
+    float max_velocity_error = .0f;
+    float max_position_error = .0f;
+    float scalar_time = .0f;
+    float packed_time = .0f;
+    int64_t contact_count = 0;
+    for (int i = 0; i < step_count; ++i) {
+        scalar_scene.world->updateInternal(dt);
+        packed_scene.world->updateInternal(dt);
+        scalar_time += scalar_scene.world->getSolverTime();
+        packed_time += packed_scene.world->getSolverTime();
+        contact_count += packed_scene.world->getSolverContactCount();
+
+        // Only the first step starts from the same state, later ones drift apart on their own
+        if (i != 0) {
+            continue;
+        }
+        for (int j = 0; j < body_count; ++j) {
+            const auto& a = scalar_scene.bodies[j];
+            const auto& b = packed_scene.bodies[j];
+            max_velocity_error = std::max(max_velocity_error, gfxm::length(a.velocity - b.velocity));
+            max_velocity_error = std::max(max_velocity_error, gfxm::length(a.angular_velocity - b.angular_velocity));
+        }
+    }
+    for (int j = 0; j < body_count; ++j) {
+        const auto& a = scalar_scene.bodies[j];
+        const auto& b = packed_scene.bodies[j];
+        max_position_error = std::max(max_position_error, gfxm::length(a.getPosition() - b.getPosition()));
+    }
+
+    float scalar_ms = scalar_time * 1000.f / step_count;
+    float packed_ms = packed_time * 1000.f / step_count;
+    LOG("  contacts/step " << contact_count / step_count
+        << ", iterations " << packed_scene.world->getSolverIterations());
+    LOG("  scalar solver " << scalar_ms << " ms/step, packed solver " << packed_ms << " ms/step, speedup "
+        << (packed_ms > .0f ? scalar_ms / packed_ms : .0f) << "x");
+    LOG("  max velocity difference after one step " << max_velocity_error
+        << ", max position difference after " << step_count << " steps " << max_position_error);
+}
@@ -0,0 +1,148 @@
+#include "bench.hpp"
+
+#include <random>
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "collision/collision_triangle_mesh.hpp"
+
+
+// A noisy terrain grid with loose triangles scattered above it, roughly the shape of a level mesh
+// Times the tree build against loading the serialized mesh, then closest ray and sweep queries
+// and the aabb candidate lookup the narrowphase uses, checked against testing every triangle
+
+static void benchMakeTrimesh(std::vector<gfxm::vec3>& vertices, std::vector<uint32_t>& indices, int side, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> height_dist(.0f, 2.f);
+    std::uniform_real_distribution<float> unit_dist(.0f, 1.f);
+
+    vertices.clear();
+    indices.clear();
+    for (int z = 0; z <= side; ++z) {
+        for (int x = 0; x <= side; ++x) {
+            vertices.push_back(gfxm::vec3((float)x, height_dist(rng), (float)z));
+        }
+    }
+    for (int z = 0; z < side; ++z) {
+        for (int x = 0; x < side; ++x) {
+            uint32_t a = z * (side + 1) + x;
+            uint32_t b = a + 1;
+            uint32_t c = a + side + 1;
+            uint32_t d = c + 1;
+            indices.insert(indices.end(), { a, c, b, b, c, d });
+        }
+    }
+    for (int i = 0; i < side * 20; ++i) {
+        gfxm::vec3 p(unit_dist(rng) * side, 2.f + unit_dist(rng) * 3.f, unit_dist(rng) * side);
+        uint32_t base = (uint32_t)vertices.size();
+        vertices.push_back(p);
+        vertices.push_back(p + gfxm::vec3(unit_dist(rng), unit_dist(rng), .0f));
+        vertices.push_back(p + gfxm::vec3(.0f, unit_dist(rng), unit_dist(rng)));
+        indices.insert(indices.end(), { base, base + 1, base + 2 });
+    }
+}
+
+void benchPhyTrimesh(const ConsoleCommand& cmd) {
+    const int side = std::max(1, cmd.arg<int>(0, 300));
+    const int query_count = std::max(1, cmd.arg<int>(1, 20000));
+    const int check_count = std::min(query_count, 200);
+    const float sweep_radius = .3f;
+
+    std::vector<gfxm::vec3> vertices;
+    std::vector<uint32_t> indices;
+    benchMakeTrimesh(vertices, indices, side, 1337);
+    LOG("bench.phy_trimesh: " << indices.size() / 3 << " triangles, " << query_count << " queries");
+
+    timer timer_;
+    CollisionTriangleMesh mesh;
+    timer_.start();
+    mesh.setData(vertices.data(), 0, vertices.size(), indices.data(), indices.size());
+    float build_ms = timer_.stop() * 1000.f;
+
+    std::vector<uint8_t> bytes;
+    mesh.serialize(bytes);
+    CollisionTriangleMesh loaded;
+    timer_.start();
+    bool load_ok = loaded.deserialize(bytes);
+    float load_ms = timer_.stop() * 1000.f;
+
+    std::mt19937 rng(7331);
+    std::uniform_real_distribution<float> unit_dist(.0f, 1.f);
+    std::vector<gfxm::vec3> from(query_count);
+    std::vector<gfxm::vec3> to(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        from[i] = gfxm::vec3(unit_dist(rng) * side, 6.f, unit_dist(rng) * side);
+        to[i] = from[i] + gfxm::vec3(unit_dist(rng) * 20.f - 10.f, -8.f, unit_dist(rng) * 20.f - 10.f);
+    }
+
+    std::vector<RayHitPoint> ray_hits(query_count);
+    std::vector<char> ray_has_hit(query_count);
+    timer_.start();
+    for (int i = 0; i < query_count; ++i) {
+        ray_has_hit[i] = mesh.rayTestClosest(gfxm::ray(from[i], to[i] - from[i]), ray_hits[i]);
+    }
+    float ray_ms = timer_.stop() * 1000.f;
+
+    std::vector<SweepContactPoint> sweep_hits(query_count);
+    std::vector<char> sweep_has_hit(query_count);
+    timer_.start();
+    for (int i = 0; i < query_count; ++i) {
+        sweep_has_hit[i] = mesh.sweepSphereClosest(from[i], to[i], sweep_radius, sweep_hits[i]);
+    }
+    float sweep_ms = timer_.stop() * 1000.f;
+
+    int candidate_total = 0;
+    timer_.start();
+    for (int i = 0; i < query_count; ++i) {
+        gfxm::aabb box;
+        // Roughly a character standing on the terrain
+        box.from = gfxm::vec3(to[i].x, .5f, to[i].z);
+        box.to = box.from + gfxm::vec3(1.f, 2.f, 1.f);
+        int triangles[128];
+        candidate_total += mesh.findPotentialTrianglesAabb(box, triangles, 128);
+    }
+    float aabb_ms = timer_.stop() * 1000.f;
+
+    // Reference results from every triangle, only for the first few queries
+    int mismatches = 0;
+    const gfxm::vec3* V = mesh.getVertexData();
+    const uint32_t* I = mesh.getIndexData();
+    for (int i = 0; i < check_count; ++i) {
+        float ray_best = INFINITY;
+        float sweep_best = INFINITY;
+        for (size_t t = 0; t < mesh.triangleCount(); ++t) {
+            const gfxm::vec3& A = V[I[t * 3]];
+            const gfxm::vec3& B = V[I[t * 3 + 1]];
+            const gfxm::vec3& C = V[I[t * 3 + 2]];
+            RayHitPoint rhp;
+            if (intersectRayTriangle(gfxm::ray(from[i], to[i] - from[i]), A, B, C, rhp)) {
+                ray_best = std::min(ray_best, rhp.distance);
+            }
+            SweepContactPoint scp;
+            if (intersectionSweepSphereTriangle(from[i], to[i], sweep_radius, A, B, C, scp)) {
+                sweep_best = std::min(sweep_best, scp.distance_traveled);
+            }
+        }
+        if ((ray_best != INFINITY) != (bool)ray_has_hit[i]
+            || (ray_has_hit[i] && fabsf(ray_best - ray_hits[i].distance) > 1e-4f)) {
+            ++mismatches;
+        }
+        if ((sweep_best != INFINITY) != (bool)sweep_has_hit[i]
+            || (sweep_has_hit[i] && fabsf(sweep_best - sweep_hits[i].distance_traveled) > 1e-4f)) {
+            ++mismatches;
+        }
+        RayHitPoint loaded_hit;
+        bool loaded_has_hit = loaded.rayTestClosest(gfxm::ray(from[i], to[i] - from[i]), loaded_hit);
+        if (loaded_has_hit != (bool)ray_has_hit[i] || (loaded_has_hit && loaded_hit.distance != ray_hits[i].distance)) {
+            ++mismatches;
+        }
+    }
+
+    LOG("  build " << build_ms << " ms, " << mesh.getTree().getNodeCount() << " nodes, serialized "
+        << bytes.size() / 1024 << " KiB, load " << load_ms << " ms" << (load_ok ? "" : " (FAILED)"));
+    LOG("  ray closest " << ray_ms << " ms, sphere sweep closest " << sweep_ms << " ms, aabb candidates "
+        << aabb_ms << " ms (" << (float)candidate_total / query_count << " per query)");
+    if (mismatches) {
+        LOG_WARN("    " << mismatches << " results differ from testing every triangle, first " << check_count << " queries");
+    }
+}
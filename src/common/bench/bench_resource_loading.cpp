@@ -0,0 +1,150 @@
+#include "bench.hpp"
+
+#include <stdio.h>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "resource_manager/resource_manager.hpp"
+
+
+// A level's worth of small resources, every fourth one depending on two others further down the list.
+// Files are written to two temp directories up front, one per run, so both start from the same disk cache state.
+// Runs loadResource() on every id, then loadAsync() on every id with update() called in a loop until
+// nothing is in flight. Decode hashes the payload decode_rounds times to stand in for real parsing.
+// Reports wall time for both, and for the async run the main thread time spent in update() and the longest
+// single update(), which is the stall a frame would see
+
+struct BenchLoadResource : public IAsyncLoadable {
+    std::vector<ResourceRef<BenchLoadResource>> deps;
+    uint64_t hash = 0;
+    static int decode_rounds;
+
+    bool decode(byte_reader& in, ResourceLoadContext& ctx) override {
+        uint32_t dep_count = 0;
+        in.read<uint32_t>(&dep_count);
+        deps.resize(dep_count);
+        for (uint32_t i = 0; i < dep_count; ++i) {
+            std::string id;
+            in.read_string(&id);
+            ctx.depend(deps[i], id);
+        }
+        std::vector<uint8_t> payload(in.size() - in.tell());
+        in.read(payload.data(), payload.size());
+
+        hash = 14695981039346656037ull;
+        for (int r = 0; r < decode_rounds; ++r) {
+            for (size_t i = 0; i < payload.size(); ++i) {
+                hash = (hash ^ payload[i]) * 1099511628211ull;
+            }
+        }
+        return true;
+    }
+};
+int BenchLoadResource::decode_rounds = 1;
+
+static std::string benchLoadResourceId(const std::filesystem::path& dir, int i) {
+    return "file://" + (dir / ("r" + std::to_string(i) + ".bin")).string();
+}
+
+static bool benchWriteLoadResources(const std::filesystem::path& dir, int resource_count, int payload_bytes) {
+    std::filesystem::create_directories(dir);
+    std::vector<uint8_t> payload(payload_bytes);
+    for (int i = 0; i < resource_count; ++i) {
+        std::vector<std::string> deps;
+        if (i % 4 == 0) {
+            for (int d = 1; d <= 2 && i + d * 3 < resource_count; ++d) {
+                deps.push_back(benchLoadResourceId(dir, i + d * 3));
+            }
+        }
+        for (int b = 0; b < payload_bytes; ++b) {
+            payload[b] = (uint8_t)((i * 31 + b * 7) & 0xFF);
+        }
+
+        FILE* f = fopen((dir / ("r" + std::to_string(i) + ".bin")).string().c_str(), "wb");
+        if (!f) {
+            return false;
+        }
+        uint32_t dep_count = (uint32_t)deps.size();
+        fwrite(&dep_count, sizeof(dep_count), 1, f);
+        for (auto& id : deps) {
+            uint32_t len = (uint32_t)id.size();
+            fwrite(&len, sizeof(len), 1, f);
+            fwrite(id.data(), 1, id.size(), f);
+        }
+        fwrite(payload.data(), 1, payload.size(), f);
+        fclose(f);
+    }
+    return true;
+}
+
+void benchResourceLoading(const ConsoleCommand& cmd) {
+    const int resource_count = std::max(1, cmd.arg<int>(0, 5000));
+    const int payload_kb = std::max(1, cmd.arg<int>(1, 64));
+    BenchLoadResource::decode_rounds = std::max(1, cmd.arg<int>(2, 4));
+    LOG("bench.resource_loading: " << resource_count << " resources, " << payload_kb << " kb each, "
+        << BenchLoadResource::decode_rounds << " decode rounds, " << std::thread::hardware_concurrency() << " hardware threads");
+
+    const auto root = std::filesystem::temp_directory_path() / "bench_resource_loading";
+    const auto sync_dir = root / "sync";
+    const auto async_dir = root / "async";
+    if (!benchWriteLoadResources(sync_dir, resource_count, payload_kb * 1024)
+        || !benchWriteLoadResources(async_dir, resource_count, payload_kb * 1024)
+    ) {
+        LOG_ERR("bench.resource_loading: failed to write resources to " << root.string());
+        return;
+    }
+
+    auto resman = ResourceManager::get();
+    std::vector<ResourceRef<BenchLoadResource>> refs(resource_count);
+    timer timer_;
+
+    timer_.start();
+    for (int i = 0; i < resource_count; ++i) {
+        refs[i] = resman->load<BenchLoadResource>(benchLoadResourceId(sync_dir, i));
+    }
+    const float sync_ms = timer_.stop() * 1000.f;
+    int sync_loaded = 0;
+    for (auto& r : refs) {
+        sync_loaded += r.isLoaded() ? 1 : 0;
+        r.reset();
+    }
+
+    int async_loaded = 0;
+    timer_.start();
+    for (int i = 0; i < resource_count; ++i) {
+        refs[i] = resman->loadAsync<BenchLoadResource>(
+            benchLoadResourceId(async_dir, i), eResourcePriorityVisible,
+            [&async_loaded](const ResourceRef<BenchLoadResource>& ref) {
+                async_loaded += ref.isLoaded() ? 1 : 0;
+            }
+        );
+    }
+    const float submit_ms = timer_.stop() * 1000.f;
+    float update_ms = .0f;
+    float max_update_ms = .0f;
+    int update_count = 0;
+    timer timer_update;
+    while (resman->getLoadsInFlight() > 0) {
+        timer_update.start();
+        resman->update();
+        const float ms = timer_update.stop() * 1000.f;
+        update_ms += ms;
+        max_update_ms = std::max(max_update_ms, ms);
+        ++update_count;
+        std::this_thread::yield();
+    }
+    const float async_ms = timer_.stop() * 1000.f;
+    for (auto& r : refs) {
+        r.reset();
+    }
+    resman->collectGarbage();
+    std::filesystem::remove_all(root);
+
+    LOG("  load: " << sync_ms << " ms, all of it on the main thread, " << sync_loaded << " loaded");
+    LOG("  loadAsync: " << async_ms << " ms, main thread " << submit_ms << " ms submitting and " << update_ms << " ms in "
+        << update_count << " update() calls, longest " << max_update_ms << " ms, " << async_loaded << " loaded");
+    LOG("  " << sync_ms / async_ms << "x wall time, " << sync_ms / (submit_ms + update_ms) << "x main thread time");
+}
@@ -0,0 +1,154 @@
+#include "bench.hpp"
+
+#include <random>
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "world/common_systems/scene_system.hpp"
+#include "world/common_systems/bvh_visibility_provider.hpp"
+
+
+// A large open level of small proxies, a fraction of them moving every frame, seen by
+// several views at once like a camera with shadow cascades. Culls by testing every proxy
+// against every frustum, then through the stock provider one view at a time, then all views
+// in a single traversal. Visible counts have to match the brute force ones
+
+// There is no gpu here, the "bucket" a proxy submits to is a counter
+struct BenchVisProxy : public SceneProxy {
+    gfxm::vec3 pos;
+    float half_size = .5f;
+
+    void updateBounds() override {
+        setBoundingBox(gfxm::aabb(pos - gfxm::vec3(half_size, half_size, half_size), pos + gfxm::vec3(half_size, half_size, half_size)));
+    }
+    void submit(gpuRenderBucket* bucket) override {
+        ++*reinterpret_cast<int*>(bucket);
+    }
+};
+
+void benchSceneVisibility(const ConsoleCommand& cmd) {
+    const int proxy_count = std::max(1, cmd.arg<int>(0, 100000));
+    const int view_count = std::max(1, cmd.arg<int>(1, 4));
+    const int frame_count = std::max(1, cmd.arg<int>(2, 100));
+    const float LEVEL_SIZE = 2000.f;
+    const float MOVING_FRACTION = .05f;
+    LOG("bench.scene_visibility: " << proxy_count << " proxies, " << view_count << " views, " << frame_count << " frames");
+
+    std::mt19937 rng(1337);
+    std::uniform_real_distribution<float> pos_dist(.0f, LEVEL_SIZE);
+    std::uniform_real_distribution<float> size_dist(.25f, 2.f);
+    std::uniform_real_distribution<float> step_dist(-1.f, 1.f);
+
+    SceneSystem sys;
+    std::vector<BenchVisProxy> proxies(proxy_count);
+    for (auto& p : proxies) {
+        p.pos = gfxm::vec3(pos_dist(rng), pos_dist(rng) * .02f, pos_dist(rng));
+        p.half_size = size_dist(rng);
+        sys.addProxy(&p);
+    }
+    BvhVisibilityProvider* bvh = dynamic_cast<BvhVisibilityProvider*>(sys.getProvider());
+    if (!bvh) {
+        LOG_WARN("bench.scene_visibility: SceneSystem has no stock provider");
+        return;
+    }
+    sys.updateProxies();
+    LOG("  tree height " << bvh->getHeight() << " over " << bvh->getProxyCount() << " proxies");
+
+    // The first view is the main camera, the rest look further out like shadow cascades would
+    const gfxm::mat4 proj = gfxm::perspective(gfxm::radian(65.f), 16.f / 9.f, .1f, 300.f);
+    std::vector<VisibilityQuery> queries;
+    std::vector<int> counters(view_count);
+    std::vector<gpuRenderBucket*> buckets(view_count);
+    for (int v = 0; v < view_count; ++v) {
+        buckets[v] = reinterpret_cast<gpuRenderBucket*>(&counters[v]);
+    }
+    auto makeViews = [&](int frame) {
+        queries.clear();
+        const float angle = frame * .01f;
+        const gfxm::vec3 eye(LEVEL_SIZE * .5f + cosf(angle) * 200.f, 20.f, LEVEL_SIZE * .5f + sinf(angle) * 200.f);
+        for (int v = 0; v < view_count; ++v) {
+            const float yaw = angle + v * .3f;
+            const gfxm::vec3 target = eye + gfxm::vec3(cosf(yaw), -.1f * v, sinf(yaw));
+            queries.push_back(VisibilityQuery(proj, gfxm::lookAt(eye, target, gfxm::vec3(0, 1, 0)), v));
+        }
+    };
+    auto moveProxies = [&]() {
+        const int moving = (int)(proxy_count * MOVING_FRACTION);
+        for (int i = 0; i < moving; ++i) {
+            auto& p = proxies[rng() % proxy_count];
+            p.pos += gfxm::vec3(step_dist(rng), .0f, step_dist(rng));
+            p.markDirty();
+        }
+    };
+
+    std::vector<int> ref_visible(view_count);
+    int mismatches = 0;
+    auto check = [&]() {
+        for (int v = 0; v < view_count; ++v) {
+            if (counters[v] != ref_visible[v]) {
+                ++mismatches;
+            }
+            counters[v] = 0;
+        }
+    };
+
+    timer timer_;
+    float update_ms = .0f;
+    float brute_ms = .0f;
+    float single_ms = .0f;
+    float multi_ms = .0f;
+    VisibilityStats multi_stats;
+    for (int f = 0; f < frame_count; ++f) {
+        moveProxies();
+        timer_.start();
+        sys.updateProxies();
+        update_ms += timer_.stop() * 1000.f;
+
+        makeViews(f);
+
+        timer_.start();
+        for (int v = 0; v < view_count; ++v) {
+            int visible = 0;
+            for (auto& p : proxies) {
+                if (gfxm::intersect_frustum_aabb(queries[v].fru, p.getBoundingBox())) {
+                    ++visible;
+                }
+            }
+            ref_visible[v] = visible;
+        }
+        brute_ms += timer_.stop() * 1000.f;
+
+        timer_.start();
+        for (int v = 0; v < view_count; ++v) {
+            sys.collectVisible(queries[v], buckets[v]);
+        }
+        single_ms += timer_.stop() * 1000.f;
+        check();
+
+        timer_.start();
+        sys.collectVisible(queries.data(), buckets.data(), view_count);
+        multi_ms += timer_.stop() * 1000.f;
+        check();
+
+        for (int v = 0; v < bvh->getStatsCount(); ++v) {
+            multi_stats.nodes_tested += bvh->getStats(v).nodes_tested;
+            multi_stats.visible += bvh->getStats(v).visible;
+            multi_stats.culled += bvh->getStats(v).culled;
+        }
+    }
+
+    LOG("  tree refit " << update_ms / frame_count << " ms/frame, " << (int)(proxy_count * MOVING_FRACTION) << " moving");
+    LOG("  brute force " << brute_ms / frame_count << " ms/frame");
+    LOG("  tree, one view at a time " << single_ms / frame_count << " ms/frame");
+    LOG("  tree, all views in one pass " << multi_ms / frame_count << " ms/frame");
+    LOG("  per view and frame: " << multi_stats.visible / (frame_count * view_count) << " visible, "
+        << multi_stats.culled / (frame_count * view_count) << " culled, "
+        << multi_stats.nodes_tested / (frame_count * view_count) << " node tests");
+    if (mismatches) {
+        LOG_WARN("    visible counts differ from brute force in " << mismatches << " view(s)");
+    }
+
+    for (auto& p : proxies) {
+        sys.removeProxy(&p);
+    }
+}
@@ -0,0 +1,204 @@
+#include "bench.hpp"
+
+#include <random>
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "util/thread_pool.hpp"
+#include "gpu/skinning/skinning_cpu.hpp"
+
+
+// Characters sharing one skinned mesh, each with its own pose and output streams, like
+// instances of the same model. Skins all of them with the plain port of the compute shader,
+// then the blended matrix kernels on sse and avx2, on one thread and split over the pool the
+// same way the cpu backend does it. Every result is checked against the port.
+// Dual quaternion blending is checked on the vertices that follow a single bone, where it has
+// to land on the same spot as linear blending
+
+struct BenchSkinMesh {
+    std::vector<gfxm::vec3> positions;
+    std::vector<gfxm::vec3> normals;
+    std::vector<gfxm::vec3> tangents;
+    std::vector<gfxm::vec3> bitangents;
+    std::vector<gfxm::ivec4> bone_indices;
+    std::vector<gfxm::vec4> bone_weights;
+};
+
+struct BenchSkinCharacter {
+    std::vector<gfxm::mat4> poses;
+    std::vector<gpuSkinDualQuat> dual_quats;
+    std::vector<gfxm::vec3> out_positions;
+    std::vector<gfxm::vec3> out_normals;
+    std::vector<gfxm::vec3> out_tangents;
+    std::vector<gfxm::vec3> out_bitangents;
+    gpuSkinCpuStreams streams;
+};
+
+static void benchMakeSkinMesh(BenchSkinMesh& mesh, int vertex_count, int bone_count, std::mt19937& rng) {
+    std::uniform_real_distribution<float> unit_dist(-1.f, 1.f);
+    std::uniform_int_distribution<int> bone_dist(0, bone_count - 1);
+    mesh.positions.resize(vertex_count);
+    mesh.normals.resize(vertex_count);
+    mesh.tangents.resize(vertex_count);
+    mesh.bitangents.resize(vertex_count);
+    mesh.bone_indices.resize(vertex_count);
+    mesh.bone_weights.resize(vertex_count);
+    for (int i = 0; i < vertex_count; ++i) {
+        mesh.positions[i] = gfxm::vec3(unit_dist(rng) * .3f, (i * 1.8f) / vertex_count, unit_dist(rng) * .3f);
+        mesh.normals[i] = gfxm::normalize(gfxm::vec3(unit_dist(rng), unit_dist(rng), unit_dist(rng)));
+        mesh.tangents[i] = gfxm::normalize(gfxm::cross(mesh.normals[i], gfxm::vec3(0, 1, 0)));
+        mesh.bitangents[i] = gfxm::cross(mesh.normals[i], mesh.tangents[i]);
+        // Every eighth vertex follows one bone only
+        if (i % 8 == 0) {
+            const int b = bone_dist(rng);
+            mesh.bone_indices[i] = gfxm::ivec4(b, 0, 0, 0);
+            mesh.bone_weights[i] = gfxm::vec4(1.f, .0f, .0f, .0f);
+            continue;
+        }
+        gfxm::vec4 w(fabsf(unit_dist(rng)), fabsf(unit_dist(rng)), fabsf(unit_dist(rng)), fabsf(unit_dist(rng)));
+        w = w / (w.x + w.y + w.z + w.w + FLT_EPSILON);
+        mesh.bone_indices[i] = gfxm::ivec4(bone_dist(rng), bone_dist(rng), bone_dist(rng), bone_dist(rng));
+        mesh.bone_weights[i] = w;
+    }
+}
+
+static void benchPoseCharacter(BenchSkinCharacter& ch, int character, int frame) {
+    for (int b = 0; b < ch.poses.size(); ++b) {
+        const float angle = sinf(frame * .1f + b * .4f + character) * .7f;
+        const gfxm::quat q = gfxm::angle_axis(angle, gfxm::normalize(gfxm::vec3(.3f, 1.f, .2f * b)));
+        gfxm::mat4 m = gfxm::to_mat4(q);
+        m[3] = gfxm::vec4((float)(character % 20), b * .03f, (float)(character / 20), 1.f);
+        ch.poses[b] = m;
+    }
+}
+
+void benchSkinning(const ConsoleCommand& cmd) {
+    const int character_count = std::max(1, cmd.arg<int>(0, 200));
+    const int vertex_count = std::max(1, cmd.arg<int>(1, 6000));
+    const int bone_count = std::max(1, cmd.arg<int>(2, 60));
+    const int thread_count = std::max(1, cmd.arg<int>(3, 4));
+    const int frame_count = 10;
+    const int JOB_VERTEX_COUNT = 4096;
+    LOG("bench.skinning: " << character_count << " characters, " << vertex_count << " vertices, "
+        << bone_count << " bones, " << frame_count << " frames");
+    if (!gpuSkinCpuHasAvx2()) {
+        LOG("  no avx2 on this cpu, the avx2 runs use sse");
+    }
+
+    std::mt19937 rng(1337);
+    BenchSkinMesh mesh;
+    benchMakeSkinMesh(mesh, vertex_count, bone_count, rng);
+
+    std::vector<BenchSkinCharacter> characters(character_count);
+    for (auto& ch : characters) {
+        ch.poses.resize(bone_count);
+        ch.dual_quats.resize(bone_count);
+        ch.out_positions.resize(vertex_count);
+        ch.out_normals.resize(vertex_count);
+        ch.out_tangents.resize(vertex_count);
+        ch.out_bitangents.resize(vertex_count);
+        auto& s = ch.streams;
+        s.vertex_count = vertex_count;
+        s.positions = mesh.positions.data();
+        s.normals = mesh.normals.data();
+        s.tangents = mesh.tangents.data();
+        s.bitangents = mesh.bitangents.data();
+        s.bone_indices = mesh.bone_indices.data();
+        s.bone_weights = mesh.bone_weights.data();
+        s.out_positions = ch.out_positions.data();
+        s.out_normals = ch.out_normals.data();
+        s.out_tangents = ch.out_tangents.data();
+        s.out_bitangents = ch.out_bitangents.data();
+    }
+
+    // Reference results for the last frame, one character at a time to keep the memory down
+    BenchSkinCharacter ref;
+    ref.out_positions.resize(vertex_count);
+    ref.out_normals.resize(vertex_count);
+    ref.out_tangents.resize(vertex_count);
+    ref.out_bitangents.resize(vertex_count);
+    auto refStreams = [&](const BenchSkinCharacter& ch) {
+        gpuSkinCpuStreams s = ch.streams;
+        s.out_positions = ref.out_positions.data();
+        s.out_normals = ref.out_normals.data();
+        s.out_tangents = ref.out_tangents.data();
+        s.out_bitangents = ref.out_bitangents.data();
+        return s;
+    };
+    auto maxDiff = [&](bool single_bone_only) {
+        float max_diff = .0f;
+        for (int c = 0; c < character_count; ++c) {
+            auto& ch = characters[c];
+            gpuSkinCpuReference(ch.poses.data(), refStreams(ch), 0, vertex_count);
+            for (int i = 0; i < vertex_count; ++i) {
+                if (single_bone_only && i % 8 != 0) {
+                    continue;
+                }
+                max_diff = std::max(max_diff, gfxm::length(ch.out_positions[i] - ref.out_positions[i]));
+                max_diff = std::max(max_diff, gfxm::length(ch.out_normals[i] - ref.out_normals[i]));
+                max_diff = std::max(max_diff, gfxm::length(ch.out_tangents[i] - ref.out_tangents[i]));
+                max_diff = std::max(max_diff, gfxm::length(ch.out_bitangents[i] - ref.out_bitangents[i]));
+            }
+        }
+        return max_diff;
+    };
+
+    std::vector<std::pair<int, int>> jobs; // character, first vertex
+    for (int c = 0; c < character_count; ++c) {
+        for (int first = 0; first < vertex_count; first += JOB_VERTEX_COUNT) {
+            jobs.push_back(std::make_pair(c, first));
+        }
+    }
+    ThreadPool pool(thread_count);
+
+    timer timer_;
+    // Dual quaternions are made serially before the jobs, like the cpu backend does
+    auto run = [&](const char* name, auto&& skin_fn, bool threaded, bool dual_quat) {
+        float ms = .0f;
+        for (int f = 0; f < frame_count; ++f) {
+            for (int c = 0; c < character_count; ++c) {
+                benchPoseCharacter(characters[c], c, f);
+            }
+            timer_.start();
+            if (dual_quat) {
+                for (auto& ch : characters) {
+                    gpuSkinCpuMakeDualQuats(ch.poses.data(), (int)ch.poses.size(), ch.dual_quats.data());
+                }
+            }
+            if (threaded) {
+                pool.run((int)jobs.size(), [&](int j) {
+                    const int c = jobs[j].first;
+                    const int first = jobs[j].second;
+                    skin_fn(characters[c], first, std::min(JOB_VERTEX_COUNT, vertex_count - first));
+                });
+            } else {
+                for (auto& ch : characters) {
+                    skin_fn(ch, 0, vertex_count);
+                }
+            }
+            ms += timer_.stop() * 1000.f;
+        }
+        const float diff = maxDiff(dual_quat);
+        LOG("  " << name << " " << ms / frame_count << " ms/frame");
+        if (diff > 1e-3f) {
+            LOG_WARN("    differs from the reference by up to " << diff);
+        }
+    };
+
+    run("reference", [](BenchSkinCharacter& ch, int first, int count) {
+        gpuSkinCpuReference(ch.poses.data(), ch.streams, first, count);
+    }, false, false);
+    run("linear, sse", [](BenchSkinCharacter& ch, int first, int count) {
+        gpuSkinCpuLinear(ch.poses.data(), ch.streams, first, count, false);
+    }, false, false);
+    run("linear, avx2", [](BenchSkinCharacter& ch, int first, int count) {
+        gpuSkinCpuLinear(ch.poses.data(), ch.streams, first, count);
+    }, false, false);
+    LOG("  on " << thread_count << " threads:");
+    run("linear, avx2", [](BenchSkinCharacter& ch, int first, int count) {
+        gpuSkinCpuLinear(ch.poses.data(), ch.streams, first, count);
+    }, true, false);
+    run("dual quaternion", [](BenchSkinCharacter& ch, int first, int count) {
+        gpuSkinCpuDualQuat(ch.dual_quats.data(), ch.streams, first, count);
+    }, true, true);
+}
@@ -0,0 +1,225 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "typeface/font.hpp"
+#include "text_layout/text_layout.hpp"
+#include "text_layout/text_layout_cache.hpp"
+
+
+// Hud style labels laid out every frame, a few of them changing (counters, timers, health).
+// Immediate: a fresh TextLayout per label per frame like xui::Host debug text did, then TextLayoutCache.
+// Retained: a TextLayout per label like the gui text elements keep, edits relaid out
+// from scratch (what every setString() did before) or from the first changed character.
+// Last, a log window: one long multiline layout getting a line appended per frame.
+// Checks cached and incrementally built glyphs against a fresh layout
+
+static const int BENCH_TEXT_LAYOUT_FRAMES = 30;
+static const int BENCH_TEXT_LAYOUT_WRAP_WIDTH = 200;
+
+static std::string benchMakeLabel(int i, int frame) {
+    char buf[128];
+    snprintf(
+        buf, sizeof(buf), "Entity %05d  pos %.1f %.1f %.1f  hp %d/100",
+        i, (i % 97) * .5f, (i % 13) * 1.5f, -(i % 31) * .25f, 100 - (i + frame) % 100
+    );
+    return buf;
+}
+
+static bool benchSameGlyphs(const std::vector<TextLayout::GlyphInstance>& a, const std::vector<TextLayout::GlyphInstance>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (int i = 0; i < a.size(); ++i) {
+        const auto& ga = a[i];
+        const auto& gb = b[i];
+        if (ga.renderable != gb.renderable
+            || ga.glyph_rect.min.x != gb.glyph_rect.min.x || ga.glyph_rect.min.y != gb.glyph_rect.min.y
+            || ga.glyph_rect.max.x != gb.glyph_rect.max.x || ga.glyph_rect.max.y != gb.glyph_rect.max.y
+            || ga.lut_values[0] != gb.lut_values[0]
+        ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void benchTextLayoutImmediate(Font* font, const std::vector<std::string>& labels, int edits_per_frame) {
+    timer timer_;
+    size_t quad_count = 0;
+
+    timer_.start();
+    for (int frame = 0; frame < BENCH_TEXT_LAYOUT_FRAMES; ++frame) {
+        for (int i = 0; i < labels.size(); ++i) {
+            TextLayout layout;
+            layout.build(labels[i], font, (i & 1) ? BENCH_TEXT_LAYOUT_WRAP_WIDTH : -1);
+            for (int j = 0; j < layout.glyphs.size(); ++j) {
+                if (layout.glyphs[j].renderable) {
+                    quad_count += layout.glyphs[j].makeQuad().rgba[0] != 0;
+                }
+            }
+        }
+    }
+    const float uncached_ms = timer_.stop() * 1000.f / BENCH_TEXT_LAYOUT_FRAMES;
+
+    TextLayoutCache cache;
+    for (int i = 0; i < labels.size(); ++i) {
+        cache.get(labels[i], font, (i & 1) ? BENCH_TEXT_LAYOUT_WRAP_WIDTH : -1);
+    }
+    cache.endFrame();
+
+    timer_.start();
+    for (int frame = 0; frame < BENCH_TEXT_LAYOUT_FRAMES; ++frame) {
+        for (int i = 0; i < labels.size(); ++i) {
+            quad_count += cache.get(labels[i], font, (i & 1) ? BENCH_TEXT_LAYOUT_WRAP_WIDTH : -1).quads.size();
+        }
+        cache.endFrame();
+    }
+    const float steady_ms = timer_.stop() * 1000.f / BENCH_TEXT_LAYOUT_FRAMES;
+
+    std::vector<std::string> edited = labels;
+    const int misses_before = cache.getMissCount();
+    timer_.start();
+    for (int frame = 0; frame < BENCH_TEXT_LAYOUT_FRAMES; ++frame) {
+        for (int e = 0; e < edits_per_frame; ++e) {
+            const int i = (frame * edits_per_frame + e) * 7919 % edited.size();
+            edited[i] = benchMakeLabel(i, frame + 1);
+        }
+        for (int i = 0; i < edited.size(); ++i) {
+            quad_count += cache.get(edited[i], font, (i & 1) ? BENCH_TEXT_LAYOUT_WRAP_WIDTH : -1).quads.size();
+        }
+        cache.endFrame();
+    }
+    const float edits_ms = timer_.stop() * 1000.f / BENCH_TEXT_LAYOUT_FRAMES;
+    const int edit_misses = cache.getMissCount() - misses_before;
+
+    int mismatches = 0;
+    for (int i = 0; i < edited.size(); ++i) {
+        const int width = (i & 1) ? BENCH_TEXT_LAYOUT_WRAP_WIDTH : -1;
+        TextLayout fresh;
+        fresh.build(edited[i], font, width);
+        mismatches += !benchSameGlyphs(cache.get(edited[i], font, width).layout.glyphs, fresh.glyphs);
+    }
+
+    LOG("  immediate, new TextLayout per label: " << uncached_ms << " ms/frame");
+    LOG("  immediate, TextLayoutCache steady:   " << steady_ms << " ms/frame, " << cache.size() << " entries");
+    LOG("  immediate, TextLayoutCache edited:   " << edits_ms << " ms/frame, " << edit_misses / BENCH_TEXT_LAYOUT_FRAMES << " misses/frame");
+    LOG("  (" << quad_count << " quads total)");
+    if (mismatches) {
+        LOG_WARN("  " << mismatches << " cached layouts differ from a fresh build");
+    }
+}
+
+static void benchTextLayoutRetained(Font* font, const std::vector<std::string>& labels, int edits_per_frame) {
+    timer timer_;
+    float times_ms[2] = { .0f, .0f };
+    int mismatches = 0;
+
+    for (int incremental = 0; incremental < 2; ++incremental) {
+        std::vector<std::string> strings = labels;
+        std::vector<TextLayout> layouts(strings.size());
+        for (int i = 0; i < layouts.size(); ++i) {
+            layouts[i].setFont(font);
+            layouts[i].setWidth((i & 1) ? std::optional<int>(BENCH_TEXT_LAYOUT_WRAP_WIDTH) : std::nullopt);
+            layouts[i].setString(strings[i].data(), strings[i].size());
+            layouts[i].build();
+        }
+
+        timer_.start();
+        for (int frame = 0; frame < BENCH_TEXT_LAYOUT_FRAMES; ++frame) {
+            for (int e = 0; e < edits_per_frame; ++e) {
+                const int i = (frame * edits_per_frame + e) * 7919 % strings.size();
+                strings[i] = benchMakeLabel(i, frame + 1);
+                layouts[i].setString(strings[i].data(), strings[i].size());
+                if (!incremental) {
+                    // What any setString() cost before: everything from the first character
+                    layouts[i].setFont(font);
+                }
+            }
+            for (int i = 0; i < layouts.size(); ++i) {
+                layouts[i].build();
+            }
+        }
+        times_ms[incremental] = timer_.stop() * 1000.f / BENCH_TEXT_LAYOUT_FRAMES;
+
+        for (int i = 0; incremental && i < layouts.size(); ++i) {
+            TextLayout fresh;
+            fresh.setFont(font);
+            fresh.setWidth(layouts[i].width_constraint);
+            fresh.setString(strings[i].data(), strings[i].size());
+            fresh.build();
+            mismatches += !benchSameGlyphs(layouts[i].glyphs, fresh.glyphs);
+        }
+    }
+
+    LOG("  retained, " << edits_per_frame << " edits/frame: full relayout " << times_ms[0] << " ms/frame, incremental " << times_ms[1] << " ms/frame");
+    if (mismatches) {
+        LOG_WARN("  " << mismatches << " incremental layouts differ from a fresh build");
+    }
+}
+
+static void benchTextLayoutLogWindow(Font* font, int line_count) {
+    timer timer_;
+    float times_ms[2] = { .0f, .0f };
+    int mismatches = 0;
+
+    for (int incremental = 0; incremental < 2; ++incremental) {
+        std::string text;
+        for (int i = 0; i < line_count; ++i) {
+            text += "[info] " + benchMakeLabel(i, 0) + " loaded\n";
+        }
+        TextLayout layout;
+        layout.setFont(font);
+        layout.setWidth(BENCH_TEXT_LAYOUT_WRAP_WIDTH * 2);
+        layout.setString(text.data(), text.size());
+        layout.build();
+
+        timer_.start();
+        for (int frame = 0; frame < BENCH_TEXT_LAYOUT_FRAMES; ++frame) {
+            text += "[warn] " + benchMakeLabel(frame, frame) + " is late\n";
+            layout.setString(text.data(), text.size());
+            if (!incremental) {
+                layout.setFont(font);
+            }
+            layout.build();
+        }
+        times_ms[incremental] = timer_.stop() * 1000.f / BENCH_TEXT_LAYOUT_FRAMES;
+
+        if (incremental) {
+            TextLayout fresh;
+            fresh.setFont(font);
+            fresh.setWidth(BENCH_TEXT_LAYOUT_WRAP_WIDTH * 2);
+            fresh.setString(text.data(), text.size());
+            fresh.build();
+            mismatches += !benchSameGlyphs(layout.glyphs, fresh.glyphs);
+        }
+    }
+
+    LOG("  log window, " << line_count << " lines + 1/frame: full relayout " << times_ms[0] << " ms/frame, incremental " << times_ms[1] << " ms/frame");
+    if (mismatches) {
+        LOG_WARN("  incremental log layout differs from a fresh build");
+    }
+}
+
+void benchTextLayout(const ConsoleCommand& cmd) {
+    const int label_count = std::max(1, cmd.arg<int>(0, 10000));
+    const int edits_per_frame = std::max(0, cmd.arg<int>(1, 100));
+
+    std::shared_ptr<Font> font = fontGet("fonts/ProggyClean.ttf", 16, 72);
+    if (!font) {
+        LOG_WARN("bench.text_layout: failed to load fonts/ProggyClean.ttf");
+        return;
+    }
+
+    LOG("bench.text_layout: " << label_count << " labels, " << edits_per_frame << " edited per frame, every other one wrapped at " << BENCH_TEXT_LAYOUT_WRAP_WIDTH << "px");
+    std::vector<std::string> labels(label_count);
+    for (int i = 0; i < label_count; ++i) {
+        labels[i] = benchMakeLabel(i, 0);
+    }
+    benchTextLayoutImmediate(font.get(), labels, edits_per_frame);
+    benchTextLayoutRetained(font.get(), labels, edits_per_frame);
+    benchTextLayoutLogWindow(font.get(), 2000);
+}
@@ -0,0 +1,160 @@
+#include "bench.hpp"
+
+#include <random>
+#include <vector>
+#include "log/log.hpp"
+#include "util/timer.hpp"
+#include "util/thread_pool.hpp"
+#include "transform_node/transform_node.hpp"
+#include "transform_node/transform_hierarchy.hpp"
+
+
+// Skeleton instances animated every frame: every bone gets a new rotation, then every bone
+// world matrix is read like skinning does. Runs on plain linked TransformNodes with their
+// recursive lazy update, then on the same nodes bound to a TransformHierarchy, reading lazily
+// and after the single update() pass, serial and threaded
+
+struct BenchTransformsSet {
+    std::vector<HTransform> nodes;
+    TransformHierarchy hierarchy;
+
+    ~BenchTransformsSet() {
+        for (auto& n : nodes) {
+            n.release();
+        }
+    }
+};
+
+static void benchMakeSkeletons(BenchTransformsSet& set, const std::vector<int>& parent_array, int skeleton_count, bool bind) {
+    const int bone_count = (int)parent_array.size();
+    set.nodes.resize(skeleton_count * bone_count);
+    for (int s = 0; s < skeleton_count; ++s) {
+        HTransform* bones = &set.nodes[s * bone_count];
+        for (int i = 0; i < bone_count; ++i) {
+            bones[i].acquire();
+            if (i == 0) {
+                bones[i]->setTranslation(gfxm::vec3((float)(s % 32), .0f, (float)(s / 32)));
+            } else {
+                bones[i]->setTranslation(gfxm::vec3(.0f, .2f, .0f));
+            }
+        }
+        if (bind) {
+            set.hierarchy.createBlock(bones, parent_array.data(), bone_count);
+        } else {
+            for (int i = 1; i < bone_count; ++i) {
+                transformNodeAttach(bones[parent_array[i]], bones[i]);
+            }
+        }
+    }
+}
+
+static void benchAnimate(BenchTransformsSet& set, int bone_count, int frame) {
+    const float phase = frame * .05f;
+    for (int n = 0; n < set.nodes.size(); ++n) {
+        const int bone = n % bone_count;
+        set.nodes[n]->setRotation(gfxm::angle_axis(sinf(phase + bone * .3f) * .3f, gfxm::vec3(.0f, .0f, 1.f)));
+    }
+}
+
+static void benchRead(BenchTransformsSet& set, std::vector<gfxm::mat4>& out) {
+    for (int n = 0; n < set.nodes.size(); ++n) {
+        out[n] = set.nodes[n]->getWorldTransform();
+    }
+}
+
+void benchTransforms(const ConsoleCommand& cmd) {
+    const int skeleton_count = std::max(1, cmd.arg<int>(0, 500));
+    const int bone_count = std::max(1, cmd.arg<int>(1, 60));
+    const int frame_count = std::max(1, cmd.arg<int>(2, 100));
+    const int thread_count = std::max(1, cmd.arg<int>(3, 4));
+
+    // Spine with limbs branching off, parents listed before children like Skeleton does
+    std::vector<int> parent_array(bone_count);
+    std::mt19937 rng(1337);
+    parent_array[0] = -1;
+    for (int i = 1; i < bone_count; ++i) {
+        std::uniform_int_distribution<int> parent_dist(std::max(0, i - 6), i - 1);
+        parent_array[i] = parent_dist(rng);
+    }
+    LOG("bench.transforms: " << skeleton_count << " skeletons, " << bone_count << " bones, " << frame_count << " frames");
+
+    const int total = skeleton_count * bone_count;
+    std::vector<gfxm::mat4> ref(total);
+    std::vector<gfxm::mat4> res(total);
+    timer timer_;
+
+    float recursive_ms = .0f;
+    {
+        BenchTransformsSet set;
+        benchMakeSkeletons(set, parent_array, skeleton_count, false);
+        timer_.start();
+        for (int f = 0; f < frame_count; ++f) {
+            benchAnimate(set, bone_count, f);
+            benchRead(set, ref);
+        }
+        recursive_ms = timer_.stop() * 1000.f;
+    }
+
+    float max_diff = .0f;
+    auto compare = [&]() {
+        for (int n = 0; n < total; ++n) {
+            for (int c = 0; c < 4; ++c) {
+                for (int r = 0; r < 4; ++r) {
+                    max_diff = std::max(max_diff, fabsf(ref[n][c][r] - res[n][c][r]));
+                }
+            }
+        }
+    };
+
+    float lazy_ms = .0f;
+    float pass_ms = .0f;
+    float threaded_ms = .0f;
+    float update_ms = .0f;
+    float threaded_update_ms = .0f;
+    timer timer_update;
+    {
+        BenchTransformsSet set;
+        benchMakeSkeletons(set, parent_array, skeleton_count, true);
+
+        timer_.start();
+        for (int f = 0; f < frame_count; ++f) {
+            benchAnimate(set, bone_count, f);
+            benchRead(set, res);
+        }
+        lazy_ms = timer_.stop() * 1000.f;
+        compare();
+
+        timer_.start();
+        for (int f = 0; f < frame_count; ++f) {
+            benchAnimate(set, bone_count, f);
+            timer_update.start();
+            set.hierarchy.update();
+            update_ms += timer_update.stop() * 1000.f;
+            benchRead(set, res);
+        }
+        pass_ms = timer_.stop() * 1000.f;
+        compare();
+
+        ThreadPool pool(thread_count);
+        timer_.start();
+        for (int f = 0; f < frame_count; ++f) {
+            benchAnimate(set, bone_count, f);
+            timer_update.start();
+            set.hierarchy.update(&pool);
+            threaded_update_ms += timer_update.stop() * 1000.f;
+            benchRead(set, res);
+        }
+        threaded_ms = timer_.stop() * 1000.f;
+        compare();
+    }
+
+    LOG("  recursive " << recursive_ms / frame_count << " ms/frame");
+    LOG("  hierarchy, read lazily " << lazy_ms / frame_count << " ms/frame");
+    LOG("  hierarchy, update pass " << pass_ms / frame_count << " ms/frame, "
+        << update_ms / frame_count << " ms of it in update()");
+    LOG("  hierarchy, update pass on " << thread_count << " threads " << threaded_ms / frame_count << " ms/frame, "
+        << threaded_update_ms / frame_count << " ms of it in update()");
+    if (max_diff > 1e-4f) {
+        LOG_WARN("    world matrices differ from the recursive update by up to " << max_diff);
+    }
+}
@@ -0,0 +1,281 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <vector>
+#include "math/gfxm.hpp"
+
+
+constexpr uint32_t AABB_TREE_NULL_NODE = 0xFFFFFFFF;
+
+template<typename PAYLOAD_T>
+struct AabbTreeNode {
+    gfxm::aabb aabb;
+    PAYLOAD_T payload;
+    union {
+        uint32_t parent;
+        uint32_t next_free;
+    };
+    uint32_t left;
+    uint32_t right;
+    int32_t height; // leaf = 0, free = -1
+
+    bool isLeaf() const { return left == AABB_TREE_NULL_NODE; }
+};
+
+// Node pool and incremental insertion shared by the dynamic trees,
+// AabbTreeFlat over rigid bodies and BvhVisibilityProvider over scene proxies.
+// The owner allocates a leaf, sets its payload and (fat) aabb, then calls insertLeaf()
+template<typename PAYLOAD_T>
+class AabbTreeDynamic {
+protected:
+    typedef AabbTreeNode<PAYLOAD_T> node_t;
+
+    std::vector<node_t> nodes;
+    uint32_t root = AABB_TREE_NULL_NODE;
+    uint32_t free_list = AABB_TREE_NULL_NODE;
+
+    uint32_t allocNode();
+    void freeNode(uint32_t id);
+
+    void insertLeaf(uint32_t leaf);
+    void removeLeaf(uint32_t leaf);
+    void rotate(uint32_t id);
+
+    static bool aabbOverlap(const gfxm::aabb& a, const gfxm::aabb& b) {
+        return a.from.x <= b.to.x && a.to.x >= b.from.x
+            && a.from.y <= b.to.y && a.to.y >= b.from.y
+            && a.from.z <= b.to.z && a.to.z >= b.from.z;
+    }
+    static bool aabbContains(const gfxm::aabb& outer, const gfxm::aabb& inner) {
+        return outer.from.x <= inner.from.x && outer.from.y <= inner.from.y && outer.from.z <= inner.from.z
+            && outer.to.x >= inner.to.x && outer.to.y >= inner.to.y && outer.to.z >= inner.to.z;
+    }
+    static float aabbArea(const gfxm::aabb& box) {
+        float x = box.to.x - box.from.x;
+        float y = box.to.y - box.from.y;
+        float z = box.to.z - box.from.z;
+        return 2.f * (x * y + y * z + z * x);
+    }
+};
+
+template<typename PAYLOAD_T>
+uint32_t AabbTreeDynamic<PAYLOAD_T>::allocNode() {
+    if (free_list == AABB_TREE_NULL_NODE) {
+        node_t n;
+        n.payload = PAYLOAD_T();
+        n.next_free = AABB_TREE_NULL_NODE;
+        n.left = AABB_TREE_NULL_NODE;
+        n.right = AABB_TREE_NULL_NODE;
+        n.height = -1;
+        free_list = (uint32_t)nodes.size();
+        nodes.push_back(n);
+    }
+    uint32_t id = free_list;
+    node_t& n = nodes[id];
+    free_list = n.next_free;
+    n.payload = PAYLOAD_T();
+    n.parent = AABB_TREE_NULL_NODE;
+    n.left = AABB_TREE_NULL_NODE;
+    n.right = AABB_TREE_NULL_NODE;
+    n.height = 0;
+    return id;
+}
+template<typename PAYLOAD_T>
+void AabbTreeDynamic<PAYLOAD_T>::freeNode(uint32_t id) {
+    assert(id < nodes.size());
+    nodes[id].next_free = free_list;
+    nodes[id].height = -1;
+    nodes[id].payload = PAYLOAD_T();
+    free_list = id;
+}
+
+template<typename PAYLOAD_T>
+void AabbTreeDynamic<PAYLOAD_T>::insertLeaf(uint32_t leaf) {
+    if (root == AABB_TREE_NULL_NODE) {
+        root = leaf;
+        nodes[root].parent = AABB_TREE_NULL_NODE;
+        return;
+    }
+
+    // Find the best sibling by descending along the cheapest surface area cost
+    const gfxm::aabb leaf_aabb = nodes[leaf].aabb;
+    uint32_t index = root;
+    while (!nodes[index].isLeaf()) {
+        const node_t& n = nodes[index];
+        float area = aabbArea(n.aabb);
+        float combined_area = aabbArea(gfxm::aabb_union(n.aabb, leaf_aabb));
+
+        // Cost of creating a new parent for this node and the new leaf
+        float cost = 2.f * combined_area;
+        // Minimum cost of pushing the leaf further down
+        float inheritance_cost = 2.f * (combined_area - area);
+
+        auto descendCost = [&](uint32_t child)->float {
+            const node_t& c = nodes[child];
+            float new_area = aabbArea(gfxm::aabb_union(leaf_aabb, c.aabb));
+            if (c.isLeaf()) {
+                return new_area + inheritance_cost;
+            }
+            return (new_area - aabbArea(c.aabb)) + inheritance_cost;
+        };
+        float cost_left = descendCost(n.left);
+        float cost_right = descendCost(n.right);
+
+        if (cost < cost_left && cost < cost_right) {
+            break;
+        }
+        index = cost_left < cost_right ? n.left : n.right;
+    }
+
+    uint32_t sibling = index;
+    uint32_t old_parent = nodes[sibling].parent;
+    uint32_t new_parent = allocNode();
+    {
+        node_t& np = nodes[new_parent];
+        np.parent = old_parent;
+        np.aabb = gfxm::aabb_union(leaf_aabb, nodes[sibling].aabb);
+        np.height = nodes[sibling].height + 1;
+        np.left = sibling;
+        np.right = leaf;
+    }
+    nodes[sibling].parent = new_parent;
+    nodes[leaf].parent = new_parent;
+
+    if (old_parent != AABB_TREE_NULL_NODE) {
+        if (nodes[old_parent].left == sibling) {
+            nodes[old_parent].left = new_parent;
+        } else {
+            nodes[old_parent].right = new_parent;
+        }
+    } else {
+        root = new_parent;
+    }
+
+    // Refit ancestors, rotating where it lowers the surface area
+    index = nodes[leaf].parent;
+    while (index != AABB_TREE_NULL_NODE) {
+        rotate(index);
+
+        node_t& n = nodes[index];
+        n.aabb = gfxm::aabb_union(nodes[n.left].aabb, nodes[n.right].aabb);
+        n.height = 1 + gfxm::_max(nodes[n.left].height, nodes[n.right].height);
+        index = n.parent;
+    }
+}
+
+template<typename PAYLOAD_T>
+void AabbTreeDynamic<PAYLOAD_T>::removeLeaf(uint32_t leaf) {
+    if (leaf == root) {
+        root = AABB_TREE_NULL_NODE;
+        return;
+    }
+
+    uint32_t parent = nodes[leaf].parent;
+    uint32_t grand_parent = nodes[parent].parent;
+    uint32_t sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+    if (grand_parent != AABB_TREE_NULL_NODE) {
+        if (nodes[grand_parent].left == parent) {
+            nodes[grand_parent].left = sibling;
+        } else {
+            nodes[grand_parent].right = sibling;
+        }
+        nodes[sibling].parent = grand_parent;
+        freeNode(parent);
+
+        uint32_t index = grand_parent;
+        while (index != AABB_TREE_NULL_NODE) {
+            node_t& n = nodes[index];
+            n.aabb = gfxm::aabb_union(nodes[n.left].aabb, nodes[n.right].aabb);
+            n.height = 1 + gfxm::_max(nodes[n.left].height, nodes[n.right].height);
+            index = n.parent;
+        }
+    } else {
+        root = sibling;
+        nodes[sibling].parent = AABB_TREE_NULL_NODE;
+        freeNode(parent);
+    }
+    nodes[leaf].parent = AABB_TREE_NULL_NODE;
+}
+
+// Tree rotation by surface area:
+// tries swapping one child of A with a grandchild under the other child,
+// keeps the swap that shrinks the affected child's area the most
+//
+//       A
+//     /   \
+//    B     C
+//   / \   / \
+//  D   E F   G
+template<typename PAYLOAD_T>
+void AabbTreeDynamic<PAYLOAD_T>::rotate(uint32_t a) {
+    node_t& A = nodes[a];
+    uint32_t b = A.left;
+    uint32_t c = A.right;
+    const node_t& B = nodes[b];
+    const node_t& C = nodes[c];
+
+    if (B.isLeaf() && C.isLeaf()) {
+        return;
+    }
+
+    enum ROTATION { NONE, B_F, B_G, C_D, C_E };
+    ROTATION best_rotation = NONE;
+    float best_cost = .0f;
+
+    if (!C.isLeaf()) {
+        float area_c = aabbArea(C.aabb);
+        // B <-> F, C becomes B + G
+        float cost_bf = aabbArea(gfxm::aabb_union(B.aabb, nodes[C.right].aabb)) - area_c;
+        // B <-> G, C becomes B + F
+        float cost_bg = aabbArea(gfxm::aabb_union(B.aabb, nodes[C.left].aabb)) - area_c;
+        if (cost_bf < best_cost) { best_cost = cost_bf; best_rotation = B_F; }
+        if (cost_bg < best_cost) { best_cost = cost_bg; best_rotation = B_G; }
+    }
+    if (!B.isLeaf()) {
+        float area_b = aabbArea(B.aabb);
+        // C <-> D, B becomes C + E
+        float cost_cd = aabbArea(gfxm::aabb_union(C.aabb, nodes[B.right].aabb)) - area_b;
+        // C <-> E, B becomes C + D
+        float cost_ce = aabbArea(gfxm::aabb_union(C.aabb, nodes[B.left].aabb)) - area_b;
+        if (cost_cd < best_cost) { best_cost = cost_cd; best_rotation = C_D; }
+        if (cost_ce < best_cost) { best_cost = cost_ce; best_rotation = C_E; }
+    }
+
+    auto swapIntoA = [this, a](uint32_t a_child, uint32_t inner, bool grandchild_is_left, bool a_child_is_left) {
+        node_t& I = nodes[inner];
+        uint32_t grandchild = grandchild_is_left ? I.left : I.right;
+        if (a_child_is_left) {
+            nodes[a].left = grandchild;
+        } else {
+            nodes[a].right = grandchild;
+        }
+        nodes[grandchild].parent = a;
+        if (grandchild_is_left) {
+            I.left = a_child;
+        } else {
+            I.right = a_child;
+        }
+        nodes[a_child].parent = inner;
+        I.aabb = gfxm::aabb_union(nodes[I.left].aabb, nodes[I.right].aabb);
+        I.height = 1 + gfxm::_max(nodes[I.left].height, nodes[I.right].height);
+    };
+
+    switch (best_rotation) {
+    case NONE:
+        break;
+    case B_F:
+        swapIntoA(b, c, true, true);
+        break;
+    case B_G:
+        swapIntoA(b, c, false, true);
+        break;
+    case C_D:
+        swapIntoA(c, b, true, false);
+        break;
+    case C_E:
+        swapIntoA(c, b, false, false);
+        break;
+    }
+}
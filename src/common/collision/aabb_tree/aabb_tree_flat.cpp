@@ -0,0 +1,158 @@
+#include "aabb_tree_flat.hpp"
+
+#include "collision/collider.hpp"
+
+
+AabbTreeFlat::AabbTreeFlat(int initial_capacity) {
+    nodes.reserve(initial_capacity);
+}
+
+uint32_t AabbTreeFlat::createProxy(const gfxm::aabb& aabb, phyRigidBody* collider) {
+    uint32_t id = allocNode();
+    AabbTreeFlatNode& n = nodes[id];
+    n.aabb = gfxm::aabb_grow(aabb, AABB_TREE_FAT_MARGIN);
+    n.payload = collider;
+    n.height = 0;
+    insertLeaf(id);
+    ++leaf_count;
+    return id;
+}
+void AabbTreeFlat::destroyProxy(uint32_t proxy) {
+    assert(proxy < nodes.size());
+    assert(nodes[proxy].isLeaf());
+    removeLeaf(proxy);
+    freeNode(proxy);
+    --leaf_count;
+}
+bool AabbTreeFlat::moveProxy(uint32_t proxy, const gfxm::aabb& aabb, const gfxm::vec3& displacement) {
+    assert(proxy < nodes.size());
+    assert(nodes[proxy].isLeaf());
+
+    gfxm::aabb fat = gfxm::aabb_grow(aabb, AABB_TREE_FAT_MARGIN);
+    const gfxm::vec3 d = displacement * AABB_TREE_DISPLACEMENT_MULTIPLIER;
+    if (d.x < .0f) { fat.from.x += d.x; } else { fat.to.x += d.x; }
+    if (d.y < .0f) { fat.from.y += d.y; } else { fat.to.y += d.y; }
+    if (d.z < .0f) { fat.from.z += d.z; } else { fat.to.z += d.z; }
+
+    const gfxm::aabb& old_fat = nodes[proxy].aabb;
+    if (aabbContains(old_fat, aabb)) {
+        // Still enclosed, but reinsert anyway if the old box has become
+        // much larger than needed (body slowed down or stopped)
+        gfxm::aabb huge = gfxm::aabb_grow(fat, AABB_TREE_FAT_MARGIN * 4.f);
+        if (aabbContains(huge, old_fat)) {
+            return false;
+        }
+    }
+
+    removeLeaf(proxy);
+    nodes[proxy].aabb = fat;
+    insertLeaf(proxy);
+    return true;
+}
+
+float AabbTreeFlat::getAreaRatio() const {
+    if (root == AABB_TREE_NULL_NODE) {
+        return .0f;
+    }
+    float root_area = aabbArea(nodes[root].aabb);
+    float total_area = .0f;
+    for (int i = 0; i < nodes.size(); ++i) {
+        const AabbTreeFlatNode& n = nodes[i];
+        if (n.height < 0) {
+            continue;
+        }
+        total_area += aabbArea(n.aabb);
+    }
+    return root_area > .0f ? total_area / root_area : .0f;
+}
+
+uint32_t AabbTreeFlat::testRayPacket(const AabbTreeRayPacket& p, const gfxm::aabb& box, uint32_t lanes) {
+    uint32_t result = 0;
+#if PHY_SSE
+    const __m128 zero = _mm_setzero_ps();
+    for (int base = 0; base < AABB_TREE_RAY_PACKET_SIZE; base += 4) {
+        if (((lanes >> base) & 0xF) == 0) {
+            continue;
+        }
+        const __m128 r = _mm_load_ps(p.radius + base);
+        __m128 t_near = zero;
+        __m128 t_far = _mm_load_ps(p.t_max + base);
+        for (int i = 0; i < 3; ++i) {
+            const __m128 o = _mm_load_ps(p.origin[i] + base);
+            const __m128 inv_d = _mm_load_ps(p.inv_direction[i] + base);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_set1_ps(box.from[i]), r), o), inv_d);
+            __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_set1_ps(box.to[i]), r), o), inv_d);
+            t_near = _mm_max_ps(t_near, _mm_min_ps(t1, t2));
+            t_far = _mm_min_ps(t_far, _mm_max_ps(t1, t2));
+        }
+        result |= uint32_t(_mm_movemask_ps(_mm_cmple_ps(t_near, t_far))) << base;
+    }
+#else
+    for (int lane = 0; lane < AABB_TREE_RAY_PACKET_SIZE; ++lane) {
+        if (!(lanes & (1u << lane))) {
+            continue;
+        }
+        float t_near = .0f;
+        float t_far = p.t_max[lane];
+        for (int i = 0; i < 3; ++i) {
+            float t1 = (box.from[i] - p.radius[lane] - p.origin[i][lane]) * p.inv_direction[i][lane];
+            float t2 = (box.to[i] + p.radius[lane] - p.origin[i][lane]) * p.inv_direction[i][lane];
+            t_near = gfxm::_max(t_near, gfxm::_min(t1, t2));
+            t_far = gfxm::_min(t_far, gfxm::_max(t1, t2));
+        }
+        if (t_near <= t_far) {
+            result |= 1u << lane;
+        }
+    }
+#endif
+    return result & lanes;
+}
+
+void AabbTreeFlat::rayTest(const gfxm::ray& ray, void* context, void(*callback_fn)(void*, const gfxm::ray&, phyRigidBody*)) const {
+    if (root == AABB_TREE_NULL_NODE) {
+        return;
+    }
+    AabbTreeStack<uint32_t> stack;
+    stack.push(root);
+    while (!stack.empty()) {
+        const AabbTreeFlatNode& n = nodes[stack.pop()];
+        if (!intersectRayAabb(ray, n.aabb)) {
+            continue;
+        }
+        if (n.isLeaf()) {
+            callback_fn(context, ray, n.payload);
+        } else {
+            stack.push(n.left);
+            stack.push(n.right);
+        }
+    }
+}
+void AabbTreeFlat::sphereSweep(const gfxm::vec3& from, const gfxm::vec3& to, float radius, void* context, void(*callback_fn)(void*, const gfxm::vec3&, const gfxm::vec3&, float, phyRigidBody*)) const {
+    if (root == AABB_TREE_NULL_NODE) {
+        return;
+    }
+    AabbTreeStack<uint32_t> stack;
+    stack.push(root);
+    while (!stack.empty()) {
+        const AabbTreeFlatNode& n = nodes[stack.pop()];
+        if (!intersectCapsuleAabb(from, to, radius, n.aabb)) {
+            continue;
+        }
+        if (n.isLeaf()) {
+            callback_fn(context, from, to, radius, n.payload);
+        } else {
+            stack.push(n.left);
+            stack.push(n.right);
+        }
+    }
+}
+
+void AabbTreeFlat::debugDraw() const {
+    for (int i = 0; i < nodes.size(); ++i) {
+        const AabbTreeFlatNode& n = nodes[i];
+        if (n.height <= 0) {
+            continue;
+        }
+        dbgDrawAabb(n.aabb, 0xFF00FFFF);
+    }
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <vector>
+#include <bit>
+#include <string.h>
+#include "math/gfxm.hpp"
+#include "collision/simd.hpp"
+#include "debug_draw/debug_draw.hpp"
+#include "collision/intersection/ray.hpp"
+#include "collision/intersection/capsule_capsule.hpp"
+#include "aabb_tree_stack.hpp"
+#include "aabb_tree_dynamic.hpp"
+
+
+class phyRigidBody;
+
+// Flat incremental bounding volume tree
+// Nodes live in a single contiguous pool and reference each other by 32-bit index,
+// leaves store a 'fat' aabb so small movements don't cause reinsertion
+
+constexpr float AABB_TREE_FAT_MARGIN = .1f;
+constexpr float AABB_TREE_DISPLACEMENT_MULTIPLIER = 2.f;
+constexpr int AABB_TREE_RAY_PACKET_SIZE = 8;
+
+typedef AabbTreeNode<phyRigidBody*> AabbTreeFlatNode;
+
+struct AabbTreePacketStackEntry {
+    uint32_t node;
+    uint32_t lanes;
+};
+
+// Segments tested against the tree together, lane i goes from origin to origin + direction, t in [0, 1]
+// radius inflates the node bounds for sphere sweeps, 0 for rays
+// Lanes drop out once their bit in 'active' is cleared, t_max can be lowered to skip nodes past a known hit
+struct AabbTreeRayPacket {
+    alignas(16) float origin[3][AABB_TREE_RAY_PACKET_SIZE];
+    alignas(16) float inv_direction[3][AABB_TREE_RAY_PACKET_SIZE];
+    alignas(16) float radius[AABB_TREE_RAY_PACKET_SIZE];
+    alignas(16) float t_max[AABB_TREE_RAY_PACKET_SIZE];
+    uint32_t active = 0;
+
+    void setLane(int lane, const gfxm::vec3& from, const gfxm::vec3& to, float r) {
+        const gfxm::vec3 d = to - from;
+        for (int i = 0; i < 3; ++i) {
+            origin[i][lane] = from[i];
+            // Keeps the slab test free of inf * 0
+            inv_direction[i][lane] = fabsf(d[i]) > 1e-20f ? 1.f / d[i] : (d[i] < .0f ? -1e20f : 1e20f);
+        }
+        radius[lane] = r;
+        t_max[lane] = 1.f;
+        active |= 1u << lane;
+    }
+    void clear() {
+        memset(this, 0, sizeof(*this));
+    }
+};
+
+class AabbTreeFlat : public AabbTreeDynamic<phyRigidBody*> {
+    int leaf_count = 0;
+
+    // Bit i set if active lane i of 'lanes' touches the box
+    static uint32_t testRayPacket(const AabbTreeRayPacket& packet, const gfxm::aabb& box, uint32_t lanes);
+public:
+    AabbTreeFlat(int initial_capacity = 256);
+
+    uint32_t createProxy(const gfxm::aabb& aabb, phyRigidBody* collider);
+    void destroyProxy(uint32_t proxy);
+    // Returns true if the proxy had to be reinserted
+    bool moveProxy(uint32_t proxy, const gfxm::aabb& aabb, const gfxm::vec3& displacement);
+
+    const gfxm::aabb& getFatAabb(uint32_t proxy) const { return nodes[proxy].aabb; }
+    phyRigidBody* getCollider(uint32_t proxy) const { return nodes[proxy].payload; }
+
+    int getLeafCount() const { return leaf_count; }
+    int getNodeCount() const { return leaf_count > 0 ? leaf_count * 2 - 1 : 0; }
+    int getHeight() const { return root == AABB_TREE_NULL_NODE ? 0 : nodes[root].height; }
+    float getAreaRatio() const;
+
+    // CALLBACK_T: void(phyRigidBody*)
+    template<typename CALLBACK_T>
+    void forEachOverlap(const gfxm::aabb& box, const CALLBACK_T& callback) const {
+        if (root == AABB_TREE_NULL_NODE) {
+            return;
+        }
+        AabbTreeStack<uint32_t> stack;
+        stack.push(root);
+        while (!stack.empty()) {
+            const AabbTreeFlatNode& n = nodes[stack.pop()];
+            if (!aabbOverlap(n.aabb, box)) {
+                continue;
+            }
+            if (n.isLeaf()) {
+                callback(n.payload);
+            } else {
+                stack.push(n.left);
+                stack.push(n.right);
+            }
+        }
+    }
+
+    // Batched pair query for a set of moved colliders
+    // Walks the tree once per collider without going through a type-erased callback,
+    // PAIR_SINK_T: void(phyRigidBody* a, phyRigidBody* b), expected to be inlined
+    // GET_AABB_T: const gfxm::aabb&(phyRigidBody*), returns the tight bounds used for the leaf test
+    template<typename GET_AABB_T, typename PAIR_SINK_T>
+    void findPairs(phyRigidBody* const* colliders, int count, float margin, const GET_AABB_T& get_aabb, const PAIR_SINK_T& sink) const {
+        if (root == AABB_TREE_NULL_NODE) {
+            return;
+        }
+        AabbTreeStack<uint32_t> stack;
+        for (int i = 0; i < count; ++i) {
+            phyRigidBody* a = colliders[i];
+            gfxm::aabb box = get_aabb(a);
+            box.from -= gfxm::vec3(margin, margin, margin);
+            box.to += gfxm::vec3(margin, margin, margin);
+
+            stack.push(root);
+            while (!stack.empty()) {
+                const AabbTreeFlatNode& n = nodes[stack.pop()];
+                if (!aabbOverlap(n.aabb, box)) {
+                    continue;
+                }
+                if (n.isLeaf()) {
+                    if (n.payload != a && aabbOverlap(get_aabb(n.payload), box)) {
+                        sink(a, n.payload);
+                    }
+                } else {
+                    stack.push(n.left);
+                    stack.push(n.right);
+                }
+            }
+        }
+    }
+
+    // Packet traversal, each node is tested against all lanes still in the packet at once
+    // LEAF_T: void(int lane, phyRigidBody*), may lower packet.t_max[lane] or clear the lane's active bit
+    template<typename LEAF_T>
+    void rayTestPacket(AabbTreeRayPacket& packet, const LEAF_T& leaf_fn) const {
+        if (root == AABB_TREE_NULL_NODE) {
+            return;
+        }
+        AabbTreeStack<AabbTreePacketStackEntry> stack;
+        stack.push(AabbTreePacketStackEntry{ root, packet.active });
+        while (!stack.empty()) {
+            const AabbTreePacketStackEntry e = stack.pop();
+            const AabbTreeFlatNode& n = nodes[e.node];
+            uint32_t lanes = testRayPacket(packet, n.aabb, e.lanes & packet.active);
+            if (!lanes) {
+                continue;
+            }
+            if (n.isLeaf()) {
+                while (lanes) {
+                    int lane = std::countr_zero(lanes);
+                    lanes &= lanes - 1;
+                    if (packet.active & (1u << lane)) {
+                        leaf_fn(lane, n.payload);
+                    }
+                }
+            } else {
+                stack.push(AabbTreePacketStackEntry{ n.left, lanes });
+                stack.push(AabbTreePacketStackEntry{ n.right, lanes });
+            }
+        }
+    }
+
+    void rayTest(const gfxm::ray& ray, void* context, void(*callback_fn)(void*, const gfxm::ray&, phyRigidBody*)) const;
+    void sphereSweep(const gfxm::vec3& from, const gfxm::vec3& to, float radius, void* context, void(*callback_fn)(void*, const gfxm::vec3&, const gfxm::vec3&, float, phyRigidBody*)) const;
+
+    void debugDraw() const;
+};
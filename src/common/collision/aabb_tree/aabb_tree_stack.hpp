@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <string.h>
+
+
+constexpr int AABB_TREE_STACK_SIZE = 256;
+
+// Traversal stack, inline up to AABB_TREE_STACK_SIZE entries, moves to the heap
+// when a degenerate tree (piles of coincident or collinear bodies) goes deeper than that
+template<typename T>
+class AabbTreeStack {
+    T inline_entries[AABB_TREE_STACK_SIZE];
+    std::vector<T> heap_entries;
+    T* entries = inline_entries;
+    int capacity = AABB_TREE_STACK_SIZE;
+    int sp = 0;
+
+    void grow() {
+        const int new_capacity = capacity * 2;
+        if (entries == inline_entries) {
+            heap_entries.resize(new_capacity);
+            memcpy(heap_entries.data(), inline_entries, sizeof(T) * sp);
+        } else {
+            heap_entries.resize(new_capacity);
+        }
+        entries = heap_entries.data();
+        capacity = new_capacity;
+    }
+public:
+    AabbTreeStack() = default;
+    AabbTreeStack(const AabbTreeStack&) = delete;
+    AabbTreeStack& operator=(const AabbTreeStack&) = delete;
+
+    bool empty() const { return sp == 0; }
+    void push(const T& value) {
+        if (sp == capacity) {
+            grow();
+        }
+        entries[sp++] = value;
+    }
+    T pop() { return entries[--sp]; }
+};
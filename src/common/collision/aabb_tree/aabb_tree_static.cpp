@@ -0,0 +1,185 @@
+#include "aabb_tree_static.hpp"
+
+#include <algorithm>
+#include "debug_draw/debug_draw.hpp"
+
+
+static float aabbArea(const gfxm::aabb& box) {
+    float x = box.to.x - box.from.x;
+    float y = box.to.y - box.from.y;
+    float z = box.to.z - box.from.z;
+    return 2.f * (x * y + y * z + z * x);
+}
+
+struct AabbTreeStaticBin {
+    gfxm::aabb aabb;
+    int count;
+};
+
+struct AabbTreeStaticBuildTask {
+    uint32_t begin;
+    uint32_t end;
+    uint32_t parent;    // Node to link as the right child of, or UINT32_MAX
+    int depth;
+};
+
+void AabbTreeStatic::clear() {
+    nodes.clear();
+    item_count = 0;
+}
+
+void AabbTreeStatic::build(const gfxm::aabb* boxes, int count, std::vector<uint32_t>& order, int max_leaf_size) {
+    clear();
+    order.resize(count);
+    if (count <= 0) {
+        return;
+    }
+    max_leaf_size = std::max(1, max_leaf_size);
+    item_count = count;
+
+    std::vector<gfxm::vec3> centroids(count);
+    for (int i = 0; i < count; ++i) {
+        order[i] = i;
+        centroids[i] = (boxes[i].from + boxes[i].to) * .5f;
+    }
+    // A binary tree over n items never needs more
+    nodes.reserve(count * 2);
+
+    std::vector<AabbTreeStaticBuildTask> tasks;
+    tasks.push_back(AabbTreeStaticBuildTask{ 0, (uint32_t)count, UINT32_MAX, 0 });
+    while (!tasks.empty()) {
+        const AabbTreeStaticBuildTask task = tasks.back();
+        tasks.pop_back();
+
+        const uint32_t node_id = (uint32_t)nodes.size();
+        nodes.push_back(AabbTreeStaticNode());
+        if (task.parent != UINT32_MAX) {
+            nodes[task.parent].first = node_id;
+        }
+
+        gfxm::aabb bounds = boxes[order[task.begin]];
+        gfxm::vec3 cmin = centroids[order[task.begin]];
+        gfxm::vec3 cmax = cmin;
+        for (uint32_t i = task.begin + 1; i < task.end; ++i) {
+            bounds = gfxm::aabb_union(bounds, boxes[order[i]]);
+            const gfxm::vec3& c = centroids[order[i]];
+            for (int a = 0; a < 3; ++a) {
+                cmin[a] = gfxm::_min(cmin[a], c[a]);
+                cmax[a] = gfxm::_max(cmax[a], c[a]);
+            }
+        }
+        nodes[node_id].aabb = bounds;
+
+        const int n = (int)(task.end - task.begin);
+        // Happens only with pathological input
+        const bool depth_limit = task.depth >= AABB_TREE_STATIC_MAX_DEPTH;
+        if (n <= 1 || depth_limit) {
+            nodes[node_id].first = task.begin;
+            nodes[node_id].count = n;
+            continue;
+        }
+
+        // Find the cheapest bin boundary over all three axes
+        float best_cost = INFINITY;
+        int best_axis = -1;
+        int best_split = 0;
+        float best_scale = .0f;
+        for (int a = 0; a < 3; ++a) {
+            const float extent = cmax[a] - cmin[a];
+            if (extent <= 1e-12f) {
+                continue;
+            }
+            const float scale = AABB_TREE_STATIC_BIN_COUNT * (1.f - 1e-6f) / extent;
+            AabbTreeStaticBin bins[AABB_TREE_STATIC_BIN_COUNT];
+            for (int b = 0; b < AABB_TREE_STATIC_BIN_COUNT; ++b) {
+                bins[b].count = 0;
+            }
+            for (uint32_t i = task.begin; i < task.end; ++i) {
+                int b = std::min(AABB_TREE_STATIC_BIN_COUNT - 1, (int)((centroids[order[i]][a] - cmin[a]) * scale));
+                if (bins[b].count++ == 0) {
+                    bins[b].aabb = boxes[order[i]];
+                } else {
+                    bins[b].aabb = gfxm::aabb_union(bins[b].aabb, boxes[order[i]]);
+                }
+            }
+
+            // Right side areas swept from the end, left side accumulated on the way back
+            float right_area[AABB_TREE_STATIC_BIN_COUNT];
+            int right_count[AABB_TREE_STATIC_BIN_COUNT];
+            gfxm::aabb acc;
+            int acc_count = 0;
+            for (int b = AABB_TREE_STATIC_BIN_COUNT - 1; b > 0; --b) {
+                if (bins[b].count) {
+                    acc = acc_count ? gfxm::aabb_union(acc, bins[b].aabb) : bins[b].aabb;
+                    acc_count += bins[b].count;
+                }
+                right_count[b] = acc_count;
+                right_area[b] = acc_count ? aabbArea(acc) : .0f;
+            }
+            acc_count = 0;
+            for (int b = 0; b < AABB_TREE_STATIC_BIN_COUNT - 1; ++b) {
+                if (bins[b].count) {
+                    acc = acc_count ? gfxm::aabb_union(acc, bins[b].aabb) : bins[b].aabb;
+                    acc_count += bins[b].count;
+                }
+                if (acc_count == 0 || right_count[b + 1] == 0) {
+                    continue;
+                }
+                float cost = acc_count * aabbArea(acc) + right_count[b + 1] * right_area[b + 1];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = a;
+                    best_split = b + 1;
+                    best_scale = scale;
+                }
+            }
+        }
+
+        // Traversal and item tests are treated as costing the same
+        const float node_area = aabbArea(bounds);
+        if (n <= max_leaf_size && (best_axis < 0 || node_area + best_cost >= n * node_area)) {
+            nodes[node_id].first = task.begin;
+            nodes[node_id].count = n;
+            continue;
+        }
+
+        uint32_t mid;
+        if (best_axis < 0) {
+            // All centroids in one spot, any split is as good as another
+            mid = task.begin + n / 2;
+        } else {
+            const float axis_min = cmin[best_axis];
+            uint32_t* split = std::partition(order.data() + task.begin, order.data() + task.end, [&](uint32_t item)->bool {
+                int b = std::min(AABB_TREE_STATIC_BIN_COUNT - 1, (int)((centroids[item][best_axis] - axis_min) * best_scale));
+                return b < best_split;
+            });
+            mid = (uint32_t)(split - order.data());
+        }
+        nodes[node_id].count = 0;
+        tasks.push_back(AabbTreeStaticBuildTask{ mid, task.end, node_id, task.depth + 1 });
+        tasks.push_back(AabbTreeStaticBuildTask{ task.begin, mid, UINT32_MAX, task.depth + 1 });
+    }
+}
+
+bool AabbTreeStatic::setNodes(const AabbTreeStaticNode* data, size_t count, uint32_t item_count) {
+    clear();
+    for (size_t i = 0; i < count; ++i) {
+        const AabbTreeStaticNode& n = data[i];
+        if (n.isLeaf()) {
+            if (n.first > item_count || n.count > item_count - n.first) {
+                return false;
+            }
+        } else if (n.first <= i + 1 || n.first >= count || i + 1 >= count) {
+            return false;
+        }
+    }
+    nodes.insert(nodes.end(), data, data + count);
+    this->item_count = item_count;
+    return true;
+}
+
+void AabbTreeStatic::debugDraw(uint32_t color) const {
+    for (auto& n : nodes) {
+        dbgDrawAabb(n.aabb, color);
+    }
+}
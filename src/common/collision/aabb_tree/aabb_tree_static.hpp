@@ -0,0 +1,170 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <vector>
+#include "math/gfxm.hpp"
+#include "aabb_tree_stack.hpp"
+
+
+// Bounding volume tree over a fixed set of items, built once with a binned surface area heuristic
+// Nodes are stored depth first in one array: the left child of an inner node always follows it,
+// only the right child index is stored. Leaves reference a contiguous range of item slots,
+// build() returns the item order so the caller can store its items to match
+
+constexpr int AABB_TREE_STATIC_BIN_COUNT = 16;
+constexpr int AABB_TREE_STATIC_MAX_LEAF_SIZE = 4;
+// build() makes a leaf of whatever is left at this depth, trees loaded with setNodes() can be deeper
+constexpr int AABB_TREE_STATIC_MAX_DEPTH = 64;
+
+struct AabbTreeStaticNode {
+    gfxm::aabb aabb;
+    uint32_t first; // first item slot for leaves, right child for inner nodes
+    uint32_t count; // 0 for inner nodes
+
+    bool isLeaf() const { return count != 0; }
+};
+
+struct AabbTreeStaticStackEntry {
+    uint32_t node;
+    float t_entry;
+};
+
+// Segment from origin to origin + direction, t in [0, 1], radius inflates the boxes it's tested against
+struct AabbTreeStaticSegment {
+    gfxm::vec3 origin;
+    gfxm::vec3 inv_direction;
+    float radius;
+
+    AabbTreeStaticSegment(const gfxm::vec3& from, const gfxm::vec3& to, float radius)
+        : origin(from), radius(radius) {
+        const gfxm::vec3 d = to - from;
+        for (int i = 0; i < 3; ++i) {
+            // Keeps the slab test free of inf * 0
+            inv_direction[i] = fabsf(d[i]) > 1e-20f ? 1.f / d[i] : (d[i] < .0f ? -1e20f : 1e20f);
+        }
+    }
+
+    bool test(const gfxm::aabb& box, float t_max, float& t_entry) const {
+        float t0 = .0f;
+        float t1 = t_max;
+        for (int i = 0; i < 3; ++i) {
+            float ta = (box.from[i] - radius - origin[i]) * inv_direction[i];
+            float tb = (box.to[i] + radius - origin[i]) * inv_direction[i];
+            t0 = gfxm::_max(t0, gfxm::_min(ta, tb));
+            t1 = gfxm::_min(t1, gfxm::_max(ta, tb));
+        }
+        t_entry = t0;
+        return t0 <= t1;
+    }
+};
+
+class AabbTreeStatic {
+    std::vector<AabbTreeStaticNode> nodes;
+    uint32_t item_count = 0;
+
+    static bool aabbOverlap(const gfxm::aabb& a, const gfxm::aabb& b) {
+        return a.from.x <= b.to.x && a.to.x >= b.from.x
+            && a.from.y <= b.to.y && a.to.y >= b.from.y
+            && a.from.z <= b.to.z && a.to.z >= b.from.z;
+    }
+
+    // LEAF_T: void(uint32_t item, float& t_max), lowering t_max skips everything past it
+    template<typename LEAF_T>
+    void segmentTest(const AabbTreeStaticSegment& seg, float t_max, const LEAF_T& leaf_fn) const {
+        if (nodes.empty()) {
+            return;
+        }
+        AabbTreeStack<AabbTreeStaticStackEntry> stack;
+        float t_root;
+        if (!seg.test(nodes[0].aabb, t_max, t_root)) {
+            return;
+        }
+        stack.push(AabbTreeStaticStackEntry{ 0, t_root });
+        while (!stack.empty()) {
+            const AabbTreeStaticStackEntry e = stack.pop();
+            if (e.t_entry > t_max) {
+                continue;
+            }
+            const uint32_t id = e.node;
+            const AabbTreeStaticNode& n = nodes[id];
+            if (n.isLeaf()) {
+                for (uint32_t i = n.first; i < n.first + n.count; ++i) {
+                    leaf_fn(i, t_max);
+                }
+                continue;
+            }
+            const uint32_t left = id + 1;
+            const uint32_t right = n.first;
+            float t_left, t_right;
+            bool hit_left = seg.test(nodes[left].aabb, t_max, t_left);
+            bool hit_right = seg.test(nodes[right].aabb, t_max, t_right);
+            // Far child goes on the stack first so the near one is visited first
+            if (hit_left && hit_right) {
+                if (t_left <= t_right) {
+                    stack.push(AabbTreeStaticStackEntry{ right, t_right });
+                    stack.push(AabbTreeStaticStackEntry{ left, t_left });
+                } else {
+                    stack.push(AabbTreeStaticStackEntry{ left, t_left });
+                    stack.push(AabbTreeStaticStackEntry{ right, t_right });
+                }
+            } else if (hit_left) {
+                stack.push(AabbTreeStaticStackEntry{ left, t_left });
+            } else if (hit_right) {
+                stack.push(AabbTreeStaticStackEntry{ right, t_right });
+            }
+        }
+    }
+public:
+    void clear();
+    // Fills 'order' with the item index for each slot
+    void build(const gfxm::aabb* boxes, int count, std::vector<uint32_t>& order, int max_leaf_size = AABB_TREE_STATIC_MAX_LEAF_SIZE);
+
+    bool empty() const { return nodes.empty(); }
+    int getNodeCount() const { return (int)nodes.size(); }
+    uint32_t getItemCount() const { return item_count; }
+    const gfxm::aabb& getBounds() const { return nodes[0].aabb; }
+    const std::vector<AabbTreeStaticNode>& getNodes() const { return nodes; }
+    // For loading a tree saved with getNodes(), fails if the nodes don't form a valid tree over item_count slots
+    bool setNodes(const AabbTreeStaticNode* data, size_t count, uint32_t item_count);
+
+    // LEAF_T: void(uint32_t item, float& t_max), t is the fraction of the way from 'from' to 'to',
+    // items are visited roughly front to back
+    template<typename LEAF_T>
+    void rayTest(const gfxm::vec3& from, const gfxm::vec3& to, const LEAF_T& leaf_fn) const {
+        segmentTest(AabbTreeStaticSegment(from, to, .0f), 1.f, leaf_fn);
+    }
+    template<typename LEAF_T>
+    void sphereSweep(const gfxm::vec3& from, const gfxm::vec3& to, float radius, const LEAF_T& leaf_fn) const {
+        segmentTest(AabbTreeStaticSegment(from, to, radius), 1.f, leaf_fn);
+    }
+
+    // LEAF_T: bool(uint32_t item), return false to stop
+    template<typename LEAF_T>
+    void forEachOverlap(const gfxm::aabb& box, const LEAF_T& leaf_fn) const {
+        if (nodes.empty()) {
+            return;
+        }
+        AabbTreeStack<uint32_t> stack;
+        stack.push(0);
+        while (!stack.empty()) {
+            const uint32_t id = stack.pop();
+            const AabbTreeStaticNode& n = nodes[id];
+            if (!aabbOverlap(n.aabb, box)) {
+                continue;
+            }
+            if (n.isLeaf()) {
+                for (uint32_t i = n.first; i < n.first + n.count; ++i) {
+                    if (!leaf_fn(i)) {
+                        return;
+                    }
+                }
+            } else {
+                stack.push(n.first);
+                stack.push(id + 1);
+            }
+        }
+    }
+
+    void debugDraw(uint32_t color) const;
+};
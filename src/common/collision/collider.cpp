@@ -7,4 +7,9 @@ void phyRigidBody::markAsExternallyTransformed() {
     if (collision_world) {
         collision_world->markAsExternallyTransformed(this);
     }
+}
+void phyRigidBody::wakeUp() {
+    if (collision_world) {
+        collision_world->wakeCollider(this);
+    }
 }
\ No newline at end of file
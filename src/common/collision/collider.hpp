@@ -24,7 +24,7 @@ constexpr uint64_t COLLISION_MASK_EVERYTHING
     | COLLISION_LAYER_PROJECTILE;
 
 
-#include "aabb_tree/aabb_tree.hpp"
+#include "aabb_tree/aabb_tree_flat.hpp"
 enum COLLIDER_USER {
     COLLIDER_USER_NONE,
     COLLIDER_USER_ACTOR,
@@ -59,17 +59,20 @@ protected:
 
     gfxm::vec3 correction_accum;
 
+    int island_index = -1;      // Union-find node while islands are built, then the island of an awake body
+    int sleeping_island = -1;   // Slot in phyWorld's sleeping island list, -1 if not asleep as part of an island
+    int solver_body = -1;       // Body index in the packed contact solver of the batch the body is solved in
+
     phyRigidBody(PHY_COLLIDER_TYPE type)
         : type(type) {
         user_data.type = 0;
         user_data.user_ptr = 0;
-        tree_elem.collider = this;
     }
 public:
     ColliderUserData user_data = { 0 };
     uint64_t collision_mask = COLLISION_LAYER_DEFAULT | COLLISION_LAYER_CHARACTER | COLLISION_LAYER_PROJECTILE;
     uint64_t collision_group = COLLISION_LAYER_DEFAULT;    
-    AabbTreeElement tree_elem;
+    uint32_t tree_proxy = AABB_TREE_NULL_NODE;
 
     // DYNAMICS TEST
     float mass = .0f;
@@ -82,12 +85,13 @@ public:
     gfxm::mat3 inverse_inertia_tensor = gfxm::mat3(1);
     float sleep_timer = .0f;
     bool is_sleeping = false;
+    // Solver iterations for the island this body ends up in, the island uses the largest value among its bodies
+    // 0 to use the world default
+    int solver_iterations = 0;
     // ====
 
     phyRigidBody()
-    : type(PHY_COLLIDER_TYPE::COLLIDER) {
-        tree_elem.collider = this;
-    }
+    : type(PHY_COLLIDER_TYPE::COLLIDER) {}
     virtual ~phyRigidBody() {}
 
     void setCenterOffset(const gfxm::vec3& offset) {
@@ -110,6 +114,8 @@ public:
     }
 
     void markAsExternallyTransformed();
+    // Wakes the body along with the rest of its sleeping island
+    void wakeUp();
 
     gfxm::vec3 getCenterOffset() {
         return center_offset;
@@ -120,11 +126,14 @@ public:
     gfxm::vec3        getCOM() const { return position + gfxm::to_mat3(rotation) * mass_center; }
 
     const gfxm::mat4& getTransform() {
-        world_transform
-            = gfxm::translate(gfxm::mat4(1.f), position)
-            * gfxm::to_mat4(rotation);
+        world_transform = calcTransform();
         return world_transform;
     }
+    // Doesn't write to the body, for the narrowphase workers that can share a body between pairs
+    gfxm::mat4 calcTransform() const {
+        return gfxm::translate(gfxm::mat4(1.f), position)
+            * gfxm::to_mat4(rotation);
+    }
     gfxm::mat4 getPrevTransform() {
         return gfxm::translate(gfxm::mat4(1.f), prev_pos)
             * gfxm::to_mat4(prev_rotation);
@@ -172,6 +181,8 @@ public:
             return;
         }
 
+        wakeUp();
+
         velocity += impulse * (1.0f / mass);
 
         gfxm::vec3 wCOM = getPosition() + gfxm::to_mat3(getRotation()) * mass_center;
@@ -0,0 +1,319 @@
+#include "collision_triangle_mesh.hpp"
+
+#include <unordered_map>
+#include "serialization/virtual_obuf.hpp"
+
+
+void CollisionTriangleMesh::setData(const gfxm::vec3* vertices, phySurfaceProp* props, size_t vertex_count, const uint32_t* indices, size_t index_count) {
+    this->vertices.clear();
+    this->indices.clear();
+    this->surface_props.clear();
+    edge_neighbors.clear();
+    tree.clear();
+
+    if (vertex_count == 0 || index_count == 0) {
+        assert(false);
+        return;
+    }
+
+    this->vertices.insert(this->vertices.end(), vertices, vertices + vertex_count);
+    this->indices.insert(this->indices.end(), indices, indices + index_count - index_count % 3);
+    if (props) {
+        this->surface_props.insert(this->surface_props.end(), props, props + vertex_count);
+    }
+
+    _buildTree();
+    _buildEdgeNeighbors();
+}
+
+void CollisionTriangleMesh::_buildTree() {
+    const size_t tri_count = triangleCount();
+    std::vector<gfxm::aabb> boxes(tri_count);
+    for (size_t t = 0; t < tri_count; ++t) {
+        gfxm::aabb& box = boxes[t];
+        box.from = vertices[indices[t * 3]];
+        box.to = box.from;
+        gfxm::expand_aabb(box, vertices[indices[t * 3 + 1]]);
+        gfxm::expand_aabb(box, vertices[indices[t * 3 + 2]]);
+    }
+
+    std::vector<uint32_t> order;
+    tree.build(boxes.data(), (int)tri_count, order);
+
+    // Triangles of a leaf end up next to each other
+    std::vector<uint32_t> sorted(indices.size());
+    for (size_t i = 0; i < tri_count; ++i) {
+        sorted[i * 3] = indices[order[i] * 3];
+        sorted[i * 3 + 1] = indices[order[i] * 3 + 1];
+        sorted[i * 3 + 2] = indices[order[i] * 3 + 2];
+    }
+    indices.swap(sorted);
+}
+
+void CollisionTriangleMesh::_buildEdgeNeighbors() {
+    // Keyed by directed edge, the first triangle to have an edge stores it,
+    // the one with the opposite winding becomes its neighbor
+    std::unordered_map<uint64_t, COLLISION_TRI_MESH_EDGE_NEIGHBORS> edge_map;
+    for (uint32_t i = 0; i < indices.size(); i += 3) {
+        for (int j = 0; j < 3; ++j) {
+            uint32_t a = indices[i + j];
+            uint32_t b = indices[(i + (j + 1) % 3)];
+            uint64_t key = uint64_t(a) | (uint64_t(b) << 32);
+            uint64_t lookup_key = uint64_t(b) | (uint64_t(a) << 32);
+
+            auto it = edge_map.find(lookup_key);
+            if (it != edge_map.end()) {
+                it->second.b = i / 3;
+            } else {
+                edge_map[key] = COLLISION_TRI_MESH_EDGE_NEIGHBORS{ i / 3, i / 3 };
+            }
+        }
+    }
+
+    edge_neighbors.resize(indices.size());
+    for (uint32_t i = 0; i < indices.size(); i += 3) {
+        for (int j = 0; j < 3; ++j) {
+            uint32_t a = indices[i + j];
+            uint32_t b = indices[(i + (j + 1) % 3)];
+            uint64_t key_a = uint64_t(a) | (uint64_t(b) << 32);
+            uint64_t key_b = uint64_t(b) | (uint64_t(a) << 32);
+            auto it = edge_map.find(key_a);
+            if (it == edge_map.end()) {
+                it = edge_map.find(key_b);
+            }
+            assert(it != edge_map.end());
+            edge_neighbors[i + j] = it->second;
+        }
+    }
+}
+
+void CollisionTriangleMesh::rayTest(const gfxm::ray& ray, void* context, void(*callback_fn)(void*, const RayHitPoint&)) const {
+    tree.rayTest(ray.origin, ray.origin + ray.direction, [&](uint32_t tri, float& t_max) {
+        uint32_t ia = indices[tri * 3];
+        uint32_t ib = indices[tri * 3 + 1];
+        uint32_t ic = indices[tri * 3 + 2];
+
+        RayHitPoint rhp;
+        if (intersectRayTriangle(ray, vertices[ia], vertices[ib], vertices[ic], rhp)) {
+            if (!surface_props.empty()) {
+                // TODO: Blend
+                rhp.prop = surface_props[ia];
+            }
+            callback_fn(context, rhp);
+        }
+    });
+}
+
+void CollisionTriangleMesh::sweepSphereTest(const gfxm::vec3& from, const gfxm::vec3& to, float sweep_radius, void* context, void(*callback_fn)(void*, const SweepContactPoint&)) const {
+    tree.sphereSweep(from, to, sweep_radius, [&](uint32_t tri, float& t_max) {
+        uint32_t ia = indices[tri * 3];
+        uint32_t ib = indices[tri * 3 + 1];
+        uint32_t ic = indices[tri * 3 + 2];
+
+        SweepContactPoint scp;
+        if (intersectionSweepSphereTriangle(from, to, sweep_radius, vertices[ia], vertices[ib], vertices[ic], scp)) {
+            if (!surface_props.empty()) {
+                // TODO: Blend
+                scp.prop = surface_props[ia];
+            }
+            callback_fn(context, scp);
+        }
+    });
+}
+
+// Distances are converted back to t, padded so that a hit exactly on a node boundary isn't skipped
+static float distanceToT(float distance, float length) {
+    float t = length > .0f ? gfxm::_max(.0f, distance) / length : .0f;
+    return t * 1.0001f + 1e-5f;
+}
+
+bool CollisionTriangleMesh::rayTestClosest(const gfxm::ray& ray, RayHitPoint& rhp) const {
+    const float length = gfxm::length(ray.direction);
+    bool has_hit = false;
+    rhp.distance = INFINITY;
+    tree.rayTest(ray.origin, ray.origin + ray.direction, [&](uint32_t tri, float& t_max) {
+        uint32_t ia = indices[tri * 3];
+        uint32_t ib = indices[tri * 3 + 1];
+        uint32_t ic = indices[tri * 3 + 2];
+
+        RayHitPoint hit;
+        if (!intersectRayTriangle(ray, vertices[ia], vertices[ib], vertices[ic], hit)) {
+            return;
+        }
+        has_hit = true;
+        if (hit.distance < rhp.distance) {
+            if (!surface_props.empty()) {
+                // TODO: Blend
+                hit.prop = surface_props[ia];
+            }
+            rhp = hit;
+            t_max = gfxm::_min(t_max, distanceToT(hit.distance, length));
+        }
+    });
+    return has_hit;
+}
+
+bool CollisionTriangleMesh::sweepSphereClosest(const gfxm::vec3& from, const gfxm::vec3& to, float sweep_radius, SweepContactPoint& scp) const {
+    const float length = gfxm::length(to - from);
+    bool has_hit = false;
+    scp.distance_traveled = INFINITY;
+    tree.sphereSweep(from, to, sweep_radius, [&](uint32_t tri, float& t_max) {
+        uint32_t ia = indices[tri * 3];
+        uint32_t ib = indices[tri * 3 + 1];
+        uint32_t ic = indices[tri * 3 + 2];
+
+        SweepContactPoint hit;
+        if (!intersectionSweepSphereTriangle(from, to, sweep_radius, vertices[ia], vertices[ib], vertices[ic], hit)) {
+            return;
+        }
+        has_hit = true;
+        if (hit.distance_traveled < scp.distance_traveled) {
+            if (!surface_props.empty()) {
+                // TODO: Blend
+                hit.prop = surface_props[ia];
+            }
+            scp = hit;
+            t_max = gfxm::_min(t_max, distanceToT(hit.distance_traveled, length));
+        }
+    });
+    return has_hit;
+}
+
+int CollisionTriangleMesh::findPotentialTrianglesAabb(const gfxm::aabb& aabb, int* triangles, int max_triangles) const {
+    int triangles_found = 0;
+    if (max_triangles <= 0) {
+        return 0;
+    }
+    tree.forEachOverlap(aabb, [&](uint32_t tri)->bool {
+        // Leaves hold several triangles, keep only the ones that overlap on their own
+        const gfxm::vec3& A = vertices[indices[tri * 3]];
+        const gfxm::vec3& B = vertices[indices[tri * 3 + 1]];
+        const gfxm::vec3& C = vertices[indices[tri * 3 + 2]];
+        for (int i = 0; i < 3; ++i) {
+            if (gfxm::_max(A[i], gfxm::_max(B[i], C[i])) < aabb.from[i] || gfxm::_min(A[i], gfxm::_min(B[i], C[i])) > aabb.to[i]) {
+                return true;
+            }
+        }
+        triangles[triangles_found++] = (int)tri;
+        return triangles_found < max_triangles;
+    });
+    return triangles_found;
+}
+
+void CollisionTriangleMesh::serialize(std::vector<uint8_t>& data) {
+    const auto& nodes = tree.getNodes();
+    vofbuf vof;
+    vof.write<uint32_t>(COLLISION_TRI_MESH_MAGIC);
+    vof.write<uint32_t>(COLLISION_TRI_MESH_VERSION);
+    vof.write_vector(vertices, true);
+    vof.write_vector(indices, true);
+    vof.write_vector(surface_props, true);
+    vof.write_vector(edge_neighbors, true);
+    vof.write<uint32_t>(tree.getItemCount());
+    vof.write_vector(nodes, true);
+    data.insert(data.end(), vof.getData(), vof.getData() + vof.getSize());
+}
+
+// Bounds checked, the data may come from an old or truncated file
+struct CollisionTriangleMeshReader {
+    const uint8_t* cur;
+    const uint8_t* end;
+
+    template<typename T>
+    bool read(T& value) {
+        if (end - cur < (ptrdiff_t)sizeof(T)) {
+            return false;
+        }
+        memcpy(&value, cur, sizeof(T));
+        cur += sizeof(T);
+        return true;
+    }
+    template<typename T>
+    bool readVector(std::vector<T>& vec) {
+        uint32_t count = 0;
+        if (!read(count)) {
+            return false;
+        }
+        if ((size_t)(end - cur) / sizeof(T) < count) {
+            return false;
+        }
+        vec.resize(count);
+        if (count) {
+            memcpy(vec.data(), cur, count * sizeof(T));
+        }
+        cur += count * sizeof(T);
+        return true;
+    }
+};
+
+bool CollisionTriangleMesh::deserialize(const void* data, size_t size) {
+    CollisionTriangleMeshReader reader{ (const uint8_t*)data, (const uint8_t*)data + size };
+    uint32_t magic = 0;
+    if (!reader.read(magic) || magic != COLLISION_TRI_MESH_MAGIC) {
+        return _deserializeMesh3d(data, size);
+    }
+
+    vertices.clear();
+    indices.clear();
+    surface_props.clear();
+    edge_neighbors.clear();
+    tree.clear();
+
+    uint32_t version = 0;
+    uint32_t tree_item_count = 0;
+    std::vector<AabbTreeStaticNode> nodes;
+    if (!reader.read(version) || version != COLLISION_TRI_MESH_VERSION) {
+        LOG_ERR("CollisionTriangleMesh: unsupported version " << version);
+        return false;
+    }
+    if (!reader.readVector(vertices)
+        || !reader.readVector(indices)
+        || !reader.readVector(surface_props)
+        || !reader.readVector(edge_neighbors)
+        || !reader.read(tree_item_count)
+        || !reader.readVector(nodes)
+    ) {
+        LOG_ERR("CollisionTriangleMesh: unexpected end of data");
+        vertices.clear();
+        indices.clear();
+        surface_props.clear();
+        edge_neighbors.clear();
+        return false;
+    }
+
+    bool valid = indices.size() % 3 == 0
+        && (surface_props.empty() || surface_props.size() == vertices.size())
+        && edge_neighbors.size() == indices.size()
+        && tree_item_count == triangleCount();
+    for (size_t i = 0; valid && i < indices.size(); ++i) {
+        valid = indices[i] < vertices.size();
+    }
+    for (size_t i = 0; valid && i < edge_neighbors.size(); ++i) {
+        valid = edge_neighbors[i].a < tree_item_count && edge_neighbors[i].b < tree_item_count;
+    }
+    if (!valid || !tree.setNodes(nodes.data(), nodes.size(), tree_item_count)) {
+        LOG_ERR("CollisionTriangleMesh: invalid data");
+        vertices.clear();
+        indices.clear();
+        surface_props.clear();
+        edge_neighbors.clear();
+        tree.clear();
+        return false;
+    }
+    return true;
+}
+
+bool CollisionTriangleMesh::_deserializeMesh3d(const void* data, size_t size) {
+    Mesh3d mesh;
+    mesh.deserialize(data, size);
+    auto vertex_data = mesh.getAttribArrayData(VFMT::Position_GUID);
+    auto vertex_array_size = mesh.getAttribArraySize(VFMT::Position_GUID);
+    auto index_data = mesh.getIndexArrayData();
+    auto index_array_size = mesh.getIndexArraySize();
+    if (!vertex_data || !index_data || vertex_array_size == 0 || index_array_size == 0) {
+        LOG_ERR("CollisionTriangleMesh: no vertex or index data");
+        return false;
+    }
+    setData((const gfxm::vec3*)vertex_data, 0, vertex_array_size / sizeof(gfxm::vec3), (const uint32_t*)index_data, index_array_size / sizeof(uint32_t));
+    return true;
+}
@@ -2,7 +2,7 @@
 
 
 
-void fixEdgeCollisionNormal(phyContactPoint& cp, int tri, const gfxm::mat4& mesh_transform, const CollisionTriangleMesh* mesh) {
+void fixEdgeCollisionNormal(phyContactPoint& cp, int tri, const gfxm::mat4& mesh_transform, const CollisionTriangleMesh* mesh, bool dbg_draw) {
     if (cp.type != CONTACT_POINT_TYPE::TRIANGLE_EDGE) {
         return;
     }
@@ -24,9 +24,11 @@ void fixEdgeCollisionNormal(phyContactPoint& cp, int tri, const gfxm::mat4& mesh
         Nb = -Nb;
     }
 
-    dbgDrawArrow(cp.point_b, Na, DBG_COLOR_RED);
-    dbgDrawArrow(cp.point_b, Nb, DBG_COLOR_GREEN);
-    dbgDrawArrow(cp.point_b, cp.normal_b, DBG_COLOR_BLUE);
+    if (dbg_draw) {
+        dbgDrawArrow(cp.point_b, Na, DBG_COLOR_RED);
+        dbgDrawArrow(cp.point_b, Nb, DBG_COLOR_GREEN);
+        dbgDrawArrow(cp.point_b, cp.normal_b, DBG_COLOR_BLUE);
+    }
 
     const gfxm::vec3 Ca = gfxm::cross(cp.normal_b, Na);
     const gfxm::vec3 Cb = gfxm::cross(cp.normal_b, Nb);
@@ -48,7 +50,9 @@ void fixEdgeCollisionNormal(phyContactPoint& cp, int tri, const gfxm::mat4& mesh
         gfxm::vec2 v2(cosf(a), sinf(a));
         cp.normal_b = gfxm::unproject_point_xy(v2, gfxm::vec3(0,0,0), Na, gfxm::normalize(gfxm::cross(Na, Ne)));
         cp.normal_a = -cp.normal_b;
-        dbgDrawArrow(cp.point_b + gfxm::vec3(.0f, .1f, .0f), cp.normal_b, DBG_COLOR_BLUE | DBG_COLOR_RED);
+        if (dbg_draw) {
+            dbgDrawArrow(cp.point_b + gfxm::vec3(.0f, .1f, .0f), cp.normal_b, DBG_COLOR_BLUE | DBG_COLOR_RED);
+        }
     }
 }
 
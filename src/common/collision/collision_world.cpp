@@ -8,7 +8,9 @@
 #include "util/timer.hpp"
 
 #include "intersection/gjkepa/gjkepa.hpp"
+#include "intersection/gjkepa/gjk_convex_mesh.hpp"
 #include "intersection/sat/sat_convexmesh_triangle.hpp"
+#include "intersection/sat/sat_box_box.hpp"
 
 #include "shape/sphere.hpp"
 #include "shape/box.hpp"
@@ -101,15 +103,15 @@ void phyWorld::_removeColliderFromDirtyTransformArray(phyRigidBody* collider) {
     collider->dirty_transform_index = -1;
 }
 
-void phyWorld::_broadphase() {    
+void phyWorld::_broadphase() {
     // Determine potential collisions
-    for (int i = 0; i < dirty_transform_count; ++i) {
-        auto a = dirty_transform_array[i];
-        // TODO: Actually expand aabb at collider scope, not here every time
-        gfxm::aabb box = a->world_aabb;
-        box.from -= gfxm::vec3(.01f, .01f, .01f);
-        box.to += gfxm::vec3(.01f, .01f, .01f);
-        aabb_tree.forEachOverlap(box, [this, &a](phyRigidBody* b) {
+    // TODO: Actually expand aabb at collider scope, not here every time
+    aabb_tree.findPairs(
+        dirty_transform_array.data(), dirty_transform_count, .01f,
+        [](phyRigidBody* c)->const gfxm::aabb& {
+            return c->world_aabb;
+        },
+        [this](phyRigidBody* a, phyRigidBody* b) {
             bool layer_test
                 = (a->collision_group & b->collision_mask)
                 && (b->collision_group & a->collision_mask);
@@ -123,19 +125,20 @@ void phyWorld::_broadphase() {
             }
             if(_isTransformDirty(b) && a->id >= b->id) {
                 return;
-            }/*
-            if(a == b) {
-                return;
-            }*/
+            }
 
             PHY_PAIR_TYPE pair_identifier = (PHY_PAIR_TYPE)((int)a->getShape()->getShapeType() | (int)b->getShape()->getShapeType());
-            if ((int)a->getShape()->getShapeType() <= (int)b->getShape()->getShapeType()) {
+            int type_a = (int)a->getShape()->getShapeType();
+            int type_b = (int)b->getShape()->getShapeType();
+            // Same shape pairs are ordered by id, the cached manifold stores contact points
+            // relative to its first collider and must not see the pair flipped
+            if (type_a < type_b || (type_a == type_b && a->id < b->id)) {
                 potential_pairs[pair_identifier].push_back(std::make_pair(a, b));
             } else {
                 potential_pairs[pair_identifier].push_back(std::make_pair(b, a));
             }
-        });
-    }
+        }
+    );
 }
 
 void phyWorld::_broadphase_Naive() {
@@ -467,56 +470,455 @@ void phyWorld::_adjustPenetrationsOld() {
     }
 }
 
-void phyWorld::_solveImpulses(float dt) {
-    const float inv_dt = dt > .0f ? (1.f / dt) : .0f;
+bool phyWorld::_isDynamic(const phyRigidBody* body) const {
+    // Removed bodies can still be referenced by old manifolds
+    return body->collision_world == this
+        && body->mass > .0f
+        && !(body->getFlags() & COLLIDER_STATIC);
+}
+bool phyWorld::_isAwakeDynamic(const phyRigidBody* body) const {
+    return !body->is_sleeping && _isDynamic(body);
+}
+// Bodies outside of the island being solved are treated as immovable, same as in _solveBatchPacked.
+// They can be shared with islands solved on other threads, so their velocities must not be written
+float phyWorld::_getSolverInverseMass(phyRigidBody* body) const {
+    return _isAwakeDynamic(body) ? body->getInverseMass() : .0f;
+}
+gfxm::mat3 phyWorld::_getSolverInverseInertia(phyRigidBody* body) const {
+    return _isAwakeDynamic(body) ? body->getInverseWorldInertiaTensor() : gfxm::mat3(.0f);
+}
+
+int phyWorld::_findIslandRoot(int node) {
+    while (island_parents[node] != node) {
+        island_parents[node] = island_parents[island_parents[node]];
+        node = island_parents[node];
+    }
+    return node;
+}
+
+void phyWorld::_wakeOverlappingBodies(phyRigidBody* collider) {
+    if (collider->getFlags() & COLLIDER_NO_RESPONSE) {
+        return;
+    }
+    aabb_tree.forEachOverlap(gfxm::aabb_grow(collider->getBoundingAabb(), .01f), [this, collider](phyRigidBody* other) {
+        bool layer_test
+            = (collider->collision_group & other->collision_mask)
+            && (other->collision_group & collider->collision_mask);
+        if (other != collider && layer_test && other->is_sleeping && _isDynamic(other)) {
+            wakeCollider(other);
+        }
+    });
+}
 
+void phyWorld::_buildIslands() {
+    island_edges.clear();
     for (int i = 0; i < narrow_phase.manifoldCount(); ++i) {
         auto& m = narrow_phase.getManifold(i);
         phyRigidBody* a = m.collider_a;
         phyRigidBody* b = m.collider_b;
+        // Manifolds are kept around after the contact is lost
         if (m.pointCount() == 0) {
-            assert(false);
             continue;
         }
-        if ((m.collider_a->getFlags() & COLLIDER_NO_RESPONSE) || (m.collider_b->getFlags() & COLLIDER_NO_RESPONSE)) {
+        if ((a->getFlags() & COLLIDER_NO_RESPONSE) || (b->getFlags() & COLLIDER_NO_RESPONSE)) {
             continue;
         }
-        if (m.collider_a->getType() == PHY_COLLIDER_TYPE::PROBE
-            || m.collider_b->getType() == PHY_COLLIDER_TYPE::PROBE) {
+        if (a->getType() == PHY_COLLIDER_TYPE::PROBE || b->getType() == PHY_COLLIDER_TYPE::PROBE) {
+            continue;
+        }
+        if (!_isDynamic(a) && !_isDynamic(b)) {
+            continue;
+        }
+        island_edges.push_back(phyIslandEdge{ a, b, i, nullptr });
+    }
+    for (int i = 0; i < joints.size(); ++i) {
+        phyJoint* joint = joints[i];
+        if (!_isDynamic(joint->body_a) && !_isDynamic(joint->body_b)) {
+            continue;
+        }
+        island_edges.push_back(phyIslandEdge{ joint->body_a, joint->body_b, -1, joint });
+    }
+
+    // An awake body touching a sleeping one wakes its whole island,
+    // repeated since the woken island can be touching another sleeping one
+    bool woke_any = true;
+    while (woke_any) {
+        woke_any = false;
+        for (int i = 0; i < island_edges.size(); ++i) {
+            const auto& e = island_edges[i];
+            bool a_awake = _isAwakeDynamic(e.a);
+            bool b_awake = _isAwakeDynamic(e.b);
+            if (a_awake == b_awake) {
+                continue;
+            }
+            phyRigidBody* sleeper = a_awake ? e.b : e.a;
+            if (!sleeper->is_sleeping || !_isDynamic(sleeper)) {
+                continue;
+            }
+            wakeCollider(sleeper);
+            woke_any = true;
+        }
+    }
+
+    // Union awake dynamic bodies connected by an edge,
+    // static bodies don't join islands so that everything resting on the same floor isn't one island
+    island_parents.resize(colliders.size());
+    for (int i = 0; i < colliders.size(); ++i) {
+        colliders[i]->island_index = i;
+        island_parents[i] = i;
+    }
+    for (int i = 0; i < island_edges.size(); ++i) {
+        const auto& e = island_edges[i];
+        if (!_isAwakeDynamic(e.a) || !_isAwakeDynamic(e.b)) {
+            continue;
+        }
+        int root_a = _findIslandRoot(e.a->island_index);
+        int root_b = _findIslandRoot(e.b->island_index);
+        if (root_a != root_b) {
+            island_parents[std::max(root_a, root_b)] = std::min(root_a, root_b);
+        }
+    }
+
+    // Number islands in collider order, so the result doesn't depend on anything but the world state
+    islands.clear();
+    island_roots.assign(colliders.size(), -1);
+    for (int i = 0; i < colliders.size(); ++i) {
+        phyRigidBody* c = colliders[i];
+        if (!_isAwakeDynamic(c)) {
+            c->island_index = -1;
+            continue;
+        }
+        int root = _findIslandRoot(i);
+        if (island_roots[root] < 0) {
+            island_roots[root] = (int)islands.size();
+            islands.push_back(phyIsland());
+            islands.back().solver_iterations = 0;
+        }
+        c->island_index = island_roots[root];
+        phyIsland& island = islands[c->island_index];
+        ++island.body_count;
+        island.solver_iterations = std::max(island.solver_iterations, c->solver_iterations);
+    }
+
+    auto fn_edge_island = [this](const phyIslandEdge& e)->int {
+        if (_isAwakeDynamic(e.a)) {
+            return e.a->island_index;
+        }
+        if (_isAwakeDynamic(e.b)) {
+            return e.b->island_index;
+        }
+        return -1;
+    };
+    for (int i = 0; i < island_edges.size(); ++i) {
+        int island = fn_edge_island(island_edges[i]);
+        if (island < 0) {
+            continue;
+        }
+        if (island_edges[i].joint) {
+            ++islands[island].joint_count;
+        } else {
+            ++islands[island].manifold_count;
+        }
+    }
+
+    int body_offset = 0;
+    int manifold_offset = 0;
+    int joint_offset = 0;
+    for (auto& island : islands) {
+        island.first_body = body_offset;
+        island.first_manifold = manifold_offset;
+        island.first_joint = joint_offset;
+        body_offset += island.body_count;
+        manifold_offset += island.manifold_count;
+        joint_offset += island.joint_count;
+        island.body_count = 0;
+        island.manifold_count = 0;
+        island.joint_count = 0;
+        if (island.solver_iterations == 0) {
+            island.solver_iterations = default_solver_iterations;
+        }
+    }
+    island_bodies.resize(body_offset);
+    island_manifolds.resize(manifold_offset);
+    island_joints.resize(joint_offset);
+
+    for (int i = 0; i < colliders.size(); ++i) {
+        phyRigidBody* c = colliders[i];
+        if (c->island_index < 0) {
+            continue;
+        }
+        phyIsland& island = islands[c->island_index];
+        island_bodies[island.first_body + island.body_count++] = c;
+    }
+    for (int i = 0; i < island_edges.size(); ++i) {
+        const auto& e = island_edges[i];
+        int island_idx = fn_edge_island(e);
+        if (island_idx < 0) {
+            continue;
+        }
+        phyIsland& island = islands[island_idx];
+        if (e.joint) {
+            island_joints[island.first_joint + island.joint_count++] = e.joint;
+        } else {
+            island_manifolds[island.first_manifold + island.manifold_count++] = e.manifold;
+        }
+    }
+}
+
+void phyWorld::_sleepIslands(float dt) {
+    for (int i = 0; i < islands.size(); ++i) {
+        const phyIsland& island = islands[i];
+        bool can_sleep = true;
+        for (int j = 0; j < island.body_count; ++j) {
+            phyRigidBody* body = island_bodies[island.first_body + j];
+            if (body->velocity.length2() < PHY_SLEEP_VELOCITY_THRESHOLD2
+                && body->angular_velocity.length2() < PHY_SLEEP_VELOCITY_THRESHOLD2
+            ) {
+                body->sleep_timer += dt;
+            } else {
+                body->sleep_timer = .0f;
+            }
+            can_sleep = can_sleep && body->sleep_timer > PHY_SLEEP_THRESHOLD_SEC;
+        }
+        if (!can_sleep) {
             continue;
         }
-        bool a_skip = a->is_sleeping || a->mass == .0f || a->getFlags() & COLLIDER_STATIC;
-        bool b_skip = b->is_sleeping || b->mass == .0f || b->getFlags() & COLLIDER_STATIC;
-        if(a_skip && b_skip) {
+
+        int slot = 0;
+        if (free_sleeping_islands.empty()) {
+            slot = (int)sleeping_islands.size();
+            sleeping_islands.push_back(std::vector<phyRigidBody*>());
+        } else {
+            slot = free_sleeping_islands.back();
+            free_sleeping_islands.pop_back();
+        }
+        auto& sleeping_bodies = sleeping_islands[slot];
+        for (int j = 0; j < island.body_count; ++j) {
+            phyRigidBody* body = island_bodies[island.first_body + j];
+            body->is_sleeping = true;
+            body->sleeping_island = slot;
+            body->velocity = gfxm::vec3(.0f, .0f, .0f);
+            body->angular_velocity = gfxm::vec3(.0f, .0f, .0f);
+            sleeping_bodies.push_back(body);
+        }
+    }
+
+    island_stats.island_count = (int)islands.size();
+    island_stats.active_body_count = 0;
+    island_stats.sleeping_body_count = 0;
+    for (int i = 0; i < colliders.size(); ++i) {
+        if (!_isDynamic(colliders[i])) {
             continue;
         }
+        if (colliders[i]->is_sleeping) {
+            ++island_stats.sleeping_body_count;
+        } else {
+            ++island_stats.active_body_count;
+        }
+    }
+    island_stats.woken_body_count = woken_count;
+    woken_count = 0;
+}
+
+void phyWorld::_solveImpulses(float dt) {
+    const float inv_dt = dt > .0f ? (1.f / dt) : .0f;
+    const int island_count = (int)islands.size();
+    solver_contact_count = 0;
+    if (island_count == 0) {
+        return;
+    }
+
+    // Consecutive islands with the same iteration count share a packed batch
+    solver_batches.clear();
+    for (int i = 0; i < island_count; ++i) {
+        const phyIsland& island = islands[i];
+        int contact_count = 0;
+        for (int j = 0; j < island.manifold_count; ++j) {
+            contact_count += narrow_phase.getManifold(island_manifolds[island.first_manifold + j]).pointCount();
+        }
+        solver_contact_count += contact_count;
+        bool packed = packed_solver_enabled && island.joint_count == 0;
+        if (packed && !solver_batches.empty()) {
+            phySolverBatch& last = solver_batches.back();
+            if (last.packed
+                && last.contact_count < PHY_SOLVER_MIN_CONTACTS_PER_BATCH
+                && islands[last.first_island].solver_iterations == island.solver_iterations
+            ) {
+                ++last.island_count;
+                last.contact_count += contact_count;
+                continue;
+            }
+        }
+        solver_batches.push_back(phySolverBatch{ i, 1, contact_count, packed });
+    }
+    const int batch_count = (int)solver_batches.size();
+
+    // Cut the batch list into contiguous jobs of roughly equal cost
+    auto fn_batch_cost = [this](const phySolverBatch& batch)->int64_t {
+        const phyIsland& island = islands[batch.first_island];
+        if (batch.packed) {
+            return int64_t(batch.contact_count) * island.solver_iterations / PHY_SOLVER_LANES + batch.contact_count;
+        }
+        return int64_t(island.manifold_count + island.joint_count) * island.solver_iterations + island.body_count;
+    };
+    int64_t total_cost = 0;
+    for (int i = 0; i < batch_count; ++i) {
+        total_cost += fn_batch_cost(solver_batches[i]);
+    }
+    const int job_count = std::min(thread_pool.getThreadCount() * PHY_SOLVER_JOBS_PER_THREAD, batch_count);
+    solver_jobs.clear();
+    solver_jobs.push_back(0);
+    int64_t cost = 0;
+    for (int i = 0; i < batch_count; ++i) {
+        cost += fn_batch_cost(solver_batches[i]);
+        if (solver_jobs.size() < job_count && cost * job_count >= total_cost * (int64_t)solver_jobs.size()) {
+            solver_jobs.push_back(i + 1);
+        }
+    }
+    if (solver_jobs.back() != batch_count) {
+        solver_jobs.push_back(batch_count);
+    }
+    while (solver_contexts.size() < solver_jobs.size() - 1) {
+        solver_contexts.push_back(std::make_unique<phySolverContext>());
+    }
+
+    // Islands share no dynamic bodies, static ones are only read
+    std::function<void(int)> fn_job = [this, dt, inv_dt](int job) {
+        for (int i = solver_jobs[job]; i < solver_jobs[job + 1]; ++i) {
+            const phySolverBatch& batch = solver_batches[i];
+            if (batch.packed) {
+                _solveBatchPacked(batch, *solver_contexts[job], inv_dt);
+                continue;
+            }
+            for (int j = batch.first_island; j < batch.first_island + batch.island_count; ++j) {
+                _solveIsland(islands[j], dt, inv_dt);
+            }
+        }
+    };
+    thread_pool.run((int)solver_jobs.size() - 1, fn_job);
+}
 
+void phyWorld::_solveIsland(const phyIsland& island, float dt, float inv_dt) {
+    for (int i = 0; i < island.manifold_count; ++i) {
+        auto& m = narrow_phase.getManifold(island_manifolds[island.first_manifold + i]);
         for (int j = 0; j < m.pointCount(); ++j) {
             phyContactPoint* pt = &m.points[j];
             _preStepContact(m.collider_a, m.collider_b, *pt, inv_dt);
         }
     }
 
-    for(int i = 0; i < joints.size(); ++i) {
-        auto& joint = joints[i];
-        _preStepJoint(joint, dt, inv_dt);
+    for (int i = 0; i < island.joint_count; ++i) {
+        _preStepJoint(island_joints[island.first_joint + i], dt, inv_dt);
     }
 
-
-    //LOG_DBG("### Impulse solver ###");
-    constexpr int SOLVER_ITERATIONS = 16;
-    for (int si = 0; si < SOLVER_ITERATIONS; ++si) {
-        for (int i = 0; i < narrow_phase.manifoldCount(); ++i) {
-            auto& m = narrow_phase.getManifold(i);
+    for (int si = 0; si < island.solver_iterations; ++si) {
+        for (int i = 0; i < island.manifold_count; ++i) {
+            auto& m = narrow_phase.getManifold(island_manifolds[island.first_manifold + i]);
             _solveManifoldImpulseIteration(m);
-            //_solveManifoldFrictionIteration(m);
         }
 
-        for(int i = 0; i < joints.size(); ++i) {
-            auto& joint = joints[i];
-            _solveJoint(joint);
+        for (int i = 0; i < island.joint_count; ++i) {
+            _solveJoint(island_joints[island.first_joint + i]);
+        }
+    }
+}
+
+void phyWorld::_solveBatchPacked(const phySolverBatch& batch, phySolverContext& ctx, float inv_dt) {
+    phyContactSolver& solver = ctx.solver;
+    solver.clear();
+    ctx.points.clear();
+    const int island_end = batch.first_island + batch.island_count;
+
+    // The scalar prestep computes masses and applies warm starting,
+    // the packed solver picks up from the resulting velocities
+    for (int i = batch.first_island; i < island_end; ++i) {
+        const phyIsland& island = islands[i];
+        for (int j = 0; j < island.manifold_count; ++j) {
+            auto& m = narrow_phase.getManifold(island_manifolds[island.first_manifold + j]);
+            for (int k = 0; k < m.pointCount(); ++k) {
+                _preStepContact(m.collider_a, m.collider_b, m.points[k], inv_dt);
+            }
+        }
+    }
+
+    for (int i = batch.first_island; i < island_end; ++i) {
+        const phyIsland& island = islands[i];
+        for (int j = 0; j < island.body_count; ++j) {
+            phyRigidBody* body = island_bodies[island.first_body + j];
+            body->solver_body = solver.addBody(body->velocity, body->angular_velocity, true);
+        }
+    }
+
+    for (int i = batch.first_island; i < island_end; ++i) {
+        const phyIsland& island = islands[i];
+        for (int j = 0; j < island.manifold_count; ++j) {
+            auto& m = narrow_phase.getManifold(island_manifolds[island.first_manifold + j]);
+            phyRigidBody* a = m.collider_a;
+            phyRigidBody* b = m.collider_b;
+            // Anything that is not part of the island can't be pushed, it also may be shared with other jobs
+            const bool a_dynamic = _isAwakeDynamic(a);
+            const bool b_dynamic = _isAwakeDynamic(b);
+
+            phySolverContactDesc desc;
+            desc.body_a = a_dynamic ? a->solver_body : solver.addBody(a->velocity, a->angular_velocity, false);
+            desc.body_b = b_dynamic ? b->solver_body : solver.addBody(b->velocity, b->angular_velocity, false);
+            desc.inv_mass_a = _getSolverInverseMass(a);
+            desc.inv_mass_b = _getSolverInverseMass(b);
+            desc.inv_inertia_a = _getSolverInverseInertia(a);
+            desc.inv_inertia_b = _getSolverInverseInertia(b);
+            desc.friction = gfxm::sqrt(a->friction * b->friction);
+
+            const gfxm::vec3 wCOM_A = a->position + gfxm::to_mat3(a->getRotation()) * a->mass_center;
+            const gfxm::vec3 wCOM_B = b->position + gfxm::to_mat3(b->getRotation()) * b->mass_center;
+            for (int k = 0; k < m.pointCount(); ++k) {
+                phyContactPoint& cp = m.points[k];
+                // Same lever arms as _solveContactIteration and _solveContactFrictionIteration
+                gfxm::vec3 contact_point = gfxm::lerp(cp.point_a, cp.point_b, .5f);
+                desc.normal = gfxm::normalize(cp.normal_a);
+                desc.r_normal_a = contact_point - (wCOM_A + a->center_offset);
+                desc.r_normal_b = contact_point - (wCOM_B + b->center_offset);
+                desc.t1 = cp.t1;
+                desc.t2 = cp.t2;
+                desc.r_friction_a = cp.point_b - wCOM_A;
+                desc.r_friction_b = cp.point_a - wCOM_B;
+                desc.mass_normal = cp.mass_normal;
+#if PHY_ENABLE_FRICTION
+                desc.mass_tangent1 = cp.mass_tangent1;
+                desc.mass_tangent2 = cp.mass_tangent2;
+#else
+                desc.mass_tangent1 = .0f;
+                desc.mass_tangent2 = .0f;
+#endif
+                desc.bias = cp.bias;
+                desc.jn = cp.Jn_acc;
+                desc.jt1 = gfxm::dot(cp.t1, cp.Jt_acc);
+                desc.jt2 = gfxm::dot(cp.t2, cp.Jt_acc);
+                solver.addContact(desc);
+                ctx.points.push_back(&cp);
+            }
+        }
+    }
+
+    solver.build();
+    solver.solve(islands[batch.first_island].solver_iterations);
+
+    for (int i = batch.first_island; i < island_end; ++i) {
+        const phyIsland& island = islands[i];
+        for (int j = 0; j < island.body_count; ++j) {
+            phyRigidBody* body = island_bodies[island.first_body + j];
+            body->velocity = solver.getVelocity(body->solver_body);
+            body->angular_velocity = solver.getAngularVelocity(body->solver_body);
+            body->solver_body = -1;
         }
     }
+    // Accumulated impulses are kept for warm starting next step
+    for (int i = 0; i < ctx.points.size(); ++i) {
+        phyContactPoint& cp = *ctx.points[i];
+        float jt1 = .0f;
+        float jt2 = .0f;
+        solver.getContactImpulse(i, cp.Jn_acc, jt1, jt2, cp.dbg_vn);
+        cp.Jt_acc = cp.t1 * jt1 + cp.t2 * jt2;
+    }
 }
 
 void phyWorld::_preStepContact(phyRigidBody* bodyA, phyRigidBody* bodyB, phyContactPoint& cp, float inv_dt) {
@@ -535,11 +937,11 @@ void phyWorld::_preStepContact(phyRigidBody* bodyA, phyRigidBody* bodyB, phyCont
     gfxm::vec3 rAxn = gfxm::cross(rA, N);
     gfxm::vec3 rBxn = gfxm::cross(rB, N);
 
-    float invMassA = bodyA->getInverseMass();
-    float invMassB = bodyB->getInverseMass();
+    float invMassA = _getSolverInverseMass(bodyA);
+    float invMassB = _getSolverInverseMass(bodyB);
     float invMassSum = invMassA + invMassB;
-    gfxm::mat3 invInertiaA = bodyA->getInverseWorldInertiaTensor();
-    gfxm::mat3 invInertiaB = bodyB->getInverseWorldInertiaTensor();
+    gfxm::mat3 invInertiaA = _getSolverInverseInertia(bodyA);
+    gfxm::mat3 invInertiaB = _getSolverInverseInertia(bodyB);
     /*
     if(dynamic_cast<const phyTriangleMeshShape*>(bodyA->shape)
         && dynamic_cast<const phyConvexMeshShape*>(bodyB->shape)) {
@@ -690,11 +1092,11 @@ void phyWorld::_solveContactIteration(phyRigidBody* bodyA, phyRigidBody* bodyB,
     gfxm::vec3 vB = bodyB->velocity + gfxm::cross(bodyB->angular_velocity, rB);
     gfxm::vec3 relativeVelocity = vB - vA;
     
-    gfxm::mat3 invInertiaA = bodyA->getInverseWorldInertiaTensor();
-    gfxm::mat3 invInertiaB = bodyB->getInverseWorldInertiaTensor();
+    gfxm::mat3 invInertiaA = _getSolverInverseInertia(bodyA);
+    gfxm::mat3 invInertiaB = _getSolverInverseInertia(bodyB);
 
-    float invMassA = bodyA->getInverseMass();
-    float invMassB = bodyB->getInverseMass();
+    float invMassA = _getSolverInverseMass(bodyA);
+    float invMassB = _getSolverInverseMass(bodyB);
 
     //dbgDrawLine(contactPoint, contactPoint + collisionNormal, 0xFF0000FF);
     //dbgDrawLine(contactPoint, contactPoint + relativeVelocity, 0xFF00FF00);
@@ -750,11 +1152,11 @@ void phyWorld::_solveContactFrictionIteration(phyRigidBody* bodyA, phyRigidBody*
     gfxm::vec3 vB = bodyB->velocity + gfxm::cross(bodyB->angular_velocity, rB);
     gfxm::vec3 relativeVelocity = vB - vA;
 
-    gfxm::mat3 invInertiaA = bodyA->getInverseWorldInertiaTensor();
-    gfxm::mat3 invInertiaB = bodyB->getInverseWorldInertiaTensor();
+    gfxm::mat3 invInertiaA = _getSolverInverseInertia(bodyA);
+    gfxm::mat3 invInertiaB = _getSolverInverseInertia(bodyB);
 
-    float invMassA = bodyA->getInverseMass();
-    float invMassB = bodyB->getInverseMass();
+    float invMassA = _getSolverInverseMass(bodyA);
+    float invMassB = _getSolverInverseMass(bodyB);
 
     // ---- FRICTION IMPULSE ----
     // Recalculate relative velocity again
@@ -817,10 +1219,10 @@ void phyWorld::_preStepJoint(phyJoint* joint, float dt, float inv_dt) {
         return;
     }
 
-    float invMassA = body_a->getInverseMass();
-    float invMassB = body_b->getInverseMass();
-    gfxm::mat3 invInertiaA = body_a->getInverseWorldInertiaTensor();
-    gfxm::mat3 invInertiaB = body_b->getInverseWorldInertiaTensor();
+    float invMassA = _getSolverInverseMass(body_a);
+    float invMassB = _getSolverInverseMass(body_b);
+    gfxm::mat3 invInertiaA = _getSolverInverseInertia(body_a);
+    gfxm::mat3 invInertiaB = _getSolverInverseInertia(body_b);
 
     joint->rA = gfxm::to_mat3(body_a->rotation) * joint->lcl_anchor_a;
     joint->rB = gfxm::to_mat3(body_b->rotation) * joint->lcl_anchor_b;
@@ -940,10 +1342,10 @@ void phyWorld::_solveJoint(phyJoint* joint) {
         return;
     }
 
-    float invMassA = body_a->getInverseMass();
-    float invMassB = body_b->getInverseMass();
-    gfxm::mat3 invInertiaA = body_a->getInverseWorldInertiaTensor();
-    gfxm::mat3 invInertiaB = body_b->getInverseWorldInertiaTensor();
+    float invMassA = _getSolverInverseMass(body_a);
+    float invMassB = _getSolverInverseMass(body_b);
+    gfxm::mat3 invInertiaA = _getSolverInverseInertia(body_a);
+    gfxm::mat3 invInertiaB = _getSolverInverseInertia(body_b);
     
     gfxm::vec3 vA = body_a->velocity + gfxm::cross(body_a->angular_velocity, joint->rA);
     gfxm::vec3 vB = body_b->velocity + gfxm::cross(body_b->angular_velocity, joint->rB);
@@ -1073,8 +1475,7 @@ void phyWorld::addCollider(phyRigidBody* collider) {
         probes.push_back((phyProbe*)collider);
     }
 
-    collider->tree_elem.aabb = collider->getBoundingAabb();
-    aabb_tree.add(&collider->tree_elem);
+    collider->tree_proxy = aabb_tree.createProxy(collider->getBoundingAabb(), collider);
 
     collider->collision_world = this;
 
@@ -1084,9 +1485,17 @@ void phyWorld::addCollider(phyRigidBody* collider) {
     collider->is_sleeping = true;
 }
 void phyWorld::removeCollider(phyRigidBody* collider) {
+    // Whatever was resting on it has to fall
+    if (_isDynamic(collider)) {
+        wakeCollider(collider);
+    } else {
+        _wakeOverlappingBodies(collider);
+    }
+
     _removeColliderFromDirtyTransformArray(collider);
 
-    aabb_tree.remove(&collider->tree_elem);
+    aabb_tree.destroyProxy(collider->tree_proxy);
+    collider->tree_proxy = AABB_TREE_NULL_NODE;
 
     collider->collision_world = 0;
 
@@ -1107,6 +1516,34 @@ void phyWorld::removeCollider(phyRigidBody* collider) {
 }
 void phyWorld::markAsExternallyTransformed(phyRigidBody* collider) {
     _setColliderTransformDirty(collider);
+    // Static bodies never join islands, bodies resting on them are woken here
+    if (_isDynamic(collider)) {
+        wakeCollider(collider);
+    } else {
+        _wakeOverlappingBodies(collider);
+    }
+}
+void phyWorld::wakeCollider(phyRigidBody* collider) {
+    if (!collider->is_sleeping) {
+        return;
+    }
+    if (collider->sleeping_island < 0) {
+        collider->is_sleeping = false;
+        collider->sleep_timer = .0f;
+        ++woken_count;
+        return;
+    }
+    const int slot = collider->sleeping_island;
+    auto& sleeping_bodies = sleeping_islands[slot];
+    for (int i = 0; i < sleeping_bodies.size(); ++i) {
+        phyRigidBody* body = sleeping_bodies[i];
+        body->is_sleeping = false;
+        body->sleep_timer = .0f;
+        body->sleeping_island = -1;
+    }
+    woken_count += (int)sleeping_bodies.size();
+    sleeping_bodies.clear();
+    free_sleeping_islands.push_back(slot);
 }
 
 void phyWorld::addJoint(phyJoint* joint) {
@@ -1140,23 +1577,16 @@ struct CastSphereContext {
     uint64_t mask = 0;
     bool hasHit = false;
 };
-static void rayTestCallback(void* context, const gfxm::ray& ray, phyRigidBody* cdr) {
-    CastRayContext* ctx = (CastRayContext*)context;
-
-    if ((ctx->mask & cdr->collision_group) == 0) {
-        return;
-    }
-    
+static bool rayTestCollider(const gfxm::ray& ray, phyRigidBody* cdr, RayHitPoint& rhp) {
     const phyShape* shape = cdr->getShape();
     if (!shape) {
         assert(false);
-        return;
+        return false;
     }
 
     gfxm::mat4 shape_transform = cdr->getShapeTransform();
     gfxm::vec3 shape_pos = shape_transform * gfxm::vec4(0, 0, 0, 1);
 
-    RayHitPoint rhp;
     bool hasHit = false;
     switch (shape->getShapeType()) {
     case PHY_SHAPE_TYPE::SPHERE:
@@ -1187,8 +1617,29 @@ static void rayTestCallback(void* context, const gfxm::ray& ray, phyRigidBody* c
         }
         break;
     }
+    case PHY_SHAPE_TYPE::HEIGHTFIELD: {
+        const gfxm::vec3 O = gfxm::inverse(shape_transform) * gfxm::vec4(ray.origin, 1.f);
+        const gfxm::vec3 D = gfxm::inverse(shape_transform) * gfxm::vec4(ray.direction, .0f);
+        const gfxm::ray R(O, D, ray.length);
+        hasHit = intersectRayHeightfield(R, ((const phyHeightfieldShape*)shape), rhp);
+        if(hasHit) {
+            rhp.point = shape_transform * gfxm::vec4(rhp.point, 1.f);
+            rhp.normal = shape_transform * gfxm::vec4(rhp.normal, .0f);
+        }
+        break;
+    }
     };
-    if (hasHit) {
+    return hasHit;
+}
+static void rayTestCallback(void* context, const gfxm::ray& ray, phyRigidBody* cdr) {
+    CastRayContext* ctx = (CastRayContext*)context;
+
+    if ((ctx->mask & cdr->collision_group) == 0) {
+        return;
+    }
+
+    RayHitPoint rhp;
+    if (rayTestCollider(ray, cdr, rhp)) {
         ctx->hasHit = true;
         if (ctx->rhp.distance > rhp.distance) {
             ctx->rhp = rhp;
@@ -1200,6 +1651,7 @@ static void rayTestCallback(void* context, const gfxm::ray& ray, phyRigidBody* c
 
 struct POINT_SUPPORT_TAG {};
 struct INFLATED_CONVEX_TAG {};
+struct TRIANGLE_SUPPORT_TAG {};
 
 template<>
 class GJKEPA_SupportGetter<POINT_SUPPORT_TAG> {
@@ -1216,34 +1668,106 @@ public:
 };
 template<>
 class GJKEPA_SupportGetter<INFLATED_CONVEX_TAG> {
-    gfxm::mat4 transform;
-    const phyConvexMeshShape* shape;
+    GJKEPA_SupportGetter<phyConvexMeshShape> hull;
     float radius;
 public:
     GJKEPA_SupportGetter(const gfxm::mat4& transform, const phyConvexMeshShape* shape, float radius)
-        : transform(transform), shape(shape), radius(radius) {}
+        : hull(transform, shape), radius(radius) {}
 
-    gfxm::vec3 getPosition() const { return transform[3]; }
+    gfxm::vec3 getPosition() const { return hull.getPosition(); }
 
     gfxm::vec3 operator()(const gfxm::vec3& dir) const {
-        return shape->getMinkowskiSupportPoint(dir, transform) + gfxm::normalize(dir) * radius;
+        return hull(dir) + gfxm::normalize(dir) * radius;
     }
 };
+template<>
+class GJKEPA_SupportGetter<TRIANGLE_SUPPORT_TAG> {
+    const gfxm::vec3* points;
+public:
+    GJKEPA_SupportGetter(const gfxm::vec3* points)
+        : points(points) {}
 
-static void sphereSweepCallback(void* context, const gfxm::vec3& from, const gfxm::vec3& to, float radius, phyRigidBody* cdr) {
-    CastSphereContext* ctx = (CastSphereContext*)context;
-    if ((ctx->mask & cdr->collision_group) == 0) {
-        return;
+    gfxm::vec3 getPosition() const { return (points[0] + points[1] + points[2]) / 3.f; }
+
+    gfxm::vec3 operator()(const gfxm::vec3& dir) const {
+        float da = gfxm::dot(points[0], dir);
+        float db = gfxm::dot(points[1], dir);
+        float dc = gfxm::dot(points[2], dir);
+        if (da > db && da > dc) {
+            return points[0];
+        } else if (db > dc) {
+            return points[1];
+        } else {
+            return points[2];
+        }
+    }
+};
+
+// A body's world aabb taken into heightfield local space
+static gfxm::aabb heightfieldLocalAabb(const gfxm::aabb& world_box, const gfxm::mat4& inv_transform) {
+    gfxm::aabb box;
+    for (int i = 0; i < 8; ++i) {
+        const gfxm::vec3 pt = inv_transform * gfxm::vec4(
+            (i & 1) ? world_box.to.x : world_box.from.x,
+            (i & 2) ? world_box.to.y : world_box.from.y,
+            (i & 4) ? world_box.to.z : world_box.from.z,
+            1.f
+        );
+        if (i == 0) {
+            box.from = pt;
+            box.to = pt;
+        } else {
+            gfxm::expand_aabb(box, pt);
+        }
+    }
+    return box;
+}
+static void heightfieldContactToWorld(phyContactPoint& cp, const gfxm::mat4& transform) {
+    cp.normal_a = transform * gfxm::vec4(cp.normal_a, .0f);
+    cp.normal_b = transform * gfxm::vec4(cp.normal_b, .0f);
+    cp.point_a = transform * gfxm::vec4(cp.point_a, 1.f);
+    cp.point_b = transform * gfxm::vec4(cp.point_b, 1.f);
+}
+static void heightfieldDebugDrawCell(const gfxm::vec3* corners, const gfxm::mat4& transform) {
+    gfxm::vec3 p[4];
+    for (int i = 0; i < 4; ++i) {
+        p[i] = transform * gfxm::vec4(corners[i], 1.f);
+    }
+    dbgDrawLine(p[0], p[1], 0xFFFFFFFF);
+    dbgDrawLine(p[1], p[2], 0xFFFFFFFF);
+    dbgDrawLine(p[2], p[3], 0xFFFFFFFF);
+    dbgDrawLine(p[3], p[0], 0xFFFFFFFF);
+    dbgDrawLine(p[2], p[0], 0xFFFFFFFF);
+}
+// Calls cell_fn(corners) for every cell local_box touches, corners in heightfield space as getCellCorners() gives them
+// Large bodies or fine grids overlap more cells than fit in one buffer, those go in several batches
+// CELL_FN_T: void(const gfxm::vec3* corners)
+template<typename CELL_FN_T>
+static void forEachHeightfieldCell(const phyHeightfieldShape* heightfield, const gfxm::aabb& local_box, const gfxm::mat4& transform, bool debug_draw, const CELL_FN_T& cell_fn) {
+    int cells[PHY_HEIGHTFIELD_MAX_CELLS_PER_PAIR];
+    int resume_cell = 0;
+    while (resume_cell != -1) {
+        const int cell_count = heightfield->findPotentialCells(local_box, cells, PHY_HEIGHTFIELD_MAX_CELLS_PER_PAIR, resume_cell);
+        for (int i = 0; i < cell_count; ++i) {
+            gfxm::vec3 p[4];
+            heightfield->getCellCorners(cells[i] % heightfield->getCellCountX(), cells[i] / heightfield->getCellCountX(), p);
+            if (debug_draw) {
+                heightfieldDebugDrawCell(p, transform);
+            }
+            cell_fn(p);
+        }
     }
+}
+
+static bool sphereSweepCollider(const gfxm::vec3& from, const gfxm::vec3& to, float radius, phyRigidBody* cdr, SweepContactPoint& scp) {
     const phyShape* shape = cdr->getShape();
     if (!shape) {
         assert(false);
-        return;
+        return false;
     }
     gfxm::mat4 shape_transform = cdr->getShapeTransform();
     gfxm::vec3 shape_pos = shape_transform * gfxm::vec4(0, 0, 0, 1);
     
-    SweepContactPoint scp;
     bool hasHit = false;
     switch (shape->getShapeType()) {
     case PHY_SHAPE_TYPE::SPHERE:
@@ -1295,8 +1819,16 @@ static void sphereSweepCallback(void* context, const gfxm::vec3& from, const gfx
         break;
     }
     };
+    return hasHit;
+}
+static void sphereSweepCallback(void* context, const gfxm::vec3& from, const gfxm::vec3& to, float radius, phyRigidBody* cdr) {
+    CastSphereContext* ctx = (CastSphereContext*)context;
+    if ((ctx->mask & cdr->collision_group) == 0) {
+        return;
+    }
 
-    if (hasHit) {
+    SweepContactPoint scp;
+    if (sphereSweepCollider(from, to, radius, cdr, scp)) {
         ctx->hasHit = true;
         if (ctx->scp.distance_traveled > scp.distance_traveled) {
             ctx->scp = scp;
@@ -1365,31 +1897,293 @@ phySphereSweepResult phyWorld::sphereSweep(const gfxm::vec3& from, const gfxm::v
     return ssr;
 }
 
-void phyWorld::sphereTest(const gfxm::mat4& tr, float radius) {
-#if COLLISION_DBG_DRAW_TESTS == 1
-    if (dbg_draw_enabled) {
-        dbgDrawSphere(tr, radius, DBG_COLOR_RED);
+int phyWorld::_queryJobCount(int query_count) const {
+    // Debug drawing is not thread safe, some of the shape tests draw
+    const int thread_count = dbg_draw_enabled ? 1 : thread_pool.getThreadCount();
+    int job_count = std::min(
+        thread_count * PHY_QUERY_JOBS_PER_THREAD,
+        (query_count + PHY_QUERY_MIN_QUERIES_PER_JOB - 1) / PHY_QUERY_MIN_QUERIES_PER_JOB
+    );
+    return std::max(job_count, 1);
+}
+
+void phyWorld::_runQueryPackets(int query_count, const std::function<void(int, int, int)>& fn) {
+    const int job_count = _queryJobCount(query_count);
+    std::function<void(int)> fn_job = [query_count, job_count, &fn](int job) {
+        const int begin = int(int64_t(query_count) * job / job_count);
+        const int end = int(int64_t(query_count) * (job + 1) / job_count);
+        for (int i = begin; i < end; i += AABB_TREE_RAY_PACKET_SIZE) {
+            fn(job, i, std::min(AABB_TREE_RAY_PACKET_SIZE, end - i));
+        }
+    };
+    if (job_count == 1) {
+        fn_job(0);
+    } else {
+        thread_pool.run(job_count, fn_job);
     }
-#endif
-    // TODO
 }
 
-void phyWorld::debugDraw() {
-    if (!dbg_draw_enabled) {
-        return;
+// Hit distances are world units, packets work with t along the whole segment
+static float queryDistanceToT(float distance, float length) {
+    // Slightly past the hit so that nodes touching it are still visited
+    return length > .0f ? (distance / length) * 1.0001f + 1e-5f : 1.f;
+}
+
+// Hits a packet appended past 'begin' are regrouped by lane, nearest first, and counted per query
+template<typename HIT_T>
+static void sortPacketHits(std::vector<HIT_T>& hits, size_t begin, const std::vector<int>& lanes, int* hit_counts) {
+    std::vector<int> order(lanes.size());
+    for (int i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        if (lanes[a] != lanes[b]) {
+            return lanes[a] < lanes[b];
+        }
+        return hits[begin + a].distance < hits[begin + b].distance;
+    });
+    std::vector<HIT_T> sorted(order.size());
+    for (int i = 0; i < order.size(); ++i) {
+        sorted[i] = hits[begin + order[i]];
+        ++hit_counts[lanes[order[i]]];
+    }
+    std::copy(sorted.begin(), sorted.end(), hits.begin() + begin);
+}
+
+// Jobs cover consecutive queries, so concatenating their hits keeps query order
+template<typename HIT_T>
+static void mergeQueryHits(
+    const std::vector<std::vector<HIT_T>>& job_hits, int job_count, const std::vector<int>& hit_counts,
+    std::vector<HIT_T>& hits, std::vector<int>& first
+) {
+    const int count = (int)hit_counts.size();
+    first.resize(count + 1);
+    first[0] = 0;
+    for (int i = 0; i < count; ++i) {
+        first[i + 1] = first[i] + hit_counts[i];
+    }
+    hits.clear();
+    hits.reserve(first[count]);
+    for (int i = 0; i < job_count; ++i) {
+        hits.insert(hits.end(), job_hits[i].begin(), job_hits[i].end());
     }
-#if COLLISION_DBG_DRAW_COLLIDERS == 1
-    for (int k = 0; k < colliders.size(); ++k) {
-        auto& col = colliders[k];
-        assert(col->getShape());
-        auto shape = col->getShape();
-        gfxm::mat4 transform = col->getShapeTransform();
+}
 
-        uint32_t color = 0xFFFFFFFF;
-        if (col->getType() == PHY_COLLIDER_TYPE::PROBE) {
-            color = 0xFF8AA63A;
-        } else if (col->is_sleeping) {
-            color = 0xFFFF77CC;
+void phyWorld::rayTestBatch(const phyRayQuery* queries, int count, phyRayCastResult* results, PHY_QUERY_HIT hit) {
+    _runQueryPackets(count, [this, queries, results, hit](int job, int first, int packet_count) {
+        AabbTreeRayPacket packet;
+        packet.clear();
+        gfxm::ray rays[AABB_TREE_RAY_PACKET_SIZE];
+        float lengths[AABB_TREE_RAY_PACKET_SIZE];
+        RayHitPoint closest[AABB_TREE_RAY_PACKET_SIZE];
+        phyRigidBody* closest_collider[AABB_TREE_RAY_PACKET_SIZE];
+        for (int i = 0; i < packet_count; ++i) {
+            const phyRayQuery& q = queries[first + i];
+            packet.setLane(i, q.from, q.to, .0f);
+            rays[i] = gfxm::ray(q.from, q.to - q.from);
+            lengths[i] = gfxm::length(q.to - q.from);
+            closest[i].distance = INFINITY;
+            closest_collider[i] = 0;
+        }
+
+        aabb_tree.rayTestPacket(packet, [&](int lane, phyRigidBody* cdr) {
+            if ((queries[first + lane].mask & cdr->collision_group) == 0) {
+                return;
+            }
+            RayHitPoint rhp;
+            if (!rayTestCollider(rays[lane], cdr, rhp) || rhp.distance >= closest[lane].distance) {
+                return;
+            }
+            closest[lane] = rhp;
+            closest_collider[lane] = cdr;
+            if (hit == PHY_QUERY_HIT::ANY) {
+                packet.active &= ~(1u << lane);
+            } else {
+                packet.t_max[lane] = std::min(packet.t_max[lane], queryDistanceToT(rhp.distance, lengths[lane]));
+            }
+        });
+
+        for (int i = 0; i < packet_count; ++i) {
+            phyRayCastResult& r = results[first + i];
+            if (closest_collider[i]) {
+                r = phyRayCastResult{
+                    closest[i].point, closest[i].normal,
+                    closest_collider[i], closest[i].prop, closest[i].distance, true
+                };
+            } else {
+                r = phyRayCastResult{
+                    gfxm::vec3(0,0,0), gfxm::vec3(0,0,0),
+                    0, phySurfaceProp(), .0f, false
+                };
+            }
+        }
+    });
+}
+
+void phyWorld::rayTestBatch(const phyRayQuery* queries, int count, phyRayHitList& out) {
+    const int job_count = _queryJobCount(count);
+    if (query_ray_hits.size() < job_count) {
+        query_ray_hits.resize(job_count);
+    }
+    for (int i = 0; i < job_count; ++i) {
+        query_ray_hits[i].clear();
+    }
+    query_hit_counts.assign(count, 0);
+
+    _runQueryPackets(count, [this, queries](int job, int first, int packet_count) {
+        auto& job_hits = query_ray_hits[job];
+        AabbTreeRayPacket packet;
+        packet.clear();
+        gfxm::ray rays[AABB_TREE_RAY_PACKET_SIZE];
+        for (int i = 0; i < packet_count; ++i) {
+            const phyRayQuery& q = queries[first + i];
+            packet.setLane(i, q.from, q.to, .0f);
+            rays[i] = gfxm::ray(q.from, q.to - q.from);
+        }
+
+        const size_t packet_begin = job_hits.size();
+        std::vector<int> lanes;
+        aabb_tree.rayTestPacket(packet, [&](int lane, phyRigidBody* cdr) {
+            if ((queries[first + lane].mask & cdr->collision_group) == 0) {
+                return;
+            }
+            RayHitPoint rhp;
+            if (!rayTestCollider(rays[lane], cdr, rhp)) {
+                return;
+            }
+            job_hits.push_back(phyRayCastResult{ rhp.point, rhp.normal, cdr, rhp.prop, rhp.distance, true });
+            lanes.push_back(lane);
+        });
+
+        sortPacketHits(job_hits, packet_begin, lanes, query_hit_counts.data() + first);
+    });
+
+    mergeQueryHits(query_ray_hits, job_count, query_hit_counts, out.hits, out.first);
+}
+
+void phyWorld::sphereSweepBatch(const phySphereSweepQuery* queries, int count, phySphereSweepResult* results, PHY_QUERY_HIT hit) {
+    _runQueryPackets(count, [this, queries, results, hit](int job, int first, int packet_count) {
+        AabbTreeRayPacket packet;
+        packet.clear();
+        float lengths[AABB_TREE_RAY_PACKET_SIZE];
+        SweepContactPoint closest[AABB_TREE_RAY_PACKET_SIZE];
+        phyRigidBody* closest_collider[AABB_TREE_RAY_PACKET_SIZE];
+        for (int i = 0; i < packet_count; ++i) {
+            const phySphereSweepQuery& q = queries[first + i];
+            packet.setLane(i, q.from, q.to, q.radius);
+            lengths[i] = gfxm::length(q.to - q.from);
+            closest[i].distance_traveled = INFINITY;
+            closest_collider[i] = 0;
+        }
+
+        aabb_tree.rayTestPacket(packet, [&](int lane, phyRigidBody* cdr) {
+            const phySphereSweepQuery& q = queries[first + lane];
+            if ((q.mask & cdr->collision_group) == 0) {
+                return;
+            }
+            SweepContactPoint scp;
+            if (!sphereSweepCollider(q.from, q.to, q.radius, cdr, scp) || scp.distance_traveled >= closest[lane].distance_traveled) {
+                return;
+            }
+            closest[lane] = scp;
+            closest_collider[lane] = cdr;
+            if (hit == PHY_QUERY_HIT::ANY) {
+                packet.active &= ~(1u << lane);
+            } else {
+                packet.t_max[lane] = std::min(packet.t_max[lane], queryDistanceToT(scp.distance_traveled, lengths[lane]));
+            }
+        });
+
+        for (int i = 0; i < packet_count; ++i) {
+            phySphereSweepResult& r = results[first + i];
+            r = phySphereSweepResult();
+            r.sphere_pos = queries[first + i].to;
+            if (closest_collider[i]) {
+                r.collider = closest_collider[i];
+                r.prop = closest[i].prop;
+                r.contact = closest[i].contact;
+                r.distance = closest[i].distance_traveled;
+                r.hasHit = true;
+                r.normal = closest[i].normal;
+                r.sphere_pos = closest[i].sweep_contact_pos;
+            }
+        }
+    });
+}
+
+void phyWorld::sphereSweepBatch(const phySphereSweepQuery* queries, int count, phySphereSweepHitList& out) {
+    const int job_count = _queryJobCount(count);
+    if (query_sweep_hits.size() < job_count) {
+        query_sweep_hits.resize(job_count);
+    }
+    for (int i = 0; i < job_count; ++i) {
+        query_sweep_hits[i].clear();
+    }
+    query_hit_counts.assign(count, 0);
+
+    _runQueryPackets(count, [this, queries](int job, int first, int packet_count) {
+        auto& job_hits = query_sweep_hits[job];
+        AabbTreeRayPacket packet;
+        packet.clear();
+        for (int i = 0; i < packet_count; ++i) {
+            const phySphereSweepQuery& q = queries[first + i];
+            packet.setLane(i, q.from, q.to, q.radius);
+        }
+
+        const size_t packet_begin = job_hits.size();
+        std::vector<int> lanes;
+        aabb_tree.rayTestPacket(packet, [&](int lane, phyRigidBody* cdr) {
+            const phySphereSweepQuery& q = queries[first + lane];
+            if ((q.mask & cdr->collision_group) == 0) {
+                return;
+            }
+            SweepContactPoint scp;
+            if (!sphereSweepCollider(q.from, q.to, q.radius, cdr, scp)) {
+                return;
+            }
+            phySphereSweepResult r;
+            r.collider = cdr;
+            r.prop = scp.prop;
+            r.contact = scp.contact;
+            r.distance = scp.distance_traveled;
+            r.hasHit = true;
+            r.normal = scp.normal;
+            r.sphere_pos = scp.sweep_contact_pos;
+            job_hits.push_back(r);
+            lanes.push_back(lane);
+        });
+
+        sortPacketHits(job_hits, packet_begin, lanes, query_hit_counts.data() + first);
+    });
+
+    mergeQueryHits(query_sweep_hits, job_count, query_hit_counts, out.hits, out.first);
+}
+
+void phyWorld::sphereTest(const gfxm::mat4& tr, float radius) {
+#if COLLISION_DBG_DRAW_TESTS == 1
+    if (dbg_draw_enabled) {
+        dbgDrawSphere(tr, radius, DBG_COLOR_RED);
+    }
+#endif
+    // TODO
+}
+
+void phyWorld::debugDraw() {
+    if (!dbg_draw_enabled) {
+        return;
+    }
+#if COLLISION_DBG_DRAW_COLLIDERS == 1
+    for (int k = 0; k < colliders.size(); ++k) {
+        auto& col = colliders[k];
+        assert(col->getShape());
+        auto shape = col->getShape();
+        gfxm::mat4 transform = col->getShapeTransform();
+
+        uint32_t color = 0xFFFFFFFF;
+        if (col->getType() == PHY_COLLIDER_TYPE::PROBE) {
+            color = 0xFF8AA63A;
+        } else if (col->is_sleeping) {
+            color = 0xFFFF77CC;
         }
 
         //dbgDrawAabb(col->getBoundingAabb(), 0xFF999999);
@@ -1571,115 +2365,11 @@ void phyWorld::update_variableDt(float dt) {
     //
     debugDraw();
 }
-bool dbg_stepPhysics = true;
-void phyWorld::updateInternal(float dt) {
-    if (dbg_stepPhysics) {
-        //dbg_stepPhysics = false;
-    } else {
-        return;
-    }
-    ++tick_id;
-
-    // Clear per-frame data
-    //clearContactPoints();
-
-    for (auto& it : potential_pairs) {
-        it.second.clear();
-    }
-    for (int i = 0; i < probes.size(); ++i) {
-        probes[i]->_clearOverlappingColliders();
-    }
-
-    // Update bounds data
-    //for (int i = 0; i < colliders.size(); ++i) {
-    //    auto collider = colliders[i];
-    for (int i = 0; i < dirty_transform_count; ++i) {
-        auto collider = dirty_transform_array[i];
-        const phyShape* shape = collider->getShape();
-        if (!shape) {
-            assert(false);
-            continue;
-        }
-        gfxm::mat4 transform = collider->getShapeTransform();
-        if (!transform.is_valid()) {
-            assert(false);
-            continue;
-        }
-        collider->world_aabb = shape->calcWorldAabb(transform);
-    }
-
-    // Update aabb tree
-    //for (int i = 0; i < colliders.size(); ++i) {
-    //    auto collider = colliders[i];
-    for (int i = 0; i < dirty_transform_count; ++i) {
-        auto collider = dirty_transform_array[i];
-        collider->tree_elem.aabb = collider->getBoundingAabb();
-        aabb_tree.remove(&collider->tree_elem);
-        aabb_tree.add(&collider->tree_elem);
-    }
-    aabb_tree.update();
-
-    _broadphase();
-
-    // Clear dirty array
-    clearDirtyTransformArray();
-
-    // Find contact points to preserve
-    if(1) {
-        int contact_points_confirmed = 0;
-        const float SEPARATION_THRESHOLD = 2e-2f;
-        const float SHEARING_THRESHOLD = 5e-2f;
-        for (int i = 0; i < narrow_phase.manifoldCount(); ++i) {
-            phyManifold& M = narrow_phase.getManifold(i);
-            int write_index = 0;
-            for (int j = 0; j < M.pointCount(); ++j) {
-                phyContactPoint cp = M.points[j];
-                const gfxm::vec3 wA = M.collider_a->getTransform() * gfxm::vec4(cp.lcl_point_a, 1.f);
-                gfxm::vec3 wB       = M.collider_b->getTransform() * gfxm::vec4(cp.lcl_point_b, 1.f);
-                const gfxm::vec3 wN = gfxm::normalize(gfxm::to_mat3(M.collider_a->getRotation()) * cp.lcl_normal);
-                float separation = gfxm::dot(wN, wB - wA);
-
-                if (tick_id - cp.tick_id > 3) {
-                    //continue;
-                }
-                if (separation > SEPARATION_THRESHOLD) {
-                    continue;
-                }
-                gfxm::vec3 shearing = (wB - wA) - separation * wN;
-                if(shearing.length2() > SHEARING_THRESHOLD * SHEARING_THRESHOLD) {
-                    continue;
-                }
-                
-                wB = wA + wN * separation;
-
-                assert(wN.is_valid());
-            
-                cp.point_a = wA;
-                cp.point_b = wB;
-                cp.normal_a = wN;
-                cp.normal_b = -wN;
-                cp.depth = -separation;// < .0f ? .0f : -separation;
-                
-                M.points[write_index] = cp;
-                ++write_index;
-                ++contact_points_confirmed;
-            }
-            M.points.resize(write_index);
-            narrow_phase.rebuildManifold(&M);
-        }
-        //LOG_DBG("Confirmed contacts: " << contact_points_confirmed);
-    }
-    
-    /*
-    LOG_DBG("=== Manifolds ===");
-    LOG_DBG("Manifolds back: " << narrow_phase.oldManifoldCount());
-    LOG_DBG("Manifolds front: " << narrow_phase.manifoldCount());
-    */
-
-    // Check for actual collisions
-    for (int i = 0; i < potential_pairs[PHY_PAIR_TYPE::SPHERE_SPHERE].size(); ++i) {
-        auto a = potential_pairs[PHY_PAIR_TYPE::SPHERE_SPHERE][i].first;
-        auto b = potential_pairs[PHY_PAIR_TYPE::SPHERE_SPHERE][i].second;
+void phyWorld::_narrowphasePair(const phyPotentialPair& pair, phyNarrowPhaseContext& ctx) {
+    phyRigidBody* a = pair.a;
+    phyRigidBody* b = pair.b;
+    switch (pair.type) {
+    case PHY_PAIR_TYPE::SPHERE_SPHERE: {
         auto a_type = a->getType();
         auto b_type = b->getType();
         auto sa = (const phySphereShape*)a->getShape();
@@ -1697,48 +2387,53 @@ void phyWorld::updateInternal(float dt) {
             gfxm::vec3 pt_a = normal_a * sa->radius + a_pos;
             gfxm::vec3 pt_b = normal_b * sb->radius + b_pos;
 
-            phyManifold* manifold = narrow_phase.getManifold(a, b, normal_a);
-            narrow_phase.addContact(manifold, pt_a, pt_b, normal_a, normal_b, distance);
+            ctx.contacts.addContact(a, b, normal_a, pt_a, pt_b, normal_a, normal_b, distance);
         }
+        break;
     }
-    for (int i = 0; i < potential_pairs[PHY_PAIR_TYPE::BOX_BOX].size(); ++i) {
-        auto a = potential_pairs[PHY_PAIR_TYPE::BOX_BOX][i].first;
-        auto b = potential_pairs[PHY_PAIR_TYPE::BOX_BOX][i].second;
+    case PHY_PAIR_TYPE::BOX_BOX: {
         auto sa = (const phyBoxShape*)a->getShape();
         auto sb = (const phyBoxShape*)b->getShape();
-        const gfxm::mat4& tr_a = a->getTransform();
-        const gfxm::mat4& tr_b = b->getTransform();
+        const gfxm::mat4 tr_a = a->calcTransform();
+        const gfxm::mat4 tr_b = b->calcTransform();
         /*
         phyContactPoint cp;
         if (intersectBoxBox(sa->half_extents, tr_a, sb->half_extents, tr_b, cp)) {
             phyManifold* manifold = narrow_phase.createManifold(a, b);
             narrow_phase.addContact(manifold, cp);
         }*/
+        if (sat_box_contacts_enabled) {
+            const phyManifold* cached = narrow_phase.findManifold(a, b, 0);
+            phyContactPoint contacts[SAT_BOX_MAX_CONTACTS];
+            int feature = -1;
+            int count = SAT_BoxBox(
+                sa->half_extents, tr_a, sb->half_extents, tr_b,
+                cached ? cached->sat_feature : -1, contacts, feature
+            );
+            ctx.contacts.addManifold(a, b, 0, feature, contacts, count);
+            break;
+        }
         GJKEPA_SupportGetter<phyBoxShape> a_support(tr_a, sa);
         GJKEPA_SupportGetter<phyBoxShape> b_support(tr_b, sb);
         GJK_Simplex simplex;
         EPA_Result result;
-        if (GJKEPA_T(a_support, b_support, simplex, epa_ctx, result)) {
-            phyManifold* manifold = narrow_phase.getManifold(a, b, 0);
-            narrow_phase.addContact(manifold, result.contact_a, result.contact_b, result.normal, -result.normal, result.depth);
+        if (GJKEPA_T(a_support, b_support, simplex, ctx.epa_ctx, result)) {
+            ctx.contacts.addContact(a, b, 0, result.contact_a, result.contact_b, result.normal, -result.normal, result.depth);
         }
+        break;
     }
-    for (int i = 0; i < potential_pairs[PHY_PAIR_TYPE::SPHERE_BOX].size(); ++i) {
-        auto a = potential_pairs[PHY_PAIR_TYPE::SPHERE_BOX][i].first;
-        auto b = potential_pairs[PHY_PAIR_TYPE::SPHERE_BOX][i].second;
+    case PHY_PAIR_TYPE::SPHERE_BOX: {
         auto sa = (const phySphereShape*)a->getShape();
         auto sb = (const phyBoxShape*)b->getShape();
         gfxm::mat4 box_transform = b->getShapeTransform();
         gfxm::vec3 sphere_pos = a->getShapeTransform() * gfxm::vec4(0, 0, 0, 1);        
         phyContactPoint cp;
         if (intersectionSphereBox(sa->radius, sphere_pos, sb->half_extents, box_transform, cp)) {
-            phyManifold* manifold = narrow_phase.getManifold(a, b, 0);
-            narrow_phase.addContact(manifold, cp);
+            ctx.contacts.addContact(a, b, 0, cp);
         }
+        break;
     }
-    for (int i = 0; i < potential_pairs[PHY_PAIR_TYPE::CAPSULE_SPHERE].size(); ++i) {
-        auto a = potential_pairs[PHY_PAIR_TYPE::CAPSULE_SPHERE][i].first;
-        auto b = potential_pairs[PHY_PAIR_TYPE::CAPSULE_SPHERE][i].second;
+    case PHY_PAIR_TYPE::CAPSULE_SPHERE: {
         auto sa = (const phySphereShape*)a->getShape();
         auto sb = (const phyCapsuleShape*)b->getShape();
         gfxm::mat4 capsule_transform = b->getShapeTransform();
@@ -1747,30 +2442,37 @@ void phyWorld::updateInternal(float dt) {
         if (intersectionSphereCapsule(
             sa->radius, sphere_pos, sb->radius, sb->height, capsule_transform, cp
         )) {
-            phyManifold* manifold = narrow_phase.getManifold(a, b, 0);
-            narrow_phase.addContact(manifold, cp);
+            ctx.contacts.addContact(a, b, 0, cp);
         }
+        break;
     }
-    for (int i = 0; i < potential_pairs[PHY_PAIR_TYPE::CAPSULE_BOX].size(); ++i) {
-        auto a = potential_pairs[PHY_PAIR_TYPE::CAPSULE_BOX][i].first;
-        auto b = potential_pairs[PHY_PAIR_TYPE::CAPSULE_BOX][i].second;
+    case PHY_PAIR_TYPE::CAPSULE_BOX: {
         auto sa = (const phyBoxShape*)a->getShape();
         auto sb = (const phyCapsuleShape*)b->getShape();
         gfxm::mat4 a_transform = a->getShapeTransform();
         gfxm::mat4 b_transform = b->getShapeTransform();
 
+        if (sat_box_contacts_enabled) {
+            const phyManifold* cached = narrow_phase.findManifold(a, b, 0);
+            phyContactPoint contacts[SAT_BOX_MAX_CONTACTS];
+            int feature = -1;
+            int count = SAT_BoxCapsule(
+                sa->half_extents, a_transform, sb->radius, sb->height, b_transform,
+                cached ? cached->sat_feature : -1, contacts, feature
+            );
+            ctx.contacts.addManifold(a, b, 0, feature, contacts, count);
+            break;
+        }
         GJKEPA_SupportGetter<phyBoxShape> a_support(a_transform, sa);
         GJKEPA_SupportGetter<phyCapsuleShape> b_support(b_transform, sb);
         GJK_Simplex simplex;
         EPA_Result result;
-        if (GJKEPA_T(a_support, b_support, simplex, epa_ctx, result)) {
-            phyManifold* manifold = narrow_phase.getManifold(a, b, 0);
-            narrow_phase.addContact(manifold, result.contact_a, result.contact_b, result.normal, -result.normal, result.depth);
+        if (GJKEPA_T(a_support, b_support, simplex, ctx.epa_ctx, result)) {
+            ctx.contacts.addContact(a, b, 0, result.contact_a, result.contact_b, result.normal, -result.normal, result.depth);
         }
+        break;
     }
-    for (int i = 0; i < potential_pairs[PHY_PAIR_TYPE::CAPSULE_CAPSULE].size(); ++i) {
-        auto a = potential_pairs[PHY_PAIR_TYPE::CAPSULE_CAPSULE][i].first;
-        auto b = potential_pairs[PHY_PAIR_TYPE::CAPSULE_CAPSULE][i].second;
+    case PHY_PAIR_TYPE::CAPSULE_CAPSULE: {
         auto sa = (const phyCapsuleShape*)a->getShape();
         auto sb = (const phyCapsuleShape*)b->getShape();
         
@@ -1782,20 +2484,17 @@ void phyWorld::updateInternal(float dt) {
         if (intersectCapsuleCapsule(
             sa->radius, sa->height, transform_a, sb->radius, sb->height, transform_b, cp
         )) {
-            phyManifold* manifold = narrow_phase.getManifold(a, b, 0);
-            narrow_phase.addContact(manifold, cp);
+            ctx.contacts.addContact(a, b, 0, cp);
         }
+        break;
     }
-    for (int i = 0; i < potential_pairs[PHY_PAIR_TYPE::SPHERE_TRIANGLEMESH].size(); ++i) {
-        phyRigidBody* a = potential_pairs[PHY_PAIR_TYPE::SPHERE_TRIANGLEMESH][i].first;
-        phyRigidBody* b = potential_pairs[PHY_PAIR_TYPE::SPHERE_TRIANGLEMESH][i].second;
+    case PHY_PAIR_TYPE::SPHERE_TRIANGLEMESH: {
         auto sa = (const phySphereShape*)a->getShape();
         auto sb = (const phyTriangleMeshShape*)b->getShape();
 
         const gfxm::mat4 transform_a = a->getShapeTransform();
         const gfxm::mat4 transform_b = b->getShapeTransform();
 
-        phyManifold* manifold = 0;
         int triangles[128];
         int tri_count = 0;
         tri_count = sb->getMesh()->findPotentialTrianglesAabb(a->getBoundingAabb(), triangles, 128);
@@ -1818,15 +2517,15 @@ void phyWorld::updateInternal(float dt) {
             if (intersectSphereTriangle(
                 sa->radius, transform_a[3], A, B, C, cp
             )) {
-                phyManifold* manifold = narrow_phase.getManifold(a, b, cp.normal_a);
-                fixEdgeCollisionNormal(cp, tri, transform_b, sb->getMesh());
-                narrow_phase.addContact(manifold, cp);
+                // Manifold is keyed by the normal before the edge fix
+                gfxm::vec3 N = cp.normal_a;
+                fixEdgeCollisionNormal(cp, tri, transform_b, sb->getMesh(), dbg_draw_enabled);
+                ctx.contacts.addContact(a, b, N, cp);
             }
         }
+        break;
     }
-    for (int i = 0; i < potential_pairs[PHY_PAIR_TYPE::BOX_TRIANGLEMESH].size(); ++i) {
-        phyRigidBody* a = potential_pairs[PHY_PAIR_TYPE::BOX_TRIANGLEMESH][i].first;
-        phyRigidBody* b = potential_pairs[PHY_PAIR_TYPE::BOX_TRIANGLEMESH][i].second;
+    case PHY_PAIR_TYPE::BOX_TRIANGLEMESH: {
         auto sa = (const phyBoxShape*)a->getShape();
         auto sb = (const phyTriangleMeshShape*)b->getShape();
         const gfxm::mat4 transform_a = a->getShapeTransform();
@@ -1844,15 +2543,13 @@ void phyWorld::updateInternal(float dt) {
 
             GJK_Simplex simplex;
             EPA_Result result;
-            if (GJKEPA_T(a_support, b_support, simplex, epa_ctx, result)) {
-                phyManifold* manifold = narrow_phase.getManifold(a, b, result.normal);
-                narrow_phase.addContact(manifold, result.contact_a, result.contact_b, result.normal, -result.normal, result.depth);
+            if (GJKEPA_T(a_support, b_support, simplex, ctx.epa_ctx, result)) {
+                ctx.contacts.addContact(a, b, result.normal, result.contact_a, result.contact_b, result.normal, -result.normal, result.depth);
             }
         }
+        break;
     }
-    for (int i = 0; i < potential_pairs[PHY_PAIR_TYPE::CAPSULE_TRIANGLEMESH].size(); ++i) {
-        phyRigidBody* a = potential_pairs[PHY_PAIR_TYPE::CAPSULE_TRIANGLEMESH][i].first;
-        phyRigidBody* b = potential_pairs[PHY_PAIR_TYPE::CAPSULE_TRIANGLEMESH][i].second;
+    case PHY_PAIR_TYPE::CAPSULE_TRIANGLEMESH: {
         auto sa = (const phyCapsuleShape*)a->getShape();
         auto sb = (const phyTriangleMeshShape*)b->getShape();
 
@@ -1861,7 +2558,6 @@ void phyWorld::updateInternal(float dt) {
         const gfxm::mat4 transform_a = a->getShapeTransform();
         const gfxm::mat4 transform_b = b->getShapeTransform();
 
-        phyManifold* manifold = 0;
         int triangles[128];
         int tri_count = 0;
         tri_count = sb->getMesh()->findPotentialTrianglesAabb(a->getBoundingAabb(), triangles, 128);
@@ -1888,14 +2584,12 @@ void phyWorld::updateInternal(float dt) {
                 // NOTE: This can cause bad behavior when neighboring surfaces are not connected by an edge
                 //fixEdgeCollisionNormal(cp, tri, transform_b, sb->getMesh());
 
-                phyManifold* manifold = narrow_phase.getManifold(a, b, cp.normal_a);
-                narrow_phase.addContact(manifold, cp);
+                ctx.contacts.addContact(a, b, cp.normal_a, cp);
             }
         }
+        break;
     }
-    for (int i = 0; i < potential_pairs[PHY_PAIR_TYPE::CAPSULE_CONVEX_MESH].size(); ++i) {
-        phyRigidBody* a = potential_pairs[PHY_PAIR_TYPE::CAPSULE_CONVEX_MESH][i].first;
-        phyRigidBody* b = potential_pairs[PHY_PAIR_TYPE::CAPSULE_CONVEX_MESH][i].second;
+    case PHY_PAIR_TYPE::CAPSULE_CONVEX_MESH: {
         auto sa = (const phyCapsuleShape*)a->getShape();
         auto sb = (const phyConvexMeshShape*)b->getShape();
 
@@ -1909,15 +2603,15 @@ void phyWorld::updateInternal(float dt) {
 
         GJK_Simplex simplex;
         EPA_Result result;
-        if (GJKEPA_T(a_support, b_support, simplex, epa_ctx, result)) {
-            phyManifold* manifold = narrow_phase.getManifold(a, b, 0);
-            narrow_phase.addContact(manifold, result.contact_a, result.contact_b, result.normal, -result.normal, result.depth);
-            sb->debugDraw(transform_b, 0xFF0000FF);
+        if (GJKEPA_T(a_support, b_support, simplex, ctx.epa_ctx, result)) {
+            ctx.contacts.addContact(a, b, 0, result.contact_a, result.contact_b, result.normal, -result.normal, result.depth);
+            if (dbg_draw_enabled) {
+                sb->debugDraw(transform_b, 0xFF0000FF);
+            }
         }
+        break;
     }
-    for (int i = 0; i < potential_pairs[PHY_PAIR_TYPE::TRIANGLE_MESH_CONVEX_MESH].size(); ++i) {
-        phyRigidBody* a = potential_pairs[PHY_PAIR_TYPE::TRIANGLE_MESH_CONVEX_MESH][i].first;
-        phyRigidBody* b = potential_pairs[PHY_PAIR_TYPE::TRIANGLE_MESH_CONVEX_MESH][i].second;
+    case PHY_PAIR_TYPE::TRIANGLE_MESH_CONVEX_MESH: {
         auto sa = (const phyTriangleMeshShape*)a->getShape();
         auto sb = (const phyConvexMeshShape*)b->getShape();
         const gfxm::mat4 transform_a = a->getShapeTransform();
@@ -1948,66 +2642,20 @@ void phyWorld::updateInternal(float dt) {
             /*
             phyContactPoint cp;
             if (SAT_ConvexMeshTriangle(transform_b, sb->getMesh(), tri_points, cp)) {
-                phyManifold* manifold = narrow_phase.getManifold(a, b, cp.normal_a);
-                narrow_phase.addContact(manifold, cp.point_a, cp.point_b, cp.normal_a, cp.normal_b, cp.depth);
+                ctx.contacts.addContact(a, b, cp.normal_a, cp.point_a, cp.point_b, cp.normal_a, cp.normal_b, cp.depth);
             }*/
             GJKEPA_SupportGetter<phyTriangleMeshShape> a_support(transform_a, sa, tri);
             GJKEPA_SupportGetter<phyConvexMeshShape> b_support(transform_b, sb);            
 
             GJK_Simplex simplex;
             EPA_Result result;
-            if (GJKEPA_T(a_support, b_support, simplex, epa_ctx, result)) {
-                phyManifold* manifold = narrow_phase.getManifold(a, b, result.normal);
-                narrow_phase.addContact(manifold, result.contact_a, result.contact_b, result.normal, -result.normal, result.depth);
+            if (GJKEPA_T(a_support, b_support, simplex, ctx.epa_ctx, result)) {
+                ctx.contacts.addContact(a, b, result.normal, result.contact_a, result.contact_b, result.normal, -result.normal, result.depth);
             }
         }
+        break;
     }
-    /*
-    for (int i = 0; i < potential_pairs[PHY_PAIR_TYPE::TRIANGLE_MESH_CONVEX_MESH].size(); ++i) {
-        phyRigidBody* a = potential_pairs[PHY_PAIR_TYPE::TRIANGLE_MESH_CONVEX_MESH][i].first;
-        phyRigidBody* b = potential_pairs[PHY_PAIR_TYPE::TRIANGLE_MESH_CONVEX_MESH][i].second;
-        auto sa = (const phyTriangleMeshShape*)a->getShape();
-        auto sb = (const phyConvexMeshShape*)b->getShape();
-
-        //dbgDrawLine(a->position, b->position, DBG_COLOR_RED);
-        
-        const gfxm::mat4 transform_a = a->getShapeTransform();
-        const gfxm::mat4 transform_b = b->getShapeTransform();
-
-        int triangles[128];
-        int tri_count = 0;
-        tri_count = sa->getMesh()->findPotentialTrianglesAabb(b->getBoundingAabb(), triangles, 128);
-
-        for (int j = 0; j < tri_count; ++j) {
-            int tri = triangles[j];
-
-#if COLLISION_DBG_DRAW_CONTACT_POINTS == 1
-            const gfxm::vec3* vertices = sa->getMesh()->getVertexData();
-            const uint32_t* indices = sa->getMesh()->getIndexData();
-            gfxm::vec3 A, B, C;
-            A = transform_a * gfxm::vec4(vertices[indices[tri * 3]], 1.0f);
-            B = transform_a * gfxm::vec4(vertices[indices[tri * 3 + 1]], 1.0f);
-            C = transform_a * gfxm::vec4(vertices[indices[tri * 3 + 2]], 1.0f);
-            if (dbg_draw_enabled) {
-                dbgDrawLine(A, B, DBG_COLOR_RED);
-                dbgDrawLine(B, C, DBG_COLOR_GREEN);
-                dbgDrawLine(C, A, DBG_COLOR_BLUE);
-            }
-#endif
-            GJKEPA_SupportGetter<phyTriangleMeshShape> a_support(transform_a, sa, tri);
-            GJKEPA_SupportGetter<phyConvexMeshShape> b_support(transform_b, sb);            
-
-            GJK_Simplex simplex;
-            EPA_Result result;
-            if (GJKEPA_T(a_support, b_support, simplex, epa_ctx, result)) {
-                phyManifold* manifold = narrow_phase.getManifold(a, b, result.normal);
-                narrow_phase.addContact(manifold, result.contact_a, result.contact_b, result.normal, -result.normal, result.depth);
-            }
-        }
-    }*/
-    for (int i = 0; i < potential_pairs[PHY_PAIR_TYPE::CONVEX_MESH_CONVEX_MESH].size(); ++i) {
-        phyRigidBody* a = potential_pairs[PHY_PAIR_TYPE::CONVEX_MESH_CONVEX_MESH][i].first;
-        phyRigidBody* b = potential_pairs[PHY_PAIR_TYPE::CONVEX_MESH_CONVEX_MESH][i].second;
+    case PHY_PAIR_TYPE::CONVEX_MESH_CONVEX_MESH: {
         auto sa = (const phyConvexMeshShape*)a->getShape();
         auto sb = (const phyConvexMeshShape*)b->getShape();
 
@@ -2021,14 +2669,12 @@ void phyWorld::updateInternal(float dt) {
 
         GJK_Simplex simplex;
         EPA_Result result;
-        if (GJKEPA_T(a_support, b_support, simplex, epa_ctx, result)) {
-            phyManifold* manifold = narrow_phase.getManifold(a, b, result.normal);
-            narrow_phase.addContact(manifold, result.contact_a, result.contact_b, result.normal, -result.normal, result.depth);
+        if (GJKEPA_T(a_support, b_support, simplex, ctx.epa_ctx, result)) {
+            ctx.contacts.addContact(a, b, result.normal, result.contact_a, result.contact_b, result.normal, -result.normal, result.depth);
         }
+        break;
     }
-    for (int i = 0; i < potential_pairs[PHY_PAIR_TYPE::SPHERE_HEIGHTFIELD].size(); ++i) {
-        phyRigidBody* a = potential_pairs[PHY_PAIR_TYPE::SPHERE_HEIGHTFIELD][i].first;
-        phyRigidBody* b = potential_pairs[PHY_PAIR_TYPE::SPHERE_HEIGHTFIELD][i].second;
+    case PHY_PAIR_TYPE::SPHERE_HEIGHTFIELD: {
         auto sphere = (const phySphereShape*)a->getShape();
         auto heightfield = (const phyHeightfieldShape*)b->getShape();
         const gfxm::mat4 transform_a = a->getShapeTransform();
@@ -2037,115 +2683,316 @@ void phyWorld::updateInternal(float dt) {
         const gfxm::mat4 inv_b = gfxm::inverse(transform_b);
         const gfxm::vec3 sphere_pos = inv_b * transform_a[3];
 
-        float minx = sphere_pos.x - sphere->radius;
-        float maxx = sphere_pos.x + sphere->radius;
-        float minz = sphere_pos.z - sphere->radius;
-        float maxz = sphere_pos.z + sphere->radius;
-        float miny = sphere_pos.y - sphere->radius;
-        float maxy = sphere_pos.y + sphere->radius;
+        gfxm::aabb local_box;
+        local_box.from = sphere_pos - gfxm::vec3(sphere->radius, sphere->radius, sphere->radius);
+        local_box.to = sphere_pos + gfxm::vec3(sphere->radius, sphere->radius, sphere->radius);
+
+        forEachHeightfieldCell(heightfield, local_box, transform_b, dbg_draw_enabled, [&](const gfxm::vec3* p) {
+            phyContactPoint cp;
+            if (intersectSphereTriangle(
+                sphere->radius, sphere_pos, p[0], p[1], p[2], cp
+            )) {
+                heightfieldContactToWorld(cp, transform_b);
+                ctx.contacts.addContact(a, b, cp.normal_a, cp);
+            }
+            if (intersectSphereTriangle(
+                sphere->radius, sphere_pos, p[2], p[3], p[0], cp
+            )) {
+                heightfieldContactToWorld(cp, transform_b);
+                ctx.contacts.addContact(a, b, cp.normal_a, cp);
+            }
+        });
+        break;
+    }
+    case PHY_PAIR_TYPE::BOX_HEIGHTFIELD: {
+        auto sa = (const phyBoxShape*)a->getShape();
+        auto heightfield = (const phyHeightfieldShape*)b->getShape();
+        const gfxm::mat4 transform_b = b->getShapeTransform();
+
+        // Box goes to heightfield space, cells are used as they are stored
+        const gfxm::mat4 inv_b = gfxm::inverse(transform_b);
+        const gfxm::mat4 transform_a = inv_b * a->getShapeTransform();
+
+        forEachHeightfieldCell(heightfield, heightfieldLocalAabb(a->getBoundingAabb(), inv_b), transform_b, dbg_draw_enabled, [&](const gfxm::vec3* p) {
+            const gfxm::vec3 triangles[2][3] = {
+                { p[0], p[1], p[2] },
+                { p[2], p[3], p[0] }
+            };
+            for (int t = 0; t < 2; ++t) {
+                GJKEPA_SupportGetter<phyBoxShape> a_support(transform_a, sa);
+                GJKEPA_SupportGetter<TRIANGLE_SUPPORT_TAG> b_support(triangles[t]);
+
+                GJK_Simplex simplex;
+                EPA_Result result;
+                if (GJKEPA_T(a_support, b_support, simplex, ctx.epa_ctx, result)) {
+                    const gfxm::vec3 N = transform_b * gfxm::vec4(result.normal, .0f);
+                    ctx.contacts.addContact(
+                        a, b, N,
+                        transform_b * gfxm::vec4(result.contact_a, 1.f),
+                        transform_b * gfxm::vec4(result.contact_b, 1.f),
+                        N, -N, result.depth
+                    );
+                }
+            }
+        });
+        break;
+    }
+    case PHY_PAIR_TYPE::CAPSULE_HEIGHTFIELD: {
+        auto sa = (const phyCapsuleShape*)a->getShape();
+        auto heightfield = (const phyHeightfieldShape*)b->getShape();
+        const gfxm::mat4 transform_b = b->getShapeTransform();
+
+        const gfxm::mat4 inv_b = gfxm::inverse(transform_b);
+        const gfxm::mat4 transform_a = inv_b * a->getShapeTransform();
+
+        forEachHeightfieldCell(heightfield, heightfieldLocalAabb(a->getBoundingAabb(), inv_b), transform_b, dbg_draw_enabled, [&](const gfxm::vec3* p) {
+            phyContactPoint cp;
+            if (intersectCapsuleTriangle2(
+                sa->radius, sa->height, transform_a, p[0], p[1], p[2], cp
+            )) {
+                heightfieldContactToWorld(cp, transform_b);
+                ctx.contacts.addContact(a, b, cp.normal_a, cp);
+            }
+            if (intersectCapsuleTriangle2(
+                sa->radius, sa->height, transform_a, p[2], p[3], p[0], cp
+            )) {
+                heightfieldContactToWorld(cp, transform_b);
+                ctx.contacts.addContact(a, b, cp.normal_a, cp);
+            }
+        });
+        break;
+    }
+    case PHY_PAIR_TYPE::CONVEX_MESH_HEIGHTFIELD: {
+        auto sa = (const phyConvexMeshShape*)a->getShape();
+        auto heightfield = (const phyHeightfieldShape*)b->getShape();
+        const gfxm::mat4 transform_b = b->getShapeTransform();
+
+        const gfxm::mat4 inv_b = gfxm::inverse(transform_b);
+        const gfxm::mat4 transform_a = inv_b * a->getShapeTransform();
 
-        float cell_width = heightfield->getCellWidth();
-        float cell_depth = heightfield->getCellDepth();
+        forEachHeightfieldCell(heightfield, heightfieldLocalAabb(a->getBoundingAabb(), inv_b), transform_b, dbg_draw_enabled, [&](const gfxm::vec3* p) {
+            const gfxm::vec3 triangles[2][3] = {
+                { p[0], p[1], p[2] },
+                { p[2], p[3], p[0] }
+            };
+            for (int t = 0; t < 2; ++t) {
+                GJKEPA_SupportGetter<phyConvexMeshShape> a_support(transform_a, sa);
+                GJKEPA_SupportGetter<TRIANGLE_SUPPORT_TAG> b_support(triangles[t]);
+
+                GJK_Simplex simplex;
+                EPA_Result result;
+                if (GJKEPA_T(a_support, b_support, simplex, ctx.epa_ctx, result)) {
+                    const gfxm::vec3 N = transform_b * gfxm::vec4(result.normal, .0f);
+                    ctx.contacts.addContact(
+                        a, b, N,
+                        transform_b * gfxm::vec4(result.contact_a, 1.f),
+                        transform_b * gfxm::vec4(result.contact_b, 1.f),
+                        N, -N, result.depth
+                    );
+                }
+            }
+        });
+        break;
+    }
 
-        int sminx = gfxm::clamp(minx / cell_width, .0f, heightfield->getSampleCountX() - 1);
-        int smaxx = gfxm::clamp(1 + maxx / cell_width, .0f, heightfield->getSampleCountX() - 1);
-        int sminz = gfxm::clamp(minz / cell_depth, .0f, heightfield->getSampleCountZ() - 1);
-        int smaxz = gfxm::clamp(1 + maxz / cell_depth, .0f, heightfield->getSampleCountZ() - 1);
 
-        if (sminx == smaxx || sminz == smaxz) {
+    default:
+        break;
+    }
+}
+void phyWorld::_narrowphase() {
+    // Order matters, manifolds are created in the order contacts are merged
+    static const PHY_PAIR_TYPE pair_types[] = {
+        PHY_PAIR_TYPE::SPHERE_SPHERE,
+        PHY_PAIR_TYPE::BOX_BOX,
+        PHY_PAIR_TYPE::SPHERE_BOX,
+        PHY_PAIR_TYPE::CAPSULE_SPHERE,
+        PHY_PAIR_TYPE::CAPSULE_BOX,
+        PHY_PAIR_TYPE::CAPSULE_CAPSULE,
+        PHY_PAIR_TYPE::SPHERE_TRIANGLEMESH,
+        PHY_PAIR_TYPE::BOX_TRIANGLEMESH,
+        PHY_PAIR_TYPE::CAPSULE_TRIANGLEMESH,
+        PHY_PAIR_TYPE::CAPSULE_CONVEX_MESH,
+        PHY_PAIR_TYPE::TRIANGLE_MESH_CONVEX_MESH,
+        PHY_PAIR_TYPE::CONVEX_MESH_CONVEX_MESH,
+        PHY_PAIR_TYPE::SPHERE_HEIGHTFIELD,
+        PHY_PAIR_TYPE::BOX_HEIGHTFIELD,
+        PHY_PAIR_TYPE::CAPSULE_HEIGHTFIELD,
+        PHY_PAIR_TYPE::CONVEX_MESH_HEIGHTFIELD
+    };
+
+    narrowphase_pairs.clear();
+    for (auto type : pair_types) {
+        auto it = potential_pairs.find(type);
+        if (it == potential_pairs.end()) {
             continue;
         }
+        for (auto& p : it->second) {
+            narrowphase_pairs.push_back(phyPotentialPair{ type, p.first, p.second });
+        }
+    }
 
-        {
-            gfxm::vec3 p0 = transform_b * gfxm::vec4(minx, .0f, minz, 1.f);
-            gfxm::vec3 p1 = transform_b * gfxm::vec4(maxx, .0f, minz, 1.f);
-            gfxm::vec3 p2 = transform_b * gfxm::vec4(maxx, .0f, maxz, 1.f);
-            gfxm::vec3 p3 = transform_b * gfxm::vec4(minx, .0f, maxz, 1.f);
-
-            dbgDrawLine(p0, p1, 0xFFFF00FF);
-            dbgDrawLine(p1, p2, 0xFFFF00FF);
-            dbgDrawLine(p2, p3, 0xFFFF00FF);
-            dbgDrawLine(p3, p0, 0xFFFF00FF);
-        }
-        {
-            gfxm::vec3 p0 = transform_b * gfxm::vec4(sminx * cell_width, .0f, sminz * cell_depth, 1.f);
-            gfxm::vec3 p1 = transform_b * gfxm::vec4(smaxx * cell_width, .0f, sminz * cell_depth, 1.f);
-            gfxm::vec3 p2 = transform_b * gfxm::vec4(smaxx * cell_width, .0f, smaxz * cell_depth, 1.f);
-            gfxm::vec3 p3 = transform_b * gfxm::vec4(sminx * cell_width, .0f, smaxz * cell_depth, 1.f);
-
-            dbgDrawLine(p0, p1, 0xFF0000FF);
-            dbgDrawLine(p1, p2, 0xFF0000FF);
-            dbgDrawLine(p2, p3, 0xFF0000FF);
-            dbgDrawLine(p3, p0, 0xFF0000FF);
-        }
-
-        int scount_x = heightfield->getSampleCountX();
-        const float* samples = heightfield->getData();
-        for (int z = sminz; z < smaxz; ++z) {
-            for (int x = sminx; x < smaxx; ++x) {
-                float h0 = samples[x + z * scount_x];
-                float h1 = samples[x + (z + 1) * scount_x];
-                float h2 = samples[x + 1 + (z + 1) * scount_x];
-                float h3 = samples[x + 1 + z * scount_x];
-
-                float hmin = gfxm::_min(gfxm::_min(h0, h1), gfxm::_min(h2, h3));
-                float hmax = gfxm::_max(gfxm::_max(h0, h1), gfxm::_max(h2, h3));
-
-                if ((hmin < miny && hmax < miny)
-                    || (hmin > maxy && hmax > maxy)
-                    ) {
-                    continue;
-                }
+    // Debug drawing is not thread safe
+    const int thread_count = dbg_draw_enabled ? 1 : thread_pool.getThreadCount();
+    const int pair_count = (int)narrowphase_pairs.size();
+    int job_count = std::min(
+        thread_count * PHY_NARROWPHASE_JOBS_PER_THREAD,
+        (pair_count + PHY_NARROWPHASE_MIN_PAIRS_PER_JOB - 1) / PHY_NARROWPHASE_MIN_PAIRS_PER_JOB
+    );
+    job_count = std::max(job_count, 1);
+    while (narrowphase_contexts.size() < job_count) {
+        narrowphase_contexts.push_back(std::make_unique<phyNarrowPhaseContext>());
+    }
 
-                {
-                    gfxm::vec3 p0 = transform_b * gfxm::vec4(x * cell_width, h0, z * cell_depth, 1.f);
-                    gfxm::vec3 p1 = transform_b * gfxm::vec4(x * cell_width, h1, (z + 1) * cell_depth, 1.f);
-                    gfxm::vec3 p2 = transform_b * gfxm::vec4((x + 1) * cell_width, h2, (z + 1) * cell_depth, 1.f);
-                    gfxm::vec3 p3 = transform_b * gfxm::vec4((x + 1) * cell_width, h3, z * cell_depth, 1.f);
-
-                    dbgDrawLine(p0, p1, 0xFFFFFFFF);
-                    dbgDrawLine(p1, p2, 0xFFFFFFFF);
-                    dbgDrawLine(p2, p3, 0xFFFFFFFF);
-                    dbgDrawLine(p3, p0, 0xFFFFFFFF);
-                    dbgDrawLine(p2, p0, 0xFFFFFFFF);
-                }
+    // Each job gets a contiguous range of pairs and writes to its own buffer,
+    // buffers are merged in job order so the result is the same for any thread count
+    std::function<void(int)> fn_job = [this, pair_count, job_count](int job) {
+        phyNarrowPhaseContext& ctx = *narrowphase_contexts[job];
+        ctx.contacts.clear();
+        const int begin = int(int64_t(pair_count) * job / job_count);
+        const int end = int(int64_t(pair_count) * (job + 1) / job_count);
+        for (int i = begin; i < end; ++i) {
+            _narrowphasePair(narrowphase_pairs[i], ctx);
+        }
+    };
+    if (thread_count == 1) {
+        for (int i = 0; i < job_count; ++i) {
+            fn_job(i);
+        }
+    } else {
+        thread_pool.run(job_count, fn_job);
+    }
+
+    for (int i = 0; i < job_count; ++i) {
+        narrow_phase.addContacts(narrowphase_contexts[i]->contacts);
+    }
+}
+bool dbg_stepPhysics = true;
+void phyWorld::updateInternal(float dt) {
+    if (dbg_stepPhysics) {
+        //dbg_stepPhysics = false;
+    } else {
+        return;
+    }
+    ++tick_id;
+
+    // Clear per-frame data
+    //clearContactPoints();
 
-                gfxm::vec3 p0(x * cell_width, h0, z * cell_depth);
-                gfxm::vec3 p1(x * cell_width, h1, (z + 1) * cell_depth);
-                gfxm::vec3 p2((x + 1) * cell_width, h2, (z + 1) * cell_depth);
-                gfxm::vec3 p3((x + 1) * cell_width, h3, z * cell_depth);
-                phyContactPoint cp;
-                if (intersectSphereTriangle(
-                    sphere->radius, sphere_pos, p0, p1, p2, cp
-                )) {
-                    cp.normal_a = transform_b * gfxm::vec4(cp.normal_a, .0f);
-                    cp.normal_b = transform_b * gfxm::vec4(cp.normal_b, .0f);
-                    cp.point_a = transform_b * gfxm::vec4(cp.point_a, 1.f);
-                    cp.point_b = transform_b * gfxm::vec4(cp.point_b, 1.f);
-                    phyManifold* manifold = narrow_phase.getManifold(a, b, cp.normal_a);
-                    narrow_phase.addContact(manifold, cp);
+    for (auto& it : potential_pairs) {
+        it.second.clear();
+    }
+    for (int i = 0; i < probes.size(); ++i) {
+        probes[i]->_clearOverlappingColliders();
+    }
+
+    // Wake bodies that were given velocity while asleep
+    for (int i = 0; i < colliders.size(); ++i) {
+        auto collider = colliders[i];
+        if (collider->is_sleeping
+            && (collider->velocity.length2() > FLT_EPSILON || collider->angular_velocity.length2() > FLT_EPSILON)
+        ) {
+            wakeCollider(collider);
+        }
+    }
+
+    // Update bounds data
+    //for (int i = 0; i < colliders.size(); ++i) {
+    //    auto collider = colliders[i];
+    for (int i = 0; i < dirty_transform_count; ++i) {
+        auto collider = dirty_transform_array[i];
+        const phyShape* shape = collider->getShape();
+        if (!shape) {
+            assert(false);
+            continue;
+        }
+        gfxm::mat4 transform = collider->getShapeTransform();
+        if (!transform.is_valid()) {
+            assert(false);
+            continue;
+        }
+        collider->world_aabb = shape->calcWorldAabb(transform);
+    }
+
+    // Update aabb tree
+    //for (int i = 0; i < colliders.size(); ++i) {
+    //    auto collider = colliders[i];
+    for (int i = 0; i < dirty_transform_count; ++i) {
+        auto collider = dirty_transform_array[i];
+        aabb_tree.moveProxy(collider->tree_proxy, collider->getBoundingAabb(), collider->velocity * dt);
+    }
+
+    _broadphase();
+
+    // Find contact points to preserve
+    if(1) {
+        int contact_points_confirmed = 0;
+        const float SEPARATION_THRESHOLD = 2e-2f;
+        const float SHEARING_THRESHOLD = 5e-2f;
+        for (int i = 0; i < narrow_phase.manifoldCount(); ++i) {
+            phyManifold& M = narrow_phase.getManifold(i);
+            // Neither body moved, sleeping islands keep their contacts as they are
+            if (!_isAwakeDynamic(M.collider_a) && !_isAwakeDynamic(M.collider_b)
+                && !_isTransformDirty(M.collider_a) && !_isTransformDirty(M.collider_b)
+            ) {
+                continue;
+            }
+            int write_index = 0;
+            for (int j = 0; j < M.pointCount(); ++j) {
+                phyContactPoint cp = M.points[j];
+                const gfxm::vec3 wA = M.collider_a->getTransform() * gfxm::vec4(cp.lcl_point_a, 1.f);
+                gfxm::vec3 wB       = M.collider_b->getTransform() * gfxm::vec4(cp.lcl_point_b, 1.f);
+                const gfxm::vec3 wN = gfxm::normalize(gfxm::to_mat3(M.collider_a->getRotation()) * cp.lcl_normal);
+                float separation = gfxm::dot(wN, wB - wA);
+
+                if (tick_id - cp.tick_id > 3) {
+                    //continue;
                 }
-                if (intersectSphereTriangle(
-                    sphere->radius, sphere_pos, p2, p3, p0, cp
-                )) {
-                    cp.normal_a = transform_b * gfxm::vec4(cp.normal_a, .0f);
-                    cp.normal_b = transform_b * gfxm::vec4(cp.normal_b, .0f);
-                    cp.point_a = transform_b * gfxm::vec4(cp.point_a, 1.f);
-                    cp.point_b = transform_b * gfxm::vec4(cp.point_b, 1.f);
-                    phyManifold* manifold = narrow_phase.getManifold(a, b, cp.normal_a);
-                    narrow_phase.addContact(manifold, cp);
+                if (separation > SEPARATION_THRESHOLD) {
+                    continue;
+                }
+                gfxm::vec3 shearing = (wB - wA) - separation * wN;
+                if(shearing.length2() > SHEARING_THRESHOLD * SHEARING_THRESHOLD) {
+                    continue;
                 }
+                
+                wB = wA + wN * separation;
+
+                assert(wN.is_valid());
+            
+                cp.point_a = wA;
+                cp.point_b = wB;
+                cp.normal_a = wN;
+                cp.normal_b = -wN;
+                cp.depth = -separation;// < .0f ? .0f : -separation;
+                
+                M.points[write_index] = cp;
+                ++write_index;
+                ++contact_points_confirmed;
             }
+            M.points.resize(write_index);
+            narrow_phase.rebuildManifold(&M);
         }
+        //LOG_DBG("Confirmed contacts: " << contact_points_confirmed);
     }
 
-    // Poke awake colliding bodies
+    // Clear dirty array
+    clearDirtyTransformArray();
+    
     /*
-    for (int i = 0; i < narrow_phase.manifoldCount(); ++i) {
-        auto& m = narrow_phase.getManifold(i);
-        m.collider_a->is_sleeping = false;
-        m.collider_b->is_sleeping = false;
-    }*/
+    LOG_DBG("=== Manifolds ===");
+    LOG_DBG("Manifolds back: " << narrow_phase.oldManifoldCount());
+    LOG_DBG("Manifolds front: " << narrow_phase.manifoldCount());
+    */
+
+    // Check for actual collisions
+    timer timer_narrowphase;
+    timer_narrowphase.start();
+    _narrowphase();
+    narrowphase_time = timer_narrowphase.stop();
+
+    // Poke awake colliding bodies and group them into islands
+    _buildIslands();
 
     // Fill overlapping collider arrays for probe objects
     for (int i = 0; i < narrow_phase.manifoldCount(); ++i) {
@@ -2174,7 +3021,10 @@ void phyWorld::updateInternal(float dt) {
     }
 
     // Resolve penetration (impulse)
+    timer timer_solver;
+    timer_solver.start();
     _solveImpulses(dt);
+    solver_time = timer_solver.stop();
 
     // Store previous position
     for (int i = 0; i < colliders.size(); ++i) {
@@ -2246,23 +3096,6 @@ void phyWorld::updateInternal(float dt) {
         }
     }
 
-    const float SLEEP_THRESHOLD_SEC = 5.f;
-    for (int i = 0; i < colliders.size(); ++i) {
-        auto& collider = colliders[i];
-        const float EPS = 1e-3f;
-        if (collider->velocity.length2() < EPS
-            && collider->angular_velocity.length2() < EPS
-        ) {
-            collider->sleep_timer += dt;
-            if(collider->sleep_timer > SLEEP_THRESHOLD_SEC) {
-                collider->is_sleeping = true;
-                collider->velocity = gfxm::vec3(.0f, .0f, .0f);
-                collider->angular_velocity = gfxm::vec3(.0f, .0f, .0f);
-            }
-        } else {
-            collider->is_sleeping = false;
-            collider->sleep_timer = .0f;
-        }
-    }
+    _sleepIslands(dt);
 }
 
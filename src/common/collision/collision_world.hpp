@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <vector>
 #include <unordered_map>
+#include <memory>
+#include <algorithm>
 #include "math/gfxm.hpp"
 #include "collision/common.hpp"
 #include "collision/narrow_phase.hpp"
@@ -16,10 +18,13 @@
 #include "collision/shape/empty.hpp"
 
 #include "collision/collider.hpp"
+#include "collision/contact_solver.hpp"
 
 #include "debug_draw/debug_draw.hpp"
 
-#include "aabb_tree/aabb_tree.hpp"
+#include "aabb_tree/aabb_tree_flat.hpp"
+
+#include "util/thread_pool.hpp"
 
 #define PHY_ENABLE_ACCUMULATION 1
 #define PHY_ENABLE_POSITION_CORRECTION 1
@@ -27,6 +32,23 @@
 #define PHY_ENABLE_WARM_STARTING 1
 #define PHY_ENABLE_FRICTION 1
 
+// Narrowphase pairs are split into roughly this many jobs per thread to even out the load
+constexpr int PHY_NARROWPHASE_JOBS_PER_THREAD = 4;
+constexpr int PHY_NARROWPHASE_MIN_PAIRS_PER_JOB = 32;
+// Same for islands in the solver, islands are never split between jobs
+constexpr int PHY_SOLVER_JOBS_PER_THREAD = 4;
+// Small islands are packed together until a batch has this many contacts, so SIMD blocks stay full
+constexpr int PHY_SOLVER_MIN_CONTACTS_PER_BATCH = 256;
+
+// Batched ray and sweep queries
+constexpr int PHY_QUERY_JOBS_PER_THREAD = 4;
+constexpr int PHY_QUERY_MIN_QUERIES_PER_JOB = 64;
+
+constexpr int PHY_DEFAULT_SOLVER_ITERATIONS = 16;
+// An island falls asleep once all of its bodies stayed below the threshold for this long
+constexpr float PHY_SLEEP_THRESHOLD_SEC = 5.f;
+constexpr float PHY_SLEEP_VELOCITY_THRESHOLD2 = 1e-3f;
+
 #define COLLISION_DBG_DRAW_AABB_TREE 0
 #define COLLISION_DBG_DRAW_COLLIDERS 1
 #define COLLISION_DBG_DRAW_CONTACT_POINTS 1
@@ -51,6 +73,33 @@ struct phySphereSweepResult {
     bool hasHit = false;
 };
 
+enum class PHY_QUERY_HIT {
+    CLOSEST,    // Nearest hit along the segment
+    ANY         // First hit found, stops looking as soon as there is one
+};
+
+struct phyRayQuery {
+    gfxm::vec3 from;
+    gfxm::vec3 to;
+    uint64_t mask = COLLISION_MASK_EVERYTHING;
+};
+struct phySphereSweepQuery {
+    gfxm::vec3 from;
+    gfxm::vec3 to;
+    float radius = .0f;
+    uint64_t mask = COLLISION_MASK_EVERYTHING;
+};
+
+// Every hit of a batch, hits of query i are hits[first[i]] to hits[first[i + 1] - 1], nearest first
+struct phyRayHitList {
+    std::vector<phyRayCastResult> hits;
+    std::vector<int> first;
+};
+struct phySphereSweepHitList {
+    std::vector<phySphereSweepResult> hits;
+    std::vector<int> first;
+};
+
 class phyJoint {
 public:
     phyJoint(phyRigidBody* a, phyRigidBody* b, const gfxm::vec3& joint_pt, const gfxm::mat3& joint_basis)
@@ -102,6 +151,62 @@ public:
     float softness = .0f;
 };
 
+struct phyPotentialPair {
+    PHY_PAIR_TYPE type;
+    phyRigidBody* a;
+    phyRigidBody* b;
+};
+
+// Per job scratch and output, one per narrowphase job
+struct phyNarrowPhaseContext {
+    EPA_Context epa_ctx;
+    phyContactBuffer contacts;
+};
+
+// Contact manifold or joint connecting two bodies, at least one of them dynamic
+struct phyIslandEdge {
+    phyRigidBody* a;
+    phyRigidBody* b;
+    int manifold;       // -1 for joints
+    phyJoint* joint;
+};
+
+// Group of awake dynamic bodies connected by contacts and joints, rebuilt every step
+// Islands share no dynamic bodies and are solved independently of each other
+// Ranges point into phyWorld's island_bodies, island_manifolds and island_joints
+struct phyIsland {
+    int first_body = 0;
+    int body_count = 0;
+    int first_manifold = 0;
+    int manifold_count = 0;
+    int first_joint = 0;
+    int joint_count = 0;
+    int solver_iterations = PHY_DEFAULT_SOLVER_ITERATIONS;
+};
+
+// Run of consecutive islands solved together, either by the packed contact solver
+// or one island at a time by the scalar one (islands with joints, or the packed solver is off)
+// Batches only depend on the islands, not on the thread count
+struct phySolverBatch {
+    int first_island = 0;
+    int island_count = 0;
+    int contact_count = 0;
+    bool packed = false;
+};
+
+// Per job scratch for the packed solver
+struct phySolverContext {
+    phyContactSolver solver;
+    std::vector<phyContactPoint*> points;
+};
+
+struct phyIslandStats {
+    int island_count = 0;
+    int active_body_count = 0;
+    int sleeping_body_count = 0;
+    int woken_body_count = 0;   // Woken since the end of the previous step
+};
+
 class phyWorld {
     std::vector<phyRigidBody*> colliders;
     std::vector<phyJoint*> joints;
@@ -115,9 +220,37 @@ class phyWorld {
     float dt_accum = .0f;
     int tick_id = 0;
 
-    EPA_Context epa_ctx;
-
-    AabbTree aabb_tree;
+    ThreadPool thread_pool;
+    std::vector<phyPotentialPair> narrowphase_pairs;
+    std::vector<std::unique_ptr<phyNarrowPhaseContext>> narrowphase_contexts;
+    float narrowphase_time = .0f;
+
+    std::vector<phyIslandEdge> island_edges;
+    std::vector<int> island_parents;
+    std::vector<int> island_roots;
+    std::vector<phyIsland> islands;
+    std::vector<phyRigidBody*> island_bodies;
+    std::vector<int> island_manifolds;
+    std::vector<phyJoint*> island_joints;
+    std::vector<phySolverBatch> solver_batches;
+    std::vector<int> solver_jobs;
+    std::vector<std::unique_ptr<phySolverContext>> solver_contexts;
+    bool packed_solver_enabled = true;
+    bool sat_box_contacts_enabled = true;
+    float solver_time = .0f;
+    int solver_contact_count = 0;
+    // Bodies of each island that fell asleep, kept to wake them together
+    std::vector<std::vector<phyRigidBody*>> sleeping_islands;
+    std::vector<int> free_sleeping_islands;
+    // Per job hit lists and hit counts of the batched queries, merged in job order
+    std::vector<std::vector<phyRayCastResult>> query_ray_hits;
+    std::vector<std::vector<phySphereSweepResult>> query_sweep_hits;
+    std::vector<int> query_hit_counts;
+    int default_solver_iterations = PHY_DEFAULT_SOLVER_ITERATIONS;
+    int woken_count = 0;
+    phyIslandStats island_stats;
+
+    AabbTreeFlat aabb_tree;
 
     std::vector<phyRigidBody*> dirty_transform_array;
     int dirty_transform_count = 0;
@@ -134,6 +267,17 @@ class phyWorld {
 
     void _broadphase();
     void _broadphase_Naive();
+    void _narrowphase();
+    void _narrowphasePair(const phyPotentialPair& pair, phyNarrowPhaseContext& ctx);
+
+    bool _isDynamic(const phyRigidBody* body) const;
+    bool _isAwakeDynamic(const phyRigidBody* body) const;
+    float _getSolverInverseMass(phyRigidBody* body) const;
+    gfxm::mat3 _getSolverInverseInertia(phyRigidBody* body) const;
+    int _findIslandRoot(int node);
+    void _wakeOverlappingBodies(phyRigidBody* collider);
+    void _buildIslands();
+    void _sleepIslands(float dt);
 
     void _transformContactPoints();
     void _transformContactPoints2();
@@ -141,6 +285,8 @@ class phyWorld {
     void _adjustPenetrationsOld();
     // Physics experiments
     void _solveImpulses(float dt);
+    void _solveIsland(const phyIsland& island, float dt, float inv_dt);
+    void _solveBatchPacked(const phySolverBatch& batch, phySolverContext& ctx, float inv_dt);
     void _preStepContact(phyRigidBody* bodyA, phyRigidBody* bodyB, phyContactPoint& cp, float inv_dt);
     void _solveManifoldImpulseIteration(phyManifold& m);
     void _solveManifoldFrictionIteration(phyManifold& m);
@@ -153,6 +299,10 @@ class phyWorld {
     
     void _applyImpulse(phyRigidBody* body, const gfxm::vec3 linJ, const gfxm::vec3& angJ, float invMass, const gfxm::mat3& invInertiaWorld);
 
+    int _queryJobCount(int query_count) const;
+    // fn(job, first query, query count) for every packet of consecutive queries
+    void _runQueryPackets(int query_count, const std::function<void(int, int, int)>& fn);
+
 public:
     gfxm::vec3 gravity = gfxm::vec3(.0f, -9.8f, .0f);
 
@@ -163,6 +313,7 @@ public:
     void addCollider(phyRigidBody* collider);
     void removeCollider(phyRigidBody* collider);
     void markAsExternallyTransformed(phyRigidBody* collider);
+    void wakeCollider(phyRigidBody* collider);
 
     void addJoint(phyJoint* joint);
     void removeJoint(phyJoint* joint);
@@ -171,6 +322,14 @@ public:
     phySphereSweepResult sphereSweep(const gfxm::vec3& from, const gfxm::vec3& to, float radius, uint64_t mask = COLLISION_MASK_EVERYTHING);
     void sphereTest(const gfxm::mat4& tr, float radius);
 
+    // Batched queries, consecutive queries are traversed as one packet so rays that start close
+    // to each other should be submitted next to each other
+    // Large batches are split across the world's threads, not to be called while the world is updating
+    void rayTestBatch(const phyRayQuery* queries, int count, phyRayCastResult* results, PHY_QUERY_HIT hit = PHY_QUERY_HIT::CLOSEST);
+    void rayTestBatch(const phyRayQuery* queries, int count, phyRayHitList& hits);
+    void sphereSweepBatch(const phySphereSweepQuery* queries, int count, phySphereSweepResult* results, PHY_QUERY_HIT hit = PHY_QUERY_HIT::CLOSEST);
+    void sphereSweepBatch(const phySphereSweepQuery* queries, int count, phySphereSweepHitList& hits);
+
     void debugDraw();
 
     void update(float dt, float time_step, int max_steps);
@@ -182,4 +341,28 @@ public:
     void clearDirtyTransformArray() { dirty_transform_count = 0; }
 
     void enableDbgDraw(bool enable) { dbg_draw_enabled = enable; }
+
+    // Narrowphase and solver worker threads, including the calling thread
+    // Results do not depend on the thread count
+    void setThreadCount(int count) { thread_pool.setThreadCount(count); }
+    int getThreadCount() const { return thread_pool.getThreadCount(); }
+
+    // Used by islands whose bodies don't ask for more, see phyRigidBody::solver_iterations
+    void setSolverIterations(int count) { default_solver_iterations = std::max(count, 1); }
+    int getSolverIterations() const { return default_solver_iterations; }
+    const phyIslandStats& getIslandStats() const { return island_stats; }
+
+    // Packed SIMD contact solver, the scalar one is still used for islands with joints
+    void enablePackedSolver(bool enable) { packed_solver_enabled = enable; }
+    bool isPackedSolverEnabled() const { return packed_solver_enabled; }
+
+    // Box-box and box-capsule contacts from SAT with a full manifold per step, GJK/EPA otherwise
+    void enableSatBoxContacts(bool enable) { sat_box_contacts_enabled = enable; }
+    bool isSatBoxContactsEnabled() const { return sat_box_contacts_enabled; }
+    float getSolverTime() const { return solver_time; }
+    int getSolverContactCount() const { return solver_contact_count; }
+
+    float getNarrowphaseTime() const { return narrowphase_time; }
+    int getNarrowphasePairCount() const { return (int)narrowphase_pairs.size(); }
+    int getManifoldCount() const { return narrow_phase.manifoldCount(); }
 };
@@ -0,0 +1,380 @@
+#include "contact_solver.hpp"
+
+#include <assert.h>
+#include <bit>
+#include <string.h>
+
+
+// Four lanes of floats, every operation below acts on all lanes at once
+#if PHY_SOLVER_SSE
+struct phyLane4 {
+    __m128 m;
+};
+struct phyMask4 {
+    __m128 m;
+};
+inline phyLane4 lane4Load(const float* p) { return { _mm_load_ps(p) }; }
+inline void lane4Store(float* p, phyLane4 a) { _mm_store_ps(p, a.m); }
+inline phyLane4 lane4Set(float f) { return { _mm_set1_ps(f) }; }
+inline phyLane4 operator+(phyLane4 a, phyLane4 b) { return { _mm_add_ps(a.m, b.m) }; }
+inline phyLane4 operator-(phyLane4 a, phyLane4 b) { return { _mm_sub_ps(a.m, b.m) }; }
+inline phyLane4 operator*(phyLane4 a, phyLane4 b) { return { _mm_mul_ps(a.m, b.m) }; }
+inline phyLane4 operator/(phyLane4 a, phyLane4 b) { return { _mm_div_ps(a.m, b.m) }; }
+inline phyLane4 lane4Max(phyLane4 a, phyLane4 b) { return { _mm_max_ps(a.m, b.m) }; }
+inline phyLane4 lane4Sqrt(phyLane4 a) { return { _mm_sqrt_ps(a.m) }; }
+inline phyMask4 lane4Greater(phyLane4 a, phyLane4 b) { return { _mm_cmpgt_ps(a.m, b.m) }; }
+inline phyMask4 operator&(phyMask4 a, phyMask4 b) { return { _mm_and_ps(a.m, b.m) }; }
+inline phyLane4 lane4Select(phyMask4 mask, phyLane4 a, phyLane4 b) {
+    return { _mm_or_ps(_mm_and_ps(mask.m, a.m), _mm_andnot_ps(mask.m, b.m)) };
+}
+#else
+struct phyLane4 {
+    float f[4];
+};
+struct phyMask4 {
+    bool b[4];
+};
+inline phyLane4 lane4Load(const float* p) { return { p[0], p[1], p[2], p[3] }; }
+inline void lane4Store(float* p, phyLane4 a) { for (int i = 0; i < 4; ++i) p[i] = a.f[i]; }
+inline phyLane4 lane4Set(float f) { return { f, f, f, f }; }
+inline phyLane4 operator+(phyLane4 a, phyLane4 b) { for (int i = 0; i < 4; ++i) a.f[i] += b.f[i]; return a; }
+inline phyLane4 operator-(phyLane4 a, phyLane4 b) { for (int i = 0; i < 4; ++i) a.f[i] -= b.f[i]; return a; }
+inline phyLane4 operator*(phyLane4 a, phyLane4 b) { for (int i = 0; i < 4; ++i) a.f[i] *= b.f[i]; return a; }
+inline phyLane4 operator/(phyLane4 a, phyLane4 b) { for (int i = 0; i < 4; ++i) a.f[i] /= b.f[i]; return a; }
+inline phyLane4 lane4Max(phyLane4 a, phyLane4 b) { for (int i = 0; i < 4; ++i) a.f[i] = a.f[i] > b.f[i] ? a.f[i] : b.f[i]; return a; }
+inline phyLane4 lane4Sqrt(phyLane4 a) { for (int i = 0; i < 4; ++i) a.f[i] = sqrtf(a.f[i]); return a; }
+inline phyMask4 lane4Greater(phyLane4 a, phyLane4 b) {
+    return { a.f[0] > b.f[0], a.f[1] > b.f[1], a.f[2] > b.f[2], a.f[3] > b.f[3] };
+}
+inline phyMask4 operator&(phyMask4 a, phyMask4 b) {
+    return { a.b[0] && b.b[0], a.b[1] && b.b[1], a.b[2] && b.b[2], a.b[3] && b.b[3] };
+}
+inline phyLane4 lane4Select(phyMask4 mask, phyLane4 a, phyLane4 b) {
+    for (int i = 0; i < 4; ++i) a.f[i] = mask.b[i] ? a.f[i] : b.f[i];
+    return a;
+}
+#endif
+
+static_assert(PHY_SOLVER_LANES == 4, "phyLane4 assumes four lanes");
+
+struct phyLane4Vec3 {
+    phyLane4 x, y, z;
+};
+inline phyLane4Vec3 lane4LoadVec3(const float (&p)[3][PHY_SOLVER_LANES]) {
+    return { lane4Load(p[0]), lane4Load(p[1]), lane4Load(p[2]) };
+}
+inline phyLane4 lane4Dot(const phyLane4Vec3& a, const phyLane4Vec3& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+inline void lane4AddScaled(phyLane4Vec3& a, const phyLane4Vec3& b, phyLane4 s) {
+    a.x = a.x + b.x * s;
+    a.y = a.y + b.y * s;
+    a.z = a.z + b.z * s;
+}
+inline void lane4SubScaled(phyLane4Vec3& a, const phyLane4Vec3& b, phyLane4 s) {
+    a.x = a.x - b.x * s;
+    a.y = a.y - b.y * s;
+    a.z = a.z - b.z * s;
+}
+
+// Bodies of a block go through registers as xyz rows, body i in lane i
+static void lane4GatherBodies(const phySolverBody* bodies, const int* idx, phyLane4Vec3& v, phyLane4Vec3& w) {
+#if PHY_SOLVER_SSE
+    __m128 v0 = _mm_load_ps(bodies[idx[0]].v);
+    __m128 v1 = _mm_load_ps(bodies[idx[1]].v);
+    __m128 v2 = _mm_load_ps(bodies[idx[2]].v);
+    __m128 v3 = _mm_load_ps(bodies[idx[3]].v);
+    _MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+    v = { { v0 }, { v1 }, { v2 } };
+    __m128 w0 = _mm_load_ps(bodies[idx[0]].w);
+    __m128 w1 = _mm_load_ps(bodies[idx[1]].w);
+    __m128 w2 = _mm_load_ps(bodies[idx[2]].w);
+    __m128 w3 = _mm_load_ps(bodies[idx[3]].w);
+    _MM_TRANSPOSE4_PS(w0, w1, w2, w3);
+    w = { { w0 }, { w1 }, { w2 } };
+#else
+    for (int i = 0; i < PHY_SOLVER_LANES; ++i) {
+        const phySolverBody& b = bodies[idx[i]];
+        v.x.f[i] = b.v[0];
+        v.y.f[i] = b.v[1];
+        v.z.f[i] = b.v[2];
+        w.x.f[i] = b.w[0];
+        w.y.f[i] = b.w[1];
+        w.z.f[i] = b.w[2];
+    }
+#endif
+}
+static void lane4ScatterBodies(phySolverBody* bodies, const int* idx, const phyLane4Vec3& v, const phyLane4Vec3& w) {
+#if PHY_SOLVER_SSE
+    __m128 v0 = v.x.m;
+    __m128 v1 = v.y.m;
+    __m128 v2 = v.z.m;
+    __m128 v3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+    _mm_store_ps(bodies[idx[0]].v, v0);
+    _mm_store_ps(bodies[idx[1]].v, v1);
+    _mm_store_ps(bodies[idx[2]].v, v2);
+    _mm_store_ps(bodies[idx[3]].v, v3);
+    __m128 w0 = w.x.m;
+    __m128 w1 = w.y.m;
+    __m128 w2 = w.z.m;
+    __m128 w3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(w0, w1, w2, w3);
+    _mm_store_ps(bodies[idx[0]].w, w0);
+    _mm_store_ps(bodies[idx[1]].w, w1);
+    _mm_store_ps(bodies[idx[2]].w, w2);
+    _mm_store_ps(bodies[idx[3]].w, w3);
+#else
+    for (int i = 0; i < PHY_SOLVER_LANES; ++i) {
+        phySolverBody& b = bodies[idx[i]];
+        b.v[0] = v.x.f[i];
+        b.v[1] = v.y.f[i];
+        b.v[2] = v.z.f[i];
+        b.w[0] = w.x.f[i];
+        b.w[1] = w.y.f[i];
+        b.w[2] = w.z.f[i];
+    }
+#endif
+}
+
+
+phyContactSolver::phyContactSolver() {
+    clear();
+}
+
+void phyContactSolver::clear() {
+    bodies.clear();
+    body_dynamic.clear();
+    body_colors.clear();
+    contacts.clear();
+    blocks.clear();
+    // Body 0 is the null body unused lanes point at
+    addBody(gfxm::vec3(0, 0, 0), gfxm::vec3(0, 0, 0), false);
+}
+
+int phyContactSolver::addBody(const gfxm::vec3& velocity, const gfxm::vec3& angular_velocity, bool dynamic) {
+    phySolverBody body = {
+        { velocity.x, velocity.y, velocity.z, .0f },
+        { angular_velocity.x, angular_velocity.y, angular_velocity.z, .0f }
+    };
+    bodies.push_back(body);
+    body_dynamic.push_back(dynamic ? 1 : 0);
+    return (int)bodies.size() - 1;
+}
+
+int phyContactSolver::addContact(const phySolverContactDesc& desc) {
+    assert(desc.body_a >= 0 && desc.body_a < bodies.size());
+    assert(desc.body_b >= 0 && desc.body_b < bodies.size());
+    contacts.push_back(desc);
+    return (int)contacts.size() - 1;
+}
+
+void phyContactSolver::build() {
+    const int contact_count = (int)contacts.size();
+
+    // Greedy coloring, each contact takes the lowest color neither of its dynamic bodies has used yet
+    // Contacts that find no free color go to the overflow color and get a block each
+    body_colors.assign(bodies.size(), 0);
+    contact_colors.resize(contact_count);
+    color_offsets.assign(PHY_SOLVER_MAX_COLORS + 2, 0);
+    for (int i = 0; i < contact_count; ++i) {
+        const auto& c = contacts[i];
+        uint64_t used = 0;
+        if (body_dynamic[c.body_a]) {
+            used |= body_colors[c.body_a];
+        }
+        if (body_dynamic[c.body_b]) {
+            used |= body_colors[c.body_b];
+        }
+        int color = PHY_SOLVER_MAX_COLORS;
+        if (~used) {
+            color = std::countr_zero(~used);
+            uint64_t bit = 1ull << color;
+            if (body_dynamic[c.body_a]) {
+                body_colors[c.body_a] |= bit;
+            }
+            if (body_dynamic[c.body_b]) {
+                body_colors[c.body_b] |= bit;
+            }
+        }
+        contact_colors[i] = color;
+        ++color_offsets[color + 1];
+    }
+    for (int i = 0; i < PHY_SOLVER_MAX_COLORS + 1; ++i) {
+        color_offsets[i + 1] += color_offsets[i];
+    }
+
+    // Sort by color, keeping the original order within a color
+    color_contacts.resize(contact_count);
+    {
+        int offsets[PHY_SOLVER_MAX_COLORS + 1];
+        memcpy(offsets, color_offsets.data(), sizeof(offsets));
+        for (int i = 0; i < contact_count; ++i) {
+            color_contacts[offsets[contact_colors[i]]++] = i;
+        }
+    }
+
+    int block_count = 0;
+    for (int color = 0; color < PHY_SOLVER_MAX_COLORS; ++color) {
+        int count = color_offsets[color + 1] - color_offsets[color];
+        block_count += (count + PHY_SOLVER_LANES - 1) / PHY_SOLVER_LANES;
+    }
+    block_count += color_offsets[PHY_SOLVER_MAX_COLORS + 1] - color_offsets[PHY_SOLVER_MAX_COLORS];
+
+    blocks.resize(block_count);
+    memset(blocks.data(), 0, blocks.size() * sizeof(blocks[0]));
+    for (auto& b : blocks) {
+        for (int lane = 0; lane < PHY_SOLVER_LANES; ++lane) {
+            b.contact[lane] = -1;
+        }
+    }
+    contact_slots.resize(contact_count);
+    int block = 0;
+    for (int color = 0; color < PHY_SOLVER_MAX_COLORS + 1; ++color) {
+        const int lanes = color == PHY_SOLVER_MAX_COLORS ? 1 : PHY_SOLVER_LANES;
+        int lane = 0;
+        for (int i = color_offsets[color]; i < color_offsets[color + 1]; ++i) {
+            if (lane == lanes) {
+                lane = 0;
+                ++block;
+            }
+            _packContact(blocks[block], lane, color_contacts[i]);
+            contact_slots[color_contacts[i]] = block * PHY_SOLVER_LANES + lane;
+            ++lane;
+        }
+        if (lane > 0) {
+            ++block;
+        }
+    }
+    assert(block == block_count);
+}
+
+void phyContactSolver::_packContact(phySolverContactBlock& b, int lane, int contact_index) {
+    const phySolverContactDesc& c = contacts[contact_index];
+    b.body_a[lane] = c.body_a;
+    b.body_b[lane] = c.body_b;
+    b.contact[lane] = contact_index;
+    b.inv_mass_a[lane] = c.inv_mass_a;
+    b.inv_mass_b[lane] = c.inv_mass_b;
+
+    auto fn_store = [lane](float (&dst)[3][PHY_SOLVER_LANES], const gfxm::vec3& v) {
+        dst[0][lane] = v.x;
+        dst[1][lane] = v.y;
+        dst[2][lane] = v.z;
+    };
+
+    gfxm::vec3 rn_a = gfxm::cross(c.r_normal_a, c.normal);
+    gfxm::vec3 rn_b = gfxm::cross(c.r_normal_b, c.normal);
+    fn_store(b.normal, c.normal);
+    fn_store(b.rn_a, rn_a);
+    fn_store(b.rn_b, rn_b);
+    fn_store(b.in_a, c.inv_inertia_a * rn_a);
+    fn_store(b.in_b, c.inv_inertia_b * rn_b);
+    b.mass_normal[lane] = c.mass_normal;
+    b.bias[lane] = c.bias;
+    b.jn[lane] = c.jn;
+
+    const gfxm::vec3 tangents[2] = { c.t1, c.t2 };
+    for (int k = 0; k < 2; ++k) {
+        gfxm::vec3 rt_a = gfxm::cross(c.r_friction_a, tangents[k]);
+        gfxm::vec3 rt_b = gfxm::cross(c.r_friction_b, tangents[k]);
+        fn_store(b.tangent[k], tangents[k]);
+        fn_store(b.rt_a[k], rt_a);
+        fn_store(b.rt_b[k], rt_b);
+        fn_store(b.it_a[k], c.inv_inertia_a * rt_a);
+        fn_store(b.it_b[k], c.inv_inertia_b * rt_b);
+    }
+    b.mass_tangent[0][lane] = c.mass_tangent1;
+    b.mass_tangent[1][lane] = c.mass_tangent2;
+    b.jt[0][lane] = c.jt1;
+    b.jt[1][lane] = c.jt2;
+    b.friction[lane] = c.friction;
+}
+
+void phyContactSolver::_solveBlock(phySolverContactBlock& b) {
+    phyLane4Vec3 vA, wA, vB, wB;
+    lane4GatherBodies(bodies.data(), b.body_a, vA, wA);
+    lane4GatherBodies(bodies.data(), b.body_b, vB, wB);
+    const phyLane4 inv_mass_a = lane4Load(b.inv_mass_a);
+    const phyLane4 inv_mass_b = lane4Load(b.inv_mass_b);
+    const phyLane4 zero = lane4Set(.0f);
+
+    // Normal
+    {
+        const phyLane4Vec3 N = lane4LoadVec3(b.normal);
+        const phyLane4Vec3 rn_a = lane4LoadVec3(b.rn_a);
+        const phyLane4Vec3 rn_b = lane4LoadVec3(b.rn_b);
+        phyLane4Vec3 dv = { vB.x - vA.x, vB.y - vA.y, vB.z - vA.z };
+        phyLane4 vn = lane4Dot(dv, N) + lane4Dot(wB, rn_b) - lane4Dot(wA, rn_a);
+        lane4Store(b.vn, vn);
+
+        phyLane4 jn_old = lane4Load(b.jn);
+        phyLane4 jn_delta = (lane4Load(b.bias) - vn) * lane4Load(b.mass_normal);
+        phyLane4 jn_new = lane4Max(zero, jn_old + jn_delta);
+        jn_delta = jn_new - jn_old;
+        lane4Store(b.jn, jn_new);
+
+        lane4SubScaled(vA, N, inv_mass_a * jn_delta);
+        lane4SubScaled(wA, lane4LoadVec3(b.in_a), jn_delta);
+        lane4AddScaled(vB, N, inv_mass_b * jn_delta);
+        lane4AddScaled(wB, lane4LoadVec3(b.in_b), jn_delta);
+    }
+
+    // Friction, both tangents are clamped together to a circle of radius mu * Jn
+    {
+        phyLane4Vec3 dv = { vB.x - vA.x, vB.y - vA.y, vB.z - vA.z };
+        phyLane4Vec3 T[2];
+        phyLane4 jt_old[2];
+        phyLane4 jt_new[2];
+        for (int k = 0; k < 2; ++k) {
+            T[k] = lane4LoadVec3(b.tangent[k]);
+            phyLane4 vt = lane4Dot(dv, T[k]) + lane4Dot(wB, lane4LoadVec3(b.rt_b[k])) - lane4Dot(wA, lane4LoadVec3(b.rt_a[k]));
+            jt_old[k] = lane4Load(b.jt[k]);
+            jt_new[k] = jt_old[k] - vt * lane4Load(b.mass_tangent[k]);
+        }
+        phyLane4 jt_max = lane4Max(zero, lane4Load(b.friction) * lane4Load(b.jn));
+        phyLane4 len2 = jt_new[0] * jt_new[0] + jt_new[1] * jt_new[1];
+        phyMask4 clamp = lane4Greater(len2, lane4Set(.000001f)) & lane4Greater(len2, jt_max * jt_max);
+        phyLane4 scale = lane4Select(clamp, jt_max / lane4Sqrt(lane4Select(clamp, len2, lane4Set(1.f))), lane4Set(1.f));
+        for (int k = 0; k < 2; ++k) {
+            jt_new[k] = jt_new[k] * scale;
+            phyLane4 jt_delta = jt_new[k] - jt_old[k];
+            lane4Store(b.jt[k], jt_new[k]);
+
+            lane4SubScaled(vA, T[k], inv_mass_a * jt_delta);
+            lane4SubScaled(wA, lane4LoadVec3(b.it_a[k]), jt_delta);
+            lane4AddScaled(vB, T[k], inv_mass_b * jt_delta);
+            lane4AddScaled(wB, lane4LoadVec3(b.it_b[k]), jt_delta);
+        }
+    }
+
+    // Lanes never share a dynamic body, lanes sharing a static one write back its unchanged velocity
+    lane4ScatterBodies(bodies.data(), b.body_a, vA, wA);
+    lane4ScatterBodies(bodies.data(), b.body_b, vB, wB);
+}
+
+void phyContactSolver::solve(int iterations) {
+    for (int it = 0; it < iterations; ++it) {
+        for (auto& b : blocks) {
+            _solveBlock(b);
+        }
+    }
+}
+
+gfxm::vec3 phyContactSolver::getVelocity(int body) const {
+    const auto& b = bodies[body];
+    return gfxm::vec3(b.v[0], b.v[1], b.v[2]);
+}
+gfxm::vec3 phyContactSolver::getAngularVelocity(int body) const {
+    const auto& b = bodies[body];
+    return gfxm::vec3(b.w[0], b.w[1], b.w[2]);
+}
+void phyContactSolver::getContactImpulse(int contact, float& jn, float& jt1, float& jt2, float& vn) const {
+    const int slot = contact_slots[contact];
+    const auto& b = blocks[slot / PHY_SOLVER_LANES];
+    const int lane = slot % PHY_SOLVER_LANES;
+    jn = b.jn[lane];
+    jt1 = b.jt[0][lane];
+    jt2 = b.jt[1][lane];
+    vn = b.vn[lane];
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "math/gfxm.hpp"
+#include "collision/simd.hpp"
+
+
+// Contact solver working on packed structure-of-arrays rows
+// Contacts are colored so that no two lanes of a block share a dynamic body,
+// which lets a whole block be solved at once with SSE, or lane by lane without it
+
+#define PHY_ENABLE_SIMD_SOLVER 1
+
+#if PHY_ENABLE_SIMD_SOLVER && PHY_SSE
+#define PHY_SOLVER_SSE 1
+#else
+#define PHY_SOLVER_SSE 0
+#endif
+
+constexpr int PHY_SOLVER_LANES = 4;
+// Contacts of a body that has more than this many are solved in blocks of their own
+constexpr int PHY_SOLVER_MAX_COLORS = 64;
+
+// Velocity of a body as seen by the solver, padded so each half loads as one vector
+struct alignas(16) phySolverBody {
+    float v[4];
+    float w[4];
+};
+
+// Contact as handed to the solver, lever arms are relative to each body's center of mass
+// Normal and friction rows use different arms to match the scalar solver
+struct phySolverContactDesc {
+    int body_a;
+    int body_b;
+    float inv_mass_a;
+    float inv_mass_b;
+    gfxm::mat3 inv_inertia_a;
+    gfxm::mat3 inv_inertia_b;
+    gfxm::vec3 normal;
+    gfxm::vec3 r_normal_a;
+    gfxm::vec3 r_normal_b;
+    gfxm::vec3 t1;
+    gfxm::vec3 t2;
+    gfxm::vec3 r_friction_a;
+    gfxm::vec3 r_friction_b;
+    float mass_normal;
+    float mass_tangent1;
+    float mass_tangent2;
+    float bias;
+    float friction;
+    // Accumulated impulses to start from
+    float jn;
+    float jt1;
+    float jt2;
+};
+
+// PHY_SOLVER_LANES contacts, unused lanes point at the null body and have zero mass
+struct alignas(16) phySolverContactBlock {
+    int body_a[PHY_SOLVER_LANES];
+    int body_b[PHY_SOLVER_LANES];
+    int contact[PHY_SOLVER_LANES];  // -1 for unused lanes
+    float inv_mass_a[PHY_SOLVER_LANES];
+    float inv_mass_b[PHY_SOLVER_LANES];
+
+    float normal[3][PHY_SOLVER_LANES];
+    float rn_a[3][PHY_SOLVER_LANES];     // rA x N
+    float rn_b[3][PHY_SOLVER_LANES];     // rB x N
+    float in_a[3][PHY_SOLVER_LANES];     // invIA * (rA x N)
+    float in_b[3][PHY_SOLVER_LANES];     // invIB * (rB x N)
+    float mass_normal[PHY_SOLVER_LANES];
+    float bias[PHY_SOLVER_LANES];
+    float jn[PHY_SOLVER_LANES];
+    float vn[PHY_SOLVER_LANES];          // Normal velocity seen by the last iteration
+
+    float tangent[2][3][PHY_SOLVER_LANES];
+    float rt_a[2][3][PHY_SOLVER_LANES];
+    float rt_b[2][3][PHY_SOLVER_LANES];
+    float it_a[2][3][PHY_SOLVER_LANES];
+    float it_b[2][3][PHY_SOLVER_LANES];
+    float mass_tangent[2][PHY_SOLVER_LANES];
+    float jt[2][PHY_SOLVER_LANES];
+    float friction[PHY_SOLVER_LANES];
+};
+
+class phyContactSolver {
+    std::vector<phySolverBody> bodies;
+    std::vector<uint8_t> body_dynamic;
+    std::vector<uint64_t> body_colors;
+    std::vector<phySolverContactDesc> contacts;
+    std::vector<int> contact_colors;
+    std::vector<int> color_offsets;
+    std::vector<int> color_contacts;
+    std::vector<phySolverContactBlock> blocks;
+    std::vector<int> contact_slots;     // block * PHY_SOLVER_LANES + lane for each contact
+
+    void _packContact(phySolverContactBlock& block, int lane, int contact_index);
+    void _solveBlock(phySolverContactBlock& block);
+public:
+    phyContactSolver();
+
+    void clear();
+    // Only dynamic bodies are colored, others are never written to by a non zero impulse
+    // so any number of lanes can share them
+    int addBody(const gfxm::vec3& velocity, const gfxm::vec3& angular_velocity, bool dynamic);
+    int addContact(const phySolverContactDesc& desc);
+    // Colors and packs the contacts, called once after all bodies and contacts are added
+    void build();
+    void solve(int iterations);
+
+    gfxm::vec3 getVelocity(int body) const;
+    gfxm::vec3 getAngularVelocity(int body) const;
+    void getContactImpulse(int contact, float& jn, float& jt1, float& jt2, float& vn) const;
+
+    int bodyCount() const { return (int)bodies.size(); }
+    int contactCount() const { return (int)contacts.size(); }
+    int blockCount() const { return (int)blocks.size(); }
+};
@@ -1,14 +1,21 @@
 #pragma once
 
+#include <float.h>
 #include <vector>
 #include <unordered_set>
 #include "math/gfxm.hpp"
+#include "collision/simd.hpp"
 #include "debug_draw/debug_draw.hpp"
 #include "collision/collision_contact_point.hpp"
 #include "collision/intersection/sphere_capsule.hpp"
 #include "collision/intersection/ray.hpp"
 
 
+// Smaller hulls are scanned linearly, 4 vertices at a time
+constexpr int PHY_CONVEX_HILL_CLIMB_MIN_VERTICES = 32;
+// Octahedral direction bins per side, each remembers the support vertex to start hill climbing from
+constexpr int PHY_CONVEX_SEED_BINS = 8;
+
 class phyConvexMesh {
 public:
     struct Edge {
@@ -23,6 +30,34 @@ private:
     std::vector<gfxm::vec3> face_normals;
     gfxm::vec3 centroid;
 
+    // Neighbours of vertex i are adjacency[adjacency_offsets[i]] .. adjacency[adjacency_offsets[i + 1]]
+    std::vector<uint32_t> adjacency_offsets;
+    std::vector<uint32_t> adjacency;
+    uint32_t support_seeds[PHY_CONVEX_SEED_BINS * PHY_CONVEX_SEED_BINS];
+    bool can_hill_climb = false;
+    // Vertices split by component, padded to a multiple of 4 with copies of the first vertex
+    std::vector<float> soa_x;
+    std::vector<float> soa_y;
+    std::vector<float> soa_z;
+
+    static int seedBin(const gfxm::vec3& dir) {
+        const float l1 = fabsf(dir.x) + fabsf(dir.y) + fabsf(dir.z);
+        if (!(l1 >= 1e-20f)) {
+            return 0;
+        }
+        float u = dir.x / l1;
+        float v = dir.z / l1;
+        if (dir.y < .0f) {
+            const float fu = (1.f - fabsf(v)) * (u < .0f ? -1.f : 1.f);
+            const float fv = (1.f - fabsf(u)) * (v < .0f ? -1.f : 1.f);
+            u = fu;
+            v = fv;
+        }
+        const int iu = (int)gfxm::clamp((u * .5f + .5f) * PHY_CONVEX_SEED_BINS, .0f, PHY_CONVEX_SEED_BINS - 1.f);
+        const int iv = (int)gfxm::clamp((v * .5f + .5f) * PHY_CONVEX_SEED_BINS, .0f, PHY_CONVEX_SEED_BINS - 1.f);
+        return iv * PHY_CONVEX_SEED_BINS + iu;
+    }
+
     void fixWinding() {
         if (vertices.empty() || indices.empty()) {
             return;
@@ -83,6 +118,71 @@ private:
         }
         centroid /= float(vertices.size());
     }
+    void makeSupportData() {
+        const int count = vertices.size();
+        const int padded = (count + 3) & ~3;
+        soa_x.resize(padded);
+        soa_y.resize(padded);
+        soa_z.resize(padded);
+        for (int i = 0; i < padded; ++i) {
+            const gfxm::vec3& v = vertices[i < count ? i : 0];
+            soa_x[i] = v.x;
+            soa_y[i] = v.y;
+            soa_z[i] = v.z;
+        }
+
+        adjacency_offsets.assign(count + 1, 0);
+        for (auto& e : edges) {
+            ++adjacency_offsets[e.a + 1];
+            ++adjacency_offsets[e.b + 1];
+        }
+        for (int i = 0; i < count; ++i) {
+            adjacency_offsets[i + 1] += adjacency_offsets[i];
+        }
+        adjacency.resize(adjacency_offsets[count]);
+        std::vector<uint32_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+        for (auto& e : edges) {
+            adjacency[fill[e.a]++] = e.b;
+            adjacency[fill[e.b]++] = e.a;
+        }
+
+        // Climbing only finds the support if the triangles are the hull's own faces:
+        // every vertex has to be used and sit behind every face plane
+        can_hill_climb = count >= PHY_CONVEX_HILL_CLIMB_MIN_VERTICES;
+        for (int i = 0; i < count && can_hill_climb; ++i) {
+            can_hill_climb = adjacency_offsets[i + 1] > adjacency_offsets[i];
+        }
+        float extent = .0f;
+        for (int i = 0; i < count; ++i) {
+            extent = gfxm::_max(extent, gfxm::length(vertices[i] - centroid));
+        }
+        const float tolerance = extent * 1e-4f;
+        for (int f = 0; f < face_normals.size() && can_hill_climb; ++f) {
+            const gfxm::vec3& N = face_normals[f];
+            const float plane_d = gfxm::dot(N, vertices[indices[f * 3]]);
+            for (int i = 0; i < count; ++i) {
+                if (gfxm::dot(N, vertices[i]) - plane_d > tolerance) {
+                    can_hill_climb = false;
+                    break;
+                }
+            }
+        }
+
+        for (int iv = 0; iv < PHY_CONVEX_SEED_BINS; ++iv) {
+            for (int iu = 0; iu < PHY_CONVEX_SEED_BINS; ++iu) {
+                float u = (iu + .5f) / PHY_CONVEX_SEED_BINS * 2.f - 1.f;
+                float v = (iv + .5f) / PHY_CONVEX_SEED_BINS * 2.f - 1.f;
+                const float y = 1.f - fabsf(u) - fabsf(v);
+                if (y < .0f) {
+                    const float fu = (1.f - fabsf(v)) * (u < .0f ? -1.f : 1.f);
+                    const float fv = (1.f - fabsf(u)) * (v < .0f ? -1.f : 1.f);
+                    u = fu;
+                    v = fv;
+                }
+                support_seeds[iv * PHY_CONVEX_SEED_BINS + iu] = count ? findSupportVertexLinear(gfxm::vec3(u, y, v)) : 0;
+            }
+        }
+    }
 public:
     void setData(const gfxm::vec3* verts, int vertex_count, const int* inds, int index_count) {
         vertices.clear();
@@ -94,6 +194,7 @@ public:
         makeFaceNormals();
         makeEdgeList();
         findCentroid();
+        makeSupportData();
     }
 
     int vertexCount() const { return vertices.size(); }
@@ -110,6 +211,93 @@ public:
 
     const gfxm::vec3& getCentroid() const { return centroid; }
 
+    // Index of the vertex furthest along dir, first one on ties
+    int findSupportVertexLinear(const gfxm::vec3& dir) const {
+        if (soa_x.empty()) {
+            return 0;
+        }
+#if PHY_SSE
+        const __m128 dx = _mm_set1_ps(dir.x);
+        const __m128 dy = _mm_set1_ps(dir.y);
+        const __m128 dz = _mm_set1_ps(dir.z);
+        __m128 best = _mm_set1_ps(-FLT_MAX);
+        __m128i best_idx = _mm_setzero_si128();
+        __m128i idx = _mm_setr_epi32(0, 1, 2, 3);
+        const __m128i four = _mm_set1_epi32(4);
+        for (int i = 0; i < soa_x.size(); i += 4) {
+            const __m128 d = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&soa_x[i]), dx), _mm_mul_ps(_mm_loadu_ps(&soa_y[i]), dy)),
+                _mm_mul_ps(_mm_loadu_ps(&soa_z[i]), dz)
+            );
+            const __m128 gt = _mm_cmpgt_ps(d, best);
+            best = _mm_or_ps(_mm_and_ps(gt, d), _mm_andnot_ps(gt, best));
+            best_idx = _mm_or_si128(_mm_and_si128(_mm_castps_si128(gt), idx), _mm_andnot_si128(_mm_castps_si128(gt), best_idx));
+            idx = _mm_add_epi32(idx, four);
+        }
+        alignas(16) float lane_d[4];
+        alignas(16) int32_t lane_idx[4];
+        _mm_store_ps(lane_d, best);
+        _mm_store_si128((__m128i*)lane_idx, best_idx);
+        int vid = lane_idx[0];
+        float max_d = lane_d[0];
+        for (int i = 1; i < 4; ++i) {
+            if (lane_d[i] > max_d || (lane_d[i] == max_d && lane_idx[i] < vid)) {
+                vid = lane_idx[i];
+                max_d = lane_d[i];
+            }
+        }
+        return vid;
+#else
+        float max_d = -FLT_MAX;
+        int vid = 0;
+        for (int i = 0; i < vertices.size(); ++i) {
+            float d = gfxm::dot(dir, vertices[i]);
+            if (d > max_d) {
+                vid = i;
+                max_d = d;
+            }
+        }
+        return vid;
+#endif
+    }
+    // Index of the vertex furthest along dir.
+    // Large hulls walk the vertex adjacency uphill, starting from hint if it's closer than the seed for dir.
+    // Pass the previous result as hint when consecutive directions are close
+    int findSupportVertex(const gfxm::vec3& dir, int hint = -1) const {
+        if (!can_hill_climb) {
+            return findSupportVertexLinear(dir);
+        }
+        int vid = support_seeds[seedBin(dir)];
+        float max_d = gfxm::dot(dir, vertices[vid]);
+        if (hint >= 0 && hint < vertices.size()) {
+            const float d = gfxm::dot(dir, vertices[hint]);
+            if (d > max_d) {
+                vid = hint;
+                max_d = d;
+            }
+        }
+        while (true) {
+            int next = vid;
+            for (uint32_t k = adjacency_offsets[vid]; k < adjacency_offsets[vid + 1]; ++k) {
+                const uint32_t n = adjacency[k];
+                const float d = gfxm::dot(dir, vertices[n]);
+                if (d > max_d) {
+                    next = n;
+                    max_d = d;
+                }
+            }
+            if (next == vid) {
+                break;
+            }
+            vid = next;
+        }
+        // Stuck on a flat patch facing away from dir, happens when vertices lie inside hull faces
+        if (max_d < gfxm::dot(dir, centroid)) {
+            return findSupportVertexLinear(dir);
+        }
+        return vid;
+    }
+
     bool intersectRay(const gfxm::vec3& rO, const gfxm::vec3& rV) {
         assert(false);
         return false;
@@ -214,6 +214,10 @@ bool EPA_addPoint(EPA_Context& ctx, const GJK_SupportPoint& Ps) {
                 if(found_idx >= 0) {
                     ctx.hole_edges.erase(found_idx);
                 } else {
+                    if (ctx.hole_edges.count == ctx.hole_edges.capacity()) {
+                        LOG_ERR("EPA ran out of horizon edge slots: " << ctx.hole_edges.capacity());
+                        return false;
+                    }
                     ctx.hole_edges.push_back(e);
                 }
             }
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "gjk.hpp"
+#include "collision/shape/convex_mesh.hpp"
+
+
+// Body transforms are rigid, the direction goes to shape space through the transposed rotation
+// computed once per pair instead of a full inverse per query.
+// Each query starts climbing from the previous support, GJK and EPA directions change little between iterations
+template<>
+class GJKEPA_SupportGetter<phyConvexMeshShape> {
+    gfxm::mat4 transform;
+    gfxm::mat3 inverse_rotation;
+    const phyConvexMeshShape* shape;
+    mutable int last_vertex = -1;
+public:
+    GJKEPA_SupportGetter(const gfxm::mat4& transform, const phyConvexMeshShape* shape)
+        : transform(transform),
+        inverse_rotation(gfxm::transpose(gfxm::to_mat3(transform))),
+        shape(shape) {}
+
+    gfxm::vec3 getPosition() const { return transform[3]; }
+
+    gfxm::vec3 operator()(const gfxm::vec3& dir) const {
+        last_vertex = shape->getSupportVertex(inverse_rotation * dir, last_vertex);
+        return transform * gfxm::vec4(shape->getMesh()->getVertexData()[last_vertex], 1.f);
+    }
+};
@@ -2,6 +2,7 @@
 
 #include "collision/collision_triangle_mesh.hpp"
 #include "collision/convex_mesh.hpp"
+#include "collision/shape/heightfield.hpp"
 #include "collision/collider.hpp"
 
 
@@ -63,30 +64,12 @@ bool intersectRayTriangle(
 
 
 
-struct TriangleMeshRayTestContext {
-    RayHitPoint pt;
-    bool hasHit = false;
-};
-
-void TriangleMeshRayTestClosestCb(void* context, const RayHitPoint& rhp) {
-    TriangleMeshRayTestContext* ctx = (TriangleMeshRayTestContext*)context;
-    ctx->hasHit = true;
-    if (rhp.distance < ctx->pt.distance) {
-        ctx->pt = rhp;
-    }
-}
-
 bool intersectRayTriangleMesh(
     const gfxm::ray& ray,
     const CollisionTriangleMesh* mesh,
     RayHitPoint& rhp
 ) {
-    TriangleMeshRayTestContext ctx;
-    ctx.hasHit = false;
-    ctx.pt.distance = INFINITY;
-    mesh->rayTest(ray, &ctx, &TriangleMeshRayTestClosestCb);
-    rhp = ctx.pt;
-    return ctx.hasHit;
+    return mesh->rayTestClosest(ray, rhp);
 }
 
 
@@ -116,3 +99,16 @@ bool intersectRayConvexMesh(
     return ctx.hasHit;
 }
 
+
+bool intersectRayHeightfield(
+    const gfxm::ray& ray,
+    const phyHeightfieldShape* heightfield,
+    RayHitPoint& rhp
+) {
+    if (!heightfield->rayTest(ray, rhp)) {
+        return false;
+    }
+    rhp.prop = phySurfaceProp{ COLLISION_SURFACE_GRAVEL };
+    return true;
+}
+
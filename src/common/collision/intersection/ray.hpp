@@ -131,9 +131,13 @@ inline bool intersectRaySphere(
     }
     if (delta == .0f) {
         float t = -b / (2.0f * a);
+        if (t < .0f || t > 1.0f) {
+            return false;
+        }
         gfxm::vec3 hit = ray.origin + ray.direction * t;
         rhp.normal = gfxm::normalize(hit - sphere_pos);
         rhp.point = hit;
+        rhp.distance = gfxm::length(ray.direction) * t;
         return true;
     }
     if (delta > .0f) {
@@ -255,3 +259,7 @@ bool intersectRayTriangleMesh(const gfxm::ray& ray, const CollisionTriangleMesh*
 
 class phyConvexMesh;
 bool intersectRayConvexMesh(const gfxm::ray& ray, const phyConvexMesh* mesh, RayHitPoint& rhp);
+
+
+class phyHeightfieldShape;
+bool intersectRayHeightfield(const gfxm::ray& ray, const phyHeightfieldShape* heightfield, RayHitPoint& rhp);
@@ -0,0 +1,579 @@
+#include "sat_box_box.hpp"
+
+#include <float.h>
+#include "collision/intersection/capsule_capsule.hpp"
+
+
+// Another axis replaces the current best one only when it is clearly shallower,
+// keeps the reference face from flipping between nearly equal axes of a resting box
+static const float SAT_RELATIVE_TOLERANCE = .95f;
+static const float SAT_ABSOLUTE_TOLERANCE = .01f; // times the smallest half extent
+// Closest points axis of a capsule this close to a box face normal is treated as that face
+static const float SAT_FACE_ALIGNMENT = .999f;
+
+struct SatBox {
+    gfxm::vec3 center;
+    gfxm::vec3 axes[3];
+    gfxm::vec3 half_extents;
+
+    SatBox(const gfxm::vec3& half_extents, const gfxm::mat4& transform)
+        : center(transform[3]), half_extents(half_extents) {
+        for (int i = 0; i < 3; ++i) {
+            axes[i] = transform[i];
+        }
+    }
+
+    float projectedRadius(const gfxm::vec3& L) const {
+        return half_extents.x * fabsf(gfxm::dot(axes[0], L))
+            + half_extents.y * fabsf(gfxm::dot(axes[1], L))
+            + half_extents.z * fabsf(gfxm::dot(axes[2], L));
+    }
+    gfxm::vec3 toLocal(const gfxm::vec3& p) const {
+        const gfxm::vec3 d = p - center;
+        return gfxm::vec3(gfxm::dot(d, axes[0]), gfxm::dot(d, axes[1]), gfxm::dot(d, axes[2]));
+    }
+    gfxm::vec3 toWorld(const gfxm::vec3& p) const {
+        return center + axes[0] * p.x + axes[1] * p.y + axes[2] * p.z;
+    }
+    float smallestExtent() const {
+        return gfxm::_min(half_extents.x, gfxm::_min(half_extents.y, half_extents.z));
+    }
+};
+
+static bool satBoxBoxAxis(int feature, const SatBox& A, const SatBox& B, gfxm::vec3& out_axis, float& out_separation) {
+    gfxm::vec3 L;
+    if (feature < 3) {
+        L = A.axes[feature];
+    } else if (feature < 6) {
+        L = B.axes[feature - 3];
+    } else {
+        L = gfxm::cross(A.axes[(feature - 6) / 3], B.axes[(feature - 6) % 3]);
+        const float len = L.length();
+        // Parallel edges, the face axes cover it
+        if (len < 1e-4f) {
+            return false;
+        }
+        L /= len;
+    }
+    float dist = gfxm::dot(B.center - A.center, L);
+    if (dist < .0f) {
+        L = -L;
+        dist = -dist;
+    }
+    out_axis = L;
+    out_separation = dist - A.projectedRadius(L) - B.projectedRadius(L);
+    return true;
+}
+
+// Sutherland-Hodgman, keeps the part of the polygon where dot(N, p) <= d
+static int satClipPolygon(const gfxm::vec3* in, int count, const gfxm::vec3& N, float d, gfxm::vec3* out) {
+    int out_count = 0;
+    for (int i = 0; i < count; ++i) {
+        const gfxm::vec3& a = in[i];
+        const gfxm::vec3& b = in[(i + 1) % count];
+        const float da = gfxm::dot(N, a) - d;
+        const float db = gfxm::dot(N, b) - d;
+        if (da <= .0f) {
+            out[out_count++] = a;
+        }
+        if ((da <= .0f) != (db <= .0f)) {
+            out[out_count++] = a + (b - a) * (da / (da - db));
+        }
+    }
+    return out_count;
+}
+
+// Deepest point, the one farthest from it, then the largest triangle on each side of that line
+static int satReducePoints(const gfxm::vec3* points, const float* separations, int count, const gfxm::vec3& N, int* out_indices) {
+    if (count <= SAT_BOX_MAX_CONTACTS) {
+        for (int i = 0; i < count; ++i) {
+            out_indices[i] = i;
+        }
+        return count;
+    }
+    int i0 = 0;
+    for (int i = 1; i < count; ++i) {
+        if (separations[i] < separations[i0]) {
+            i0 = i;
+        }
+    }
+    int i1 = i0 == 0 ? 1 : 0;
+    for (int i = 0; i < count; ++i) {
+        if ((points[i] - points[i0]).length2() > (points[i1] - points[i0]).length2()) {
+            i1 = i;
+        }
+    }
+    int i2 = -1;
+    int i3 = -1;
+    float max_area = .0f;
+    float min_area = .0f;
+    for (int i = 0; i < count; ++i) {
+        const float area = gfxm::dot(gfxm::cross(points[i1] - points[i0], points[i] - points[i0]), N);
+        if (area > max_area) {
+            max_area = area;
+            i2 = i;
+        }
+        if (area < min_area) {
+            min_area = area;
+            i3 = i;
+        }
+    }
+    int n = 0;
+    out_indices[n++] = i0;
+    out_indices[n++] = i1;
+    if (i2 >= 0) {
+        out_indices[n++] = i2;
+    }
+    if (i3 >= 0) {
+        out_indices[n++] = i3;
+    }
+    return n;
+}
+
+// Incident face of inc clipped against the side planes of the reference face,
+// N is the reference face normal pointing towards inc. With flip A is inc, contacts are written as A to B
+static int satBoxFaceContacts(const SatBox& ref, int ref_axis, const SatBox& inc, const gfxm::vec3& N, bool flip, phyContactPoint* out_contacts) {
+    int inc_axis = 0;
+    for (int i = 1; i < 3; ++i) {
+        if (fabsf(gfxm::dot(inc.axes[i], N)) > fabsf(gfxm::dot(inc.axes[inc_axis], N))) {
+            inc_axis = i;
+        }
+    }
+    const float inc_sign = gfxm::dot(inc.axes[inc_axis], N) > .0f ? -1.f : 1.f;
+    const gfxm::vec3 inc_center = inc.center + inc.axes[inc_axis] * (inc.half_extents[inc_axis] * inc_sign);
+    const gfxm::vec3 du = inc.axes[(inc_axis + 1) % 3] * inc.half_extents[(inc_axis + 1) % 3];
+    const gfxm::vec3 dv = inc.axes[(inc_axis + 2) % 3] * inc.half_extents[(inc_axis + 2) % 3];
+
+    gfxm::vec3 poly[8] = {
+        inc_center + du + dv,
+        inc_center - du + dv,
+        inc_center - du - dv,
+        inc_center + du - dv
+    };
+    gfxm::vec3 tmp[8];
+    int count = 4;
+    for (int i = 1; i < 3 && count > 0; ++i) {
+        const int k = (ref_axis + i) % 3;
+        const gfxm::vec3& side = ref.axes[k];
+        const float offset = gfxm::dot(side, ref.center);
+        count = satClipPolygon(poly, count, side, offset + ref.half_extents[k], tmp);
+        if (count == 0) {
+            break;
+        }
+        count = satClipPolygon(tmp, count, -side, -offset + ref.half_extents[k], poly);
+    }
+
+    const float face_d = gfxm::dot(N, ref.center) + ref.half_extents[ref_axis];
+    gfxm::vec3 points[8];
+    float separations[8];
+    int point_count = 0;
+    for (int i = 0; i < count; ++i) {
+        const float separation = gfxm::dot(N, poly[i]) - face_d;
+        if (separation <= SAT_BOX_CONTACT_MARGIN) {
+            points[point_count] = poly[i];
+            separations[point_count] = separation;
+            ++point_count;
+        }
+    }
+
+    int indices[SAT_BOX_MAX_CONTACTS];
+    const int n = satReducePoints(points, separations, point_count, N, indices);
+    for (int i = 0; i < n; ++i) {
+        const gfxm::vec3& p_inc = points[indices[i]];
+        const gfxm::vec3 p_ref = p_inc - N * separations[indices[i]];
+        phyContactPoint& cp = out_contacts[i];
+        cp.point_a = flip ? p_inc : p_ref;
+        cp.point_b = flip ? p_ref : p_inc;
+        cp.normal_a = flip ? -N : N;
+        cp.normal_b = -cp.normal_a;
+        cp.depth = -separations[indices[i]];
+    }
+    return n;
+}
+
+int SAT_BoxBox(
+    const gfxm::vec3& half_extents_a, const gfxm::mat4& transform_a,
+    const gfxm::vec3& half_extents_b, const gfxm::mat4& transform_b,
+    int cached_feature, phyContactPoint* out_contacts, int& out_feature
+) {
+    const SatBox A(half_extents_a, transform_a);
+    const SatBox B(half_extents_b, transform_b);
+
+    gfxm::vec3 cached_axis;
+    float cached_separation = -FLT_MAX;
+    bool cached_valid = false;
+    if (cached_feature >= 0 && cached_feature < 15) {
+        cached_valid = satBoxBoxAxis(cached_feature, A, B, cached_axis, cached_separation);
+        if (cached_valid && cached_separation > .0f) {
+            out_feature = cached_feature;
+            return 0;
+        }
+    }
+
+    // Best axis of each group: faces of A, faces of B, edge pairs
+    int best_feature[3] = { -1, -1, -1 };
+    float best_separation[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    gfxm::vec3 best_axis[3];
+    for (int f = 0; f < 15; ++f) {
+        if (f == cached_feature) {
+            continue;
+        }
+        gfxm::vec3 L;
+        float separation;
+        if (!satBoxBoxAxis(f, A, B, L, separation)) {
+            continue;
+        }
+        if (separation > .0f) {
+            out_feature = f;
+            return 0;
+        }
+        const int group = f < 3 ? 0 : (f < 6 ? 1 : 2);
+        if (separation > best_separation[group]) {
+            best_separation[group] = separation;
+            best_feature[group] = f;
+            best_axis[group] = L;
+        }
+    }
+    if (cached_valid) {
+        const int group = cached_feature < 3 ? 0 : (cached_feature < 6 ? 1 : 2);
+        if (cached_separation > best_separation[group]) {
+            best_separation[group] = cached_separation;
+            best_feature[group] = cached_feature;
+            best_axis[group] = cached_axis;
+        }
+    }
+
+    const float abs_tolerance = SAT_ABSOLUTE_TOLERANCE * gfxm::_min(A.smallestExtent(), B.smallestExtent());
+    int feature = best_feature[0];
+    float separation = best_separation[0];
+    gfxm::vec3 N = best_axis[0];
+    for (int group = 1; group < 3; ++group) {
+        if (best_feature[group] >= 0
+            && best_separation[group] > SAT_RELATIVE_TOLERANCE * separation + abs_tolerance
+        ) {
+            feature = best_feature[group];
+            separation = best_separation[group];
+            N = best_axis[group];
+        }
+    }
+    if (cached_valid && feature != cached_feature
+        && !(separation > SAT_RELATIVE_TOLERANCE * cached_separation + abs_tolerance)
+    ) {
+        feature = cached_feature;
+        separation = cached_separation;
+        N = cached_axis;
+    }
+    out_feature = feature;
+
+    if (feature < 3) {
+        return satBoxFaceContacts(A, feature, B, N, false, out_contacts);
+    }
+    if (feature < 6) {
+        return satBoxFaceContacts(B, feature - 3, A, -N, true, out_contacts);
+    }
+
+    // Edge pair, the edge of each box that is deepest along the axis
+    const int ia = (feature - 6) / 3;
+    const int ib = (feature - 6) % 3;
+    gfxm::vec3 ca = A.center;
+    gfxm::vec3 cb = B.center;
+    for (int k = 0; k < 3; ++k) {
+        if (k != ia) {
+            ca += A.axes[k] * (gfxm::dot(A.axes[k], N) > .0f ? A.half_extents[k] : -A.half_extents[k]);
+        }
+        if (k != ib) {
+            cb += B.axes[k] * (gfxm::dot(B.axes[k], N) > .0f ? -B.half_extents[k] : B.half_extents[k]);
+        }
+    }
+    const gfxm::vec3 ea = A.axes[ia] * A.half_extents[ia];
+    const gfxm::vec3 eb = B.axes[ib] * B.half_extents[ib];
+    gfxm::vec3 pa, pb;
+    closestPointSegmentSegment(ca - ea, ca + ea, cb - eb, cb + eb, pa, pb);
+
+    phyContactPoint& cp = out_contacts[0];
+    cp.point_a = pa;
+    cp.point_b = pb;
+    cp.normal_a = N;
+    cp.normal_b = -N;
+    cp.depth = -separation;
+    return 1;
+}
+
+// Closest points between a segment and a solid box, false if the segment goes through the box.
+// Away from the box the closest pair is an endpoint against the box or the segment against one of the 12 edges
+static bool satClosestSegmentBox(const SatBox& box, const gfxm::vec3& P0, const gfxm::vec3& P1, gfxm::vec3& out_on_segment, gfxm::vec3& out_on_box) {
+    const gfxm::vec3 l0 = box.toLocal(P0);
+    const gfxm::vec3 l1 = box.toLocal(P1);
+    const gfxm::vec3& h = box.half_extents;
+
+    float tmin = .0f;
+    float tmax = 1.f;
+    const gfxm::vec3 d = l1 - l0;
+    for (int k = 0; k < 3 && tmin <= tmax; ++k) {
+        if (fabsf(d[k]) < FLT_EPSILON) {
+            if (l0[k] < -h[k] || l0[k] > h[k]) {
+                tmax = -1.f;
+            }
+            continue;
+        }
+        float t0 = (-h[k] - l0[k]) / d[k];
+        float t1 = (h[k] - l0[k]) / d[k];
+        if (t0 > t1) {
+            std::swap(t0, t1);
+        }
+        tmin = gfxm::_max(tmin, t0);
+        tmax = gfxm::_min(tmax, t1);
+    }
+    if (tmin <= tmax) {
+        return false;
+    }
+
+    float best = FLT_MAX;
+    auto fnCandidate = [&](const gfxm::vec3& on_segment, const gfxm::vec3& on_box) {
+        const float dist2 = (on_segment - on_box).length2();
+        if (dist2 < best) {
+            best = dist2;
+            out_on_segment = on_segment;
+            out_on_box = on_box;
+        }
+    };
+    const gfxm::vec3 ends[2] = { l0, l1 };
+    for (int i = 0; i < 2; ++i) {
+        fnCandidate(ends[i], gfxm::vec3(
+            gfxm::clamp(ends[i].x, -h.x, h.x),
+            gfxm::clamp(ends[i].y, -h.y, h.y),
+            gfxm::clamp(ends[i].z, -h.z, h.z)
+        ));
+    }
+    for (int k = 0; k < 3; ++k) {
+        const int u = (k + 1) % 3;
+        const int v = (k + 2) % 3;
+        for (int s = 0; s < 4; ++s) {
+            gfxm::vec3 e0, e1;
+            e0[k] = -h[k];
+            e1[k] = h[k];
+            e0[u] = e1[u] = (s & 1) ? h[u] : -h[u];
+            e0[v] = e1[v] = (s & 2) ? h[v] : -h[v];
+            gfxm::vec3 c_segment, c_edge;
+            closestPointSegmentSegment(l0, l1, e0, e1, c_segment, c_edge);
+            fnCandidate(c_segment, c_edge);
+        }
+    }
+    out_on_segment = box.toWorld(out_on_segment);
+    out_on_box = box.toWorld(out_on_box);
+    return true;
+}
+
+int SAT_BoxCapsule(
+    const gfxm::vec3& half_extents, const gfxm::mat4& box_transform,
+    float radius, float height, const gfxm::mat4& capsule_transform,
+    int cached_feature, phyContactPoint* out_contacts, int& out_feature
+) {
+    const SatBox box(half_extents, box_transform);
+    const gfxm::vec3 P0 = capsule_transform * gfxm::vec4(.0f, height * .5f, .0f, 1.f);
+    const gfxm::vec3 P1 = capsule_transform * gfxm::vec4(.0f, -height * .5f, .0f, 1.f);
+
+    gfxm::vec3 closest_on_segment;
+    gfxm::vec3 closest_on_box;
+    bool closest_done = false;
+    bool closest_valid = false;
+    auto fnAxis = [&](int feature, gfxm::vec3& out_axis, float& out_separation)->bool {
+        gfxm::vec3 L;
+        if (feature < 3) {
+            L = box.axes[feature];
+        } else if (feature < 6) {
+            L = gfxm::cross(box.axes[feature - 3], P1 - P0);
+            const float len = L.length();
+            if (len < 1e-4f * (height + FLT_EPSILON)) {
+                return false;
+            }
+            L /= len;
+        } else {
+            if (!closest_done) {
+                closest_valid = satClosestSegmentBox(box, P0, P1, closest_on_segment, closest_on_box);
+                closest_done = true;
+            }
+            if (!closest_valid) {
+                return false;
+            }
+            L = closest_on_segment - closest_on_box;
+            const float len = L.length();
+            if (len < 1e-6f) {
+                return false;
+            }
+            L /= len;
+        }
+        const float d0 = gfxm::dot(P0 - box.center, L);
+        const float d1 = gfxm::dot(P1 - box.center, L);
+        const float rb = box.projectedRadius(L);
+        const float separation_pos = gfxm::_min(d0, d1) - radius - rb;
+        const float separation_neg = -gfxm::_max(d0, d1) - radius - rb;
+        if (separation_neg > separation_pos) {
+            out_axis = -L;
+            out_separation = separation_neg;
+        } else {
+            out_axis = L;
+            out_separation = separation_pos;
+        }
+        return true;
+    };
+
+    gfxm::vec3 cached_axis;
+    float cached_separation = -FLT_MAX;
+    bool cached_valid = false;
+    if (cached_feature >= 0 && cached_feature < 7) {
+        cached_valid = fnAxis(cached_feature, cached_axis, cached_separation);
+        if (cached_valid && cached_separation > .0f) {
+            out_feature = cached_feature;
+            return 0;
+        }
+    }
+
+    // Best axis of each group: box faces, box edges x capsule axis, closest points
+    int best_feature[3] = { -1, -1, -1 };
+    float best_separation[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    gfxm::vec3 best_axis[3];
+    for (int f = 0; f < 7; ++f) {
+        gfxm::vec3 L;
+        float separation;
+        if (f == cached_feature) {
+            if (!cached_valid) {
+                continue;
+            }
+            L = cached_axis;
+            separation = cached_separation;
+        } else if (!fnAxis(f, L, separation)) {
+            continue;
+        }
+        if (separation > .0f) {
+            out_feature = f;
+            return 0;
+        }
+        const int group = f < 3 ? 0 : (f < 6 ? 1 : 2);
+        if (separation > best_separation[group]) {
+            best_separation[group] = separation;
+            best_feature[group] = f;
+            best_axis[group] = L;
+        }
+    }
+
+    const float abs_tolerance = SAT_ABSOLUTE_TOLERANCE * gfxm::_min(box.smallestExtent(), radius);
+    int feature = best_feature[0];
+    float separation = best_separation[0];
+    gfxm::vec3 N = best_axis[0];
+    for (int group = 1; group < 3; ++group) {
+        if (best_feature[group] >= 0
+            && best_separation[group] > SAT_RELATIVE_TOLERANCE * separation + abs_tolerance
+        ) {
+            feature = best_feature[group];
+            separation = best_separation[group];
+            N = best_axis[group];
+        }
+    }
+    if (cached_valid && feature != cached_feature
+        && !(separation > SAT_RELATIVE_TOLERANCE * cached_separation + abs_tolerance)
+    ) {
+        feature = cached_feature;
+        separation = cached_separation;
+        N = cached_axis;
+    }
+    out_feature = feature;
+
+    // A capsule resting on a face is found by the closest points axis, it still needs both ends
+    int face = feature < 3 ? feature : -1;
+    gfxm::vec3 face_N = N;
+    if (feature == 6) {
+        for (int k = 0; k < 3; ++k) {
+            if (fabsf(gfxm::dot(N, box.axes[k])) > SAT_FACE_ALIGNMENT) {
+                face = k;
+                face_N = box.axes[k] * (gfxm::dot(N, box.axes[k]) > .0f ? 1.f : -1.f);
+            }
+        }
+    }
+
+    if (face >= 0) {
+        // Capsule axis clipped to the face rectangle
+        float tmin = .0f;
+        float tmax = 1.f;
+        for (int i = 1; i < 3; ++i) {
+            const int k = (face + i) % 3;
+            const float d0 = gfxm::dot(P0 - box.center, box.axes[k]);
+            const float dd = gfxm::dot(P1 - P0, box.axes[k]);
+            const float h = box.half_extents[k];
+            if (fabsf(dd) < FLT_EPSILON) {
+                if (d0 < -h || d0 > h) {
+                    tmax = -1.f;
+                }
+                continue;
+            }
+            float t0 = (-h - d0) / dd;
+            float t1 = (h - d0) / dd;
+            if (t0 > t1) {
+                std::swap(t0, t1);
+            }
+            tmin = gfxm::_max(tmin, t0);
+            tmax = gfxm::_min(tmax, t1);
+        }
+
+        // An end that dips below the face beyond its edge is deeper than anything inside the rectangle,
+        // keep it unclipped or the contact would be shallower than the axis says
+        const float d0 = gfxm::dot(face_N, P0);
+        const float d1 = gfxm::dot(face_N, P1);
+        const float t_deep = d0 < d1 ? .0f : 1.f;
+        if (tmin > tmax) {
+            tmin = tmax = t_deep;
+        } else {
+            const float d_clipped = gfxm::_min(d0 + (d1 - d0) * tmin, d0 + (d1 - d0) * tmax);
+            if (gfxm::_min(d0, d1) < d_clipped - abs_tolerance) {
+                tmin = gfxm::_min(tmin, t_deep);
+                tmax = gfxm::_max(tmax, t_deep);
+            }
+        }
+
+        const float face_d = gfxm::dot(face_N, box.center) + box.half_extents[face];
+        const float ts[2] = { tmin, tmax };
+        int count = 0;
+        for (int i = 0; i < (tmax - tmin > 1e-4f ? 2 : 1); ++i) {
+            const gfxm::vec3 p = P0 + (P1 - P0) * ts[i];
+            const float plane_dist = gfxm::dot(face_N, p) - face_d;
+            const float s = plane_dist - radius;
+            if (s > SAT_BOX_CONTACT_MARGIN) {
+                continue;
+            }
+            phyContactPoint& cp = out_contacts[count++];
+            cp.point_a = p - face_N * plane_dist;
+            cp.point_b = p - face_N * radius;
+            cp.normal_a = face_N;
+            cp.normal_b = -face_N;
+            cp.depth = -s;
+        }
+        // Only the closest points axis snapped to a face can end up with nothing here
+        if (count > 0 || feature != 6) {
+            return count;
+        }
+    }
+
+    phyContactPoint& cp = out_contacts[0];
+    if (feature == 6) {
+        cp.point_a = closest_on_box;
+        cp.point_b = closest_on_segment - N * radius;
+    } else {
+        // Box edge against the capsule axis, the edge deepest along the axis
+        const int k = feature - 3;
+        gfxm::vec3 c = box.center;
+        for (int i = 0; i < 3; ++i) {
+            if (i != k) {
+                c += box.axes[i] * (gfxm::dot(box.axes[i], N) > .0f ? box.half_extents[i] : -box.half_extents[i]);
+            }
+        }
+        const gfxm::vec3 e = box.axes[k] * box.half_extents[k];
+        gfxm::vec3 on_edge, on_segment;
+        closestPointSegmentSegment(c - e, c + e, P0, P1, on_edge, on_segment);
+        cp.point_a = on_edge;
+        cp.point_b = on_segment - N * radius;
+    }
+    cp.normal_a = N;
+    cp.normal_b = -N;
+    cp.depth = -separation;
+    return 1;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "math/gfxm.hpp"
+#include "collision/collision_contact_point.hpp"
+
+
+constexpr int SAT_BOX_MAX_CONTACTS = 4;
+// Clipped points this far outside the reference face are still kept, same as points preserved between frames
+constexpr float SAT_BOX_CONTACT_MARGIN = 5e-3f;
+
+// Box features, the axis that was last found separating or used for contacts:
+// -1 none, 0-2 face of A, 3-5 face of B, 6-14 edge of A x edge of B (6 + edge_a * 3 + edge_b)
+// The cached feature is tested first, a pair that stays apart exits after one axis,
+// one that stays in contact keeps its reference face unless another axis is clearly better.
+// Returns the contact count, up to SAT_BOX_MAX_CONTACTS, normal_a points from A to B.
+// Zero means the boxes are apart and out_feature is the separating axis
+int SAT_BoxBox(
+    const gfxm::vec3& half_extents_a, const gfxm::mat4& transform_a,
+    const gfxm::vec3& half_extents_b, const gfxm::mat4& transform_b,
+    int cached_feature, phyContactPoint* out_contacts, int& out_feature
+);
+
+// Capsule features: 0-2 box face, 3-5 box edge x capsule axis, 6 closest points between the capsule axis and the box.
+// Box is A, up to 2 contacts when the capsule lies on a face
+int SAT_BoxCapsule(
+    const gfxm::vec3& half_extents, const gfxm::mat4& box_transform,
+    float radius, float height, const gfxm::mat4& capsule_transform,
+    int cached_feature, phyContactPoint* out_contacts, int& out_feature
+);
@@ -140,6 +140,9 @@ public:
     int iminx = 0, imaxx = 0;
     int iminy = 0, imaxy = 0;
 
+    // Separating axis or reference feature from the last SAT test of this pair, see SAT_BoxBox()
+    int sat_feature = -1;
+
     phyManifold() {}
     phyManifold(uint64_t key)
         : key(key) {}
@@ -10,9 +10,9 @@ phyManifold* phyNarrowPhase::findCachedManifold(manifold_key_t key) {
 }
 phyManifold* phyNarrowPhase::createNewManifold(manifold_key_t key) {
     auto it_second =
-        front->pair_manifold_table.insert(std::make_pair(key, front->manifolds.count())).first;
+        front->pair_manifold_table.insert(std::make_pair(key, (int)front->manifolds.size())).first;
     front->manifolds.push_back(phyManifold());
-    return &front->manifolds[front->manifolds.count() - 1];
+    return &front->manifolds.back();
 }
 
 
@@ -31,7 +31,7 @@ phyManifold* phyNarrowPhase::getManifold(phyRigidBody* a, phyRigidBody* b, uint1
     auto it = front->pair_manifold_table.find(key);
     if (it == front->pair_manifold_table.end()) {
         is_fresh = true;
-        it = front->pair_manifold_table.insert(std::make_pair(key, front->manifolds.count())).first;
+        it = front->pair_manifold_table.insert(std::make_pair(key, (int)front->manifolds.size())).first;
         phyManifold m(key);
         m.initial_normal = Ninitial;
         front->manifolds.push_back(m);
@@ -85,8 +85,8 @@ void phyNarrowPhase::primeManifold(phyManifold* manifold, phyContactPoint& cp) {
 }
 void phyNarrowPhase::removeManifold(int i) {
     auto removed_key = front->manifolds[i].key;
-    std::swap(front->manifolds[i], front->manifolds[front->manifolds.count() - 1]);
-    front->manifolds.resize(front->manifolds.count() - 1);
+    std::swap(front->manifolds[i], front->manifolds.back());
+    front->manifolds.pop_back();
     front->pair_manifold_table[front->manifolds[i].key] = i;
     front->pair_manifold_table.erase(removed_key);
 }
@@ -298,3 +298,59 @@ void phyNarrowPhase::addContact(phyManifold* manifold, phyContactPoint& cp) {
     addContact3(manifold, cp);
 }
 
+const phyManifold* phyNarrowPhase::findManifold(phyRigidBody* a, phyRigidBody* b, uint16_t normal_key) const {
+    auto it = front->pair_manifold_table.find(MAKE_MANIFOLD_KEY(a->id, b->id, normal_key));
+    if (it == front->pair_manifold_table.end()) {
+        return 0;
+    }
+    return &front->manifolds[it->second];
+}
+
+void phyNarrowPhase::replaceManifold(const phyContactBuffer& buffer, const phyFeatureRecord& f) {
+    // Old points within this distance pass their accumulated impulses to the new ones
+    const float WARM_START_DISTANCE2 = .05f * .05f;
+
+    if (f.contact_count == 0) {
+        auto it = front->pair_manifold_table.find(MAKE_MANIFOLD_KEY(f.collider_a->id, f.collider_b->id, f.normal_key));
+        if (it != front->pair_manifold_table.end()) {
+            front->manifolds[it->second].sat_feature = f.feature;
+        }
+        return;
+    }
+
+    phyManifold* manifold = getManifold(f.collider_a, f.collider_b, f.normal_key);
+    manifold->sat_feature = f.feature;
+    phyArray<phyContactPoint, PHY_MAX_MANIFOLD_POINTS> old_points = manifold->points;
+    manifold->points.clear();
+    for (int i = 0; i < f.contact_count; ++i) {
+        phyContactPoint cp = buffer[f.first_contact + i].cp;
+        addContact(manifold, cp);
+    }
+    for (int i = 0; i < manifold->pointCount(); ++i) {
+        auto& cp = manifold->points[i];
+        for (int j = 0; j < old_points.count(); ++j) {
+            if ((old_points[j].point_a - cp.point_a).length2() < WARM_START_DISTANCE2) {
+                cp.Jn_acc = old_points[j].Jn_acc;
+                cp.Jt_acc = old_points[j].Jt_acc;
+                break;
+            }
+        }
+    }
+}
+
+void phyNarrowPhase::addContacts(const phyContactBuffer& buffer) {
+    int next_feature = 0;
+    int i = 0;
+    while (i < buffer.count() || next_feature < buffer.featureCount()) {
+        if (next_feature < buffer.featureCount() && buffer.getFeature(next_feature).first_contact == i) {
+            const phyFeatureRecord& f = buffer.getFeature(next_feature++);
+            replaceManifold(buffer, f);
+            i += f.contact_count;
+            continue;
+        }
+        const phyContactRecord& r = buffer[i++];
+        phyManifold* manifold = getManifold(r.collider_a, r.collider_b, r.normal_key, r.initial_normal);
+        phyContactPoint cp = r.cp;
+        addContact(manifold, cp);
+    }
+}
@@ -3,8 +3,6 @@
 #include "manifold.hpp"
 
 
-constexpr int PHY_MAX_MANIFOLDS = 8192;
-
 inline uint32_t phyHash(uint32_t a)
 {
     a = (a+0x7ed55d16u) + (a<<12);
@@ -37,7 +35,77 @@ typedef uint64_t manifold_key_t;
 
 struct phyNarrowPhaseData {
     std::unordered_map<manifold_key_t, int> pair_manifold_table;
-    phyArray<phyManifold, PHY_MAX_MANIFOLDS> manifolds;
+    std::vector<phyManifold> manifolds;
+};
+
+// Contact found by a narrowphase job
+// Jobs can run in parallel, their results are replayed into phyNarrowPhase in pair order
+struct phyContactRecord {
+    phyRigidBody* collider_a;
+    phyRigidBody* collider_b;
+    gfxm::vec3 initial_normal;
+    uint16_t normal_key;
+    phyContactPoint cp;
+};
+
+// Full manifold from a SAT test, replaces the manifold's points instead of merging into them.
+// Also written for pairs that are apart, so the separating axis is tested first next time
+struct phyFeatureRecord {
+    phyRigidBody* collider_a;
+    phyRigidBody* collider_b;
+    uint16_t normal_key;
+    int feature;
+    int first_contact;  // contacts [first_contact, first_contact + contact_count) of the buffer
+    int contact_count;
+};
+
+class phyContactBuffer {
+    std::vector<phyContactRecord> records;
+    std::vector<phyFeatureRecord> feature_records;
+public:
+    void clear() {
+        records.clear();
+        feature_records.clear();
+    }
+    int count() const { return (int)records.size(); }
+    const phyContactRecord& operator[](int i) const { return records[i]; }
+    int featureCount() const { return (int)feature_records.size(); }
+    const phyFeatureRecord& getFeature(int i) const { return feature_records[i]; }
+
+    void addManifold(phyRigidBody* a, phyRigidBody* b, uint16_t normal_key, int feature, const phyContactPoint* contacts, int contact_count) {
+        feature_records.push_back(phyFeatureRecord{ a, b, normal_key, feature, count(), contact_count });
+        for (int i = 0; i < contact_count; ++i) {
+            records.push_back(phyContactRecord{ a, b, gfxm::vec3(), normal_key, contacts[i] });
+        }
+    }
+
+    // Same manifold key arguments as phyNarrowPhase::getManifold()
+    void addContact(phyRigidBody* a, phyRigidBody* b, const gfxm::vec3& N, const phyContactPoint& cp) {
+        addContact(a, b, phyMakeNormalKey(N), N, cp);
+    }
+    void addContact(phyRigidBody* a, phyRigidBody* b, uint16_t normal_key, const phyContactPoint& cp) {
+        addContact(a, b, normal_key, gfxm::vec3(), cp);
+    }
+    void addContact(phyRigidBody* a, phyRigidBody* b, uint16_t normal_key, const gfxm::vec3& Ninitial, const phyContactPoint& cp) {
+        records.push_back(phyContactRecord{ a, b, Ninitial, normal_key, cp });
+    }
+    template<typename KEY_T>
+    void addContact(
+        phyRigidBody* a, phyRigidBody* b, const KEY_T& key,
+        const gfxm::vec3& pt_a,
+        const gfxm::vec3& pt_b,
+        const gfxm::vec3& normal_a,
+        const gfxm::vec3& normal_b,
+        float distance
+    ) {
+        phyContactPoint cp;
+        cp.point_a = pt_a;
+        cp.point_b = pt_b;
+        cp.normal_a = normal_a;
+        cp.normal_b = normal_b;
+        cp.depth = distance;
+        addContact(a, b, key, cp);
+    }
 };
 
 class phyNarrowPhase {
@@ -48,12 +116,13 @@ class phyNarrowPhase {
 
     phyManifold* findCachedManifold(manifold_key_t key);
     phyManifold* createNewManifold(manifold_key_t key);
+    void replaceManifold(const phyContactBuffer& buffer, const phyFeatureRecord& f);
 
 public:
-    int manifoldCount() const { return front->manifolds.count(); }
+    int manifoldCount() const { return (int)front->manifolds.size(); }
     phyManifold& getManifold(int at) { return front->manifolds[at]; }
 
-    int oldManifoldCount() const { return back->manifolds.count(); }
+    int oldManifoldCount() const { return (int)back->manifolds.size(); }
     phyManifold& getOldManifold(int at) { return back->manifolds[at]; }
 
     void flipBuffers(int tick_id);
@@ -78,5 +147,12 @@ public:
 
     void addContact3(phyManifold* m, phyContactPoint& cp);
     void addContact(phyManifold* manifold, phyContactPoint& cp);
+
+    // Read only, safe to call from narrowphase jobs
+    const phyManifold* findManifold(phyRigidBody* a, phyRigidBody* b, uint16_t normal_key) const;
+
+    // Replays recorded contacts in order, same as calling getManifold() and addContact() for each.
+    // Manifolds recorded with phyContactBuffer::addManifold() replace the points of the pair's manifold
+    void addContacts(const phyContactBuffer& buffer);
 };
 
@@ -52,20 +52,15 @@ public:
             return gfxm::vec3(0,0,0);
         }
 
-        gfxm::vec3 lcl_dir = gfxm::inverse(transform) * gfxm::vec4(dir, .0f);
-
-        float max_d = -FLT_MAX;
-        int vid = 0;
-        for (int i = 0; i < mesh->vertexCount(); ++i) {
-            const auto& v = mesh->getVertexData()[i];
-            float d = gfxm::dot(lcl_dir, v);
-            if (d > max_d) {
-                vid = i;
-                max_d = d;
-            }
-        }
+        // Support of a linearly transformed hull: M * support(transpose(M) * dir)
+        const gfxm::vec3 lcl_dir = gfxm::transpose(gfxm::to_mat3(transform)) * dir;
+        const int vid = mesh->findSupportVertex(lcl_dir);
         return transform * gfxm::vec4(mesh->getVertexData()[vid], 1.f);
     }
+    // lcl_dir in shape space, hint is the vertex a previous query returned or -1
+    int getSupportVertex(const gfxm::vec3& lcl_dir, int hint = -1) const {
+        return mesh->findSupportVertex(lcl_dir, hint);
+    }
 
     void debugDraw(const gfxm::mat4& transform, uint32_t color) const {
         if (!mesh) {
@@ -1,5 +1,8 @@
 #include "heightfield.hpp"
 
+#include "collision/simd.hpp"
+#include "collision/intersection/ray.hpp"
+#include "collision/intersection/sphere_capsule.hpp"
 
 
 void phyHeightfieldShape::init(float* data, int sample_count_x, int sample_count_z, float width, float depth) {
@@ -9,27 +12,318 @@ void phyHeightfieldShape::init(float* data, int sample_count_x, int sample_count
     this->sample_count_z = sample_count_z;
     this->width = width;
     this->depth = depth;
+    buildQuadtree();
 }
 
-gfxm::aabb phyHeightfieldShape::calcWorldAabb(const gfxm::mat4& transform) const {
-    gfxm::aabb box;
-    float cell_width = width / float(sample_count_x - 1);
-    float cell_depth = depth / float(sample_count_z - 1);
+void phyHeightfieldShape::buildQuadtree() {
+    quad_levels.clear();
+    const int cells_x = getCellCountX();
+    const int cells_z = getCellCountZ();
+    if (cells_x < 1 || cells_z < 1) {
+        return;
+    }
 
-    float y = samples[0 + 0 * sample_count_x];
-    gfxm::vec4 pt4(.0f * cell_width, y, .0f * cell_depth, 1.f);
-    gfxm::vec3 pt3 = transform * pt4;
-    box.from = pt3;
-    box.to = pt3;
+    QuadLevel leaves;
+    leaves.count_x = (cells_x + PHY_HEIGHTFIELD_LEAF_CELLS - 1) / PHY_HEIGHTFIELD_LEAF_CELLS;
+    leaves.count_z = (cells_z + PHY_HEIGHTFIELD_LEAF_CELLS - 1) / PHY_HEIGHTFIELD_LEAF_CELLS;
+    leaves.range.resize(leaves.count_x * leaves.count_z);
+    for (int lz = 0; lz < leaves.count_z; ++lz) {
+        for (int lx = 0; lx < leaves.count_x; ++lx) {
+            const int x0 = lx * PHY_HEIGHTFIELD_LEAF_CELLS;
+            const int z0 = lz * PHY_HEIGHTFIELD_LEAF_CELLS;
+            const int x1 = std::min(x0 + PHY_HEIGHTFIELD_LEAF_CELLS, cells_x);
+            const int z1 = std::min(z0 + PHY_HEIGHTFIELD_LEAF_CELLS, cells_z);
+            gfxm::vec2 range(FLT_MAX, -FLT_MAX);
+            for (int z = z0; z <= z1; ++z) {
+                for (int x = x0; x <= x1; ++x) {
+                    const float h = samples[x + z * sample_count_x];
+                    range.x = gfxm::_min(range.x, h);
+                    range.y = gfxm::_max(range.y, h);
+                }
+            }
+            leaves.range[lx + lz * leaves.count_x] = range;
+        }
+    }
+    quad_levels.push_back(std::move(leaves));
 
-    for (int z = 0; z < sample_count_z; ++z) {
-        for (int x = 0; x < sample_count_x; ++x) {
-            float y = samples[x + z * sample_count_x];
-            gfxm::vec4 pt4(x * cell_width, y, z * cell_depth, 1.f);
-            gfxm::vec3 pt3 = transform * pt4;
-            gfxm::expand_aabb(box, pt3);
+    while (quad_levels.back().count_x > 1 || quad_levels.back().count_z > 1) {
+        const QuadLevel& below = quad_levels.back();
+        QuadLevel level;
+        level.count_x = (below.count_x + 1) / 2;
+        level.count_z = (below.count_z + 1) / 2;
+        level.range.resize(level.count_x * level.count_z);
+        for (int z = 0; z < level.count_z; ++z) {
+            for (int x = 0; x < level.count_x; ++x) {
+                gfxm::vec2 range(FLT_MAX, -FLT_MAX);
+                for (int cz = z * 2; cz < std::min(z * 2 + 2, below.count_z); ++cz) {
+                    for (int cx = x * 2; cx < std::min(x * 2 + 2, below.count_x); ++cx) {
+                        const gfxm::vec2& r = below.range[cx + cz * below.count_x];
+                        range.x = gfxm::_min(range.x, r.x);
+                        range.y = gfxm::_max(range.y, r.y);
+                    }
+                }
+                level.range[x + z * level.count_x] = range;
+            }
         }
+        quad_levels.push_back(std::move(level));
+    }
+}
+
+void phyHeightfieldShape::getCellCorners(int cell_x, int cell_z, gfxm::vec3* out_corners) const {
+    const float cell_width = getCellWidth();
+    const float cell_depth = getCellDepth();
+    const float* row0 = &samples[cell_z * sample_count_x];
+    const float* row1 = row0 + sample_count_x;
+    out_corners[0] = gfxm::vec3(cell_x * cell_width, row0[cell_x], cell_z * cell_depth);
+    out_corners[1] = gfxm::vec3(cell_x * cell_width, row1[cell_x], (cell_z + 1) * cell_depth);
+    out_corners[2] = gfxm::vec3((cell_x + 1) * cell_width, row1[cell_x + 1], (cell_z + 1) * cell_depth);
+    out_corners[3] = gfxm::vec3((cell_x + 1) * cell_width, row0[cell_x + 1], cell_z * cell_depth);
+}
+
+int phyHeightfieldShape::findPotentialCells(const gfxm::aabb& local_box, int* out_cells, int max_count, int& resume_cell) const {
+    const int first_cell = resume_cell;
+    resume_cell = -1;
+    if (quad_levels.empty() || first_cell < 0) {
+        return 0;
+    }
+    const gfxm::vec2& root = quad_levels.back().range[0];
+    const float miny = local_box.from.y;
+    const float maxy = local_box.to.y;
+    if (maxy < root.x || miny > root.y) {
+        return 0;
+    }
+
+    const int cells_x = getCellCountX();
+    const int cells_z = getCellCountZ();
+    const int x0 = std::max(0, (int)floorf(local_box.from.x / getCellWidth()));
+    const int x1 = std::min(cells_x, (int)floorf(local_box.to.x / getCellWidth()) + 1);
+    const int z0 = std::max(0, (int)floorf(local_box.from.z / getCellDepth()));
+    const int z1 = std::min(cells_z, (int)floorf(local_box.to.z / getCellDepth()) + 1);
+
+    // Continue from where the previous call ran out of space
+    int z = z0;
+    int x_first = x0;
+    if (first_cell / cells_x >= z0) {
+        z = first_cell / cells_x;
+        x_first = std::max(x0, first_cell % cells_x);
     }
 
+    int count = 0;
+    for (; z < z1; ++z) {
+        const float* row0 = &samples[z * sample_count_x];
+        const float* row1 = row0 + sample_count_x;
+        int x = x_first;
+        x_first = x0;
+#if PHY_SSE
+        // Four cells per iteration, the right hand corners are the same rows shifted by one sample
+        const __m128 vminy = _mm_set1_ps(miny);
+        const __m128 vmaxy = _mm_set1_ps(maxy);
+        for (; x + 4 <= x1; x += 4) {
+            const __m128 h0 = _mm_loadu_ps(row0 + x);
+            const __m128 h1 = _mm_loadu_ps(row1 + x);
+            const __m128 h2 = _mm_loadu_ps(row1 + x + 1);
+            const __m128 h3 = _mm_loadu_ps(row0 + x + 1);
+            const __m128 lo = _mm_min_ps(_mm_min_ps(h0, h1), _mm_min_ps(h2, h3));
+            const __m128 hi = _mm_max_ps(_mm_max_ps(h0, h1), _mm_max_ps(h2, h3));
+            const int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmple_ps(lo, vmaxy), _mm_cmpge_ps(hi, vminy)));
+            if (mask == 0) {
+                continue;
+            }
+            for (int i = 0; i < 4; ++i) {
+                if ((mask & (1 << i)) == 0) {
+                    continue;
+                }
+                if (count == max_count) {
+                    resume_cell = x + i + z * cells_x;
+                    return count;
+                }
+                out_cells[count++] = x + i + z * cells_x;
+            }
+        }
+#endif
+        for (; x < x1; ++x) {
+            const float lo = gfxm::_min(gfxm::_min(row0[x], row1[x]), gfxm::_min(row1[x + 1], row0[x + 1]));
+            const float hi = gfxm::_max(gfxm::_max(row0[x], row1[x]), gfxm::_max(row1[x + 1], row0[x + 1]));
+            if (lo > maxy || hi < miny) {
+                continue;
+            }
+            if (count == max_count) {
+                resume_cell = x + z * cells_x;
+                return count;
+            }
+            out_cells[count++] = x + z * cells_x;
+        }
+    }
+    return count;
+}
+
+// Entry point of a segment into a box, t along from + dir * t, false if it misses or enters after t_max
+static bool heightfieldSegmentBox(const gfxm::vec3& from, const gfxm::vec3& dir, const gfxm::vec3& bmin, const gfxm::vec3& bmax, float t_max, float& out_t) {
+    float t0 = .0f;
+    float t1 = t_max;
+    for (int k = 0; k < 3; ++k) {
+        if (fabsf(dir[k]) < 1e-12f) {
+            if (from[k] < bmin[k] || from[k] > bmax[k]) {
+                return false;
+            }
+            continue;
+        }
+        const float inv = 1.f / dir[k];
+        float ta = (bmin[k] - from[k]) * inv;
+        float tb = (bmax[k] - from[k]) * inv;
+        if (ta > tb) {
+            std::swap(ta, tb);
+        }
+        t0 = gfxm::_max(t0, ta);
+        t1 = gfxm::_min(t1, tb);
+        if (t0 > t1) {
+            return false;
+        }
+    }
+    out_t = t0;
+    return true;
+}
+
+template<typename CELL_FN>
+void phyHeightfieldShape::walkNode(int level, int x, int z, const gfxm::vec3& from, const gfxm::vec3& dir, float radius, float& t_best, const CELL_FN& fn_cell) const {
+    const QuadLevel& lv = quad_levels[level];
+    const gfxm::vec2& range = lv.range[x + z * lv.count_x];
+    const float cell_width = getCellWidth();
+    const float cell_depth = getCellDepth();
+    const int span = PHY_HEIGHTFIELD_LEAF_CELLS << level;
+    const int cx0 = x * span;
+    const int cz0 = z * span;
+    const int cx1 = std::min(cx0 + span, getCellCountX());
+    const int cz1 = std::min(cz0 + span, getCellCountZ());
+
+    float t;
+    if (!heightfieldSegmentBox(
+        from, dir,
+        gfxm::vec3(cx0 * cell_width - radius, range.x - radius, cz0 * cell_depth - radius),
+        gfxm::vec3(cx1 * cell_width + radius, range.y + radius, cz1 * cell_depth + radius),
+        t_best, t
+    )) {
+        return;
+    }
+
+    if (level == 0) {
+        for (int cz = cz0; cz < cz1; ++cz) {
+            const float* row0 = &samples[cz * sample_count_x];
+            const float* row1 = row0 + sample_count_x;
+            for (int cx = cx0; cx < cx1; ++cx) {
+                const float lo = gfxm::_min(gfxm::_min(row0[cx], row1[cx]), gfxm::_min(row1[cx + 1], row0[cx + 1]));
+                const float hi = gfxm::_max(gfxm::_max(row0[cx], row1[cx]), gfxm::_max(row1[cx + 1], row0[cx + 1]));
+                if (!heightfieldSegmentBox(
+                    from, dir,
+                    gfxm::vec3(cx * cell_width - radius, lo - radius, cz * cell_depth - radius),
+                    gfxm::vec3((cx + 1) * cell_width + radius, hi + radius, (cz + 1) * cell_depth + radius),
+                    t_best, t
+                )) {
+                    continue;
+                }
+                fn_cell(cx, cz, t_best);
+            }
+        }
+        return;
+    }
+
+    // Near children first so the far ones are more likely to be cut off by t_best
+    const QuadLevel& below = quad_levels[level - 1];
+    const int ix[2] = { dir.x >= .0f ? 0 : 1, dir.x >= .0f ? 1 : 0 };
+    const int iz[2] = { dir.z >= .0f ? 0 : 1, dir.z >= .0f ? 1 : 0 };
+    for (int j = 0; j < 2; ++j) {
+        for (int i = 0; i < 2; ++i) {
+            const int child_x = x * 2 + ix[i];
+            const int child_z = z * 2 + iz[j];
+            if (child_x >= below.count_x || child_z >= below.count_z) {
+                continue;
+            }
+            walkNode(level - 1, child_x, child_z, from, dir, radius, t_best, fn_cell);
+        }
+    }
+}
+
+template<typename CELL_FN>
+void phyHeightfieldShape::walkSegment(const gfxm::vec3& from, const gfxm::vec3& to, float radius, float& t_best, const CELL_FN& fn_cell) const {
+    if (quad_levels.empty()) {
+        return;
+    }
+    // Hits right on a cell border can come out of the triangle tests a hair outside the inflated box,
+    // without the margin a shallow sweep would lose them to a slightly later hit in the next cell
+    const float margin = 1e-3f;
+    walkNode((int)quad_levels.size() - 1, 0, 0, from, to - from, radius + margin, t_best, fn_cell);
+}
+
+bool phyHeightfieldShape::rayTest(const gfxm::ray& ray, RayHitPoint& rhp) const {
+    const float len = ray.direction.length();
+    if (len <= FLT_EPSILON) {
+        return false;
+    }
+    bool has_hit = false;
+    float t_best = 1.f;
+    walkSegment(ray.origin, ray.origin + ray.direction, .0f, t_best, [&](int cx, int cz, float& t_best) {
+        gfxm::vec3 p[4];
+        getCellCorners(cx, cz, p);
+        RayHitPoint hit;
+        if (intersectRayTriangle(ray, p[0], p[1], p[2], hit) && hit.distance / len <= t_best) {
+            t_best = hit.distance / len;
+            rhp = hit;
+            has_hit = true;
+        }
+        if (intersectRayTriangle(ray, p[2], p[3], p[0], hit) && hit.distance / len <= t_best) {
+            t_best = hit.distance / len;
+            rhp = hit;
+            has_hit = true;
+        }
+    });
+    return has_hit;
+}
+
+bool phyHeightfieldShape::sweepSphere(const gfxm::vec3& from, const gfxm::vec3& to, float radius, SweepContactPoint& scp) const {
+    const float len = (to - from).length();
+    if (len <= FLT_EPSILON) {
+        return false;
+    }
+    bool has_hit = false;
+    float t_best = 1.f;
+    walkSegment(from, to, radius, t_best, [&](int cx, int cz, float& t_best) {
+        gfxm::vec3 p[4];
+        getCellCorners(cx, cz, p);
+        SweepContactPoint hit;
+        if (intersectionSweepSphereTriangle(from, to, radius, p[0], p[1], p[2], hit) && hit.distance_traveled / len < t_best) {
+            t_best = hit.distance_traveled / len;
+            scp = hit;
+            has_hit = true;
+        }
+        if (intersectionSweepSphereTriangle(from, to, radius, p[2], p[3], p[0], hit) && hit.distance_traveled / len < t_best) {
+            t_best = hit.distance_traveled / len;
+            scp = hit;
+            has_hit = true;
+        }
+    });
+    return has_hit;
+}
+
+gfxm::aabb phyHeightfieldShape::calcWorldAabb(const gfxm::mat4& transform) const {
+    // Root of the quadtree has the height range of the whole field
+    gfxm::vec2 range(.0f, .0f);
+    if (!quad_levels.empty()) {
+        range = quad_levels.back().range[0];
+    }
+    gfxm::aabb box;
+    for (int i = 0; i < 8; ++i) {
+        const gfxm::vec3 pt = transform * gfxm::vec4(
+            (i & 1) ? width : .0f,
+            (i & 2) ? range.y : range.x,
+            (i & 4) ? depth : .0f,
+            1.f
+        );
+        if (i == 0) {
+            box.from = pt;
+            box.to = pt;
+        } else {
+            gfxm::expand_aabb(box, pt);
+        }
+    }
     return box;
 }
\ No newline at end of file
@@ -2,14 +2,35 @@
 
 #include <vector>
 #include "shape.hpp"
+#include "collision/collision_contact_point.hpp"
 
 
+// Quadtree leaves cover this many cells on each side, below that cells are tested straight from the samples
+constexpr int PHY_HEIGHTFIELD_LEAF_CELLS = 4;
+// Narrowphase cell buffer, bodies overlapping more cells than this get them in several findPotentialCells() calls
+constexpr int PHY_HEIGHTFIELD_MAX_CELLS_PER_PAIR = 256;
+
 class phyHeightfieldShape : public phyShape {
     std::vector<float> samples;
     int sample_count_x = 0;
     int sample_count_z = 0;
     float width = 1.f;
     float depth = 1.f;
+
+    // Min/max height quadtree, quad_levels[0] has one node per leaf block, the last level is the root.
+    // A node covers 2x2 nodes of the level below
+    struct QuadLevel {
+        int count_x = 0;
+        int count_z = 0;
+        std::vector<gfxm::vec2> range;
+    };
+    std::vector<QuadLevel> quad_levels;
+
+    void buildQuadtree();
+    template<typename CELL_FN>
+    void walkSegment(const gfxm::vec3& from, const gfxm::vec3& to, float radius, float& t_best, const CELL_FN& fn_cell) const;
+    template<typename CELL_FN>
+    void walkNode(int level, int x, int z, const gfxm::vec3& from, const gfxm::vec3& dir, float radius, float& t_best, const CELL_FN& fn_cell) const;
 public:
     phyHeightfieldShape()
         : phyShape(PHY_SHAPE_TYPE::HEIGHTFIELD) {}
@@ -23,6 +44,19 @@ public:
     int getSampleCountX() const { return sample_count_x; }
     int getSampleCountZ() const { return sample_count_z; }
     const float* getData() const { return samples.data(); }
+    int getCellCountX() const { return sample_count_x - 1; }
+    int getCellCountZ() const { return sample_count_z - 1; }
+
+    // Local space corners of a cell, p0 p1 p2 and p2 p3 p0 are its triangles
+    void getCellCorners(int cell_x, int cell_z, gfxm::vec3* out_corners) const;
+    // Cells inside the xz rectangle of a local space box whose height range overlaps the box,
+    // each row is culled four cells at a time. Cells are written as x + z * getCellCountX().
+    // Start with resume_cell = 0, if out_cells fills up it is where the next call continues, -1 once all cells were visited
+    int findPotentialCells(const gfxm::aabb& local_box, int* out_cells, int max_count, int& resume_cell) const;
+
+    // Closest hit, local space. The quadtree skips everything the segment can't reach
+    bool rayTest(const gfxm::ray& ray, RayHitPoint& rhp) const;
+    bool sweepSphere(const gfxm::vec3& from, const gfxm::vec3& to, float radius, SweepContactPoint& scp) const;
 
     gfxm::aabb calcWorldAabb(const gfxm::mat4& transform) const override;
 };
\ No newline at end of file
@@ -0,0 +1,13 @@
+#pragma once
+
+// SSE2 is always there on x64, 32-bit builds only have it with /arch:SSE2
+// Set PHY_ENABLE_SSE to 0 to build the plain fallbacks everywhere
+
+#define PHY_ENABLE_SSE 1
+
+#if PHY_ENABLE_SSE && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define PHY_SSE 1
+#include <emmintrin.h>
+#else
+#define PHY_SSE 0
+#endif
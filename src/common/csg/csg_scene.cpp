@@ -54,6 +54,7 @@ void csgScene::addShape(csgBrushShape* shape, bool keep_uid) {
     shapes.insert(shape);
     shape->index = shape_vec.size();
     shape_vec.push_back(std::unique_ptr<csgBrushShape>(shape));
+    pick_tree_dirty = true;
 }
 void csgScene::removeShape(csgBrushShape* shape) {
     if (shapes.count(shape) == 0) {
@@ -74,6 +75,7 @@ void csgScene::removeShape(csgBrushShape* shape) {
     for (int i = 0; i < shape_vec.size(); ++i) {
         shape_vec[i]->index = i;
     }
+    pick_tree_dirty = true;
 }
 int csgScene::shapeCount() const {
     return shape_vec.size();
@@ -207,6 +209,7 @@ csgMaterial* csgScene::getMaterial(int i) {
 }
 void csgScene::invalidateShape(csgBrushShape* shape) {
     invalidated_shapes.insert(shape);
+    pick_tree_dirty = true;
 }
 void csgScene::markForRebuild(csgBrushShape* shape) {
     shapes_to_rebuild.insert(shape);
@@ -257,6 +260,8 @@ void csgScene::update() {
     // For all new or moved shapes
     for (auto shape : invalidated_shapes) {
         csgUpdateShapeWorldSpace(shape);
+        // A pick since the shape was invalidated could have built the tree from its old bounds
+        pick_tree_dirty = true;
 
         shapes_to_rebuild.insert(shape);
         for (auto intersecting : shape->intersecting_shapes) {
@@ -353,6 +358,22 @@ static bool isPointInsideConvexFace(const gfxm::vec3& pt, const csgFace* face) {
     }
     return true;
 }
+void csgScene::updatePickTree() {
+    if (!pick_tree_dirty) {
+        return;
+    }
+    std::vector<gfxm::aabb> boxes(shape_vec.size());
+    for (int i = 0; i < shape_vec.size(); ++i) {
+        boxes[i] = shape_vec[i]->aabb;
+    }
+    std::vector<uint32_t> order;
+    pick_tree.build(boxes.data(), (int)boxes.size(), order);
+    pick_shapes.resize(order.size());
+    for (int i = 0; i < order.size(); ++i) {
+        pick_shapes[i] = shape_vec[order[i]].get();
+    }
+    pick_tree_dirty = false;
+}
 bool csgScene::castRay(
     const gfxm::vec3& from, const gfxm::vec3& to,
     gfxm::vec3& out_hit, gfxm::vec3& out_normal,
@@ -364,11 +385,9 @@ bool csgScene::castRay(
     const csgFace* hit_face = 0;
     const csgFragment* hit_fragment = 0;
 
-    for (auto& shape : shapes) {
-        const auto& aabb = shape->aabb;
-        if (!gfxm::intersect_ray_aabb(gfxm::ray(from, (to - from)), aabb)) {
-            continue;
-        }
+    updatePickTree();
+    pick_tree.rayTest(from, to, [&](uint32_t item, float& t_max) {
+        csgBrushShape* shape = pick_shapes[item];
         for (int i = 0; i < shape->faces.size(); ++i) {
             const auto& face = *shape->faces[i].get();
             float t = .0f;
@@ -404,7 +423,8 @@ bool csgScene::castRay(
                 hit_fragment = &frag;
             }
         }
-    }
+        t_max = gfxm::_min(t_max, dist);
+    });
     if (dist == INFINITY) {
         return false;
     }
@@ -461,11 +481,9 @@ bool csgScene::castRay(
 bool csgScene::pickShape(const gfxm::vec3& from, const gfxm::vec3& to, csgBrushShape** out_shape) {
     float dist = INFINITY;
     gfxm::vec3 pt;
-    for (auto& shape : shapes) {
-        const auto& aabb = shape->aabb;
-        if (!gfxm::intersect_ray_aabb(gfxm::ray(from, (to - from)), aabb)) {
-            continue;
-        }
+    updatePickTree();
+    pick_tree.rayTest(from, to, [&](uint32_t item, float& t_max) {
+        csgBrushShape* shape = pick_shapes[item];
         for (int i = 0; i < shape->faces.size(); ++i) {
             const auto& face = *shape->faces[i].get();
             float t = .0f;
@@ -497,7 +515,8 @@ bool csgScene::pickShape(const gfxm::vec3& from, const gfxm::vec3& to, csgBrushS
                 *out_shape = shape;
             }
         }
-    }
+        t_max = gfxm::_min(t_max, dist);
+    });
     if (dist == INFINITY) {
         return false;
     }
@@ -673,6 +692,10 @@ void csgScene::serializeJson(nlohmann::json& json) {
     }
 }
 bool csgScene::deserializeJson(const nlohmann::json& json) {
+    // The pick tree points into shape_vec
+    pick_tree.clear();
+    pick_shapes.clear();
+    pick_tree_dirty = true;
     shapes.clear();
     invalidated_shapes.clear();
     shapes_to_rebuild.clear();
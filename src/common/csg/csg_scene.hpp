@@ -6,6 +6,7 @@
 #include "object/csg_object.hpp"
 #include "object/csg_group_object.hpp"
 #include "object/csg_custom_shape_object.hpp"
+#include "collision/aabb_tree/aabb_tree_static.hpp"
 
 
 class csgScene {
@@ -23,7 +24,13 @@ class csgScene {
     std::map<std::string, csgMaterial*> material_map;
     std::vector<std::unique_ptr<csgMaterial>> materials;
 
+    // Shape bounds for ray picking, rebuilt by the first pick after any shape changes
+    AabbTreeStatic pick_tree;
+    std::vector<csgBrushShape*> pick_shapes;
+    bool pick_tree_dirty = true;
+
     void updateShapeIntersections(csgBrushShape* shape);
+    void updatePickTree();
 public:
 
     void            addShape(csgBrushShape* shape, bool keep_uid = false);
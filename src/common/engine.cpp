@@ -28,6 +28,8 @@ static void onWindowResize(int width, int height) {
 
 int engineGameInit() {
     ResourceManager::get()->setBackend<gpuTexture2d>(std::make_unique<Texture2dResourceBackend>());
+    // Packs in the working directory, in name order so a later pack overrides an earlier one
+    PackFileSystem::get()->mountDirectory(".");
 
     engine_init_handler = new InitHandlerRAII;
 
@@ -5,6 +5,7 @@
 #include "platform/platform.hpp"
 #include "transform_node/transform_system.hpp"
 #include "gpu/gpu.hpp"
+#include "gpu/skinning/skinning_compute.hpp"
 #include "input/input.hpp"
 #include "util/timer.hpp"
 #include "player/player.hpp"
@@ -19,6 +20,7 @@
 // ==================
 
 #include "resource_manager/resource_manager.hpp"
+#include "resource_manager/pack/pack_builder.hpp"
 #include "con_registry/con_registry.hpp"
 
 
@@ -59,6 +61,36 @@ void DefaultRuntime::run() {
                 audioSetLooping(chan, false);
                 audioPlay(chan);
             });
+            conreg->registerCmd("r.skinning", "skinning backend: compute, cpu or cpu_dq, optional thread count for cpu", [](const ConsoleCommand& cmd) {
+                auto backend = cmd.arg<std::string>(0);
+                int thread_count = cmd.arg<int>(1, 0);
+                if (backend == "compute") {
+                    gpuSetSkinningBackend(GPU_SKIN_BACKEND_COMPUTE);
+                } else if (backend == "cpu") {
+                    gpuSetSkinningBackend(GPU_SKIN_BACKEND_CPU, GPU_SKIN_BLEND_LINEAR, thread_count);
+                } else if (backend == "cpu_dq") {
+                    gpuSetSkinningBackend(GPU_SKIN_BACKEND_CPU, GPU_SKIN_BLEND_DUAL_QUAT, thread_count);
+                } else {
+                    LOG_WARN("Unknown skinning backend: '" << backend << "'");
+                }
+            });
+            conreg->registerCmd("pack.build", "pack a directory: pack.build <dir> <out.pack> [compress=1]", [](const ConsoleCommand& cmd) {
+                auto dir = cmd.arg<std::string>(0);
+                auto out = cmd.arg<std::string>(1);
+                if (dir.empty() || out.empty()) {
+                    LOG_WARN("Usage: pack.build <dir> <out.pack> [compress=1]");
+                    return;
+                }
+                packBuild(dir, out, cmd.arg<int>(2, 1) != 0);
+            });
+            conreg->registerCmd("pack.mount", "mount a pack over loose files and packs mounted before it", [](const ConsoleCommand& cmd) {
+                PackFileSystem::get()->mount(cmd.arg<std::string>(0));
+            });
+            conreg->registerCmd("pack.unmount", "unmount a pack, resources already loaded from it stay loaded and ones still loading finish from it", [](const ConsoleCommand& cmd) {
+                if (!PackFileSystem::get()->unmount(cmd.arg<std::string>(0))) {
+                    LOG_WARN("Not mounted: '" << cmd.arg<std::string>(0) << "'");
+                }
+            });
         }
 
         // Developer console
@@ -181,6 +213,9 @@ and challenged Morgoth to come forth to single combat. And Morgoth came.)", { "p
     timer timer_ui_render;
     float dt = 1.f / 60.f;
     float total_time = .0f;
+    std::vector<VisibilityQuery> vis_queries;
+    std::vector<gpuRenderBucket*> vis_buckets;
+    std::vector<SceneSystem*> vis_systems;
     while (platformIsRunning()) {
         timer_.start();
 
@@ -210,6 +245,8 @@ and challenged Morgoth to come forth to single combat. And Morgoth came.)", { "p
         if (game_instance) {
             game_instance->update(dt);
         }
+        // Bone matrices and the like in one pass before anything draws
+        TransformSystem::update();
 
         {
             static ConInt* con_perf_kind = ConRegistry::get()->getIntVar("perflabel");
@@ -270,6 +307,36 @@ and challenged Morgoth to come forth to single combat. And Morgoth came.)", { "p
 
         // Render viewports
         timer_render.start();
+        {
+            // Views looking into the same SceneSystem are culled together in one pass
+            vis_queries.clear();
+            vis_buckets.clear();
+            vis_systems.clear();
+            for (int i = 0; i < render_views.size(); ++i) {
+                EngineRenderView* rv = render_views[i];
+                Camera* cam = rv->getCamera();
+                if (!cam || !cam->getVisibilitySystem()) {
+                    continue;
+                }
+                vis_queries.push_back(VisibilityQuery(rv->getProjection(), cam->getViewTransform(), i));
+                vis_buckets.push_back(rv->getRenderBucket());
+                vis_systems.push_back(cam->getVisibilitySystem());
+            }
+            for (int first = 0; first < vis_systems.size();) {
+                int last = first + 1;
+                for (int j = last; j < vis_systems.size(); ++j) {
+                    if (vis_systems[j] != vis_systems[first]) {
+                        continue;
+                    }
+                    std::swap(vis_queries[j], vis_queries[last]);
+                    std::swap(vis_buckets[j], vis_buckets[last]);
+                    std::swap(vis_systems[j], vis_systems[last]);
+                    ++last;
+                }
+                vis_systems[first]->collectVisible(&vis_queries[first], &vis_buckets[first], last - first);
+                first = last;
+            }
+        }
         for (int i = 0; i < render_views.size(); ++i) {
             EngineRenderView* rv = render_views[i];
             
@@ -283,12 +350,6 @@ and challenged Morgoth to come forth to single combat. And Morgoth came.)", { "p
             if (scnRenderScene* scn = cam->getScene()) {
                 scn->draw(bucket);
             }
-            if (SceneSystem* vis_sys = cam->getVisibilitySystem()) {
-                vis_sys->collectVisible(
-                    VisibilityQuery(rv->getProjection(), cam->getViewTransform(), 0),
-                    bucket
-                );
-            }
 
             DRAW_PARAMS params = {
                 .view = rv->getViewTransform(),
@@ -334,6 +395,7 @@ and challenged Morgoth to come forth to single combat. And Morgoth came.)", { "p
         stats.ui_render_time = timer_ui_render.stop();
         stats.cpu_draw_time = timer_render.stop();
 
+        ResourceManager::get()->update();
         ResourceManager::get()->collectGarbage();
 
         stats.gpu_wait_time = FLT_MAX;
@@ -254,6 +254,28 @@ public:
 
         glBindTexture(GL_TEXTURE_2D, 0);
     }
+    // Overwrites a region of the already allocated level 0, mipmaps are not regenerated.
+    // data points at the region's first pixel inside a buffer that is row_length pixels wide
+    void setSubData(const void* data, int x, int y, int width, int height, int row_length, int channels, IMAGE_CHANNEL_FORMAT fmt = IMAGE_CHANNEL_UNSIGNED_BYTE) {
+        assert(x >= 0 && y >= 0 && x + width <= this->width && y + height <= this->height);
+        GLenum format = selectFormat(internalFormat, channels);
+
+        GLenum type = GL_UNSIGNED_BYTE;
+        switch (fmt) {
+        case IMAGE_CHANNEL_UNSIGNED_BYTE: type = GL_UNSIGNED_BYTE; break;
+        case IMAGE_CHANNEL_FLOAT: type = GL_FLOAT; break;
+        };
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, id);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length);
+        GL_CHECK(glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, format, type, data));
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
 
     // TODO:
     void setFilter(GPU_TEXTURE_FILTER filter) {
@@ -1,8 +1,37 @@
 #include "skinning_compute.hpp"
 
+#include <memory>
+#include <thread>
 #include <vector>
 #include "log/log.hpp"
-
+#include "util/thread_pool.hpp"
+#include "skinning_cpu.hpp"
+
+
+// Large meshes are split so one character doesn't end up on a single thread
+constexpr int SKIN_CPU_JOB_VERTEX_COUNT = 4096;
+
+struct gpuSkinCpuData {
+    std::vector<gfxm::vec3> positions;
+    std::vector<gfxm::vec3> normals;
+    std::vector<gfxm::vec3> tangents;
+    std::vector<gfxm::vec3> bitangents;
+    std::vector<gfxm::ivec4> bone_indices;
+    std::vector<gfxm::vec4> bone_weights;
+    std::vector<gfxm::vec3> out_positions;
+    std::vector<gfxm::vec3> out_normals;
+    std::vector<gfxm::vec3> out_tangents;
+    std::vector<gfxm::vec3> out_bitangents;
+    std::vector<gpuSkinDualQuat> dual_quats;
+    gpuSkinCpuStreams streams;
+    bool is_valid = false;
+};
+
+struct SkinCpuJob {
+    gpuSkinTask* task;
+    int first;
+    int count;
+};
 
 static int s_init_count = 0;
 static GLuint s_prog_skinning = 0;
@@ -10,6 +39,13 @@ static std::vector<gpuSkinTask*> skin_tasks;
 static int scheduled_task_count = 0;
 static int skin_task_run_count = 0;
 
+static GPU_SKIN_BACKEND s_backend = GPU_SKIN_BACKEND_COMPUTE;
+static GPU_SKIN_BLEND s_blend = GPU_SKIN_BLEND_LINEAR;
+static std::unique_ptr<ThreadPool> s_cpu_pool;
+static std::vector<SkinCpuJob> s_cpu_jobs;
+static std::vector<gpuSkinTask*> s_cpu_tasks;
+static std::vector<gpuSkinTask*> s_compute_tasks;
+
 void gpuInitSkinning() {
     ++s_init_count;
     if (s_init_count > 1) {
@@ -153,6 +189,7 @@ void gpuInitSkinning() {
 }
 void gpuCleanupSkinning() {
     for (int i = 0; i < skin_tasks.size(); ++i) {
+        delete skin_tasks[i]->cpu_data;
         delete skin_tasks[i];
     }
     skin_tasks.clear();
@@ -187,6 +224,7 @@ void gpuDestroySkinTask(gpuSkinTask* task) {
         skin_tasks[idx]->index = idx;
     }
     skin_tasks.pop_back();
+    delete task->cpu_data;
     delete task;
 }
 void gpuScheduleSkinTask(gpuSkinTask* task) {
@@ -248,15 +286,125 @@ static void updateSkinVertexDataComputeSingle(
     glDeleteBuffers(1, &bufPose);
 }
 
-void gpuRunSkinTasks() {
-    glBindVertexArray(0);
-    glUseProgram(s_prog_skinning);
+// Reads the whole buffer, getData() has no offset or size
+template<typename T>
+static bool skinReadBack(const gpuBuffer* buf, std::vector<T>& out, int count) {
+    if (!buf || buf->getSize() < count * sizeof(T)) {
+        return false;
+    }
+    out.resize((buf->getSize() + sizeof(T) - 1) / sizeof(T));
+    buf->getData(out.data());
+    out.resize(count);
+    return true;
+}
 
+static gpuSkinCpuData* skinCreateCpuData(const gpuSkinTask* task) {
+    gpuSkinCpuData* data = new gpuSkinCpuData;
+    const int vertex_count = task->vertex_count;
+    if (!skinReadBack(task->bufVerticesSource, data->positions, vertex_count)
+        || !skinReadBack(task->bufBoneIndices, data->bone_indices, vertex_count)
+        || !skinReadBack(task->bufBoneWeights, data->bone_weights, vertex_count)
+    ) {
+        LOG_WARN("Skin task source buffers can't be read back, the task stays on the compute backend");
+        return data;
+    }
+    for (int i = 0; i < vertex_count; ++i) {
+        const gfxm::ivec4& bi = data->bone_indices[i];
+        if (bi.x < 0 || bi.y < 0 || bi.z < 0 || bi.w < 0
+            || bi.x >= task->pose_count || bi.y >= task->pose_count || bi.z >= task->pose_count || bi.w >= task->pose_count
+        ) {
+            LOG_WARN("Skin task bone index out of range, the task stays on the compute backend");
+            return data;
+        }
+    }
+
+    auto& s = data->streams;
+    s.vertex_count = vertex_count;
+    s.positions = data->positions.data();
+    s.bone_indices = data->bone_indices.data();
+    s.bone_weights = data->bone_weights.data();
+    data->out_positions.resize(vertex_count);
+    s.out_positions = data->out_positions.data();
+    // Optional streams, skipped entirely when the source isn't there
+    if (task->bufNormalsOut && skinReadBack(task->bufNormalsSource, data->normals, vertex_count)) {
+        data->out_normals.resize(vertex_count);
+        s.normals = data->normals.data();
+        s.out_normals = data->out_normals.data();
+    }
+    if (task->bufTangentsOut && skinReadBack(task->bufTangentsSource, data->tangents, vertex_count)) {
+        data->out_tangents.resize(vertex_count);
+        s.tangents = data->tangents.data();
+        s.out_tangents = data->out_tangents.data();
+    }
+    if (task->bufBitangentsOut && skinReadBack(task->bufBitangentsSource, data->bitangents, vertex_count)) {
+        data->out_bitangents.resize(vertex_count);
+        s.bitangents = data->bitangents.data();
+        s.out_bitangents = data->out_bitangents.data();
+    }
+    data->is_valid = true;
+    return data;
+}
+
+static void skinRunTasksCpu() {
+    s_cpu_tasks.clear();
+    s_cpu_jobs.clear();
     for (int i = 0; i < scheduled_task_count; ++i) {
-        auto t = *skin_tasks[i];
-        if (!t.is_valid) {
+        gpuSkinTask* t = skin_tasks[i];
+        if (!t->is_valid) {
             continue;
         }
+        if (!t->cpu_data) {
+            t->cpu_data = skinCreateCpuData(t);
+        }
+        if (!t->cpu_data->is_valid) {
+            s_compute_tasks.push_back(t);
+            continue;
+        }
+        if (s_blend == GPU_SKIN_BLEND_DUAL_QUAT) {
+            t->cpu_data->dual_quats.resize(t->pose_count);
+            gpuSkinCpuMakeDualQuats(t->pose_transforms, t->pose_count, t->cpu_data->dual_quats.data());
+        }
+        s_cpu_tasks.push_back(t);
+        for (int first = 0; first < t->vertex_count; first += SKIN_CPU_JOB_VERTEX_COUNT) {
+            s_cpu_jobs.push_back(SkinCpuJob{ t, first, std::min(SKIN_CPU_JOB_VERTEX_COUNT, t->vertex_count - first) });
+        }
+    }
+
+    const bool dual_quat = s_blend == GPU_SKIN_BLEND_DUAL_QUAT;
+    s_cpu_pool->run((int)s_cpu_jobs.size(), [dual_quat](int job_idx) {
+        const SkinCpuJob& job = s_cpu_jobs[job_idx];
+        const gpuSkinCpuData* data = job.task->cpu_data;
+        if (dual_quat) {
+            gpuSkinCpuDualQuat(data->dual_quats.data(), data->streams, job.first, job.count);
+        } else {
+            gpuSkinCpuLinear(job.task->pose_transforms, data->streams, job.first, job.count);
+        }
+    });
+
+    // Uploads stay on the thread that owns the context
+    for (auto t : s_cpu_tasks) {
+        const gpuSkinCpuData* data = t->cpu_data;
+        const size_t size = t->vertex_count * sizeof(gfxm::vec3);
+        t->bufVerticesOut->setArraySubData(data->out_positions.data(), size, 0);
+        if (data->streams.out_normals) {
+            t->bufNormalsOut->setArraySubData(data->out_normals.data(), size, 0);
+        }
+        if (data->streams.out_tangents) {
+            t->bufTangentsOut->setArraySubData(data->out_tangents.data(), size, 0);
+        }
+        if (data->streams.out_bitangents) {
+            t->bufBitangentsOut->setArraySubData(data->out_bitangents.data(), size, 0);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static void skinRunTasksCompute() {
+    glBindVertexArray(0);
+    glUseProgram(s_prog_skinning);
+
+    for (int i = 0; i < s_compute_tasks.size(); ++i) {
+        const gpuSkinTask& t = *s_compute_tasks[i];
         updateSkinVertexDataComputeSingle(
             t.pose_transforms, t.pose_count,
             t.bufVerticesSource, t.bufNormalsSource,
@@ -267,8 +415,6 @@ void gpuRunSkinTasks() {
             t.vertex_count
         );
     }
-    skin_task_run_count = scheduled_task_count;
-    scheduled_task_count = 0;
 
     glUseProgram(0);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
@@ -283,10 +429,65 @@ void gpuRunSkinTasks() {
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, 0);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, 0);
 }
+
+void gpuRunSkinTasks() {
+    s_compute_tasks.clear();
+    if (s_backend == GPU_SKIN_BACKEND_CPU) {
+        skinRunTasksCpu();
+    } else {
+        for (int i = 0; i < scheduled_task_count; ++i) {
+            if (skin_tasks[i]->is_valid) {
+                s_compute_tasks.push_back(skin_tasks[i]);
+            }
+        }
+    }
+    if (!s_compute_tasks.empty()) {
+        skinRunTasksCompute();
+    }
+    skin_task_run_count = scheduled_task_count;
+    scheduled_task_count = 0;
+}
 int gpuGetSkinTaskExecCount() {
     return skin_task_run_count;
 }
 
+void gpuSetSkinningBackend(GPU_SKIN_BACKEND backend, GPU_SKIN_BLEND blend, int thread_count) {
+    s_backend = backend;
+    s_blend = backend == GPU_SKIN_BACKEND_CPU ? blend : GPU_SKIN_BLEND_LINEAR;
+    if (backend == GPU_SKIN_BACKEND_CPU) {
+        if (thread_count <= 0) {
+            thread_count = std::max(1, (int)std::thread::hardware_concurrency());
+        }
+        if (!s_cpu_pool) {
+            s_cpu_pool.reset(new ThreadPool(thread_count));
+        } else if (s_cpu_pool->getThreadCount() != thread_count) {
+            s_cpu_pool->setThreadCount(thread_count);
+        }
+        LOG("Skinning on the cpu, " << (blend == GPU_SKIN_BLEND_DUAL_QUAT ? "dual quaternion" : "linear") << " blending, "
+            << thread_count << " threads" << (gpuSkinCpuHasAvx2() ? ", avx2" : ", sse"));
+    } else {
+        // Cpu side copies are not needed anymore
+        for (auto t : skin_tasks) {
+            delete t->cpu_data;
+            t->cpu_data = nullptr;
+        }
+        s_cpu_pool.reset();
+        LOG("Skinning on the gpu");
+    }
+}
+GPU_SKIN_BACKEND gpuGetSkinningBackend() {
+    return s_backend;
+}
+GPU_SKIN_BLEND gpuGetSkinningBlend() {
+    return s_blend;
+}
+const gfxm::vec3* gpuGetSkinTaskCpuPositions(const gpuSkinTask* task) {
+    if (s_backend != GPU_SKIN_BACKEND_CPU || !task->cpu_data || !task->cpu_data->is_valid) {
+        return nullptr;
+    }
+    return task->cpu_data->out_positions.data();
+}
+
 void gpuUpdateSkinVertexDataCompute(gpuSkinTask* skin_instances, int count) {
     glBindVertexArray(0);
 
@@ -4,6 +4,17 @@
 #include "gpu/gpu_buffer.hpp"
 
 
+struct gpuSkinCpuData;
+
+enum GPU_SKIN_BACKEND {
+    GPU_SKIN_BACKEND_COMPUTE,
+    GPU_SKIN_BACKEND_CPU
+};
+enum GPU_SKIN_BLEND {
+    GPU_SKIN_BLEND_LINEAR,
+    GPU_SKIN_BLEND_DUAL_QUAT // Cpu backend only
+};
+
 struct gpuSkinTask {
     int index = -1;
     int vertex_count = 0;
@@ -20,6 +31,8 @@ struct gpuSkinTask {
     gpuBuffer* bufTangentsOut = nullptr;
     gpuBuffer* bufBitangentsOut = nullptr;
     bool is_valid = false;
+    // Cpu backend only, source streams read back once and the latest results
+    gpuSkinCpuData* cpu_data = nullptr;
 };
 
 void gpuInitSkinning();
@@ -31,4 +44,12 @@ void         gpuScheduleSkinTask(gpuSkinTask*);
 void         gpuRunSkinTasks();
 int          gpuGetSkinTaskExecCount();
 
+// Cpu skinning spreads tasks over thread_count threads, 0 picks the hardware thread count
+// Can be switched at any point between frames
+void             gpuSetSkinningBackend(GPU_SKIN_BACKEND backend, GPU_SKIN_BLEND blend = GPU_SKIN_BLEND_LINEAR, int thread_count = 0);
+GPU_SKIN_BACKEND gpuGetSkinningBackend();
+GPU_SKIN_BLEND   gpuGetSkinningBlend();
+// Skinned positions from the last run on the cpu backend, null otherwise
+const gfxm::vec3* gpuGetSkinTaskCpuPositions(const gpuSkinTask*);
+
 void gpuUpdateSkinVertexDataCompute(gpuSkinTask* skin_instances, int count);
\ No newline at end of file
@@ -0,0 +1,337 @@
+#include "skinning_cpu.hpp"
+
+#include <assert.h>
+
+// SSE2 is always there on x64, avx2 is checked for at runtime
+// and only the functions marked SKIN_CPU_TARGET_AVX2 use it
+#if defined(_M_X64) || defined(__x86_64__)
+#define SKIN_CPU_SSE 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SKIN_CPU_TARGET_AVX2
+#else
+#define SKIN_CPU_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#else
+#define SKIN_CPU_SSE 0
+#endif
+
+
+bool gpuSkinCpuHasAvx2() {
+#if SKIN_CPU_SSE
+    static const bool has_avx2 = []() -> bool {
+#if defined(_MSC_VER)
+        int regs[4];
+        __cpuid(regs, 0);
+        if (regs[0] < 7) {
+            return false;
+        }
+        __cpuid(regs, 1);
+        const bool has_fma = (regs[2] & (1 << 12)) != 0;
+        const bool has_osxsave = (regs[2] & (1 << 27)) != 0;
+        const bool has_avx = (regs[2] & (1 << 28)) != 0;
+        if (!has_fma || !has_osxsave || !has_avx) {
+            return false;
+        }
+        // The os has to save ymm registers too
+        if ((_xgetbv(0) & 6) != 6) {
+            return false;
+        }
+        __cpuidex(regs, 7, 0);
+        return (regs[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    }();
+    return has_avx2;
+#else
+    return false;
+#endif
+}
+
+static inline void skinCheckBones(const gfxm::ivec4& bi) {
+    assert(bi.x >= 0 && bi.y >= 0 && bi.z >= 0 && bi.w >= 0);
+}
+
+void gpuSkinCpuReference(const gfxm::mat4* poses, const gpuSkinCpuStreams& s, int first, int count) {
+    for (int i = first; i < first + count; ++i) {
+        const gfxm::ivec4 bi = s.bone_indices[i];
+        const gfxm::vec4 w = s.bone_weights[i];
+        skinCheckBones(bi);
+        const gfxm::mat4& m0 = poses[bi.x];
+        const gfxm::mat4& m1 = poses[bi.y];
+        const gfxm::mat4& m2 = poses[bi.z];
+        const gfxm::mat4& m3 = poses[bi.w];
+
+        auto skin = [&](const gfxm::vec3& v, float vw) -> gfxm::vec3 {
+            const gfxm::vec4 v4(v, vw);
+            return gfxm::vec3(m0 * v4 * w.x + m1 * v4 * w.y + m2 * v4 * w.z + m3 * v4 * w.w);
+        };
+        s.out_positions[i] = skin(s.positions[i], 1.f);
+        if (s.out_normals) {
+            s.out_normals[i] = skin(s.normals[i], .0f);
+        }
+        if (s.out_tangents) {
+            s.out_tangents[i] = skin(s.tangents[i], .0f);
+        }
+        if (s.out_bitangents) {
+            s.out_bitangents[i] = skin(s.bitangents[i], .0f);
+        }
+    }
+}
+
+#if SKIN_CPU_SSE
+// Output streams are packed vec3, never write the fourth lane
+static inline void skinStoreVec3(gfxm::vec3* out, __m128 v) {
+    _mm_storel_pi((__m64*)out, v);
+    _mm_store_ss(&out->z, _mm_movehl_ps(v, v));
+}
+
+static void skinLinearSse(const gfxm::mat4* poses, const gpuSkinCpuStreams& s, int first, int count) {
+    for (int i = first; i < first + count; ++i) {
+        const gfxm::ivec4 bi = s.bone_indices[i];
+        const gfxm::vec4 w = s.bone_weights[i];
+        skinCheckBones(bi);
+        const float* m0 = (const float*)&poses[bi.x];
+        const float* m1 = (const float*)&poses[bi.y];
+        const float* m2 = (const float*)&poses[bi.z];
+        const float* m3 = (const float*)&poses[bi.w];
+        const __m128 w0 = _mm_set1_ps(w.x);
+        const __m128 w1 = _mm_set1_ps(w.y);
+        const __m128 w2 = _mm_set1_ps(w.z);
+        const __m128 w3 = _mm_set1_ps(w.w);
+
+        __m128 c[4];
+        for (int col = 0; col < 4; ++col) {
+            c[col] = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m0 + col * 4), w0), _mm_mul_ps(_mm_loadu_ps(m1 + col * 4), w1)),
+                _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m2 + col * 4), w2), _mm_mul_ps(_mm_loadu_ps(m3 + col * 4), w3))
+            );
+        }
+        auto rotate = [&c](const gfxm::vec3& v) -> __m128 {
+            return _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(c[0], _mm_set1_ps(v.x)), _mm_mul_ps(c[1], _mm_set1_ps(v.y))),
+                _mm_mul_ps(c[2], _mm_set1_ps(v.z))
+            );
+        };
+
+        skinStoreVec3(&s.out_positions[i], _mm_add_ps(rotate(s.positions[i]), c[3]));
+        if (s.out_normals) {
+            skinStoreVec3(&s.out_normals[i], rotate(s.normals[i]));
+        }
+        if (s.out_tangents) {
+            skinStoreVec3(&s.out_tangents[i], rotate(s.tangents[i]));
+        }
+        if (s.out_bitangents) {
+            skinStoreVec3(&s.out_bitangents[i], rotate(s.bitangents[i]));
+        }
+    }
+}
+
+// Two matrix columns per register, one blended matrix is two registers
+SKIN_CPU_TARGET_AVX2
+static inline __m128 skinTransformAvx2(__m256 c01, __m256 c23, const gfxm::vec3& v, float vw) {
+    // Built from two broadcasts, an eight float set goes through the stack
+    const __m256 xy = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(v.x)), _mm_set1_ps(v.y), 1);
+    const __m256 zw = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(v.z)), _mm_set1_ps(vw), 1);
+    const __m256 r = _mm256_fmadd_ps(c23, zw, _mm256_mul_ps(c01, xy));
+    return _mm_add_ps(_mm256_castps256_ps128(r), _mm256_extractf128_ps(r, 1));
+}
+
+SKIN_CPU_TARGET_AVX2
+static void skinLinearAvx2(const gfxm::mat4* poses, const gpuSkinCpuStreams& s, int first, int count) {
+    for (int i = first; i < first + count; ++i) {
+        const gfxm::ivec4 bi = s.bone_indices[i];
+        const gfxm::vec4 w = s.bone_weights[i];
+        skinCheckBones(bi);
+        const float* m0 = (const float*)&poses[bi.x];
+        const float* m1 = (const float*)&poses[bi.y];
+        const float* m2 = (const float*)&poses[bi.z];
+        const float* m3 = (const float*)&poses[bi.w];
+        const __m256 w0 = _mm256_set1_ps(w.x);
+        const __m256 w1 = _mm256_set1_ps(w.y);
+        const __m256 w2 = _mm256_set1_ps(w.z);
+        const __m256 w3 = _mm256_set1_ps(w.w);
+
+        __m256 c01 = _mm256_mul_ps(_mm256_loadu_ps(m0), w0);
+        __m256 c23 = _mm256_mul_ps(_mm256_loadu_ps(m0 + 8), w0);
+        c01 = _mm256_fmadd_ps(_mm256_loadu_ps(m1), w1, c01);
+        c23 = _mm256_fmadd_ps(_mm256_loadu_ps(m1 + 8), w1, c23);
+        c01 = _mm256_fmadd_ps(_mm256_loadu_ps(m2), w2, c01);
+        c23 = _mm256_fmadd_ps(_mm256_loadu_ps(m2 + 8), w2, c23);
+        c01 = _mm256_fmadd_ps(_mm256_loadu_ps(m3), w3, c01);
+        c23 = _mm256_fmadd_ps(_mm256_loadu_ps(m3 + 8), w3, c23);
+
+        skinStoreVec3(&s.out_positions[i], skinTransformAvx2(c01, c23, s.positions[i], 1.f));
+        if (s.out_normals) {
+            skinStoreVec3(&s.out_normals[i], skinTransformAvx2(c01, c23, s.normals[i], .0f));
+        }
+        if (s.out_tangents) {
+            skinStoreVec3(&s.out_tangents[i], skinTransformAvx2(c01, c23, s.tangents[i], .0f));
+        }
+        if (s.out_bitangents) {
+            skinStoreVec3(&s.out_bitangents[i], skinTransformAvx2(c01, c23, s.bitangents[i], .0f));
+        }
+    }
+}
+#endif
+
+void gpuSkinCpuLinear(const gfxm::mat4* poses, const gpuSkinCpuStreams& s, int first, int count, bool allow_avx2) {
+#if SKIN_CPU_SSE
+    if (allow_avx2 && gpuSkinCpuHasAvx2()) {
+        skinLinearAvx2(poses, s, first, count);
+    } else {
+        skinLinearSse(poses, s, first, count);
+    }
+#else
+    gpuSkinCpuReference(poses, s, first, count);
+#endif
+}
+
+void gpuSkinCpuMakeDualQuats(const gfxm::mat4* poses, int pose_count, gpuSkinDualQuat* out) {
+    for (int i = 0; i < pose_count; ++i) {
+        const gfxm::mat4& m = poses[i];
+        float scale = gfxm::length(gfxm::vec3(m[0]));
+        if (scale < FLT_EPSILON) {
+            scale = 1.f;
+        }
+        gfxm::mat3 rot = gfxm::to_mat3(m);
+        for (int c = 0; c < 3; ++c) {
+            rot[c] = rot[c] / scale;
+        }
+        const gfxm::quat q = gfxm::to_quat(rot);
+        const gfxm::vec3 t = gfxm::vec3(m[3]);
+
+        // dual = .5 * (t, 0) * real
+        out[i].real = q;
+        out[i].dual = gfxm::quat(
+            .5f * (t.x * q.w + t.y * q.z - t.z * q.y),
+            .5f * (-t.x * q.z + t.y * q.w + t.z * q.x),
+            .5f * (t.x * q.y - t.y * q.x + t.z * q.w),
+            -.5f * (t.x * q.x + t.y * q.y + t.z * q.z)
+        );
+        out[i].scale = scale;
+    }
+}
+
+void gpuSkinCpuDualQuat(const gpuSkinDualQuat* dual_quats, const gpuSkinCpuStreams& s, int first, int count) {
+    for (int i = first; i < first + count; ++i) {
+        const gfxm::ivec4 bi = s.bone_indices[i];
+        const gfxm::vec4 w = s.bone_weights[i];
+        skinCheckBones(bi);
+        const gpuSkinDualQuat* dq[4] = { &dual_quats[bi.x], &dual_quats[bi.y], &dual_quats[bi.z], &dual_quats[bi.w] };
+        const float weights[4] = { w.x, w.y, w.z, w.w };
+
+        // Flip quaternions that are in the other hemisphere from the first one, or the blend takes the long way around
+        alignas(16) float real[4];
+        alignas(16) float dual[4];
+        const float scale = dq[0]->scale * w.x + dq[1]->scale * w.y + dq[2]->scale * w.z + dq[3]->scale * w.w;
+#if SKIN_CPU_SSE
+        {
+            const __m128 sign_mask = _mm_set1_ps(-.0f);
+            const __m128 pivot = _mm_loadu_ps(&dq[0]->real.x);
+            __m128 real4 = _mm_setzero_ps();
+            __m128 dual4 = _mm_setzero_ps();
+            for (int k = 0; k < 4; ++k) {
+                const __m128 r = _mm_loadu_ps(&dq[k]->real.x);
+                const __m128 d = _mm_loadu_ps(&dq[k]->dual.x);
+                // Dot product in every lane
+                __m128 dot = _mm_mul_ps(pivot, r);
+                dot = _mm_add_ps(dot, _mm_shuffle_ps(dot, dot, _MM_SHUFFLE(2, 3, 0, 1)));
+                dot = _mm_add_ps(dot, _mm_shuffle_ps(dot, dot, _MM_SHUFFLE(1, 0, 3, 2)));
+                const __m128 wk = _mm_xor_ps(_mm_set1_ps(weights[k]), _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), sign_mask));
+                real4 = _mm_add_ps(real4, _mm_mul_ps(r, wk));
+                dual4 = _mm_add_ps(dual4, _mm_mul_ps(d, wk));
+            }
+            __m128 len = _mm_mul_ps(real4, real4);
+            len = _mm_add_ps(len, _mm_shuffle_ps(len, len, _MM_SHUFFLE(2, 3, 0, 1)));
+            len = _mm_add_ps(len, _mm_shuffle_ps(len, len, _MM_SHUFFLE(1, 0, 3, 2)));
+            const __m128 inv_len = _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(len));
+            _mm_store_ps(real, _mm_mul_ps(real4, inv_len));
+            _mm_store_ps(dual, _mm_mul_ps(dual4, inv_len));
+        }
+#else
+        {
+            const gfxm::quat& pivot = dq[0]->real;
+            for (int j = 0; j < 4; ++j) {
+                real[j] = .0f;
+                dual[j] = .0f;
+            }
+            for (int k = 0; k < 4; ++k) {
+                const gfxm::quat& r = dq[k]->real;
+                const gfxm::quat& d = dq[k]->dual;
+                float wk = weights[k];
+                if (pivot.x * r.x + pivot.y * r.y + pivot.z * r.z + pivot.w * r.w < .0f) {
+                    wk = -wk;
+                }
+                real[0] += r.x * wk; real[1] += r.y * wk; real[2] += r.z * wk; real[3] += r.w * wk;
+                dual[0] += d.x * wk; dual[1] += d.y * wk; dual[2] += d.z * wk; dual[3] += d.w * wk;
+            }
+            const float inv_len = 1.f / sqrtf(real[0] * real[0] + real[1] * real[1] + real[2] * real[2] + real[3] * real[3]);
+            for (int j = 0; j < 4; ++j) {
+                real[j] *= inv_len;
+                dual[j] *= inv_len;
+            }
+        }
+#endif
+        const float x = real[0], y = real[1], z = real[2], qw = real[3];
+        const float dx = dual[0], dy = dual[1], dz = dual[2], dw = dual[3];
+
+        // Back to a matrix, then the same transform as linear blending
+        const float m00 = (1.f - 2.f * (y * y + z * z)) * scale;
+        const float m01 = 2.f * (x * y + qw * z) * scale;
+        const float m02 = 2.f * (x * z - qw * y) * scale;
+        const float m10 = 2.f * (x * y - qw * z) * scale;
+        const float m11 = (1.f - 2.f * (x * x + z * z)) * scale;
+        const float m12 = 2.f * (y * z + qw * x) * scale;
+        const float m20 = 2.f * (x * z + qw * y) * scale;
+        const float m21 = 2.f * (y * z - qw * x) * scale;
+        const float m22 = (1.f - 2.f * (x * x + y * y)) * scale;
+        // 2 * (qw * d.xyz - dw * q.xyz + cross(q.xyz, d.xyz))
+        const float tx = 2.f * (qw * dx - dw * x + (y * dz - z * dy));
+        const float ty = 2.f * (qw * dy - dw * y + (z * dx - x * dz));
+        const float tz = 2.f * (qw * dz - dw * z + (x * dy - y * dx));
+#if SKIN_CPU_SSE
+        const __m128 c[4] = {
+            _mm_setr_ps(m00, m01, m02, .0f), _mm_setr_ps(m10, m11, m12, .0f),
+            _mm_setr_ps(m20, m21, m22, .0f), _mm_setr_ps(tx, ty, tz, .0f)
+        };
+        auto rotate = [&c](const gfxm::vec3& v) -> __m128 {
+            return _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(c[0], _mm_set1_ps(v.x)), _mm_mul_ps(c[1], _mm_set1_ps(v.y))),
+                _mm_mul_ps(c[2], _mm_set1_ps(v.z))
+            );
+        };
+        skinStoreVec3(&s.out_positions[i], _mm_add_ps(rotate(s.positions[i]), c[3]));
+        if (s.out_normals) {
+            skinStoreVec3(&s.out_normals[i], rotate(s.normals[i]));
+        }
+        if (s.out_tangents) {
+            skinStoreVec3(&s.out_tangents[i], rotate(s.tangents[i]));
+        }
+        if (s.out_bitangents) {
+            skinStoreVec3(&s.out_bitangents[i], rotate(s.bitangents[i]));
+        }
+#else
+        auto rotate = [&](const gfxm::vec3& v) -> gfxm::vec3 {
+            return gfxm::vec3(
+                m00 * v.x + m10 * v.y + m20 * v.z,
+                m01 * v.x + m11 * v.y + m21 * v.z,
+                m02 * v.x + m12 * v.y + m22 * v.z
+            );
+        };
+        s.out_positions[i] = rotate(s.positions[i]) + gfxm::vec3(tx, ty, tz);
+        if (s.out_normals) {
+            s.out_normals[i] = rotate(s.normals[i]);
+        }
+        if (s.out_tangents) {
+            s.out_tangents[i] = rotate(s.tangents[i]);
+        }
+        if (s.out_bitangents) {
+            s.out_bitangents[i] = rotate(s.bitangents[i]);
+        }
+#endif
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "math/gfxm.hpp"
+
+
+// Cpu skinning kernels, no gl context needed
+// Same inputs as the skinning compute shader: packed vec3 streams, BoneIndex4 as ivec4, BoneWeight4 as vec4
+// Normal, tangent and bitangent streams are optional, leave both the source and the output null to skip one
+// Kernels work on the [first, first + count) vertex range so one mesh can be split between threads
+
+struct gpuSkinCpuStreams {
+    int vertex_count = 0;
+    const gfxm::vec3* positions = nullptr;
+    const gfxm::vec3* normals = nullptr;
+    const gfxm::vec3* tangents = nullptr;
+    const gfxm::vec3* bitangents = nullptr;
+    const gfxm::ivec4* bone_indices = nullptr;
+    const gfxm::vec4* bone_weights = nullptr;
+    gfxm::vec3* out_positions = nullptr;
+    gfxm::vec3* out_normals = nullptr;
+    gfxm::vec3* out_tangents = nullptr;
+    gfxm::vec3* out_bitangents = nullptr;
+};
+
+// A pose matrix as a unit dual quaternion plus a uniform scale
+// Poses with non uniform scale lose the non uniform part
+struct gpuSkinDualQuat {
+    gfxm::quat real;
+    gfxm::quat dual;
+    float scale;
+};
+
+bool gpuSkinCpuHasAvx2();
+
+// Straight port of the compute shader, every bone matrix applied to every attribute
+void gpuSkinCpuReference(const gfxm::mat4* poses, const gpuSkinCpuStreams& s, int first, int count);
+// Blends the four bone matrices first, then transforms once. Uses avx2 when the cpu has it
+void gpuSkinCpuLinear(const gfxm::mat4* poses, const gpuSkinCpuStreams& s, int first, int count, bool allow_avx2 = true);
+
+void gpuSkinCpuMakeDualQuats(const gfxm::mat4* poses, int pose_count, gpuSkinDualQuat* out);
+// Dual quaternion blending, keeps volume around twisting joints where linear blending collapses
+void gpuSkinCpuDualQuat(const gpuSkinDualQuat* dual_quats, const gpuSkinCpuStreams& s, int first, int count);
@@ -70,7 +70,9 @@ void _guiInitShaders() {
             uniform mat4 matModel;
         
             void main(){
-                vec2 uv_ = texelFetch(texTextUVLookupTable, ivec2(inTextUVLookup, 0), 0).xy;
+                // FONT_LUT_WIDTH texels per row
+                int lut_index = int(inTextUVLookup);
+                vec2 uv_ = texelFetch(texTextUVLookupTable, ivec2(lut_index % 1024, lut_index / 1024), 0).xy;
                 uv_frag = uv_;
                 col_frag = inColorRGBA;        
 
@@ -121,7 +123,9 @@ void _guiInitShaders() {
             uniform mat4 matModel;
         
             void main(){
-                vec2 uv_ = texelFetch(texTextUVLookupTable, ivec2(inTextUVLookup, 0), 0).xy;
+                // FONT_LUT_WIDTH texels per row
+                int lut_index = int(inTextUVLookup);
+                vec2 uv_ = texelFetch(texTextUVLookupTable, ivec2(lut_index % 1024, lut_index / 1024), 0).xy;
                 uv_frag = uv_;
                 col_frag = inColorRGBA;        
 
@@ -13,7 +13,7 @@ Log* Log::GetInstance() {
     return &fl;
 }
 void Log::Write(const std::ostringstream& strm, LOG_TYPE type) {
-    GetInstance()->_write(strm.str(), type);
+    GetInstance()->_write(strm.view(), type);
 }
 void Log::Write(const std::string& str, LOG_TYPE type) {
     GetInstance()->_write(str, type);
@@ -21,6 +21,9 @@ void Log::Write(const std::string& str, LOG_TYPE type) {
 void Log::Flush() {
     GetInstance()->_flush();
 }
+void Log::SetFullPolicy(LOG_FULL_POLICY policy) {
+    GetInstance()->ring.setFullPolicy(policy);
+}
 void Log::AddConsumer(LogConsumer* c) {
     GetInstance()->_addConsumer(c);
 }
@@ -34,46 +37,49 @@ Log::Log()
     _addConsumer(file_consumer.get());
 
     thread_writer = std::thread([this](){
+        ring.setConsumerThread(std::this_thread::get_id());
+        // Reused between drains, the strings keep their capacity
+        std::vector<LogEntry> batch;
         do {
-            std::queue<LogEntry> lines_copy;
-            {
-                std::lock_guard<std::mutex> lock(sync);
-                if(!working && lines.empty())
-                    break;
-                
-                lines_copy = lines;
-                while(!lines.empty()) {
-                    lines.pop();
-                }
-            }
+            const bool stopping = !working;
+            const int count = ring.drain(batch);
+            const uint64_t dropped = ring.takeDroppedCount();
 
-            {
+            if(count || dropped) {
                 std::lock_guard<std::mutex> lock(consumer_sync);
-                bool anything_written = false;
-                while(!lines_copy.empty()) {
+                if(dropped) {
+                    LogEntry e{
+                        LOG_WARN,
+                        time(0),
+                        GetCurrentThreadId(),
+                        "Log: " + std::to_string(dropped) + " lines dropped, writer thread fell behind"
+                    };
                     for (int i = 0; i < consumers.size(); ++i) {
-                        consumers[i]->consume(lines_copy.front());
+                        consumers[i]->consume(e);
                     }
-                    lines_copy.pop();
-                    anything_written = true;
                 }
-                if(anything_written) {
+                for (int j = 0; j < count; ++j) {
                     for (int i = 0; i < consumers.size(); ++i) {
-                        consumers[i]->flush();
+                        consumers[i]->consume(batch[j]);
                     }
                 }
+                for (int i = 0; i < consumers.size(); ++i) {
+                    consumers[i]->flush();
+                }
             }
+            consumed_pos.store(ring.getReadPosition(), std::memory_order_release);
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if(stopping && count == 0)
+                break;
+            if(count == 0) {
+                ring.waitForLines(LOG_DRAIN_INTERVAL_MS);
+            }
         } while(1);
-
-        for (int i = 0; i < consumers.size(); ++i) {
-            consumers[i]->flush();
-        }
     });
 }
 Log::~Log() {
     working = false;
+    ring.wakeConsumer();
     if(thread_writer.joinable()) {
         thread_writer.join();
     }
@@ -83,16 +89,18 @@ void Log::_addConsumer(LogConsumer* c) {
     std::lock_guard<std::mutex> lock(consumer_sync);
     consumers.push_back(c);
 }
-void Log::_write(const std::string& str, LOG_TYPE type) {
-    std::lock_guard<std::mutex> lock(sync);
-    lines.push(LogEntry{
-        type,
-        time(0),
-        GetCurrentThreadId(),
-        str
-    });
+void Log::_write(std::string_view str, LOG_TYPE type) {
+    ring.push(type, GetCurrentThreadId(), str);
 }
 void Log::_flush() {
-    // TODO: lol
+    if(std::this_thread::get_id() == thread_writer.get_id()) {
+        // A consumer logging, would wait on itself
+        return;
+    }
+    const uint64_t target = ring.getWritePosition();
+    while(consumed_pos.load(std::memory_order_acquire) < target && working) {
+        ring.wakeConsumer();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
 }
 
@@ -2,18 +2,24 @@
 #define LOG_HPP
 
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <sstream>
 #include <thread>
 #include <queue>
+#include <atomic>
 #include <mutex>
 #include <fstream>
 #include <ctime>
 
 #include "log_consumer.hpp"
+#include "log_ring.hpp"
 #include "math/gfxm.hpp"
 //#include <util/filesystem/filesystem.hpp>
 
+// Longest the writer thread sleeps with nothing to do, a full ring wakes it earlier
+constexpr int LOG_DRAIN_INTERVAL_MS = 10;
+
 class Log {
 private:
     std::unique_ptr<LogConsumer> stdout_consumer;
@@ -24,19 +30,22 @@ public:
     static void AddConsumer(LogConsumer* c);
     static void Write(const std::ostringstream& strm, LOG_TYPE type = LOG_INFO);
     static void Write(const std::string& str, LOG_TYPE type = LOG_INFO);
+    // Blocks until every line written so far has reached the consumers
     static void Flush();
+    // What Write() does when the writer thread falls LOG_RING_SIZE lines behind
+    static void SetFullPolicy(LOG_FULL_POLICY policy);
 private:
     Log();
     ~Log();
 
     void _addConsumer(LogConsumer* c);
-    void _write(const std::string& str, LOG_TYPE type);
+    void _write(std::string_view str, LOG_TYPE type);
     void _flush();
 
-    bool working;
-    std::mutex sync;
+    std::atomic<bool> working;
     std::mutex consumer_sync;
-    std::queue<LogEntry> lines;
+    LogRing ring;
+    std::atomic<uint64_t> consumed_pos = 0;
     std::thread thread_writer;
     std::vector<LogConsumer*> consumers;
 };
@@ -0,0 +1,123 @@
+#include "log_ring.hpp"
+
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+
+LogRing::LogRing()
+: slots(new Slot[LOG_RING_SIZE]) {
+    for (int i = 0; i < LOG_RING_SIZE; ++i) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+        slots[i].overflow = nullptr;
+    }
+}
+LogRing::~LogRing() {
+    for (int i = 0; i < LOG_RING_SIZE; ++i) {
+        delete slots[i].overflow;
+    }
+}
+
+bool LogRing::push(LOG_TYPE type, unsigned long thread_id, std::string_view line) {
+    uint64_t pos = write_pos.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+    int full_spins = 0;
+    std::chrono::steady_clock::time_point full_deadline;
+    while (true) {
+        slot = &slots[pos & (LOG_RING_SIZE - 1)];
+        const uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+        const int64_t diff = (int64_t)(seq - pos);
+        if (diff == 0) {
+            if (write_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Full, the slot still holds a line from the previous lap
+            if (full_policy.load(std::memory_order_relaxed) == LOG_FULL_DROP
+                || consumer_thread.load(std::memory_order_relaxed) == std::this_thread::get_id()
+            ) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            wakeConsumer();
+            if (full_spins == 0) {
+                full_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(LOG_FULL_BLOCK_TIMEOUT_MS);
+            }
+            if (full_spins < LOG_FULL_BLOCK_SPINS) {
+                std::this_thread::yield();
+            } else if (std::chrono::steady_clock::now() < full_deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            } else {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            ++full_spins;
+            pos = write_pos.load(std::memory_order_relaxed);
+        } else {
+            pos = write_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->type = type;
+    slot->t = time(0);
+    slot->thread_id = thread_id;
+    if (line.size() <= LOG_SLOT_TEXT_SIZE) {
+        slot->length = (uint32_t)line.size();
+        memcpy(slot->text, line.data(), line.size());
+    } else {
+        slot->length = 0;
+        slot->overflow = new std::string(line);
+    }
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    // Don't let it fill up between the consumer's timed wake-ups
+    if (((pos + 1) & (LOG_RING_SIZE / 2 - 1)) == 0) {
+        wakeConsumer();
+    }
+    return true;
+}
+
+int LogRing::drain(std::vector<LogEntry>& batch) {
+    uint64_t pos = read_pos.load(std::memory_order_relaxed);
+    int count = 0;
+    while (true) {
+        Slot* slot = &slots[pos & (LOG_RING_SIZE - 1)];
+        if (slot->sequence.load(std::memory_order_acquire) != pos + 1) {
+            break;
+        }
+        if (count == batch.size()) {
+            batch.emplace_back();
+        }
+        LogEntry& e = batch[count++];
+        e.type = slot->type;
+        e.t = slot->t;
+        e.thread_id = slot->thread_id;
+        if (slot->overflow) {
+            e.line.swap(*slot->overflow);
+            delete slot->overflow;
+            slot->overflow = nullptr;
+        } else {
+            e.line.assign(slot->text, slot->length);
+        }
+        slot->sequence.store(pos + LOG_RING_SIZE, std::memory_order_release);
+        ++pos;
+    }
+    read_pos.store(pos, std::memory_order_release);
+    return count;
+}
+
+void LogRing::waitForLines(int timeout_ms) {
+    std::unique_lock<std::mutex> lock(wake_sync);
+    wake.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]() {
+        return wake_requested;
+    });
+    wake_requested = false;
+}
+
+void LogRing::wakeConsumer() {
+    {
+        std::lock_guard<std::mutex> lock(wake_sync);
+        wake_requested = true;
+    }
+    wake.notify_one();
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "log_entry.hpp"
+
+
+constexpr int LOG_RING_SIZE = 4096; // power of two
+constexpr int LOG_SLOT_TEXT_SIZE = 224;
+// Blocked writers yield this many times before sleeping between retries
+constexpr int LOG_FULL_BLOCK_SPINS = 64;
+// Blocked writers give up and drop the line after this long, a stuck consumer can't hang the process
+constexpr int LOG_FULL_BLOCK_TIMEOUT_MS = 1000;
+
+enum LOG_FULL_POLICY {
+    LOG_FULL_BLOCK,     // writers wait for the consumer up to LOG_FULL_BLOCK_TIMEOUT_MS, the consumer thread itself never waits
+    LOG_FULL_DROP       // writers drop the line and count it
+};
+
+// Bounded multi-producer single-consumer queue of log lines.
+// A writer claims a slot with one compare-exchange and copies the line into it, lines longer than
+// LOG_SLOT_TEXT_SIZE go to the heap. No locks on the write path unless the ring is full and the policy is to block
+class LogRing {
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> sequence;
+        LOG_TYPE type;
+        uint32_t length;
+        time_t t;
+        unsigned long thread_id;
+        std::string* overflow;
+        char text[LOG_SLOT_TEXT_SIZE];
+    };
+    std::unique_ptr<Slot[]> slots;
+    alignas(64) std::atomic<uint64_t> write_pos = 0;
+    alignas(64) std::atomic<uint64_t> read_pos = 0;
+    std::atomic<uint64_t> dropped = 0;
+    std::atomic<int> full_policy = LOG_FULL_BLOCK;
+    // A line logged from the consumer (or a sink it calls) into a full ring would wait on itself
+    std::atomic<std::thread::id> consumer_thread;
+
+    std::mutex wake_sync;
+    std::condition_variable wake;
+    bool wake_requested = false;
+public:
+    LogRing();
+    ~LogRing();
+    LogRing(const LogRing&) = delete;
+    LogRing& operator=(const LogRing&) = delete;
+
+    void setFullPolicy(LOG_FULL_POLICY policy) { full_policy = policy; }
+    LOG_FULL_POLICY getFullPolicy() const { return (LOG_FULL_POLICY)full_policy.load(); }
+
+    // Call from the consumer thread before it starts draining
+    void setConsumerThread(std::thread::id id) { consumer_thread.store(id, std::memory_order_relaxed); }
+
+    // Any thread. False if the ring was full and the line dropped
+    bool push(LOG_TYPE type, unsigned long thread_id, std::string_view line);
+
+    // Consumer thread. Takes every line that is ready, in order, into batch[0..n) and returns n.
+    // Entries already in batch are reused, their strings keep their capacity, long lines are swapped in
+    int drain(std::vector<LogEntry>& batch);
+    // Consumer thread. Sleeps until timeout_ms runs out or a writer calls wakeConsumer()
+    void waitForLines(int timeout_ms);
+    void wakeConsumer();
+
+    uint64_t takeDroppedCount() { return dropped.exchange(0); }
+    // Lines claimed by writers so far, and lines taken by the consumer so far
+    uint64_t getWritePosition() const { return write_pos.load(std::memory_order_acquire); }
+    uint64_t getReadPosition() const { return read_pos.load(std::memory_order_acquire); }
+};
@@ -61,6 +61,7 @@ bool m3dpProject::load(const std::string& project_path) {
     import_model = json.value("import_model", true);
     import_materials = json.value("import_materials", true);
     import_animations = json.value("import_animations", true);
+    compress_animations = json.value("compress_animations", false);
     external_skeleton = json.value("external_skeleton", false);
 
     return true;
@@ -78,6 +79,7 @@ void m3dpProject::save(const std::string& project_path) {
     json["import_model"] = import_model;
     json["import_materials"] = import_materials;
     json["import_animations"] = import_animations;
+    json["compress_animations"] = compress_animations;
     json["external_skeleton"] = external_skeleton;
 
     std::ofstream f(project_path, std::ios::binary | std::ios::trunc);
@@ -240,6 +242,16 @@ void m3dpProject::import(m3dData& m3d) {
     // animations
     for (int i = 0; i < model_source->animCount(); ++i) {
         auto anim = model_source->getAnimation(i);
+        // The importer's clip is shared, it's compressed the first time the project is imported
+        if (compress_animations && !anim->clip->isCompressed()) {
+            animCompressStats stats;
+            if (anim->clip->compress(animCompressSettings(), &stats)) {
+                LOG_DBG("m3dpProject: compressed " << anim->name << " " << stats.raw_bytes << " -> " << stats.compressed_bytes << " bytes, max error t "
+                    << stats.max_translation_error << ", r " << stats.max_rotation_error << ", s " << stats.max_scale_error);
+            } else {
+                LOG_WARN("m3dpProject: failed to compress " << anim->name << ", keeping the curves");
+            }
+        }
         m3d.animations.push_back(anim->clip);
     }
 }
@@ -47,6 +47,8 @@ public:
     bool import_model = true;
     bool import_materials = true;
     bool import_animations = true;
+    // Clips are written as animCompressedClip, their key curves are dropped
+    bool compress_animations = false;
     bool external_skeleton = false;
 
     std::unique_ptr<ModelImporter> model_source;
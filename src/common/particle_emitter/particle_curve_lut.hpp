@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string.h>
+#include <vector>
+#include "math/gfxm.hpp"
+#include "animation/curve.hpp"
+#include "particle_data.hpp"
+
+
+// Emitter curves are only ever sampled over [0, 1] (normalized lifetime, emitter cursor, a random number),
+// so they are baked into PTCL_CURVE_LUT_SIZE even steps and read with one lerp instead of a binary search.
+// Curves are piecewise linear, a step that has a keyframe inside it is off by at most
+// slope * (1 / PTCL_CURVE_LUT_SIZE) / 2 of the exact value
+constexpr int PTCL_CURVE_LUT_SIZE = 256;
+
+template<typename T>
+class ptclCurveLut {
+    T values[PTCL_CURVE_LUT_SIZE + 1];
+    std::vector<keyframe<T>> baked_keyframes;
+    bool is_baked = false;
+public:
+    // Rebakes only if the keyframes differ from the ones the table was made from, returns true if it did
+    bool update(const curve<T>& c) {
+        const auto& keyframes = c.get_keyframes();
+        if (is_baked
+            && keyframes.size() == baked_keyframes.size()
+            && (keyframes.empty() || memcmp(keyframes.data(), baked_keyframes.data(), keyframes.size() * sizeof(keyframes[0])) == 0)
+        ) {
+            return false;
+        }
+        for (int i = 0; i <= PTCL_CURVE_LUT_SIZE; ++i) {
+            values[i] = c.at(i / (float)PTCL_CURVE_LUT_SIZE);
+        }
+        baked_keyframes = keyframes;
+        is_baked = true;
+        return true;
+    }
+
+    const T* data() const { return values; }
+
+    T at(float t) const {
+        float x = gfxm::_min(gfxm::_max(t * PTCL_CURVE_LUT_SIZE, .0f), (float)PTCL_CURVE_LUT_SIZE);
+        int i = gfxm::_min((int)x, PTCL_CURVE_LUT_SIZE - 1);
+        float f = x - i;
+        return values[i] + (values[i + 1] - values[i]) * f;
+    }
+};
+
+struct ptclEmitterCurveLuts {
+    ptclCurveLut<float>         pt_per_second;
+    ptclCurveLut<gfxm::vec3>    initial_scale;
+    ptclCurveLut<gfxm::vec4>    rgba;
+    ptclCurveLut<float>         scale;
+
+    void update(const ParticleEmitterParams& params) {
+        pt_per_second.update(params.pt_per_second_curve);
+        initial_scale.update(params.initial_scale_curve);
+        rgba.update(params.rgba_curve);
+        scale.update(params.scale_curve);
+    }
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "particle_data.hpp"
+#include "particle_instance_pool.hpp"
 
 
 class ParticleSimulation;
@@ -8,10 +9,14 @@ class ParticleEmitterMaster;
 class ParticleEmitterInstance {
     friend ParticleSimulation;
     friend ParticleEmitterMaster;
+    template<typename> friend class ptclInstancePool;
 
     ParticleEmitterMaster* master = 0;
     ParticleSimulation* simulation = 0;
     bool has_teleported = false;
+    // Where the simulation keeps it
+    PTCL_POOL_LIST pool_list = PTCL_POOL_NONE;
+    int pool_index = -1;
 public:
     ptclParticleData particle_data;
     std::vector<ptclComponent*> component_instances;
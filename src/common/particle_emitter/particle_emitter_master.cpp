@@ -111,8 +111,7 @@ bool ParticleEmitterMaster::load(byte_reader& in) {
         return false;
     }
 
-    std::string str(view.data, view.data + view.size);
-    nlohmann::json json = nlohmann::json::parse(str);
+    nlohmann::json json = nlohmann::json::parse(view.data, view.data + view.size);
 
     return deserializeJson(json);
 }
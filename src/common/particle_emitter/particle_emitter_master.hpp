@@ -6,6 +6,7 @@
 
 #include "resource_manager/loadable.hpp"
 #include "particle_data.hpp"
+#include "particle_curve_lut.hpp"
 #include "shape/particle_emitter_shape.hpp"
 #include "component/particle_emitter_component.hpp"
 #include "renderer/particle_emitter_renderer.hpp"
@@ -29,6 +30,8 @@ private:
     mutable std::mt19937_64 mt_gen;
     mutable std::uniform_real_distribution<float> u01;
 
+    ptclEmitterCurveLuts curve_luts;
+
 public:
     ParticleEmitterParams params;
     std::unique_ptr<IParticleEmitterShape> shape;
@@ -96,6 +99,12 @@ public:
         return u01(mt_gen);
     }
 
+    // params curves are public and edited in place, so the tables are checked against them on every call
+    const ptclEmitterCurveLuts& getCurveLuts() {
+        curve_luts.update(params);
+        return curve_luts;
+    }
+
 
     void setParticlePerSecondCurve(const curve<float>& c) {
         params.pt_per_second_curve = c;
@@ -4,6 +4,7 @@
 
 #include "particle_emitter/particle_emitter_master.hpp"
 #include "particle_emitter/particle_emitter_instance.hpp"
+#include "particle_emitter/particle_kernels.hpp"
 
 static float s_particle_time_scale = 1.0f;
 
@@ -16,11 +17,10 @@ void ptclUpdateEmit(float dt, ParticleEmitterInstance* instance) {
 
     auto master = instance->getMaster();
     const auto params = &master->params;
+    const auto& luts = master->getCurveLuts();
 
     const float     duration = params->duration;
     const bool      looping = params->looping;
-    /* const */auto pt_per_second_curve = params->pt_per_second_curve;
-    /* const */auto initial_scale_curve = params->initial_scale_curve;
     const auto      shape = master->shape.get();
     const float     rnd0 = master->getRandomNumber();
     const float     rnd1 = master->getRandomNumber();
@@ -47,7 +47,7 @@ void ptclUpdateEmit(float dt, ParticleEmitterInstance* instance) {
     }
 
     time_cache += dt;
-    float pt_per_sec = gfxm::_max(.0f, pt_per_second_curve.at(cursor / duration));
+    float pt_per_sec = gfxm::_max(.0f, luts.pt_per_second.at(cursor / duration));
     int nParticlesToEmit = (int)(pt_per_sec * time_cache);
     if (nParticlesToEmit > 0) {
         time_cache = .0f;
@@ -60,6 +60,7 @@ void ptclUpdateEmit(float dt, ParticleEmitterInstance* instance) {
         gfxm::vec3 base_pos_b = world_transform[3];
         world_transform_old = world_transform;
 
+        const gfxm::vec3 initial_scale = luts.initial_scale.at(rnd2);
         for (int i = begin_new; i < end_new; ++i) {
             float mul = ((float)(i - begin_new) / (float)nParticlesToEmit);
             if (has_teleported) {
@@ -72,7 +73,7 @@ void ptclUpdateEmit(float dt, ParticleEmitterInstance* instance) {
             particle_data.particleStates[i].velocity *= .0f;// u01(mt_gen) * 5.0f;
             particle_data.particleStates[i].ang_velocity = gfxm::vec3(0, 0, (1.0f - rnd0 * 2.0f) * 5.0f);
             particle_data.particleRotation[i] = gfxm::angle_axis(gfxm::pi * rnd1 * 2.0f, gfxm::vec3(0, 0, 1));
-            particle_data.particleScale[i] = gfxm::vec4(initial_scale_curve.at(rnd2), particle_data.particleScale[i].w);
+            particle_data.particleScale[i] = gfxm::vec4(initial_scale, particle_data.particleScale[i].w);
         }
         for (auto& r : instance->renderer_instances) {
             r->onParticlesSpawned(&particle_data, begin_new, end_new);
@@ -80,17 +81,14 @@ void ptclUpdateEmit(float dt, ParticleEmitterInstance* instance) {
     }
 }
 
-void ptclUpdate(float dt, ParticleEmitterInstance* instance) {
+void ptclUpdate(float dt, ParticleEmitterInstance* instance, ThreadPool* pool) {
     dt *= s_particle_time_scale * 1.f;
 
     auto master = instance->getMaster();
     const ParticleEmitterParams* params = &master->params;
+    const auto& luts = master->getCurveLuts();
 
-    /*const */auto& scale_curve = params->scale_curve;
-    /*const */auto& rgba_curve = params->rgba_curve;
     float max_lifetime = params->max_lifetime;
-    gfxm::vec3 gravity = params->gravity;
-    float terminal_velocity = params->terminal_velocity;
     PARTICLE_MOVEMENT_MODE move_mode = master->movement_mode;
 
     auto& particle_data = instance->particle_data;
@@ -100,72 +98,32 @@ void ptclUpdate(float dt, ParticleEmitterInstance* instance) {
         c->update(&particle_data, dt);
     }*/
 
+    ptclKernelParams kernel_params;
+    kernel_params.dt = dt;
+    kernel_params.inv_max_lifetime = 1.f / max_lifetime;
+    kernel_params.gravity = params->gravity;
+    kernel_params.terminal_velocity = params->terminal_velocity;
+    kernel_params.scale_lut = &luts.scale;
+    kernel_params.rgba_lut = &luts.rgba;
     if(move_mode == PARTICLE_MOVEMENT_WORLD) {
-        for (int i = 0; i < particle_data.aliveCount(); ++i) {
-            float& lifetime = particle_data.particleScale[i].w;
-
-            float& size = particle_data.particlePositions[i].w;
-            size = scale_curve.at(lifetime / max_lifetime);
-
-            gfxm::vec3 pos = particle_data.particlePositions[i];
-            gfxm::vec3& velocity = particle_data.particleStates[i].velocity;
-            pos += velocity * dt;
-            velocity += gravity * dt;
-        
-            if (master->noise) {
-                static gfxm::vec3 noise_offs;
-                noise_offs.z += .01f * dt;
-                gfxm::vec4 noise;
-                // TODO: Stack gets corrupted
-            
-                master->noise->FillNoiseSet(
-                    &noise[0], pos.x + noise_offs.x, pos.y + noise_offs.y, pos.z + noise_offs.z, 1, 1, 1, 1.0f
-                );
-                noise = (noise * 2.f - gfxm::normalize(noise));
-                //velocity += gfxm::vec3(noise) * dt * 10.f;
-            }
-            gfxm::vec3 velo_N = gfxm::normalize(velocity);
-            float d = gfxm::dot(velocity, velo_N);
-            if (d > terminal_velocity) {
-                velocity *= terminal_velocity / d;
-            }
-
-            particle_data.particlePositions[i] = gfxm::vec4(pos, size);
-            
-            particle_data.particleRotation[i]
-                = gfxm::euler_to_quat(particle_data.particleStates[i].ang_velocity * dt)
-                * particle_data.particleRotation[i];
-
-            particle_data.particleColors[i] = rgba_curve.at(lifetime / max_lifetime);
-        }
+        kernel_params.shape_transform = nullptr;
     } else if(move_mode == PARTICLE_MOVEMENT_SHAPE) {
-        const auto&   world_transform = instance->world_transform;
         master->shape->advanceMovement(dt, &particle_data, params->max_lifetime);
-
-        for (int i = 0; i < particle_data.aliveCount(); ++i) {
-            float& lifetime = particle_data.particleScale[i].w;
-
-            float size = particle_data.particlePositions[i].w;
-            size = scale_curve.at(lifetime / max_lifetime);
-
-            particle_data.particlePositions[i] = world_transform * gfxm::vec4(particle_data.particlePositions[i], 1.f);
-            particle_data.particlePositions[i].w = size;
-
-            particle_data.particleRotation[i]
-                = gfxm::euler_to_quat(particle_data.particleStates[i].ang_velocity * dt)
-                * particle_data.particleRotation[i];
-
-            particle_data.particleColors[i] = rgba_curve.at(lifetime / max_lifetime);
-        }
+        kernel_params.shape_transform = &instance->world_transform;
     } else {
         assert(false);
     }
 
-    if (dt > .0f) {
-        for (int i = 0; i < particle_data.aliveCount(); ++i) {
-            particle_data.particleStates[i].velocity =
-                gfxm::vec3(particle_data.particlePositions[i]) - gfxm::vec3(particle_data.particlePrevPositions[i]);
-        }
+    const ptclKernelStreams streams = ptclMakeKernelStreams(particle_data);
+    const int alive_count = particle_data.aliveCount();
+    if (pool && pool->getThreadCount() > 1 && alive_count >= PTCL_PARALLEL_MIN_COUNT) {
+        const int job_count = (alive_count + PTCL_PARALLEL_JOB_SIZE - 1) / PTCL_PARALLEL_JOB_SIZE;
+        pool->run(job_count, [&kernel_params, &streams, alive_count](int job) {
+            const int first = job * PTCL_PARALLEL_JOB_SIZE;
+            ptclKernelUpdate(kernel_params, streams, first, gfxm::_min(PTCL_PARALLEL_JOB_SIZE, alive_count - first));
+        });
+    } else {
+        ptclKernelUpdate(kernel_params, streams, 0, alive_count);
     }
 
     for (int i = 0; i < particle_data.aliveCount(); ++i) {        
@@ -187,10 +145,11 @@ void ptclUpdate(float dt, ParticleEmitterInstance* instance) {
         r->update(params, &particle_data, dt);
     }
 
+    // Only live particles are read next frame, recycled and spawned ones bring their own
     memcpy(
         &particle_data.particlePrevPositions[0],
         &particle_data.particlePositions[0],
-        particle_data.particlePositions.size() * sizeof(particle_data.particlePositions[0])
+        particle_data.aliveCount() * sizeof(particle_data.particlePositions[0])
     );
 
     instance->cursor += dt;
@@ -2,9 +2,16 @@
 
 #include "particle_emitter_master.hpp"
 #include "particle_emitter_instance.hpp"
+#include "util/thread_pool.hpp"
 
 
+// Emitters with fewer live particles than this are updated on the calling thread
+constexpr int PTCL_PARALLEL_MIN_COUNT = 16384;
+// Particles per job when an emitter is split between threads, a multiple of the kernels' 4 wide groups
+constexpr int PTCL_PARALLEL_JOB_SIZE = 4096;
+
 void ptclSetTimeScale(float scale);
 
 void ptclUpdateEmit(float dt, ParticleEmitterInstance* inst);
-void ptclUpdate(float dt, ParticleEmitterInstance* inst);
+// pool is optional, large emitters split the kernel work between its threads
+void ptclUpdate(float dt, ParticleEmitterInstance* inst, ThreadPool* pool = nullptr);
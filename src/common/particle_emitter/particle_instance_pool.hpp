@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+
+enum PTCL_POOL_LIST : uint8_t {
+    PTCL_POOL_NONE,
+    PTCL_POOL_ACTIVE,
+    PTCL_POOL_PASSIVE,
+    PTCL_POOL_FREE
+};
+
+// Instances of one emitter master in three dense lists
+// Active instances emit, passive ones were released and only run out the particles they have,
+// free ones wait for the next acquire. Moving an instance between lists is O(1) and allocates
+// nothing once the lists have grown to the peak instance count.
+// T needs PTCL_POOL_LIST pool_list, int pool_index and bool isAlive() const, visible to the pool
+template<typename T>
+class ptclInstancePool {
+    std::vector<T*> active;
+    // In release order. Instances of one master share a max lifetime and stop emitting on release,
+    // so they mostly run out of particles in this order too, but per-particle lifetimes
+    // and whatever else keeps isAlive() true can hold a released instance past a later one
+    std::vector<T*> passive;
+    std::vector<T*> free_list;
+public:
+    const std::vector<T*>& getActive() const { return active; }
+    const std::vector<T*>& getPassive() const { return passive; }
+    int freeCount() const { return (int)free_list.size(); }
+
+    // Takes an instance off the free list and makes it active, null when the list is empty
+    T* reuse() {
+        if (free_list.empty()) {
+            return nullptr;
+        }
+        T* inst = free_list.back();
+        free_list.pop_back();
+        add(inst);
+        return inst;
+    }
+    // Adds a newly created instance as active
+    void add(T* inst) {
+        inst->pool_list = PTCL_POOL_ACTIVE;
+        inst->pool_index = (int)active.size();
+        active.push_back(inst);
+    }
+    // Active to passive, false if the instance was not active
+    bool release(T* inst) {
+        if (inst->pool_list != PTCL_POOL_ACTIVE) {
+            return false;
+        }
+        const int i = inst->pool_index;
+        T* last = active.back();
+        active[i] = last;
+        last->pool_index = i;
+        active.pop_back();
+
+        inst->pool_list = PTCL_POOL_PASSIVE;
+        inst->pool_index = -1;
+        passive.push_back(inst);
+        return true;
+    }
+    // Frees every passive instance that has no particles left, live ones stay in release order.
+    // Calls on_retire(T*) for each before it goes on the free list. Returns how many were freed
+    template<typename ON_RETIRE_T>
+    int retire(const ON_RETIRE_T& on_retire) {
+        int kept = 0;
+        for (int i = 0; i < passive.size(); ++i) {
+            T* inst = passive[i];
+            if (inst->isAlive()) {
+                passive[kept++] = inst;
+                continue;
+            }
+            on_retire(inst);
+            inst->pool_list = PTCL_POOL_FREE;
+            free_list.push_back(inst);
+        }
+        const int count = (int)passive.size() - kept;
+        passive.resize(kept);
+        return count;
+    }
+};
@@ -0,0 +1,270 @@
+#include "particle_kernels.hpp"
+
+#include <math.h>
+
+// SSE2 is always there on x64
+#if defined(_M_X64) || defined(__x86_64__)
+#define PTCL_KERNEL_SSE 1
+#include <emmintrin.h>
+#else
+#define PTCL_KERNEL_SSE 0
+#endif
+
+
+ptclKernelStreams ptclMakeKernelStreams(ptclParticleData& data) {
+    ptclKernelStreams s;
+    s.states = data.particleStates.data();
+    s.positions = data.particlePositions.data();
+    s.prev_positions = data.particlePrevPositions.data();
+    s.scale = data.particleScale.data();
+    s.colors = data.particleColors.data();
+    s.rotation = data.particleRotation.data();
+    return s;
+}
+
+// Lut position for a normalized lifetime, shared by the size and color curves
+static inline int ptclLutIndex(float t, float& frac) {
+    float x = gfxm::_min(gfxm::_max(t * PTCL_CURVE_LUT_SIZE, .0f), (float)PTCL_CURVE_LUT_SIZE);
+    int i = gfxm::_min((int)x, PTCL_CURVE_LUT_SIZE - 1);
+    frac = x - i;
+    return i;
+}
+
+#if PTCL_KERNEL_SSE
+
+// Four quaternions, one per lane
+struct ptclQuat4 {
+    __m128 x, y, z, w;
+};
+
+// Same formula as gfxm's quat operator*, without the normalize
+static inline ptclQuat4 ptclQuatMul4(const ptclQuat4& a, const ptclQuat4& b) {
+    ptclQuat4 r;
+    r.x = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(a.w, b.x), _mm_mul_ps(b.w, a.x)),
+        _mm_sub_ps(_mm_mul_ps(a.y, b.z), _mm_mul_ps(b.y, a.z))
+    );
+    r.y = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(a.w, b.y), _mm_mul_ps(b.w, a.y)),
+        _mm_sub_ps(_mm_mul_ps(b.x, a.z), _mm_mul_ps(a.x, b.z))
+    );
+    r.z = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(a.w, b.z), _mm_mul_ps(b.w, a.z)),
+        _mm_sub_ps(_mm_mul_ps(a.x, b.y), _mm_mul_ps(b.x, a.y))
+    );
+    r.w = _mm_sub_ps(
+        _mm_sub_ps(_mm_mul_ps(b.w, a.w), _mm_mul_ps(b.x, a.x)),
+        _mm_add_ps(_mm_mul_ps(b.y, a.y), _mm_mul_ps(b.z, a.z))
+    );
+    return r;
+}
+static inline void ptclQuatNormalize4(ptclQuat4& q) {
+    __m128 len2 = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(q.x, q.x), _mm_mul_ps(q.y, q.y)),
+        _mm_add_ps(_mm_mul_ps(q.z, q.z), _mm_mul_ps(q.w, q.w))
+    );
+    __m128 inv = _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(len2));
+    q.x = _mm_mul_ps(q.x, inv);
+    q.y = _mm_mul_ps(q.y, inv);
+    q.z = _mm_mul_ps(q.z, inv);
+    q.w = _mm_mul_ps(q.w, inv);
+}
+
+// Cephes sinf/cosf: reduce by pi/2 in three parts, minimax polynomials on [-pi/4, pi/4],
+// then pick and flip by quadrant. Within a couple of ulp of sinf/cosf for |x| < 8192
+static inline void ptclSinCos4(__m128 x, __m128& out_sin, __m128& out_cos) {
+    const __m128 two_over_pi = _mm_set1_ps(0.63661977236758134f);
+    __m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, two_over_pi));
+    __m128 qf = _mm_cvtepi32_ps(q);
+    __m128 y = _mm_sub_ps(x, _mm_mul_ps(qf, _mm_set1_ps(1.5703125f)));
+    y = _mm_sub_ps(y, _mm_mul_ps(qf, _mm_set1_ps(4.837512969970703125e-4f)));
+    y = _mm_sub_ps(y, _mm_mul_ps(qf, _mm_set1_ps(7.54978995489188216e-8f)));
+
+    __m128 z = _mm_mul_ps(y, y);
+    __m128 ps = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), z), _mm_set1_ps(8.3321608736e-3f));
+    ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(-1.6666654611e-1f));
+    ps = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ps, z), y), y);
+    __m128 pc = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), z), _mm_set1_ps(-1.388731625493765e-3f));
+    pc = _mm_add_ps(_mm_mul_ps(pc, z), _mm_set1_ps(4.166664568298827e-2f));
+    pc = _mm_mul_ps(_mm_mul_ps(pc, z), z);
+    pc = _mm_add_ps(_mm_sub_ps(pc, _mm_mul_ps(z, _mm_set1_ps(.5f))), _mm_set1_ps(1.f));
+
+    // Odd quadrants swap sin and cos, sin is negative in quadrants 2 and 3, cos in 1 and 2
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i two = _mm_set1_epi32(2);
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+    __m128 s = _mm_or_ps(_mm_and_ps(swap, pc), _mm_andnot_ps(swap, ps));
+    __m128 c = _mm_or_ps(_mm_and_ps(swap, ps), _mm_andnot_ps(swap, pc));
+    __m128 sin_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two), 30));
+    __m128 cos_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30));
+    out_sin = _mm_xor_ps(s, sin_sign);
+    out_cos = _mm_xor_ps(c, cos_sign);
+}
+
+template<bool SHAPE, bool WRITE_VELOCITY>
+static void ptclKernelMoveSSE(const ptclKernelParams& p, const ptclKernelStreams& s, int first, int count) {
+    const float* scale_values = p.scale_lut->data();
+    const gfxm::vec4* rgba_values = p.rgba_lut->data();
+    const __m128 dt = _mm_set1_ps(p.dt);
+    const __m128 gravity_dt = _mm_mul_ps(_mm_setr_ps(p.gravity.x, p.gravity.y, p.gravity.z, .0f), dt);
+    // Velocity is loaded with the ang_velocity.x that follows it, the last lane has to survive the store
+    const __m128 mask_xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    __m128 m0 = _mm_setzero_ps(), m1 = m0, m2 = m0, m3 = m0;
+    if (SHAPE) {
+        const gfxm::mat4& m = *p.shape_transform;
+        m0 = _mm_setr_ps(m[0].x, m[0].y, m[0].z, m[0].w);
+        m1 = _mm_setr_ps(m[1].x, m[1].y, m[1].z, m[1].w);
+        m2 = _mm_setr_ps(m[2].x, m[2].y, m[2].z, m[2].w);
+        m3 = _mm_setr_ps(m[3].x, m[3].y, m[3].z, m[3].w);
+    }
+
+    const int end = first + count;
+    for (int i = first; i < end; ++i) {
+        float frac;
+        const int k = ptclLutIndex(s.scale[i].w * p.inv_max_lifetime, frac);
+        const __m128 f = _mm_set1_ps(frac);
+        const float size = scale_values[k] + (scale_values[k + 1] - scale_values[k]) * frac;
+        const __m128 c0 = _mm_loadu_ps(&rgba_values[k].x);
+        const __m128 c1 = _mm_loadu_ps(&rgba_values[k + 1].x);
+        _mm_storeu_ps(&s.colors[i].x, _mm_add_ps(c0, _mm_mul_ps(_mm_sub_ps(c1, c0), f)));
+
+        float* velocity = &s.states[i].velocity.x;
+        __m128 v = _mm_loadu_ps(velocity);
+        __m128 pos = _mm_loadu_ps(&s.positions[i].x);
+        if (SHAPE) {
+            pos = _mm_add_ps(
+                _mm_add_ps(
+                    _mm_mul_ps(m0, _mm_shuffle_ps(pos, pos, _MM_SHUFFLE(0, 0, 0, 0))),
+                    _mm_mul_ps(m1, _mm_shuffle_ps(pos, pos, _MM_SHUFFLE(1, 1, 1, 1)))
+                ),
+                _mm_add_ps(_mm_mul_ps(m2, _mm_shuffle_ps(pos, pos, _MM_SHUFFLE(2, 2, 2, 2))), m3)
+            );
+        } else {
+            pos = _mm_add_ps(pos, _mm_mul_ps(v, dt));
+        }
+
+        if (WRITE_VELOCITY) {
+            __m128 moved = _mm_sub_ps(pos, _mm_loadu_ps(&s.prev_positions[i].x));
+            _mm_storeu_ps(velocity, _mm_or_ps(_mm_and_ps(mask_xyz, moved), _mm_andnot_ps(mask_xyz, v)));
+        } else if (!SHAPE) {
+            v = _mm_add_ps(v, gravity_dt);
+            _mm_storeu_ps(velocity, v);
+            gfxm::vec3& vel = s.states[i].velocity;
+            float d = sqrtf(gfxm::dot(vel, vel));
+            if (d > p.terminal_velocity) {
+                vel *= p.terminal_velocity / d;
+            }
+        }
+
+        // (x, y, z, size)
+        __m128 zw = _mm_unpackhi_ps(pos, _mm_set1_ps(size));
+        _mm_storeu_ps(&s.positions[i].x, _mm_shuffle_ps(pos, zw, _MM_SHUFFLE(1, 0, 1, 0)));
+    }
+}
+
+static void ptclKernelRotateSSE(const ptclKernelParams& p, const ptclKernelStreams& s, int first, int count) {
+    const __m128 half_dt = _mm_set1_ps(p.dt * .5f);
+    const __m128 zero = _mm_setzero_ps();
+    const int end = first + count;
+    int i = first;
+    for (; i + 4 <= end; i += 4) {
+        const ptclParticleData::Particle* st = s.states + i;
+        __m128 ax = _mm_mul_ps(_mm_setr_ps(st[0].ang_velocity.x, st[1].ang_velocity.x, st[2].ang_velocity.x, st[3].ang_velocity.x), half_dt);
+        __m128 ay = _mm_mul_ps(_mm_setr_ps(st[0].ang_velocity.y, st[1].ang_velocity.y, st[2].ang_velocity.y, st[3].ang_velocity.y), half_dt);
+        __m128 az = _mm_mul_ps(_mm_setr_ps(st[0].ang_velocity.z, st[1].ang_velocity.z, st[2].ang_velocity.z, st[3].ang_velocity.z), half_dt);
+
+        // euler_to_quat: qz * qy * qx
+        ptclQuat4 e;
+        e.x = zero;
+        e.y = zero;
+        ptclSinCos4(az, e.z, e.w);
+        // Emitters only ever spin around z, skip the other two axes when all four are zero
+        if (_mm_movemask_ps(_mm_or_ps(_mm_cmpneq_ps(ax, zero), _mm_cmpneq_ps(ay, zero))) != 0) {
+            ptclQuat4 qy = { zero, zero, zero, zero };
+            ptclQuat4 qx = { zero, zero, zero, zero };
+            ptclSinCos4(ay, qy.y, qy.w);
+            ptclSinCos4(ax, qx.x, qx.w);
+            e = ptclQuatMul4(ptclQuatMul4(e, qy), qx);
+            ptclQuatNormalize4(e);
+        }
+
+        ptclQuat4 r;
+        r.x = _mm_loadu_ps(&s.rotation[i].x);
+        r.y = _mm_loadu_ps(&s.rotation[i + 1].x);
+        r.z = _mm_loadu_ps(&s.rotation[i + 2].x);
+        r.w = _mm_loadu_ps(&s.rotation[i + 3].x);
+        _MM_TRANSPOSE4_PS(r.x, r.y, r.z, r.w);
+        r = ptclQuatMul4(e, r);
+        ptclQuatNormalize4(r);
+        _MM_TRANSPOSE4_PS(r.x, r.y, r.z, r.w);
+        _mm_storeu_ps(&s.rotation[i].x, r.x);
+        _mm_storeu_ps(&s.rotation[i + 1].x, r.y);
+        _mm_storeu_ps(&s.rotation[i + 2].x, r.z);
+        _mm_storeu_ps(&s.rotation[i + 3].x, r.w);
+    }
+    for (; i < end; ++i) {
+        s.rotation[i] = gfxm::euler_to_quat(s.states[i].ang_velocity * p.dt) * s.rotation[i];
+    }
+}
+
+#else
+
+static void ptclKernelUpdateScalar(const ptclKernelParams& p, const ptclKernelStreams& s, int first, int count) {
+    const float* scale_values = p.scale_lut->data();
+    const gfxm::vec4* rgba_values = p.rgba_lut->data();
+    const bool write_velocity = p.dt > .0f;
+    const int end = first + count;
+    for (int i = first; i < end; ++i) {
+        float frac;
+        const int k = ptclLutIndex(s.scale[i].w * p.inv_max_lifetime, frac);
+        const float size = scale_values[k] + (scale_values[k + 1] - scale_values[k]) * frac;
+        s.colors[i] = rgba_values[k] + (rgba_values[k + 1] - rgba_values[k]) * frac;
+
+        gfxm::vec3& velocity = s.states[i].velocity;
+        gfxm::vec3 pos;
+        if (p.shape_transform) {
+            pos = *p.shape_transform * gfxm::vec4(gfxm::vec3(s.positions[i]), 1.f);
+        } else {
+            pos = gfxm::vec3(s.positions[i]) + velocity * p.dt;
+        }
+        if (write_velocity) {
+            velocity = pos - gfxm::vec3(s.prev_positions[i]);
+        } else if (!p.shape_transform) {
+            velocity += p.gravity * p.dt;
+            float d = gfxm::length(velocity);
+            if (d > p.terminal_velocity) {
+                velocity *= p.terminal_velocity / d;
+            }
+        }
+        s.positions[i] = gfxm::vec4(pos, size);
+
+        s.rotation[i] = gfxm::euler_to_quat(s.states[i].ang_velocity * p.dt) * s.rotation[i];
+    }
+}
+
+#endif
+
+void ptclKernelUpdate(const ptclKernelParams& p, const ptclKernelStreams& s, int first, int count) {
+    if (count <= 0) {
+        return;
+    }
+#if PTCL_KERNEL_SSE
+    const bool write_velocity = p.dt > .0f;
+    if (p.shape_transform) {
+        if (write_velocity) {
+            ptclKernelMoveSSE<true, true>(p, s, first, count);
+        } else {
+            ptclKernelMoveSSE<true, false>(p, s, first, count);
+        }
+    } else {
+        if (write_velocity) {
+            ptclKernelMoveSSE<false, true>(p, s, first, count);
+        } else {
+            ptclKernelMoveSSE<false, false>(p, s, first, count);
+        }
+    }
+    ptclKernelRotateSSE(p, s, first, count);
+#else
+    ptclKernelUpdateScalar(p, s, first, count);
+#endif
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "math/gfxm.hpp"
+#include "particle_data.hpp"
+#include "particle_curve_lut.hpp"
+
+
+// Per frame particle update, no gl context needed
+// Streams point at ptclParticleData's arrays, kernels work on the [first, first + count) particle range
+// so one emitter can be split between threads
+// Output matches the old per particle loop within the curve lut error and float rounding
+
+struct ptclKernelStreams {
+    ptclParticleData::Particle* states = nullptr;
+    gfxm::vec4* positions = nullptr;
+    const gfxm::vec4* prev_positions = nullptr;
+    const gfxm::vec4* scale = nullptr;  // .w is lifetime
+    gfxm::vec4* colors = nullptr;
+    gfxm::quat* rotation = nullptr;
+};
+
+struct ptclKernelParams {
+    float dt = .0f;
+    float inv_max_lifetime = 1.f;
+    gfxm::vec3 gravity;
+    float terminal_velocity = 200.f;
+    const ptclCurveLut<float>* scale_lut = nullptr;
+    const ptclCurveLut<gfxm::vec4>* rgba_lut = nullptr;
+    // PARTICLE_MOVEMENT_SHAPE, positions are local to the emitter and get moved into world space.
+    // Null for PARTICLE_MOVEMENT_WORLD, positions are integrated with velocity
+    const gfxm::mat4* shape_transform = nullptr;
+};
+
+ptclKernelStreams ptclMakeKernelStreams(ptclParticleData& data);
+
+// Size over lifetime, position, rotation, color over lifetime.
+// With dt > 0 velocity becomes the distance moved this frame (position - previous position)
+void ptclKernelUpdate(const ptclKernelParams& p, const ptclKernelStreams& s, int first, int count);
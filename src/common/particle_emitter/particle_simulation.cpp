@@ -2,29 +2,12 @@
 #include "world/world.hpp"
 
 
-void ParticleSimulation::free_(ParticleEmitterInstance* inst) {
-    if (inst == nullptr) {
-        assert(false);
-        return;
-    }
-
-    auto it = pools.find(inst->master);
-    if (it == pools.end()) {
-        return;
-    }
-
-    auto& pool = it->second;
-    int slot = -1;
-    for (int i = 0; i < pool.instances.size(); ++i) {
-        if (inst == pool.instances[i]) {
-            slot = i;
-            break;
-        }
-    }
-    if (slot != -1) {
-        pool.free_slots.insert(slot);
-        pool.instances[slot]->despawn(world->getRenderScene());
+ParticleSimulation::Pool* ParticleSimulation::findPool(ParticleEmitterMaster* master) {
+    auto it = pool_lookup.find(master);
+    if (it == pool_lookup.end()) {
+        return nullptr;
     }
+    return &pools[it->second];
 }
 
 
@@ -47,76 +30,55 @@ ParticleEmitterInstance* ParticleSimulation::acquire(ResourceRef<ParticleEmitter
         return 0;
     }
 
-    auto it = pools.find(em.get());
-    if (it == pools.end()) {
-        it = pools.insert(std::make_pair(em.get(), Pool())).first;
+    Pool* pool = findPool(em.get());
+    if (!pool) {
+        pool_lookup.insert(std::make_pair(em.get(), (int)pools.size()));
+        pools.emplace_back();
+        pool = &pools.back();
+        pool->master = em.get();
     }
 
-    auto& pool = it->second;
-    if (!pool.free_slots.empty()) {
-        int slot = *pool.free_slots.begin();
-        pool.free_slots.erase(pool.free_slots.begin());
-
-        active_instances.insert(pool.instances[slot]);
-        pool.instances[slot]->spawn(world->getRenderScene());
-        pool.instances[slot]->is_alive = true;
-        pool.instances[slot]->softReset();
-        return pool.instances[slot];        
+    auto instance = pool->instances.reuse();
+    if (!instance) {
+        instance = em->createInstance();
+        instance->simulation = this;
+        pool->instances.add(instance);
     }
-
-    auto instance = em->createInstance();
-    pool.instances.push_back(instance);
-    active_instances.insert(instance);
     instance->spawn(world->getRenderScene());
     instance->softReset();
-    return pool.instances.back();
+    return instance;
 }
 void ParticleSimulation::release(ParticleEmitterInstance* inst) {
-    if (inst == nullptr) {
+    if (inst == nullptr || inst->simulation != this) {
         return;
     }
 
-    auto it = pools.find(inst->master);
-    if (it == pools.end()) {
+    Pool* pool = findPool(inst->master);
+    if (!pool) {
         return;
     }
-
-    auto& pool = it->second;
-    int slot = -1;
-    for (int i = 0; i < pool.instances.size(); ++i) {
-        if (inst == pool.instances[i]) {
-            slot = i;
-            break;
-        }
-    }
-    if (slot != -1) {
-        active_instances.erase(pool.instances[slot]);
-        passive_instances.insert(pool.instances[slot]);
-        pool.instances[slot]->is_alive = false;
+    if (pool->instances.release(inst)) {
+        inst->is_alive = false;
     }
 }
 
 void ParticleSimulation::update(float dt) {
-    for (auto inst : active_instances) {
-        ptclUpdateEmit(dt, inst);
-    }
-    for (auto inst : active_instances) {
-        ptclUpdate(dt, inst);
-    }
-    for (auto inst : passive_instances) {
-        ptclUpdate(dt, inst);
-    }
-
-    std::set<ParticleEmitterInstance*> to_remove;
-    for (auto inst : passive_instances) {
-        if (!inst->isAlive()) {
-            to_remove.insert(inst);
+    for (auto& pool : pools) {
+        const auto& active = pool.instances.getActive();
+        const auto& passive = pool.instances.getPassive();
+        for (int i = 0; i < active.size(); ++i) {
+            ptclUpdateEmit(dt, active[i]);
+        }
+        for (int i = 0; i < active.size(); ++i) {
+            ptclUpdate(dt, active[i], &thread_pool);
+        }
+        for (int i = 0; i < passive.size(); ++i) {
+            ptclUpdate(dt, passive[i], &thread_pool);
         }
-    }
 
-    for (auto inst : to_remove) {
-        free_(inst);
-        passive_instances.erase(inst);
+        pool.instances.retire([this](ParticleEmitterInstance* inst) {
+            inst->despawn(world->getRenderScene());
+        });
     }
 }
 
@@ -1,31 +1,40 @@
 #pragma once
 
+#include <unordered_map>
 #include "particle_emitter/particle_emitter_master.hpp"
 #include "particle_emitter/particle_impl.hpp"
+#include "particle_emitter/particle_instance_pool.hpp"
 
 
 class RuntimeWorld;
 class ParticleSimulation {
     struct Pool {
-        std::set<int> free_slots;
-        std::vector<ParticleEmitterInstance*> instances;
+        ParticleEmitterMaster* master = 0;
+        ptclInstancePool<ParticleEmitterInstance> instances;
     };
 
     RuntimeWorld* world = 0;
-    std::unordered_map<ParticleEmitterMaster*, Pool> pools;
+    // One pool per master, a master's instances are updated together
+    std::vector<Pool> pools;
+    std::unordered_map<ParticleEmitterMaster*, int> pool_lookup;
 
-    std::set<ParticleEmitterInstance*> active_instances;
-    std::set<ParticleEmitterInstance*> passive_instances;
+    ThreadPool thread_pool;
 
-    void free_(ParticleEmitterInstance* inst);
+    Pool* findPool(ParticleEmitterMaster* master);
 
 public:
     ParticleSimulation();
     ParticleSimulation(RuntimeWorld* world);
     ~ParticleSimulation();
 
+    // No allocations once every master has had as many instances as it needs at the same time
     ParticleEmitterInstance*    acquire(ResourceRef<ParticleEmitterMaster> em);
+    // The instance stops emitting, is updated until its particles are gone, then goes back to its pool
     void                        release(ParticleEmitterInstance* inst);
 
+    // Total thread count including the calling thread
+    void setThreadCount(int count) { thread_pool.setThreadCount(count); }
+    int getThreadCount() const { return thread_pool.getThreadCount(); }
+
     void update(float dt);
 };
\ No newline at end of file
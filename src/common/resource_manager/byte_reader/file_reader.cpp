@@ -1,13 +1,21 @@
 #include <assert.h>
+#include <sys/stat.h>
 #include "file_reader.hpp"
 
 
 size_t file_reader::get_size() const {
-    size_t t = ftell(file);
-    fseek(file, 0, SEEK_END);
-    size_t s = ftell(file);
-    fseek(file, t, SEEK_SET);
-    return s;
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_fstat64(_fileno(file), &st) != 0) {
+        return 0;
+    }
+#else
+    struct stat st;
+    if (fstat(fileno(file), &st) != 0) {
+        return 0;
+    }
+#endif
+    return (size_t)st.st_size;
 }
 int file_reader::seek_origin_to_c_constant(seek_origin origin) {
     switch(origin) {
@@ -8,8 +8,8 @@ class memory_reader : public byte_reader {
     size_t m_size = 0;
     size_t m_cur = 0;
 public:
-    memory_reader(void* data, size_t size, extension hint = e_ext_unknown)
-        : byte_reader(hint), m_data(data), m_size(size) {}
+    memory_reader(void* data, size_t size, extension hint = e_ext_unknown, const std::string& filename_hint = "")
+        : byte_reader(hint, filename_hint), m_data(data), m_size(size) {}
 
     size_t read(void* dst, size_t bytes) override;
     bool seek(int64_t offset, seek_origin origin) override;
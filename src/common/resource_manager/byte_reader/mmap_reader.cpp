@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <filesystem>
+#include <string.h>
+#include "mmap_reader.hpp"
+#include "file_reader.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+mmap_reader::mmap_reader() {}
+mmap_reader::mmap_reader(const std::string& fname, extension hint)
+: byte_reader(hint, fname) {
+    open(fname, hint);
+}
+mmap_reader::~mmap_reader() {
+    close();
+}
+
+bool mmap_reader::open(const std::string& fname, extension hint) {
+    close();
+    byte_reader::extension_hint = hint;
+    byte_reader::filename_hint_ = fname;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER sz = { 0 };
+    if (!GetFileSizeEx(file, &sz) || sz.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) {
+        return false;
+    }
+    // The view keeps the mapping and the file alive
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view) {
+        return false;
+    }
+    m_data = (const uint8_t*)view;
+    m_size = (size_t)sz.QuadPart;
+#else
+    int fd = ::open(fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    m_data = (const uint8_t*)view;
+    m_size = (size_t)st.st_size;
+#endif
+    m_cur = 0;
+    return true;
+}
+
+void mmap_reader::close() {
+    if (!m_data) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+#else
+    munmap((void*)m_data, m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_cur = 0;
+}
+
+void mmap_reader::prefetch() const {
+    volatile uint8_t sink = 0;
+    for (size_t i = 0; i < m_size; i += 4096) {
+        sink += m_data[i];
+    }
+}
+
+size_t mmap_reader::read(void* dst, size_t bytes) {
+    size_t count = std::min(bytes, m_size - m_cur);
+    memcpy(dst, m_data + m_cur, count);
+    m_cur += count;
+    return count;
+}
+
+bool mmap_reader::seek(int64_t offset, seek_origin origin) {
+    int64_t base = 0;
+    switch (origin) {
+    case seek_set: base = 0; break;
+    case seek_cur: base = (int64_t)m_cur; break;
+    case seek_end: base = (int64_t)m_size; break;
+    }
+    int64_t new_cur = base + offset;
+    if (new_cur < 0 || new_cur > (int64_t)m_size) {
+        return false;
+    }
+    m_cur = (size_t)new_cur;
+    return true;
+}
+
+size_t mmap_reader::tell() const {
+    return m_cur;
+}
+
+size_t mmap_reader::size() const {
+    return m_size;
+}
+
+bool mmap_reader::is_valid() const {
+    return m_data != nullptr;
+}
+
+bool mmap_reader::is_eof() const {
+    return m_cur >= m_size;
+}
+
+byte_reader::memory_view mmap_reader::try_slurp() {
+    return memory_view{
+        .data = m_data,
+        .size = m_size
+    };
+}
+
+
+byte_reader* open_file_reader(const std::string& fname, extension hint) {
+    std::error_code ec;
+    uintmax_t sz = std::filesystem::file_size(fname, ec);
+    if (!ec && sz >= MMAP_READER_MIN_SIZE) {
+        mmap_reader* mr = new mmap_reader(fname, hint);
+        if (mr->is_valid()) {
+            return mr;
+        }
+        delete mr;
+    }
+    return new file_reader(fname, hint);
+}
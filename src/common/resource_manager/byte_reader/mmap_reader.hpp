@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include "byte_reader.hpp"
+
+
+// Maps a file read-only, try_slurp() points straight into the mapping.
+// The file can't be written to while it's mapped on Windows, drop the reader once the resource is loaded
+class mmap_reader : public byte_reader {
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_cur = 0;
+public:
+    mmap_reader();
+    mmap_reader(const std::string& fname, extension hint = e_ext_unknown);
+    ~mmap_reader();
+    mmap_reader(const mmap_reader&) = delete;
+    mmap_reader& operator=(const mmap_reader&) = delete;
+
+    bool open(const std::string& fname, extension hint = e_ext_unknown);
+    void close();
+    // Reads one byte of every page so later reads don't fault on this thread
+    void prefetch() const;
+
+    size_t read(void* dst, size_t bytes) override;
+    bool seek(int64_t offset, seek_origin origin) override;
+    size_t tell() const override;
+    size_t size() const override;
+    bool is_valid() const override;
+    bool is_eof() const override;
+    byte_reader::memory_view try_slurp() override;
+};
+
+// Below this mapping costs more than a read
+constexpr size_t MMAP_READER_MIN_SIZE = 64 * 1024;
+
+// mmap_reader for files of MMAP_READER_MIN_SIZE and up, file_reader for smaller ones.
+// Never null, check is_valid()
+byte_reader* open_file_reader(const std::string& fname, extension hint = e_ext_unknown);
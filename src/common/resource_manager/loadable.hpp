@@ -1,6 +1,9 @@
 #pragma once
 
+#include <functional>
 #include <span>
+#include <string>
+#include <vector>
 #include "byte_reader/byte_reader.hpp"
 
 
@@ -26,4 +29,39 @@ public:
     virtual ~ILoadable() {}
 
     virtual bool load(byte_reader&) = 0;
+};
+
+struct ResourceEntry;
+class ResourceManager;
+template<typename RES_T>
+class ResourceRef;
+
+// Passed to IAsyncLoadable::decode(), collects the resources it depends on
+class ResourceLoadContext {
+    friend ResourceManager;
+    bool is_async = false;
+    // Run on the main thread after decode() returns, each one starts loading a dependency
+    // at the given priority and returns its entry
+    std::vector<std::function<ResourceEntry*(int)>> requests;
+public:
+    // Loaded synchronously out is set right away. Loaded in the background it is set on the main thread
+    // after decode() returns, so out must stay where it is until then.
+    // The resource is finalized only once the dependency is done loading
+    template<typename RES_T>
+    void depend(ResourceRef<RES_T>& out, const std::string& resource_id);
+};
+
+[[cppi_decl, no_reflect]];
+class IAsyncLoadable;
+
+// A resource that can be decoded off the main thread, see ResourceManager::loadAsync()
+// decode() runs on a loader worker: no gpu calls and no loadResource(), dependencies go through ctx.
+// finalize() runs on the main thread after every dependency is done loading.
+// load() runs the two back to back on the calling thread
+class IAsyncLoadable : public ILoadable {
+public:
+    virtual bool decode(byte_reader& in, ResourceLoadContext& ctx) = 0;
+    virtual bool finalize() { return true; }
+
+    bool load(byte_reader& in) override;
 };
\ No newline at end of file
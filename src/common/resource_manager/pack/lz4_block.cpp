@@ -0,0 +1,153 @@
+#include "lz4_block.hpp"
+
+#include <string.h>
+#include <vector>
+
+
+constexpr int LZ4_MIN_MATCH = 4;
+// The last match has to start this far from the end of the block and the last 5 bytes are always literals
+constexpr int LZ4_MF_LIMIT = 12;
+constexpr int LZ4_LAST_LITERALS = 5;
+constexpr int LZ4_MAX_DISTANCE = 65535;
+constexpr int LZ4_HASH_LOG = 16;
+
+static uint32_t lz4Read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+static uint32_t lz4Hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+static uint8_t* lz4WriteLength(uint8_t* op, int len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+int lz4_compress_block(const uint8_t* src, int src_size, uint8_t* dst, int dst_capacity) {
+    std::vector<int> table(1 << LZ4_HASH_LOG, -1);
+    uint8_t* op = dst;
+    uint8_t* const op_end = dst + dst_capacity;
+    int ip = 0;
+    int anchor = 0;
+
+    auto emit = [&](int literal_count, int offset, int match_len) -> bool {
+        // Worst case for this sequence: token, literal length bytes, literals, offset, match length bytes
+        if (op + 1 + literal_count / 255 + 1 + literal_count + 2 + match_len / 255 + 1 > op_end) {
+            return false;
+        }
+        uint8_t* token = op++;
+        *token = (uint8_t)((literal_count >= 15 ? 15 : literal_count) << 4);
+        if (literal_count >= 15) {
+            op = lz4WriteLength(op, literal_count - 15);
+        }
+        memcpy(op, src + anchor, literal_count);
+        op += literal_count;
+        if (match_len == 0) {
+            return true;
+        }
+        *op++ = (uint8_t)(offset & 0xFF);
+        *op++ = (uint8_t)(offset >> 8);
+        const int ml = match_len - LZ4_MIN_MATCH;
+        *token |= (uint8_t)(ml >= 15 ? 15 : ml);
+        if (ml >= 15) {
+            op = lz4WriteLength(op, ml - 15);
+        }
+        return true;
+    };
+
+    const int match_limit = src_size - LZ4_LAST_LITERALS;
+    while (ip <= src_size - LZ4_MF_LIMIT) {
+        const uint32_t seq = lz4Read32(src + ip);
+        const uint32_t h = lz4Hash(seq);
+        const int ref = table[h];
+        table[h] = ip;
+        if (ref < 0 || ip - ref > LZ4_MAX_DISTANCE || lz4Read32(src + ref) != seq) {
+            ++ip;
+            continue;
+        }
+        int len = LZ4_MIN_MATCH;
+        while (ip + len < match_limit && src[ref + len] == src[ip + len]) {
+            ++len;
+        }
+        if (!emit(ip - anchor, ip - ref, len)) {
+            return 0;
+        }
+        ip += len;
+        anchor = ip;
+    }
+    if (!emit(src_size - anchor, 0, 0)) {
+        return 0;
+    }
+    return (int)(op - dst);
+}
+
+int lz4_decompress_block(const uint8_t* src, int src_size, uint8_t* dst, int dst_capacity) {
+    const uint8_t* ip = src;
+    const uint8_t* const ip_end = src + src_size;
+    uint8_t* op = dst;
+    uint8_t* const op_end = dst + dst_capacity;
+
+    while (ip < ip_end) {
+        const uint8_t token = *ip++;
+        size_t literal_count = token >> 4;
+        if (literal_count == 15) {
+            uint8_t b;
+            do {
+                if (ip >= ip_end) {
+                    return -1;
+                }
+                b = *ip++;
+                literal_count += b;
+            } while (b == 255);
+        }
+        if (literal_count > (size_t)(ip_end - ip) || literal_count > (size_t)(op_end - op)) {
+            return -1;
+        }
+        memcpy(op, ip, literal_count);
+        ip += literal_count;
+        op += literal_count;
+        if (ip == ip_end) {
+            break;
+        }
+
+        if (ip_end - ip < 2) {
+            return -1;
+        }
+        const size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) {
+            return -1;
+        }
+        size_t match_len = token & 15;
+        if (match_len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= ip_end) {
+                    return -1;
+                }
+                b = *ip++;
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += LZ4_MIN_MATCH;
+        if (match_len > (size_t)(op_end - op)) {
+            return -1;
+        }
+        const uint8_t* match = op - offset;
+        if (offset >= match_len) {
+            memcpy(op, match, match_len);
+            op += match_len;
+        } else {
+            // Overlapping, repeats the last offset bytes
+            for (size_t i = 0; i < match_len; ++i) {
+                *op++ = *match++;
+            }
+        }
+    }
+    return (int)(op - dst);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+
+// Raw LZ4 block format, no frame header, so the reference lz4 library can read and write the same data.
+// The compressor is a plain greedy one, fast enough for building packs offline
+
+inline int lz4_compress_bound(int src_size) {
+    return src_size + src_size / 255 + 16;
+}
+
+// Returns the compressed size, 0 if it doesn't fit in dst_capacity
+int lz4_compress_block(const uint8_t* src, int src_size, uint8_t* dst, int dst_capacity);
+// Returns the decompressed size, -1 if the input is malformed or doesn't fit in dst_capacity
+int lz4_decompress_block(const uint8_t* src, int src_size, uint8_t* dst, int dst_capacity);
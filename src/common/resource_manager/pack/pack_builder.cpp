@@ -0,0 +1,139 @@
+#include "pack_builder.hpp"
+
+#include <stdio.h>
+#include <algorithm>
+#include <filesystem>
+#include <vector>
+#include "log/log.hpp"
+#include "lz4_block.hpp"
+#include "pack_file.hpp"
+
+
+static bool packWritePadding(FILE* f, uint64_t& offset, uint64_t alignment) {
+    static const char zeros[PACK_ALIGNMENT] = { 0 };
+    const uint64_t pad = (alignment - offset % alignment) % alignment;
+    if (pad && fwrite(zeros, 1, pad, f) != pad) {
+        return false;
+    }
+    offset += pad;
+    return true;
+}
+
+bool packBuild(const std::string& src_dir, const std::string& out_path, bool compress, PackBuildStats* stats) {
+    std::vector<std::string> names;
+    std::error_code ec;
+    for (auto& it : std::filesystem::recursive_directory_iterator(src_dir, ec)) {
+        if (!it.is_regular_file()) {
+            continue;
+        }
+        std::string name = it.path().lexically_normal().generic_string();
+        if (name.size() > UINT16_MAX) {
+            LOG_WARN("PACK: Skipping " << name << ", name too long");
+            continue;
+        }
+        names.push_back(name);
+    }
+    if (ec) {
+        LOG_ERR("PACK: Failed to list " << src_dir << ": " << ec.message());
+        return false;
+    }
+    std::sort(names.begin(), names.end());
+
+    FILE* f = fopen(out_path.c_str(), "wb");
+    if (!f) {
+        LOG_ERR("PACK: Failed to create " << out_path);
+        return false;
+    }
+
+    PackBuildStats st;
+    PACK_HEAD head;
+    head.tag = PACK_TAG;
+    head.version = PACK_VERSION;
+    uint64_t offset = 0;
+    bool ok = fwrite(&head, sizeof(head), 1, f) == 1;
+    offset += sizeof(head);
+
+    std::vector<PACK_ENTRY> entries;
+    std::string name_table;
+    std::vector<uint8_t> raw;
+    std::vector<uint8_t> packed;
+    for (int i = 0; ok && i < names.size(); ++i) {
+        FILE* src = fopen(names[i].c_str(), "rb");
+        if (!src) {
+            LOG_ERR("PACK: Failed to open " << names[i]);
+            ok = false;
+            break;
+        }
+        fseek(src, 0, SEEK_END);
+        const long sz = ftell(src);
+        fseek(src, 0, SEEK_SET);
+        raw.resize(std::max(0L, sz));
+        const bool read_ok = sz >= 0 && fread(raw.data(), 1, raw.size(), src) == raw.size();
+        fclose(src);
+        if (!read_ok || raw.size() > UINT32_MAX) {
+            LOG_ERR("PACK: Failed to read " << names[i]);
+            ok = false;
+            break;
+        }
+
+        PACK_ENTRY e;
+        e.hash = pack_hash(names[i]);
+        e.raw_size = (uint32_t)raw.size();
+        e.name_offset = (uint32_t)name_table.size();
+        e.name_length = (uint16_t)names[i].size();
+        name_table += names[i];
+
+        const uint8_t* data = raw.data();
+        e.size = e.raw_size;
+        if (compress && !raw.empty()) {
+            packed.resize(lz4_compress_bound((int)raw.size()));
+            int packed_size = lz4_compress_block(raw.data(), (int)raw.size(), packed.data(), (int)packed.size());
+            if (packed_size > 0 && packed_size <= (int)(raw.size() - raw.size() / 8)) {
+                data = packed.data();
+                e.size = (uint32_t)packed_size;
+                e.compression = PACK_COMPRESSION_LZ4;
+                ++st.compressed_count;
+            }
+        }
+
+        ok = packWritePadding(f, offset, PACK_ALIGNMENT);
+        e.offset = offset;
+        ok = ok && (e.size == 0 || fwrite(data, 1, e.size, f) == e.size);
+        offset += e.size;
+        entries.push_back(e);
+
+        ++st.file_count;
+        st.raw_bytes += e.raw_size;
+        st.stored_bytes += e.size;
+    }
+
+    if (ok) {
+        std::stable_sort(entries.begin(), entries.end(), [](const PACK_ENTRY& a, const PACK_ENTRY& b) {
+            return a.hash < b.hash;
+        });
+        ok = packWritePadding(f, offset, 8);
+        head.entry_count = (uint32_t)entries.size();
+        head.offs_entries = offset;
+        ok = ok && (entries.empty() || fwrite(entries.data(), sizeof(PACK_ENTRY), entries.size(), f) == entries.size());
+        offset += entries.size() * sizeof(PACK_ENTRY);
+        head.names_size = (uint32_t)name_table.size();
+        head.offs_names = offset;
+        ok = ok && (name_table.empty() || fwrite(name_table.data(), 1, name_table.size(), f) == name_table.size());
+        offset += name_table.size();
+        ok = ok && fseek(f, 0, SEEK_SET) == 0 && fwrite(&head, sizeof(head), 1, f) == 1;
+    }
+    fclose(f);
+    if (!ok) {
+        LOG_ERR("PACK: Failed to write " << out_path);
+        std::filesystem::remove(out_path, ec);
+        return false;
+    }
+
+    st.pack_bytes = offset;
+    LOG("PACK: Built " << out_path << ", " << st.file_count << " files, " << st.compressed_count << " compressed, "
+        << st.raw_bytes / 1024 << " kb of data, " << st.pack_bytes / 1024 << " kb pack");
+    if (stats) {
+        *stats = st;
+    }
+    return true;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+
+struct PackBuildStats {
+    int file_count = 0;
+    int compressed_count = 0;
+    uint64_t raw_bytes = 0;
+    uint64_t stored_bytes = 0;
+    uint64_t pack_bytes = 0;
+};
+
+// Packs every file under src_dir. Entries are named by their path as reached from src_dir,
+// so build from the directory resource ids are relative to: packBuild("core", "core.pack")
+// stores core/materials/default.mat under that name.
+// With compress set, entries are LZ4 compressed when that saves at least an eighth of their size
+bool packBuild(const std::string& src_dir, const std::string& out_path, bool compress, PackBuildStats* stats = nullptr);
@@ -0,0 +1,162 @@
+#include "pack_file.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <filesystem>
+#include <mutex>
+#include "log/log.hpp"
+#include "lz4_block.hpp"
+#include "resource_manager/byte_reader/memory_reader.hpp"
+
+
+// Reader over an uncompressed entry, holds the archive so an unmount doesn't pull the mapping from under it
+class pack_entry_reader : public memory_reader {
+    std::shared_ptr<const PackArchive> archive;
+public:
+    pack_entry_reader(std::shared_ptr<const PackArchive> archive, const PACK_ENTRY* e, const std::string& filename_hint)
+        : memory_reader((void*)archive->getData(e), e->size, e_ext_unknown, filename_hint), archive(std::move(archive)) {}
+};
+
+bool PackArchive::open(const std::string& path) {
+    this->path = path;
+    if (!file.open(path)) {
+        LOG_ERR("PACK: Failed to map " << path);
+        return false;
+    }
+    base = file.try_slurp().data;
+    const size_t file_size = file.size();
+
+    PACK_HEAD head;
+    if (file_size < sizeof(head)) {
+        LOG_ERR("PACK: " << path << " is too small");
+        return false;
+    }
+    memcpy(&head, base, sizeof(head));
+    if (head.tag != PACK_TAG || head.version != PACK_VERSION) {
+        LOG_ERR("PACK: " << path << " is not a pack or has an unsupported version");
+        return false;
+    }
+    if (head.offs_entries > file_size
+        || (file_size - head.offs_entries) / sizeof(PACK_ENTRY) < head.entry_count
+        || head.offs_names > file_size
+        || file_size - head.offs_names < head.names_size
+    ) {
+        LOG_ERR("PACK: " << path << " has its index out of bounds");
+        return false;
+    }
+
+    entries = (const PACK_ENTRY*)(base + head.offs_entries);
+    names = (const char*)(base + head.offs_names);
+    for (uint32_t i = 0; i < head.entry_count; ++i) {
+        const PACK_ENTRY& e = entries[i];
+        if (e.offset > file_size || file_size - e.offset < e.size
+            || (uint64_t)e.name_offset + e.name_length > head.names_size
+            || (i > 0 && entries[i - 1].hash > e.hash)
+        ) {
+            LOG_ERR("PACK: " << path << " has a corrupt entry " << i);
+            entries = nullptr;
+            names = nullptr;
+            return false;
+        }
+    }
+    entry_count = head.entry_count;
+    return true;
+}
+
+const PACK_ENTRY* PackArchive::find(std::string_view name) const {
+    const uint64_t hash = pack_hash(name);
+    const PACK_ENTRY* end = entries + entry_count;
+    const PACK_ENTRY* it = std::lower_bound(entries, end, hash, [](const PACK_ENTRY& e, uint64_t h) {
+        return e.hash < h;
+    });
+    for (; it != end && it->hash == hash; ++it) {
+        if (pack_name_equal(getName(it), name)) {
+            return it;
+        }
+    }
+    return nullptr;
+}
+
+
+PackFileSystem* PackFileSystem::get() {
+    static PackFileSystem fs;
+    return &fs;
+}
+
+bool PackFileSystem::mount(const std::string& path) {
+    std::shared_ptr<PackArchive> archive(new PackArchive);
+    if (!archive->open(path)) {
+        return false;
+    }
+    LOG("PACK: Mounted " << path << ", " << archive->entryCount() << " entries");
+    std::unique_lock<std::shared_mutex> lock(sync);
+    archives.push_back(std::move(archive));
+    mount_count = (int)archives.size();
+    return true;
+}
+
+bool PackFileSystem::unmount(const std::string& path) {
+    std::unique_lock<std::shared_mutex> lock(sync);
+    for (int i = (int)archives.size() - 1; i >= 0; --i) {
+        if (archives[i]->getPath() != path) {
+            continue;
+        }
+        archives.erase(archives.begin() + i);
+        mount_count = (int)archives.size();
+        return true;
+    }
+    return false;
+}
+
+int PackFileSystem::mountDirectory(const std::string& dir) {
+    std::vector<std::string> paths;
+    std::error_code ec;
+    for (auto& it : std::filesystem::directory_iterator(dir, ec)) {
+        if (it.is_regular_file() && it.path().extension() == ".pack") {
+            paths.push_back(it.path().string());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    int count = 0;
+    for (auto& p : paths) {
+        count += mount(p) ? 1 : 0;
+    }
+    return count;
+}
+
+bool PackFileSystem::exists(std::string_view name) const {
+    std::shared_lock<std::shared_mutex> lock(sync);
+    for (int i = (int)archives.size() - 1; i >= 0; --i) {
+        if (archives[i]->find(name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+byte_reader* PackFileSystem::open(std::string_view name, std::vector<char>& storage) const {
+    std::shared_lock<std::shared_mutex> lock(sync);
+    for (int i = (int)archives.size() - 1; i >= 0; --i) {
+        const PackArchive* archive = archives[i].get();
+        const PACK_ENTRY* e = archive->find(name);
+        if (!e) {
+            continue;
+        }
+        const std::string filename_hint(name);
+        if (e->compression == PACK_COMPRESSION_NONE) {
+            return new pack_entry_reader(archives[i], e, filename_hint);
+        }
+        if (e->compression != PACK_COMPRESSION_LZ4) {
+            LOG_ERR("PACK: Unknown compression " << (int)e->compression << " for " << name << " in " << archive->getPath());
+            return nullptr;
+        }
+        storage.resize(e->raw_size);
+        int sz = lz4_decompress_block(archive->getData(e), (int)e->size, (uint8_t*)storage.data(), (int)storage.size());
+        if (sz != (int)e->raw_size) {
+            LOG_ERR("PACK: Failed to decompress " << name << " in " << archive->getPath());
+            return nullptr;
+        }
+        return new memory_reader(storage.data(), storage.size(), e_ext_unknown, filename_hint);
+    }
+    return nullptr;
+}
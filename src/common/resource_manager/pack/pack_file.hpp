@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "resource_manager/byte_reader/mmap_reader.hpp"
+
+
+constexpr uint32_t PACK_TAG = 'P' | ('A' << 8) | ('K' << 16) | ('\0' << 24);
+constexpr uint32_t PACK_VERSION = 1;
+constexpr uint64_t PACK_ALIGNMENT = 4096;
+
+enum PACK_COMPRESSION : uint8_t {
+    PACK_COMPRESSION_NONE,
+    PACK_COMPRESSION_LZ4
+};
+
+// Head at offset 0, payloads each starting on a PACK_ALIGNMENT boundary,
+// then the entry table sorted by hash and the name table
+#pragma pack(push, 1)
+struct PACK_HEAD {
+    uint32_t tag = 0;
+    uint32_t version = 0;
+
+    uint32_t entry_count = 0;
+    uint32_t names_size = 0;
+    uint64_t offs_entries = 0;
+    uint64_t offs_names = 0;
+};
+struct PACK_ENTRY {
+    uint64_t hash = 0;
+    uint64_t offset = 0;
+    uint32_t size = 0;          // as stored
+    uint32_t raw_size = 0;      // decompressed
+    uint32_t name_offset = 0;   // into the name table, not null terminated
+    uint16_t name_length = 0;
+    uint8_t compression = PACK_COMPRESSION_NONE;
+    uint8_t reserved = 0;
+};
+#pragma pack(pop)
+
+// Entries are named by file path with forward slashes, backslashes in a lookup match forward ones
+inline uint64_t pack_hash(std::string_view name) {
+    uint64_t h = 14695981039346656037ull;
+    for (char c : name) {
+        h = (h ^ (uint8_t)(c == '\\' ? '/' : c)) * 1099511628211ull;
+    }
+    return h;
+}
+inline bool pack_name_equal(std::string_view stored, std::string_view name) {
+    if (stored.size() != name.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < name.size(); ++i) {
+        if (stored[i] != (name[i] == '\\' ? '/' : name[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// One mounted pack, mapped whole. The index is read in place
+class PackArchive {
+    std::string path;
+    mmap_reader file;
+    const uint8_t* base = nullptr;
+    const PACK_ENTRY* entries = nullptr;
+    const char* names = nullptr;
+    uint32_t entry_count = 0;
+public:
+    bool open(const std::string& path);
+
+    const std::string& getPath() const { return path; }
+    int entryCount() const { return (int)entry_count; }
+    const PACK_ENTRY* getEntry(int i) const { return &entries[i]; }
+    std::string_view getName(const PACK_ENTRY* e) const { return std::string_view(names + e->name_offset, e->name_length); }
+    const uint8_t* getData(const PACK_ENTRY* e) const { return base + e->offset; }
+
+    // Binary search on the hash, null if there is no such entry
+    const PACK_ENTRY* find(std::string_view name) const;
+};
+
+// Mounted packs, searched last mounted first so a later pack overrides entries of earlier ones.
+// Lookups and reads are safe from any thread, mount and unmount take an exclusive lock.
+// Readers over uncompressed entries share ownership of their archive, an unmounted pack
+// stays mapped until the last of them is destroyed
+class PackFileSystem {
+    mutable std::shared_mutex sync;
+    std::vector<std::shared_ptr<PackArchive>> archives;
+    std::atomic<int> mount_count = 0;
+public:
+    static PackFileSystem* get();
+
+    bool mount(const std::string& path);
+    bool unmount(const std::string& path);
+    // Mounts every .pack file in dir in name order, returns how many
+    int mountDirectory(const std::string& dir);
+    bool hasMounts() const { return mount_count > 0; }
+
+    bool exists(std::string_view name) const;
+    // A reader over the entry, null if there is none or it is corrupt. Uncompressed entries are read
+    // straight from the mapping, compressed ones are decompressed into storage, which has to outlive the reader
+    byte_reader* open(std::string_view name, std::vector<char>& storage) const;
+};
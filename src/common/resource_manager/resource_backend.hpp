@@ -4,6 +4,7 @@
 
 
 struct ResourceEntry;
+class ResourceLoadContext;
 class IResourceBackend {
 public:
     virtual ~IResourceBackend() {}
@@ -14,4 +15,12 @@ public:
     virtual void release(void*) = 0;
     virtual void collectGarbage() = 0;
     virtual void update() {}
+
+    // Background loading, see ResourceManager::loadAsync()
+    // Backends that can decode off the main thread get their object from create() on the main thread,
+    // decode() fills it on a loader worker, finalize() completes it back on the main thread.
+    // The rest get load() on the main thread with the file already read into memory
+    virtual bool canDecodeAsync() const { return false; }
+    virtual bool decode(void* object, byte_reader& in, ResourceLoadContext& ctx) { return false; }
+    virtual bool finalize(void* object) { return true; }
 };
\ No newline at end of file
@@ -28,17 +28,20 @@ enum eUriSchema {
     eUriNone,
     eUriError,
     eUriFile,
-    eUriBase64
+    eUriBase64,
+    eUriPack
 };
 inline const char* uri_schema_to_string(eUriSchema sch) {
     switch (sch) {
     case eUriNone: return "<none>";
     case eUriError: return "<error>";
     case eUriFile: return "file";
+    case eUriPack: return "pack";
     }
     return "<unknown>";
 }
 
+struct ResourceLoadJob;
 struct ResourceEntry {
     ResourceEntry() {}
     virtual ~ResourceEntry() {}
@@ -53,6 +56,8 @@ struct ResourceEntry {
     std::unique_ptr<byte_reader> reader;
     std::vector<char> loading_payload; // for base64 source
     std::set<ResourceEntry*> dependents;
+    // Set while a background load is in flight, main thread only
+    ResourceLoadJob* load_job = nullptr;
 
     void addRef() {
         ++ref_count;
@@ -0,0 +1,184 @@
+#include "resource_loader.hpp"
+
+#include "base64/base64.hpp"
+#include "byte_reader/memory_reader.hpp"
+#include "byte_reader/mmap_reader.hpp"
+#include "pack/pack_file.hpp"
+
+
+ResourceLoader::ResourceLoader(int decode_thread_count) {
+    io_thread = std::thread([this]() {
+        _th_io();
+    });
+    for (int i = 0; i < decode_thread_count; ++i) {
+        decode_threads.push_back(std::thread([this]() {
+            _th_decode();
+        }));
+    }
+}
+ResourceLoader::~ResourceLoader() {
+    {
+        std::unique_lock<std::mutex> lock(sync);
+        is_running = false;
+    }
+    cv_work.notify_all();
+    io_thread.join();
+    for (auto& th : decode_threads) {
+        th.join();
+    }
+}
+
+void ResourceLoader::_push(std::deque<ResourceLoadJob*>* queues, ResourceLoadJob* job) {
+    int priority = job->priority.load();
+    job->queued_priority = priority;
+    queues[priority].push_back(job);
+}
+ResourceLoadJob* ResourceLoader::_pop(std::deque<ResourceLoadJob*>* queues) {
+    for (int p = eResourcePriorityCount - 1; p >= 0; --p) {
+        auto& q = queues[p];
+        while (!q.empty()) {
+            ResourceLoadJob* job = q.front();
+            q.pop_front();
+            // Promoted jobs leave a stale copy in the queue they were in before
+            if (job->queued_priority != p) {
+                continue;
+            }
+            job->queued_priority = -1;
+            return job;
+        }
+    }
+    return nullptr;
+}
+void ResourceLoader::_finish(ResourceLoadJob* job) {
+    {
+        std::unique_lock<std::mutex> lock(sync);
+        job->stage = eResourceLoadDone;
+        done.push_back(job);
+    }
+    cv_done.notify_all();
+}
+
+void ResourceLoader::_th_io() {
+    while (true) {
+        ResourceLoadJob* job = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(sync);
+            cv_work.wait(lock, [this, &job]() {
+                job = _pop(read_queues);
+                return job != nullptr || !is_running;
+            });
+            if (!job) {
+                return;
+            }
+        }
+
+        if (job->cancelled) {
+            _finish(job);
+            continue;
+        }
+
+        eUriSchema schema = job->schema;
+        if (schema == eUriPack) {
+            // Compressed entries are decompressed into bytes here, stored ones are read from the mapping
+            job->reader.reset(PackFileSystem::get()->open(job->path, job->bytes));
+            job->read_ok = job->reader != nullptr;
+            // Unmounted after the job was started, the entry path is the loose file's path too
+            if (!job->read_ok) {
+                schema = eUriFile;
+            }
+        }
+
+        if (schema == eUriFile) {
+            std::unique_ptr<byte_reader> reader(open_file_reader(job->path));
+            if (reader->is_valid()) {
+                if (auto mapped = dynamic_cast<mmap_reader*>(reader.get())) {
+                    // Fault the pages in here rather than on a decode worker or the main thread
+                    mapped->prefetch();
+                    job->reader = std::move(reader);
+                    job->read_ok = true;
+                } else {
+                    job->bytes.resize(reader->size());
+                    job->read_ok = reader->read(job->bytes.data(), job->bytes.size()) == job->bytes.size();
+                }
+            }
+            if (job->read_ok && !job->reader) {
+                job->reader.reset(new memory_reader(job->bytes.data(), job->bytes.size(), e_ext_unknown, job->path));
+            }
+        } else if (schema == eUriBase64) {
+            job->read_ok = base64_decode(job->path.data(), job->path.size(), job->bytes);
+            if (job->read_ok) {
+                job->reader.reset(new memory_reader(job->bytes.data(), job->bytes.size()));
+            }
+        }
+
+        if (!job->read_ok || !job->decode_async || job->cancelled) {
+            _finish(job);
+            continue;
+        }
+        {
+            std::unique_lock<std::mutex> lock(sync);
+            job->stage = eResourceLoadDecode;
+            _push(decode_queues, job);
+        }
+        cv_work.notify_all();
+    }
+}
+
+void ResourceLoader::_th_decode() {
+    while (true) {
+        ResourceLoadJob* job = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(sync);
+            cv_work.wait(lock, [this, &job]() {
+                job = _pop(decode_queues);
+                return job != nullptr || !is_running;
+            });
+            if (!job) {
+                return;
+            }
+        }
+
+        if (!job->cancelled) {
+            job->decode_ok = job->backend->decode(job->object, *job->reader, job->ctx);
+        }
+        _finish(job);
+    }
+}
+
+void ResourceLoader::submit(ResourceLoadJob* job) {
+    {
+        std::unique_lock<std::mutex> lock(sync);
+        job->stage = eResourceLoadRead;
+        _push(read_queues, job);
+    }
+    cv_work.notify_all();
+}
+
+void ResourceLoader::promote(ResourceLoadJob* job, eResourcePriority priority) {
+    std::unique_lock<std::mutex> lock(sync);
+    if (job->priority.load() >= priority) {
+        return;
+    }
+    job->priority = priority;
+    if (job->queued_priority < 0) {
+        return;
+    }
+    if (job->stage == eResourceLoadRead) {
+        _push(read_queues, job);
+    } else if (job->stage == eResourceLoadDecode) {
+        _push(decode_queues, job);
+    }
+}
+
+void ResourceLoader::takeDone(std::vector<ResourceLoadJob*>& out) {
+    std::unique_lock<std::mutex> lock(sync);
+    out.insert(out.end(), done.begin(), done.end());
+    done.clear();
+}
+
+void ResourceLoader::waitDone(int timeout_ms) {
+    std::unique_lock<std::mutex> lock(sync);
+    cv_done.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]() {
+        return !done.empty();
+    });
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "resource_entry.hpp"
+#include "loadable.hpp"
+
+
+enum eResourcePriority {
+    eResourcePriorityPrefetch,
+    eResourcePriorityVisible,
+    eResourcePriorityBlocking,
+    eResourcePriorityCount
+};
+
+enum eResourceLoadStage {
+    eResourceLoadRead,      // waiting for or on the io thread
+    eResourceLoadDecode,    // waiting for or on a decode worker
+    eResourceLoadDone       // back from the workers, belongs to the main thread from here on
+};
+
+// One background load, created and destroyed on the main thread by ResourceManager
+// Workers only touch the read/decode fields, entry and the dependency bookkeeping belong to the main thread
+struct ResourceLoadJob {
+    ResourceEntry* entry = nullptr;
+    IResourceBackend* backend = nullptr;
+    eUriSchema schema = eUriNone;
+    std::string path;
+    // Created on the main thread for backends that decode off it, null otherwise
+    void* object = nullptr;
+    bool decode_async = false;
+
+    std::atomic<int> priority = eResourcePriorityVisible;
+    std::atomic<bool> cancelled = false;
+    // Guarded by the loader's mutex
+    eResourceLoadStage stage = eResourceLoadRead;
+    int queued_priority = -1;
+
+    // Worker output, reader is a mapping of the file or a memory_reader over bytes
+    std::unique_ptr<byte_reader> reader;
+    std::vector<char> bytes;
+    bool read_ok = false;
+    bool decode_ok = false;
+    ResourceLoadContext ctx;
+
+    // Main thread
+    std::vector<ResourceEntry*> dependencies;
+    int pending_dependencies = 0;
+    std::vector<ResourceLoadJob*> dependents;
+    std::vector<std::function<void(ResourceEntry*)>> callbacks;
+    int finalize_priority = -1;     // queue the job sits in while waiting for finalize, -1 if it doesn't
+    int cancelled_callback_count = 0;
+    bool restart = false;           // requested again after it was cancelled
+};
+
+// An io thread that reads files and a pool of decode workers, both taking jobs highest priority first
+// Finished jobs are handed back through takeDone(), nothing here runs on the main thread
+class ResourceLoader {
+    std::mutex sync;
+    std::condition_variable cv_work;
+    std::condition_variable cv_done;
+    std::deque<ResourceLoadJob*> read_queues[eResourcePriorityCount];
+    std::deque<ResourceLoadJob*> decode_queues[eResourcePriorityCount];
+    std::vector<ResourceLoadJob*> done;
+    bool is_running = true;
+
+    std::thread io_thread;
+    std::vector<std::thread> decode_threads;
+
+    void _push(std::deque<ResourceLoadJob*>* queues, ResourceLoadJob* job);
+    ResourceLoadJob* _pop(std::deque<ResourceLoadJob*>* queues);
+    void _finish(ResourceLoadJob* job);
+    void _th_io();
+    void _th_decode();
+public:
+    ResourceLoader(int decode_thread_count);
+    ~ResourceLoader();
+    ResourceLoader(const ResourceLoader&) = delete;
+    ResourceLoader& operator=(const ResourceLoader&) = delete;
+
+    int getDecodeThreadCount() const { return (int)decode_threads.size(); }
+
+    void submit(ResourceLoadJob* job);
+    // Moves a job that is still queued to a higher priority queue
+    void promote(ResourceLoadJob* job, eResourcePriority priority);
+    // Appends every job the workers are done with to out
+    void takeDone(std::vector<ResourceLoadJob*>& out);
+    // Blocks until a job is done or the timeout runs out
+    void waitDone(int timeout_ms);
+};
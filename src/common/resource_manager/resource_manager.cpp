@@ -0,0 +1,288 @@
+#include "resource_manager.hpp"
+
+#include <thread>
+#include "util/timer.hpp"
+
+
+bool IAsyncLoadable::load(byte_reader& in) {
+    // Not async: depend() loads dependencies as it goes
+    ResourceLoadContext ctx;
+    if (!decode(in, ctx)) {
+        return false;
+    }
+    return finalize();
+}
+
+
+ResourceLoader* ResourceManager::getLoader() {
+    if (!loader) {
+        int count = loader_thread_count;
+        if (count <= 0) {
+            // Leave a core for the main thread and one for the io thread
+            count = std::clamp((int)std::thread::hardware_concurrency() - 2, 1, 4);
+        }
+        loader.reset(new ResourceLoader(count));
+    }
+    return loader.get();
+}
+
+void ResourceManager::setLoaderThreadCount(int count) {
+    loader_thread_count = count;
+    if (loader && jobs_in_flight == 0) {
+        loader.reset();
+    }
+}
+
+// An entry resolved to a pack that has been unmounted since goes back to the loose file,
+// pack entries are named by the same relative path
+void ResourceManager::resolveUnmountedPack(ResourceEntry* entry) {
+    if (entry->schema != eUriPack || PackFileSystem::get()->exists(entry->resource_path)) {
+        return;
+    }
+    LOG_DBG("RES: " << entry->resource_path << " is no longer in a mounted pack, using the loose file");
+    entry->schema = eUriFile;
+}
+
+void ResourceManager::startLoadJob(ResourceEntry* entry, eResourcePriority priority) {
+    resolveUnmountedPack(entry);
+    if(entry->schema != eUriBase64) {
+        LOG("RES: Loading async " << uri_schema_to_string(entry->schema) << "://" << entry->resource_path);
+    } else {
+        LOG("RES: Loading async " << uri_schema_to_string(entry->schema) << "://omitted-for-brevity");
+    }
+
+    ResourceLoadJob* job = new ResourceLoadJob;
+    job->entry = entry;
+    job->backend = entry->backend;
+    job->schema = entry->schema;
+    job->path = entry->resource_path;
+    job->priority = priority;
+    job->decode_async = entry->backend->canDecodeAsync();
+    if (job->decode_async) {
+        job->object = entry->backend->create();
+        job->ctx.is_async = true;
+    }
+
+    entry->state = eResourceLoading;
+    entry->load_job = job;
+    ++jobs_in_flight;
+    getLoader()->submit(job);
+}
+
+void ResourceManager::promoteLoadJob(ResourceEntry* entry, eResourcePriority priority) {
+    ResourceLoadJob* job = entry->load_job;
+    if (!job || job->priority >= priority) {
+        return;
+    }
+    if (job->finalize_priority >= 0) {
+        // Stale copy in the old queue is skipped by popFinalize()
+        job->priority = priority;
+        job->finalize_priority = priority;
+        finalize_queues[priority].push_back(job);
+    } else {
+        loader->promote(job, priority);
+    }
+    for (auto dep : job->dependencies) {
+        promoteLoadJob(dep, priority);
+    }
+}
+
+bool ResourceManager::isWaitingOn(ResourceEntry* entry, ResourceEntry* dependency, std::vector<ResourceEntry*>& visited) {
+    if (entry == dependency) {
+        return true;
+    }
+    if (!entry->load_job || std::find(visited.begin(), visited.end(), entry) != visited.end()) {
+        return false;
+    }
+    visited.push_back(entry);
+    for (auto dep : entry->load_job->dependencies) {
+        if (isWaitingOn(dep, dependency, visited)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ResourceManager::processDoneJob(ResourceLoadJob* job) {
+    if (job->cancelled || !job->read_ok || (job->decode_async && !job->decode_ok)) {
+        completeJob(job);
+        return;
+    }
+
+    if (job->decode_async) {
+        std::vector<ResourceEntry*> visited;
+        for (auto& request : job->ctx.requests) {
+            ResourceEntry* dep = request(job->priority);
+            if (!dep) {
+                continue;
+            }
+            dep->dependents.insert(job->entry);
+            job->dependencies.push_back(dep);
+            if (!dep->load_job) {
+                continue;
+            }
+            visited.clear();
+            if (isWaitingOn(dep, job->entry, visited)) {
+                LOG_ERR("RES: Cyclic dependency detected, '" << job->entry->resource_id
+                    << "' will be finalized before '" << dep->resource_id << "' and never unloaded");
+                continue;
+            }
+            dep->load_job->dependents.push_back(job);
+            ++job->pending_dependencies;
+        }
+        job->ctx.requests.clear();
+    }
+
+    if (job->pending_dependencies == 0) {
+        queueFinalize(job);
+    }
+}
+
+void ResourceManager::queueFinalize(ResourceLoadJob* job) {
+    job->finalize_priority = job->priority;
+    finalize_queues[job->finalize_priority].push_back(job);
+}
+
+ResourceLoadJob* ResourceManager::popFinalize(bool blocking_only) {
+    const int lowest = blocking_only ? eResourcePriorityBlocking : 0;
+    for (int p = eResourcePriorityCount - 1; p >= lowest; --p) {
+        auto& q = finalize_queues[p];
+        while (!q.empty()) {
+            ResourceLoadJob* job = q.front();
+            q.pop_front();
+            if (job->finalize_priority != p) {
+                continue;
+            }
+            job->finalize_priority = -1;
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void ResourceManager::completeJob(ResourceLoadJob* job) {
+    ResourceEntry* entry = job->entry;
+    IResourceBackend* backend = job->backend;
+    // Cleared first: a resource loading its dependencies from here must not wait() on itself,
+    // cycles go through loading_stack the same as synchronous loads
+    entry->load_job = nullptr;
+    --jobs_in_flight;
+
+    void* res = nullptr;
+    if (!job->cancelled && job->read_ok) {
+        loading_stack.push_back(entry);
+        if (job->decode_async) {
+            if (job->decode_ok && backend->finalize(job->object)) {
+                res = job->object;
+                job->object = nullptr;
+            }
+        } else {
+            // Backends may hold on to the reader past load(), it has to outlive the job
+            entry->loading_payload.swap(job->bytes);
+            entry->reader = std::move(job->reader);
+            res = backend->load(entry);
+        }
+        loading_stack.pop_back();
+    }
+    if (job->object) {
+        backend->release(job->object);
+        job->object = nullptr;
+    }
+
+    if (job->cancelled) {
+        entry->state = eResourceUnloaded;
+        for (int i = 0; i < job->cancelled_callback_count; ++i) {
+            job->callbacks[i](entry);
+        }
+        if (job->restart) {
+            startLoadJob(entry, (eResourcePriority)job->priority.load());
+            ResourceLoadJob* next = entry->load_job;
+            next->callbacks.insert(
+                next->callbacks.end(),
+                std::make_move_iterator(job->callbacks.begin() + job->cancelled_callback_count),
+                std::make_move_iterator(job->callbacks.end())
+            );
+            next->dependents = std::move(job->dependents);
+        }
+        delete job;
+        return;
+    }
+
+    if (!res) {
+        if (!job->read_ok) {
+            LOG_ERR("RES: Failed to read " << uri_schema_to_string(entry->schema) << "://" << (entry->schema == eUriBase64 ? "omitted-for-brevity" : entry->resource_path));
+        }
+        LOG_WARN("RES: Failed to load resource " << entry->resource_id);
+        entry->data = nullptr;
+        entry->state = eResourceAbsent;
+    } else {
+        entry->data = res;
+        entry->state = eResourcePresent;
+    }
+
+    for (auto dependent : job->dependents) {
+        if (--dependent->pending_dependencies == 0) {
+            queueFinalize(dependent);
+        }
+    }
+    for (auto& cb : job->callbacks) {
+        cb(entry);
+    }
+    delete job;
+}
+
+void ResourceManager::update(float budget_ms) {
+    if (!loader) {
+        return;
+    }
+    timer timer_;
+    timer_.start();
+
+    // Local, legacy loaders and callbacks can get back in here through wait()
+    std::vector<ResourceLoadJob*> done;
+    loader->takeDone(done);
+    for (auto job : done) {
+        processDoneJob(job);
+    }
+
+    while (true) {
+        const bool over_budget = timer_.stop() * 1000.f >= budget_ms;
+        ResourceLoadJob* job = popFinalize(over_budget);
+        if (!job) {
+            break;
+        }
+        completeJob(job);
+    }
+}
+
+void ResourceManager::wait(ResourceEntry* entry) {
+    if (!entry || !entry->load_job) {
+        return;
+    }
+    promoteLoadJob(entry, eResourcePriorityBlocking);
+    while (entry->load_job) {
+        update(.0f);
+        if (!entry->load_job) {
+            break;
+        }
+        loader->waitDone(1);
+    }
+}
+
+bool ResourceManager::cancelLoad(ResourceEntry* entry) {
+    if (!entry || !entry->load_job) {
+        return false;
+    }
+    ResourceLoadJob* job = entry->load_job;
+    if (job->cancelled || !job->dependents.empty()) {
+        return false;
+    }
+    job->cancelled = true;
+    job->restart = false;
+    job->cancelled_callback_count = (int)job->callbacks.size();
+    if (job->finalize_priority >= 0) {
+        job->finalize_priority = -1;
+        completeJob(job);
+    }
+    return true;
+}
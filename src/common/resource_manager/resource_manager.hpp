@@ -9,6 +9,7 @@
 
 #include "resource_ref.hpp"
 #include "resource_backend.hpp"
+#include "resource_loader.hpp"
 
 #include "base64/base64.hpp"
 #include "resource_manager/byte_reader/memory_reader.hpp"
@@ -69,6 +70,23 @@ public:
     void release(void* ptr) override {
         delete static_cast<RES_T*>(ptr);
     }
+    bool canDecodeAsync() const override {
+        return std::is_base_of_v<IAsyncLoadable, RES_T>;
+    }
+    bool decode(void* object, byte_reader& in, ResourceLoadContext& ctx) override {
+        if constexpr (std::is_base_of_v<IAsyncLoadable, RES_T>) {
+            return static_cast<RES_T*>(object)->decode(in, ctx);
+        } else {
+            return false;
+        }
+    }
+    bool finalize(void* object) override {
+        if constexpr (std::is_base_of_v<IAsyncLoadable, RES_T>) {
+            return static_cast<RES_T*>(object)->finalize();
+        } else {
+            return true;
+        }
+    }
     void collectGarbage() override {
         for (auto& kv : entries) {
             auto entry = kv.second.get();
@@ -88,6 +106,8 @@ public:
 #include "reflection/reflection.hpp"
 
 #include "byte_reader/file_reader.hpp"
+#include "byte_reader/mmap_reader.hpp"
+#include "pack/pack_file.hpp"
 
 // TODO: Separate data providers per schema
 
@@ -96,6 +116,22 @@ class ResourceManager {
     std::vector<ResourceEntry*> loading_stack;
     std::vector<std::unique_ptr<ResourceEntry>> orphan_entries;
 
+    // Background loading
+    std::unique_ptr<ResourceLoader> loader;
+    int loader_thread_count = 0;
+    int jobs_in_flight = 0;
+    std::deque<ResourceLoadJob*> finalize_queues[eResourcePriorityCount];
+
+    ResourceLoader* getLoader();
+    void resolveUnmountedPack(ResourceEntry* entry);
+    void startLoadJob(ResourceEntry* entry, eResourcePriority priority);
+    void promoteLoadJob(ResourceEntry* entry, eResourcePriority priority);
+    bool isWaitingOn(ResourceEntry* entry, ResourceEntry* dependency, std::vector<ResourceEntry*>& visited);
+    void processDoneJob(ResourceLoadJob* job);
+    void queueFinalize(ResourceLoadJob* job);
+    ResourceLoadJob* popFinalize(bool blocking_only);
+    void completeJob(ResourceLoadJob* job);
+
     eUriSchema convertUri(std::string& inout) {
         std::string& str = inout;
         size_t pos = str.find("://");
@@ -105,7 +141,8 @@ class ResourceManager {
 
         static std::map<std::string, eUriSchema> schema_map = {
             { "file", eUriFile },
-            { "base64", eUriBase64 }
+            { "base64", eUriBase64 },
+            { "pack", eUriPack }
         };
 
         std::string schema(str.begin(), str.begin() + pos);
@@ -182,6 +219,19 @@ class ResourceManager {
                 return entry;
             }
 
+            // Mounted packs override loose files, and a lookup there is a hash search instead of a stat
+            if (PackFileSystem::get()->hasMounts()) {
+                for (int i = 0; i < extensions.size(); ++i) {
+                    std::string fname = MKSTR(resource_id << "." << extension_to_string(extensions[i]));
+                    if (!PackFileSystem::get()->exists(fname)) {
+                        continue;
+                    }
+                    entry->schema = eUriPack;
+                    entry->resource_path = fname;
+                    return entry;
+                }
+            }
+
             for (int i = 0; i < extensions.size(); ++i) {
                 extension ext = extensions[i];
                 // TODO: check extension_to_string's result validity
@@ -221,6 +271,25 @@ public:
         return it->second.get();
     }
 
+    // Decode workers for loadAsync(), 0 picks a count from the hardware.
+    // Takes effect when the loader is next created, right away if nothing is loading
+    void setLoaderThreadCount(int count);
+    int getLoadsInFlight() const { return jobs_in_flight; }
+
+    // Hands finished background loads their dependencies and finalizes the ones that are ready,
+    // highest priority first. Stops after budget_ms, except for blocking loads, which all finalize.
+    // Main thread, once per frame
+    void update(float budget_ms = 2.f);
+    // Blocks until the entry's background load is done, promoting it and everything it waits on to blocking
+    void wait(ResourceEntry* entry);
+    // Drops a background load nothing else waits on, the entry goes back to unloaded.
+    // Callbacks already registered are still called. False if there was nothing to cancel
+    bool cancelLoad(ResourceEntry* entry);
+    template<typename RES_T>
+    bool cancelLoad(const ResourceRef<RES_T>& ref) {
+        return cancelLoad(ref._getEntry());
+    }
+
     void collectGarbage() {
         for (auto& kv : backend_map) {
             auto backend = kv.second.get();
@@ -241,6 +310,7 @@ public:
 
     template<typename RES_T>
     ResourceRef<RES_T> load(ResourceEntry* entry) {
+        resolveUnmountedPack(entry);
         if(entry->schema != eUriBase64) {
             LOG("RES: Loading " << uri_schema_to_string(entry->schema) << "://" << entry->resource_path);
         } else {
@@ -252,7 +322,7 @@ public:
 
         switch (entry->schema) {
         case eUriFile: {
-            file_reader* fr = new file_reader(entry->resource_path);
+            byte_reader* fr = open_file_reader(entry->resource_path);
             if (!fr) {
                 LOG_ERR("RES: File not found: " << entry->resource_path);
                 loading_stack.pop_back();
@@ -302,6 +372,30 @@ public:
             loading_stack.pop_back();
             return ref;
         }
+        case eUriPack: {
+            byte_reader* pr = PackFileSystem::get()->open(entry->resource_path, entry->loading_payload);
+            if (!pr) {
+                LOG_ERR("RES: Not found in mounted packs: " << entry->resource_path);
+                entry->data = nullptr;
+                entry->state = eResourceAbsent;
+                loading_stack.pop_back();
+                return ResourceRef<RES_T>(nullptr);
+            }
+            entry->reader.reset(pr);
+            void* res = entry->backend->load(entry);
+            if (!res) {
+                LOG_WARN("RES: Failed to load resource " << entry->resource_id);
+                entry->data = nullptr;
+                entry->state = eResourceAbsent;
+                loading_stack.pop_back();
+                return ResourceRef<RES_T>(nullptr);
+            }
+            entry->data = res;
+            entry->state = eResourcePresent;
+            ResourceRef<RES_T> ref(entry);
+            loading_stack.pop_back();
+            return ref;
+        }
         }
 
         LOG_ERR("RES: Unsupported schema: " << uri_schema_to_string(entry->schema));
@@ -343,6 +437,10 @@ public:
             LOG_WARN("RES: Tried to load absent resource '" << e->resource_id << "'");
             return nullptr;
         case eResourceLoading:
+            if (e->load_job) {
+                wait(e);
+                return e->state == eResourcePresent ? ResourceRef<RES_T>(e) : nullptr;
+            }
             return ResourceRef<RES_T>(e);
         };
 
@@ -351,6 +449,56 @@ public:
         return nullptr;
     }
 
+    // Returns right away, the file is read on the io thread and IAsyncLoadable resources are decoded
+    // on a worker. Other resources load on the main thread in update() once the file is in memory.
+    // The ref is empty until on_done, which is called on the main thread, from update() or right here
+    // if the resource was already loaded. Requesting a resource that is already loading
+    // raises its priority if the new one is higher
+    template<typename RES_T>
+    ResourceRef<RES_T> loadAsync(
+        const std::string& resource_id,
+        eResourcePriority priority = eResourcePriorityVisible,
+        std::function<void(const ResourceRef<RES_T>&)> on_done = nullptr
+    ) {
+        ResourceEntry* e = resolveResourceId<RES_T>(resource_id);
+        if (!e) {
+            LOG_ERR("RES: Failed to resolve resource id: " << resource_id);
+            assert(false);
+            return nullptr;
+        }
+
+        switch (e->state) {
+        case eResourceInvalidState:
+        case eResourceUnloaded:
+            startLoadJob(e, priority);
+            break;
+        case eResourceLoading:
+            if (e->load_job) {
+                if (e->load_job->cancelled) {
+                    e->load_job->restart = true;
+                }
+                promoteLoadJob(e, priority);
+            }
+            break;
+        case eResourcePresent:
+        case eResourceAbsent:
+            break;
+        }
+
+        ResourceRef<RES_T> ref(e->state == eResourceAbsent ? nullptr : e);
+        if (!on_done) {
+            return ref;
+        }
+        if (e->load_job) {
+            e->load_job->callbacks.push_back([on_done](ResourceEntry* entry) {
+                on_done(ResourceRef<RES_T>(entry->state == eResourceAbsent ? nullptr : entry));
+            });
+        } else {
+            on_done(ref);
+        }
+        return ref;
+    }
+
     template<typename RES_T>
     ResourceRef<RES_T> create(const std::string& resource_id) {
         IResourceBackend* backend = getOrCreateBackend<RES_T>();
@@ -382,11 +530,33 @@ public:
 };
 
 
+template<typename RES_T>
+void ResourceLoadContext::depend(ResourceRef<RES_T>& out, const std::string& resource_id) {
+    if (!is_async) {
+        out = ResourceManager::get()->load<RES_T>(resource_id);
+        return;
+    }
+    requests.push_back([&out, resource_id](int priority) -> ResourceEntry* {
+        out = ResourceManager::get()->loadAsync<RES_T>(resource_id, (eResourcePriority)priority);
+        return out._getEntry();
+    });
+}
+
+
 template<typename RES_T>
 ResourceRef<RES_T> loadResource(const std::string& resource_id) {
     return ResourceManager::get()->load<RES_T>(resource_id);
 }
 
+template<typename RES_T>
+ResourceRef<RES_T> loadResourceAsync(
+    const std::string& resource_id,
+    eResourcePriority priority = eResourcePriorityVisible,
+    std::function<void(const ResourceRef<RES_T>&)> on_done = nullptr
+) {
+    return ResourceManager::get()->loadAsync<RES_T>(resource_id, priority, on_done);
+}
+
 template<typename RES_T>
 ResourceRef<RES_T> createResource(const std::string& resource_id) {
     return ResourceManager::get()->create<RES_T>(resource_id);
@@ -80,6 +80,12 @@ public:
     const std::string& getResourceId() const {
         return entry->resource_id;
     }
+    eResourceState getState() const {
+        return entry ? entry->state : eResourceInvalidState;
+    }
+    bool isLoaded() const {
+        return entry && entry->state == eResourcePresent;
+    }
 
     // Used only to add an id for an entry you've created yourself,
     // so that the ResourceRef can be serialized as a proper reference
@@ -87,6 +93,7 @@ public:
         if(!entry) return;
         entry->resource_id = id;
     }
+    ResourceEntry* _getEntry() const { return entry; }
 
     RES_T* get() { return static_cast<RES_T*>(entry->data); }
     const RES_T* get() const { return static_cast<RES_T*>(entry->data); }
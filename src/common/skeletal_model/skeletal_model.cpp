@@ -211,8 +211,7 @@ bool SkeletalModel::load(byte_reader& reader) {
     if (!view) {
         return false;
     }
-    std::string str_json(view.data, view.data + view.size);
-    nlohmann::json json = nlohmann::json::parse(str_json);
+    nlohmann::json json = nlohmann::json::parse(view.data, view.data + view.size);
     if (!json.is_object()) {
         return false;
     }
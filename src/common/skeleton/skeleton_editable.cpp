@@ -132,10 +132,15 @@ HSHARED<SkeletonInstance> Skeleton::createInstance() {
         hinstance->bone_nodes[i]->setRotation(bone_array[i]->getLclRotation());
         hinstance->bone_nodes[i]->setScale(bone_array[i]->getLclScale());
     }
-    for (int i = 0; i < boneCount(); ++i) {
-        int parent_idx = parent_array[i];
-        if (parent_idx != -1) {
-            transformNodeAttach(hinstance->bone_nodes[parent_idx], hinstance->bone_nodes[i]);
+    hinstance->transform_block = TransformSystem::getHierarchy()->createBlock(
+        hinstance->bone_nodes.data(), parent_array.data(), (int)boneCount()
+    );
+    if (hinstance->transform_block == -1) {
+        for (int i = 0; i < boneCount(); ++i) {
+            int parent_idx = parent_array[i];
+            if (parent_idx != -1) {
+                transformNodeAttach(hinstance->bone_nodes[parent_idx], hinstance->bone_nodes[i]);
+            }
         }
     }
 
@@ -191,8 +196,7 @@ bool Skeleton::load_json(byte_reader& in) {
     if (!view) {
         return false;
     }
-    std::string str_json(view.data, view.data + view.size);
-    nlohmann::json j = nlohmann::json::parse(str_json);
+    nlohmann::json j = nlohmann::json::parse(view.data, view.data + view.size);
     if (!j.is_object()) {
         return false;
     }
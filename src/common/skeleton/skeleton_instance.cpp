@@ -18,6 +18,9 @@ SkeletonInstance::~SkeletonInstance() {
         gpuGetDevice()->destroyParamBlock(kv.second);
     }
     transform_blocks.clear();
+    if (transform_block != -1) {
+        TransformSystem::getHierarchy()->destroyBlock(transform_block);
+    }
 }
 
 const int* SkeletonInstance::getParentArrayPtr() {
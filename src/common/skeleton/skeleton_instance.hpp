@@ -5,6 +5,7 @@
 #include "handle/hshared.hpp"
 #include "math/gfxm.hpp"
 #include "transform_node/transform_node.hpp"
+#include "transform_node/transform_hierarchy.hpp"
 #include "gpu/param_block/transform_block.hpp"
 
 
@@ -17,6 +18,7 @@ class SkeletonInstance {
     Skeleton*            prototype = 0;
 
     std::vector<Handle<TransformNode>> bone_nodes;
+    int transform_block = -1; // Bone nodes are stored in the shared TransformHierarchy
     std::map<int, gpuTransformBlock*> transform_blocks;
     bool is_valid = true;
 public:
@@ -28,6 +30,8 @@ public:
     const int*  getParentArrayPtr();
     Handle<TransformNode> getBoneNode(int i) { return bone_nodes[i]; }
     Handle<TransformNode> getBoneNode(const char* name);
+    // Block of the bone nodes in TransformSystem::getHierarchy(), -1 if they are linked nodes
+    int getHierarchyBlock() const { return transform_block; }
     gpuTransformBlock* getTransformBlock(const char* name);
     gpuTransformBlock* getTransformBlock(int bone_idx);
 
@@ -16,8 +16,7 @@ bool StaticModel::load(byte_reader& reader) {
     if (!view) {
         return false;
     }
-    std::string str_json(view.data, view.data + view.size);
-    nlohmann::json j = nlohmann::json::parse(str_json);
+    nlohmann::json j = nlohmann::json::parse(view.data, view.data + view.size);
     if (!j.is_object()) {
         return false;
     }
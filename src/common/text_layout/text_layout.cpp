@@ -17,6 +17,41 @@ bool TextLayout::_is_space(uint32_t ch) {
     return isspace(ch);
 }
 
+void TextLayout::_invalidate(uint32_t flags) {
+    dirty_flags |= flags;
+    dirty_begin = 0;
+}
+// Every natural line but the last ends with '\n', one that ends at or before dirty_begin did not change
+int TextLayout::_firstDirtyLine() {
+    if (lines.empty()) {
+        return 0;
+    }
+    auto it = std::partition_point(lines.begin(), lines.end() - 1, [this](const Line& ln) {
+        return ln.decoded_end <= dirty_begin;
+    });
+    return it - lines.begin();
+}
+// Wrapped lines split from the natural lines before _firstDirtyLine() all start before it
+int TextLayout::_firstDirtyWrappedLine() {
+    if (lines.empty()) {
+        return 0;
+    }
+    const int decoded_begin = lines[_firstDirtyLine()].decoded_begin;
+    auto it = std::partition_point(lines_wrapped.begin(), lines_wrapped.end(), [decoded_begin](const Line& ln) {
+        return ln.decoded_begin < decoded_begin;
+    });
+    return it - lines_wrapped.begin();
+}
+void TextLayout::_measureHeight() {
+    if(!height_constraint.has_value()) {
+        bounding_height_no_pad = lines_wrapped.size() * line_height;
+        bounding_height = bounding_height_no_pad + pad_top + pad_bottom;
+    } else {
+        bounding_height = height_constraint.value();
+        bounding_height_no_pad = bounding_height - (pad_top + pad_bottom);
+    }
+}
+
 void TextLayout::_beginSpanQuad(int line_idx, uint32_t col, int x) {
     Span sp;
     sp.line_idx = line_idx;
@@ -65,7 +100,8 @@ void TextLayout::addRange(int begin, int end, uint32_t id) {
 
 void TextLayout::setFont(Font* f) {
     font = f;
-    dirty_flags |= DIRTY_WRAPPING;
+    // Natural line widths and font metrics are measured in the DIRTY_LINES pass
+    _invalidate(DIRTY_LINES);
 }
 void TextLayout::setString(const char* str, size_t len) {
     string_view = str;
@@ -75,37 +111,37 @@ void TextLayout::setString(const char* str, size_t len) {
 void TextLayout::setWidth(std::optional<int> w) {
     // TODO: If width was unconstrained but the new width is equal or more than natural width - do not invalidate wrapping
     if (width_constraint.has_value() != w.has_value()) {
-        dirty_flags |= DIRTY_WRAPPING;
+        _invalidate(DIRTY_WRAPPING);
     }
     if (width_constraint.has_value() && w.has_value() && width_constraint.value() != w.value()) {
-        dirty_flags |= DIRTY_WRAPPING;
+        _invalidate(DIRTY_WRAPPING);
     }
     width_constraint = w;
 }
 void TextLayout::setHeight(std::optional<int> h) {
     if (height_constraint.has_value() != h.has_value()) {
-        dirty_flags |= DIRTY_GLYPHS;
+        _invalidate(DIRTY_GLYPHS);
     }
     if (height_constraint.has_value() && h.has_value() && height_constraint.value() != h.value()) {
-        dirty_flags |= DIRTY_GLYPHS;
+        _invalidate(DIRTY_GLYPHS);
     }
     height_constraint = h;
 }
 void TextLayout::setHAlign(TextLayout::HALIGN halign) {
     if (hori_align != halign) {
-        dirty_flags |= DIRTY_GLYPHS;
+        _invalidate(DIRTY_GLYPHS);
     }
     hori_align = halign;
 }
 void TextLayout::setVAlign(TextLayout::VALIGN valign) {
     if (vert_align != valign) {
-        dirty_flags |= DIRTY_GLYPHS;
+        _invalidate(DIRTY_GLYPHS);
     }
     vert_align = valign;
 }
 void TextLayout::setPadding(int left, int right, int top, int bottom) {
     if (pad_left != left || pad_right != right || pad_top != top || pad_bottom != bottom) {
-        dirty_flags |= DIRTY_WRAPPING;
+        _invalidate(DIRTY_WRAPPING);
     }
     pad_left = left;
     pad_right = right;
@@ -119,81 +155,130 @@ void TextLayout::build(BuildMode build_mode) {
 
     const int SPACES_PER_TAB = 4;
 
+    // base_color is set directly and baked into every glyph
+    if (glyphs_color != base_color) {
+        _invalidate(DIRTY_GLYPHS);
+        glyphs_color = base_color;
+    }
+
     // Decode, Build natural lines
     if(dirty_flags & DIRTY_LINES) {
         dirty_flags &= ~DIRTY_LINES;
-        dirty_flags |= DIRTY_WRAPPING;
-
-        ascender = font->getAscender();
-        descender = font->getDescender();
-
-        string_decoded.clear();
-        string_decoded.reserve(string_len);
-        lines.clear();
-
-        Line* line = &lines.emplace_back();
-        line->raw_begin = 0;
-        line->decoded_begin = 0;
-
-        const char* pbegin = string_view;
-        const char* pend = string_view + string_len;
-        const char* pcur = pbegin;
-        while (pcur != pend) {
-            int raw_index = pcur - pbegin;
-            uint32_t ch = utf8_next(pcur, pend);
-            int next_raw_index = pcur - pbegin;
-            string_decoded.push_back(ch);
-
-            if (ch == '\n') {
-                line->raw_end = raw_index;
-                line->decoded_end = string_decoded.size();
-
-                line = &lines.emplace_back();
-                line->raw_begin = next_raw_index;
-                line->decoded_begin = string_decoded.size();
-                continue;
+
+        // Decode over the previous string, noting where the two start to differ
+        int first_changed = -1;
+        int n_decoded = 0;
+        {
+            const char* pcur = string_view;
+            const char* pend = string_view + string_len;
+            while (pcur != pend) {
+                uint32_t ch = utf8_next(pcur, pend);
+                if (n_decoded < string_decoded.size()) {
+                    if (first_changed == -1 && string_decoded[n_decoded] != ch) {
+                        first_changed = n_decoded;
+                    }
+                    string_decoded[n_decoded] = ch;
+                } else {
+                    if (first_changed == -1) {
+                        first_changed = n_decoded;
+                    }
+                    string_decoded.push_back(ch);
+                }
+                ++n_decoded;
             }
+            if (first_changed == -1 && n_decoded != string_decoded.size()) {
+                first_changed = n_decoded;
+            }
+            string_decoded.resize(n_decoded);
+        }
+        if (first_changed != -1) {
+            dirty_begin = gfxm::_min(dirty_begin, first_changed);
         }
-        string_decoded.shrink_to_fit();
-        line->raw_end = pend - pbegin;
-        line->decoded_end = string_decoded.size();
+        // Same string as before and nothing else invalidated
+        if (dirty_begin != INT_MAX) {
+            dirty_flags |= DIRTY_WRAPPING;
+
+            ascender = font->getAscender();
+            descender = font->getDescender();
+
+            // Lines that ended before the first changed character are kept, the rest are split again
+            const int first_line = _firstDirtyLine();
+            int raw_begin = 0;
+            int decoded_begin = 0;
+            if (!lines.empty()) {
+                raw_begin = lines[first_line].raw_begin;
+                decoded_begin = lines[first_line].decoded_begin;
+            }
+            lines.resize(first_line);
+
+            Line* line = &lines.emplace_back();
+            line->raw_begin = raw_begin;
+            line->decoded_begin = decoded_begin;
+
+            const char* pbegin = string_view;
+            const char* pend = string_view + string_len;
+            const char* pcur = pbegin + raw_begin;
+            int decoded_index = decoded_begin;
+            while (pcur != pend) {
+                int raw_index = pcur - pbegin;
+                uint32_t ch = utf8_next(pcur, pend);
+                int next_raw_index = pcur - pbegin;
+                ++decoded_index;
+
+                if (ch == '\n') {
+                    line->raw_end = raw_index;
+                    line->decoded_end = decoded_index;
+
+                    line = &lines.emplace_back();
+                    line->raw_begin = next_raw_index;
+                    line->decoded_begin = decoded_index;
+                    continue;
+                }
+            }
+            line->raw_end = pend - pbegin;
+            line->decoded_end = decoded_index;
         
-        // Measure natural extents
-        {
-            space_width = font->getGlyph(' ').horiAdvance / 64;
-            tab_width = space_width * SPACES_PER_TAB;
-            line_height = font->getLineHeight();
-
-            bounding_width = 0;
-            for (int i = 0; i < lines.size(); ++i) {
-                Line* ln = &lines[i];
-                ln->y_baseline = ascender + line_height * i;
-                int hori_advance = 0;
-                for (int j = ln->decoded_begin; j < ln->decoded_end; ++j) {
-                    uint32_t ch = string_decoded[j];
-
-                    if (ch == '\t') {
-                        hori_advance = tab_width * (1 + hori_advance / tab_width);;
-                        continue;
-                    }
-                    if (ch == 0x03) { // ETX
+            // Measure natural extents
+            {
+                space_width = font->getGlyph(' ').horiAdvance / 64;
+                tab_width = space_width * SPACES_PER_TAB;
+                line_height = font->getLineHeight();
+
+                bounding_width = 0;
+                for (int i = 0; i < lines.size(); ++i) {
+                    Line* ln = &lines[i];
+                    if (i < first_line) {
+                        bounding_width = gfxm::_max(ln->bounding_width, bounding_width);
                         continue;
                     }
+                    ln->y_baseline = ascender + line_height * i;
+                    int hori_advance = 0;
+                    for (int j = ln->decoded_begin; j < ln->decoded_end; ++j) {
+                        uint32_t ch = string_decoded[j];
 
-                    auto glyph = font->getGlyph(ch);
-                    int glyph_hori_advance = glyph.horiAdvance / 64;
+                        if (ch == '\t') {
+                            hori_advance = tab_width * (1 + hori_advance / tab_width);;
+                            continue;
+                        }
+                        if (ch == 0x03) { // ETX
+                            continue;
+                        }
 
-                    hori_advance += glyph_hori_advance;
+                        auto glyph = font->getGlyph(ch);
+                        int glyph_hori_advance = glyph.horiAdvance / 64;
+
+                        hori_advance += glyph_hori_advance;
+                    }
+                    ln->bounding_width = hori_advance;
+                    bounding_width = gfxm::_max(ln->bounding_width, bounding_width);
                 }
-                ln->bounding_width = hori_advance;
-                bounding_width = gfxm::_max(ln->bounding_width, bounding_width);
-            }
-            bounding_width += pad_left + pad_right;
+                bounding_width += pad_left + pad_right;
 
-            if(!height_constraint.has_value()) {
-                bounding_height = lines_wrapped.size() * line_height + pad_top + pad_bottom;
-            } else {
-                bounding_height = height_constraint.value();
+                if(!height_constraint.has_value()) {
+                    bounding_height = lines_wrapped.size() * line_height + pad_top + pad_bottom;
+                } else {
+                    bounding_height = height_constraint.value();
+                }
             }
         }
     }
@@ -207,11 +292,15 @@ void TextLayout::build(BuildMode build_mode) {
         dirty_flags &= ~DIRTY_WRAPPING;
         dirty_flags |= DIRTY_GLYPHS | DIRTY_PADDING;
 
+        // Each natural line wraps on its own, only the ones from the first changed line on are wrapped again
+        const int first_line = _firstDirtyLine();
+        const int first_wrapped = _firstDirtyWrappedLine();
+        lines_wrapped.resize(first_wrapped);
+
         if(width_constraint.has_value()) {
-            lines_wrapped.clear();
             lines_wrapped.reserve(lines.size());
 
-            for (int i = 0; i < lines.size(); ++i) {
+            for (int i = first_line; i < lines.size(); ++i) {
                 Line* ln = &lines[i];
                 Line* ln_wrapped = &lines_wrapped.emplace_back(*ln);
 
@@ -264,7 +353,7 @@ void TextLayout::build(BuildMode build_mode) {
                 }
             }
         } else {
-            lines_wrapped = lines;
+            lines_wrapped.insert(lines_wrapped.end(), lines.begin() + first_line, lines.end());
         }
 
         // Measure line widths
@@ -273,7 +362,7 @@ void TextLayout::build(BuildMode build_mode) {
             tab_width = space_width * SPACES_PER_TAB;
             line_height = font->getLineHeight();
 
-            for (int i = 0; i < lines_wrapped.size(); ++i) {
+            for (int i = first_wrapped; i < lines_wrapped.size(); ++i) {
                 Line* ln = &lines_wrapped[i];
                 ln->y_baseline = ascender + line_height * i;
                 int hori_advance = 0;
@@ -311,13 +400,7 @@ void TextLayout::build(BuildMode build_mode) {
                 bounding_width_no_pad = bounding_width - (pad_left + pad_right);
             }
 
-            if(!height_constraint.has_value()) {
-                bounding_height_no_pad = lines_wrapped.size() * line_height;
-                bounding_height = bounding_height_no_pad + pad_top + pad_bottom;
-            } else {
-                bounding_height = height_constraint.value();
-                bounding_height_no_pad = bounding_height - (pad_top + pad_bottom);
-            }
+            _measureHeight();
         }
     }
 
@@ -329,6 +412,9 @@ void TextLayout::build(BuildMode build_mode) {
     if(dirty_flags & DIRTY_GLYPHS) {
         dirty_flags &= ~DIRTY_GLYPHS;
 
+        // setHeight() only invalidates glyphs
+        _measureHeight();
+
         float halign_mul = .0f;
         float valign_mul = .0f;
         switch (hori_align) {
@@ -344,9 +430,18 @@ void TextLayout::build(BuildMode build_mode) {
 
         const int valign_offset = (bounding_height_no_pad - lines_wrapped.size() * line_height) * valign_mul;
 
-        glyphs.clear();
-        for (int n_line = 0; n_line < lines_wrapped.size(); ++n_line) {
+        // Alignment offsets are baked into glyphs, lines before the edit keep theirs only if the text block did not change size
+        int first_wrapped = _firstDirtyWrappedLine();
+        if ((halign_mul != .0f && glyphs_width_no_pad != bounding_width_no_pad) || glyphs_valign_offset != valign_offset) {
+            first_wrapped = 0;
+        }
+        glyphs_width_no_pad = bounding_width_no_pad;
+        glyphs_valign_offset = valign_offset;
+
+        glyphs.resize(first_wrapped > 0 ? lines_wrapped[first_wrapped - 1].glyph_end : 0);
+        for (int n_line = first_wrapped; n_line < lines_wrapped.size(); ++n_line) {
             Line* ln = &lines_wrapped[n_line];
+            ln->glyph_begin = glyphs.size();
 
             const int halign_offset = (bounding_width_no_pad - ln->bounding_width) * halign_mul;
 
@@ -437,7 +532,10 @@ void TextLayout::build(BuildMode build_mode) {
                 hori_advance += glyph_advance;
             }
             ln->x_end = halign_offset + hori_advance;
+            ln->glyph_end = glyphs.size();
         }
+
+        dirty_begin = INT_MAX;
     }
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <limits.h>
 #include <stack>
 #include "math/gfxm.hpp"
 #include "typeface/font.hpp"
@@ -97,6 +98,9 @@ struct TextLayout {
     };
 
     uint32_t dirty_flags = 0;
+    // First decoded character whose layout is out of date, build() keeps lines and glyphs before it.
+    // setString() does not move it, the DIRTY_LINES pass diffs the new string against string_decoded
+    int dirty_begin = 0;
 
     SPACE space = Y_DOWN;
     uint32_t base_color = 0xFFFFFFFF;
@@ -133,7 +137,16 @@ struct TextLayout {
     int bounding_width_no_pad = 0, bounding_height_no_pad = 0;
     int box_height = 0;
 
+    // Inputs the current glyphs were built with, glyphs before dirty_begin are reused only if these still match
+    int glyphs_width_no_pad = 0;
+    int glyphs_valign_offset = 0;
+    uint32_t glyphs_color = 0;
+
     bool _is_space(uint32_t ch);
+    void _invalidate(uint32_t flags);
+    int _firstDirtyLine();
+    int _firstDirtyWrappedLine();
+    void _measureHeight();
 
     void _beginSpanQuad(int line_idx, uint32_t col, int x);
     void _endSpanQuad(int x);
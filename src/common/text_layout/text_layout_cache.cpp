@@ -0,0 +1,82 @@
+#include "text_layout_cache.hpp"
+
+
+uint64_t TextLayoutCache::makeKey(const std::string& str, Font* font, int max_width, TextLayout::HALIGN halign) {
+    constexpr uint64_t FNV_OFFSET = 14695981039346656037ULL;
+    constexpr uint64_t FNV_PRIME  = 1099511628211ULL;
+
+    uint64_t hash = FNV_OFFSET;
+    for (int i = 0; i < str.size(); ++i) {
+        hash ^= uint8_t(str[i]);
+        hash *= FNV_PRIME;
+    }
+    const uint64_t params[] = { uint64_t(uintptr_t(font)), uint64_t(uint32_t(max_width)), uint64_t(halign) };
+    for (int i = 0; i < sizeof(params) / sizeof(params[0]); ++i) {
+        hash ^= params[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+TextLayoutCache::TextLayoutCache(int max_unused_frames)
+: max_unused_frames(max_unused_frames) {}
+
+const TextLayoutCache::Entry& TextLayoutCache::get(const std::string& str, Font* font, int max_width, TextLayout::HALIGN halign) {
+    const uint64_t key = makeKey(str, font, max_width, halign);
+    auto& slot = entries[key];
+    if (!slot) {
+        slot.reset(new Entry);
+    }
+    Entry* e = slot.get();
+    e->last_used_frame = frame;
+
+    // Font::init() hands out new glyph cache indices, atlas growth bumps the generation too, but is rare
+    if (e->font == font
+        && e->font_generation == font->getAtlasGeneration()
+        && e->max_width == max_width
+        && e->halign == halign
+        && e->str == str
+    ) {
+        ++hits;
+        return *e;
+    }
+    ++misses;
+
+    // New key or a hash collision, either way the slot is rebuilt for this request
+    e->str = str;
+    e->font = font;
+    e->max_width = max_width;
+    e->halign = halign;
+
+    e->layout.build(e->str, font, max_width);
+    if (halign != TextLayout::HALIGN_LEFT) {
+        e->layout.alignHorizontal(halign, max_width);
+    }
+    e->font_generation = font->getAtlasGeneration();
+
+    e->quads.clear();
+    e->quads.reserve(e->layout.glyphs.size());
+    for (int i = 0; i < e->layout.glyphs.size(); ++i) {
+        const auto& g = e->layout.glyphs[i];
+        if (!g.renderable) {
+            continue;
+        }
+        e->quads.push_back(g.makeQuad());
+    }
+    return *e;
+}
+
+void TextLayoutCache::endFrame() {
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (frame - it->second->last_used_frame >= max_unused_frames) {
+            it = entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    ++frame;
+}
+
+void TextLayoutCache::clear() {
+    entries.clear();
+}
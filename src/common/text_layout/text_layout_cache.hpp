@@ -0,0 +1,49 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "text_layout.hpp"
+
+
+constexpr int TEXT_LAYOUT_CACHE_MAX_UNUSED_FRAMES = 60;
+
+// Finished layouts for immediate mode text (debug overlays, hud labels, log lines)
+// that is laid out again every frame, mostly unchanged.
+// Keyed by (string, font, max width, alignment), get() only builds on a miss.
+// Entries not requested for max_unused_frames endFrame() calls are dropped
+class TextLayoutCache {
+public:
+    struct Entry {
+        std::string str;
+        Font* font = nullptr;
+        int font_generation = 0;
+        int max_width = -1;
+        TextLayout::HALIGN halign = TextLayout::HALIGN_LEFT;
+        uint64_t last_used_frame = 0;
+
+        TextLayout layout;
+        // Renderable glyphs only
+        std::vector<TextLayout::Quad> quads;
+    };
+private:
+    std::unordered_map<uint64_t, std::unique_ptr<Entry>> entries;
+    uint64_t frame = 0;
+    int max_unused_frames = TEXT_LAYOUT_CACHE_MAX_UNUSED_FRAMES;
+    int hits = 0;
+    int misses = 0;
+
+    static uint64_t makeKey(const std::string& str, Font* font, int max_width, TextLayout::HALIGN halign);
+public:
+    TextLayoutCache(int max_unused_frames = TEXT_LAYOUT_CACHE_MAX_UNUSED_FRAMES);
+
+    // The entry stays valid until the next endFrame() or clear()
+    const Entry& get(const std::string& str, Font* font, int max_width = -1, TextLayout::HALIGN halign = TextLayout::HALIGN_LEFT);
+
+    void endFrame();
+    void clear();
+
+    size_t size() const { return entries.size(); }
+    int getHitCount() const { return hits; }
+    int getMissCount() const { return misses; }
+};
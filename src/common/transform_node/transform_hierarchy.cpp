@@ -0,0 +1,426 @@
+#include "transform_hierarchy.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include "transform_node.hpp"
+#include "util/thread_pool.hpp"
+#include "log/log.hpp"
+
+
+// parent * T * R * S, the local part is affine so its bottom row is never multiplied
+static inline void composeWorldTransform(
+    const gfxm::mat4& parent,
+    const gfxm::vec3& t, const gfxm::quat& r, const gfxm::vec3& s,
+    gfxm::mat4& out
+) {
+    const gfxm::mat3 rot = gfxm::to_mat3(r);
+    const gfxm::vec4 p0 = parent[0];
+    const gfxm::vec4 p1 = parent[1];
+    const gfxm::vec4 p2 = parent[2];
+    const gfxm::vec4 p3 = parent[3];
+    for (int c = 0; c < 3; ++c) {
+        const gfxm::vec3 axis = rot[c] * s[c];
+        out[c] = p0 * axis.x + p1 * axis.y + p2 * axis.z;
+    }
+    out[3] = p0 * t.x + p1 * t.y + p2 * t.z + p3;
+}
+
+// What TransformNode::_getParentTransform() passes down when a node doesn't inherit everything
+static gfxm::mat4 partialParentTransform(const gfxm::mat4& parent, uint32_t flags) {
+    gfxm::vec3 parent_pos(0, 0, 0);
+    gfxm::quat parent_rot(0, 0, 0, 1);
+    gfxm::vec3 parent_scl(1, 1, 1);
+    if (flags & TRANSFORM_INHERIT_POSITION) {
+        parent_pos = parent[3];
+    }
+    if (flags & TRANSFORM_INHERIT_ROTATION) {
+        parent_rot = gfxm::to_quat(gfxm::to_orient_mat3(parent));
+    }
+    if (flags & TRANSFORM_INHERIT_SCALE) {
+        parent_scl = gfxm::vec3(
+            gfxm::vec3(parent[0]).length(),
+            gfxm::vec3(parent[1]).length(),
+            gfxm::vec3(parent[2]).length()
+        );
+    }
+    return gfxm::translate(gfxm::mat4(1.f), parent_pos)
+        * gfxm::to_mat4(parent_rot)
+        * gfxm::scale(gfxm::mat4(1.f), parent_scl);
+}
+
+
+void TransformHierarchy::_markDirty(uint32_t slot) {
+    const int block_id = slot_blocks[slot];
+    TransformHierarchyBlock& block = blocks[block_id];
+    if (!block.is_pending) {
+        block.is_pending = true;
+        pending_blocks.push_back(block_id);
+    }
+    const uint32_t end = subtree_ends[slot];
+    if (block.listener_count == 0) {
+        if (!dirty_flags[slot]) {
+            memset(&dirty_flags[slot], 1, end - slot);
+        }
+        return;
+    }
+
+    // Same notification order as TransformNode::dirty()
+    if (nodes[slot].isValid()) {
+        nodes[slot]->_callDirtyCallback();
+    }
+    _fireTickets(slot);
+    if (dirty_flags[slot]) {
+        return;
+    }
+    uint32_t i = slot;
+    while (i < end) {
+        TransformNode* node = nodes[i].isValid() ? nodes[i].deref() : nullptr;
+        if (i != slot) {
+            if (node) {
+                node->_callDirtyCallback();
+            }
+            // Already dirty means everything under it is too
+            if (dirty_flags[i]) {
+                i = subtree_ends[i];
+                continue;
+            }
+        }
+        dirty_flags[i] = 1;
+        if (node) {
+            for (auto ch = node->first_child; ch.isValid(); ch = ch->next_sibling) {
+                ch->dirty();
+            }
+        }
+        ++i;
+    }
+}
+
+void TransformHierarchy::_fireTickets(uint32_t slot) {
+    if (blocks[slot_blocks[slot]].listener_count == 0) {
+        return;
+    }
+    const uint32_t generation = TransformSystem::getGeneration();
+    const uint32_t end = subtree_ends[slot];
+    uint32_t i = slot;
+    while (i < end) {
+        if (generations[i] == generation) {
+            i = subtree_ends[i];
+            continue;
+        }
+        generations[i] = generation;
+        if (nodes[i].isValid()) {
+            TransformNode* node = nodes[i].deref();
+            node->_fireOwnTickets();
+            for (auto ch = node->first_child; ch.isValid(); ch = ch->next_sibling) {
+                ch->_fireTickets();
+            }
+        }
+        ++i;
+    }
+}
+
+void TransformHierarchy::_addListeners(uint32_t slot, int count) {
+    TransformHierarchyBlock& block = blocks[slot_blocks[slot]];
+    block.listener_count += count;
+    assert(block.listener_count >= 0);
+}
+
+void TransformHierarchy::_updateRoots(const TransformHierarchyBlock& block) {
+    static const gfxm::mat4 identity = gfxm::mat4(1.f);
+    const uint32_t end = block.first + block.count;
+    for (uint32_t i = block.first; i < end; i = subtree_ends[i]) {
+        if (!dirty_flags[i]) {
+            continue;
+        }
+        if (nodes[i].isValid() && nodes[i]->parent.isValid()) {
+            composeWorldTransform(nodes[i]->_getParentTransform(), translations[i], rotations[i], scales[i], world_transforms[i]);
+        } else {
+            composeWorldTransform(identity, translations[i], rotations[i], scales[i], world_transforms[i]);
+        }
+        dirty_flags[i] = 0;
+    }
+}
+
+void TransformHierarchy::_updateRange(uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; ++i) {
+        if (!dirty_flags[i]) {
+            continue;
+        }
+        assert(parents[i] >= 0);
+        if (inherit_flags[i] == TRANSFORM_INHERIT_ALL) {
+            composeWorldTransform(world_transforms[parents[i]], translations[i], rotations[i], scales[i], world_transforms[i]);
+        } else {
+            composeWorldTransform(
+                partialParentTransform(world_transforms[parents[i]], inherit_flags[i]),
+                translations[i], rotations[i], scales[i], world_transforms[i]
+            );
+        }
+        dirty_flags[i] = 0;
+    }
+}
+
+void TransformHierarchy::_updateBlock(TransformHierarchyBlock& block) {
+    // Roots first, they may read matrices from outside the block
+    _updateRoots(block);
+    _updateRange(block.first, block.first + block.count);
+    block.is_pending = false;
+}
+
+int TransformHierarchy::createBlock(const Handle<TransformNode>* in_nodes, const int* parent_array, int count) {
+    if (count <= 0) {
+        return -1;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (parent_array[i] < -1 || parent_array[i] >= count || parent_array[i] == i) {
+            LOG_ERR("TransformHierarchy: invalid parent index " << parent_array[i] << " at " << i);
+            return -1;
+        }
+        if (!in_nodes[i].isValid() || in_nodes[i]->hierarchy) {
+            LOG_ERR("TransformHierarchy: node " << i << " is invalid or already in a hierarchy");
+            return -1;
+        }
+    }
+
+    // Children of each node, to walk the tree depth first
+    std::vector<int> child_offsets(count + 1, 0);
+    std::vector<int> children(count);
+    for (int i = 0; i < count; ++i) {
+        if (parent_array[i] >= 0) {
+            ++child_offsets[parent_array[i] + 1];
+        }
+    }
+    for (int i = 0; i < count; ++i) {
+        child_offsets[i + 1] += child_offsets[i];
+    }
+    {
+        std::vector<int> fill(child_offsets.begin(), child_offsets.end() - 1);
+        for (int i = 0; i < count; ++i) {
+            if (parent_array[i] >= 0) {
+                children[fill[parent_array[i]]++] = i;
+            }
+        }
+    }
+    std::vector<int> order;
+    order.reserve(count);
+    std::vector<int> stack;
+    for (int root = 0; root < count; ++root) {
+        if (parent_array[root] != -1) {
+            continue;
+        }
+        stack.push_back(root);
+        while (!stack.empty()) {
+            int n = stack.back();
+            stack.pop_back();
+            order.push_back(n);
+            for (int c = child_offsets[n + 1] - 1; c >= child_offsets[n]; --c) {
+                stack.push_back(children[c]);
+            }
+        }
+    }
+    if (order.size() != count) {
+        LOG_ERR("TransformHierarchy: parent array contains a cycle");
+        return -1;
+    }
+
+    int block_id;
+    if (!free_blocks.empty()) {
+        block_id = free_blocks.back();
+        free_blocks.pop_back();
+    } else {
+        block_id = (int)blocks.size();
+        blocks.emplace_back();
+    }
+
+    const uint32_t first = (uint32_t)nodes.size();
+    const uint32_t new_size = first + count;
+    parents.resize(new_size);
+    subtree_ends.resize(new_size);
+    slot_blocks.resize(new_size, block_id);
+    translations.resize(new_size);
+    rotations.resize(new_size);
+    scales.resize(new_size);
+    world_transforms.resize(new_size);
+    inherit_flags.resize(new_size);
+    dirty_flags.resize(new_size, 1);
+    generations.resize(new_size, -1);
+    input_slots.resize(new_size);
+    nodes.resize(new_size);
+
+    TransformHierarchyBlock& block = blocks[block_id];
+    block = TransformHierarchyBlock();
+    block.first = first;
+    block.count = count;
+    block.is_alive = true;
+
+    std::vector<uint32_t> slots(count);
+    for (int k = 0; k < count; ++k) {
+        slots[order[k]] = first + k;
+        input_slots[first + order[k]] = k;
+    }
+    for (int k = 0; k < count; ++k) {
+        const int i = order[k];
+        const uint32_t slot = first + k;
+        const int parent_idx = parent_array[i];
+        Handle<TransformNode> node = in_nodes[i];
+
+        parents[slot] = parent_idx < 0 ? -1 : (int32_t)slots[parent_idx];
+        subtree_ends[slot] = slot + 1;
+        translations[slot] = node->translation;
+        rotations[slot] = node->rotation;
+        scales[slot] = node->scale;
+        world_transforms[slot] = gfxm::mat4(1.f);
+        inherit_flags[slot] = (uint8_t)node->inherit_flags;
+        nodes[slot] = node;
+
+        // Links inside the block are kept by the parent array only
+        if (parent_idx >= 0) {
+            if (node->parent.isValid()) {
+                node->parent->_eraseChild(node);
+            }
+            node->parent = in_nodes[parent_idx];
+        }
+        block.listener_count += node->_listenerCount();
+        node->hierarchy = this;
+        node->hierarchy_slot = slot;
+    }
+    for (uint32_t slot = new_size; slot-- > first;) {
+        if (parents[slot] >= 0) {
+            subtree_ends[parents[slot]] = std::max(subtree_ends[parents[slot]], subtree_ends[slot]);
+        }
+    }
+
+    block.is_pending = true;
+    pending_blocks.push_back(block_id);
+    return block_id;
+}
+
+void TransformHierarchy::destroyBlock(int block_id) {
+    if (block_id < 0 || block_id >= blocks.size() || !blocks[block_id].is_alive) {
+        assert(false);
+        return;
+    }
+    const TransformHierarchyBlock block = blocks[block_id];
+    const uint32_t end = block.first + block.count;
+
+    for (uint32_t slot = block.first; slot < end; ++slot) {
+        if (!nodes[slot].isValid()) {
+            continue;
+        }
+        TransformNode* node = nodes[slot].deref();
+        node->translation = translations[slot];
+        node->rotation = rotations[slot];
+        node->scale = scales[slot];
+        node->dirty_ = true;
+        node->hierarchy = nullptr;
+        node->hierarchy_slot = 0;
+    }
+    for (uint32_t slot = block.first; slot < end; ++slot) {
+        if (parents[slot] < 0 || !nodes[slot].isValid()) {
+            continue;
+        }
+        nodes[slot]->parent = Handle<TransformNode>();
+        if (nodes[parents[slot]].isValid()) {
+            transformNodeAttach(nodes[parents[slot]], nodes[slot]);
+        }
+    }
+
+    // Close the gap, slots of the blocks after this one move down
+    parents.erase(parents.begin() + block.first, parents.begin() + end);
+    subtree_ends.erase(subtree_ends.begin() + block.first, subtree_ends.begin() + end);
+    slot_blocks.erase(slot_blocks.begin() + block.first, slot_blocks.begin() + end);
+    translations.erase(translations.begin() + block.first, translations.begin() + end);
+    rotations.erase(rotations.begin() + block.first, rotations.begin() + end);
+    scales.erase(scales.begin() + block.first, scales.begin() + end);
+    world_transforms.erase(world_transforms.begin() + block.first, world_transforms.begin() + end);
+    inherit_flags.erase(inherit_flags.begin() + block.first, inherit_flags.begin() + end);
+    dirty_flags.erase(dirty_flags.begin() + block.first, dirty_flags.begin() + end);
+    generations.erase(generations.begin() + block.first, generations.begin() + end);
+    input_slots.erase(input_slots.begin() + block.first, input_slots.begin() + end);
+    nodes.erase(nodes.begin() + block.first, nodes.begin() + end);
+    for (uint32_t slot = block.first; slot < nodes.size(); ++slot) {
+        if (parents[slot] >= 0) {
+            parents[slot] -= block.count;
+        }
+        subtree_ends[slot] -= block.count;
+        if (nodes[slot].isValid()) {
+            nodes[slot]->hierarchy_slot = slot;
+        }
+    }
+    for (auto& b : blocks) {
+        if (b.is_alive && b.first > block.first) {
+            b.first -= block.count;
+        }
+    }
+    // The id can be reused by createBlock() before the next update()
+    if (block.is_pending) {
+        pending_blocks.erase(std::remove(pending_blocks.begin(), pending_blocks.end(), block_id), pending_blocks.end());
+    }
+
+    blocks[block_id] = TransformHierarchyBlock();
+    free_blocks.push_back(block_id);
+}
+
+void TransformHierarchy::setLocalTransforms(
+    int block_id, int first, int count,
+    const gfxm::vec3* translation, const gfxm::quat* rotation, const gfxm::vec3* scale, size_t stride
+) {
+    if (block_id < 0 || block_id >= blocks.size() || !blocks[block_id].is_alive) {
+        assert(false);
+        return;
+    }
+    const TransformHierarchyBlock& block = blocks[block_id];
+    assert(first >= 0 && first + count <= block.count);
+    const uint32_t* block_slots = &input_slots[block.first + first];
+    const uint8_t* t = (const uint8_t*)translation;
+    const uint8_t* r = (const uint8_t*)rotation;
+    const uint8_t* s = (const uint8_t*)scale;
+    for (int i = 0; i < count; ++i) {
+        const uint32_t slot = block.first + block_slots[i];
+        translations[slot] = *(const gfxm::vec3*)(t + i * stride);
+        rotations[slot] = *(const gfxm::quat*)(r + i * stride);
+        scales[slot] = *(const gfxm::vec3*)(s + i * stride);
+        _markDirty(slot);
+    }
+}
+
+void TransformHierarchy::update(ThreadPool* pool) {
+    update_blocks.clear();
+    // Roots are done here on the calling thread, they can pull in
+    // nodes from outside the block that update lazily
+    for (int i = 0; i < pending_blocks.size(); ++i) {
+        TransformHierarchyBlock& block = blocks[pending_blocks[i]];
+        if (!block.is_alive || !block.is_pending) {
+            continue;
+        }
+        // Cleared right away so a block listed twice is only updated once
+        block.is_pending = false;
+        _updateRoots(block);
+        update_blocks.push_back(pending_blocks[i]);
+    }
+    pending_blocks.clear();
+
+    const int block_count = (int)update_blocks.size();
+    if (!pool || pool->getThreadCount() == 1 || block_count < 2) {
+        for (int i = 0; i < block_count; ++i) {
+            const TransformHierarchyBlock& block = blocks[update_blocks[i]];
+            _updateRange(block.first, block.first + block.count);
+        }
+    } else {
+        const int job_count = std::min(block_count, pool->getThreadCount() * 4);
+        pool->run(job_count, [this, block_count, job_count](int job) {
+            const int begin = block_count * job / job_count;
+            const int end = block_count * (job + 1) / job_count;
+            for (int i = begin; i < end; ++i) {
+                const TransformHierarchyBlock& block = blocks[update_blocks[i]];
+                _updateRange(block.first, block.first + block.count);
+            }
+        });
+    }
+}
+
+const gfxm::mat4& TransformHierarchy::getWorldTransform(uint32_t slot) {
+    if (dirty_flags[slot]) {
+        _updateBlock(blocks[slot_blocks[slot]]);
+    }
+    return world_transforms[slot];
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "math/gfxm.hpp"
+#include "handle/handle.hpp"
+
+
+class TransformNode;
+class ThreadPool;
+
+// Flat storage for transform nodes that form a fixed tree, like the bones of a skeleton instance
+// Each tree is a block of slots in depth first order: a parent always comes before its children
+// and everything under a node is one contiguous range of slots.
+// Local TRS and world matrices are kept in parallel arrays, marking a node dirty only sets flags
+// over its range, world matrices are rebuilt by a linear pass over the block when one is read,
+// or for every pending block at once in update()
+// Bound nodes keep working through their handles as before, only their data lives here
+// Dirty callbacks can fire a little more often than with linked nodes: reading any node
+// brings the whole block up to date, so the next change notifies everything under it again
+
+struct TransformHierarchyBlock {
+    uint32_t first = 0;
+    uint32_t count = 0;
+    int listener_count = 0; // dirty callbacks, tickets and outside children on the block's nodes
+    bool is_pending = false;
+    bool is_alive = false;
+};
+
+class TransformHierarchy {
+    friend TransformNode;
+
+    std::vector<int32_t> parents;       // parent slot, -1 for block roots
+    std::vector<uint32_t> subtree_ends; // one past the last slot under this one
+    std::vector<uint32_t> slot_blocks;
+    std::vector<gfxm::vec3> translations;
+    std::vector<gfxm::quat> rotations;
+    std::vector<gfxm::vec3> scales;
+    std::vector<gfxm::mat4> world_transforms;
+    std::vector<uint8_t> inherit_flags; // TRANSFORM_INHERIT_*, roots read theirs from the node
+    std::vector<uint8_t> dirty_flags;
+    std::vector<uint32_t> generations;  // For dirty tickets
+    std::vector<uint32_t> input_slots;  // k-th node passed to createBlock() -> its slot, relative to the block
+    std::vector<Handle<TransformNode>> nodes;
+
+    std::vector<TransformHierarchyBlock> blocks;
+    std::vector<int> free_blocks;
+    std::vector<int> pending_blocks;
+    std::vector<int> update_blocks;
+
+    void _markDirty(uint32_t slot);
+    void _fireTickets(uint32_t slot);
+    void _addListeners(uint32_t slot, int count);
+    void _updateRoots(const TransformHierarchyBlock& block);
+    void _updateRange(uint32_t begin, uint32_t end);
+    void _updateBlock(TransformHierarchyBlock& block);
+public:
+    // Binds 'count' nodes, parent_array holds indices into 'nodes', -1 for roots.
+    // Roots keep whatever parent they already have outside of the block.
+    // Returns the block id or -1 if the parent array doesn't form a tree
+    int createBlock(const Handle<TransformNode>* nodes, const int* parent_array, int count);
+    // Nodes that are still alive get their data back and are linked as a regular tree
+    void destroyBlock(int block);
+
+    // Local TRS of 'count' nodes of a block starting at 'first', numbered the way they were passed to createBlock()
+    // Values are read 'stride' bytes apart, so arrays of structs can be passed as they are
+    // Does what the three setters on each node would, but marks every node dirty once
+    void setLocalTransforms(
+        int block, int first, int count,
+        const gfxm::vec3* translation, const gfxm::quat* rotation, const gfxm::vec3* scale, size_t stride
+    );
+
+    // Rebuilds world matrices of every block with dirty nodes
+    // Blocks are spread over the pool if one is given
+    void update(ThreadPool* pool = nullptr);
+
+    int slotCount() const { return (int)nodes.size(); }
+    int pendingBlockCount() const { return (int)pending_blocks.size(); }
+
+    // References stay valid until the next createBlock() or destroyBlock()
+    const gfxm::mat4& getWorldTransform(uint32_t slot);
+};
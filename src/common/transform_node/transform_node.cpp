@@ -1,5 +1,7 @@
 #include "transform_node.hpp"
 
+#include "transform_hierarchy.hpp"
+
 
 int TransformNode::addDirtyCallback(pfn_transform_callback_t cb, void* context) {
     static int next_dirty_callback_id = 0;
@@ -16,6 +18,9 @@ int TransformNode::addDirtyCallback(pfn_transform_callback_t cb, void* context)
     uptr->next = 0;
     uptr->context = context;
 
+    if (hierarchy) {
+        _addListeners(1);
+    }
     return uptr->id;
 }
 
@@ -26,10 +31,16 @@ void TransformNode::removeDirtyCallback(int id) {
     }
     if (*upptr) {
         (*upptr) = std::move((*upptr)->next);
+        if (hierarchy) {
+            _addListeners(-1);
+        }
     }
 }
 
 void TransformNode::attachTicket(TransformTicket* t) {
+    if (hierarchy) {
+        _addListeners(1);
+    }
     if (first_ticket == nullptr) {
         first_ticket = t;
         t->next = nullptr;
@@ -45,6 +56,9 @@ void TransformNode::attachTicket(TransformTicket* t) {
     t->markDirty();
 }
 void TransformNode::detachTicket(TransformTicket* t) {
+    if (hierarchy) {
+        _addListeners(-1);
+    }
     if (t == first_ticket) {
         first_ticket = first_ticket->next;
         t->next = nullptr;
@@ -65,14 +79,23 @@ void TransformNode::translate(float x, float y, float z) {
     translate(gfxm::vec3(x, y, z));
 }
 void TransformNode::translate(const gfxm::vec3& t) {
+    if (hierarchy) {
+        hierarchy->translations[hierarchy_slot] += t;
+        hierarchy->_markDirty(hierarchy_slot);
+        return;
+    }
     translation += t;
     dirty();
 }
 void TransformNode::rotate(float angle, const gfxm::vec3& axis) {
-    rotation = gfxm::angle_axis(angle, axis) * rotation;
-    dirty();
+    rotate(gfxm::angle_axis(angle, axis));
 }
 void TransformNode::rotate(const gfxm::quat& q) {
+    if (hierarchy) {
+        hierarchy->rotations[hierarchy_slot] = q * hierarchy->rotations[hierarchy_slot];
+        hierarchy->_markDirty(hierarchy_slot);
+        return;
+    }
     rotation = q * rotation;
     dirty();
 }
@@ -80,51 +103,114 @@ void TransformNode::rotate(const gfxm::quat& q) {
 void TransformNode::setTranslation(float x, float y, float z) {
     setTranslation(gfxm::vec3(x, y, z));
 }
+void TransformNode::setInheritFlags(transform_inherit_flags_t flags) {
+    inherit_flags = flags;
+    if (hierarchy) {
+        hierarchy->inherit_flags[hierarchy_slot] = (uint8_t)flags;
+    }
+}
 void TransformNode::setTranslation(const gfxm::vec3& t) {
+    if (hierarchy) {
+        hierarchy->translations[hierarchy_slot] = t;
+        hierarchy->_markDirty(hierarchy_slot);
+        return;
+    }
     translation = t;
     dirty();
 }
 void TransformNode::setRotation(const gfxm::quat& q) {
+    if (hierarchy) {
+        hierarchy->rotations[hierarchy_slot] = q;
+        hierarchy->_markDirty(hierarchy_slot);
+        return;
+    }
     rotation = q;
     dirty();
 }
 void TransformNode::setScale(const gfxm::vec3& s) {
+    if (hierarchy) {
+        hierarchy->scales[hierarchy_slot] = s;
+        hierarchy->_markDirty(hierarchy_slot);
+        return;
+    }
     scale = s;
     dirty();
 }
 
+const gfxm::vec3& TransformNode::getTranslation() const {
+    return hierarchy ? hierarchy->translations[hierarchy_slot] : translation;
+}
+const gfxm::quat& TransformNode::getRotation() const {
+    return hierarchy ? hierarchy->rotations[hierarchy_slot] : rotation;
+}
+const gfxm::vec3& TransformNode::getScale() const {
+    return hierarchy ? hierarchy->scales[hierarchy_slot] : scale;
+}
+
+
+void TransformNode::_dirtyBound() {
+    hierarchy->_markDirty(hierarchy_slot);
+}
+void TransformNode::_fireTicketsBound() {
+    hierarchy->_fireTickets(hierarchy_slot);
+}
+void TransformNode::_addListeners(int count) {
+    hierarchy->_addListeners(hierarchy_slot, count);
+}
+int TransformNode::_listenerCount() const {
+    int count = 0;
+    for (auto cb = dirty_callback.get(); cb; cb = cb->next.get()) {
+        ++count;
+    }
+    for (auto t = first_ticket; t; t = t->next) {
+        ++count;
+    }
+    for (auto ch = first_child; ch.isValid(); ch = ch->next_sibling) {
+        ++count;
+    }
+    return count;
+}
+void TransformNode::_unbind() {
+    hierarchy->_addListeners(hierarchy_slot, -_listenerCount());
+    hierarchy->nodes[hierarchy_slot] = Handle<TransformNode>();
+    hierarchy = nullptr;
+}
+
+gfxm::mat4 TransformNode::_getParentTransform() const {
+    if((inherit_flags & TRANSFORM_INHERIT_ALL) == TRANSFORM_INHERIT_ALL) {
+        return parent->getWorldTransform();
+    }
+    gfxm::vec3 parent_pos(0, 0, 0);
+    gfxm::quat parent_rot(0, 0, 0, 1);
+    gfxm::vec3 parent_scl(1, 1, 1);
+    if (inherit_flags & TRANSFORM_INHERIT_POSITION) {
+        parent_pos = parent->getWorldTranslation();
+    }
+    if (inherit_flags & TRANSFORM_INHERIT_ROTATION) {
+        parent_rot = parent->getWorldRotation();
+    }
+    if (inherit_flags & TRANSFORM_INHERIT_SCALE) {
+        parent_scl = parent->getWorldScale();
+    }
+    return gfxm::translate(gfxm::mat4(1.f), parent_pos)
+        * gfxm::to_mat4(parent_rot)
+        * gfxm::scale(gfxm::mat4(1.f), parent_scl);
+}
 
 gfxm::mat4 TransformNode::getLocalTransform() const {
-    return gfxm::translate(gfxm::mat4(1.0f), translation)
-        * gfxm::to_mat4(rotation)
-        * gfxm::scale(gfxm::mat4(1.0f), scale);
+    return gfxm::translate(gfxm::mat4(1.0f), getTranslation())
+        * gfxm::to_mat4(getRotation())
+        * gfxm::scale(gfxm::mat4(1.0f), getScale());
 }
 const gfxm::mat4& TransformNode::getWorldTransform() const {
+    if (hierarchy) {
+        return hierarchy->getWorldTransform(hierarchy_slot);
+    }
     if (!dirty_) {
         return world_transform;
     } else {
         if (parent.isValid()) {
-            if((inherit_flags & TRANSFORM_INHERIT_ALL) == TRANSFORM_INHERIT_ALL) {
-                world_transform = parent->getWorldTransform() * getLocalTransform();
-            } else {
-                gfxm::vec3 parent_pos(0, 0, 0);
-                gfxm::quat parent_rot(0, 0, 0, 1);
-                gfxm::vec3 parent_scl(1, 1, 1);
-                if (inherit_flags & TRANSFORM_INHERIT_POSITION) {
-                    parent_pos = parent->getWorldTranslation();
-                }
-                if (inherit_flags & TRANSFORM_INHERIT_ROTATION) {
-                    parent_rot = parent->getWorldRotation();
-                }
-                if (inherit_flags & TRANSFORM_INHERIT_SCALE) {
-                    parent_scl = parent->getWorldScale();
-                }
-                gfxm::mat4 parent_trs
-                    = gfxm::translate(gfxm::mat4(1.f), parent_pos)
-                    * gfxm::to_mat4(parent_rot)
-                    * gfxm::scale(gfxm::mat4(1.f), parent_scl);
-                world_transform = parent_trs * getLocalTransform();
-            }
+            world_transform = _getParentTransform() * getLocalTransform();
         } else {
             world_transform = getLocalTransform();
         }
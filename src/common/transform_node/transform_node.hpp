@@ -32,10 +32,12 @@ constexpr transform_inherit_flags_t TRANSFORM_INHERIT_ALL       = TRANSFORM_INHE
                                                                 | TRANSFORM_INHERIT_SCALE;
 
 class TransformNode;
+class TransformHierarchy;
 using HTransform = Handle<TransformNode>;
 
 class TransformNode {
     friend void transformNodeAttach(Handle<TransformNode> parent, Handle<TransformNode> child);
+    friend TransformHierarchy;
 
     Handle<TransformNode> parent;
     Handle<TransformNode> next_sibling;
@@ -53,7 +55,35 @@ class TransformNode {
 
     transform_inherit_flags_t inherit_flags = TRANSFORM_INHERIT_ALL;
 
+    // Set while the node's data lives in a TransformHierarchy block
+    TransformHierarchy* hierarchy = nullptr;
+    uint32_t hierarchy_slot = 0;
+
+    void _dirtyBound();
+    void _fireTicketsBound();
+    void _addListeners(int count);
+    int _listenerCount() const;
+    gfxm::mat4 _getParentTransform() const;
+
+    void _callDirtyCallback() {
+        if (dirty_callback) {
+            dirty_callback->call();
+        }
+    }
+    void _fireOwnTickets() {
+        auto cur = first_ticket;
+        while (cur) {
+            cur->markDirty();
+            cur = cur->next;
+        }
+    }
+
     inline void dirty() {
+        if (hierarchy) {
+            _dirtyBound();
+            return;
+        }
+
         if (dirty_callback) {
             dirty_callback->call();
         }
@@ -73,16 +103,16 @@ class TransformNode {
     }
 
     void _fireTickets() {
+        if (hierarchy) {
+            _fireTicketsBound();
+            return;
+        }
         if (generation == TransformSystem::getGeneration()) {
             return;
         }
         generation = TransformSystem::getGeneration();
 
-        auto cur = first_ticket;
-        while (cur) {
-            cur->markDirty();
-            cur = cur->next;
-        }
+        _fireOwnTickets();
 
         auto ch = first_child;
         while (ch.isValid()) {
@@ -118,44 +148,63 @@ class TransformNode {
                 ch = ch->next_sibling;
             }
         }
+        if (hierarchy) {
+            _addListeners(1);
+        }
         _validateChildren();
     }
     void _eraseChild(Handle<TransformNode> child) {
+        bool erased = false;
         if (first_child == child) {
             first_child = first_child->next_sibling;
+            erased = true;
         } else {
             auto ch = first_child;
             while (ch.isValid()) {
                 if (ch->next_sibling == child) {
                     ch->next_sibling = ch->next_sibling->next_sibling;
                     child->next_sibling = Handle<TransformNode>();
+                    erased = true;
                     break;
                 }
                 ch = ch->next_sibling;
             }
         }
+        if (hierarchy && erased) {
+            _addListeners(-1);
+        }
         _validateChildren();
     }
     void _eraseChild(TransformNode* pchild) {
         if (!first_child.isValid()) {
             return;
         }
+        bool erased = false;
         if (first_child.deref() == pchild) {
             first_child = first_child->next_sibling;
+            erased = true;
         } else {
             auto ch = first_child;
             while (ch.isValid()) {
                 if (ch->next_sibling.isValid() && ch->next_sibling.deref() == pchild) {
                     ch->next_sibling = ch->next_sibling->next_sibling;
+                    erased = true;
                     break;
                 }
                 ch = ch->next_sibling;
             }
         }
+        if (hierarchy && erased) {
+            _addListeners(-1);
+        }
         _validateChildren();
     }
+    void _unbind();
 public:
     ~TransformNode() {
+        if (hierarchy) {
+            _unbind();
+        }
         if (parent.isValid()) {
             parent->_eraseChild(this);
         }
@@ -176,7 +225,7 @@ public:
         return parent;
     }
 
-    void setInheritFlags(transform_inherit_flags_t flags) { inherit_flags = flags; }
+    void setInheritFlags(transform_inherit_flags_t flags);
 
     void translate(float x, float y, float z);
     void translate(const gfxm::vec3& t);
@@ -188,9 +237,11 @@ public:
     void setRotation(const gfxm::quat& q);
     void setScale(const gfxm::vec3& s);
 
-    const gfxm::vec3& getTranslation() const { return translation; }
-    const gfxm::quat& getRotation() const { return rotation; }
-    const gfxm::vec3& getScale() const { return scale; }
+    bool isInHierarchy() const { return hierarchy != nullptr; }
+
+    const gfxm::vec3& getTranslation() const;
+    const gfxm::quat& getRotation() const;
+    const gfxm::vec3& getScale() const;
 
     gfxm::vec3 getWorldTranslation() const { return getWorldTransform()[3]; }
     gfxm::quat getWorldRotation() const { return gfxm::to_quat(gfxm::to_orient_mat3(getWorldTransform())); }
@@ -1,5 +1,7 @@
 #include "transform_system.hpp"
 
+#include "transform_hierarchy.hpp"
+
 
 uint32_t TransformSystem::generation = 0;
 
@@ -11,3 +13,10 @@ uint32_t TransformSystem::getGeneration() {
     return generation;
 }
 
+TransformHierarchy* TransformSystem::getHierarchy() {
+    static TransformHierarchy hierarchy;
+    return &hierarchy;
+}
+void TransformSystem::update(ThreadPool* pool) {
+    getHierarchy()->update(pool);
+}
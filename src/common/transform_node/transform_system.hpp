@@ -3,9 +3,16 @@
 #include <stdint.h>
 
 
+class TransformHierarchy;
+class ThreadPool;
+
 class TransformSystem {
     static uint32_t generation;
 public:
     static void nextFrame();
     static uint32_t getGeneration();
-};
\ No newline at end of file
+
+    static TransformHierarchy* getHierarchy();
+    // Rebuilds world matrices of everything in the shared hierarchy that changed
+    static void update(ThreadPool* pool = nullptr);
+};
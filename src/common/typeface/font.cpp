@@ -3,8 +3,6 @@
 #include <cctype>
 #include <memory>
 
-#include "rect_pack.hpp"
-
 #include <freetype/ftstroke.h>
 
 extern FT_Library* s_ftlib;
@@ -36,8 +34,9 @@ FontGlyph& Font::loadGlyph(uint32_t ch) {
     }
     assert(typeface->face->glyph->bitmap.pixel_mode == FT_PIXEL_MODE_GRAY);
 
-    size_t w = typeface->face->glyph->bitmap.width;
-    size_t h = typeface->face->glyph->bitmap.rows;
+    const FT_Bitmap& bitmap = typeface->face->glyph->bitmap;
+    size_t w = bitmap.width;
+    size_t h = bitmap.rows;
     
     g.glyph_idx = glyph_idx;
     g.cache_idx = cache_idx;
@@ -46,13 +45,78 @@ FontGlyph& Font::loadGlyph(uint32_t ch) {
     g.horiAdvance = typeface->face->glyph->advance.x;
     g.bearingX = typeface->face->glyph->bitmap_left;
     g.bearingY = typeface->face->glyph->bitmap_top;
-    
-    // TODO: ?
+
+    // The bitmap goes straight into the atlas, it is never rendered again
+    const int atlas_generation = atlas.getGeneration();
+    auto it_same_glyph = glyph_index_to_cache.find(glyph_idx);
+    if (it_same_glyph != glyph_index_to_cache.end()) {
+        const FontGlyph& same = glyph_cache[it_same_glyph->second];
+        g.atlas_px_min_x = same.atlas_px_min_x;
+        g.atlas_px_min_y = same.atlas_px_min_y;
+        g.atlas_px_max_x = same.atlas_px_max_x;
+        g.atlas_px_max_y = same.atlas_px_max_y;
+    } else {
+        GlyphAtlasRect rc;
+        if (!atlas.insert(bitmap.buffer, w, h, bitmap.pitch, rc)) {
+            if (!is_atlas_full) {
+                LOG_WARN("Font atlas is full, new glyphs of " << typeface->filename << " " << font_height << " will not be drawn");
+                is_atlas_full = true;
+            }
+            rc = GlyphAtlasRect();
+        } else {
+            glyph_index_to_cache[glyph_idx] = cache_idx;
+        }
+        g.atlas_px_min_x = rc.x;
+        g.atlas_px_min_y = rc.y + rc.h;
+        g.atlas_px_max_x = rc.x + rc.w;
+        g.atlas_px_max_y = rc.y;
+    }
+
+    if (lut.size() < glyph_cache.size() * 4) {
+        lut.resize(std::max(lut.size() * 2, size_t(FONT_LUT_WIDTH)));
+    }
+    if (atlas.getGeneration() != atlas_generation) {
+        // Atlas grew, glyphs kept their pixels but every normalized uv changed
+        for (auto& cached : glyph_cache) {
+            updateGlyphUv(cached);
+        }
+    } else {
+        updateGlyphUv(g);
+    }
+
     is_texture_data_stale = true;
-    //updateTextures();
     return g;
 }
 
+void Font::updateGlyphUv(FontGlyph& g) {
+    const float atlas_w = (float)atlas.getWidth();
+    const float atlas_h = (float)atlas.getHeight();
+    gfxm::vec2 _min = gfxm::vec2(
+        g.atlas_px_min_x / atlas_w,
+        g.atlas_px_max_y / atlas_h
+    );
+    gfxm::vec2 _max = gfxm::vec2(
+        g.atlas_px_max_x / atlas_w,
+        g.atlas_px_min_y / atlas_h
+    );
+    g.uv_rect.min = gfxm::vec2(_min.x, _max.y);
+    g.uv_rect.max = gfxm::vec2(_max.x, _min.y);
+
+    const int first = g.cache_idx * 4;
+    lut[first] = gfxm::vec2(_min.x, _max.y);
+    lut[first + 1] = gfxm::vec2(_max.x, _max.y);
+    lut[first + 2] = gfxm::vec2(_max.x, _min.y);
+    lut[first + 3] = gfxm::vec2(_min.x, _min.y);
+
+    if (lut_dirty_begin >= lut_dirty_end) {
+        lut_dirty_begin = first;
+        lut_dirty_end = first + 4;
+    } else {
+        lut_dirty_begin = std::min(lut_dirty_begin, first);
+        lut_dirty_end = std::max(lut_dirty_end, first + 4);
+    }
+}
+
 void Font::updateTextures() {
     /*
     if (texture_data == nullptr) {
@@ -72,14 +136,44 @@ void Font::updateTextures() {
         texture_data.reset(new FontTextureData);
         texture_data->atlas.reset(new gpuTexture2d());
         texture_data->lut.reset(new gpuTexture2d());
+        uploaded_atlas_generation = 0;
+        uploaded_lut_size = 0;
     }
 
-    ktImage imgAtlas;
-    ktImage imgLut;
-    buildAtlas(&imgAtlas, &imgLut);
-    texture_data->atlas->setData(&imgAtlas);
-    texture_data->lut->setData(&imgLut);
-    texture_data->lut->setFilter(GPU_TEXTURE_FILTER_NEAREST);
+    // Only glyphs added since the last upload, unless the atlas was reallocated
+    if (uploaded_atlas_generation != atlas.getGeneration()) {
+        texture_data->atlas->setData(atlas.getPixels(), atlas.getWidth(), atlas.getHeight(), 1);
+        uploaded_atlas_generation = atlas.getGeneration();
+    } else {
+        for (const auto& rc : atlas.getDirtyRects()) {
+            texture_data->atlas->setSubData(
+                atlas.getPixels() + rc.y * atlas.getWidth() + rc.x,
+                rc.x, rc.y, rc.w, rc.h, atlas.getWidth(), 1
+            );
+        }
+    }
+    atlas.clearDirtyRects();
+
+    // lut.size() is always a multiple of FONT_LUT_WIDTH
+    if (uploaded_lut_size != lut.size()) {
+        texture_data->lut->setData(lut.data(), FONT_LUT_WIDTH, lut.size() / FONT_LUT_WIDTH, 2, IMAGE_CHANNEL_FLOAT);
+        texture_data->lut->setFilter(GPU_TEXTURE_FILTER_NEAREST);
+        uploaded_lut_size = lut.size();
+    } else if (lut_dirty_begin < lut_dirty_end) {
+        const int first_row = lut_dirty_begin / FONT_LUT_WIDTH;
+        const int last_row = (lut_dirty_end - 1) / FONT_LUT_WIDTH;
+        if (first_row == last_row) {
+            texture_data->lut->setSubData(
+                &lut[lut_dirty_begin], lut_dirty_begin % FONT_LUT_WIDTH, first_row, lut_dirty_end - lut_dirty_begin, 1, 0, 2, IMAGE_CHANNEL_FLOAT
+            );
+        } else {
+            texture_data->lut->setSubData(
+                &lut[first_row * FONT_LUT_WIDTH], 0, first_row, FONT_LUT_WIDTH, last_row - first_row + 1, 0, 2, IMAGE_CHANNEL_FLOAT
+            );
+        }
+    }
+    lut_dirty_begin = 0;
+    lut_dirty_end = 0;
 
     is_texture_data_stale = false;
 }
@@ -95,6 +189,14 @@ Font::Font(const std::shared_ptr<Typeface>& typeface, int font_height, int dpi)
 
 void Font::init(const std::shared_ptr<Typeface>& typeface, int font_height, int dpi) {
     glyphs.clear();
+    glyph_cache.clear();
+    glyph_index_to_cache.clear();
+    atlas.init(GLYPH_ATLAS_INITIAL_WIDTH, GLYPH_ATLAS_INITIAL_HEIGHT, GLYPH_ATLAS_MAX_SIZE);
+    is_atlas_full = false;
+    lut.clear();
+    lut_dirty_begin = 0;
+    lut_dirty_end = 0;
+    is_texture_data_stale = true;
 
     this->typeface = typeface;
     this->font_height = font_height;
@@ -179,118 +281,11 @@ FontTextureData* Font::getTextureData() {
 }
 
 void Font::buildAtlas(ktImage* image, ktImage* lookup_texture) {
-    const FT_Face& face = typeface->face;
-
-    FT_Error err = FT_Select_Charmap(face, FT_ENCODING_UNICODE);
-    assert(!err);
-    err = FT_Set_Char_Size(face, 0, font_height * 64.0f, dpi, dpi);
-    assert(!err);
-
-    const FT_Int32 LOAD_FLAGS = FT_LOAD_COLOR | FT_LOAD_TARGET_LIGHT | FT_LOAD_FORCE_AUTOHINT;
-
-    std::vector<RectPack::Rect> rects;
-    rects.reserve(128);
-    for (int i = 0; i < glyph_cache.size(); ++i) {
-        const auto& cached_glyph = glyph_cache[i];
-        uint32_t glyph_idx = cached_glyph.glyph_idx;
-        //FT_UInt glyph_idx = FT_Get_Char_Index(face, codepoint);
-        FT_Error err = FT_Load_Glyph(face, glyph_idx, LOAD_FLAGS);
-        assert(!err);
-        if (face->glyph->format != FT_GLYPH_FORMAT_BITMAP) {
-            err = FT_Render_Glyph(face->glyph, FT_RENDER_MODE_LIGHT);
-            assert(!err);
-        }
-        assert(face->glyph->bitmap.pixel_mode == FT_PIXEL_MODE_GRAY);
-        size_t w = face->glyph->bitmap.width;
-        size_t h = face->glyph->bitmap.rows;
-
-        RectPack::Rect& r = rects.emplace_back();
-        r.id = cached_glyph.cache_idx; // same as i
-        r.w = w;
-        r.h = h;
-    }
-
-    // TODO: border should be readable by users of the font
-    constexpr int border = 1;
-    RectPack packer;
-    RectPack::Rect image_rect = packer.pack(
-        rects.data(), rects.size(), border,
-        RectPack::MAXSIDE, RectPack::POWER_OF_TWO
-    );
-
-    image->reserve(image_rect.w, image_rect.h, 1);
-    for (int i = 0; i < rects.size(); ++i) {
-        uint32_t glyph_idx = glyph_cache[rects[i].id].glyph_idx;
-        FT_Error err = FT_Load_Glyph(face, glyph_idx, LOAD_FLAGS);
-        assert(!err);
-        FT_BitmapGlyph bitmapGlyph;
-        if (face->glyph->format != FT_GLYPH_FORMAT_BITMAP) {
-            /* DO THIS IF U WANT BORDERS, GLYPH BITMAP RECT BECOMS BIGGER, NEED TO ADJUST FOR THAT
-            FT_Stroker stroker;
-            FT_Stroker_New(*s_ftlib, &stroker);
-            FT_Stroker_Set(stroker, 2 * 64, FT_STROKER_LINECAP_ROUND, FT_STROKER_LINEJOIN_ROUND, 0);
-
-            FT_Glyph glph;
-            FT_Get_Glyph(face->glyph, &glph);
-            FT_Glyph_StrokeBorder(&glph, stroker, false, true);
-            FT_Glyph_To_Bitmap(&glph, FT_RENDER_MODE_NORMAL, 0, true);
-            bitmapGlyph = reinterpret_cast<FT_BitmapGlyph>(glph);
-            */
-            err = FT_Render_Glyph(face->glyph, FT_RENDER_MODE_LIGHT);
-            assert(!err);
-        }
-        assert(face->glyph->bitmap.pixel_mode == FT_PIXEL_MODE_GRAY);
-        size_t w = face->glyph->bitmap.width;
-        size_t h = face->glyph->bitmap.rows;
-
-        image->blit(
-            face->glyph->bitmap.buffer, w, h, 1, rects[i].x, rects[i].y
-        );
-    }
-
-    // Build uv lookup texture
-    for (int i = 0; i < rects.size(); ++i) {
-        auto& rc = rects[i];
-        rc.x -= border;
-        rc.y -= border;
-        rc.w += border * 2;
-        rc.h += border * 2;
-    }
-    std::vector<gfxm::vec2> lookup(glyph_cache.size() * 4);
-    for (int i = 0; i < rects.size(); ++i) {
-        gfxm::vec2 _min = gfxm::vec2(
-            rects[i].x / image_rect.w,
-            rects[i].y / image_rect.h
-        );
-        gfxm::vec2 _max = gfxm::vec2(
-            (rects[i].x + rects[i].w) / image_rect.w,
-            (rects[i].y + rects[i].h) / image_rect.h
-        );
-
-        gfxm::vec2 l[] = {
-            gfxm::vec2(_min.x, _max.y),
-            gfxm::vec2(_max.x, _max.y),
-            gfxm::vec2(_max.x, _min.y),
-            gfxm::vec2(_min.x, _min.y)
-        };
-
-        auto& g = glyph_cache[rects[i].id];
-        g.uv_rect.min = gfxm::vec2(_min.x, _max.y);
-        g.uv_rect.max = gfxm::vec2(_max.x, _min.y);
-        g.atlas_px_min_x = rects[i].x;
-        g.atlas_px_min_y = rects[i].y + rects[i].h;
-        g.atlas_px_max_x = rects[i].x + rects[i].w;
-        g.atlas_px_max_y = rects[i].y;
-
-        lookup[g.cache_idx * 4] = l[0];
-        lookup[g.cache_idx * 4 + 1] = l[1];
-        lookup[g.cache_idx * 4 + 2] = l[2];
-        lookup[g.cache_idx * 4 + 3] = l[3];
-        //lookup.insert(lookup.end(), l, l + sizeof(l) / sizeof(l[0]));
-    }
+    // Glyphs are already in the persistent atlas, this hands out a copy of it and of the uv lookup
+    image->setData(atlas.getPixels(), atlas.getWidth(), atlas.getHeight(), 1);
     if (lookup_texture) {
-        int lookup_texture_width = lookup.size();
-        lookup_texture->setData(lookup.data(), lookup_texture_width, 1, 2, IMAGE_CHANNEL_FLOAT);
+        int lookup_texture_height = (glyph_cache.size() * 4 + FONT_LUT_WIDTH - 1) / FONT_LUT_WIDTH;
+        lookup_texture->setData(lut.data(), FONT_LUT_WIDTH, lookup_texture_height, 2, IMAGE_CHANNEL_FLOAT);
     }
 }
 
@@ -3,6 +3,11 @@
 #include "typeface.hpp"
 #include <memory>
 #include "gpu/gpu_texture_2d.hpp"
+#include "glyph_atlas.hpp"
+
+// The uv lookup texture is FONT_LUT_WIDTH texels wide, lookup index i is at (i % width, i / width)
+// Text shaders hardcode the same width
+constexpr int FONT_LUT_WIDTH = 1024;
 
 
 struct FontGlyph {
@@ -35,10 +40,23 @@ class Font {
     int descender = 0;
     std::unordered_map<uint32_t, int> glyphs;
     std::vector<FontGlyph> glyph_cache;
+    // Glyphs are rendered into the atlas once, when first requested.
+    // Codepoints that share a glyph (all the missing ones for example) share its atlas slot
+    GlyphAtlas atlas;
+    std::unordered_map<uint32_t, int> glyph_index_to_cache;
+    bool is_atlas_full = false;
+    // Four uv corners per cached glyph, FONT_LUT_WIDTH per row.
+    // Row count doubles so the lut texture is rarely reallocated
+    std::vector<gfxm::vec2> lut;
+    int lut_dirty_begin = 0;
+    int lut_dirty_end = 0;
+    int uploaded_atlas_generation = 0;
+    int uploaded_lut_size = 0;
     std::unique_ptr<FontTextureData> texture_data;
     bool is_texture_data_stale = true;
 
     FontGlyph& loadGlyph(uint32_t ch);
+    void updateGlyphUv(FontGlyph& g);
     void updateTextures();
 public:
     Font() {}
@@ -62,6 +80,9 @@ public:
     FontGlyph& getGlyphRef(uint32_t ch);
 
     FontTextureData* getTextureData();
+    // Changes when the atlas grows, uv rects copied out of glyphs before that are no longer valid.
+    // Lut indices stay valid
+    int getAtlasGeneration() const { return atlas.getGeneration(); }
 
     void buildAtlas(ktImage* image, ktImage* lookup_texture);
     int findCursorPos(const char* str, int str_len, float pointer_x, float max_width, float* out_screen_x);
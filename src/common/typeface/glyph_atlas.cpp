@@ -0,0 +1,127 @@
+#include "glyph_atlas.hpp"
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+
+GlyphAtlas::GlyphAtlas() {
+    init(GLYPH_ATLAS_INITIAL_WIDTH, GLYPH_ATLAS_INITIAL_HEIGHT, GLYPH_ATLAS_MAX_SIZE);
+}
+
+void GlyphAtlas::init(int width, int height, int max_size) {
+    assert(width > 0 && height > 0 && width <= max_size && height <= max_size);
+    this->width = width;
+    this->height = height;
+    this->max_size = max_size;
+    ++generation;
+    pixels.clear();
+    pixels.resize(width * height, 0);
+    shelves.clear();
+    dirty_rects.clear();
+}
+
+bool GlyphAtlas::grow(int required_height) {
+    if (height < max_size) {
+        // Rows are appended at the end, everything already in the atlas keeps its pixel position
+        int new_height = height * 2;
+        while (new_height < required_height && new_height < max_size) {
+            new_height *= 2;
+        }
+        height = std::min(new_height, max_size);
+        pixels.resize(width * height, 0);
+    } else if (width < max_size) {
+        // Rows get longer, existing shelves gain free space on the right
+        const int new_width = std::min(width * 2, max_size);
+        std::vector<uint8_t> widened(new_width * height, 0);
+        for (int y = 0; y < height; ++y) {
+            memcpy(&widened[y * new_width], &pixels[y * width], width);
+        }
+        pixels.swap(widened);
+        width = new_width;
+    } else {
+        return false;
+    }
+    ++generation;
+    return true;
+}
+
+int GlyphAtlas::findShelf(int w, int h) {
+    // Shelves a little taller than the glyph are fine, much taller ones are left for tall glyphs
+    const int max_waste = h / 4 + 2;
+    while (true) {
+        int best = -1;
+        for (int i = 0; i < shelves.size(); ++i) {
+            const Shelf& s = shelves[i];
+            if (s.height < h || s.height - h > max_waste || width - s.cursor_x < w) {
+                continue;
+            }
+            if (best == -1 || s.height < shelves[best].height) {
+                best = i;
+            }
+        }
+        if (best != -1) {
+            return best;
+        }
+
+        const int top = shelves.empty() ? 0 : shelves.back().y + shelves.back().height;
+        if (top + h <= height) {
+            Shelf& s = shelves.emplace_back();
+            s.y = top;
+            s.height = h;
+            s.cursor_x = 0;
+            return (int)shelves.size() - 1;
+        }
+        if (!grow(top + h)) {
+            break;
+        }
+    }
+
+    // Out of space, any shelf the glyph fits on will do
+    for (int i = 0; i < shelves.size(); ++i) {
+        const Shelf& s = shelves[i];
+        if (s.height >= h && width - s.cursor_x >= w) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool GlyphAtlas::insert(const uint8_t* bitmap, int w, int h, int pitch, GlyphAtlasRect& out_rect) {
+    assert(w >= 0 && h >= 0 && pitch >= w);
+    const int slot_w = w + GLYPH_ATLAS_BORDER * 2;
+    const int slot_h = h + GLYPH_ATLAS_BORDER * 2;
+    if (slot_w > max_size || slot_h > max_size) {
+        return false;
+    }
+    const int shelf_idx = findShelf(slot_w, slot_h);
+    if (shelf_idx == -1) {
+        return false;
+    }
+    Shelf& shelf = shelves[shelf_idx];
+
+    out_rect.x = shelf.cursor_x;
+    out_rect.y = shelf.y;
+    out_rect.w = slot_w;
+    out_rect.h = slot_h;
+    shelf.cursor_x += slot_w;
+
+    for (int y = 0; w > 0 && y < h; ++y) {
+        memcpy(
+            &pixels[(out_rect.y + GLYPH_ATLAS_BORDER + y) * width + out_rect.x + GLYPH_ATLAS_BORDER],
+            bitmap + y * pitch, w
+        );
+    }
+
+    // Glyphs usually arrive one after another on the same shelf, so one rect per shelf per upload
+    if (!dirty_rects.empty()) {
+        GlyphAtlasRect& last = dirty_rects.back();
+        if (last.y == out_rect.y && last.x + last.w == out_rect.x) {
+            last.w += out_rect.w;
+            last.h = std::max(last.h, out_rect.h);
+            return true;
+        }
+    }
+    dirty_rects.push_back(out_rect);
+    return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+
+constexpr int GLYPH_ATLAS_INITIAL_WIDTH = 1024;
+constexpr int GLYPH_ATLAS_INITIAL_HEIGHT = 128;
+constexpr int GLYPH_ATLAS_MAX_SIZE = 4096;
+// Empty pixels around every glyph, uv rects include them so linear filtering never reaches a neighbor
+constexpr int GLYPH_ATLAS_BORDER = 1;
+
+struct GlyphAtlasRect {
+    int x = 0;
+    int y = 0;
+    int w = 0;
+    int h = 0;
+};
+
+// Single channel atlas that glyphs are added to one at a time.
+// Glyphs go on shelves, rows as tall as the glyph that opened them, and are never moved.
+// When nothing fits the atlas doubles its height, then its width, pixel positions stay the same
+// but normalized uvs have to be recomputed, getGeneration() changes when that happens.
+// Every insert records the pixels it touched so only those need to be uploaded
+class GlyphAtlas {
+    struct Shelf {
+        int y = 0;
+        int height = 0;
+        int cursor_x = 0;
+    };
+
+    int width = 0;
+    int height = 0;
+    int max_size = 0;
+    int generation = 0;
+    std::vector<uint8_t> pixels;
+    std::vector<Shelf> shelves;
+    std::vector<GlyphAtlasRect> dirty_rects;
+
+    int findShelf(int w, int h);
+    bool grow(int required_height);
+public:
+    GlyphAtlas();
+
+    void init(int width, int height, int max_size);
+
+    // Copies a glyph bitmap into free space, out_rect is the slot including the border.
+    // Returns false if the atlas is full at its max size
+    bool insert(const uint8_t* bitmap, int w, int h, int pitch, GlyphAtlasRect& out_rect);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getGeneration() const { return generation; }
+    const uint8_t* getPixels() const { return pixels.data(); }
+
+    // Changed areas since the last clearDirtyRects(), neighbors on the same shelf are merged
+    const std::vector<GlyphAtlasRect>& getDirtyRects() const { return dirty_rects; }
+    void clearDirtyRects() { dirty_rects.clear(); }
+};
@@ -0,0 +1,98 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+
+ThreadPool::ThreadPool(int thread_count) {
+    _startWorkers(std::max(thread_count, 1) - 1);
+}
+ThreadPool::~ThreadPool() {
+    _stopWorkers();
+}
+
+void ThreadPool::_th_worker(uint64_t start_generation) {
+    uint64_t seen_generation = start_generation;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(sync);
+            cv_work.wait(lock, [this, seen_generation]() {
+                return !is_running || generation != seen_generation;
+            });
+            if (!is_running) {
+                return;
+            }
+            seen_generation = generation;
+        }
+
+        _runJobs();
+
+        {
+            std::lock_guard<std::mutex> lock(sync);
+            if (--workers_busy == 0) {
+                cv_done.notify_one();
+            }
+        }
+    }
+}
+
+void ThreadPool::_runJobs() {
+    int job = 0;
+    while ((job = next_job.fetch_add(1)) < job_count) {
+        (*job_fn)(job);
+    }
+}
+
+void ThreadPool::_startWorkers(int count) {
+    is_running = true;
+    workers.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        workers.push_back(std::thread(&ThreadPool::_th_worker, this, generation));
+    }
+}
+
+void ThreadPool::_stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(sync);
+        is_running = false;
+    }
+    cv_work.notify_all();
+    for (auto& w : workers) {
+        w.join();
+    }
+    workers.clear();
+}
+
+void ThreadPool::setThreadCount(int count) {
+    count = std::max(count, 1);
+    if (count == getThreadCount()) {
+        return;
+    }
+    _stopWorkers();
+    _startWorkers(count - 1);
+}
+
+void ThreadPool::run(int job_count, const std::function<void(int)>& fn) {
+    if (workers.empty() || job_count <= 1) {
+        for (int i = 0; i < job_count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sync);
+        this->job_fn = &fn;
+        this->job_count = job_count;
+        next_job.store(0);
+        workers_busy = (int)workers.size();
+        ++generation;
+    }
+    cv_work.notify_all();
+
+    _runJobs();
+
+    std::unique_lock<std::mutex> lock(sync);
+    cv_done.wait(lock, [this]() { return workers_busy == 0; });
+    job_fn = nullptr;
+    this->job_count = 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fork-join pool of persistent worker threads
+// The calling thread takes part in the work, run() returns once every job is done
+// Jobs are identified by index only, which thread runs which job is not defined
+class ThreadPool {
+    std::vector<std::thread> workers;
+    std::mutex sync;
+    std::condition_variable cv_work;
+    std::condition_variable cv_done;
+
+    const std::function<void(int)>* job_fn = nullptr;
+    int job_count = 0;
+    std::atomic<int> next_job = 0;
+    int workers_busy = 0;
+    uint64_t generation = 0;
+    bool is_running = true;
+
+    void _th_worker(uint64_t start_generation);
+    void _runJobs();
+    void _startWorkers(int count);
+    void _stopWorkers();
+public:
+    ThreadPool(int thread_count = 1);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Total thread count including the calling thread
+    // Not to be called while run() is in progress
+    void setThreadCount(int count);
+    int getThreadCount() const { return (int)workers.size() + 1; }
+
+    void run(int job_count, const std::function<void(int)>& fn);
+};
@@ -3,22 +3,77 @@
 
 
 void AnimationSystem::addAnimObject(AnimObject* o) {
-    objects.insert(o);
+    if (o->system_index != -1) {
+        assert(false);
+        return;
+    }
+    o->system_index = (int)objects.size();
+    objects.push_back(o);
 }
 
 void AnimationSystem::removeAnimObject(AnimObject* o) {
-    objects.erase(o);
+    if (o->system_index < 0 || o->system_index >= objects.size() || objects[o->system_index] != o) {
+        assert(false);
+        return;
+    }
+    objects[o->system_index] = nullptr;
+    ++removed_count;
+    o->system_index = -1;
 }
 
-void AnimationSystem::update(float dt) {
-    for (auto o : objects) {
-        auto& anim_inst = o->anim_inst;
-        if (!anim_inst->update(dt)) {
+void AnimationSystem::compact() {
+    // Keeps the order of the rest, events of the remaining objects come out as before
+    int count = 0;
+    for (int i = 0; i < objects.size(); ++i) {
+        AnimObject* o = objects[i];
+        if (!o) {
             continue;
         }
+        o->system_index = count;
+        objects[count++] = o;
+    }
+    objects.resize(count);
+    removed_count = 0;
+}
+
+void AnimationSystem::update(float dt) {
+    if (removed_count) {
+        compact();
+    }
+    const int object_count = (int)objects.size();
+    updated.resize(object_count);
+
+    // Evaluate
+    // Several small jobs per thread, a thread that is done early takes the next one off the pool
+    const int job_count = std::min(object_count, thread_pool.getThreadCount() * ANIM_SYSTEM_JOBS_PER_THREAD);
+    thread_pool.run(job_count, [this, object_count, job_count, dt](int job) {
+        const int begin = object_count * job / job_count;
+        const int end = object_count * (job + 1) / job_count;
+        for (int i = begin; i < end; ++i) {
+            updated[i] = objects[i]->anim_inst->update(dt);
+        }
+    });
 
+    // Write back
+    for (int i = 0; i < object_count; ++i) {
+        if (!updated[i]) {
+            continue;
+        }
+        AnimObject* o = objects[i];
+        auto& anim_inst = o->anim_inst;
         auto& skl_inst = o->skl_inst;
         anim_inst->getSampleBuffer()->applySamples(skl_inst);
+
+        for (int id : anim_inst->getUnknownHostEvents()) {
+            LOG_ERR("Host event " << id << " does not exist");
+        }
+        for (int id : anim_inst->getHostEvents()) {
+            if (host_event_cb) {
+                host_event_cb(o, id);
+            } else {
+                LOG("Host event " << id);
+            }
+        }
         anim_inst->getAudioCmdBuffer()->execute(skl_inst);
 
         // Root motion
@@ -30,4 +85,4 @@ void AnimationSystem::update(float dt) {
             root->rotate(anim_inst->getSampleBuffer()->getRootMotionSample().r);
         }*/
     }
-}
\ No newline at end of file
+}
@@ -1,17 +1,44 @@
 #pragma once
 
+#include <functional>
 #include "animation/animator/animator_instance.hpp"
+#include "util/thread_pool.hpp"
 
 
 struct AnimObject {
     AnimMachineInstance* anim_inst = nullptr;
     SkeletonInstance* skl_inst = nullptr;
+    int system_index = -1; // Position in AnimationSystem, -1 when not added
 };
 
+// Instances are evaluated in two phases:
+//  - every AnimMachineInstance::update() runs on the pool, each one only touches its own data
+//  - samples are written to the skeletons and host events and audio are dispatched
+//    on the calling thread, in the order the objects were added
+// So the results and the order of events don't depend on the thread count
+constexpr int ANIM_SYSTEM_JOBS_PER_THREAD = 8;
+
 class AnimationSystem {
-    std::set<AnimObject*> objects;
+    // Removed objects leave a nullptr behind until the next update() compacts them,
+    // so removing many objects stays linear and the rest keep their order
+    std::vector<AnimObject*> objects;
+    int removed_count = 0;
+    std::vector<uint8_t> updated;
+    ThreadPool thread_pool;
+    std::function<void(AnimObject*, int)> host_event_cb;
+
+    void compact();
 public:
     void addAnimObject(AnimObject*);
     void removeAnimObject(AnimObject*);
+
+    void setThreadCount(int count) { thread_pool.setThreadCount(count); }
+    int getThreadCount() const { return thread_pool.getThreadCount(); }
+    // Called for every host event fired by an instance's vm during update(), after evaluation is done
+    // Without one the events are only logged
+    void setHostEventCallback(const std::function<void(AnimObject*, int)>& cb) { host_event_cb = cb; }
+
+    size_t objectCount() const { return objects.size() - removed_count; }
+
     void update(float dt);
-};
\ No newline at end of file
+};
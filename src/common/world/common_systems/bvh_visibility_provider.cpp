@@ -0,0 +1,191 @@
+#include "bvh_visibility_provider.hpp"
+
+#include <algorithm>
+#include <bit>
+#include "collision/simd.hpp"
+#include "debug_draw/debug_draw.hpp"
+
+
+void BvhVisibilityProvider::makeFrustum(const gfxm::frustum& fru, BvhVisFrustum& out) {
+    for (int i = 0; i < 8; ++i) {
+        if (i < 6) {
+            out.nx[i] = fru.planes[i].normal.x;
+            out.ny[i] = fru.planes[i].normal.y;
+            out.nz[i] = fru.planes[i].normal.z;
+            out.d[i] = fru.planes[i].d;
+        } else {
+            out.nx[i] = .0f;
+            out.ny[i] = .0f;
+            out.nz[i] = .0f;
+            out.d[i] = -1.f;
+        }
+    }
+}
+
+// A plane rejects the box when even the corner furthest along the normal is not past d,
+// the box is fully inside when the nearest corner is past d for every plane
+BvhVisibilityProvider::CLASSIFY BvhVisibilityProvider::classify(const BvhVisFrustum& fru, const gfxm::aabb& box) {
+#if PHY_SSE
+    const __m128 sign_mask = _mm_set1_ps(-.0f);
+    const __m128 cx = _mm_set1_ps((box.from.x + box.to.x) * .5f);
+    const __m128 cy = _mm_set1_ps((box.from.y + box.to.y) * .5f);
+    const __m128 cz = _mm_set1_ps((box.from.z + box.to.z) * .5f);
+    const __m128 ex = _mm_set1_ps((box.to.x - box.from.x) * .5f);
+    const __m128 ey = _mm_set1_ps((box.to.y - box.from.y) * .5f);
+    const __m128 ez = _mm_set1_ps((box.to.z - box.from.z) * .5f);
+    int outside = 0;
+    int inside = 0xF;
+    for (int g = 0; g < 8; g += 4) {
+        const __m128 nx = _mm_load_ps(fru.nx + g);
+        const __m128 ny = _mm_load_ps(fru.ny + g);
+        const __m128 nz = _mm_load_ps(fru.nz + g);
+        const __m128 d = _mm_load_ps(fru.d + g);
+        const __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_mul_ps(nz, cz));
+        const __m128 radius = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(_mm_andnot_ps(sign_mask, nx), ex),
+            _mm_mul_ps(_mm_andnot_ps(sign_mask, ny), ey)),
+            _mm_mul_ps(_mm_andnot_ps(sign_mask, nz), ez)
+        );
+        outside |= _mm_movemask_ps(_mm_cmple_ps(_mm_add_ps(dist, radius), d));
+        inside &= _mm_movemask_ps(_mm_cmpgt_ps(_mm_sub_ps(dist, radius), d));
+    }
+    if (outside) {
+        return OUTSIDE;
+    }
+    return inside == 0xF ? INSIDE : INTERSECTS;
+#else
+    const gfxm::vec3 c = (box.from + box.to) * .5f;
+    const gfxm::vec3 e = (box.to - box.from) * .5f;
+    bool inside = true;
+    for (int i = 0; i < 6; ++i) {
+        const float dist = fru.nx[i] * c.x + fru.ny[i] * c.y + fru.nz[i] * c.z;
+        const float radius = fabsf(fru.nx[i]) * e.x + fabsf(fru.ny[i]) * e.y + fabsf(fru.nz[i]) * e.z;
+        if (dist + radius <= fru.d[i]) {
+            return OUTSIDE;
+        }
+        inside = inside && dist - radius > fru.d[i];
+    }
+    return inside ? INSIDE : INTERSECTS;
+#endif
+}
+
+void BvhVisibilityProvider::onAddProxy(VisibilityProxyItem* item) {
+    // Bounds are not known yet, the proxy is inserted with the first updateProxies()
+    item->provider_index = BVH_VIS_NULL_NODE;
+}
+void BvhVisibilityProvider::onRemoveProxy(VisibilityProxyItem* item) {
+    const uint32_t leaf = item->provider_index;
+    if (leaf == BVH_VIS_NULL_NODE) {
+        return;
+    }
+    assert(leaf < nodes.size() && nodes[leaf].isLeaf() && nodes[leaf].payload == item->proxy);
+    removeLeaf(leaf);
+    freeNode(leaf);
+    --leaf_count;
+    item->provider_index = BVH_VIS_NULL_NODE;
+}
+void BvhVisibilityProvider::updateProxies(VisibilityProxyItem* items, int count) {
+    for (int i = 0; i < count; ++i) {
+        VisibilityProxyItem& item = items[i];
+        const gfxm::aabb& box = item.proxy->getBoundingBox();
+        uint32_t leaf = item.provider_index;
+        if (leaf != BVH_VIS_NULL_NODE) {
+            const gfxm::aabb& fat = nodes[leaf].aabb;
+            // Reinsert when the proxy left its fat box, or shrank well inside of it
+            if (aabbContains(fat, box) && aabbContains(gfxm::aabb_grow(box, BVH_VIS_FAT_MARGIN * 4.f), fat)) {
+                continue;
+            }
+            removeLeaf(leaf);
+        } else {
+            leaf = allocNode();
+            nodes[leaf].payload = item.proxy;
+            item.provider_index = leaf;
+            ++leaf_count;
+        }
+        nodes[leaf].aabb = gfxm::aabb_grow(box, BVH_VIS_FAT_MARGIN);
+        nodes[leaf].height = 0;
+        insertLeaf(leaf);
+    }
+}
+
+void BvhVisibilityProvider::collectVisible(const VisibilityQuery& query, gpuRenderBucket* bucket) {
+    collectVisibleMulti(&query, &bucket, 1);
+}
+
+void BvhVisibilityProvider::collectVisibleMulti(const VisibilityQuery* queries, gpuRenderBucket* const* buckets, int count) {
+    stats.assign(count, VisibilityStats());
+    // One pass per mask width of views
+    for (int first = 0; first < count; first += BVH_VIS_MAX_VIEWS) {
+        _collectVisible(queries + first, buckets + first, std::min(count - first, BVH_VIS_MAX_VIEWS), &stats[first]);
+    }
+}
+
+void BvhVisibilityProvider::_collectVisible(const VisibilityQuery* queries, gpuRenderBucket* const* buckets, int count, VisibilityStats* out_stats) {
+    frustums.resize(count);
+    for (int i = 0; i < count; ++i) {
+        makeFrustum(queries[i].fru, frustums[i]);
+    }
+    if (root == BVH_VIS_NULL_NODE) {
+        return;
+    }
+
+    const uint32_t all_views = count == 32 ? 0xFFFFFFFF : ((1u << count) - 1);
+    stack.clear();
+    stack.push_back(StackEntry{ root, all_views, 0 });
+    while (!stack.empty()) {
+        const StackEntry e = stack.back();
+        stack.pop_back();
+        const BvhVisNode& n = nodes[e.node];
+
+        uint32_t partial = e.partial;
+        uint32_t inside = e.inside;
+        for (uint32_t views = e.partial; views; views &= views - 1) {
+            const int v = std::countr_zero(views);
+            const uint32_t bit = 1u << v;
+            ++out_stats[v].nodes_tested;
+            CLASSIFY c = classify(frustums[v], n.aabb);
+            if (c == OUTSIDE) {
+                partial &= ~bit;
+            } else if (c == INSIDE) {
+                partial &= ~bit;
+                inside |= bit;
+            }
+        }
+        if ((partial | inside) == 0) {
+            continue;
+        }
+
+        if (!n.isLeaf()) {
+            stack.push_back(StackEntry{ n.right, partial, inside });
+            stack.push_back(StackEntry{ n.left, partial, inside });
+            continue;
+        }
+
+        // Leaves hold the fat box, views that only intersect it check the proxy's own bounds
+        SceneProxy* proxy = n.payload;
+        for (uint32_t views = partial; views; views &= views - 1) {
+            const int v = std::countr_zero(views);
+            ++out_stats[v].nodes_tested;
+            if (classify(frustums[v], proxy->getBoundingBox()) != OUTSIDE) {
+                inside |= 1u << v;
+            }
+        }
+        for (uint32_t views = inside; views; views &= views - 1) {
+            const int v = std::countr_zero(views);
+            ++out_stats[v].visible;
+            proxy->submit(buckets[v]);
+        }
+    }
+    for (int i = 0; i < count; ++i) {
+        out_stats[i].culled = leaf_count - out_stats[i].visible;
+    }
+}
+
+void BvhVisibilityProvider::debugDraw(uint32_t color) const {
+    for (auto& n : nodes) {
+        if (n.height < 0) {
+            continue;
+        }
+        dbgDrawAabb(n.aabb, color);
+    }
+}
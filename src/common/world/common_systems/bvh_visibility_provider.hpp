@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "math/gfxm.hpp"
+#include "collision/aabb_tree/aabb_tree_dynamic.hpp"
+#include "scene_system.hpp"
+
+
+// Stock visibility provider, an incremental bounding volume tree over proxy bounds
+// Leaves store a fat box so proxies that move a little don't touch the tree,
+// the dirty segment handed over in updateProxies() is all that gets refit.
+// Several views are culled in one traversal: each node carries the set of views
+// it still has to be tested against and the set it is already fully inside of
+
+constexpr uint32_t BVH_VIS_NULL_NODE = AABB_TREE_NULL_NODE;
+constexpr float BVH_VIS_FAT_MARGIN = .25f;
+constexpr int BVH_VIS_MAX_VIEWS = 32;
+
+typedef AabbTreeNode<SceneProxy*> BvhVisNode;
+
+// Frustum planes laid out for testing four at a time, the last two lanes always pass
+struct BvhVisFrustum {
+    alignas(16) float nx[8];
+    alignas(16) float ny[8];
+    alignas(16) float nz[8];
+    alignas(16) float d[8];
+};
+
+struct VisibilityStats {
+    int nodes_tested = 0;
+    int visible = 0;
+    int culled = 0;
+};
+
+class BvhVisibilityProvider : public IVisibilityProvider, private AabbTreeDynamic<SceneProxy*> {
+    int leaf_count = 0;
+
+    struct StackEntry {
+        uint32_t node;
+        uint32_t partial; // views that still need testing
+        uint32_t inside;  // views the node is fully inside of
+    };
+    std::vector<StackEntry> stack;
+    std::vector<BvhVisFrustum> frustums;
+    std::vector<VisibilityStats> stats;
+
+    void _collectVisible(const VisibilityQuery* queries, gpuRenderBucket* const* buckets, int count, VisibilityStats* out_stats);
+public:
+    enum CLASSIFY { OUTSIDE, INTERSECTS, INSIDE };
+
+    static void makeFrustum(const gfxm::frustum& fru, BvhVisFrustum& out);
+    // Same outcome as gfxm::intersect_frustum_aabb() for anything but OUTSIDE
+    static CLASSIFY classify(const BvhVisFrustum& fru, const gfxm::aabb& box);
+
+    void onAddProxy(VisibilityProxyItem* item) override;
+    void onRemoveProxy(VisibilityProxyItem* item) override;
+    void updateProxies(VisibilityProxyItem* items, int count) override;
+    void collectVisible(const VisibilityQuery& query, gpuRenderBucket* bucket) override;
+    void collectVisibleMulti(const VisibilityQuery* queries, gpuRenderBucket* const* buckets, int count) override;
+
+    int getProxyCount() const { return leaf_count; }
+    int getHeight() const { return root == BVH_VIS_NULL_NODE ? 0 : nodes[root].height; }
+    // Counts from the last collectVisible call, one per query
+    int getStatsCount() const { return (int)stats.size(); }
+    const VisibilityStats& getStats(int query) const { return stats[query]; }
+
+    void debugDraw(uint32_t color) const;
+};
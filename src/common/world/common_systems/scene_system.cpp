@@ -1,6 +1,7 @@
 #include "scene_system.hpp"
 
 #include <algorithm>
+#include "bvh_visibility_provider.hpp"
 
 
 void SceneProxy::setTransformNode(HTransform node) {
@@ -18,6 +19,11 @@ void SceneProxy::markDirty() {
     sys->markDirty(this);
 }
 
+SceneSystem::SceneSystem()
+: default_provider(new BvhVisibilityProvider) {
+    provider = default_provider.get();
+}
+
 SceneSystem::~SceneSystem() {
     while (!proxies.empty()) {
         removeProxy(proxies.back().proxy);
@@ -120,6 +126,23 @@ void SceneSystem::markDirty(SceneProxy* prox) {
     ++dirty_count;
 }
 
+void SceneSystem::_switchProvider(IVisibilityProvider* prov) {
+    if (prov == provider) {
+        return;
+    }
+    for (int i = 0; i < proxies.size(); ++i) {
+        if (provider) {
+            provider->onRemoveProxy(&proxies[i]);
+        }
+        if (prov) {
+            prov->onAddProxy(&proxies[i]);
+        }
+    }
+    provider = prov;
+    // The new provider has to see every proxy's bounds once
+    dirty_count = proxies.size();
+}
+
 void SceneSystem::_replaceTransformNode(SceneProxy* prox, HTransform node) {
     if (prox->transform_ticket) {
         prox->transform_node->detachTicket(prox->transform_ticket);
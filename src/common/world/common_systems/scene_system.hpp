@@ -2,6 +2,7 @@
 
 #include "scene_system.auto.hpp"
 #include <set>
+#include <memory>
 #include "math/gfxm.hpp"
 #include "transform_node/transform_node.hpp"
 #include "gpu/render_bucket.hpp"
@@ -57,6 +58,7 @@ struct VisibilityQuery {
 
 struct VisibilityProxyItem {
     SceneProxy* proxy = nullptr;
+    uint32_t provider_index = 0xFFFFFFFF; // Owned by the provider, a tree leaf or a slot id
     //std::unique_ptr<VisProviderProxy> provider_internal;
 };
 
@@ -67,16 +69,26 @@ public:
     virtual void onRemoveProxy(VisibilityProxyItem*) = 0;
     virtual void updateProxies(VisibilityProxyItem* items, int count) = 0;
     virtual void collectVisible(const VisibilityQuery& query, gpuRenderBucket* bucket) = 0;
+    // Several views in one go, main camera, shadow cascades, probes
+    // Providers that can share the work between views should override this
+    virtual void collectVisibleMulti(const VisibilityQuery* queries, gpuRenderBucket* const* buckets, int count) {
+        for (int i = 0; i < count; ++i) {
+            collectVisible(queries[i], buckets[i]);
+        }
+    }
 };
 
 [[cppi_class]];
 class SceneSystem {
+    std::unique_ptr<IVisibilityProvider> default_provider;
     IVisibilityProvider* provider = nullptr;
     std::vector<VisibilityProxyItem> proxies;
     int dirty_count = 0;
     TransformDirtyList_T<SceneProxy> transform_dirty_list;
+
+    void _switchProvider(IVisibilityProvider* prov);
 public:
-    SceneSystem() {}
+    SceneSystem();
     SceneSystem(SceneSystem&) = delete;
     ~SceneSystem();
 
@@ -86,16 +98,18 @@ public:
     void removeProxy(SceneProxy* prox);
     void markDirty(SceneProxy*);
 
+    // Replaces the stock BvhVisibilityProvider
     void registerProvider(IVisibilityProvider* prov) {
-        provider = prov;
+        _switchProvider(prov ? prov : default_provider.get());
     }
     void unregisterProvider(IVisibilityProvider* prov) {
         if (prov != provider) {
             assert(false);
             return;
         }
-        provider = nullptr;
+        _switchProvider(default_provider.get());
     }
+    IVisibilityProvider* getProvider() { return provider; }
 
     void updateProxies() {
         if (!provider) {
@@ -133,6 +147,15 @@ public:
         }
         provider->collectVisible(query, bucket);
     }
+    void collectVisible(const VisibilityQuery* queries, gpuRenderBucket* const* buckets, int count) {
+        if (!provider) {
+            for (int i = 0; i < count; ++i) {
+                collectVisible(queries[i], buckets[i]);
+            }
+            return;
+        }
+        provider->collectVisibleMulti(queries, buckets, count);
+    }
 
     void _replaceTransformNode(SceneProxy* prox, HTransform node);
 };
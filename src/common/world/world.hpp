@@ -260,6 +260,11 @@ class RuntimeWorld : public IWorld {
 
     // ConVars
     ConRegistry::WatchTicket con_phy_gravity;
+    ConRegistry::WatchTicket con_phy_threads;
+    ConRegistry::WatchTicket con_anim_threads;
+    ConRegistry::WatchTicket con_ptcl_threads;
+    ConRegistry::WatchTicket con_phy_solver_iterations;
+    ConRegistry::WatchTicket con_phy_packed_solver;
 
     void updateWorldControllers(float dt) {
         for (auto& kv : world_controllers) {
@@ -300,9 +305,29 @@ public:
         con_phy_gravity = ConRegistry::get()->watchFloat("phy.gravity", [this](float value) {
             collision_world->gravity = gfxm::vec3(.0f, -value, .0f);
         });
+        con_phy_threads = ConRegistry::get()->watchInt("phy.threads", [this](int value) {
+            collision_world->setThreadCount(value);
+        });
+        con_anim_threads = ConRegistry::get()->watchInt("anim.threads", [this](int value) {
+            anim_sys.setThreadCount(value);
+        });
+        con_ptcl_threads = ConRegistry::get()->watchInt("ptcl.threads", [this](int value) {
+            particle_sim->setThreadCount(value);
+        });
+        con_phy_solver_iterations = ConRegistry::get()->watchInt("phy.solver_iterations", [this](int value) {
+            collision_world->setSolverIterations(value);
+        });
+        con_phy_packed_solver = ConRegistry::get()->watchInt("phy.packed_solver", [this](int value) {
+            collision_world->enablePackedSolver(value != 0);
+        });
     }
     ~RuntimeWorld() {
         ConRegistry::get()->unwatch(con_phy_gravity);
+        ConRegistry::get()->unwatch(con_phy_threads);
+        ConRegistry::get()->unwatch(con_anim_threads);
+        ConRegistry::get()->unwatch(con_ptcl_threads);
+        ConRegistry::get()->unwatch(con_phy_solver_iterations);
+        ConRegistry::get()->unwatch(con_phy_packed_solver);
     }
 
     scnRenderScene* getRenderScene() { return renderScene.get(); }
@@ -309,15 +309,14 @@ namespace xui {
             str += "\n// TODO: Window resizing";
             str += "\n// TODO: Nested render targets. Might require rc_visual_bounds";
 
-            TextLayout layout;
-            layout.build(str, font, test_width);
+            const auto& layout = text_layout_cache.get(str, font, test_width);
 
             std::vector<TextVertex> vertices;
-            for (int i = 0; i < layout.glyphs.size(); ++i) {
-                const auto& g = layout.glyphs[i];
-                const auto& q = g.makeQuad();
+            vertices.reserve(layout.quads.size() * 12);
+            for (int i = 0; i < layout.quads.size(); ++i) {
+                const auto& q = layout.quads[i];
                 
-                uint32_t color = g.color;
+                uint32_t color = q.rgba[0];
                 if(color == 0xFFFFFFFF) {
                     color = gfxm::hsv2rgb32(gfxm::fract(time + i * .025f), .3f, 1.f, 1.f);
                 }
@@ -351,6 +350,7 @@ namespace xui {
 
             renderer->drawText(vertices.data(), vertices.size(), font);
         }
+        text_layout_cache.endFrame();
 
         renderer->render(width, height, clear);
     }
@@ -4,6 +4,7 @@
 #include "xui/renderer/renderer.hpp"
 #include "xui/elements/root.hpp"
 #include "gui/style/style_component.hpp"
+#include "text_layout/text_layout_cache.hpp"
 
 
 namespace xui {
@@ -35,6 +36,8 @@ namespace xui {
 
         std::vector<Element*> managed_elements;
 
+        TextLayoutCache text_layout_cache;
+
         void updateHovered(Element*, HIT);
         void updatePressed(Element*, HIT);
 
@@ -11,6 +11,8 @@
 
 #include "math/fft.hpp"
 
+#include "bench/bench.hpp"
+
 static void printSamples2(float* samples_before, gfxm::complex* spectrum, gfxm::complex* samples_after, int count) {
     printf("#\tin\tspec\tout\n");
     printf("------------------------------\n");
@@ -201,12 +203,22 @@ void normalKeyTest() {
 }
 
 
-int main(int argc, char* argv) {
+int main(int argc, char** argv) {
     cppiReflectInit();
 
+    if (benchRunFromCommandLine(argc, argv)) {
+        return 0;
+    }
+
     engineGameInit();
 
     ConRegistry::get()->registerFloat("phy.gravity", "gravity", 9.8f);
+    ConRegistry::get()->registerInt("phy.threads", "physics narrowphase and solver thread count", 1, 1, 16);
+    ConRegistry::get()->registerInt("phy.solver_iterations", "default solver iterations per island", PHY_DEFAULT_SOLVER_ITERATIONS, 1, 128);
+    ConRegistry::get()->registerInt("phy.packed_solver", "solve contacts with the packed simd solver", 1, 0, 1);
+    ConRegistry::get()->registerInt("anim.threads", "animation system thread count", 1, 1, 16);
+    ConRegistry::get()->registerInt("ptcl.threads", "particle update thread count for large emitters", 1, 1, 16);
+    benchRegisterCommands();
 
     {
         std::unique_ptr<DefaultRuntime> rt(new DefaultRuntime(
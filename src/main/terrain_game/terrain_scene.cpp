@@ -67,19 +67,25 @@ void TerrainScene::onDespawnScene(IWorld& world) {
 
 
 void TerrainScene::onAddProxy(VisibilityProxyItem* item) {
-    proxies.insert(item->proxy);
+    proxy_bvh.onAddProxy(item);
 }
 void TerrainScene::onRemoveProxy(VisibilityProxyItem* item) {
-    proxies.erase(item->proxy);
+    proxy_bvh.onRemoveProxy(item);
 }
 void TerrainScene::updateProxies(VisibilityProxyItem* items, int count) {
+    proxy_bvh.updateProxies(items, count);
+}
+void TerrainScene::collectVisible(const VisibilityQuery& query, gpuRenderBucket* bucket) {
+    collectSectors(query, bucket);
+    proxy_bvh.collectVisible(query, bucket);
+}
+void TerrainScene::collectVisibleMulti(const VisibilityQuery* queries, gpuRenderBucket* const* buckets, int count) {
     for (int i = 0; i < count; ++i) {
-        auto prox = items[i].proxy;
-        // TODO: Update internal representation of the proxy,
-        // with spatial data, like which cell it's in
+        collectSectors(queries[i], buckets[i]);
     }
+    proxy_bvh.collectVisibleMulti(queries, buckets, count);
 }
-void TerrainScene::collectVisible(const VisibilityQuery& query, gpuRenderBucket* bucket) {
+void TerrainScene::collectSectors(const VisibilityQuery& query, gpuRenderBucket* bucket) {
     for (auto& s : sectors) {
         /*
         dbgDrawFrustum(query.fru, 0xFFFFFFFF);
@@ -95,16 +101,6 @@ void TerrainScene::collectVisible(const VisibilityQuery& query, gpuRenderBucket*
         }
     }
     //bucket->add(water_renderable.get());
-
-    for (auto p : proxies) {
-        if (!gfxm::intersect_frustum_aabb(query.fru, p->getBoundingBox())) {
-            continue;
-        }
-        //dbgDrawAabb(p->getBoundingBox(), 0xFFFFFFFF);
-        //dbgDrawSphere(p->getBoundingSphereOrigin(), .1f, 0xFFFF00FF);
-        //dbgDrawSphere(p->getBoundingSphereOrigin(), p->getBoundingRadius(), 0xFFFFFFFF);
-        p->submit(bucket);
-    }
 }
 
 void TerrainScene::makeSector(
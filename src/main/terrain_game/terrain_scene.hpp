@@ -2,6 +2,7 @@
 
 #include "scene/scene.hpp"
 #include "world/common_systems/scene_system.hpp"
+#include "world/common_systems/bvh_visibility_provider.hpp"
 #include "world/common_systems/player_start_system.hpp"
 #include "collision/phy.hpp"
 #include "gpu/gpu.hpp"
@@ -50,13 +51,15 @@ class TerrainScene : public IScene, public IVisibilityProvider {
     RHSHARED<SkeletalModelInstance> model_instance;
     // TESTING
 
-    std::set<SceneProxy*> proxies;
+    // Sectors are culled here, everything else goes through the stock tree
+    BvhVisibilityProvider proxy_bvh;
 
     void makeSector(
         Sector& sector, ktImage& img,
         const gfxm::vec2& size, const gfxm::vec2& offset,
         const gfxm::vec2& img_min, const gfxm::vec2& img_max
     );
+    void collectSectors(const VisibilityQuery& query, gpuRenderBucket* bucket);
 
 public:
     void onSpawnScene(IWorld& world) override;
@@ -66,6 +69,7 @@ public:
     void onRemoveProxy(VisibilityProxyItem*) override;
     void updateProxies(VisibilityProxyItem* items, int count) override;
     void collectVisible(const VisibilityQuery& query, gpuRenderBucket* bucket) override;
+    void collectVisibleMulti(const VisibilityQuery* queries, gpuRenderBucket* const* buckets, int count) override;
 
     bool load(const std::string& path) override;
 };